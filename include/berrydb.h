@@ -8,8 +8,11 @@
 namespace berrydb {}  // namespace berrydb
 
 #include "berrydb/catalog.h"
+#include "berrydb/cursor.h"
 #include "berrydb/options.h"
+#include "berrydb/pinned_value.h"
 #include "berrydb/pool.h"
+#include "berrydb/read_transaction.h"
 #include "berrydb/space.h"
 #include "berrydb/span.h"
 #include "berrydb/status.h"
@@ -18,5 +21,6 @@ namespace berrydb {}  // namespace berrydb
 #include "berrydb/types.h"
 #include "berrydb/version.h"
 #include "berrydb/vfs.h"
+#include "berrydb/write_batch.h"
 
 #endif  // BERRYDB_INCLUDE_BERRYDB_H_
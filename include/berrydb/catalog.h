@@ -24,6 +24,7 @@ enum class Status : int;
  * is responsible for avoiding data races.
  */
 class Catalog {
+ public:
   /** Opens a catalog listed in this catalog.
    *
    * No other change operation (Create* / Delete*) may be issued concurrently
@@ -0,0 +1,109 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_INCLUDE_BERRYDB_CURSOR_H_
+#define BERRYDB_INCLUDE_BERRYDB_CURSOR_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+
+namespace berrydb {
+
+enum class Status : int;
+
+/**
+ * Iterates over the keys in a space, in key order.
+ *
+ * Cursors are created by ReadTransaction::CreateCursor(), and see the same
+ * snapshot of the store as their transaction. A cursor is either positioned at
+ * a key in the space, or is invalid. New cursors are invalid, and must be
+ * positioned by one of the Seek methods.
+ *
+ * Scanning a large range of keys is efficient. The cursor reads the pages that
+ * hold the upcoming keys ahead of time, in batches. Once a scan covers many
+ * pages, the pages that were already visited are the first to be evicted from
+ * the page pool, so scans don't push out the data cached for other operations.
+ *
+ * Cursors must be released before their transaction is released.
+ */
+class Cursor {
+ public:
+  /** Positions the cursor at the first key that is at least the given key.
+   *
+   * @return kAlreadyClosed if the store was closed; kNotSupported if the
+   *         space is hashed, integer-keyed or write-buffered; otherwise, most
+   *         likely kSuccess or kIoError; if no key qualifies, the cursor
+   *         becomes invalid and the result is kSuccess */
+  Status Seek(span<const uint8_t> key);
+
+  /** Positions the cursor at the space's first key.
+   *
+   * @return kAlreadyClosed if the store was closed; kNotSupported if the
+   *         space is hashed, integer-keyed or write-buffered; otherwise, most
+   *         likely kSuccess or kIoError; if the space is empty, the cursor
+   *         becomes invalid and the result is kSuccess */
+  Status SeekToFirst();
+
+  /** Positions the cursor at the space's last key.
+   *
+   * @return kAlreadyClosed if the store was closed; kNotSupported if the
+   *         space is hashed, integer-keyed or write-buffered; otherwise, most
+   *         likely kSuccess or kIoError; if the space is empty, the cursor
+   *         becomes invalid and the result is kSuccess */
+  Status SeekToLast();
+
+  /** Advances the cursor to the next key.
+   *
+   * @return kNotFound if the cursor is invalid; kAlreadyClosed if the store was
+   *         closed; otherwise, most likely kSuccess or kIoError; if the cursor
+   *         was at the space's last key, it becomes invalid and the result is
+   *         kSuccess */
+  Status Next();
+
+  /** Moves the cursor to the previous key.
+   *
+   * @return kNotFound if the cursor is invalid; kAlreadyClosed if the store was
+   *         closed; otherwise, most likely kSuccess or kIoError; if the cursor
+   *         was at the space's first key, it becomes invalid and the result is
+   *         kSuccess */
+  Status Prev();
+
+  /** True if the cursor is positioned at a key.
+   *
+   * Cursors become invalid when they move past the space's ends, and when an
+   * operation fails. */
+  bool Valid() const noexcept;
+
+  /** The key that the cursor is positioned at.
+   *
+   * The cursor must be valid. The key is valid until the cursor moves, or until
+   * the cursor is released. */
+  span<const uint8_t> key() const noexcept;
+
+  /** Reads the value of the key that the cursor is positioned at.
+   *
+   * @return status kNotFound if the cursor is invalid; kAlreadyClosed if the
+   *                store was closed; otherwise, most likely kSuccess or
+   *                kIoError
+   * @return value  the key's value; valid until the next Value() call, until
+   *                the cursor moves, or until the cursor is released */
+  std::tuple<Status, span<const uint8_t>> Value();
+
+  /** Releases the cursor's resources. */
+  void Release();
+
+ private:
+  friend class CursorImpl;
+
+  /** Use ReadTransaction::CreateCursor() to create Cursor instances. */
+  constexpr Cursor() noexcept = default;
+  /** Use Release() to destroy Cursor instances. */
+  ~Cursor() noexcept = default;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_INCLUDE_BERRYDB_CURSOR_H_
@@ -52,10 +52,167 @@ struct StoreOptions {
    * If this option is true, create_if_missing must also be true. */
   bool error_if_exists;
 
+  /** Number of threads used to replay the store's log when it is opened.
+   *
+   * Recovery spreads the work of applying logged pages across this many
+   * threads. 0 means one thread per hardware thread. */
+  size_t recovery_thread_count;
+
+  /** If true, committed transactions may be lost if the process crashes.
+   *
+   * By default, Transaction::Commit() returns after the transaction's log
+   * records are synced to persistent storage. When this option is true, commits
+   * return as soon as the records are buffered in memory, and the log is synced
+   * by a background thread, according to log_sync_interval_ms and
+   * log_sync_byte_threshold. Store::SyncLog() can be used to make all the
+   * transactions committed so far durable.
+   *
+   * A crash can lose the transactions committed after the last sync. The store
+   * remains consistent, because transactions are either recovered fully or not
+   * at all.
+   */
+  bool relaxed_durability;
+
+  /** How often the log is synced when relaxed_durability is true.
+   *
+   * This bounds the amount of time worth of commits that can be lost in a
+   * crash. Must be positive. */
+  size_t log_sync_interval_ms;
+
+  /** Buffered log bytes that trigger a sync when relaxed_durability is true.
+   *
+   * This bounds the memory used by log records waiting to be synced. 0 means
+   * that the log is only synced periodically. */
+  size_t log_sync_byte_threshold;
+
+  /** If true, page images are compressed before they are written to the log.
+   *
+   * Every commit logs the full content of the pages it modified. Compressing
+   * the content trades CPU time for less log I/O, which pays off when pages
+   * hold compressible values, such as text. Pages are compressed individually,
+   * and logged uncompressed if they don't shrink. Pages are not compressed in
+   * the page pool, nor in the store's data file, which stores each page at an
+   * offset derived from its ID, so smaller pages would not save any space.
+   *
+   * Compression requires a BerryDB build that has a compressor, such as
+   * snappy. Opening a store with this option fails with Status::kNotSupported
+   * otherwise. Stores whose logs hold compressed pages can only be recovered by
+   * builds that have the same compressor.
+   */
+  bool compress_log;
+
+  /** Log size that triggers a checkpoint, in bytes.
+   *
+   * Committed changes stay in the page pool, and only reach the store's data
+   * file when their pages are evicted, or when the store is checkpointed. A
+   * checkpoint writes all the pages holding committed changes, and lets the log
+   * be reused from the beginning. Checkpoints happen when the store is closed,
+   * and after a commit grows the log past this size, as long as no other
+   * transaction is running. Larger values let more updates to frequently used
+   * pages be absorbed in memory, at the cost of a larger log file and longer
+   * recovery times. 0 means that checkpoints only happen when the store is
+   * closed. */
+  size_t checkpoint_log_size;
+
+  /** The longest time a transaction waits for a lock held by another one.
+   *
+   * Transactions lock the spaces they read and write until they commit or roll
+   * back. Waits that would deadlock fail right away with Status::kDeadlock.
+   * Waits that time out fail with Status::kAlreadyLocked. 0 (the default)
+   * means that transactions never wait for locks.
+   *
+   * A store's transactions are used from one thread at a time, so a lock can't
+   * be released while a transaction waits for it. Waits for locks acquired on
+   * the waiting thread fail right away, regardless of this timeout. */
+  size_t lock_timeout_ms;
+
   /** Defaults. */
   StoreOptions();
 };
 
+/** Options used to create a transaction. */
+struct TransactionOptions {
+  /** If true, the transaction uses optimistic concurrency control.
+   *
+   * Optimistic transactions don't lock the spaces they access. Instead, they
+   * remember the data they read, and keep their changes private until they
+   * commit. Transaction::Commit() checks that the data read by the transaction
+   * was not modified by another transaction that committed in the meantime. If
+   * it was, the transaction is rolled back, and Commit() returns
+   * Status::kConflict. This is cheaper than locking when transactions rarely
+   * access the same data. */
+  bool optimistic;
+
+  /** Defaults. */
+  TransactionOptions();
+};
+
+/** Options used to create a space. */
+struct SpaceOptions {
+  /** If true, the space's keys are stored in a hash table.
+   *
+   * Looking up a key in a hashed space reads the same number of pages, no
+   * matter how many keys the space holds, while B+tree lookups read more pages
+   * as the tree grows. However, hashed spaces don't keep their keys in order,
+   * so they can't be scanned by cursors, and they can't be bulk-loaded. Hashed
+   * spaces are a good fit for data that is only accessed by key. */
+  bool hashed;
+
+  /** If not zero, the space's keys are unsigned integers of this many bytes.
+   *
+   * The supported sizes are 4 and 8. Keys are passed as big-endian byte
+   * strings of exactly this size, so they sort in numerical order, and other
+   * key sizes are rejected with Status::kNotSupported. The space's B+tree
+   * stores its keys in packed integer arrays instead of variable-sized entries,
+   * so it has a higher fanout and faster lookups than a regular space. Like
+   * hashed spaces, integer-keyed spaces can't be scanned by cursors, and can't
+   * be bulk-loaded. This option can't be combined with hashed. */
+  size_t integer_key_size;
+
+  /** If not zero, the space gets a Bloom filter sized for this many keys.
+   *
+   * Get() and ReadValue() test the filter before searching the space's B+tree,
+   * so most lookups for keys that don't exist read a single filter page. The
+   * filter uses 10 bits per key, and has a false positive rate of about 1% if
+   * the space holds no more keys than this number. Writes that create keys
+   * also update the filter. Deleted keys stay in the filter until it is rebuilt
+   * with Transaction::RebuildFilter(). Writes from optimistic transactions can
+   * conflict when they update the same filter page. This option can't be
+   * combined with hashed or integer_key_size. */
+  size_t bloom_filter_key_count;
+
+  /** If not zero, values of at least this many bytes go to a value log.
+   *
+   * The space's B+tree leaves only hold small references to these values, so
+   * the tree stays compact, and lookups and scans that don't need the values
+   * touch fewer pages. Logged values are appended to the log, so overwriting or
+   * deleting them leaves garbage behind, which is reclaimed by
+   * Transaction::CompactValueLog(). Values that don't fit in a store page are
+   * still stored in separate pages, and bulk-loaded values are not logged.
+   * Writes of logged values from optimistic transactions conflict, because
+   * they append to the same log page. The threshold can't exceed 65535, and
+   * this option can't be combined with hashed or integer_key_size. */
+  size_t value_log_threshold;
+
+  /** If true, the space's B+tree buffers writes in its inner nodes.
+   *
+   * Put() and Delete() add a message to a buffer in the tree's root, and the
+   * messages are moved towards the leaves in batches, as the buffers fill up.
+   * So random writes modify fewer leaf pages than in a regular space, while
+   * lookups still read one page per tree level. The savings are largest for
+   * small values, because each buffer holds more of them. Deleting a key
+   * doesn't look it up. Buffered spaces accept smaller keys than regular
+   * spaces, because their inner nodes only use an eighth of a page, or 512
+   * bytes, whichever is larger. Like hashed spaces, buffered spaces can't be
+   * scanned by cursors, and can't be bulk-loaded. All writes from optimistic
+   * transactions conflict, because they modify the root page. This option
+   * can't be combined with the options above. */
+  bool write_buffered;
+
+  /** Defaults. */
+  SpaceOptions();
+};
+
 }  // namespace berrydb
 
 #endif  // BERRYDB_INCLUDE_BERRYDB_OPTIONS_H_
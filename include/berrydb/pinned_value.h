@@ -0,0 +1,111 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_INCLUDE_BERRYDB_PINNED_VALUE_H_
+#define BERRYDB_INCLUDE_BERRYDB_PINNED_VALUE_H_
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+
+namespace berrydb {
+
+class Page;
+class PagePool;
+class ReadTransactionImpl;
+
+/** A value read from a store, exposed without being copied.
+ *
+ * Transaction::Get() and ReadTransaction::Get() can fill a PinnedValue instead
+ * of copying the value into a transaction-owned buffer. Values stored in a
+ * single page are exposed in place, and the handle keeps the page pinned in the
+ * pool, so the page can't be evicted while the value is in use. Values that
+ * span multiple pages are copied into a buffer owned by the handle. The buffer
+ * is reused by later reads into the same handle, so reading many large values
+ * through one handle doesn't allocate memory for every read.
+ *
+ * Pinned pages can't be evicted, so handles should be released soon after the
+ * value is consumed. A handle is released when it goes out of scope, when
+ * Release() is called, or when it is reused by another read. Handles must be
+ * released before the transaction that filled them is closed or released.
+ *
+ * A value read by a Transaction is valid until the transaction modifies the
+ * value's space. A value read by a ReadTransaction is always valid, but data()
+ * must be called again after other transactions write to the value's space,
+ * because writers save the content seen by readers before changing a page.
+ */
+class PinnedValue {
+ public:
+  /** Creates an empty handle. */
+  constexpr PinnedValue() noexcept = default;
+  inline ~PinnedValue() noexcept { Release(); }
+
+  PinnedValue(const PinnedValue&) = delete;
+  PinnedValue& operator=(const PinnedValue&) = delete;
+  PinnedValue(PinnedValue&& other) noexcept;
+  PinnedValue& operator=(PinnedValue&& other) noexcept;
+
+  /** The value's bytes. Empty if the handle doesn't hold a value. */
+  span<const uint8_t> data() const noexcept;
+
+  /** The value's size, in bytes. */
+  inline constexpr size_t size() const noexcept { return size_; }
+
+  /** Drops the page pin held by the handle, and frees its buffer. */
+  void Release() noexcept;
+
+ private:
+  friend class BTree;
+  friend class SpaceImpl;
+
+  /** Drops the page pin held by the handle, keeping its buffer for reuse. */
+  void Reset() noexcept;
+
+  /** Exposes a value stored in a page pool entry.
+   *
+   * @param page      the pool page holding the value; the caller's pin on the
+   *                  page is passed to the handle
+   * @param page_pool the pool that the page belongs to
+   * @param value     the value's bytes, inside the page's data
+   * @param reader    if not null, the read transaction whose snapshot the value
+   *                  belongs to
+   */
+  void Pin(Page* page, PagePool* page_pool, span<const uint8_t> value,
+           ReadTransactionImpl* reader) noexcept;
+
+  /** Exposes a value that stays unchanged while the handle is used.
+   *
+   * This is used for values stored in the page versions seen by a read
+   * transaction, which are kept until the transaction is released. */
+  void Point(span<const uint8_t> value) noexcept;
+
+  /** Makes room for a copy of a value in the handle's buffer.
+   *
+   * @param  size the value's size
+   * @return      the buffer that must receive the value's bytes
+   */
+  span<uint8_t> AllocateCopy(size_t size);
+
+  /** The pinned pool page holding the value. Null if the handle has no pin. */
+  Page* page_ = nullptr;
+  /** The pool that page_ belongs to. */
+  PagePool* page_pool_ = nullptr;
+  /** The read transaction that read the value in page_, if any. */
+  ReadTransactionImpl* reader_ = nullptr;
+  /** The value's offset in its page, used to find the value in page versions. */
+  size_t page_offset_ = 0;
+
+  /** The value's bytes, when they don't need to be looked up again. */
+  const uint8_t* data_ = nullptr;
+  /** See size(). */
+  size_t size_ = 0;
+
+  /** Holds copies of values that aren't stored in a single page. */
+  uint8_t* buffer_ = nullptr;
+  /** The size of the memory block at buffer_. */
+  size_t buffer_capacity_ = 0;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_INCLUDE_BERRYDB_PINNED_VALUE_H_
@@ -0,0 +1,98 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_INCLUDE_BERRYDB_READ_TRANSACTION_H_
+#define BERRYDB_INCLUDE_BERRYDB_READ_TRANSACTION_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+
+namespace berrydb {
+
+class Cursor;
+class PinnedValue;
+class Space;
+enum class Status : int;
+
+/**
+ * A unit of database operations that only reads data.
+ *
+ * Read transactions are much cheaper than Transaction instances, because they
+ * don't keep track of the pages they use, and never need to be rolled back.
+ *
+ * A read transaction sees a consistent snapshot of the store, which includes
+ * the transactions committed before the read transaction was created. Unlike
+ * Transaction instances, read transactions may overlap with transactions that
+ * write to the catalogs and spaces that they read from. Writers never wait for
+ * readers. Instead, the store keeps the old versions of the modified data
+ * around, until the read transactions that can see them are released. So,
+ * long-lived read transactions increase the store's memory usage.
+ *
+ * Closing the store causes future reads to fail, but the transactions must
+ * still be released before the store is released.
+ */
+class ReadTransaction {
+ public:
+  /** Reads a store key.
+   *
+   * @return status kAlreadyClosed if the store was closed; kNotFound if the
+   *                key does not exist; otherwise, most likely kSuccess or
+   *                kIoError
+   * @return value  the key's value; valid until the next Get() call on this
+   *                transaction, or until the transaction is released */
+  std::tuple<Status, span<const uint8_t>> Get(Space* space,
+                                              span<const uint8_t> key);
+
+  /** Reads a store key without copying its value, if possible.
+   *
+   * See PinnedValue for the lifetime of the value. The handle must be released
+   * before the transaction is released.
+   *
+   * @param  value receives the key's value; any value that it held before is
+   *               released
+   * @return       kAlreadyClosed if the store was closed; kNotFound if the key
+   *               does not exist; otherwise, most likely kSuccess or kIoError */
+  Status Get(Space* space, span<const uint8_t> key, PinnedValue* value);
+
+  /** Reads a range of a store key's value, without reading the entire value.
+   *
+   * Large values can be read in chunks, so they don't need to fit in memory.
+   *
+   * @param  offset     the position of the first value byte to be read
+   * @param  buffer     receives the value bytes; if the value ends before the
+   *                    buffer is full, the rest of the buffer is not modified
+   * @return status     kAlreadyClosed if the store was closed; kNotFound if the
+   *                    key does not exist; otherwise, most likely kSuccess or
+   *                    kIoError
+   * @return value_size the size of the key's entire value */
+  std::tuple<Status, size_t> ReadValue(Space* space, span<const uint8_t> key,
+                                       size_t offset, span<uint8_t> buffer);
+
+  /** Creates a cursor that iterates over a space's keys.
+   *
+   * The cursor sees this transaction's snapshot, and must be released before
+   * the transaction is released. Cursors created for hashed, integer-keyed or
+   * write-buffered spaces can't be positioned; their Seek methods return
+   * kNotSupported. */
+  Cursor* CreateCursor(Space* space);
+
+  /** Ends the transaction and releases its memory.
+   *
+   * The transaction's cursors must be released before it. */
+  void Release();
+
+ private:
+  friend class ReadTransactionImpl;
+
+  /** Use Store::CreateReadTransaction() to create ReadTransaction instances. */
+  constexpr ReadTransaction() noexcept = default;
+  /** Use Release() to destroy ReadTransaction instances. */
+  ~ReadTransaction() noexcept = default;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_INCLUDE_BERRYDB_READ_TRANSACTION_H_
@@ -30,6 +30,7 @@ class Transaction;
  * it is considered to be using the space until it commits or it is rolled back.
  */
 class Space {
+ public:
   /** Releases the memory associated with the space.
    *
    * This must not be called during a transaction operation, such
@@ -44,6 +44,27 @@ enum class Status : int {
   // a 32-bit CPU.
   kDatabaseTooLarge = 8,
 
+  // The transaction would deadlock waiting for a lock held by another
+  // transaction.
+  //
+  // The transaction should be rolled back, and may be retried.
+  kDeadlock = 9,
+
+  // An optimistic transaction read data that was modified by a transaction that
+  // committed after the read.
+  //
+  // The transaction was rolled back, and may be retried.
+  kConflict = 10,
+
+  // The key or value is too large to be stored.
+  kTooLarge = 11,
+
+  // The operation is not supported by the space's type, or by this build.
+  //
+  // For example, hashed spaces can't be scanned by cursors, and compressed logs
+  // require a build with a compressor.
+  kNotSupported = 12,
+
   // Valid values are in [kSuccess, kFirstInvalidValue).
   kFirstInvalidValue,  // This must remain at the end of the enum's block.
 };
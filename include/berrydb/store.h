@@ -12,7 +12,9 @@ namespace berrydb {
 enum class Status : int;
 
 class Catalog;
+class ReadTransaction;
 class Transaction;
+struct TransactionOptions;
 
 /**
  * An autonomous unit of storage, holding a tree of key-value stores.
@@ -58,12 +60,31 @@ class Store {
   /** Starts a transaction against this store. */
   Transaction* CreateTransaction();
 
+  /** Starts a transaction against this store, with non-default options. */
+  Transaction* CreateTransaction(const TransactionOptions& options);
+
+  /** Starts a transaction that can only read from this store.
+   *
+   * Read transactions are cheaper than general-purpose transactions. The
+   * returned transaction must be released before the store is released. */
+  ReadTransaction* CreateReadTransaction();
+
   /** Obtains the root catalog for this store.
    *
    * The root catalog is implicitly released when the Store is released, and
    * Release() should never be called on it explicitly. */
   Catalog* RootCatalog();
 
+  /** Makes all the transactions committed so far durable.
+   *
+   * This is only useful for stores opened with the relaxed_durability option.
+   * Otherwise, transactions are durable by the time their commits return.
+   *
+   * @return most likely kSuccess or kIoError; kAlreadyClosed if the store was
+   *         closed
+   */
+  Status SyncLog();
+
   /** Closes the store. */
   Status Close();
 
@@ -13,38 +13,252 @@
 namespace berrydb {
 
 class Catalog;
+class PinnedValue;
 class Space;
+struct SpaceOptions;
+class WriteBatch;
 enum class Status : int;
 
+/** Called by Transaction::CommitAsync() when the transaction is durable.
+ *
+ * @param status  kSuccess if the transaction is durable; otherwise, the error
+ *                that stopped the store's log from being synced, in which case
+ *                the transaction may be lost if the process crashes
+ * @param context the value passed to Transaction::CommitAsync()
+ */
+using CommitCallback = void (*)(Status status, void* context);
+
+/** Supplies the key/value pairs written by Transaction::BulkLoad().
+ *
+ * @param  context the value passed to Transaction::BulkLoad()
+ * @param  key     receives the next key; keys must be produced in strictly
+ *                 increasing lexicographic order
+ * @param  value   receives the next key's value
+ * @return         false if there are no more key/value pairs; the key and
+ *                 value are ignored in that case
+ *
+ * The key and value must remain valid until the next call.
+ */
+using BulkLoadSource = bool (*)(void* context, span<const uint8_t>* key,
+                                span<const uint8_t>* value);
+
 /**
  * An atomic and durable (once committed) unit of database operations.
  *
- * Transactions should use an external synchronization mechanism to avoid
- * read-write conflicts. Specifically, if a transaction writes to a catalog or
- * to a (key-value name)space, its lifetime must not overlap with the lifetime
- * of any other transaction that either reads from or writes to the same catalog
- * or space.
+ * A store's transactions are not thread-safe. Their lifetimes may overlap, but
+ * they must all be used from one thread at a time.
+ *
+ * Pessimistic transactions lock the spaces they access until they are
+ * committed or rolled back, because a space's keys share pages. Methods that
+ * read a space lock it in shared mode, and methods that modify a space or a
+ * catalog lock it in exclusive mode. So a transaction that writes to a space
+ * excludes all the other transactions that read or write the space, even if
+ * they access different keys. Methods fail with Status::kDeadlock or
+ * Status::kAlreadyLocked when a lock cannot be acquired. The transaction should
+ * then be rolled back, and may be retried. See StoreOptions::lock_timeout_ms.
+ *
+ * Cursors and Catalog::OpenSpace() don't take locks. So a transaction must not
+ * scan a space while another transaction writes to it, and a catalog's spaces
+ * must not be opened while another transaction modifies the catalog.
  */
 class Transaction {
  public:
-  /** Reads a store key. Sees Put()s and Delete()s made by this transaction. */
+  /** Reads a store key. Sees Put()s and Delete()s made by this transaction.
+   *
+   * @return status kNotFound if the key does not exist; otherwise, most likely
+   *                kSuccess or kIoError
+   * @return value  the key's value; valid until the next Get() call on this
+   *                transaction, or until the transaction is released */
   std::tuple<Status, span<const uint8_t>> Get(Space* space,
                                               span<const uint8_t> key);
 
-  /** Creates / updates a store key. Seen by Gets() made by this transaction. */
+  /** Reads a store key without copying its value, if possible.
+   *
+   * Sees Put()s and Delete()s made by this transaction. See PinnedValue for the
+   * lifetime of the value. The handle must be released before the transaction
+   * is committed or rolled back.
+   *
+   * @param  value receives the key's value; any value that it held before is
+   *               released
+   * @return       kNotFound if the key does not exist; otherwise, most likely
+   *               kSuccess or kIoError */
+  Status Get(Space* space, span<const uint8_t> key, PinnedValue* value);
+
+  /** Reads many store keys at once, without copying their values, if possible.
+   *
+   * This is faster than calling Get() for each key, because the keys' lookups
+   * share the pages that they read, and uncached pages with consecutive IDs
+   * are read together. Sees Put()s and Delete()s made by this transaction. See
+   * PinnedValue for the lifetime of the values.
+   *
+   * @param  keys     the keys to be read; may be in any order
+   * @param  statuses receives kSuccess or kNotFound for each key; must have the
+   *                  same size as keys
+   * @param  values   receives the value of each key that is found; must have
+   *                  the same size as keys; the values that the handles held
+   *                  before are released
+   * @return          kSuccess if all the keys were looked up; otherwise, most
+   *                  likely kIoError, and the statuses and values are
+   *                  unspecified */
+  Status MultiGet(Space* space, span<const span<const uint8_t>> keys,
+                  span<Status> statuses, span<PinnedValue> values);
+
+  /** Reads a range of a store key's value, without reading the entire value.
+   *
+   * Sees Put()s and Delete()s made by this transaction. Large values can be
+   * read in chunks, so they don't need to fit in memory.
+   *
+   * @param  offset     the position of the first value byte to be read
+   * @param  buffer     receives the value bytes; if the value ends before the
+   *                    buffer is full, the rest of the buffer is not modified
+   * @return status     kNotFound if the key does not exist; otherwise, most
+   *                    likely kSuccess or kIoError
+   * @return value_size the size of the key's entire value */
+  std::tuple<Status, size_t> ReadValue(Space* space, span<const uint8_t> key,
+                                       size_t offset, span<uint8_t> buffer);
+
+  /** Creates / updates a store key. Seen by Gets() made by this transaction.
+   *
+   * Values that don't fit in a store page are stored in dedicated pages.
+   *
+   * @return kTooLarge if the key doesn't fit in a store page; otherwise, most
+   *         likely kSuccess or kIoError */
   Status Put(Space* space, span<const uint8_t> key, span<const uint8_t> value);
 
-  /** Deletes a store key. Seen by Gets() made by this transaction. */
+  /** Creates / updates a store key, setting its value to a run of zeros.
+   *
+   * The value can then be written in chunks using WriteValue(), so large values
+   * don't need to fit in memory.
+   *
+   * @param  value_size the size of the key's new value
+   * @return            kTooLarge if the key doesn't fit in a store page;
+   *                    otherwise, most likely kSuccess or kIoError */
+  Status ReserveValue(Space* space, span<const uint8_t> key,
+                      size_t value_size);
+
+  /** Overwrites a range of a store key's value.
+   *
+   * This does not change the value's size. Use ReserveValue() to create a value
+   * that can be written in chunks.
+   *
+   * @param  offset the position of the first value byte to be written
+   * @param  data   the bytes to be written
+   * @return        kNotFound if the key does not exist; kTooLarge if the range
+   *                extends past the end of the value; otherwise, most likely
+   *                kSuccess or kIoError */
+  Status WriteValue(Space* space, span<const uint8_t> key, size_t offset,
+                    span<const uint8_t> data);
+
+  /** Deletes a store key. Seen by Gets() made by this transaction.
+   *
+   * Deleting a key that does not exist succeeds. */
   Status Delete(Space* space, span<const uint8_t> key);
 
+  /** Applies the Put()s and Delete()s in a batch.
+   *
+   * The changes are seen by Gets() made by this transaction. If an operation
+   * fails, the batch may have been partially applied, so the transaction should
+   * be rolled back.
+   *
+   * @param batch not modified, so it can be reused afterwards
+   */
+  Status Write(WriteBatch* batch);
+
+  /** Fills an empty space with a large number of sorted key/value pairs.
+   *
+   * This is much faster than calling Put() for each pair. The space's B+tree is
+   * built bottom-up, and its pages are written straight to the store's data
+   * file using large sequential writes, bypassing the page pool and the log.
+   * Only the change to the tree's root is logged, so the loaded pairs become
+   * visible when the transaction commits. Values that don't fit in a store page
+   * are stored as they would be by Put(). If the space has a Bloom filter, the
+   * filter is rebuilt from the loaded keys.
+   *
+   * The pairs are not locked. Like other writes, a bulk load must not overlap
+   * with other transactions that use the space. If the transaction is rolled
+   * back, the pages written by the load are leaked.
+   *
+   * @param  source  called repeatedly to obtain the key/value pairs
+   * @param  context passed to the source
+   * @return         kAlreadyExists if the space is not empty, or if the source
+   *                 produces a key that is not larger than the previous key;
+   *                 kTooLarge if a key doesn't fit in a store page;
+   *                 kNotSupported if the space is hashed, integer-keyed or
+   *                 write-buffered; otherwise, most likely kSuccess or
+   *                 kIoError
+   */
+  Status BulkLoad(Space* space, BulkLoadSource source, void* context);
+
+  /** Rebuilds a space's Bloom filter from the keys currently in the space.
+   *
+   * Bloom filters only gain keys, so the filter of a space with many deleted
+   * keys answers more lookups for missing keys by searching the space's
+   * B+tree. Rebuilding the filter drops the deleted keys. The filter is sized
+   * when the space is created, so this does not help if the space holds more
+   * keys than SpaceOptions::bloom_filter_key_count.
+   *
+   * The keys are not locked. Like a bulk load, a rebuild must not overlap with
+   * other transactions that use the space.
+   *
+   * @return kNotSupported if the space was not created with
+   *         SpaceOptions::bloom_filter_key_count; otherwise, most likely
+   *         kSuccess or kIoError
+   */
+  Status RebuildFilter(Space* space);
+
+  /** Reclaims the space taken up by overwritten and deleted logged values.
+   *
+   * The values that are still live in the older segments of the space's value
+   * log are appended to the log again, and the emptied segments are reused by
+   * later appends. The log's newest segment is not compacted.
+   *
+   * The keys are not locked. Like a bulk load, compaction must not overlap
+   * with other transactions that use the space.
+   *
+   * @return kNotSupported if the space was not created with
+   *         SpaceOptions::value_log_threshold; otherwise, most likely kSuccess
+   *         or kIoError
+   */
+  Status CompactValueLog(Space* space);
+
   /**
    * Writes Put()s and Deletes() in this transaction to durable storage.
    *
+   * In stores opened with StoreOptions::relaxed_durability, this returns before
+   * the changes are durable. Store::SyncLog() can be used to wait for them.
+   *
+   * Optimistic transactions (see TransactionOptions::optimistic) are rolled
+   * back, and this returns Status::kConflict, if the data they read was
+   * modified by a transaction that committed in the meantime.
+   *
    * After this method is called, the transaction becomes invalid. No other
    * methods should be called.
    */
   Status Commit();
 
+  /**
+   * Like Commit(), but does not wait for the changes to become durable.
+   *
+   * This returns once the transaction is sequenced: its changes are logged and
+   * are visible to transactions that start afterwards. The callback runs when
+   * the log is synced past the transaction's records. This allows a thread to
+   * have many commits in flight, and have them share a single log sync.
+   *
+   * The log is synced by the next Commit() in a store that does not use relaxed
+   * durability, by Store::SyncLog(), by the background thread in a store that
+   * uses relaxed durability, or when the store is closed. The callback runs on
+   * the thread that syncs the log, and may run before this method returns. It
+   * should return quickly, and must not use the store.
+   *
+   * After this method is called, the transaction becomes invalid. No other
+   * methods should be called.
+   *
+   * @param callback only called if this returns kSuccess
+   * @param context  passed to the callback
+   * @return         the same values as Commit()
+   */
+  Status CommitAsync(CommitCallback callback, void* context);
+
   /**
    * Discards the Put()s and Deletes() in this transaction.
    *
@@ -65,6 +279,14 @@ class Transaction {
   std::tuple<Status, Space*> CreateSpace(Catalog* catalog,
                                          span<const uint8_t> name);
 
+  /** Creates a (key/value name)space, with non-default options.
+   *
+   * @return status kNotSupported if the options are not supported; otherwise,
+   *                see the overload without options */
+  std::tuple<Status, Space*> CreateSpace(Catalog* catalog,
+                                         span<const uint8_t> name,
+                                         const SpaceOptions& options);
+
   /** Creates a catalog.
    *
    * @param catalog  the parent of the newly created catalog
@@ -78,6 +300,11 @@ class Transaction {
                                              span<const uint8_t> name);
 
   /** Deletes a (key/value name)space and all its content, or a catalog.
+   *
+   * Deleting a catalog also deletes all the catalogs and spaces that it holds.
+   * Their pages are reused once the transaction commits, so the deleted
+   * objects must not be used by other transactions, and their handles must
+   * not be used after the deletion commits.
    *
    * @param catalog the catalog that stores the reference to the catalog or the
    *                (key/value name)space that will be deleted
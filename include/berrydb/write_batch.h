@@ -0,0 +1,61 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_INCLUDE_BERRYDB_WRITE_BATCH_H_
+#define BERRYDB_INCLUDE_BERRYDB_WRITE_BATCH_H_
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+
+namespace berrydb {
+
+class Space;
+
+/** A group of Put()s and Delete()s that are applied to a store together.
+ *
+ * Batches are applied by Transaction::Write(). The batch copies the keys and
+ * values passed to it, so the caller's buffers can be reused right away.
+ *
+ * Applying a batch is cheaper than issuing the same operations one by one. The
+ * operations are applied in key order, so operations on nearby keys share the
+ * work of finding their pages. Operations on the same key are applied in the
+ * order they were added to the batch, so the last one wins.
+ *
+ * A batch can be applied multiple times, and can be reused after Clear().
+ */
+class WriteBatch {
+ public:
+  /** Creates an empty batch. */
+  static WriteBatch* Create();
+
+  /** Adds an operation that creates or updates a store key. */
+  void Put(Space* space, span<const uint8_t> key, span<const uint8_t> value);
+
+  /** Adds an operation that deletes a store key. */
+  void Delete(Space* space, span<const uint8_t> key);
+
+  /** Removes all the operations from the batch, keeping its memory. */
+  void Clear();
+
+  /** The number of operations in the batch. */
+  size_t OperationCount() const;
+
+  /** The memory used by the batch's operations, in bytes. */
+  size_t ByteSize() const;
+
+  /** Releases the batch's memory. */
+  void Release();
+
+ private:
+  friend class WriteBatchImpl;
+
+  /** Use WriteBatch::Create() to create WriteBatch instances. */
+  constexpr WriteBatch() noexcept = default;
+  /** Use Release() to destroy WriteBatch instances. */
+  ~WriteBatch() noexcept = default;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_INCLUDE_BERRYDB_WRITE_BATCH_H_
@@ -20,6 +20,7 @@
 
 #include "./platform/alloc.h"
 #include "./platform/compiler.h"
+#include "./platform/compression.h"
 #include "./platform/dcheck.h"
 #include "./platform/endianness.h"
 #include "./platform/hashing.h"
@@ -0,0 +1,96 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_PLATFORM_COMPRESSION_H_
+#define BERRYDB_PLATFORM_COMPRESSION_H_
+
+// Embedders can replace the functions below to use a different compressor.
+// Stores whose logs were written with one compressor cannot be recovered with
+// another.
+
+#include "berrydb/platform/config.h"
+#include "berrydb/types.h"
+
+#if defined(BERRYDB_PLATFORM_BUILT_WITH_SNAPPY)
+#include <snappy.h>
+#endif  // defined(BERRYDB_PLATFORM_BUILT_WITH_SNAPPY)
+
+namespace berrydb {
+
+#if defined(BERRYDB_PLATFORM_BUILT_WITH_SNAPPY)
+
+/** True if the platform implements the compression functions below. */
+constexpr bool kPlatformHasCompression = true;
+
+/** The largest output that PlatformCompress() can produce.
+ *
+ * @param  input_size the size of the data to be compressed
+ * @return            the size of the buffer passed to PlatformCompress()
+ */
+inline size_t PlatformMaxCompressedSize(size_t input_size) noexcept {
+  return snappy::MaxCompressedLength(input_size);
+}
+
+/** Compresses a buffer.
+ *
+ * @param  input       the data to be compressed
+ * @param  input_size  the number of bytes to be compressed
+ * @param  output      receives the compressed data; must have room for
+ *                     PlatformMaxCompressedSize(input_size) bytes
+ * @return             the size of the compressed data
+ */
+inline size_t PlatformCompress(const uint8_t* input, size_t input_size,
+                               uint8_t* output) noexcept {
+  size_t output_size;
+  snappy::RawCompress(reinterpret_cast<const char*>(input), input_size,
+                      reinterpret_cast<char*>(output), &output_size);
+  return output_size;
+}
+
+/** Decompresses a buffer produced by PlatformCompress().
+ *
+ * @param  input       the compressed data
+ * @param  input_size  the size of the compressed data
+ * @param  output      receives the decompressed data
+ * @param  output_size the size of the data before it was compressed
+ * @return             false if the input is corrupted, or does not decompress
+ *                     to exactly output_size bytes
+ */
+inline bool PlatformDecompress(const uint8_t* input, size_t input_size,
+                               uint8_t* output, size_t output_size) noexcept {
+  const char* const compressed = reinterpret_cast<const char*>(input);
+  size_t decompressed_size;
+  if (!snappy::GetUncompressedLength(compressed, input_size,
+                                     &decompressed_size) ||
+      decompressed_size != output_size) {
+    return false;
+  }
+  return snappy::RawUncompress(compressed, input_size,
+                               reinterpret_cast<char*>(output));
+}
+
+#else  // !defined(BERRYDB_PLATFORM_BUILT_WITH_SNAPPY)
+
+constexpr bool kPlatformHasCompression = false;
+
+// The functions below are never called when kPlatformHasCompression is false.
+
+inline size_t PlatformMaxCompressedSize(size_t input_size) noexcept {
+  return input_size;
+}
+
+inline size_t PlatformCompress(const uint8_t*, size_t, uint8_t*) noexcept {
+  return 0;
+}
+
+inline bool PlatformDecompress(const uint8_t*, size_t, uint8_t*,
+                               size_t) noexcept {
+  return false;
+}
+
+#endif  // defined(BERRYDB_PLATFORM_BUILT_WITH_SNAPPY)
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_PLATFORM_COMPRESSION_H_
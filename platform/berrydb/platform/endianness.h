@@ -13,6 +13,54 @@
 
 namespace berrydb {
 
+/** Reads a 16-bit unsigned integer from an aligned buffer.
+ *
+ * All calls should go through LoadUint16. This should not be used directly.
+ *
+ * @param  from memory holding the integer; must be 2-byte-aligned
+ * @return      the integer stored at the given location
+ */
+inline uint16_t PlatformLoadUint16(const uint8_t* from) noexcept {
+  BUILTIN_ASSUME((reinterpret_cast<uintptr_t>(from) & 1) == 0);
+  return *(reinterpret_cast<const uint16_t*>(from));
+}
+
+/** Stores a 16-bit unsigned integer to an aligned buffer.
+ *
+ * All calls should go through StoreUint16. This should not be used directly.
+ *
+ * @param  value the value to be stored
+ * @param  to    memory that will receive the integer; must be 2-byte-aligned
+ */
+inline void PlatformStoreUint16(uint16_t value, uint8_t* to) noexcept {
+  BUILTIN_ASSUME((reinterpret_cast<uintptr_t>(to) & 1) == 0);
+  *(reinterpret_cast<uint16_t*>(to)) = value;
+}
+
+/** Reads a 32-bit unsigned integer from an aligned buffer.
+ *
+ * All calls should go through LoadUint32. This should not be used directly.
+ *
+ * @param  from memory holding the integer; must be 4-byte-aligned
+ * @return      the integer stored at the given location
+ */
+inline uint32_t PlatformLoadUint32(const uint8_t* from) noexcept {
+  BUILTIN_ASSUME((reinterpret_cast<uintptr_t>(from) & 3) == 0);
+  return *(reinterpret_cast<const uint32_t*>(from));
+}
+
+/** Stores a 32-bit unsigned integer to an aligned buffer.
+ *
+ * All calls should go through StoreUint32. This should not be used directly.
+ *
+ * @param  value the value to be stored
+ * @param  to    memory that will receive the integer; must be 4-byte-aligned
+ */
+inline void PlatformStoreUint32(uint32_t value, uint8_t* to) noexcept {
+  BUILTIN_ASSUME((reinterpret_cast<uintptr_t>(to) & 3) == 0);
+  *(reinterpret_cast<uint32_t*>(to)) = value;
+}
+
 /** Reads a 64-bit unsigned integer from an aligned buffer.
  *
  * All calls should go through LoadUint64. This should not be used directly.
@@ -43,6 +91,14 @@ inline void PlatformStoreUint64(uint64_t value, uint8_t* to) noexcept {
   *(reinterpret_cast<uint64_t*>(to)) = value;
 }
 
+/** True if PlatformLoadUint32() reads integers in the CPU's native format.
+ *
+ * BerryDB's vectorized searches read arrays of 32-bit integers directly from
+ * memory. Embedders who change the storage format above must set this to false,
+ * which makes BerryDB fall back to portable code.
+ */
+constexpr bool kPlatformUint32IsNative = true;
+
 }  // namespace berrydb
 
 #endif  // BERRYDB_PLATFORM_ENDIANNESS_H_
@@ -0,0 +1,48 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/cursor.h"
+
+#include "berrydb/status.h"
+#include "../cursor_impl.h"
+
+namespace berrydb {
+
+Status Cursor::Seek(span<const uint8_t> key) {
+  return CursorImpl::FromApi(this)->Seek(key);
+}
+
+Status Cursor::SeekToFirst() {
+  return CursorImpl::FromApi(this)->SeekToFirst();
+}
+
+Status Cursor::SeekToLast() {
+  return CursorImpl::FromApi(this)->SeekToLast();
+}
+
+Status Cursor::Next() {
+  return CursorImpl::FromApi(this)->Next();
+}
+
+Status Cursor::Prev() {
+  return CursorImpl::FromApi(this)->Prev();
+}
+
+bool Cursor::Valid() const noexcept {
+  return CursorImpl::FromApi(this)->Valid();
+}
+
+span<const uint8_t> Cursor::key() const noexcept {
+  return CursorImpl::FromApi(this)->key();
+}
+
+std::tuple<Status, span<const uint8_t>> Cursor::Value() {
+  return CursorImpl::FromApi(this)->Value();
+}
+
+void Cursor::Release() {
+  CursorImpl::FromApi(this)->Release();
+}
+
+}  // namespace berrydb
@@ -10,6 +10,16 @@ PoolOptions::PoolOptions()
     : page_shift(15), page_pool_size(256), vfs(nullptr) { }
 
 StoreOptions::StoreOptions()
-    : create_if_missing(true), error_if_exists(false) { }
+    : create_if_missing(true), error_if_exists(false),
+      recovery_thread_count(0), relaxed_durability(false),
+      log_sync_interval_ms(10), log_sync_byte_threshold(1 << 20),
+      compress_log(false), checkpoint_log_size(64 << 20),
+      lock_timeout_ms(0) { }
+
+TransactionOptions::TransactionOptions() : optimistic(false) { }
+
+SpaceOptions::SpaceOptions()
+    : hashed(false), integer_key_size(0), bloom_filter_key_count(0),
+      value_log_threshold(0), write_buffered(false) { }
 
 }  // namespace berrydb
@@ -0,0 +1,121 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/pinned_value.h"
+
+#include "berrydb/platform.h"
+#include "../page.h"
+#include "../page_pool.h"
+#include "../page_versions.h"
+#include "../read_transaction_impl.h"
+#include "../store_impl.h"
+#include "../util/checks.h"
+
+namespace berrydb {
+
+PinnedValue::PinnedValue(PinnedValue&& other) noexcept
+    : page_(other.page_), page_pool_(other.page_pool_),
+      reader_(other.reader_), page_offset_(other.page_offset_),
+      data_(other.data_), size_(other.size_), buffer_(other.buffer_),
+      buffer_capacity_(other.buffer_capacity_) {
+  other.page_ = nullptr;
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.buffer_ = nullptr;
+  other.buffer_capacity_ = 0;
+}
+
+PinnedValue& PinnedValue::operator=(PinnedValue&& other) noexcept {
+  if (this == &other)
+    return *this;
+  Release();
+
+  page_ = other.page_;
+  page_pool_ = other.page_pool_;
+  reader_ = other.reader_;
+  page_offset_ = other.page_offset_;
+  data_ = other.data_;
+  size_ = other.size_;
+  buffer_ = other.buffer_;
+  buffer_capacity_ = other.buffer_capacity_;
+
+  other.page_ = nullptr;
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.buffer_ = nullptr;
+  other.buffer_capacity_ = 0;
+  return *this;
+}
+
+span<const uint8_t> PinnedValue::data() const noexcept {
+  if (reader_ != nullptr) {
+    // A writer may have modified the page after the value was read, saving the
+    // content seen by the reader's snapshot as a version.
+    const span<const uint8_t> version_data =
+        reader_->store()->page_versions()->Find(page_->page_id(),
+                                                reader_->snapshot());
+    if (!version_data.empty())
+      return version_data.subspan(page_offset_, size_);
+  }
+  return span<const uint8_t>(data_, size_);
+}
+
+void PinnedValue::Release() noexcept {
+  Reset();
+  if (buffer_ != nullptr) {
+    Deallocate(buffer_, buffer_capacity_);
+    buffer_ = nullptr;
+    buffer_capacity_ = 0;
+  }
+}
+
+void PinnedValue::Reset() noexcept {
+  if (page_ != nullptr) {
+    page_pool_->UnpinStorePage(page_);
+    page_ = nullptr;
+  }
+  reader_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void PinnedValue::Pin(Page* page, PagePool* page_pool,
+                      span<const uint8_t> value,
+                      ReadTransactionImpl* reader) noexcept {
+  BERRYDB_ASSUME(page != nullptr);
+  BERRYDB_ASSUME(page_pool != nullptr);
+  BERRYDB_ASSUME(!page->IsUnpinned());
+  BERRYDB_ASSUME(page_ == nullptr);
+
+  page_ = page;
+  page_pool_ = page_pool;
+  reader_ = reader;
+  page_offset_ = static_cast<size_t>(
+      value.data() - page->data(page_pool->page_size()).data());
+  data_ = value.data();
+  size_ = value.size();
+}
+
+void PinnedValue::Point(span<const uint8_t> value) noexcept {
+  BERRYDB_ASSUME(page_ == nullptr);
+
+  data_ = value.data();
+  size_ = value.size();
+}
+
+span<uint8_t> PinnedValue::AllocateCopy(size_t size) {
+  BERRYDB_ASSUME(page_ == nullptr);
+
+  if (size > buffer_capacity_) {
+    if (buffer_ != nullptr)
+      Deallocate(buffer_, buffer_capacity_);
+    buffer_ = reinterpret_cast<uint8_t*>(Allocate(size));
+    buffer_capacity_ = size;
+  }
+  data_ = buffer_;
+  size_ = size;
+  return span<uint8_t>(buffer_, size);
+}
+
+}  // namespace berrydb
@@ -0,0 +1,268 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/pinned_value.h"
+
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "../page_pool.h"
+#include "../store_impl.h"
+#include "../test/space_helpers.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+class PinnedValueTest : public SpaceTest {
+ protected:
+  PinnedValueTest() : SpaceTest("test_pinned_value.berry") {}
+
+  void SetUp() override {
+    SpaceTest::SetUp();
+    OpenStore();
+  }
+
+  /** Writes a key and commits the write. */
+  void CommitPut(const std::string& key, const std::string& value) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan(key), StringSpan(value)));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  /** The number of pinned pages in the store's pool. */
+  size_t PinnedPages() {
+    return StoreImpl::FromApi(store_.get())->page_pool()->pinned_pages();
+  }
+};
+
+TEST_F(PinnedValueTest, EmptyHandle) {
+  PinnedValue value;
+  EXPECT_EQ(0U, value.size());
+  EXPECT_TRUE(value.data().empty());
+  value.Release();
+  EXPECT_TRUE(value.data().empty());
+}
+
+TEST_F(PinnedValueTest, TransactionGetPinsPage) {
+  CreateSpace("space");
+  CommitPut("key", "value");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  const size_t pinned_pages = PinnedPages();
+  {
+    PinnedValue value;
+    ASSERT_EQ(Status::kSuccess,
+              transaction->Get(space_.get(), StringSpan("key"), &value));
+    EXPECT_EQ("value", SpanString(value.data()));
+    EXPECT_EQ(5U, value.size());
+    EXPECT_EQ(pinned_pages + 1, PinnedPages());
+
+    EXPECT_EQ(Status::kNotFound,
+              transaction->Get(space_.get(), StringSpan("missing"), &value));
+    EXPECT_TRUE(value.data().empty());
+    EXPECT_EQ(pinned_pages, PinnedPages());
+
+    ASSERT_EQ(Status::kSuccess,
+              transaction->Get(space_.get(), StringSpan("key"), &value));
+    EXPECT_EQ(pinned_pages + 1, PinnedPages());
+  }
+  EXPECT_EQ(pinned_pages, PinnedPages());
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(PinnedValueTest, TransactionSeesOwnWrites) {
+  CreateSpace("space");
+  CommitPut("key", "old value");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("new value")));
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ("new value", SpanString(value.data()));
+  value.Release();
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(PinnedValueTest, ReleaseAndMove) {
+  CreateSpace("space");
+  CommitPut("key", "value");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  const size_t pinned_pages = PinnedPages();
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Get(space_.get(), StringSpan("key"), &value));
+
+  PinnedValue moved(std::move(value));
+  EXPECT_TRUE(value.data().empty());
+  EXPECT_EQ("value", SpanString(moved.data()));
+  EXPECT_EQ(pinned_pages + 1, PinnedPages());
+
+  PinnedValue assigned;
+  assigned = std::move(moved);
+  EXPECT_TRUE(moved.data().empty());
+  EXPECT_EQ("value", SpanString(assigned.data()));
+  EXPECT_EQ(pinned_pages + 1, PinnedPages());
+
+  assigned.Release();
+  EXPECT_TRUE(assigned.data().empty());
+  EXPECT_EQ(pinned_pages, PinnedPages());
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(PinnedValueTest, ReadTransactionSeesSnapshot) {
+  CreateSpace("space");
+  CommitPut("key", "old value");
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ("old value", SpanString(value.data()));
+
+  // The writer modifies the pinned page in place, after saving the version
+  // seen by the reader.
+  CommitPut("key", "new value");
+  EXPECT_EQ("old value", SpanString(value.data()));
+
+  // The page is now read from the saved version, which isn't pinned.
+  const size_t pinned_pages = PinnedPages();
+  PinnedValue version_value;
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("key"), &version_value));
+  EXPECT_EQ("old value", SpanString(version_value.data()));
+  EXPECT_EQ(pinned_pages, PinnedPages());
+
+  value.Release();
+  version_value.Release();
+  reader.reset();
+
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  ASSERT_EQ(Status::kSuccess,
+            new_reader->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ("new value", SpanString(value.data()));
+}
+
+TEST_F(PinnedValueTest, OverflowValuesReuseBuffer) {
+  CreateSpace("space");
+  const std::string large_value(20000, 'l');
+  const std::string larger_value(30000, 'L');
+  CommitPut("large", large_value);
+  CommitPut("larger", larger_value);
+  CommitPut("small", "s");
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  // Read transactions keep the last page that they read pinned.
+  ASSERT_EQ(Status::kSuccess,
+            std::get<0>(reader->Get(space_.get(), StringSpan("larger"))));
+  const size_t pinned_pages = PinnedPages();
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("larger"), &value));
+  EXPECT_EQ(larger_value, SpanString(value.data()));
+  EXPECT_EQ(pinned_pages, PinnedPages());
+  const uint8_t* buffer = value.data().data();
+
+  // The buffer is large enough for the next value, so it is reused.
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("large"), &value));
+  EXPECT_EQ(large_value, SpanString(value.data()));
+  EXPECT_EQ(buffer, value.data().data());
+
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("small"), &value));
+  EXPECT_EQ("s", SpanString(value.data()));
+  EXPECT_NE(buffer, value.data().data());
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Get(space_.get(), StringSpan("large"), &value));
+  EXPECT_EQ(large_value, SpanString(value.data()));
+  value.Release();
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(PinnedValueTest, LoggedValues) {
+  space_options_.value_log_threshold = 100;
+  CreateSpace("space");
+  const std::string logged_value(500, 'v');
+  CommitPut("key", logged_value);
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ(logged_value, SpanString(value.data()));
+}
+
+TEST_F(PinnedValueTest, BufferedSpace) {
+  space_options_.write_buffered = true;
+  CreateSpace("space");
+  CommitPut("key", "value");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ("value", SpanString(value.data()));
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(space_.get(),
+                                                  StringSpan("key")));
+  EXPECT_EQ(Status::kNotFound,
+            transaction->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(PinnedValueTest, HashedSpaceCopies) {
+  space_options_.hashed = true;
+  CreateSpace("space");
+  CommitPut("key", "value");
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  // Read transactions keep the last page that they read pinned.
+  ASSERT_EQ(Status::kSuccess,
+            std::get<0>(reader->Get(space_.get(), StringSpan("key"))));
+  const size_t pinned_pages = PinnedPages();
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            reader->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ("value", SpanString(value.data()));
+  EXPECT_EQ(pinned_pages, PinnedPages());
+  EXPECT_EQ(Status::kNotFound,
+            reader->Get(space_.get(), StringSpan("missing"), &value));
+}
+
+TEST_F(PinnedValueTest, OptimisticTransactionCopies) {
+  CreateSpace("space");
+  CommitPut("key", "value");
+
+  TransactionOptions options;
+  options.optimistic = true;
+  UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+  const size_t pinned_pages = PinnedPages();
+  PinnedValue value;
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Get(space_.get(), StringSpan("key"), &value));
+  EXPECT_EQ(pinned_pages, PinnedPages());
+
+  // The transaction's write doesn't change the copied value.
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("other")));
+  EXPECT_EQ("value", SpanString(value.data()));
+  value.Release();
+  EXPECT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+}  // namespace berrydb
@@ -0,0 +1,42 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/read_transaction.h"
+
+#include "berrydb/status.h"
+#include "../cursor_impl.h"
+#include "../read_transaction_impl.h"
+#include "../space_impl.h"
+
+namespace berrydb {
+
+std::tuple<Status, span<const uint8_t>> ReadTransaction::Get(
+    Space* space, span<const uint8_t> key) {
+  return ReadTransactionImpl::FromApi(this)->Get(SpaceImpl::FromApi(space),
+                                                 key);
+}
+
+Status ReadTransaction::Get(Space* space, span<const uint8_t> key,
+                            PinnedValue* value) {
+  return ReadTransactionImpl::FromApi(this)->Get(SpaceImpl::FromApi(space),
+                                                 key, value);
+}
+
+std::tuple<Status, size_t> ReadTransaction::ReadValue(
+    Space* space, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) {
+  return ReadTransactionImpl::FromApi(this)->ReadValue(
+      SpaceImpl::FromApi(space), key, offset, buffer);
+}
+
+Cursor* ReadTransaction::CreateCursor(Space* space) {
+  return ReadTransactionImpl::FromApi(this)->CreateCursor(
+      SpaceImpl::FromApi(space))->ToApi();
+}
+
+void ReadTransaction::Release() {
+  ReadTransactionImpl::FromApi(this)->Release();
+}
+
+}  // namespace berrydb
@@ -28,6 +28,14 @@ const char* StatusToCString(Status status) noexcept {
     return "Data Corrupted";
   case Status::kDatabaseTooLarge:
     return "Database Too Large";
+  case Status::kDeadlock:
+    return "Deadlock";
+  case Status::kConflict:
+    return "Conflict";
+  case Status::kTooLarge:
+    return "Too Large";
+  case Status::kNotSupported:
+    return "Not Supported";
   case Status::kFirstInvalidValue:
     // Needed to avoid a (very useful otherwise) compiler warning.
     break;
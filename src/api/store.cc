@@ -5,6 +5,7 @@
 #include "berrydb/store.h"
 
 #include "../catalog_impl.h"
+#include "../read_transaction_impl.h"
 #include "../store_impl.h"
 #include "../transaction_impl.h"
 
@@ -18,10 +19,22 @@ Transaction* Store::CreateTransaction() {
   return StoreImpl::FromApi(this)->CreateTransaction()->ToApi();
 }
 
+Transaction* Store::CreateTransaction(const TransactionOptions& options) {
+  return StoreImpl::FromApi(this)->CreateTransaction(options)->ToApi();
+}
+
+ReadTransaction* Store::CreateReadTransaction() {
+  return StoreImpl::FromApi(this)->CreateReadTransaction()->ToApi();
+}
+
 Catalog* Store::RootCatalog() {
   return StoreImpl::FromApi(this)->RootCatalog()->ToApi();
 }
 
+Status Store::SyncLog() {
+  return StoreImpl::FromApi(this)->SyncLog();
+}
+
 Status Store::Close() {
   return StoreImpl::FromApi(this)->Close();
 }
@@ -10,6 +10,7 @@
 
 #include "berrydb/options.h"
 #include "berrydb/pool.h"
+#include "berrydb/read_transaction.h"
 #include "berrydb/status.h"
 #include "berrydb/transaction.h"
 #include "berrydb/vfs.h"
@@ -100,4 +101,21 @@ TEST_F(StoreTest, CloseAbortsTransaction) {
   EXPECT_TRUE(transaction->IsClosed());
 }
 
+TEST_F(StoreTest, ReadTransactionAfterClose) {
+  Status status;
+  Store* raw_store;
+  StoreOptions options;
+  std::tie(status, raw_store) = pool_->OpenStore(kFileName, options);
+  ASSERT_EQ(Status::kSuccess, status);
+  UniquePtr<Store> store(raw_store);
+
+  UniquePtr<ReadTransaction> transaction(store->CreateReadTransaction());
+  ASSERT_NE(nullptr, transaction.get());
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+  uint8_t key[] = {'k', 'e', 'y'};
+  EXPECT_EQ(Status::kAlreadyClosed,
+            std::get<0>(transaction->Get(nullptr, make_span(key))));
+}
+
 }  // namespace berrydb
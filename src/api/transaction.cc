@@ -4,10 +4,12 @@
 
 #include "berrydb/transaction.h"
 
+#include "berrydb/options.h"
 #include "berrydb/status.h"
 #include "../catalog_impl.h"
 #include "../space_impl.h"
 #include "../transaction_impl.h"
+#include "../write_batch_impl.h"
 
 namespace berrydb {
 
@@ -16,20 +18,76 @@ std::tuple<Status, span<const uint8_t>> Transaction::Get(
   return TransactionImpl::FromApi(this)->Get(SpaceImpl::FromApi(space), key);
 }
 
+Status Transaction::Get(Space* space, span<const uint8_t> key,
+                        PinnedValue* value) {
+  return TransactionImpl::FromApi(this)->Get(SpaceImpl::FromApi(space), key,
+                                             value);
+}
+
+Status Transaction::MultiGet(Space* space,
+                             span<const span<const uint8_t>> keys,
+                             span<Status> statuses, span<PinnedValue> values) {
+  return TransactionImpl::FromApi(this)->MultiGet(SpaceImpl::FromApi(space),
+                                                  keys, statuses, values);
+}
+
+std::tuple<Status, size_t> Transaction::ReadValue(
+    Space* space, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) {
+  return TransactionImpl::FromApi(this)->ReadValue(SpaceImpl::FromApi(space),
+                                                   key, offset, buffer);
+}
+
 Status Transaction::Put(Space* space, span<const uint8_t> key,
                         span<const uint8_t> value) {
   return TransactionImpl::FromApi(this)->Put(SpaceImpl::FromApi(space), key,
                                              value);
 }
 
+Status Transaction::ReserveValue(Space* space, span<const uint8_t> key,
+                                 size_t value_size) {
+  return TransactionImpl::FromApi(this)->ReserveValue(
+      SpaceImpl::FromApi(space), key, value_size);
+}
+
+Status Transaction::WriteValue(Space* space, span<const uint8_t> key,
+                               size_t offset, span<const uint8_t> data) {
+  return TransactionImpl::FromApi(this)->WriteValue(
+      SpaceImpl::FromApi(space), key, offset, data);
+}
+
 Status Transaction::Delete(Space* space, span<const uint8_t> key) {
   return TransactionImpl::FromApi(this)->Delete(SpaceImpl::FromApi(space), key);
 }
 
+Status Transaction::Write(WriteBatch* batch) {
+  return TransactionImpl::FromApi(this)->Write(WriteBatchImpl::FromApi(batch));
+}
+
+Status Transaction::BulkLoad(Space* space, BulkLoadSource source,
+                             void* context) {
+  return TransactionImpl::FromApi(this)->BulkLoad(SpaceImpl::FromApi(space),
+                                                  source, context);
+}
+
+Status Transaction::RebuildFilter(Space* space) {
+  return TransactionImpl::FromApi(this)->RebuildFilter(
+      SpaceImpl::FromApi(space));
+}
+
+Status Transaction::CompactValueLog(Space* space) {
+  return TransactionImpl::FromApi(this)->CompactValueLog(
+      SpaceImpl::FromApi(space));
+}
+
 Status Transaction::Commit() {
   return TransactionImpl::FromApi(this)->Commit();
 }
 
+Status Transaction::CommitAsync(CommitCallback callback, void* context) {
+  return TransactionImpl::FromApi(this)->CommitAsync(callback, context);
+}
+
 Status Transaction::Rollback() {
   return TransactionImpl::FromApi(this)->Rollback();
 }
@@ -39,7 +97,16 @@ std::tuple<Status, Space*> Transaction::CreateSpace(
   Status status;
   SpaceImpl* space;
   std::tie(status, space) = TransactionImpl::FromApi(this)->CreateSpace(
-      CatalogImpl::FromApi(catalog), name);
+      CatalogImpl::FromApi(catalog), name, SpaceOptions());
+  return {status, space->ToApi()};
+}
+
+std::tuple<Status, Space*> Transaction::CreateSpace(
+    Catalog* catalog, span<const uint8_t> name, const SpaceOptions& options) {
+  Status status;
+  SpaceImpl* space;
+  std::tie(status, space) = TransactionImpl::FromApi(this)->CreateSpace(
+      CatalogImpl::FromApi(catalog), name, options);
   return {status, space->ToApi()};
 }
 
@@ -0,0 +1,42 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "berrydb/write_batch.h"
+
+#include "../space_impl.h"
+#include "../write_batch_impl.h"
+
+namespace berrydb {
+
+// static
+WriteBatch* WriteBatch::Create() {
+  return WriteBatchImpl::Create()->ToApi();
+}
+
+void WriteBatch::Put(Space* space, span<const uint8_t> key,
+                     span<const uint8_t> value) {
+  WriteBatchImpl::FromApi(this)->Put(SpaceImpl::FromApi(space), key, value);
+}
+
+void WriteBatch::Delete(Space* space, span<const uint8_t> key) {
+  WriteBatchImpl::FromApi(this)->Delete(SpaceImpl::FromApi(space), key);
+}
+
+void WriteBatch::Clear() {
+  WriteBatchImpl::FromApi(this)->Clear();
+}
+
+size_t WriteBatch::OperationCount() const {
+  return WriteBatchImpl::FromApi(this)->OperationCount();
+}
+
+size_t WriteBatch::ByteSize() const {
+  return WriteBatchImpl::FromApi(this)->ByteSize();
+}
+
+void WriteBatch::Release() {
+  WriteBatchImpl::FromApi(this)->Release();
+}
+
+}  // namespace berrydb
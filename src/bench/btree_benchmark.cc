@@ -0,0 +1,845 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "berrydb/catalog.h"
+#include "berrydb/cursor.h"
+#include "berrydb/options.h"
+#include "berrydb/pinned_value.h"
+#include "berrydb/pool.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "berrydb/vfs.h"
+#include "../log_writer.h"
+#include "../store_impl.h"
+#include "../test/file_deleter.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kKeySize = 16;
+constexpr size_t kValueSize = 100;
+constexpr size_t kMaxValueSize = 1024;
+constexpr size_t kBatchSize = 1000;
+constexpr size_t kSmallBatchSize = 10;
+constexpr size_t kBatchGetKeyCount = 100000;
+
+}  // namespace
+
+// The workloads below are mirrored in leveldb_benchmark.cc, so the results can
+// be compared directly.
+class BTreeBenchmark : public benchmark::Fixture {
+ public:
+  BTreeBenchmark()
+      : data_file_deleter_(kFileName),
+        log_file_deleter_(Store::LogFilePath(kFileName)) {}
+
+  void SetUp(MAYBE_UNUSED const benchmark::State& state) override {
+    PoolOptions options;
+    options.page_shift = 12;
+    // Large enough to cache all the pages of the trees built by benchmarks.
+    options.page_pool_size = 16384;
+    pool_ = Pool::Create(options);
+
+    Status status;
+    Store* raw_store;
+    std::tie(status, raw_store) = pool_->OpenStore(kFileName, StoreOptions());
+    if (status != Status::kSuccess)
+      return;
+    store_.reset(raw_store);
+
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    SpaceOptions space_options;
+    space_options.hashed = hashed_space_;
+    space_options.integer_key_size = integer_key_size_;
+    space_options.bloom_filter_key_count = bloom_filter_key_count_;
+    space_options.value_log_threshold = value_log_threshold_;
+    space_options.write_buffered = write_buffered_;
+    Space* raw_space;
+    std::tie(status, raw_space) = transaction->CreateSpace(
+        store_->RootCatalog(), span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>("space"), 5), space_options);
+    if (status != Status::kSuccess)
+      return;
+    space_.reset(raw_space);
+    if (transaction->Commit() != Status::kSuccess)
+      space_.reset();
+  }
+
+  void TearDown(MAYBE_UNUSED const benchmark::State& state) override {
+    space_.reset();
+    store_.reset();
+    pool_.reset();
+
+    // Each run must start with an empty store.
+    DefaultVfs()->RemoveFile(kFileName);
+    DefaultVfs()->RemoveFile(Store::LogFilePath(kFileName));
+  }
+
+ protected:
+  /** Fills a buffer with a random key of key_size_ bytes. */
+  void GenerateKey(uint8_t* key) {
+    for (size_t i = 0; i < key_size_; ++i)
+      key[i] = static_cast<uint8_t>('a' + rnd_() % 26);
+  }
+
+  /** Writes random keys, batched in transactions. Returns false on errors. */
+  bool PutRandomKeys(size_t key_count, std::vector<std::string>* keys) {
+    uint8_t key[kKeySize];
+    const span<const uint8_t> value(value_, value_size_);
+    for (size_t i = 0; i < key_count; i += kBatchSize) {
+      UniquePtr<Transaction> transaction(store_->CreateTransaction());
+      for (size_t j = i; j < i + kBatchSize && j < key_count; ++j) {
+        GenerateKey(key);
+        if (transaction->Put(space_.get(), span<const uint8_t>(key, key_size_),
+                             value) != Status::kSuccess) {
+          return false;
+        }
+        if (keys != nullptr)
+          keys->emplace_back(reinterpret_cast<const char*>(key), key_size_);
+      }
+      if (transaction->Commit() != Status::kSuccess)
+        return false;
+    }
+    return true;
+  }
+
+  /** Commits transactions that write kBatchSize random keys each. */
+  void RandomPut(benchmark::State& state) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+
+    for (auto _ : state) {
+      if (!PutRandomKeys(kBatchSize, nullptr)) {
+        state.SkipWithError("Transaction::Put failed.");
+        return;
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * kBatchSize);
+  }
+
+  /** Commits transactions that write kSmallBatchSize random keys each into a
+   * space that starts out with state.range(0) keys.
+   *
+   * Reports the number of log bytes written for each key, which is dominated
+   * by the images of the pages dirtied by the transactions. */
+  void SmallTransactionPut(benchmark::State& state) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+    if (!PutRandomKeys(static_cast<size_t>(state.range(0)), nullptr)) {
+      state.SkipWithError("Transaction::Put failed.");
+      return;
+    }
+
+    const LogWriter* const log_writer =
+        StoreImpl::FromApi(store_.get())->log_writer();
+    size_t log_bytes = 0;
+    for (auto _ : state) {
+      const size_t log_size = log_writer->log_size();
+      if (!PutRandomKeys(kSmallBatchSize, nullptr)) {
+        state.SkipWithError("Transaction::Put failed.");
+        return;
+      }
+      // Checkpoints reset the log, so the growth is measured from the reset.
+      const size_t new_log_size = log_writer->log_size();
+      log_bytes += (new_log_size >= log_size) ? new_log_size - log_size
+                                              : new_log_size;
+    }
+    const size_t put_count = state.iterations() * kSmallBatchSize;
+    state.SetItemsProcessed(put_count);
+    state.counters["log_bytes_per_put"] =
+        static_cast<double>(log_bytes) / static_cast<double>(put_count);
+  }
+
+  /** Reads random keys from a space that holds state.range(0) keys. */
+  void RandomGet(benchmark::State& state) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+    std::vector<std::string> keys;
+    if (!PutRandomKeys(static_cast<size_t>(state.range(0)), &keys)) {
+      state.SkipWithError("Transaction::Put failed.");
+      return;
+    }
+
+    UniquePtr<ReadTransaction> transaction(store_->CreateReadTransaction());
+    size_t key_index = 0;
+    for (auto _ : state) {
+      const std::string& key = keys[key_index];
+      key_index = (key_index + 7919) % keys.size();
+      Status status;
+      span<const uint8_t> value;
+      std::tie(status, value) = transaction->Get(
+          space_.get(), span<const uint8_t>(
+              reinterpret_cast<const uint8_t*>(key.data()), key.size()));
+      if (status != Status::kSuccess) {
+        state.SkipWithError("ReadTransaction::Get failed.");
+        return;
+      }
+      benchmark::DoNotOptimize(value.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+
+  /** Reads random keys into a PinnedValue, like RandomGet(). */
+  void PinnedGet(benchmark::State& state) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+    std::vector<std::string> keys;
+    if (!PutRandomKeys(static_cast<size_t>(state.range(0)), &keys)) {
+      state.SkipWithError("Transaction::Put failed.");
+      return;
+    }
+
+    UniquePtr<ReadTransaction> transaction(store_->CreateReadTransaction());
+    PinnedValue value;
+    size_t key_index = 0;
+    for (auto _ : state) {
+      const std::string& key = keys[key_index];
+      key_index = (key_index + 7919) % keys.size();
+      const Status status = transaction->Get(
+          space_.get(), span<const uint8_t>(
+              reinterpret_cast<const uint8_t*>(key.data()), key.size()),
+          &value);
+      if (status != Status::kSuccess) {
+        state.SkipWithError("ReadTransaction::Get failed.");
+        return;
+      }
+      benchmark::DoNotOptimize(value.data().data());
+    }
+    value.Release();
+    state.SetItemsProcessed(state.iterations());
+  }
+
+  /** Reads batches of state.range(0) random keys in transactions.
+   *
+   * The space holds kBatchGetKeyCount keys. If state.range(1) is not zero, the
+   * store is reopened before each batch, so the batch reads uncached pages.
+   *
+   * @param multi_get if true, each batch is read by a MultiGet() call;
+   *                  otherwise, each key is read by a Get() call
+   */
+  void BatchGet(benchmark::State& state, bool multi_get) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+    std::vector<std::string> keys;
+    if (!PutRandomKeys(kBatchGetKeyCount, &keys)) {
+      state.SkipWithError("Transaction::Put failed.");
+      return;
+    }
+
+    const size_t batch_size = static_cast<size_t>(state.range(0));
+    const bool cold = state.range(1) != 0;
+    std::vector<span<const uint8_t>> batch(batch_size);
+    std::vector<Status> statuses(batch_size);
+    std::vector<PinnedValue> values(batch_size);
+    for (auto _ : state) {
+      state.PauseTiming();
+      for (span<const uint8_t>& key : batch) {
+        const std::string& batch_key = keys[rnd_() % keys.size()];
+        key = span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(batch_key.data()),
+            batch_key.size());
+      }
+      if (cold && !ReopenStore()) {
+        state.SkipWithError("Reopening the store failed.");
+        return;
+      }
+      state.ResumeTiming();
+
+      UniquePtr<Transaction> transaction(store_->CreateTransaction());
+      if (multi_get) {
+        const Status status = transaction->MultiGet(
+            space_.get(),
+            span<const span<const uint8_t>>(batch.data(), batch.size()),
+            span<Status>(statuses.data(), statuses.size()),
+            span<PinnedValue>(values.data(), values.size()));
+        if (status != Status::kSuccess) {
+          state.SkipWithError("Transaction::MultiGet failed.");
+          return;
+        }
+      } else {
+        for (size_t i = 0; i < batch_size; ++i) {
+          statuses[i] = transaction->Get(space_.get(), batch[i], &values[i]);
+          if (statuses[i] != Status::kSuccess) {
+            state.SkipWithError("Transaction::Get failed.");
+            return;
+          }
+        }
+      }
+      for (PinnedValue& value : values) {
+        benchmark::DoNotOptimize(value.data().data());
+        value.Release();
+      }
+      if (transaction->Commit() != Status::kSuccess) {
+        state.SkipWithError("Transaction::Commit failed.");
+        return;
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * batch_size);
+  }
+
+  /** Closes and reopens the store, emptying its page cache. */
+  bool ReopenStore() {
+    space_.reset();
+    store_.reset();
+
+    Status status;
+    Store* raw_store;
+    std::tie(status, raw_store) = pool_->OpenStore(kFileName, StoreOptions());
+    if (status != Status::kSuccess)
+      return false;
+    store_.reset(raw_store);
+
+    Space* raw_space;
+    std::tie(status, raw_space) = store_->RootCatalog()->OpenSpace(
+        span<const uint8_t>(reinterpret_cast<const uint8_t*>("space"), 5));
+    if (status != Status::kSuccess)
+      return false;
+    space_.reset(raw_space);
+    return true;
+  }
+
+  /** Looks up missing keys in a space that holds state.range(0) keys. */
+  void MissingGet(benchmark::State& state) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+    if (!PutRandomKeys(static_cast<size_t>(state.range(0)), nullptr)) {
+      state.SkipWithError("Transaction::Put failed.");
+      return;
+    }
+
+    // GenerateKey() only produces lowercase letters, so keys that start with
+    // an uppercase letter are never in the space.
+    std::vector<std::string> missing_keys;
+    uint8_t key[kKeySize];
+    for (size_t i = 0; i < 4096; ++i) {
+      GenerateKey(key);
+      key[0] = 'A';
+      missing_keys.emplace_back(reinterpret_cast<const char*>(key), key_size_);
+    }
+
+    UniquePtr<ReadTransaction> transaction(store_->CreateReadTransaction());
+    size_t key_index = 0;
+    for (auto _ : state) {
+      const std::string& missing_key = missing_keys[key_index];
+      key_index = (key_index + 1) % missing_keys.size();
+      Status status;
+      span<const uint8_t> value;
+      std::tie(status, value) = transaction->Get(
+          space_.get(), span<const uint8_t>(
+              reinterpret_cast<const uint8_t*>(missing_key.data()),
+              missing_key.size()));
+      if (status != Status::kNotFound) {
+        state.SkipWithError("ReadTransaction::Get found a missing key.");
+        return;
+      }
+      benchmark::DoNotOptimize(value.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+
+  /** Scans a space that holds state.range(0) keys, optionally reading the
+   * values. */
+  void Scan(benchmark::State& state, bool read_values) {
+    if (space_.get() == nullptr) {
+      state.SkipWithError("Creating the space failed.");
+      return;
+    }
+    const size_t key_count = static_cast<size_t>(state.range(0));
+    if (!PutRandomKeys(key_count, nullptr)) {
+      state.SkipWithError("Transaction::Put failed.");
+      return;
+    }
+
+    UniquePtr<ReadTransaction> transaction(store_->CreateReadTransaction());
+    UniquePtr<Cursor> cursor(transaction->CreateCursor(space_.get()));
+    size_t scanned_keys = 0;
+    for (auto _ : state) {
+      Status status = cursor->SeekToFirst();
+      while (status == Status::kSuccess && cursor->Valid()) {
+        if (read_values) {
+          span<const uint8_t> value;
+          std::tie(status, value) = cursor->Value();
+          benchmark::DoNotOptimize(value.data());
+        } else {
+          benchmark::DoNotOptimize(cursor->key().data());
+        }
+        ++scanned_keys;
+        if (status == Status::kSuccess)
+          status = cursor->Next();
+      }
+      if (status != Status::kSuccess) {
+        state.SkipWithError("Cursor iteration failed.");
+        return;
+      }
+    }
+    state.SetItemsProcessed(scanned_keys);
+  }
+
+  const std::string kFileName = "bench_btree.berry";
+
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  std::unique_ptr<Pool> pool_;
+  UniquePtr<Store> store_;
+  UniquePtr<Space> space_;
+  std::mt19937 rnd_;
+  uint8_t value_[kMaxValueSize] = {};
+
+  /** If true, the benchmarks use a hashed space instead of a B+tree. */
+  bool hashed_space_ = false;
+
+  /** See SpaceOptions::integer_key_size. */
+  size_t integer_key_size_ = 0;
+
+  /** The size of the keys written by PutRandomKeys(). At most kKeySize. */
+  size_t key_size_ = kKeySize;
+
+  /** See SpaceOptions::bloom_filter_key_count. */
+  size_t bloom_filter_key_count_ = 0;
+
+  /** The size of the values written by PutRandomKeys(). At most
+   * kMaxValueSize. */
+  size_t value_size_ = kValueSize;
+
+  /** See SpaceOptions::value_log_threshold. */
+  size_t value_log_threshold_ = 0;
+
+  /** See SpaceOptions::write_buffered. */
+  bool write_buffered_ = false;
+};
+
+// Runs the point lookup workloads against a hashed space, for comparison with
+// the B+tree results.
+class HashedSpaceBenchmark : public BTreeBenchmark {
+ public:
+  HashedSpaceBenchmark() { hashed_space_ = true; }
+};
+
+// Runs the point lookup workloads with 8-byte keys against a regular space.
+class ShortKeyBenchmark : public BTreeBenchmark {
+ public:
+  ShortKeyBenchmark() { key_size_ = 8; }
+};
+
+// Runs the point lookup workloads against a space with 64-bit integer keys.
+class IntegerKeySpaceBenchmark : public BTreeBenchmark {
+ public:
+  IntegerKeySpaceBenchmark() {
+    integer_key_size_ = 8;
+    key_size_ = 8;
+  }
+};
+
+// Runs the lookup workloads against a space with a Bloom filter.
+class BloomFilterSpaceBenchmark : public BTreeBenchmark {
+ public:
+  BloomFilterSpaceBenchmark() { bloom_filter_key_count_ = 100000; }
+};
+
+// Runs the workloads with 1KB values against a regular space.
+class MidValueBenchmark : public BTreeBenchmark {
+ public:
+  MidValueBenchmark() { value_size_ = kMaxValueSize; }
+};
+
+// Runs the workloads with 1KB values against a space that keeps them in a
+// value log, for comparison with MidValueBenchmark.
+class ValueLogSpaceBenchmark : public MidValueBenchmark {
+ public:
+  ValueLogSpaceBenchmark() { value_log_threshold_ = 512; }
+};
+
+// Runs the write workloads against a write-buffered space.
+class BufferedSpaceBenchmark : public BTreeBenchmark {
+ public:
+  BufferedSpaceBenchmark() { write_buffered_ = true; }
+};
+
+// Runs the write workloads with 16-byte values against a regular space.
+class SmallValueBenchmark : public BTreeBenchmark {
+ public:
+  SmallValueBenchmark() { value_size_ = 16; }
+};
+
+// Runs the write workloads with 16-byte values against a write-buffered space.
+// Buffers hold more small messages, so each flush moves larger batches.
+class BufferedSmallValueBenchmark : public SmallValueBenchmark {
+ public:
+  BufferedSmallValueBenchmark() { write_buffered_ = true; }
+};
+
+// Each iteration commits a transaction that writes kBatchSize random keys into
+// a growing tree.
+BENCHMARK_DEFINE_F(BTreeBenchmark, RandomPut)(benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, RandomPut);
+
+// Reads random keys from a tree that holds state.range(0) keys.
+BENCHMARK_DEFINE_F(BTreeBenchmark, RandomGet)(benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, RandomGet)->Arg(10000)->Arg(100000);
+
+// Reads batches of state.range(0) random keys from a tree that holds
+// kBatchGetKeyCount keys, one Get() at a time. The second argument selects an
+// uncached store.
+BENCHMARK_DEFINE_F(BTreeBenchmark, BatchGet)(benchmark::State& state) {
+  BatchGet(state, false);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, BatchGet)
+    ->Args({50, 0})->Args({500, 0})->Args({50, 1})->Args({500, 1});
+
+// Reads the same batches as BatchGet, using MultiGet().
+BENCHMARK_DEFINE_F(BTreeBenchmark, MultiGet)(benchmark::State& state) {
+  BatchGet(state, true);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, MultiGet)
+    ->Args({50, 0})->Args({500, 0})->Args({50, 1})->Args({500, 1});
+
+// Reads random keys without copying their values, for comparison with
+// RandomGet.
+BENCHMARK_DEFINE_F(BTreeBenchmark, PinnedGet)(benchmark::State& state) {
+  PinnedGet(state);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, PinnedGet)->Arg(10000)->Arg(100000);
+
+// Each iteration commits a transaction that writes kBatchSize random keys into
+// a growing hash table.
+BENCHMARK_DEFINE_F(HashedSpaceBenchmark, RandomPut)(benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(HashedSpaceBenchmark, RandomPut);
+
+// Reads random keys from a hash table that holds state.range(0) keys.
+BENCHMARK_DEFINE_F(HashedSpaceBenchmark, RandomGet)(benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(HashedSpaceBenchmark, RandomGet)
+    ->Arg(10000)->Arg(100000);
+
+// Reads random 8-byte keys from a regular B+tree, as a baseline for
+// IntegerKeySpaceBenchmark.
+BENCHMARK_DEFINE_F(ShortKeyBenchmark, RandomGet)(benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(ShortKeyBenchmark, RandomGet)->Arg(10000)->Arg(100000);
+
+// Each iteration commits a transaction that writes kBatchSize random 64-bit
+// integer keys into a growing tree.
+BENCHMARK_DEFINE_F(IntegerKeySpaceBenchmark, RandomPut)(
+    benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(IntegerKeySpaceBenchmark, RandomPut);
+
+// Reads random 64-bit integer keys from a tree that holds state.range(0) keys.
+BENCHMARK_DEFINE_F(IntegerKeySpaceBenchmark, RandomGet)(
+    benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(IntegerKeySpaceBenchmark, RandomGet)
+    ->Arg(10000)->Arg(100000);
+
+// Looks up missing keys in a tree that holds state.range(0) keys.
+BENCHMARK_DEFINE_F(BTreeBenchmark, MissingGet)(benchmark::State& state) {
+  MissingGet(state);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, MissingGet)->Arg(10000)->Arg(100000);
+
+// Each iteration commits a transaction that writes kBatchSize random keys into
+// a growing tree, and adds them to the space's Bloom filter.
+BENCHMARK_DEFINE_F(BloomFilterSpaceBenchmark, RandomPut)(
+    benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(BloomFilterSpaceBenchmark, RandomPut);
+
+// Looks up missing keys in a space that holds state.range(0) keys, where the
+// space's Bloom filter answers most lookups.
+BENCHMARK_DEFINE_F(BloomFilterSpaceBenchmark, MissingGet)(
+    benchmark::State& state) {
+  MissingGet(state);
+}
+
+BENCHMARK_REGISTER_F(BloomFilterSpaceBenchmark, MissingGet)
+    ->Arg(10000)->Arg(100000);
+
+// Each iteration scans a tree that holds state.range(0) keys, reading all the
+// values.
+BENCHMARK_DEFINE_F(BTreeBenchmark, Scan)(benchmark::State& state) {
+  Scan(state, true);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, Scan)->Arg(10000)->Arg(100000);
+
+// The workloads below compare storing 1KB values in B+tree leaves with storing
+// them in a value log.
+
+BENCHMARK_DEFINE_F(MidValueBenchmark, RandomPut)(benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(MidValueBenchmark, RandomPut);
+
+BENCHMARK_DEFINE_F(ValueLogSpaceBenchmark, RandomPut)(
+    benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(ValueLogSpaceBenchmark, RandomPut);
+
+BENCHMARK_DEFINE_F(MidValueBenchmark, RandomGet)(benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(MidValueBenchmark, RandomGet)->Arg(10000);
+
+BENCHMARK_DEFINE_F(MidValueBenchmark, PinnedGet)(benchmark::State& state) {
+  PinnedGet(state);
+}
+
+BENCHMARK_REGISTER_F(MidValueBenchmark, PinnedGet)->Arg(10000);
+
+BENCHMARK_DEFINE_F(ValueLogSpaceBenchmark, RandomGet)(
+    benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(ValueLogSpaceBenchmark, RandomGet)->Arg(10000);
+
+// Each iteration scans the keys of a tree that holds state.range(0) keys,
+// without reading the values.
+BENCHMARK_DEFINE_F(MidValueBenchmark, KeyScan)(benchmark::State& state) {
+  Scan(state, false);
+}
+
+BENCHMARK_REGISTER_F(MidValueBenchmark, KeyScan)->Arg(10000);
+
+BENCHMARK_DEFINE_F(ValueLogSpaceBenchmark, KeyScan)(benchmark::State& state) {
+  Scan(state, false);
+}
+
+BENCHMARK_REGISTER_F(ValueLogSpaceBenchmark, KeyScan)->Arg(10000);
+
+// The workloads below compare a regular tree with a write-buffered tree. Small
+// transactions dirty fewer pages in buffered trees, so they log fewer bytes.
+
+BENCHMARK_DEFINE_F(BTreeBenchmark, SmallTransactionPut)(
+    benchmark::State& state) {
+  SmallTransactionPut(state);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, SmallTransactionPut)->Arg(100000);
+
+BENCHMARK_DEFINE_F(BufferedSpaceBenchmark, SmallTransactionPut)(
+    benchmark::State& state) {
+  SmallTransactionPut(state);
+}
+
+BENCHMARK_REGISTER_F(BufferedSpaceBenchmark, SmallTransactionPut)
+    ->Arg(100000);
+
+BENCHMARK_DEFINE_F(SmallValueBenchmark, SmallTransactionPut)(
+    benchmark::State& state) {
+  SmallTransactionPut(state);
+}
+
+BENCHMARK_REGISTER_F(SmallValueBenchmark, SmallTransactionPut)->Arg(100000);
+
+BENCHMARK_DEFINE_F(BufferedSmallValueBenchmark, SmallTransactionPut)(
+    benchmark::State& state) {
+  SmallTransactionPut(state);
+}
+
+BENCHMARK_REGISTER_F(BufferedSmallValueBenchmark, SmallTransactionPut)
+    ->Arg(100000);
+
+BENCHMARK_DEFINE_F(BufferedSpaceBenchmark, RandomPut)(
+    benchmark::State& state) {
+  RandomPut(state);
+}
+
+BENCHMARK_REGISTER_F(BufferedSpaceBenchmark, RandomPut);
+
+BENCHMARK_DEFINE_F(BufferedSpaceBenchmark, RandomGet)(
+    benchmark::State& state) {
+  RandomGet(state);
+}
+
+BENCHMARK_REGISTER_F(BufferedSpaceBenchmark, RandomGet)
+    ->Arg(10000)->Arg(100000);
+
+// Each iteration bulk-loads state.range(0) sorted keys into a new space, and
+// commits the load.
+BENCHMARK_DEFINE_F(BTreeBenchmark, BulkLoad)(benchmark::State& state) {
+  if (space_.get() == nullptr) {
+    state.SkipWithError("Creating the space failed.");
+    return;
+  }
+  const size_t key_count = static_cast<size_t>(state.range(0));
+  std::vector<std::string> keys;
+  keys.reserve(key_count);
+  uint8_t key[kKeySize];
+  for (size_t i = 0; i < key_count; ++i) {
+    GenerateKey(key);
+    keys.emplace_back(reinterpret_cast<const char*>(key), kKeySize);
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  struct Source {
+    const std::vector<std::string>* keys;
+    span<const uint8_t> value;
+    size_t next;
+
+    static bool Next(void* context, span<const uint8_t>* key,
+                     span<const uint8_t>* value) {
+      Source* const source = reinterpret_cast<Source*>(context);
+      if (source->next == source->keys->size())
+        return false;
+      const std::string& next_key = (*source->keys)[source->next];
+      ++source->next;
+      *key = span<const uint8_t>(
+          reinterpret_cast<const uint8_t*>(next_key.data()), next_key.size());
+      *value = source->value;
+      return true;
+    }
+  };
+
+  size_t space_index = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    const std::string space_name = "load" + std::to_string(space_index++);
+    Status status;
+    Space* raw_space;
+    std::tie(status, raw_space) = transaction->CreateSpace(
+        store_->RootCatalog(), span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(space_name.data()),
+            space_name.size()));
+    if (status != Status::kSuccess) {
+      state.SkipWithError("Transaction::CreateSpace failed.");
+      return;
+    }
+    UniquePtr<Space> space(raw_space);
+    state.ResumeTiming();
+
+    Source source = {&keys, span<const uint8_t>(value_, kValueSize), 0};
+    if (transaction->BulkLoad(space.get(), &Source::Next, &source) !=
+        Status::kSuccess) {
+      state.SkipWithError("Transaction::BulkLoad failed.");
+      return;
+    }
+    if (transaction->Commit() != Status::kSuccess) {
+      state.SkipWithError("Transaction::Commit failed.");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.SetBytesProcessed(state.iterations() * keys.size() *
+                          (kKeySize + kValueSize));
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, BulkLoad)->Arg(100000)->Arg(1000000);
+
+// Streams a value of state.range(0) MB, in 1 MB chunks. Large values are stored
+// outside the tree, in runs of consecutive pages.
+BENCHMARK_DEFINE_F(BTreeBenchmark, LargeValueRead)(benchmark::State& state) {
+  if (space_.get() == nullptr) {
+    state.SkipWithError("Creating the space failed.");
+    return;
+  }
+  constexpr size_t kChunkSize = 1 << 20;
+  const size_t value_size = static_cast<size_t>(state.range(0)) * kChunkSize;
+  uint8_t key[kKeySize];
+  GenerateKey(key);
+  const span<const uint8_t> key_span(key);
+
+  std::vector<uint8_t> chunk(kChunkSize);
+  for (uint8_t& byte : chunk)
+    byte = static_cast<uint8_t>(rnd_());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    if (transaction->ReserveValue(space_.get(), key_span, value_size) !=
+        Status::kSuccess) {
+      state.SkipWithError("Transaction::ReserveValue failed.");
+      return;
+    }
+    for (size_t offset = 0; offset < value_size; offset += kChunkSize) {
+      if (transaction->WriteValue(space_.get(), key_span, offset,
+                                  span<const uint8_t>(chunk.data(),
+                                                      chunk.size())) !=
+          Status::kSuccess) {
+        state.SkipWithError("Transaction::WriteValue failed.");
+        return;
+      }
+    }
+    if (transaction->Commit() != Status::kSuccess) {
+      state.SkipWithError("Transaction::Commit failed.");
+      return;
+    }
+  }
+
+  UniquePtr<ReadTransaction> transaction(store_->CreateReadTransaction());
+  for (auto _ : state) {
+    for (size_t offset = 0; offset < value_size; offset += kChunkSize) {
+      Status status;
+      size_t size;
+      std::tie(status, size) = transaction->ReadValue(
+          space_.get(), key_span, offset,
+          span<uint8_t>(chunk.data(), chunk.size()));
+      if (status != Status::kSuccess) {
+        state.SkipWithError("ReadTransaction::ReadValue failed.");
+        return;
+      }
+      benchmark::DoNotOptimize(chunk.data());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * value_size);
+}
+
+BENCHMARK_REGISTER_F(BTreeBenchmark, LargeValueRead)->Arg(4)->Arg(64);
+
+}  // namespace berrydb
@@ -0,0 +1,144 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "berrydb/status.h"
+#include "../btree_node.h"
+#include "../util/endianness.h"
+#include "../util/key_hints.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kPageSize = 4096;
+
+/** Fills a leaf with random keys of the given size.
+ *
+ * @param  key_size      the size of each key
+ * @param  shared_prefix if true, all keys start with the same bytes, so their
+ *                       hints are equal and searches must compare full keys
+ * @param  node          receives the leaf
+ * @return               the keys in the leaf
+ */
+std::vector<std::string> FillLeaf(size_t key_size, bool shared_prefix,
+                                  span<uint8_t> node) {
+  std::mt19937 rnd;
+  std::uniform_int_distribution<int> byte_distribution('a', 'z');
+  const std::string value(8, 'v');
+  const span<const uint8_t> value_span(
+      reinterpret_cast<const uint8_t*>(value.data()), value.size());
+
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  std::vector<std::string> keys;
+  while (true) {
+    std::string key(key_size, 'k');
+    for (size_t i = shared_prefix ? key_size / 2 : 0; i < key_size; ++i)
+      key[i] = static_cast<char>(byte_distribution(rnd));
+    const span<const uint8_t> key_span(
+        reinterpret_cast<const uint8_t*>(key.data()), key.size());
+
+    Status status;
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(node, key_span);
+    if (status != Status::kSuccess || found)
+      continue;
+    if (!BTreeNode::LeafInsert(node, index, key_span, value_span))
+      break;
+    keys.push_back(std::move(key));
+  }
+  std::shuffle(keys.begin(), keys.end(), rnd);
+  return keys;
+}
+
+}  // namespace
+
+// Measures key lookups in a full leaf. The first argument is the key size. The
+// second argument is 1 if the keys share their first half, which defeats the
+// key hints.
+static void BM_BTreeNodeLeafFind(benchmark::State& state) {
+  const size_t key_size = static_cast<size_t>(state.range(0));
+  const bool shared_prefix = state.range(1) != 0;
+  alignas(8) uint8_t buffer[kPageSize];
+  const span<uint8_t> node(buffer);
+  const std::vector<std::string> keys =
+      FillLeaf(key_size, shared_prefix, node);
+
+  size_t key_index = 0;
+  for (auto _ : state) {
+    const std::string& key = keys[key_index];
+    key_index = (key_index + 1 == keys.size()) ? 0 : key_index + 1;
+
+    Status status;
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(
+        node, span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(key.data()), key.size()));
+    if (status != Status::kSuccess || !found) {
+      state.SkipWithError("BTreeNode::LeafFind failed.");
+      return;
+    }
+    benchmark::DoNotOptimize(index);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["entries"] = static_cast<double>(keys.size());
+}
+BENCHMARK(BM_BTreeNodeLeafFind)
+    ->ArgPair(8, 0)->ArgPair(16, 0)->ArgPair(32, 0)->ArgPair(64, 0)
+    ->ArgPair(8, 1)->ArgPair(16, 1)->ArgPair(32, 1)->ArgPair(64, 1);
+
+namespace {
+
+/** Benchmarks a search over an array of state.range(0) sorted hints. */
+template <size_t (*LowerBound)(span<const uint8_t>, size_t, uint32_t)>
+void KeyHintSearchBenchmark(benchmark::State& state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::mt19937 rnd;
+  std::vector<uint32_t> values(count);
+  for (uint32_t& value : values)
+    value = static_cast<uint32_t>(rnd());
+  std::sort(values.begin(), values.end());
+
+  std::vector<uint32_t> buffer(count);
+  const span<uint8_t> hints(reinterpret_cast<uint8_t*>(buffer.data()),
+                            count * kKeyHintSize);
+  for (size_t i = 0; i < count; ++i)
+    StoreUint32(values[i], hints.subspan(i * kKeyHintSize, kKeyHintSize));
+
+  std::vector<uint32_t> probes(1024);
+  for (uint32_t& probe : probes)
+    probe = static_cast<uint32_t>(rnd());
+
+  size_t probe_index = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(LowerBound(hints, count, probes[probe_index]));
+    probe_index = (probe_index + 1) % probes.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+// Searches using vector instructions, when available.
+static void BM_KeyHintLowerBound(benchmark::State& state) {
+  KeyHintSearchBenchmark<KeyHintLowerBound>(state);
+}
+BENCHMARK(BM_KeyHintLowerBound)->RangeMultiplier(4)->Range(16, 1024);
+
+// Searches using binary search.
+static void BM_KeyHintLowerBoundPortable(benchmark::State& state) {
+  KeyHintSearchBenchmark<KeyHintLowerBoundPortable>(state);
+}
+BENCHMARK(BM_KeyHintLowerBoundPortable)->RangeMultiplier(4)->Range(16, 1024);
+
+}  // namespace berrydb
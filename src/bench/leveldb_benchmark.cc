@@ -0,0 +1,160 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "leveldb/db.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+
+#include "berrydb/platform.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kKeySize = 16;
+constexpr size_t kValueSize = 100;
+constexpr size_t kBatchSize = 1000;
+
+}  // namespace
+
+// Mirrors the workloads in btree_benchmark.cc, so BerryDB's B+tree can be
+// compared against LevelDB's LSM tree.
+class LevelDbBenchmark : public benchmark::Fixture {
+ public:
+  void SetUp(MAYBE_UNUSED const benchmark::State& state) override {
+    leveldb::DestroyDB(kDbName, leveldb::Options());
+    leveldb::Options options;
+    options.create_if_missing = true;
+    leveldb::DB* db;
+    if (leveldb::DB::Open(options, kDbName, &db).ok())
+      db_.reset(db);
+  }
+
+  void TearDown(MAYBE_UNUSED const benchmark::State& state) override {
+    db_.reset();
+    leveldb::DestroyDB(kDbName, leveldb::Options());
+  }
+
+ protected:
+  /** Fills a buffer with a random key. */
+  void GenerateKey(char* key) {
+    for (size_t i = 0; i < kKeySize; ++i)
+      key[i] = static_cast<char>('a' + rnd_() % 26);
+  }
+
+  /** Writes random keys, batched in synced writes. Returns false on errors. */
+  bool PutRandomKeys(size_t key_count, std::vector<std::string>* keys) {
+    char key[kKeySize];
+    const leveldb::Slice value(value_, kValueSize);
+    // Synced writes match the durability of BerryDB's commits.
+    leveldb::WriteOptions write_options;
+    write_options.sync = true;
+    for (size_t i = 0; i < key_count; i += kBatchSize) {
+      leveldb::WriteBatch batch;
+      for (size_t j = i; j < i + kBatchSize && j < key_count; ++j) {
+        GenerateKey(key);
+        batch.Put(leveldb::Slice(key, kKeySize), value);
+        if (keys != nullptr)
+          keys->emplace_back(key, kKeySize);
+      }
+      if (!db_->Write(write_options, &batch).ok())
+        return false;
+    }
+    return true;
+  }
+
+  const std::string kDbName = "bench_leveldb";
+
+  std::unique_ptr<leveldb::DB> db_;
+  std::mt19937 rnd_;
+  char value_[kValueSize] = {};
+};
+
+BENCHMARK_DEFINE_F(LevelDbBenchmark, RandomPut)(benchmark::State& state) {
+  if (db_.get() == nullptr) {
+    state.SkipWithError("leveldb::DB::Open failed.");
+    return;
+  }
+
+  for (auto _ : state) {
+    if (!PutRandomKeys(kBatchSize, nullptr)) {
+      state.SkipWithError("leveldb::DB::Write failed.");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_REGISTER_F(LevelDbBenchmark, RandomPut);
+
+BENCHMARK_DEFINE_F(LevelDbBenchmark, RandomGet)(benchmark::State& state) {
+  if (db_.get() == nullptr) {
+    state.SkipWithError("leveldb::DB::Open failed.");
+    return;
+  }
+  std::vector<std::string> keys;
+  if (!PutRandomKeys(static_cast<size_t>(state.range(0)), &keys)) {
+    state.SkipWithError("leveldb::DB::Write failed.");
+    return;
+  }
+
+  const leveldb::Snapshot* snapshot = db_->GetSnapshot();
+  leveldb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  std::string value;
+  size_t key_index = 0;
+  for (auto _ : state) {
+    const std::string& key = keys[key_index];
+    key_index = (key_index + 7919) % keys.size();
+    if (!db_->Get(read_options, key, &value).ok()) {
+      state.SkipWithError("leveldb::DB::Get failed.");
+      break;
+    }
+    benchmark::DoNotOptimize(value.data());
+  }
+  db_->ReleaseSnapshot(snapshot);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(LevelDbBenchmark, RandomGet)->Arg(10000)->Arg(100000);
+
+BENCHMARK_DEFINE_F(LevelDbBenchmark, Scan)(benchmark::State& state) {
+  if (db_.get() == nullptr) {
+    state.SkipWithError("leveldb::DB::Open failed.");
+    return;
+  }
+  if (!PutRandomKeys(static_cast<size_t>(state.range(0)), nullptr)) {
+    state.SkipWithError("leveldb::DB::Write failed.");
+    return;
+  }
+
+  const leveldb::Snapshot* snapshot = db_->GetSnapshot();
+  leveldb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  std::unique_ptr<leveldb::Iterator> iterator(db_->NewIterator(read_options));
+  size_t scanned_keys = 0;
+  for (auto _ : state) {
+    for (iterator->SeekToFirst(); iterator->Valid(); iterator->Next()) {
+      benchmark::DoNotOptimize(iterator->value().data());
+      ++scanned_keys;
+    }
+    if (!iterator->status().ok()) {
+      state.SkipWithError("leveldb::Iterator failed.");
+      break;
+    }
+  }
+  iterator.reset();
+  db_->ReleaseSnapshot(snapshot);
+  state.SetItemsProcessed(scanned_keys);
+}
+
+BENCHMARK_REGISTER_F(LevelDbBenchmark, Scan)->Arg(10000)->Arg(100000);
+
+}  // namespace berrydb
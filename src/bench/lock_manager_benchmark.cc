@@ -0,0 +1,70 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "berrydb/status.h"
+#include "../lock_manager.h"
+
+namespace berrydb {
+
+// Measures the lock manager's transactions/second as the number of threads
+// grows. Stores can't be used from multiple threads, so this drives the lock
+// manager directly, and does not measure store writes. Each thread locks
+// its own key range, so the threads never wait for each other, and the
+// throughput should scale with the number of cores. Each transaction locks a
+// few records exclusively, like a small Put() batch, and then releases them,
+// like a commit.
+static void BM_LockManagerDisjointWriters(benchmark::State& state) {
+  constexpr size_t kTransactionsPerThread = 4096;
+  constexpr size_t kRecordsPerTransaction = 4;
+
+  const size_t thread_count = static_cast<size_t>(state.range(0));
+  LockManager lock_manager(1000);
+  const int space = 0;
+
+  std::atomic<bool> lock_failed(false);
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count);
+  for (auto _ : state) {
+    for (size_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back([&lock_manager, &space, &lock_failed, i] {
+        LockManager::Owner owner;
+        uint8_t key[16] = {static_cast<uint8_t>(i)};
+        for (size_t j = 0; j < kTransactionsPerThread; ++j) {
+          for (size_t k = 0; k < kRecordsPerTransaction; ++k) {
+            key[1] = static_cast<uint8_t>(j);
+            key[2] = static_cast<uint8_t>(j >> 8);
+            key[3] = static_cast<uint8_t>(k);
+            const Status status = lock_manager.Lock(
+                &owner, LockManager::RecordId(&space, make_span(key)),
+                LockManager::Mode::kExclusive);
+            if (status != Status::kSuccess)
+              lock_failed.store(true, std::memory_order_relaxed);
+          }
+          lock_manager.UnlockAll(&owner);
+        }
+      });
+    }
+    for (std::thread& thread : threads)
+      thread.join();
+    threads.clear();
+  }
+  if (lock_failed.load()) {
+    state.SkipWithError("LockManager::Lock failed.");
+    return;
+  }
+
+  state.SetItemsProcessed(state.iterations() * thread_count *
+                          kTransactionsPerThread);
+}
+BENCHMARK(BM_LockManagerDisjointWriters)
+    ->RangeMultiplier(2)->Range(1, 16)  // Writer threads.
+    ->UseRealTime();
+
+}  // namespace berrydb
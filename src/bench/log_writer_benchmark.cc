@@ -0,0 +1,193 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstdio>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "berrydb/vfs.h"
+#include "../format/log_format.h"
+#include "../log_writer.h"
+#include "../test/file_deleter.h"
+#include "../util/span_util.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+class LogWriterBenchmark : public benchmark::Fixture {
+ public:
+  LogWriterBenchmark() : vfs_(DefaultVfs()), deleter_(kFileName) {}
+
+ protected:
+  const std::string kFileName = "bench_log_writer.log";
+  static constexpr size_t kPageShift = 12;
+  static constexpr size_t kPageSize = 1 << kPageShift;
+  /** Each thread commits this many transactions per benchmark iteration. */
+  static constexpr size_t kCommitsPerThread = 256;
+
+  Vfs* vfs_;
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter deleter_;
+};
+
+// Measures commits/second as the number of committing threads grows. Each
+// transaction logs one page. The log is synced by the writer's background
+// thread, like in a store opened with relaxed durability, so the benchmark
+// focuses on the cost of getting records into the log buffer.
+BENCHMARK_DEFINE_F(LogWriterBenchmark, ConcurrentCommits)(
+    benchmark::State& state) {
+  UniquePtr<RandomAccessFile> file;
+  Status status;
+  RandomAccessFile* raw_file;
+  size_t file_size;
+  std::tie(status, raw_file, file_size) = vfs_->OpenForRandomAccess(
+      deleter_.path(), true, false);
+  if (status != Status::kSuccess) {
+    state.SkipWithError("Vfs::OpenForRandomAccess failed.");
+    return;
+  }
+  file.reset(raw_file);
+
+  const size_t thread_count = static_cast<size_t>(state.range(0));
+  const size_t transaction_size =
+      LogFormat::PageImageRecordSize(kPageShift) + LogFormat::kCommitRecordSize;
+  LogWriter writer(file.get(), file_size, kPageShift);
+  uint64_t epoch = 1;
+  writer.Reset(epoch);
+  writer.StartBackgroundSync(10, 1 << 20);
+
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count);
+  for (auto _ : state) {
+    for (size_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back([&writer, i, transaction_size] {
+        alignas(8) uint8_t page[kPageSize];
+        FillSpan(span<uint8_t>(page), static_cast<uint8_t>(i));
+        for (size_t j = 0; j < kCommitsPerThread; ++j) {
+          const uint64_t lsn = writer.Reserve(transaction_size);
+          writer.WritePageImage(lsn, i, span<const uint8_t>(page));
+          writer.WriteCommit(
+              lsn + LogFormat::PageImageRecordSize(kPageShift), 1);
+        }
+      });
+    }
+    for (std::thread& thread : threads)
+      thread.join();
+    threads.clear();
+
+    // Recycle the log, so the benchmark does not run out of disk space.
+    state.PauseTiming();
+    if (writer.StopBackgroundSync() != Status::kSuccess) {
+      state.SkipWithError("LogWriter::StopBackgroundSync failed.");
+      return;
+    }
+    ++epoch;
+    writer.Reset(epoch);
+    writer.StartBackgroundSync(10, 1 << 20);
+    state.ResumeTiming();
+  }
+  writer.StopBackgroundSync();
+
+  state.SetItemsProcessed(state.iterations() * thread_count *
+                          kCommitsPerThread);
+  state.SetBytesProcessed(state.iterations() * thread_count *
+                          kCommitsPerThread * transaction_size);
+}
+
+BENCHMARK_REGISTER_F(LogWriterBenchmark, ConcurrentCommits)
+    ->RangeMultiplier(2)->Range(1, 16)  // Committing threads.
+    ->UseRealTime();
+
+// Measures the cost of logging pages that hold JSON-like values, with and
+// without page image compression. The compression ratio and the CPU time spent
+// compressing each page are reported as counters.
+BENCHMARK_DEFINE_F(LogWriterBenchmark, PageImageCompression)(
+    benchmark::State& state) {
+  const bool compress = state.range(0) != 0;
+  if (compress && !kPlatformHasCompression) {
+    state.SkipWithError("BerryDB was built without a compressor.");
+    return;
+  }
+
+  UniquePtr<RandomAccessFile> file;
+  Status status;
+  RandomAccessFile* raw_file;
+  size_t file_size;
+  std::tie(status, raw_file, file_size) = vfs_->OpenForRandomAccess(
+      deleter_.path(), true, false);
+  if (status != Status::kSuccess) {
+    state.SkipWithError("Vfs::OpenForRandomAccess failed.");
+    return;
+  }
+  file.reset(raw_file);
+
+  constexpr size_t kPagesPerCommit = 16;
+  std::vector<uint8_t> pages(kPagesPerCommit * kPageSize);
+  size_t record_id = 0;
+  for (size_t i = 0; i < kPagesPerCommit; ++i) {
+    char* const page = reinterpret_cast<char*>(&pages[i * kPageSize]);
+    size_t offset = 0;
+    while (true) {
+      char record[128];
+      const int record_size = std::snprintf(
+          record, sizeof(record),
+          "{\"id\":%zu,\"name\":\"user%zu\",\"active\":%s,"
+          "\"tags\":[\"reader\",\"writer\"]}",
+          record_id, record_id * 7919 % 100003,
+          (record_id % 3 == 0) ? "true" : "false");
+      if (offset + record_size > kPageSize)
+        break;
+      std::copy(record, record + record_size, page + offset);
+      offset += record_size;
+      ++record_id;
+    }
+  }
+
+  LogWriter writer(file.get(), file_size, kPageShift);
+  writer.set_compresses_page_images(compress);
+  uint64_t epoch = 1;
+  writer.Reset(epoch);
+  for (auto _ : state) {
+    for (size_t i = 0; i < kPagesPerCommit; ++i) {
+      writer.AppendPageImage(
+          i, span<const uint8_t>(&pages[i * kPageSize], kPageSize));
+    }
+    writer.AppendCommit(kPagesPerCommit);
+    if (writer.Sync() != Status::kSuccess) {
+      state.SkipWithError("LogWriter::Sync failed.");
+      return;
+    }
+
+    // Recycle the log, so the benchmark does not run out of disk space.
+    if (writer.log_size() >= LogFormat::kSegmentSize) {
+      state.PauseTiming();
+      ++epoch;
+      writer.Reset(epoch);
+      state.ResumeTiming();
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kPagesPerCommit);
+  state.SetBytesProcessed(state.iterations() * kPagesPerCommit * kPageSize);
+  if (compress) {
+    const LogWriter::CompressionStats stats = writer.compression_stats();
+    state.counters["ratio"] = static_cast<double>(
+        stats.page_count * LogFormat::PageImageRecordSize(kPageShift)) /
+        static_cast<double>(stats.record_bytes);
+    state.counters["ns_per_page"] =
+        static_cast<double>(stats.compression_ns) /
+        static_cast<double>(stats.page_count);
+  }
+}
+
+BENCHMARK_REGISTER_F(LogWriterBenchmark, PageImageCompression)
+    ->Arg(0)->Arg(1);  // Compress page images.
+
+}  // namespace berrydb
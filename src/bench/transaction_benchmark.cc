@@ -0,0 +1,93 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+#include <tuple>
+
+#include "benchmark/benchmark.h"
+
+#include "berrydb/options.h"
+#include "berrydb/pool.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "../test/file_deleter.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+class TransactionBenchmark : public benchmark::Fixture {
+ public:
+  TransactionBenchmark()
+      : data_file_deleter_(kFileName),
+        log_file_deleter_(Store::LogFilePath(kFileName)) {}
+
+  void SetUp(MAYBE_UNUSED const benchmark::State& state) override {
+    PoolOptions options;
+    options.page_shift = 12;
+    options.page_pool_size = 64;
+    pool_ = Pool::Create(options);
+  }
+
+  void TearDown(MAYBE_UNUSED const benchmark::State& state) override {
+    pool_.reset();
+  }
+
+ protected:
+  const std::string kFileName = "bench_transaction.berry";
+
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  std::unique_ptr<Pool> pool_;
+};
+
+// Measures the fixed cost of a transaction that does not modify any page. This
+// is dominated by the bookkeeping done when transactions are created and
+// released.
+BENCHMARK_DEFINE_F(TransactionBenchmark, EmptyTransaction)(
+    benchmark::State& state) {
+  Status status;
+  Store* raw_store;
+  std::tie(status, raw_store) = pool_->OpenStore(kFileName, StoreOptions());
+  if (status != Status::kSuccess) {
+    state.SkipWithError("Pool::OpenStore failed.");
+    return;
+  }
+  UniquePtr<Store> store(raw_store);
+
+  for (auto _ : state) {
+    Transaction* transaction = store->CreateTransaction();
+    benchmark::DoNotOptimize(transaction->Commit());
+    transaction->Release();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(TransactionBenchmark, EmptyTransaction);
+
+BENCHMARK_DEFINE_F(TransactionBenchmark, EmptyReadTransaction)(
+    benchmark::State& state) {
+  Status status;
+  Store* raw_store;
+  std::tie(status, raw_store) = pool_->OpenStore(kFileName, StoreOptions());
+  if (status != Status::kSuccess) {
+    state.SkipWithError("Pool::OpenStore failed.");
+    return;
+  }
+  UniquePtr<Store> store(raw_store);
+
+  for (auto _ : state) {
+    ReadTransaction* transaction = store->CreateReadTransaction();
+    benchmark::DoNotOptimize(transaction);
+    transaction->Release();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(TransactionBenchmark, EmptyReadTransaction);
+
+}  // namespace berrydb
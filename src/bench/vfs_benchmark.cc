@@ -137,4 +137,60 @@ BENCHMARK_DEFINE_F(VfsBenchmark, LogWrites)(benchmark::State& state) {
 BENCHMARK_REGISTER_F(VfsBenchmark, LogWrites)->RangeMultiplier(2)->Range(
     4096, 65536);  // Log record size.
 
+BENCHMARK_DEFINE_F(VfsBenchmark, PreallocatedLogWrites)(
+    benchmark::State& state) {
+  UniquePtr<RandomAccessFile> file;
+  Status status;
+  RandomAccessFile* raw_file;
+  size_t raw_file_size;
+  std::tie(status, raw_file, raw_file_size) = vfs_->OpenForRandomAccess(
+      deleter_.path(), true, false);
+  if (status != Status::kSuccess) {
+    state.SkipWithError("Vfs::OpenForRandomAccess failed.");
+    return;
+  }
+  file.reset(raw_file);
+
+  // Preallocate the file, like the log writer does when it adds a segment.
+  size_t block_count = static_cast<size_t>(state.range(1));
+  span<const uint8_t> block_data(block_bytes_, block_size_);
+  for (size_t i = 0; i < block_count; ++i) {
+    if (file->Write(block_data, i << block_shift_) != Status::kSuccess) {
+      state.SkipWithError("RandomAccessFile::Write failed. (preallocation)");
+      return;
+    }
+  }
+  if (file->Sync() != Status::kSuccess) {
+    state.SkipWithError("RandomAccessFile::Sync failed. (preallocation)");
+    return;
+  }
+
+  size_t block_number = 0;
+  for (auto _ : state) {
+    if (file->Write(block_data, block_number << block_shift_) !=
+        Status::kSuccess) {
+      state.SkipWithError("RandomAccessFile::Write failed.");
+      return;
+    }
+    if (file->Sync() != Status::kSuccess) {
+      state.SkipWithError("RandomAccessFile::Sync failed.");
+      return;
+    }
+
+    // Wrap around, like the log does after a checkpoint. The file size never
+    // changes, so each Sync() only needs to flush data.
+    ++block_number;
+    if (block_number == block_count)
+      block_number = 0;
+  }
+
+  state.SetBytesProcessed(state.iterations() << block_shift_);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(
+    VfsBenchmark, PreallocatedLogWrites)->RangeMultiplier(2)->Ranges(
+    {{4096, 65536},  // Log record size.
+    {1024, 1024}});  // Number of records that fit in the preallocated file.
+
 }  // namespace berrydb
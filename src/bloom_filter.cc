@@ -0,0 +1,218 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./bloom_filter.h"
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree.h"
+#include "./free_page_manager.h"
+#include "./page_pool.h"
+#include "./pinned_page.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/key_hash.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+constexpr size_t BloomFilter::kBitsPerKey;
+constexpr size_t BloomFilter::kProbeCount;
+constexpr size_t BloomFilter::kBlockSize;
+
+namespace {
+
+/** The number of bits in a filter block. */
+constexpr uint32_t kBlockBits = BloomFilter::kBlockSize * 8;
+
+}  // namespace
+
+// static
+size_t BloomFilter::PageCount(size_t key_count, size_t page_size) noexcept {
+  BERRYDB_ASSUME_GT(key_count, 0U);
+
+  const size_t keys_per_page = page_size * 8 / kBitsPerKey;
+  return key_count / keys_per_page + (key_count % keys_per_page != 0 ? 1 : 0);
+}
+
+// static
+std::tuple<Status, BloomFilter> BloomFilter::Create(
+    TransactionImpl* transaction, size_t key_count) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  const size_t page_count =
+      PageCount(key_count, store->page_pool()->page_size());
+  const size_t first_page_id = store->free_page_manager()->AllocPages(
+      page_count, transaction, transaction);
+  if (UNLIKELY(first_page_id == FreePageManager::kInvalidPageId))
+    return {Status::kIoError, BloomFilter()};
+
+  BloomFilter filter(first_page_id, page_count);
+  const Status status = filter.Clear(transaction);
+  return {status, filter};
+}
+
+std::tuple<Status, bool> BloomFilter::MayContain(
+    TransactionImpl* transaction, span<const uint8_t> key) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  Status status;
+  size_t page_id, block_offset;
+  uint32_t probe_hash;
+  std::tie(status, page_id, block_offset, probe_hash) = LocateBlock(store, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+  const PinnedPage page(raw_page, page_pool);
+  const span<const uint8_t> data =
+      transaction->PageData(page.get(), page_pool->page_size());
+  return {Status::kSuccess,
+          BlockMayContain(data.subspan(block_offset, kBlockSize), probe_hash)};
+}
+
+std::tuple<Status, bool> BloomFilter::MayContain(
+    ReadTransactionImpl* transaction, span<const uint8_t> key) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  Status status;
+  size_t page_id, block_offset;
+  uint32_t probe_hash;
+  std::tie(status, page_id, block_offset, probe_hash) =
+      LocateBlock(transaction->store(), key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+
+  span<const uint8_t> data;
+  std::tie(status, data) = transaction->ReadPage(page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+  return {Status::kSuccess,
+          BlockMayContain(data.subspan(block_offset, kBlockSize), probe_hash)};
+}
+
+Status BloomFilter::Add(TransactionImpl* transaction, span<const uint8_t> key) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+  size_t page_id, block_offset;
+  uint32_t probe_hash;
+  std::tie(status, page_id, block_offset, probe_hash) = LocateBlock(store, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  // Most keys in a space are written many times. Skipping the write when the
+  // bits are already set keeps the filter page out of the transaction's log
+  // records.
+  const span<const uint8_t> data =
+      transaction->PageData(page.get(), page_size);
+  if (BlockMayContain(data.subspan(block_offset, kBlockSize), probe_hash))
+    return Status::kSuccess;
+
+  const span<uint8_t> mutable_data =
+      transaction->MutablePageData(page.get(), page_size);
+  BlockAdd(mutable_data.subspan(block_offset, kBlockSize), probe_hash);
+  return Status::kSuccess;
+}
+
+Status BloomFilter::Clear(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  for (size_t i = 0; i < page_count_; ++i) {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(first_page_id_ + i);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    FillSpan(transaction->NewPageData(page.get(), page_size), 0);
+  }
+  return Status::kSuccess;
+}
+
+Status BloomFilter::Free(TransactionImpl* transaction) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  FreePageManager* const free_page_manager =
+      transaction->store()->free_page_manager();
+  const size_t store_page_count = free_page_manager->page_count();
+  if (UNLIKELY(first_page_id_ == 0 || first_page_id_ >= store_page_count ||
+               page_count_ > store_page_count - first_page_id_)) {
+    return Status::kDataCorrupted;
+  }
+  return free_page_manager->FreePages(first_page_id_, page_count_,
+                                      transaction, transaction);
+}
+
+// static
+bool BloomFilter::BlockMayContain(span<const uint8_t> block,
+                                  uint32_t probe_hash) noexcept {
+  BERRYDB_ASSUME_EQ(block.size(), kBlockSize);
+
+  // Double hashing, with the second hash derived by rotating the first one.
+  const uint32_t delta = (probe_hash >> 17) | (probe_hash << 15);
+  for (size_t i = 0; i < kProbeCount; ++i) {
+    const uint32_t bit = probe_hash % kBlockBits;
+    if ((block[bit / 8] & (1 << (bit % 8))) == 0)
+      return false;
+    probe_hash += delta;
+  }
+  return true;
+}
+
+// static
+void BloomFilter::BlockAdd(span<uint8_t> block, uint32_t probe_hash) noexcept {
+  BERRYDB_ASSUME_EQ(block.size(), kBlockSize);
+
+  // This must generate the same bits as BlockMayContain().
+  const uint32_t delta = (probe_hash >> 17) | (probe_hash << 15);
+  for (size_t i = 0; i < kProbeCount; ++i) {
+    const uint32_t bit = probe_hash % kBlockBits;
+    block[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+    probe_hash += delta;
+  }
+}
+
+std::tuple<Status, size_t, size_t, uint32_t> BloomFilter::LocateBlock(
+    StoreImpl* store, span<const uint8_t> key) const noexcept {
+  const size_t page_size = store->page_pool()->page_size();
+  const size_t blocks_per_page = page_size / kBlockSize;
+
+  const uint64_t hash = KeyHash(key);
+  const size_t block = static_cast<size_t>(
+      (hash >> 32) % (static_cast<uint64_t>(page_count_) * blocks_per_page));
+  const size_t page_id = BTree::CheckedChildId(
+      store, static_cast<uint64_t>(first_page_id_ + block / blocks_per_page));
+  if (UNLIKELY(page_id == 0))
+    return {Status::kDataCorrupted, 0, 0, 0};
+  return {Status::kSuccess, page_id, (block % blocks_per_page) * kBlockSize,
+          static_cast<uint32_t>(hash)};
+}
+
+}  // namespace berrydb
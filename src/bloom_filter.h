@@ -0,0 +1,162 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_BLOOM_FILTER_H_
+#define BERRYDB_BLOOM_FILTER_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+
+namespace berrydb {
+
+class ReadTransactionImpl;
+enum class Status : int;
+class StoreImpl;
+class TransactionImpl;
+
+/** A blocked Bloom filter stored in a run of consecutive store pages.
+ *
+ * Spaces created with SpaceOptions::bloom_filter_key_count use a filter to
+ * answer most lookups for missing keys without descending their B+tree.
+ *
+ * The filter's bits are split into 512-bit blocks, so each block fits in a CPU
+ * cache line, and a key's bits are all in the same block. The high 32 bits of
+ * the key's KeyHash() select the block, and the low 32 bits are turned into
+ * kProbeCount bit positions using double hashing. Testing a key reads a single
+ * filter page. A filter sized with kBitsPerKey bits per key has a false
+ * positive rate of about 1%.
+ *
+ * Bits are only ever set, so deleted keys keep testing positive until the
+ * filter is cleared and rebuilt from the space's keys. Adding a key that
+ * already tests positive does not modify the filter's pages.
+ *
+ * Filter pages have no header, and an all-zero page is an empty filter page.
+ *
+ * This class does not synchronize access to the filter's pages. Transactions
+ * follow the concurrency rules documented in Space, and read transactions see
+ * the pages' old versions.
+ */
+class BloomFilter {
+ public:
+  /** The number of filter bits allocated for each expected key. */
+  static constexpr size_t kBitsPerKey = 10;
+
+  /** The number of bits set by each key. */
+  static constexpr size_t kProbeCount = 6;
+
+  /** The size of a filter block, in bytes. */
+  static constexpr size_t kBlockSize = 64;
+
+  /** Sets up a handle that does not refer to any filter. */
+  constexpr BloomFilter() noexcept : first_page_id_(0), page_count_(0) {}
+
+  /** Sets up access to the filter stored in the given pages. */
+  constexpr BloomFilter(size_t first_page_id, size_t page_count) noexcept
+      : first_page_id_(first_page_id), page_count_(page_count) {}
+
+  /** The number of pages in a filter sized for a number of keys.
+   *
+   * @param  key_count the number of keys that the filter is expected to hold;
+   *                   must be positive
+   * @param  page_size the store's page size
+   * @return           a positive number of pages
+   */
+  static size_t PageCount(size_t key_count, size_t page_size) noexcept;
+
+  /** Creates an empty filter.
+   *
+   * @param  transaction the transaction that allocates the filter's pages
+   * @param  key_count   the number of keys that the filter is expected to
+   *                     hold; must be positive
+   * @return status      most likely kSuccess or kIoError
+   * @return filter      a handle to the new filter
+   */
+  static std::tuple<Status, BloomFilter> Create(TransactionImpl* transaction,
+                                                size_t key_count);
+
+  /** True if the handle refers to a filter. */
+  inline constexpr bool exists() const noexcept { return page_count_ != 0; }
+
+  /** The ID of the filter's first page. */
+  inline constexpr size_t first_page_id() const noexcept {
+    return first_page_id_;
+  }
+
+  /** The number of pages in the filter. */
+  inline constexpr size_t page_count() const noexcept { return page_count_; }
+
+  /** Tests a key, on behalf of a write transaction.
+   *
+   * @return status       kSuccess, kDataCorrupted, or an I/O error
+   * @return may_contain  false if the key was definitely not added to the
+   *                      filter
+   */
+  std::tuple<Status, bool> MayContain(TransactionImpl* transaction,
+                                      span<const uint8_t> key) const;
+
+  /** Tests a key, as of a read snapshot.
+   *
+   * @return status       kSuccess, kDataCorrupted, or an I/O error
+   * @return may_contain  false if the key was definitely not added to the
+   *                      filter
+   */
+  std::tuple<Status, bool> MayContain(ReadTransactionImpl* transaction,
+                                      span<const uint8_t> key) const;
+
+  /** Adds a key to the filter.
+   *
+   * @return kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status Add(TransactionImpl* transaction, span<const uint8_t> key);
+
+  /** Removes all the keys from the filter, by zeroing its pages.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status Clear(TransactionImpl* transaction);
+
+  /** Frees the filter's pages when the transaction commits.
+   *
+   * @return kSuccess or kDataCorrupted
+   */
+  Status Free(TransactionImpl* transaction) const;
+
+  /** Tests a key's bits in a filter block.
+   *
+   * @param  block      a filter block; must have kBlockSize bytes
+   * @param  probe_hash the low 32 bits of the key's KeyHash()
+   * @return            false if the key was definitely not added to the block
+   */
+  static bool BlockMayContain(span<const uint8_t> block, uint32_t probe_hash)
+      noexcept;
+
+  /** Sets a key's bits in a filter block.
+   *
+   * @param block      a filter block; must have kBlockSize bytes
+   * @param probe_hash the low 32 bits of the key's KeyHash()
+   */
+  static void BlockAdd(span<uint8_t> block, uint32_t probe_hash) noexcept;
+
+ private:
+  /** Finds the filter block that holds a key's bits.
+   *
+   * @param  store        the store that holds the filter
+   * @param  key          the key whose block is computed
+   * @return status       kSuccess or kDataCorrupted
+   * @return page_id      the ID of the filter page that holds the block
+   * @return block_offset the block's offset in the filter page
+   * @return probe_hash   the hash used to compute the key's bits in the block
+   */
+  std::tuple<Status, size_t, size_t, uint32_t> LocateBlock(
+      StoreImpl* store, span<const uint8_t> key) const noexcept;
+
+  size_t first_page_id_;
+  size_t page_count_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_BLOOM_FILTER_H_
@@ -0,0 +1,357 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./bloom_filter.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/catalog.h"
+#include "berrydb/options.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "./read_transaction_impl.h"
+#include "./space_impl.h"
+#include "./test/space_helpers.h"
+#include "./transaction_impl.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+/** The context for SortedKeyPairs(). */
+struct SortedKeys {
+  std::vector<std::string> keys;
+  size_t next = 0;
+};
+
+/** Produces the keys in a SortedKeys, using the keys as values. */
+bool SortedKeyPairs(void* context, span<const uint8_t>* key,
+                    span<const uint8_t>* value) {
+  auto* const sorted_keys = static_cast<SortedKeys*>(context);
+  if (sorted_keys->next == sorted_keys->keys.size())
+    return false;
+  const std::string& next_key = sorted_keys->keys[sorted_keys->next];
+  ++sorted_keys->next;
+  *key = StringSpan(next_key);
+  *value = StringSpan(next_key);
+  return true;
+}
+
+}  // namespace
+
+TEST(BloomFilterTest, PageCount) {
+  // 4096-byte pages hold 3276 keys at 10 bits per key.
+  EXPECT_EQ(1U, BloomFilter::PageCount(1, 4096));
+  EXPECT_EQ(1U, BloomFilter::PageCount(3276, 4096));
+  EXPECT_EQ(2U, BloomFilter::PageCount(3277, 4096));
+  EXPECT_EQ(4U, BloomFilter::PageCount(13000, 4096));
+  EXPECT_EQ(16U, BloomFilter::PageCount(13000, 1024));
+}
+
+TEST(BloomFilterTest, BlockHasNoFalseNegatives) {
+  std::mt19937 rnd;
+  uint8_t block[BloomFilter::kBlockSize] = {};
+  std::vector<uint32_t> hashes;
+  for (int i = 0; i < 51; ++i) {
+    const uint32_t hash = static_cast<uint32_t>(rnd());
+    BloomFilter::BlockAdd(span<uint8_t>(block), hash);
+    hashes.push_back(hash);
+  }
+  for (uint32_t hash : hashes)
+    EXPECT_TRUE(BloomFilter::BlockMayContain(span<const uint8_t>(block), hash));
+}
+
+TEST(BloomFilterTest, BlockFalsePositiveRate) {
+  std::mt19937 rnd;
+  uint8_t block[BloomFilter::kBlockSize] = {};
+  EXPECT_FALSE(BloomFilter::BlockMayContain(span<const uint8_t>(block), 42));
+
+  // A block sized for 51 keys at 10 bits per key.
+  for (int i = 0; i < 51; ++i)
+    BloomFilter::BlockAdd(span<uint8_t>(block), static_cast<uint32_t>(rnd()));
+
+  int false_positives = 0;
+  for (int i = 0; i < 10000; ++i) {
+    if (BloomFilter::BlockMayContain(span<const uint8_t>(block),
+                                     static_cast<uint32_t>(rnd()))) {
+      ++false_positives;
+    }
+  }
+  EXPECT_LT(false_positives, 300);
+}
+
+class BloomFilterSpaceTest : public SpaceTest {
+ protected:
+  BloomFilterSpaceTest() : SpaceTest("test_bloom_filter.berry") {}
+
+  void SetUp() override {
+    SpaceTest::SetUp();
+    OpenStore();
+  }
+
+  /** Creates a space with a filter, and commits its creation. */
+  void CreateSpace(const std::string& name, size_t key_count) {
+    space_options_.bloom_filter_key_count = key_count;
+    SpaceTest::CreateSpace(name);
+  }
+
+  /** True if the space's filter may contain a key, as of a read snapshot. */
+  bool FilterMayContain(ReadTransaction* transaction, const std::string& key) {
+    const BloomFilter& filter = SpaceImpl::FromApi(space_.get())->filter();
+    Status status;
+    bool may_contain;
+    std::tie(status, may_contain) = filter.MayContain(
+        ReadTransactionImpl::FromApi(transaction), StringSpan(key));
+    EXPECT_EQ(Status::kSuccess, status);
+    return may_contain;
+  }
+};
+
+TEST_F(BloomFilterSpaceTest, CreateAddMayContainClear) {
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  TransactionImpl* const transaction_impl =
+      TransactionImpl::FromApi(transaction.get());
+
+  Status status;
+  BloomFilter filter;
+  std::tie(status, filter) = BloomFilter::Create(transaction_impl, 5000);
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(filter.exists());
+  EXPECT_EQ(2U, filter.page_count());
+
+  for (int i = 0; i < 5000; ++i) {
+    ASSERT_EQ(Status::kSuccess, filter.Add(
+        transaction_impl, StringSpan("key" + std::to_string(i))));
+  }
+  bool may_contain;
+  for (int i = 0; i < 5000; ++i) {
+    std::tie(status, may_contain) = filter.MayContain(
+        transaction_impl, StringSpan("key" + std::to_string(i)));
+    ASSERT_EQ(Status::kSuccess, status);
+    ASSERT_TRUE(may_contain) << i;
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 5000; ++i) {
+    std::tie(status, may_contain) = filter.MayContain(
+        transaction_impl, StringSpan("missing" + std::to_string(i)));
+    ASSERT_EQ(Status::kSuccess, status);
+    if (may_contain)
+      ++false_positives;
+  }
+  EXPECT_LT(false_positives, 150);
+
+  ASSERT_EQ(Status::kSuccess, filter.Clear(transaction_impl));
+  std::tie(status, may_contain) =
+      filter.MayContain(transaction_impl, StringSpan("key0"));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_FALSE(may_contain);
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BloomFilterSpaceTest, PutGetDelete) {
+  CreateSpace("space", 1000);
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+      space_.get(), StringSpan("reserved"), 4));
+  ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+      space_.get(), StringSpan("reserved"), 0, StringSpan("data")));
+  EXPECT_EQ("data", Get(transaction.get(), "reserved"));
+
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Delete(space_.get(), StringSpan("key")));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+
+  char buffer[4];
+  Status status;
+  size_t value_size;
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("missing"), 0,
+      span<uint8_t>(reinterpret_cast<uint8_t*>(buffer), sizeof(buffer)));
+  EXPECT_EQ(Status::kNotFound, status);
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BloomFilterSpaceTest, FilterSurvivesReopening) {
+  CreateSpace("space", 1000);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)), StringSpan("value")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) =
+      store_->RootCatalog()->OpenSpace(StringSpan("space"));
+  ASSERT_EQ(Status::kSuccess, status);
+  space_.reset(raw_space);
+  ASSERT_TRUE(SpaceImpl::FromApi(space_.get())->has_filter());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ("value", Get(reader.get(), std::to_string(i)));
+    ASSERT_TRUE(FilterMayContain(reader.get(), std::to_string(i)));
+  }
+  EXPECT_EQ("(missing)", Get(reader.get(), "1000"));
+}
+
+TEST_F(BloomFilterSpaceTest, RebuildDropsDeletedKeys) {
+  CreateSpace("space", 2000);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)), StringSpan("value")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; i += 2) {
+      ASSERT_EQ(Status::kSuccess, transaction->Delete(
+          space_.get(), StringSpan(std::to_string(i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    // Deleted keys stay in the filter until it is rebuilt.
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    for (int i = 0; i < 2000; ++i)
+      ASSERT_TRUE(FilterMayContain(reader.get(), std::to_string(i)));
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->RebuildFilter(space_.get()));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  int false_positives = 0;
+  for (int i = 0; i < 2000; ++i) {
+    if (i % 2 == 1) {
+      ASSERT_TRUE(FilterMayContain(reader.get(), std::to_string(i)));
+      ASSERT_EQ("value", Get(reader.get(), std::to_string(i)));
+    } else {
+      if (FilterMayContain(reader.get(), std::to_string(i)))
+        ++false_positives;
+      ASSERT_EQ("(missing)", Get(reader.get(), std::to_string(i)));
+    }
+  }
+  EXPECT_LT(false_positives, 50);
+}
+
+TEST_F(BloomFilterSpaceTest, BulkLoadFillsFilter) {
+  CreateSpace("space", 3000);
+
+  SortedKeys sorted_keys;
+  for (int i = 1; i <= 3000; ++i)
+    sorted_keys.keys.push_back("key" + std::to_string(100000 + i));
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->BulkLoad(
+        space_.get(), &SortedKeyPairs, &sorted_keys));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 1; i <= 3000; ++i) {
+    const std::string key = "key" + std::to_string(100000 + i);
+    ASSERT_EQ(key, Get(reader.get(), key));
+  }
+  EXPECT_EQ("(missing)", Get(reader.get(), "key100000"));
+}
+
+TEST_F(BloomFilterSpaceTest, RolledBackKeysLeaveFilter) {
+  CreateSpace("space", 100);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("value")));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  EXPECT_FALSE(FilterMayContain(reader.get(), "key"));
+  EXPECT_EQ("(missing)", Get(reader.get(), "key"));
+}
+
+TEST_F(BloomFilterSpaceTest, ReadTransactionsSeeSnapshots) {
+  CreateSpace("space", 100);
+
+  UniquePtr<ReadTransaction> old_reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("value")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  EXPECT_FALSE(FilterMayContain(old_reader.get(), "key"));
+  EXPECT_EQ("(missing)", Get(old_reader.get(), "key"));
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  EXPECT_EQ("value", Get(new_reader.get(), "key"));
+}
+
+TEST_F(BloomFilterSpaceTest, OptimisticTransactions) {
+  CreateSpace("space", 100);
+
+  TransactionOptions options;
+  options.optimistic = true;
+  UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), "key"));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "other key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  EXPECT_EQ("value", Get(reader.get(), "key"));
+}
+
+TEST_F(BloomFilterSpaceTest, UnsupportedOptions) {
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  SpaceOptions options;
+  options.bloom_filter_key_count = 100;
+  options.hashed = true;
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("hashed"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+
+  options.hashed = false;
+  options.integer_key_size = 8;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("integer"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+
+  // Spaces without filters can't rebuild them.
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("plain"));
+  ASSERT_EQ(Status::kSuccess, status);
+  space_.reset(raw_space);
+  EXPECT_EQ(Status::kNotSupported, transaction->RebuildFilter(space_.get()));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+}  // namespace berrydb
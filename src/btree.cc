@@ -0,0 +1,1882 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "berrydb/pinned_value.h"
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree_buffer.h"
+#include "./btree_builder.h"
+#include "./btree_node.h"
+#include "./free_page_manager.h"
+#include "./overflow_value.h"
+#include "./page_pool.h"
+#include "./pinned_page.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/span_util.h"
+#include "./value_log.h"
+
+namespace berrydb {
+
+namespace {
+
+/** Allocates and pins a page for a new tree node. */
+std::tuple<Status, Page*> AllocTreePage(TransactionImpl* transaction) {
+  StoreImpl* const store = transaction->store();
+  const size_t page_id =
+      store->free_page_manager()->AllocPage(transaction, transaction);
+  if (UNLIKELY(page_id == FreePageManager::kInvalidPageId))
+    return {Status::kIoError, nullptr};
+  return store->page_pool()->StorePage(store, page_id,
+                                       PagePool::kIgnorePageData);
+}
+
+/** Overwrites a range of a value stored outside a tree's nodes.
+ *
+ * @param  transaction the transaction that modifies the value
+ * @param  reference   the value's reference, stored in a leaf or a message
+ * @param  offset      the position of the first value byte to be written
+ * @param  data        the bytes to be written
+ * @return             kTooLarge if the range extends past the value's end;
+ *                     otherwise, most likely kSuccess or kIoError
+ */
+Status WriteReferencedValue(TransactionImpl* transaction,
+                            span<const uint8_t> reference, size_t offset,
+                            span<const uint8_t> data) {
+  if (ValueLog::IsReference(reference))
+    return ValueLog::Write(transaction, reference, offset, data);
+  Status status;
+  size_t first_page_id, value_size;
+  std::tie(status, first_page_id, value_size) =
+      OverflowValue::DecodeReference(transaction->store(), reference);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (UNLIKELY(offset > value_size || data.size() > value_size - offset))
+    return Status::kTooLarge;
+  return OverflowValue::Write(transaction, first_page_id, offset, data);
+}
+
+/** Frees the storage of a value stored outside a tree's nodes.
+ *
+ * Values in the value log are reclaimed by compacting the log, so only extents
+ * are freed here.
+ *
+ * @param  transaction the transaction that stops referencing the value
+ * @param  reference   the value's reference, stored in a leaf or a message
+ * @return             most likely kSuccess or kIoError
+ */
+Status FreeReferencedValue(TransactionImpl* transaction,
+                           span<const uint8_t> reference) {
+  if (ValueLog::IsReference(reference))
+    return Status::kSuccess;
+  return OverflowValue::FreeReferencedValue(transaction, reference);
+}
+
+/** The extent of a buffered message that was replaced by another message. */
+struct ReplacedExtent {
+  size_t first_page_id;
+  size_t value_size;
+};
+
+/** Finds the extent of a buffered message that will be replaced.
+ *
+ * @param  store         the store that holds the tree
+ * @param  buffer        the messages in a node's buffer
+ * @param  key           the key of the message that will be added
+ * @return status        kSuccess or kDataCorrupted
+ * @return first_page_id the ID of the extent's first page, or 0 if the buffer
+ *                       doesn't hold a message with an extent for the key
+ * @return value_size    the size of the value stored in the extent
+ */
+std::tuple<Status, size_t, size_t> ReplacedMessageExtent(
+    StoreImpl* store, span<const uint8_t> buffer, span<const uint8_t> key) {
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(buffer, key);
+  if (UNLIKELY(status != Status::kSuccess) || !found)
+    return {status, 0, 0};
+
+  BTreeBuffer::MessageType type;
+  span<const uint8_t> payload;
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(BTreeNode::LeafValue(buffer, index));
+  if (UNLIKELY(status != Status::kSuccess) ||
+      type != BTreeBuffer::MessageType::kPutOverflow) {
+    return {status, 0, 0};
+  }
+  return OverflowValue::DecodeReference(store, payload);
+}
+
+/** Moves the messages for the keys of a split node's right half.
+ *
+ * @param  left      the buffer of the node that was split
+ * @param  separator the smallest key that belongs to the right half
+ * @param  right     the buffer of the right half's node; must be empty
+ * @return           kSuccess or kDataCorrupted
+ */
+Status SplitBuffer(span<uint8_t> left, span<const uint8_t> separator,
+                   span<uint8_t> right) {
+  if (UNLIKELY(BTreeBuffer::IsCorrupt(left)))
+    return Status::kDataCorrupted;
+  Status status;
+  bool found;
+  size_t begin;
+  std::tie(status, found, begin) = BTreeNode::LeafFind(left, separator);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  const size_t end = BTreeNode::EntryCount(left);
+  for (size_t i = begin; i < end; ++i) {
+    span<const uint8_t> key;
+    std::tie(status, key) = BTreeNode::KeySuffix(left, i);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    // The right buffer is as large as the left one, so the messages fit.
+    const bool inserted = BTreeNode::LeafInsert(
+        right, i - begin, key, BTreeNode::LeafValue(left, i));
+    BERRYDB_ASSUME(inserted);
+  }
+  for (size_t i = end; i > begin; --i)
+    BTreeNode::LeafRemove(left, i - 1);
+  return Status::kSuccess;
+}
+
+}  // namespace
+
+// static
+size_t BTree::CheckedChildId(StoreImpl* store, uint64_t page_id64) noexcept {
+  const size_t page_id = static_cast<size_t>(page_id64);
+  // Page 0 is the store's header, so it can never be a child.
+  if (UNLIKELY(page_id != page_id64 || page_id == 0 ||
+               page_id >= store->free_page_manager()->page_count())) {
+    return 0;
+  }
+  return page_id;
+}
+
+// static
+std::tuple<Status, size_t> BTree::Create(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  PagePool* const page_pool = transaction->store()->page_pool();
+  Status status;
+  Page* raw_page;
+  std::tie(status, raw_page) = AllocTreePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage page(raw_page, page_pool);
+
+  BTreeNode::Initialize(
+      BTreeNode::Type::kLeaf, 0,
+      transaction->MutablePageData(page.get(), page_pool->page_size()));
+  return {Status::kSuccess, page->page_id()};
+}
+
+std::tuple<Status, size_t, size_t> BTree::FindLeaf(
+    TransactionImpl* transaction, span<const uint8_t> key,
+    size_t* path) const {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  size_t page_id = root_page_id_;
+  for (size_t depth = 0; depth < kMaxDepth; ++depth) {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> node =
+        NodeData(transaction->PageData(page.get(), page_size));
+    if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+      return {Status::kDataCorrupted, 0, 0};
+    if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf)
+      return {Status::kSuccess, depth, page_id};
+
+    uint64_t child64;
+    std::tie(status, child64) = BTreeNode::InnerChild(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    if (path != nullptr)
+      path[depth] = page_id;
+    page_id = CheckedChildId(store, child64);
+    if (UNLIKELY(page_id == 0))
+      return {Status::kDataCorrupted, 0, 0};
+  }
+  return {Status::kDataCorrupted, 0, 0};
+}
+
+Status BTree::Get(TransactionImpl* transaction, span<const uint8_t> key,
+                  ValueBuffer* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, value);
+  if (UNLIKELY(status != Status::kSuccess) || !is_overflow)
+    return status;
+  if (ValueLog::IsReference(span<const uint8_t>(value->data(), value->size())))
+    return ValueLog::ReadReferencedValue(transaction, value);
+  return OverflowValue::ReadReferencedValue(transaction, value);
+}
+
+Status BTree::Get(ReadTransactionImpl* transaction, span<const uint8_t> key,
+                  ValueBuffer* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, value);
+  if (UNLIKELY(status != Status::kSuccess) || !is_overflow)
+    return status;
+  if (ValueLog::IsReference(span<const uint8_t>(value->data(), value->size())))
+    return ValueLog::ReadReferencedValue(transaction, value);
+  return OverflowValue::ReadReferencedValue(transaction, value);
+}
+
+Status BTree::MultiGet(TransactionImpl* transaction,
+                       span<const span<const uint8_t>> keys,
+                       span<size_t> indexes, span<Status> statuses,
+                       span<PinnedValue> values) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(!buffered_);
+  BERRYDB_ASSUME_EQ(statuses.size(), keys.size());
+  BERRYDB_ASSUME_EQ(values.size(), keys.size());
+
+  if (indexes.empty())
+    return Status::kSuccess;
+  std::sort(indexes.begin(), indexes.end(), [&](size_t lhs, size_t rhs) {
+    return keys[lhs] < keys[rhs];
+  });
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  // Small pools get smaller prefetches, so the prefetched pages aren't evicted
+  // before they are visited. Values in leaves past the pinning budget are
+  // copied, so large batches can't fill the pool with pinned leaves.
+  const size_t max_prefetch_pages = page_pool->page_capacity() / 4;
+  size_t pinned_leaf_budget = page_pool->page_capacity() / 4;
+
+  // The keys at indexes[begin, end) are looked up in the page.
+  struct PageKeys {
+    size_t page_id;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<PageKeys, PlatformAllocator<PageKeys>> level, next_level;
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids;
+  level.push_back({root_page_id_, 0, indexes.size()});
+
+  for (size_t depth = 0; depth < kMaxDepth; ++depth) {
+    next_level.clear();
+    for (const PageKeys& page_keys : level) {
+      Status status;
+      Page* raw_page;
+      std::tie(status, raw_page) = store->FetchPage(page_keys.page_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+
+      const span<const uint8_t> node =
+          transaction->PageData(page.get(), page_size);
+      if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+        return Status::kDataCorrupted;
+
+      if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf) {
+        const bool pin_leaf =
+            !transaction->is_optimistic() && pinned_leaf_budget > 0;
+        if (pin_leaf)
+          --pinned_leaf_budget;
+        for (size_t i = page_keys.begin; i < page_keys.end; ++i) {
+          const size_t key_index = indexes[i];
+          bool found;
+          size_t index;
+          std::tie(status, found, index) =
+              BTreeNode::LeafFind(node, keys[key_index]);
+          if (UNLIKELY(status != Status::kSuccess))
+            return status;
+          if (!found) {
+            statuses[key_index] = Status::kNotFound;
+            continue;
+          }
+
+          PinnedValue* const value = &values[key_index];
+          const span<const uint8_t> entry_value =
+              BTreeNode::LeafValue(node, index);
+          if (BTreeNode::LeafHasOverflowValue(node, index)) {
+            status = ReadReferencedValue(transaction, entry_value, value);
+            if (UNLIKELY(status != Status::kSuccess))
+              return status;
+          } else if (pin_leaf) {
+            page_pool->PinStorePage(page.get());
+            value->Pin(page.get(), page_pool, entry_value, nullptr);
+          } else {
+            CopySpan(entry_value, value->AllocateCopy(entry_value.size()));
+          }
+          statuses[key_index] = Status::kSuccess;
+        }
+        continue;
+      }
+
+      // The keys are sorted, so the keys routed to a child are consecutive.
+      for (size_t i = page_keys.begin; i < page_keys.end; ++i) {
+        uint64_t child64;
+        std::tie(status, child64) =
+            BTreeNode::InnerChild(node, keys[indexes[i]]);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        const size_t child_id = CheckedChildId(store, child64);
+        if (UNLIKELY(child_id == 0))
+          return Status::kDataCorrupted;
+        if (!next_level.empty() && next_level.back().page_id == child_id &&
+            next_level.back().end == i) {
+          ++next_level.back().end;
+        } else {
+          next_level.push_back({child_id, i, i + 1});
+        }
+      }
+    }
+    if (next_level.empty())
+      return Status::kSuccess;
+
+    // Leaves are usually allocated in key order, so sorting the next level's
+    // IDs finds runs of pages that can be read together. Pages outside runs
+    // are fetched when they are visited, which reads them directly into their
+    // pool entries.
+    page_ids.clear();
+    for (const PageKeys& page_keys : next_level)
+      page_ids.push_back(page_keys.page_id);
+    std::sort(page_ids.begin(), page_ids.end());
+    page_ids.erase(std::unique(page_ids.begin(), page_ids.end()),
+                   page_ids.end());
+    size_t prefetch_budget = max_prefetch_pages;
+    size_t run_begin = 0;
+    for (size_t i = 1; i <= page_ids.size() && prefetch_budget > 0; ++i) {
+      if (i < page_ids.size() && page_ids[i] == page_ids[i - 1] + 1)
+        continue;
+      if (i - run_begin > 1) {
+        const size_t run_pages = std::min(i - run_begin, prefetch_budget);
+        const Status status = page_pool->PrefetchStorePages(
+            store, page_ids[run_begin], run_pages);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        prefetch_budget -= run_pages;
+      }
+      run_begin = i;
+    }
+
+    level.swap(next_level);
+  }
+  return Status::kDataCorrupted;
+}
+
+std::tuple<Status, size_t> BTree::ReadValue(
+    TransactionImpl* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  ValueBuffer leaf_value;
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, &leaf_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const span<const uint8_t> entry_value(leaf_value.data(), leaf_value.size());
+  if (is_overflow && ValueLog::IsReference(entry_value))
+    return ValueLog::ReadRange(transaction, entry_value, offset, buffer);
+  return OverflowValue::ReadEntryValueRange(
+      transaction, entry_value, is_overflow, offset, buffer);
+}
+
+std::tuple<Status, size_t> BTree::ReadValue(
+    ReadTransactionImpl* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  ValueBuffer leaf_value;
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, &leaf_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const span<const uint8_t> entry_value(leaf_value.data(), leaf_value.size());
+  if (is_overflow && ValueLog::IsReference(entry_value))
+    return ValueLog::ReadRange(transaction, entry_value, offset, buffer);
+  return OverflowValue::ReadEntryValueRange(
+      transaction, entry_value, is_overflow, offset, buffer);
+}
+
+Status BTree::Get(TransactionImpl* transaction, span<const uint8_t> key,
+                  PinnedValue* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+
+  value->Reset();
+  PagePool* const page_pool = transaction->store()->page_pool();
+  return VisitEntry(transaction, key,
+      [&](Page* page, span<const uint8_t> entry_value, bool is_overflow) {
+        if (is_overflow)
+          return ReadReferencedValue(transaction, entry_value, value);
+        if (transaction->is_optimistic()) {
+          // The entry may be in the transaction's private copy of the page,
+          // which is replaced when the transaction modifies the page.
+          CopySpan(entry_value, value->AllocateCopy(entry_value.size()));
+          return Status::kSuccess;
+        }
+        page_pool->PinStorePage(page);
+        value->Pin(page, page_pool, entry_value, nullptr);
+        return Status::kSuccess;
+      });
+}
+
+Status BTree::Get(ReadTransactionImpl* transaction, span<const uint8_t> key,
+                  PinnedValue* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+
+  value->Reset();
+  PagePool* const page_pool = transaction->store()->page_pool();
+  return VisitEntry(transaction, key,
+      [&](Page* page, span<const uint8_t> entry_value, bool is_overflow) {
+        if (is_overflow)
+          return ReadReferencedValue(transaction, entry_value, value);
+        if (page == nullptr) {
+          // Saved page versions stay unchanged while the transaction is open.
+          value->Point(entry_value);
+          return Status::kSuccess;
+        }
+        page_pool->PinStorePage(page);
+        value->Pin(page, page_pool, entry_value, transaction);
+        return Status::kSuccess;
+      });
+}
+
+// static
+template <typename TransactionType>
+Status BTree::ReadReferencedValue(TransactionType* transaction,
+                                  span<const uint8_t> entry_value,
+                                  PinnedValue* value) {
+  // Reading the value may unpin the page holding the entry.
+  uint8_t reference_bytes[OverflowValue::kReferenceSize];
+  if (UNLIKELY(entry_value.size() > OverflowValue::kReferenceSize))
+    return Status::kDataCorrupted;
+  const span<uint8_t> reference =
+      span<uint8_t>(reference_bytes).first(entry_value.size());
+  CopySpan(entry_value, reference);
+
+  Status status;
+  size_t value_size;
+  if (ValueLog::IsReference(reference)) {
+    std::tie(status, value_size) =
+        ValueLog::ReadRange(transaction, reference, 0, span<uint8_t>());
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    std::tie(status, value_size) = ValueLog::ReadRange(
+        transaction, reference, 0, value->AllocateCopy(value_size));
+    return status;
+  }
+
+  size_t first_page_id;
+  std::tie(status, first_page_id, value_size) =
+      OverflowValue::DecodeReference(transaction->store(), reference);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return OverflowValue::Read(transaction, first_page_id, 0,
+                             value->AllocateCopy(value_size));
+}
+
+template <typename Visitor>
+Status BTree::VisitEntry(TransactionImpl* transaction, span<const uint8_t> key,
+                         Visitor&& visitor) const {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  Status status;
+  Page* raw_page;
+  if (buffered_) {
+    size_t message_page_id, index;
+    std::tie(status, message_page_id, index) = FindMessage(transaction, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (message_page_id != 0) {
+      std::tie(status, raw_page) = store->FetchPage(message_page_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+      span<const uint8_t> message_value;
+      bool is_overflow;
+      std::tie(status, message_value, is_overflow) = MessageValue(
+          BTreeBuffer::Messages(transaction->PageData(
+              page.get(), page_pool->page_size())), index);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      return visitor(page.get(), message_value, is_overflow);
+    }
+  }
+
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) = FindLeaf(transaction, key, nullptr);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  std::tie(status, raw_page) = store->FetchPage(leaf_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_pool->page_size());
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (!found)
+    return Status::kNotFound;
+
+  return visitor(page.get(), BTreeNode::LeafValue(node, index),
+                 BTreeNode::LeafHasOverflowValue(node, index));
+}
+
+template <typename Visitor>
+Status BTree::VisitEntry(ReadTransactionImpl* transaction,
+                         span<const uint8_t> key, Visitor&& visitor) const {
+  StoreImpl* const store = transaction->store();
+  size_t page_id = root_page_id_;
+  for (size_t depth = 0; depth < kMaxDepth; ++depth) {
+    // Each ReadPage() call invalidates the data returned by the previous call,
+    // so the child's ID must be extracted before descending.
+    Status status;
+    span<const uint8_t> page_data;
+    std::tie(status, page_data) = transaction->ReadPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const span<const uint8_t> node = NodeData(page_data);
+    if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+      return Status::kDataCorrupted;
+
+    if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf) {
+      bool found;
+      size_t index;
+      std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (!found)
+        return Status::kNotFound;
+
+      return visitor(transaction->pinned_page(),
+                     BTreeNode::LeafValue(node, index),
+                     BTreeNode::LeafHasOverflowValue(node, index));
+    }
+
+    if (buffered_) {
+      const span<const uint8_t> buffer = BTreeBuffer::Messages(page_data);
+      if (UNLIKELY(BTreeBuffer::IsCorrupt(buffer)))
+        return Status::kDataCorrupted;
+      bool found;
+      size_t index;
+      std::tie(status, found, index) = BTreeNode::LeafFind(buffer, key);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (found) {
+        span<const uint8_t> message_value;
+        bool is_overflow;
+        std::tie(status, message_value, is_overflow) =
+            MessageValue(buffer, index);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        return visitor(transaction->pinned_page(), message_value,
+                       is_overflow);
+      }
+    }
+
+    uint64_t child64;
+    std::tie(status, child64) = BTreeNode::InnerChild(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    page_id = CheckedChildId(store, child64);
+    if (UNLIKELY(page_id == 0))
+      return Status::kDataCorrupted;
+  }
+  return Status::kDataCorrupted;
+}
+
+std::tuple<Status, bool> BTree::FindValue(
+    TransactionImpl* transaction, span<const uint8_t> key,
+    ValueBuffer* value) const {
+  bool is_overflow = false;
+  const Status status = VisitEntry(transaction, key,
+      [&](Page*, span<const uint8_t> entry_value, bool entry_is_overflow) {
+        value->assign(entry_value.begin(), entry_value.end());
+        is_overflow = entry_is_overflow;
+        return Status::kSuccess;
+      });
+  return {status, is_overflow};
+}
+
+std::tuple<Status, bool> BTree::FindValue(
+    ReadTransactionImpl* transaction, span<const uint8_t> key,
+    ValueBuffer* value) const {
+  bool is_overflow = false;
+  const Status status = VisitEntry(transaction, key,
+      [&](Page*, span<const uint8_t> entry_value, bool entry_is_overflow) {
+        value->assign(entry_value.begin(), entry_value.end());
+        is_overflow = entry_is_overflow;
+        return Status::kSuccess;
+      });
+  return {status, is_overflow};
+}
+
+Status BTree::Put(TransactionImpl* transaction, span<const uint8_t> key,
+                  span<const uint8_t> value) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  if (buffered_)
+    return PutBuffered(transaction, key, value.size(), value);
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (value_log_.ShouldStore(key.size(), value.size(), page_size) &&
+      BTreeNode::FitsInLeaf(key.size(), ValueLog::kReferenceSize, page_size)) {
+    return PutLogged(transaction, key, value.size(), value);
+  }
+  if (BTreeNode::FitsInLeaf(key.size(), value.size(), page_size))
+    return PutEntry(transaction, key, value, false);
+  return PutOverflow(transaction, key, value.size(), value);
+}
+
+Status BTree::ReserveValue(TransactionImpl* transaction,
+                           span<const uint8_t> key, size_t value_size) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  if (buffered_)
+    return PutBuffered(transaction, key, value_size, span<const uint8_t>());
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (value_log_.ShouldStore(key.size(), value_size, page_size) &&
+      BTreeNode::FitsInLeaf(key.size(), ValueLog::kReferenceSize, page_size)) {
+    return PutLogged(transaction, key, value_size, span<const uint8_t>());
+  }
+  if (BTreeNode::FitsInLeaf(key.size(), value_size, page_size)) {
+    const ValueBuffer zeros(value_size, 0);
+    return PutEntry(transaction, key,
+                    span<const uint8_t>(zeros.data(), zeros.size()), false);
+  }
+  return PutOverflow(transaction, key, value_size, span<const uint8_t>());
+}
+
+Status BTree::WriteValue(TransactionImpl* transaction,
+                         span<const uint8_t> key, size_t offset,
+                         span<const uint8_t> data) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+  Page* raw_page;
+  if (buffered_) {
+    size_t message_page_id, index;
+    std::tie(status, message_page_id, index) = FindMessage(transaction, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (message_page_id != 0) {
+      std::tie(status, raw_page) = store->FetchPage(message_page_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+
+      BTreeBuffer::MessageType type;
+      span<const uint8_t> payload;
+      std::tie(status, type, payload) =
+          BTreeBuffer::DecodeMessage(BTreeNode::LeafValue(
+              BTreeBuffer::Messages(
+                  transaction->PageData(page.get(), page_size)),
+              index));
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (type == BTreeBuffer::MessageType::kDelete)
+        return Status::kNotFound;
+      if (type == BTreeBuffer::MessageType::kPutOverflow)
+        return WriteReferencedValue(transaction, payload, offset, data);
+
+      if (UNLIKELY(offset > payload.size() ||
+                   data.size() > payload.size() - offset)) {
+        return Status::kTooLarge;
+      }
+      CopySpan(data, BTreeNode::LeafMutableValue(
+          BTreeBuffer::Messages(
+              transaction->MutablePageData(page.get(), page_size)),
+          index).subspan(BTreeBuffer::kMessageHeaderSize + offset,
+                         data.size()));
+      return Status::kSuccess;
+    }
+  }
+
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) = FindLeaf(transaction, key, nullptr);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  std::tie(status, raw_page) = store->FetchPage(leaf_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_size);
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (!found)
+    return Status::kNotFound;
+
+  const span<const uint8_t> leaf_value = BTreeNode::LeafValue(node, index);
+  if (BTreeNode::LeafHasOverflowValue(node, index)) {
+    // The leaf is not modified, because the reference stays the same.
+    return WriteReferencedValue(transaction, leaf_value, offset, data);
+  }
+
+  if (UNLIKELY(offset > leaf_value.size() ||
+               data.size() > leaf_value.size() - offset)) {
+    return Status::kTooLarge;
+  }
+  CopySpan(data, BTreeNode::LeafMutableValue(
+      transaction->MutablePageData(page.get(), page_size), index).subspan(
+          offset, data.size()));
+  return Status::kSuccess;
+}
+
+Status BTree::PutOverflow(TransactionImpl* transaction,
+                          span<const uint8_t> key, size_t value_size,
+                          span<const uint8_t> data) {
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (UNLIKELY(!BTreeNode::FitsInLeaf(
+          key.size(), OverflowValue::kReferenceSize, page_size))) {
+    return Status::kTooLarge;
+  }
+
+  Status status;
+  size_t first_page_id;
+  std::tie(status, first_page_id) =
+      OverflowValue::Create(transaction, value_size, data);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  uint8_t reference[OverflowValue::kReferenceSize];
+  OverflowValue::EncodeReference(first_page_id, value_size,
+                                 span<uint8_t>(reference));
+  return PutEntry(transaction, key, span<const uint8_t>(reference), true);
+}
+
+Status BTree::PutLogged(TransactionImpl* transaction, span<const uint8_t> key,
+                        size_t value_size, span<const uint8_t> data) {
+  uint8_t reference[ValueLog::kReferenceSize];
+  const Status status = value_log_.Append(transaction, key, value_size, data,
+                                          span<uint8_t>(reference));
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return PutEntry(transaction, key, span<const uint8_t>(reference), true);
+}
+
+Status BTree::PutEntry(TransactionImpl* transaction, span<const uint8_t> key,
+                       span<const uint8_t> value, bool is_overflow) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  BERRYDB_ASSUME(BTreeNode::FitsInLeaf(key.size(), value.size(), page_size));
+
+  size_t path[kMaxDepth];
+  Status status;
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) = FindLeaf(transaction, key, path);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The leaf is built in a scratch buffer if it overflows. The buffer can hold
+  // two pages, so the new entry always fits.
+  const size_t scratch_size = page_size * 2;
+  uint8_t* const scratch_buffer =
+      reinterpret_cast<uint8_t*>(Allocate(scratch_size));
+  const span<uint8_t> scratch(scratch_buffer, scratch_size);
+  {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(leaf_id);
+    if (UNLIKELY(status != Status::kSuccess)) {
+      Deallocate(scratch_buffer, scratch_size);
+      return status;
+    }
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<uint8_t> node =
+        transaction->MutablePageData(page.get(), page_size);
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+    if (UNLIKELY(status != Status::kSuccess)) {
+      Deallocate(scratch_buffer, scratch_size);
+      return status;
+    }
+    // The removed entry's index is the insertion point for the new entry.
+    if (found) {
+      if (BTreeNode::LeafHasOverflowValue(node, index)) {
+        status =
+            FreeReferencedValue(transaction, BTreeNode::LeafValue(node, index));
+        if (UNLIKELY(status != Status::kSuccess)) {
+          Deallocate(scratch_buffer, scratch_size);
+          return status;
+        }
+      }
+      BTreeNode::LeafRemove(node, index);
+    }
+    if (BTreeNode::LeafInsert(node, index, key, value, is_overflow)) {
+      Deallocate(scratch_buffer, scratch_size);
+      return Status::kSuccess;
+    }
+
+    BTreeNode::CopyNode(node, scratch);
+    const bool inserted =
+        BTreeNode::LeafInsert(scratch, index, key, value, is_overflow);
+    BERRYDB_ASSUME(inserted);
+  }
+
+  ValueBuffer separator;
+  size_t right_page_id;
+  std::tie(status, right_page_id) =
+      SplitNode(transaction, path, depth, leaf_id, key, scratch,
+                &separator);
+  if (LIKELY(status == Status::kSuccess) && right_page_id != 0) {
+    status = InsertSeparator(transaction, path, depth, key, &separator,
+                             right_page_id, scratch);
+  }
+  Deallocate(scratch_buffer, scratch_size);
+  return status;
+}
+
+Status BTree::Delete(TransactionImpl* transaction, span<const uint8_t> key) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  if (!buffered_)
+    return DeleteEntry(transaction, key);
+
+  // Keys that don't fit in a message can't be stored in the tree.
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (UNLIKELY(!BTreeBuffer::FitsInBuffer(key.size(), 0, page_size)))
+    return Status::kNotFound;
+  uint8_t message[BTreeBuffer::kMessageHeaderSize];
+  BTreeBuffer::EncodeMessage(BTreeBuffer::MessageType::kDelete,
+                             span<const uint8_t>(), span<uint8_t>(message));
+  return PutMessage(transaction, key, span<const uint8_t>(message));
+}
+
+Status BTree::DeleteEntry(TransactionImpl* transaction,
+                          span<const uint8_t> key) {
+  Status status;
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) = FindLeaf(transaction, key, nullptr);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(leaf_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  // The leaf is only modified if it has the key.
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(
+      transaction->PageData(page.get(), page_size), key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (!found)
+    return Status::kNotFound;
+
+  const span<uint8_t> node =
+      transaction->MutablePageData(page.get(), page_size);
+  if (BTreeNode::LeafHasOverflowValue(node, index)) {
+    status = FreeReferencedValue(transaction, BTreeNode::LeafValue(node, index));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  // Underflowing leaves are not merged with their siblings. Emptied leaves stay
+  // in the tree, and are reused by later insertions in their key range.
+  BTreeNode::LeafRemove(node, index);
+  return Status::kSuccess;
+}
+
+Status BTree::ApplyBatch(TransactionImpl* transaction,
+                         span<const WriteBatchImpl::Operation> operations) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(!buffered_);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  size_t path[kMaxDepth];
+  ValueBuffer lower, upper;
+  size_t i = 0;
+  while (i < operations.size()) {
+    Status status;
+    size_t depth, leaf_id;
+    std::tie(status, depth, leaf_id) =
+        FindLeaf(transaction, operations[i].key, path);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    // The operations are sorted, so the leaf's lower fence only matters for
+    // the first operation, which was routed to the leaf.
+    status = FindFences(transaction, path, depth, operations[i].key, &lower,
+                        &upper);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const span<const uint8_t> upper_fence(upper.data(), upper.size());
+
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(leaf_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    // Set when an operation goes through Put(), which may split the leaf.
+    bool leaf_changed = false;
+    for (; i < operations.size() && !leaf_changed; ++i) {
+      const WriteBatchImpl::Operation& operation = operations[i];
+      if (!upper_fence.empty() && !(operation.key < upper_fence))
+        break;
+
+      const bool is_put =
+          operation.type == WriteBatchImpl::OperationType::kPut;
+      if (is_put &&
+          ((value_log_.ShouldStore(operation.key.size(),
+                                   operation.value.size(), page_size) &&
+            BTreeNode::FitsInLeaf(operation.key.size(),
+                                  ValueLog::kReferenceSize, page_size)) ||
+           !BTreeNode::FitsInLeaf(operation.key.size(), operation.value.size(),
+                                  page_size))) {
+        status = Put(transaction, operation.key, operation.value);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        leaf_changed = true;
+        continue;
+      }
+
+      bool found;
+      size_t index;
+      std::tie(status, found, index) = BTreeNode::LeafFind(
+          transaction->PageData(page.get(), page_size), operation.key);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (!found && !is_put)
+        continue;
+
+      const span<uint8_t> node =
+          transaction->MutablePageData(page.get(), page_size);
+      if (found) {
+        if (BTreeNode::LeafHasOverflowValue(node, index)) {
+          status = FreeReferencedValue(transaction,
+                                       BTreeNode::LeafValue(node, index));
+          if (UNLIKELY(status != Status::kSuccess))
+            return status;
+        }
+        BTreeNode::LeafRemove(node, index);
+      }
+      if (!is_put ||
+          BTreeNode::LeafInsert(node, index, operation.key, operation.value)) {
+        continue;
+      }
+
+      // The leaf must be split. PutEntry() finds the same leaf again, which
+      // doesn't have the key anymore.
+      status = PutEntry(transaction, operation.key, operation.value, false);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      leaf_changed = true;
+    }
+  }
+  return Status::kSuccess;
+}
+
+Status BTree::PutBuffered(TransactionImpl* transaction,
+                          span<const uint8_t> key, size_t value_size,
+                          span<const uint8_t> data) {
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  ValueBuffer message;
+  if (BTreeBuffer::FitsInBuffer(key.size(), value_size, page_size)) {
+    // The value's bytes past the data's end stay zero.
+    message.resize(BTreeBuffer::kMessageHeaderSize + value_size);
+    BTreeBuffer::EncodeMessage(
+        BTreeBuffer::MessageType::kPut, data,
+        span<uint8_t>(message.data(),
+                      BTreeBuffer::kMessageHeaderSize + data.size()));
+  } else {
+    if (UNLIKELY(!BTreeBuffer::FitsInBuffer(
+            key.size(), OverflowValue::kReferenceSize, page_size))) {
+      return Status::kTooLarge;
+    }
+    Status status;
+    size_t first_page_id;
+    std::tie(status, first_page_id) =
+        OverflowValue::Create(transaction, value_size, data);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+
+    uint8_t reference[OverflowValue::kReferenceSize];
+    OverflowValue::EncodeReference(first_page_id, value_size,
+                                   span<uint8_t>(reference));
+    message.resize(BTreeBuffer::kMessageHeaderSize +
+                   OverflowValue::kReferenceSize);
+    BTreeBuffer::EncodeMessage(
+        BTreeBuffer::MessageType::kPutOverflow,
+        span<const uint8_t>(reference),
+        span<uint8_t>(message.data(), message.size()));
+  }
+  return PutMessage(transaction, key,
+                    span<const uint8_t>(message.data(), message.size()));
+}
+
+Status BTree::PutMessage(TransactionImpl* transaction,
+                         span<const uint8_t> key,
+                         span<const uint8_t> message) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  // Each flush moves at least one message down the tree, so the loop ends.
+  while (true) {
+    {
+      Status status;
+      Page* raw_page;
+      std::tie(status, raw_page) = store->FetchPage(root_page_id_);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+
+      const span<const uint8_t> page_data =
+          transaction->PageData(page.get(), page_size);
+      const span<const uint8_t> node = NodeData(page_data);
+      if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+        return Status::kDataCorrupted;
+      if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf)
+        break;
+      if (UNLIKELY(BTreeBuffer::IsCorrupt(BTreeBuffer::Messages(page_data))))
+        return Status::kDataCorrupted;
+
+      size_t replaced_page_id, replaced_value_size;
+      std::tie(status, replaced_page_id, replaced_value_size) =
+          ReplacedMessageExtent(store, BTreeBuffer::Messages(page_data), key);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      bool added;
+      std::tie(status, added) = BTreeBuffer::Add(
+          BTreeBuffer::Messages(
+              transaction->MutablePageData(page.get(), page_size)),
+          key, message);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (added) {
+        if (replaced_page_id == 0)
+          return Status::kSuccess;
+        return OverflowValue::Free(transaction, replaced_page_id,
+                                   replaced_value_size);
+      }
+    }
+
+    const Status status = FlushBuffer(transaction, root_page_id_, 0);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+
+  // A tree whose root is a leaf has no buffers.
+  return ApplyMessage(transaction, key, message);
+}
+
+Status BTree::FlushBuffer(TransactionImpl* transaction, size_t page_id,
+                          size_t depth) {
+  if (UNLIKELY(depth >= kMaxDepth))
+    return Status::kDataCorrupted;
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  const size_t buffer_size = page_size - BTreeBuffer::NodeSize(page_size);
+
+  // The batch is read from a copy of the buffer, because the flushed node's
+  // page changes while the batch is applied.
+  ValueBuffer batch_copy(buffer_size);
+  const span<uint8_t> batch(batch_copy.data(), buffer_size);
+  size_t batch_begin = 0, batch_end = 0, child_id;
+  {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> page_data =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(BTreeNode::NodeType(page_data) != BTreeNode::Type::kInner))
+      return Status::kDataCorrupted;
+    const span<const uint8_t> node = BTreeBuffer::Node(page_data);
+    const span<const uint8_t> buffer = BTreeBuffer::Messages(page_data);
+    if (UNLIKELY(BTreeNode::IsCorrupt(node) ||
+                 BTreeBuffer::IsCorrupt(buffer))) {
+      return Status::kDataCorrupted;
+    }
+
+    // The messages are sorted by key, so the messages routed to each child
+    // are consecutive.
+    const size_t message_count = BTreeNode::EntryCount(buffer);
+    size_t batch_child = 0, batch_bytes = 0;
+    size_t run_begin = 0, run_child = 0, run_bytes = 0;
+    for (size_t i = 0; i < message_count; ++i) {
+      span<const uint8_t> message_key;
+      std::tie(status, message_key) = BTreeNode::KeySuffix(buffer, i);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      size_t child;
+      std::tie(status, child) = BTreeNode::InnerFind(node, message_key);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+
+      if (i == 0 || child != run_child) {
+        run_begin = i;
+        run_child = child;
+        run_bytes = 0;
+      }
+      run_bytes += message_key.size() + BTreeNode::LeafValue(buffer, i).size();
+      if (run_bytes > batch_bytes) {
+        batch_begin = run_begin;
+        batch_end = i + 1;
+        batch_child = run_child;
+        batch_bytes = run_bytes;
+      }
+    }
+    if (batch_end == 0)
+      return Status::kSuccess;
+
+    uint64_t child64;
+    std::tie(status, child64) = BTreeNode::InnerChildAt(node, batch_child);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    child_id = CheckedChildId(store, child64);
+    if (UNLIKELY(child_id == 0))
+      return Status::kDataCorrupted;
+    CopySpan(buffer, batch);
+  }
+
+  bool child_is_leaf;
+  {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(child_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> page_data =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(BTreeNode::IsCorrupt(NodeData(page_data))))
+      return Status::kDataCorrupted;
+    child_is_leaf =
+        BTreeNode::NodeType(page_data) == BTreeNode::Type::kLeaf;
+
+    if (!child_is_leaf) {
+      // The batch is added to a copy of the child's buffer, so the child's
+      // page is not modified if the batch doesn't fit.
+      ValueBuffer child_copy(buffer_size);
+      const span<uint8_t> child_buffer(child_copy.data(), buffer_size);
+      CopySpan(BTreeBuffer::Messages(page_data), child_buffer);
+      if (UNLIKELY(BTreeBuffer::IsCorrupt(child_buffer)))
+        return Status::kDataCorrupted;
+
+      // The extents of the child's messages that are replaced by the batch
+      // are only freed if the whole batch fits.
+      std::vector<ReplacedExtent, PlatformAllocator<ReplacedExtent>>
+          replaced_extents;
+      bool fits = true;
+      for (size_t i = batch_begin; i < batch_end && fits; ++i) {
+        span<const uint8_t> message_key;
+        std::tie(status, message_key) = BTreeNode::KeySuffix(batch, i);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        size_t replaced_page_id, replaced_value_size;
+        std::tie(status, replaced_page_id, replaced_value_size) =
+            ReplacedMessageExtent(store, child_buffer, message_key);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        std::tie(status, fits) = BTreeBuffer::Add(
+            child_buffer, message_key, BTreeNode::LeafValue(batch, i));
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        if (fits && replaced_page_id != 0)
+          replaced_extents.push_back({replaced_page_id, replaced_value_size});
+      }
+      if (!fits)
+        return FlushBuffer(transaction, child_id, depth + 1);
+      CopySpan(child_buffer, BTreeBuffer::Messages(
+          transaction->MutablePageData(page.get(), page_size)));
+      for (const ReplacedExtent& extent : replaced_extents) {
+        status = OverflowValue::Free(transaction, extent.first_page_id,
+                                     extent.value_size);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+    }
+  }
+
+  // The batch leaves the node's buffer before it is applied to a leaf, because
+  // applying it may split the node, which moves some of its messages.
+  {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<uint8_t> buffer = BTreeBuffer::Messages(
+        transaction->MutablePageData(page.get(), page_size));
+    for (size_t i = batch_end; i > batch_begin; --i)
+      BTreeNode::LeafRemove(buffer, i - 1);
+  }
+  if (!child_is_leaf)
+    return Status::kSuccess;
+
+  for (size_t i = batch_begin; i < batch_end; ++i) {
+    Status status;
+    span<const uint8_t> message_key;
+    std::tie(status, message_key) = BTreeNode::KeySuffix(batch, i);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    status = ApplyMessage(transaction, message_key,
+                          BTreeNode::LeafValue(batch, i));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  return Status::kSuccess;
+}
+
+Status BTree::ApplyMessage(TransactionImpl* transaction,
+                           span<const uint8_t> key,
+                           span<const uint8_t> message) {
+  Status status;
+  BTreeBuffer::MessageType type;
+  span<const uint8_t> payload;
+  std::tie(status, type, payload) = BTreeBuffer::DecodeMessage(message);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  switch (type) {
+    case BTreeBuffer::MessageType::kPut:
+      return PutEntry(transaction, key, payload, false);
+    case BTreeBuffer::MessageType::kPutOverflow:
+      return PutEntry(transaction, key, payload, true);
+    case BTreeBuffer::MessageType::kDelete:
+      // Deletions are buffered without checking that the key exists.
+      status = DeleteEntry(transaction, key);
+      return (status == Status::kNotFound) ? Status::kSuccess : status;
+  }
+  BERRYDB_UNREACHABLE();
+}
+
+std::tuple<Status, size_t, size_t> BTree::FindMessage(
+    TransactionImpl* transaction, span<const uint8_t> key) const {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  size_t page_id = root_page_id_;
+  for (size_t depth = 0; depth < kMaxDepth; ++depth) {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> page_data =
+        transaction->PageData(page.get(), page_size);
+    const span<const uint8_t> node = NodeData(page_data);
+    if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+      return {Status::kDataCorrupted, 0, 0};
+    if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf)
+      return {Status::kSuccess, 0, 0};
+
+    const span<const uint8_t> buffer = BTreeBuffer::Messages(page_data);
+    if (UNLIKELY(BTreeBuffer::IsCorrupt(buffer)))
+      return {Status::kDataCorrupted, 0, 0};
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(buffer, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    if (found)
+      return {Status::kSuccess, page_id, index};
+
+    uint64_t child64;
+    std::tie(status, child64) = BTreeNode::InnerChild(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    page_id = CheckedChildId(store, child64);
+    if (UNLIKELY(page_id == 0))
+      return {Status::kDataCorrupted, 0, 0};
+  }
+  return {Status::kDataCorrupted, 0, 0};
+}
+
+// static
+std::tuple<Status, span<const uint8_t>, bool> BTree::MessageValue(
+    span<const uint8_t> buffer, size_t index) {
+  Status status;
+  BTreeBuffer::MessageType type;
+  span<const uint8_t> payload;
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(BTreeNode::LeafValue(buffer, index));
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, payload, false};
+  if (type == BTreeBuffer::MessageType::kDelete)
+    return {Status::kNotFound, payload, false};
+  return {Status::kSuccess, payload,
+          type == BTreeBuffer::MessageType::kPutOverflow};
+}
+
+Status BTree::BulkLoad(TransactionImpl* transaction, BulkLoadSource source,
+                       void* context) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(!buffered_);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(root_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage root(raw_page, page_pool);
+
+  // Trees are only empty if their root is an empty leaf.
+  const span<const uint8_t> root_node =
+      transaction->PageData(root.get(), page_size);
+  if (UNLIKELY(BTreeNode::IsCorrupt(root_node)))
+    return Status::kDataCorrupted;
+  if (BTreeNode::NodeType(root_node) != BTreeNode::Type::kLeaf ||
+      BTreeNode::EntryCount(root_node) != 0) {
+    return Status::kAlreadyExists;
+  }
+
+  BTreeBuilder builder(transaction);
+  uint8_t reference[OverflowValue::kReferenceSize];
+  span<const uint8_t> key, value;
+  while (source(context, &key, &value)) {
+    if (BTreeNode::FitsInLeaf(key.size(), value.size(), page_size)) {
+      status = builder.Add(key, value, false);
+    } else {
+      if (UNLIKELY(!BTreeNode::FitsInLeaf(
+              key.size(), OverflowValue::kReferenceSize, page_size))) {
+        return Status::kTooLarge;
+      }
+      size_t first_page_id;
+      std::tie(status, first_page_id) =
+          OverflowValue::Create(transaction, value.size(), value);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      OverflowValue::EncodeReference(first_page_id, value.size(),
+                                     span<uint8_t>(reference));
+      status = builder.Add(key, span<const uint8_t>(reference), true);
+    }
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+
+  status = builder.Finish();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // This is the only logged change to the tree's nodes. It makes the pages
+  // written by the builder reachable.
+  const span<const uint8_t> new_root_node = builder.RootNode();
+  if (!new_root_node.empty()) {
+    CopySpan(new_root_node,
+             transaction->MutablePageData(root.get(), page_size));
+  }
+  return Status::kSuccess;
+}
+
+Status BTree::ForEachKey(TransactionImpl* transaction, KeyVisitor visitor,
+                         void* context) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(visitor != nullptr);
+  BERRYDB_ASSUME(!buffered_);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  // Inner nodes link to their leftmost child, so following the links from the
+  // root leads to the first leaf.
+  size_t page_id = root_page_id_;
+  for (size_t depth = 0; ; ++depth) {
+    if (UNLIKELY(depth > kMaxDepth))
+      return Status::kDataCorrupted;
+
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    const span<const uint8_t> node =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+      return Status::kDataCorrupted;
+    if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf)
+      break;
+
+    page_id = CheckedChildId(store, BTreeNode::Link64(node));
+    if (UNLIKELY(page_id == 0))
+      return Status::kDataCorrupted;
+  }
+
+  // A leaf chain longer than the store's page count has a cycle.
+  const size_t max_leaf_count = store->free_page_manager()->page_count();
+  ValueBuffer key;
+  for (size_t leaf_count = 0; ; ++leaf_count) {
+    if (UNLIKELY(leaf_count >= max_leaf_count))
+      return Status::kDataCorrupted;
+
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    const span<const uint8_t> node =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(BTreeNode::IsCorrupt(node) ||
+                 BTreeNode::NodeType(node) != BTreeNode::Type::kLeaf)) {
+      return Status::kDataCorrupted;
+    }
+
+    const span<const uint8_t> prefix = BTreeNode::Prefix(node);
+    const size_t entry_count = BTreeNode::EntryCount(node);
+    for (size_t i = 0; i < entry_count; ++i) {
+      span<const uint8_t> suffix;
+      std::tie(status, suffix) = BTreeNode::KeySuffix(node, i);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      key.assign(prefix.begin(), prefix.end());
+      key.insert(key.end(), suffix.begin(), suffix.end());
+      status = visitor(context, span<const uint8_t>(key.data(), key.size()));
+      if (status != Status::kSuccess)
+        return status;
+    }
+
+    const uint64_t next_page_id64 = BTreeNode::Link64(node);
+    if (next_page_id64 == 0)
+      return Status::kSuccess;
+    page_id = CheckedChildId(store, next_page_id64);
+    if (UNLIKELY(page_id == 0))
+      return Status::kDataCorrupted;
+  }
+}
+
+Status BTree::CompactValueLog(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value_log_.exists());
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  Status status;
+  size_t segment_id, newest_segment_id;
+  std::tie(status, segment_id, newest_segment_id) =
+      value_log_.Segments(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The records copied out of the compacted segments are appended after the
+  // newest segment's records, so the newest segment is not compacted. A segment
+  // chain longer than the store's page count has a cycle.
+  const size_t max_segment_count = store->free_page_manager()->page_count();
+  ValueBuffer log_page(page_size);
+  ValueBuffer leaf_value;
+  for (size_t segment_count = 0; segment_id != newest_segment_id;
+       ++segment_count) {
+    if (UNLIKELY(segment_id == 0 || segment_count >= max_segment_count))
+      return Status::kDataCorrupted;
+
+    for (size_t i = 0; i < ValueLog::kSegmentPageCount; ++i) {
+      const size_t page_id = segment_id + i;
+      if (UNLIKELY(CheckedChildId(store, page_id) == 0))
+        return Status::kDataCorrupted;
+
+      // The page is copied because the appends below may be made by the same
+      // transaction that reads the page.
+      {
+        Page* raw_page;
+        std::tie(status, raw_page) = store->FetchPage(page_id);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        const PinnedPage page(raw_page, page_pool);
+        CopySpan(transaction->PageData(page.get(), page_size),
+                 span<uint8_t>(log_page.data(), page_size));
+      }
+      const span<const uint8_t> page_data(log_page.data(), page_size);
+
+      const size_t page_end = ValueLog::PageEnd(page_data);
+      size_t record_offset = ValueLog::kPageHeaderSize;
+      while (record_offset < page_end) {
+        span<const uint8_t> record_key, record_value;
+        std::tie(status, record_key, record_value) =
+            ValueLog::DecodeRecord(page_data, record_offset);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+
+        bool is_overflow;
+        std::tie(status, is_overflow) =
+            FindValue(transaction, record_key, &leaf_value);
+        if (status == Status::kSuccess && is_overflow &&
+            ValueLog::IsReference(span<const uint8_t>(leaf_value.data(),
+                                                      leaf_value.size()))) {
+          size_t live_page_id, live_offset;
+          std::tie(status, live_page_id, live_offset) =
+              ValueLog::DecodeReference(store, span<const uint8_t>(
+                  leaf_value.data(), leaf_value.size()));
+          if (UNLIKELY(status != Status::kSuccess))
+            return status;
+          if (live_page_id == page_id && live_offset == record_offset) {
+            status = PutLogged(transaction, record_key, record_value.size(),
+                               record_value);
+            if (UNLIKELY(status != Status::kSuccess))
+              return status;
+          }
+        } else if (UNLIKELY(status != Status::kSuccess &&
+                            status != Status::kNotFound)) {
+          return status;
+        }
+
+        record_offset += ValueLog::kRecordHeaderSize + record_key.size() +
+                         record_value.size();
+      }
+    }
+
+    status = value_log_.RecycleOldestSegment(transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    size_t unused_newest_segment_id;
+    std::tie(status, segment_id, unused_newest_segment_id) =
+        value_log_.Segments(transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  return Status::kSuccess;
+}
+
+Status BTree::Free(TransactionImpl* transaction) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  FreePageManager* const free_page_manager = store->free_page_manager();
+
+  // The tree is walked depth-first. A tree with more nodes than the store has
+  // pages has a cycle.
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids;
+  page_ids.push_back(root_page_id_);
+  const size_t max_node_count = free_page_manager->page_count();
+  for (size_t node_count = 0; !page_ids.empty(); ++node_count) {
+    if (UNLIKELY(node_count >= max_node_count))
+      return Status::kDataCorrupted;
+    const size_t page_id = page_ids.back();
+    page_ids.pop_back();
+
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    const span<const uint8_t> page_data =
+        transaction->PageData(page.get(), page_size);
+    const span<const uint8_t> node = NodeData(page_data);
+    if (UNLIKELY(BTreeNode::IsCorrupt(node)))
+      return Status::kDataCorrupted;
+
+    if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf) {
+      const size_t entry_count = BTreeNode::EntryCount(node);
+      for (size_t i = 0; i < entry_count; ++i) {
+        if (!BTreeNode::LeafHasOverflowValue(node, i))
+          continue;
+        status =
+            FreeReferencedValue(transaction, BTreeNode::LeafValue(node, i));
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+    } else {
+      const size_t entry_count = BTreeNode::EntryCount(node);
+      for (size_t i = 0; i <= entry_count; ++i) {
+        uint64_t child64;
+        std::tie(status, child64) = BTreeNode::InnerChildAt(node, i);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        const size_t child_id = CheckedChildId(store, child64);
+        if (UNLIKELY(child_id == 0))
+          return Status::kDataCorrupted;
+        page_ids.push_back(child_id);
+      }
+
+      if (buffered_) {
+        // Each extent is referenced by a single message or leaf entry, because
+        // messages free the extents that they replace.
+        const span<const uint8_t> buffer = BTreeBuffer::Messages(page_data);
+        if (UNLIKELY(BTreeBuffer::IsCorrupt(buffer)))
+          return Status::kDataCorrupted;
+        const size_t message_count = BTreeNode::EntryCount(buffer);
+        for (size_t i = 0; i < message_count; ++i) {
+          span<const uint8_t> value;
+          bool is_overflow;
+          std::tie(status, value, is_overflow) = MessageValue(buffer, i);
+          if (status == Status::kNotFound)
+            continue;
+          if (UNLIKELY(status != Status::kSuccess))
+            return status;
+          if (!is_overflow)
+            continue;
+          status = OverflowValue::FreeReferencedValue(transaction, value);
+          if (UNLIKELY(status != Status::kSuccess))
+            return status;
+        }
+      }
+    }
+
+    status = free_page_manager->FreePage(page_id, transaction, transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  return Status::kSuccess;
+}
+
+Status BTree::FindFences(
+    TransactionImpl* transaction, const size_t* path, size_t depth,
+    span<const uint8_t> key, ValueBuffer* lower, ValueBuffer* upper) const {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  // The tree's root covers all the keys.
+  lower->clear();
+  upper->clear();
+  // Each ancestor narrows down the range of the next node on the path.
+  for (size_t i = 0; i < depth; ++i) {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(path[i]);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    // FindLeaf() checked the page's header.
+    const span<const uint8_t> node =
+        NodeData(transaction->PageData(page.get(), page_size));
+    size_t index;
+    std::tie(status, index) = BTreeNode::InnerFind(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+
+    const span<const uint8_t> prefix = BTreeNode::Prefix(node);
+    span<const uint8_t> suffix;
+    if (index > 0) {
+      std::tie(status, suffix) = BTreeNode::KeySuffix(node, index - 1);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      lower->assign(prefix.begin(), prefix.end());
+      lower->insert(lower->end(), suffix.begin(), suffix.end());
+    }
+    if (index < BTreeNode::EntryCount(node)) {
+      std::tie(status, suffix) = BTreeNode::KeySuffix(node, index);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      upper->assign(prefix.begin(), prefix.end());
+      upper->insert(upper->end(), suffix.begin(), suffix.end());
+    }
+  }
+  return Status::kSuccess;
+}
+
+std::tuple<Status, size_t> BTree::SplitNode(
+    TransactionImpl* transaction, const size_t* path, size_t depth,
+    size_t page_id, span<const uint8_t> key, span<const uint8_t> node,
+    ValueBuffer* separator) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  // The halves of a buffered tree's inner nodes get empty buffers, which use
+  // the rest of their pages.
+  const bool is_inner = BTreeNode::NodeType(node) == BTreeNode::Type::kInner;
+  const size_t node_size = NodeSize(BTreeNode::NodeType(node), page_size);
+  const bool has_buffers = node_size != page_size;
+
+  // The node's key range determines the prefixes of the halves. Splitting also
+  // relies on the node's entries being consistent with the range.
+  ValueBuffer lower, upper;
+  Status status = FindFences(transaction, path, depth, key, &lower, &upper);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const span<const uint8_t> lower_fence(lower.data(), lower.size());
+  const span<const uint8_t> upper_fence(upper.data(), upper.size());
+  if (UNLIKELY(!BTreeNode::HasValidEntries(node, lower_fence, upper_fence)))
+    return {Status::kDataCorrupted, 0};
+  separator->resize(BTreeNode::MaxKeySize(page_size));
+  const span<uint8_t> separator_buffer(separator->data(), separator->size());
+
+  Page* raw_right_page;
+  std::tie(status, raw_right_page) = AllocTreePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage right_page(raw_right_page, page_pool);
+  const size_t right_page_id = right_page->page_id();
+  const span<uint8_t> right_data =
+      transaction->MutablePageData(right_page.get(), page_size);
+  if (has_buffers) {
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0,
+                          BTreeBuffer::Messages(right_data));
+  }
+  const span<uint8_t> right = right_data.first(node_size);
+
+  if (page_id != root_page_id_) {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0};
+    const PinnedPage page(raw_page, page_pool);
+    const span<uint8_t> page_data =
+        transaction->MutablePageData(page.get(), page_size);
+
+    const size_t separator_size = BTreeNode::Split(
+        node, lower_fence, upper_fence, page_data.first(node_size), right,
+        right_page_id, separator_buffer);
+    separator->resize(separator_size);
+    if (has_buffers) {
+      status = SplitBuffer(
+          BTreeBuffer::Messages(page_data),
+          span<const uint8_t>(separator->data(), separator->size()),
+          BTreeBuffer::Messages(right_data));
+      if (UNLIKELY(status != Status::kSuccess))
+        return {status, 0};
+    }
+    return {Status::kSuccess, right_page_id};
+  }
+
+  // The root page stays in place, so it gets two new children.
+  Page* raw_left_page;
+  std::tie(status, raw_left_page) = AllocTreePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage left_page(raw_left_page, page_pool);
+  const size_t left_page_id = left_page->page_id();
+  const span<uint8_t> left_data =
+      transaction->MutablePageData(left_page.get(), page_size);
+  if (has_buffers) {
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0,
+                          BTreeBuffer::Messages(left_data));
+  }
+
+  const size_t separator_size = BTreeNode::Split(
+      node, lower_fence, upper_fence, left_data.first(node_size), right,
+      right_page_id, separator_buffer);
+  const span<const uint8_t> separator_key(separator->data(), separator_size);
+
+  Page* raw_root_page;
+  std::tie(status, raw_root_page) = store->FetchPage(root_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage root_page(raw_root_page, page_pool);
+
+  span<uint8_t> root =
+      transaction->MutablePageData(root_page.get(), page_size);
+  if (buffered_) {
+    // The root still covers all the keys, so an inner root keeps its buffer.
+    // A leaf root becomes an inner node, so it gets an empty buffer.
+    if (!is_inner) {
+      BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0,
+                            BTreeBuffer::Messages(root));
+    }
+    root = BTreeBuffer::Node(root);
+  }
+  BTreeNode::Initialize(BTreeNode::Type::kInner, left_page_id, root);
+  const bool inserted =
+      BTreeNode::InnerInsert(root, 0, separator_key, right_page_id);
+  BERRYDB_ASSUME(inserted);
+  return {Status::kSuccess, 0};
+}
+
+Status BTree::InsertSeparator(
+    TransactionImpl* transaction, const size_t* path, size_t depth,
+    span<const uint8_t> key, ValueBuffer* separator, size_t right_page_id,
+    span<uint8_t> scratch) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  while (depth > 0) {
+    --depth;
+    const size_t page_id = path[depth];
+    {
+      Status status;
+      Page* raw_page;
+      std::tie(status, raw_page) = store->FetchPage(page_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+
+      const span<uint8_t> node =
+          NodeData(transaction->MutablePageData(page.get(), page_size));
+      const span<const uint8_t> separator_key(separator->data(),
+                                              separator->size());
+      size_t index;
+      std::tie(status, index) = BTreeNode::InnerFind(node, separator_key);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (BTreeNode::InnerInsert(node, index, separator_key, right_page_id))
+        return Status::kSuccess;
+
+      BTreeNode::CopyNode(node, scratch);
+      const bool inserted = BTreeNode::InnerInsert(
+          scratch, index, separator_key, right_page_id);
+      BERRYDB_ASSUME(inserted);
+    }
+
+    Status status;
+    std::tie(status, right_page_id) =
+        SplitNode(transaction, path, depth, page_id, key, scratch,
+                  separator);
+    if (UNLIKELY(status != Status::kSuccess) || right_page_id == 0)
+      return status;
+  }
+
+  // The root's split does not produce a separator, so the loop always returns.
+  BERRYDB_UNREACHABLE();
+}
+
+}  // namespace berrydb
@@ -0,0 +1,645 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_BTREE_H_
+#define BERRYDB_BTREE_H_
+
+#include <tuple>
+#include <vector>
+
+#include "berrydb/span.h"
+#include "berrydb/transaction.h"
+#include "berrydb/types.h"
+#include "./btree_buffer.h"
+#include "./btree_node.h"
+#include "./util/platform_allocator.h"
+#include "./value_log.h"
+#include "./write_batch_impl.h"
+
+namespace berrydb {
+
+class PinnedValue;
+class ReadTransactionImpl;
+enum class Status : int;
+class StoreImpl;
+class TransactionImpl;
+
+/** A B+tree stored in a store's pages. Backs spaces and catalogs.
+ *
+ * The key/value pairs are stored in leaf pages, which are linked in key order.
+ * Inner pages store separator keys that route lookups to leaves. See BTreeNode
+ * for the page layout.
+ *
+ * A tree is identified by its root page, which never changes. When the root
+ * overflows, its entries are moved into two new pages, and the root becomes
+ * their parent. This lets catalogs refer to trees by their root page IDs.
+ *
+ * Nodes are not merged when keys are deleted. Empty leaves stay in the tree,
+ * and are filled up again by later insertions.
+ *
+ * Buffered trees trade some read work for fewer leaf writes. Their inner nodes
+ * only use a part of their pages, and the rest of each page holds a buffer of
+ * pending writes. See BTreeBuffer for the layout. Put() and Delete() add a
+ * message to the root's buffer. When a buffer fills up, the messages routed to
+ * the child that would receive the most messages are moved to that child's
+ * buffer, or are applied to the child if it is a leaf. So each leaf write
+ * applies a batch of changes. Lookups check the buffers on the way to the
+ * key's leaf, so they read the same pages as in a regular tree. Buffered trees
+ * can't be bulk-loaded or walked by cursors, because their leaves don't have
+ * the latest changes.
+ *
+ * This class does not synchronize access to the tree's pages. Transactions
+ * follow the concurrency rules documented in Space, and read transactions see
+ * the pages' old versions.
+ */
+class BTree {
+ public:
+  /** The buffer that receives the values read by Get(). */
+  using ValueBuffer = std::vector<uint8_t, PlatformAllocator<uint8_t>>;
+
+  /** The maximum number of levels in a tree.
+   *
+   * A tree this deep holds more keys than any store can have pages, so deeper
+   * trees are considered corrupted. This catches cycles in corrupted trees.
+   */
+  static constexpr size_t kMaxDepth = 32;
+
+  /** Sets up access to the tree rooted at the given page. */
+  explicit constexpr BTree(size_t root_page_id) noexcept
+      : root_page_id_(root_page_id) {}
+
+  /** Sets up access to a tree whose mid-sized values are kept in a log. */
+  constexpr BTree(size_t root_page_id, const ValueLog& value_log) noexcept
+      : root_page_id_(root_page_id), value_log_(value_log) {}
+
+  /** Sets up access to a tree that may buffer writes in its inner nodes.
+   *
+   * Buffered trees can't have a value log. */
+  constexpr BTree(size_t root_page_id, const ValueLog& value_log,
+                  bool buffered) noexcept
+      : root_page_id_(root_page_id), value_log_(value_log),
+        buffered_(buffered) {}
+
+  /** Creates an empty tree.
+   *
+   * @param  transaction  the transaction that allocates the tree's root page
+   * @return status       most likely kSuccess or kIoError
+   * @return root_page_id the ID of the new tree's root page
+   */
+  static std::tuple<Status, size_t> Create(TransactionImpl* transaction);
+
+  /** Converts a page ID read from a node, checking that it can be a tree page.
+   *
+   * @param  store     the store that holds the tree
+   * @param  page_id64 a page ID read from a node
+   * @return           the page ID, or 0 if the ID cannot belong to a tree page
+   */
+  static size_t CheckedChildId(StoreImpl* store, uint64_t page_id64) noexcept;
+
+  /** The ID of the tree's root page. */
+  inline constexpr size_t root_page_id() const noexcept {
+    return root_page_id_;
+  }
+
+  /** True if the tree buffers writes in its inner nodes. */
+  inline constexpr bool buffered() const noexcept { return buffered_; }
+
+  /** The log that holds the tree's mid-sized values, if the tree has one. */
+  inline constexpr const ValueLog& value_log() const noexcept {
+    return value_log_;
+  }
+
+  /** Reads the value associated with a key.
+   *
+   * @param  transaction sees the changes that it made to the tree
+   * @param  key         the key to look up
+   * @param  value       receives the key's value
+   * @return             kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   */
+  Status Get(TransactionImpl* transaction, span<const uint8_t> key,
+             ValueBuffer* value) const;
+
+  /** Reads the value associated with a key, as of a read snapshot.
+   *
+   * @param  transaction determines the snapshot that is read
+   * @param  key         the key to look up
+   * @param  value       receives the key's value
+   * @return             kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   */
+  Status Get(ReadTransactionImpl* transaction, span<const uint8_t> key,
+             ValueBuffer* value) const;
+
+  /** Looks up the value associated with a key, without copying it.
+   *
+   * Values stored in a leaf or a message are exposed in place, and the handle
+   * pins the page holding them. Values stored outside the tree's nodes are read
+   * into the handle's buffer. Optimistic transactions read pages that may be
+   * replaced by private copies, so their values are always copied.
+   *
+   * @param  transaction sees the changes that it made to the tree
+   * @param  key         the key to look up
+   * @param  value       receives the key's value
+   * @return             kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   */
+  Status Get(TransactionImpl* transaction, span<const uint8_t> key,
+             PinnedValue* value) const;
+
+  /** Looks up the value associated with a key as of a read snapshot, without
+   * copying it.
+   *
+   * Values read from saved page versions are not pinned, because the versions
+   * are kept while the transaction is open. See the other Get() for details.
+   *
+   * @param  transaction determines the snapshot that is read
+   * @param  key         the key to look up
+   * @param  value       receives the key's value
+   * @return             kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   */
+  Status Get(ReadTransactionImpl* transaction, span<const uint8_t> key,
+             PinnedValue* value) const;
+
+  /** Looks up many keys at once, sharing the work of descending the tree.
+   *
+   * The keys are sorted, and the tree is descended one level at a time, so
+   * each page on the keys' paths is fetched once for the whole batch. Before a
+   * level is visited, its uncached pages with consecutive IDs are prefetched,
+   * so each run of pages is read using a single I/O operation.
+   *
+   * Values are exposed like in the Get() that fills a PinnedValue, except that
+   * at most a quarter of the page pool is pinned by a batch. Values in the
+   * leaves visited after that are copied.
+   *
+   * Buffered trees are not supported, because their keys may be answered by
+   * messages in inner nodes.
+   *
+   * @param  transaction sees the changes that it made to the tree
+   * @param  keys        the keys of the batch
+   * @param  indexes     the positions in keys of the keys that are looked up;
+   *                     reordered by the call
+   * @param  statuses    receives kSuccess or kNotFound for each key that is
+   *                     looked up; must have the same size as keys
+   * @param  values      receives the values of the keys that are found; must
+   *                     have the same size as keys, and must be empty
+   * @return             most likely kSuccess or kIoError; the statuses and the
+   *                     values are unspecified if this is not kSuccess
+   */
+  Status MultiGet(TransactionImpl* transaction,
+                  span<const span<const uint8_t>> keys, span<size_t> indexes,
+                  span<Status> statuses, span<PinnedValue> values) const;
+
+  /** Reads a range of the value associated with a key.
+   *
+   * @param  transaction sees the changes that it made to the tree
+   * @param  key         the key to look up
+   * @param  offset      the position of the first value byte to be read
+   * @param  buffer      receives the value bytes; the bytes past the value's
+   *                     end are not modified
+   * @return status      kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return value_size  the size of the key's value
+   */
+  std::tuple<Status, size_t> ReadValue(TransactionImpl* transaction,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer) const;
+
+  /** Reads a range of the value associated with a key, as of a read snapshot.
+   *
+   * @param  transaction determines the snapshot that is read
+   * @param  key         the key to look up
+   * @param  offset      the position of the first value byte to be read
+   * @param  buffer      receives the value bytes; the bytes past the value's
+   *                     end are not modified
+   * @return status      kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return value_size  the size of the key's value
+   */
+  std::tuple<Status, size_t> ReadValue(ReadTransactionImpl* transaction,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer) const;
+
+  /** Creates or updates a key.
+   *
+   * If the tree has a ValueLog, values accepted by ValueLog::ShouldStore() are
+   * appended to the log. Other values that don't fit in a leaf are stored in
+   * overflow pages. See OverflowValue for details. Buffered trees store values
+   * that don't fit in a message in overflow pages.
+   *
+   * @return kTooLarge if the key does not fit in a node; otherwise, most likely
+   *         kSuccess or kIoError
+   */
+  Status Put(TransactionImpl* transaction, span<const uint8_t> key,
+             span<const uint8_t> value);
+
+  /** Creates or updates a key, setting its value to zeros.
+   *
+   * The value can be filled in afterwards by WriteValue().
+   *
+   * @return kTooLarge if the key does not fit in a node; otherwise, most likely
+   *         kSuccess or kIoError
+   */
+  Status ReserveValue(TransactionImpl* transaction, span<const uint8_t> key,
+                      size_t value_size);
+
+  /** Overwrites a range of the value associated with a key.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key whose value is modified
+   * @param  offset      the position of the first value byte to be written
+   * @param  data        the bytes to be written
+   * @return             kNotFound if the tree does not contain the key;
+   *                     kTooLarge if the range extends past the value's end;
+   *                     otherwise, most likely kSuccess or kIoError
+   */
+  Status WriteValue(TransactionImpl* transaction, span<const uint8_t> key,
+                    size_t offset, span<const uint8_t> data);
+
+  /** Fills an empty tree with sorted key/value pairs, building it bottom-up.
+   *
+   * See Transaction::BulkLoad() for details, and BTreeBuilder for the
+   * implementation.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  source      produces the key/value pairs, in key order
+   * @param  context     passed to the source
+   * @return             kAlreadyExists if the tree is not empty, or if the
+   *                     keys are not sorted; kTooLarge if a key does not fit
+   *                     in a node; otherwise, most likely kSuccess or kIoError
+   */
+  Status BulkLoad(TransactionImpl* transaction, BulkLoadSource source,
+                  void* context);
+
+  /** Called by ForEachKey() for each key in the tree.
+   *
+   * @param  context the value passed to ForEachKey()
+   * @param  key     a key in the tree; only valid during the call
+   * @return         kSuccess to continue the iteration; any other status stops
+   *                 the iteration, and is returned by ForEachKey()
+   */
+  using KeyVisitor = Status (*)(void* context, span<const uint8_t> key);
+
+  /** Calls a function on every key in the tree, in key order.
+   *
+   * This walks the tree's leaves using their sibling links, so it is cheaper
+   * than a cursor. It is used to rebuild data derived from the keys, such as
+   * a space's BloomFilter. The visitor must not modify the tree.
+   *
+   * @param  transaction the transaction whose view of the tree is used
+   * @param  visitor     called with each key
+   * @param  context     passed to the visitor
+   * @return             the first status other than kSuccess returned by the
+   *                     visitor; otherwise, kSuccess, kDataCorrupted, or an I/O
+   *                     error
+   */
+  Status ForEachKey(TransactionImpl* transaction, KeyVisitor visitor,
+                    void* context) const;
+
+  /** Moves the live records out of all the value log's older segments.
+   *
+   * Each record in a segment older than the log's newest segment is checked
+   * against its key's leaf entry. Records that are still referenced are
+   * appended to the log again, and their entries are updated. The emptied
+   * segments are reused by later appends.
+   *
+   * @param  transaction the transaction that modifies the tree and the log
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status CompactValueLog(TransactionImpl* transaction);
+
+  /** Frees the tree's pages, and the extents of its large values.
+   *
+   * Used when the tree's space or catalog is deleted. The pages are reused
+   * after the transaction commits and the read snapshots that may still see
+   * the tree are gone. The tree's value log, if any, is freed separately.
+   *
+   * @param  transaction the transaction that deletes the tree
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status Free(TransactionImpl* transaction) const;
+
+  /** Removes a key.
+   *
+   * Buffered trees record the removal without looking up the key, so they
+   * only report kNotFound for keys that can't be stored in the tree.
+   *
+   * @return kNotFound if the tree does not contain the key; otherwise, most
+   *         likely kSuccess or kIoError
+   */
+  Status Delete(TransactionImpl* transaction, span<const uint8_t> key);
+
+  /** Applies a write batch's operations on the tree, in order.
+   *
+   * Consecutive operations whose keys fall in the same leaf are applied while
+   * the leaf stays pinned, so the tree is only descended once per leaf. Values
+   * that don't fit in the leaf, and insertions that would split it, go through
+   * Put(), and the next operation descends the tree again.
+   *
+   * Buffered trees are not supported, because their writes go to the root's
+   * buffer.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  operations  Put and Delete operations, sorted by key; deletions of
+   *                     missing keys are ignored
+   * @return             kTooLarge if a key does not fit in a node; otherwise,
+   *                     most likely kSuccess or kIoError
+   */
+  Status ApplyBatch(TransactionImpl* transaction,
+                    span<const WriteBatchImpl::Operation> operations);
+
+ private:
+  /** Reads a value stored outside the tree's nodes into a handle's buffer.
+   *
+   * @param  transaction the transaction that reads the value
+   * @param  entry_value a ValueLog or OverflowValue reference, stored in a leaf
+   *                     or a message
+   * @param  value       receives the value
+   * @return             most likely kSuccess or kIoError
+   */
+  template <typename TransactionType>
+  static Status ReadReferencedValue(TransactionType* transaction,
+                                    span<const uint8_t> entry_value,
+                                    PinnedValue* value);
+
+  /** Calls a function on the value stored in a key's entry.
+   *
+   * The function is called as visitor(page, entry_value, is_overflow), and its
+   * result is returned. page is the pool page holding the entry, which stays
+   * pinned while the function runs. entry_value is the value stored in the
+   * entry, and is_overflow is true if the entry stores a reference to the
+   * value. In buffered trees, the entry may be a message.
+   *
+   * @param  transaction sees the changes that it made to the tree
+   * @param  key         the key to look up
+   * @param  visitor     called if the tree contains the key
+   * @return             kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   */
+  template <typename Visitor>
+  Status VisitEntry(TransactionImpl* transaction, span<const uint8_t> key,
+                    Visitor&& visitor) const;
+
+  /** Calls a function on the value stored in a key's entry, as of a snapshot.
+   *
+   * This works like the other VisitEntry(). The page passed to the function is
+   * null if the entry was read from a saved page version, which stays unchanged
+   * until the transaction is released. Otherwise, the page is pinned by the
+   * transaction until its next ReadPage() call.
+   */
+  template <typename Visitor>
+  Status VisitEntry(ReadTransactionImpl* transaction, span<const uint8_t> key,
+                    Visitor&& visitor) const;
+
+  /** Copies the value stored in a key's leaf entry, for a write transaction.
+   *
+   * @param  transaction sees the changes that it made to the tree
+   * @param  key         the key to look up
+   * @param  value       receives the value stored in the leaf
+   * @return status      kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return is_overflow if true, the leaf stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  std::tuple<Status, bool> FindValue(TransactionImpl* transaction,
+                                     span<const uint8_t> key,
+                                     ValueBuffer* value) const;
+
+  /** Copies the value stored in a key's leaf entry, as of a read snapshot.
+   *
+   * @param  transaction determines the snapshot that is read
+   * @param  key         the key to look up
+   * @param  value       receives the value stored in the leaf
+   * @return status      kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return is_overflow if true, the leaf stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  std::tuple<Status, bool> FindValue(ReadTransactionImpl* transaction,
+                                     span<const uint8_t> key,
+                                     ValueBuffer* value) const;
+
+  /** Creates or updates a key's leaf entry.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the entry's key
+   * @param  value       the value stored in the leaf; must fit in the leaf
+   * @param  is_overflow true if the value is a reference to overflow pages
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status PutEntry(TransactionImpl* transaction, span<const uint8_t> key,
+                  span<const uint8_t> value, bool is_overflow);
+
+  /** Removes a key's leaf entry.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key whose entry is removed
+   * @return             kNotFound if the leaf does not have the key; otherwise,
+   *                     most likely kSuccess or kIoError
+   */
+  Status DeleteEntry(TransactionImpl* transaction, span<const uint8_t> key);
+
+  /** Creates or updates a key whose value is stored in overflow pages.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key that is created or updated
+   * @param  value_size  the size of the key's new value
+   * @param  data        the value's first bytes; the rest is zero-filled
+   * @return             kTooLarge if the key does not fit in a node; otherwise,
+   *                     most likely kSuccess or kIoError
+   */
+  Status PutOverflow(TransactionImpl* transaction, span<const uint8_t> key,
+                     size_t value_size, span<const uint8_t> data);
+
+  /** Creates or updates a key whose value is stored in the value log.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key that is created or updated
+   * @param  value_size  the size of the key's new value; must be accepted by
+   *                     ValueLog::ShouldStore()
+   * @param  data        the value's first bytes; the rest is zero-filled
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status PutLogged(TransactionImpl* transaction, span<const uint8_t> key,
+                   size_t value_size, span<const uint8_t> data);
+
+  /** Creates or updates a key in a buffered tree.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key that is created or updated
+   * @param  value_size  the size of the key's new value
+   * @param  data        the value's first bytes; the rest is zero-filled
+   * @return             kTooLarge if the key does not fit in a node; otherwise,
+   *                     most likely kSuccess or kIoError
+   */
+  Status PutBuffered(TransactionImpl* transaction, span<const uint8_t> key,
+                     size_t value_size, span<const uint8_t> data);
+
+  /** Adds a message to the root's buffer, flushing buffers to make room.
+   *
+   * While the root is a leaf, the tree has no buffers, and the message is
+   * applied to the root directly.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key that the message applies to
+   * @param  message     the encoded message; must fit in a buffer
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status PutMessage(TransactionImpl* transaction, span<const uint8_t> key,
+                    span<const uint8_t> message);
+
+  /** Moves a batch of messages out of an inner node's buffer.
+   *
+   * The batch consists of the messages routed to the child that receives the
+   * most message bytes. The batch is moved to the child's buffer, or applied
+   * to the child if it is a leaf. If the child's buffer does not have room for
+   * the batch, the child's buffer is flushed instead. Either way, at least one
+   * message moves down the tree.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  page_id     the inner node whose buffer is flushed
+   * @param  depth       the number of inner nodes above the flushed node
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status FlushBuffer(TransactionImpl* transaction, size_t page_id,
+                     size_t depth);
+
+  /** Applies a message to a key's leaf entry.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the key that the message applies to
+   * @param  message     the encoded message
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status ApplyMessage(TransactionImpl* transaction, span<const uint8_t> key,
+                      span<const uint8_t> message);
+
+  /** Finds the newest message for a key in a buffered tree's buffers.
+   *
+   * @param  transaction the transaction whose view of the tree is used
+   * @param  key         the key to look for
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return page_id     the inner node page whose buffer has the message; 0 if
+   *                     no buffer has a message for the key
+   * @return index       the message's entry index in the buffer
+   */
+  std::tuple<Status, size_t, size_t> FindMessage(TransactionImpl* transaction,
+                                                 span<const uint8_t> key) const;
+
+  /** The result of the message for a key in a buffer.
+   *
+   * @param  buffer      a buffer that passed BTreeBuffer::IsCorrupt()
+   * @param  index       the index of the key's message in the buffer
+   * @return status      kNotFound if the message deletes the key; otherwise,
+   *                     kSuccess or kDataCorrupted
+   * @return value       the value stored in the message, inside the buffer
+   * @return is_overflow if true, the message stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  static std::tuple<Status, span<const uint8_t>, bool> MessageValue(
+      span<const uint8_t> buffer, size_t index);
+
+  /** The part of a tree page that holds the page's node.
+   *
+   * This is the whole page, except for the inner nodes of buffered trees. */
+  inline span<const uint8_t> NodeData(span<const uint8_t> page) const noexcept {
+    return (buffered_ &&
+            BTreeNode::NodeType(page) == BTreeNode::Type::kInner)
+        ? BTreeBuffer::Node(page) : page;
+  }
+  /** The part of a tree page that holds the page's node. */
+  inline span<uint8_t> NodeData(span<uint8_t> page) const noexcept {
+    return (buffered_ &&
+            BTreeNode::NodeType(page) == BTreeNode::Type::kInner)
+        ? BTreeBuffer::Node(page) : page;
+  }
+
+  /** The size of the nodes of the given type in this tree. */
+  inline size_t NodeSize(BTreeNode::Type type, size_t page_size)
+      const noexcept {
+    return (buffered_ && type == BTreeNode::Type::kInner)
+        ? BTreeBuffer::NodeSize(page_size) : page_size;
+  }
+
+  /** Finds the leaf that may hold a key, on behalf of a write transaction.
+   *
+   * @param  transaction the transaction whose view of the tree is used
+   * @param  key         the key to look for
+   * @param  path        if not null, receives the IDs of the inner pages on the
+   *                     way to the leaf, starting at the root; must have room
+   *                     for kMaxDepth entries
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return depth       the number of inner pages on the way to the leaf
+   * @return leaf_id     the ID of the leaf page
+   */
+  std::tuple<Status, size_t, size_t> FindLeaf(
+      TransactionImpl* transaction, span<const uint8_t> key,
+      size_t* path) const;
+
+  /** Computes the key range covered by a node, on behalf of a split.
+   *
+   * @param  transaction the transaction whose view of the tree is used
+   * @param  path        the IDs of the inner pages on the way to the node,
+   *                     starting at the root
+   * @param  depth       the number of entries in path
+   * @param  key         a key in the node's range; used to descend the tree
+   * @param  lower       receives the smallest key that the node can hold
+   * @param  upper       receives the key that bounds the node's keys; empty if
+   *                     the node is on the tree's right edge
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status FindFences(TransactionImpl* transaction, const size_t* path,
+                    size_t depth, span<const uint8_t> key, ValueBuffer* lower,
+                    ValueBuffer* upper) const;
+
+  /** Splits an overflowing node built in a scratch buffer.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  path        the IDs of the inner pages on the way to the split
+   *                     node, starting at the root
+   * @param  depth       the number of entries in path
+   * @param  page_id     the page that will receive the node's left half; if
+   *                     this is the root page, the halves go to two new pages,
+   *                     and the root becomes their parent
+   * @param  key         a key in the node's range; used to find its fences
+   * @param  node        the overflowing node
+   * @param  separator   receives a copy of the key that separates the halves
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return right_id    the page that received the node's right half, which
+   *                     needs a separator in the node's parent; 0 if the root
+   *                     page was split, because the root has no parent
+   */
+  std::tuple<Status, size_t> SplitNode(
+      TransactionImpl* transaction, const size_t* path, size_t depth,
+      size_t page_id, span<const uint8_t> key, span<const uint8_t> node,
+      ValueBuffer* separator);
+
+  /** Adds the separator for a new page to the ancestors of a split node.
+   *
+   * Inner nodes that overflow are split, going up the path as needed.
+   *
+   * @param  transaction   the transaction that modifies the tree
+   * @param  path          the IDs of the inner pages on the way to the split
+   *                       node, starting at the root
+   * @param  depth         the number of entries in path
+   * @param  key           the key whose insertion caused the split
+   * @param  separator     the smallest key in the new page; overwritten
+   * @param  right_page_id the new page
+   * @param  scratch       buffer that can hold two pages
+   * @return               kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status InsertSeparator(TransactionImpl* transaction, const size_t* path,
+                         size_t depth, span<const uint8_t> key,
+                         ValueBuffer* separator, size_t right_page_id,
+                         span<uint8_t> scratch);
+
+  const size_t root_page_id_;
+  ValueLog value_log_;
+  const bool buffered_ = false;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_BTREE_H_
@@ -0,0 +1,77 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree_buffer.h"
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./util/checks.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+constexpr size_t BTreeBuffer::kMessageHeaderSize;
+constexpr size_t BTreeBuffer::kMinNodeSize;
+constexpr size_t BTreeBuffer::kOverflowMessageOverhead;
+
+// static
+bool BTreeBuffer::IsCorrupt(span<const uint8_t> buffer) noexcept {
+  return BTreeNode::IsCorrupt(buffer) ||
+         BTreeNode::NodeType(buffer) != BTreeNode::Type::kLeaf ||
+         !BTreeNode::Prefix(buffer).empty();
+}
+
+// static
+void BTreeBuffer::EncodeMessage(MessageType type, span<const uint8_t> payload,
+                                span<uint8_t> message) noexcept {
+  BERRYDB_ASSUME_EQ(message.size(), kMessageHeaderSize + payload.size());
+  BERRYDB_ASSUME(type != MessageType::kDelete || payload.empty());
+
+  message[0] = static_cast<uint8_t>(type);
+  CopySpan(payload, message.subspan(kMessageHeaderSize, payload.size()));
+}
+
+// static
+std::tuple<Status, BTreeBuffer::MessageType, span<const uint8_t>>
+BTreeBuffer::DecodeMessage(span<const uint8_t> message) noexcept {
+  if (UNLIKELY(message.size() < kMessageHeaderSize))
+    return {Status::kDataCorrupted, MessageType::kDelete, message};
+
+  const MessageType type = static_cast<MessageType>(message[0]);
+  const span<const uint8_t> payload = message.subspan(kMessageHeaderSize);
+  if (UNLIKELY(type != MessageType::kPut &&
+               type != MessageType::kPutOverflow &&
+               (type != MessageType::kDelete || !payload.empty()))) {
+    return {Status::kDataCorrupted, MessageType::kDelete, message};
+  }
+  return {Status::kSuccess, type, payload};
+}
+
+// static
+std::tuple<Status, bool> BTreeBuffer::Add(
+    span<uint8_t> buffer, span<const uint8_t> key,
+    span<const uint8_t> message) noexcept {
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(buffer, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+
+  // Replacing a message with a smaller one always succeeds, because the old
+  // message's space is released first. Otherwise, the check below ignores the
+  // space held by the old message, so the buffer is never left without the
+  // key's old message.
+  if (!found || BTreeNode::LeafValue(buffer, index).size() < message.size()) {
+    if (!BTreeNode::LeafHasRoom(buffer, key.size(), message.size()))
+      return {Status::kSuccess, false};
+  }
+  if (found)
+    BTreeNode::LeafRemove(buffer, index);
+  const bool inserted = BTreeNode::LeafInsert(buffer, index, key, message);
+  BERRYDB_ASSUME(inserted);
+  return {Status::kSuccess, true};
+}
+
+}  // namespace berrydb
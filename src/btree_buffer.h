@@ -0,0 +1,160 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_BTREE_BUFFER_H_
+#define BERRYDB_BTREE_BUFFER_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./btree_node.h"
+#include "./overflow_value.h"
+
+namespace berrydb {
+
+enum class Status : int;
+
+/** The message buffers in the inner node pages of write-buffered B+trees.
+ *
+ * A buffered tree's leaves use whole pages, like a regular tree's leaves. Each
+ * inner node page is split in two parts. The first NodeSize() bytes hold the
+ * inner node, in the BTreeNode layout. The rest of the page holds a buffer of
+ * messages, which also uses the BTreeNode leaf layout, and never has a key
+ * prefix.
+ *
+ * A message records a Put() or a Delete() that has not reached the tree's
+ * leaves yet. A buffer holds at most one message for each key. A key's message
+ * in a buffer is newer than the key's messages in the buffers below, and than
+ * the key's leaf entry, so lookups use the first message they find on the way
+ * down from the root.
+ *
+ * Message layout, stored as the value of a buffer entry:
+ * 0: 8-bit MessageType
+ * 1: the key's new value for kPut, an OverflowValue reference for kPutOverflow,
+ *    and nothing for kDelete
+ *
+ * An all-zero buffer is empty, so inner nodes can be created in pages whose
+ * second part is zero-filled.
+ */
+class BTreeBuffer {
+ public:
+  /** The changes recorded by messages. */
+  enum class MessageType : uint8_t {
+    kPut = 1,
+    kPutOverflow = 2,
+    kDelete = 3,
+  };
+
+  /** The size of a message's header, in bytes. */
+  static constexpr size_t kMessageHeaderSize = 1;
+
+  /** The inner node part of a page never gets smaller than this.
+   *
+   * This keeps the tree's maximum key size usable on small pages. */
+  static constexpr size_t kMinNodeSize = 512;
+
+  /** The number of bytes at the start of a page used by an inner node.
+   *
+   * Inner nodes get an eighth of the page, so most of the page holds messages.
+   * Smaller nodes have fewer children, so more messages are flushed to each
+   * child at a time.
+   */
+  static constexpr size_t NodeSize(size_t page_size) noexcept {
+    return (page_size / 8 >= kMinNodeSize)
+        ? page_size / 8
+        : (page_size / 2 < kMinNodeSize ? page_size / 2 : kMinNodeSize);
+  }
+
+  /** The space used by a kPutOverflow message, aside from its key.
+   *
+   * This covers the buffer's slot, the leaf entry's header and padding, the
+   * message's header, and the overflow value reference. */
+  static constexpr size_t kOverflowMessageOverhead =
+      BTreeNode::kSlotSize + 4 + 1 + kMessageHeaderSize +
+      OverflowValue::kReferenceSize;
+
+  /** The size of the largest key that can be stored in a buffered tree.
+   *
+   * Keys must fit in the inner nodes, and kPutOverflow messages for the keys
+   * must fit in the buffers. */
+  static constexpr size_t MaxKeySize(size_t page_size) noexcept {
+    return (BTreeNode::MaxKeySize(NodeSize(page_size)) <
+            BTreeNode::MaxEntrySize(page_size - NodeSize(page_size)) -
+                kOverflowMessageOverhead)
+        ? BTreeNode::MaxKeySize(NodeSize(page_size))
+        : BTreeNode::MaxEntrySize(page_size - NodeSize(page_size)) -
+              kOverflowMessageOverhead;
+  }
+
+  /** True if a message with the given payload fits in a buffer. */
+  static constexpr bool FitsInBuffer(size_t key_size, size_t payload_size,
+                                     size_t page_size) noexcept {
+    return key_size <= MaxKeySize(page_size) &&
+           BTreeNode::FitsInLeaf(key_size, kMessageHeaderSize + payload_size,
+                                 page_size - NodeSize(page_size));
+  }
+
+  /** The part of an inner node page that holds the node. */
+  static inline span<const uint8_t> Node(span<const uint8_t> page) noexcept {
+    return page.first(NodeSize(page.size()));
+  }
+  /** The part of an inner node page that holds the node. */
+  static inline span<uint8_t> Node(span<uint8_t> page) noexcept {
+    return page.first(NodeSize(page.size()));
+  }
+
+  /** The part of an inner node page that holds the message buffer. */
+  static inline span<const uint8_t> Messages(span<const uint8_t> page)
+      noexcept {
+    return page.subspan(NodeSize(page.size()));
+  }
+  /** The part of an inner node page that holds the message buffer. */
+  static inline span<uint8_t> Messages(span<uint8_t> page) noexcept {
+    return page.subspan(NodeSize(page.size()));
+  }
+
+  /** True if a buffer's header is inconsistent with the buffer's size.
+   *
+   * See BTreeNode::IsCorrupt() for details. Buffers must be leaves without a
+   * key prefix. */
+  static bool IsCorrupt(span<const uint8_t> buffer) noexcept;
+
+  /** Encodes a message.
+   *
+   * @param type    the message's type
+   * @param payload the message's payload; must be empty for kDelete
+   * @param message receives the message; must have kMessageHeaderSize +
+   *                payload.size() bytes
+   */
+  static void EncodeMessage(MessageType type, span<const uint8_t> payload,
+                            span<uint8_t> message) noexcept;
+
+  /** Decodes a message read from a buffer.
+   *
+   * @param  message the value of a buffer entry
+   * @return status  kSuccess or kDataCorrupted
+   * @return type    the message's type
+   * @return payload the message's payload
+   */
+  static std::tuple<Status, MessageType, span<const uint8_t>> DecodeMessage(
+      span<const uint8_t> message) noexcept;
+
+  /** Adds a message to a buffer, replacing the key's older message.
+   *
+   * @param  buffer  a buffer that passed IsCorrupt()
+   * @param  key     the key that the message applies to
+   * @param  message the encoded message
+   * @return status  kSuccess or kDataCorrupted
+   * @return added   false if the buffer does not have room for the message; the
+   *                 buffer is not modified in that case
+   */
+  static std::tuple<Status, bool> Add(span<uint8_t> buffer,
+                                      span<const uint8_t> key,
+                                      span<const uint8_t> message) noexcept;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_BTREE_BUFFER_H_
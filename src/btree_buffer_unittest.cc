@@ -0,0 +1,214 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree_buffer.h"
+
+#include <string>
+#include <tuple>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/status.h"
+#include "./btree_node.h"
+#include "./overflow_value.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kPageSize = 4096;
+
+span<const uint8_t> StringSpan(const std::string& string) {
+  return span<const uint8_t>(reinterpret_cast<const uint8_t*>(string.data()),
+                             string.size());
+}
+
+std::string SpanString(span<const uint8_t> data) {
+  return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+/** Encodes a kPut message for the given value. */
+std::string PutMessage(const std::string& value) {
+  std::string message(BTreeBuffer::kMessageHeaderSize + value.size(), '\0');
+  BTreeBuffer::EncodeMessage(
+      BTreeBuffer::MessageType::kPut, StringSpan(value),
+      span<uint8_t>(reinterpret_cast<uint8_t*>(&message[0]), message.size()));
+  return message;
+}
+
+/** The message stored for a key in a buffer, or "(missing)". */
+std::string BufferLookup(span<const uint8_t> buffer, const std::string& key) {
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) =
+      BTreeNode::LeafFind(buffer, StringSpan(key));
+  EXPECT_EQ(Status::kSuccess, status);
+  if (!found)
+    return "(missing)";
+  return SpanString(BTreeNode::LeafValue(buffer, index));
+}
+
+}  // namespace
+
+TEST(BTreeBufferTest, NodeSize) {
+  EXPECT_EQ(512U, BTreeBuffer::NodeSize(4096));
+  EXPECT_EQ(1024U, BTreeBuffer::NodeSize(8192));
+  EXPECT_EQ(4096U, BTreeBuffer::NodeSize(32768));
+  EXPECT_EQ(512U, BTreeBuffer::NodeSize(2048));
+  EXPECT_EQ(512U, BTreeBuffer::NodeSize(1024));
+  EXPECT_EQ(256U, BTreeBuffer::NodeSize(512));
+
+  alignas(8) uint8_t page_bytes[kPageSize];
+  span<uint8_t> page(page_bytes);
+  EXPECT_EQ(page_bytes, BTreeBuffer::Node(page).data());
+  EXPECT_EQ(512U, BTreeBuffer::Node(page).size());
+  EXPECT_EQ(page_bytes + 512, BTreeBuffer::Messages(page).data());
+  EXPECT_EQ(kPageSize - 512, BTreeBuffer::Messages(page).size());
+}
+
+TEST(BTreeBufferTest, FitsInBuffer) {
+  const size_t max_key_size = BTreeBuffer::MaxKeySize(kPageSize);
+  EXPECT_EQ(BTreeNode::MaxKeySize(512), max_key_size);
+  EXPECT_LT(max_key_size, BTreeNode::MaxKeySize(kPageSize));
+
+  EXPECT_TRUE(BTreeBuffer::FitsInBuffer(max_key_size, 0, kPageSize));
+  EXPECT_FALSE(BTreeBuffer::FitsInBuffer(max_key_size + 1, 0, kPageSize));
+  EXPECT_TRUE(BTreeBuffer::FitsInBuffer(8, 64, kPageSize));
+  EXPECT_FALSE(BTreeBuffer::FitsInBuffer(8, kPageSize, kPageSize));
+
+  // On small pages, the buffer's size limits keys more than the node's size,
+  // because overflow references must fit next to the largest keys.
+  const size_t small_max_key_size = BTreeBuffer::MaxKeySize(1024);
+  EXPECT_LT(small_max_key_size, BTreeNode::MaxKeySize(512));
+  EXPECT_TRUE(BTreeBuffer::FitsInBuffer(
+      small_max_key_size, OverflowValue::kReferenceSize, 1024));
+}
+
+TEST(BTreeBufferTest, EncodeDecodeMessages) {
+  const std::string value = "value";
+  const std::string message = PutMessage(value);
+  ASSERT_EQ(1U + value.size(), message.size());
+
+  Status status;
+  BTreeBuffer::MessageType type;
+  span<const uint8_t> payload;
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(StringSpan(message));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(BTreeBuffer::MessageType::kPut, type);
+  EXPECT_EQ(value, SpanString(payload));
+
+  uint8_t delete_message[BTreeBuffer::kMessageHeaderSize];
+  BTreeBuffer::EncodeMessage(BTreeBuffer::MessageType::kDelete,
+                             span<const uint8_t>(),
+                             span<uint8_t>(delete_message));
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(span<const uint8_t>(delete_message));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(BTreeBuffer::MessageType::kDelete, type);
+  EXPECT_TRUE(payload.empty());
+}
+
+TEST(BTreeBufferTest, DecodeRejectsCorruptMessages) {
+  Status status;
+  BTreeBuffer::MessageType type;
+  span<const uint8_t> payload;
+
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(span<const uint8_t>());
+  EXPECT_EQ(Status::kDataCorrupted, status);
+
+  const uint8_t bad_type[] = {0, 42};
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(span<const uint8_t>(bad_type));
+  EXPECT_EQ(Status::kDataCorrupted, status);
+
+  const uint8_t delete_with_payload[] = {
+      static_cast<uint8_t>(BTreeBuffer::MessageType::kDelete), 42};
+  std::tie(status, type, payload) =
+      BTreeBuffer::DecodeMessage(span<const uint8_t>(delete_with_payload));
+  EXPECT_EQ(Status::kDataCorrupted, status);
+}
+
+TEST(BTreeBufferTest, ZeroedBufferIsEmpty) {
+  alignas(8) uint8_t page_bytes[kPageSize];
+  span<uint8_t> page(page_bytes);
+  FillSpan(page, 0);
+
+  span<const uint8_t> buffer = BTreeBuffer::Messages(page);
+  EXPECT_FALSE(BTreeBuffer::IsCorrupt(buffer));
+  EXPECT_EQ(0U, BTreeNode::EntryCount(buffer));
+}
+
+TEST(BTreeBufferTest, AddReplacesOlderMessages) {
+  alignas(8) uint8_t page_bytes[kPageSize];
+  span<uint8_t> page(page_bytes);
+  FillSpan(page, 0);
+  span<uint8_t> buffer = BTreeBuffer::Messages(page);
+
+  Status status;
+  bool added;
+  std::tie(status, added) = BTreeBuffer::Add(buffer, StringSpan("key"),
+                                             StringSpan(PutMessage("first")));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(added);
+  std::tie(status, added) = BTreeBuffer::Add(
+      buffer, StringSpan("key"), StringSpan(PutMessage("second value")));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(added);
+  std::tie(status, added) = BTreeBuffer::Add(buffer, StringSpan("key"),
+                                             StringSpan(PutMessage("3")));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(added);
+
+  EXPECT_EQ(1U, BTreeNode::EntryCount(buffer));
+  EXPECT_EQ(PutMessage("3"), BufferLookup(buffer, "key"));
+  EXPECT_FALSE(BTreeBuffer::IsCorrupt(buffer));
+}
+
+TEST(BTreeBufferTest, AddRefusesMessagesThatDontFit) {
+  alignas(8) uint8_t page_bytes[kPageSize];
+  span<uint8_t> page(page_bytes);
+  FillSpan(page, 0);
+  span<uint8_t> buffer = BTreeBuffer::Messages(page);
+
+  const std::string value(64, 'v');
+  size_t count = 0;
+  while (true) {
+    const std::string key = "key" + std::to_string(1000 + count);
+    Status status;
+    bool added;
+    std::tie(status, added) = BTreeBuffer::Add(buffer, StringSpan(key),
+                                               StringSpan(PutMessage(value)));
+    ASSERT_EQ(Status::kSuccess, status);
+    if (!added) {
+      EXPECT_EQ("(missing)", BufferLookup(buffer, key));
+      break;
+    }
+    ++count;
+  }
+  EXPECT_LT(10U, count);
+  EXPECT_EQ(count, BTreeNode::EntryCount(buffer));
+
+  // Growing an existing message must not lose the old message.
+  Status status;
+  bool added;
+  std::tie(status, added) = BTreeBuffer::Add(
+      buffer, StringSpan("key1000"), StringSpan(PutMessage(value + value)));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_FALSE(added);
+  EXPECT_EQ(PutMessage(value), BufferLookup(buffer, "key1000"));
+
+  // Shrinking an existing message always works.
+  std::tie(status, added) = BTreeBuffer::Add(buffer, StringSpan("key1000"),
+                                             StringSpan(PutMessage("v")));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_TRUE(added);
+  EXPECT_EQ(PutMessage("v"), BufferLookup(buffer, "key1000"));
+  EXPECT_EQ(count, BTreeNode::EntryCount(buffer));
+}
+
+}  // namespace berrydb
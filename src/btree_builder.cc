@@ -0,0 +1,295 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree_builder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree.h"
+#include "./btree_node.h"
+#include "./free_page_manager.h"
+#include "./page_pool.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+/** The size of the writes issued by the builder, in bytes.
+ *
+ * Large enough that writes approach the storage's sequential bandwidth. */
+constexpr size_t kRunSize = 1 << 20;
+
+/** Lexicographic comparison for keys. Returns <0, 0, or >0, like memcmp(). */
+int CompareKeys(span<const uint8_t> lhs, span<const uint8_t> rhs) noexcept {
+  const size_t size = std::min(lhs.size(), rhs.size());
+  const int result = (size == 0) ? 0 : std::memcmp(lhs.data(), rhs.data(), size);
+  if (result != 0)
+    return result;
+  return (lhs.size() < rhs.size()) ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+/** The size of the shortest prefix of upper that is larger than lower.
+ *
+ * The prefix is the shortest key that separates the two keys in an inner node.
+ *
+ * @param lower must be smaller than upper
+ * @param upper the key whose prefix is the separator
+ */
+size_t SeparatorSize(span<const uint8_t> lower, span<const uint8_t> upper)
+    noexcept {
+  const size_t size = std::min(lower.size(), upper.size());
+  size_t common_size = 0;
+  while (common_size < size && lower[common_size] == upper[common_size])
+    ++common_size;
+  BERRYDB_ASSUME_LT(common_size, upper.size());
+  return common_size + 1;
+}
+
+}  // namespace
+
+BTreeBuilder::BTreeBuilder(TransactionImpl* transaction)
+    : transaction_(transaction),
+      page_size_(transaction->store()->page_pool()->page_size()),
+      run_page_count_(std::max(kRunSize / page_size_,
+                               static_cast<size_t>(1))) {
+  // AddChild() holds on to spans pointing into the levels.
+  levels_.reserve(BTree::kMaxDepth);
+}
+
+BTreeBuilder::~BTreeBuilder() = default;
+
+Status BTreeBuilder::Add(span<const uint8_t> key, span<const uint8_t> value,
+                         bool is_overflow) {
+  BERRYDB_ASSUME(
+      BTreeNode::FitsInLeaf(key.size(), value.size(), page_size_));
+
+  if (levels_.empty()) {
+    levels_.emplace_back();
+    levels_[0].node.resize(page_size_);
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0,
+                          span<uint8_t>(levels_[0].node.data(), page_size_));
+  } else {
+    const span<const uint8_t> last_key(last_key_.data(), last_key_.size());
+    if (UNLIKELY(CompareKeys(key, last_key) <= 0))
+      return Status::kAlreadyExists;
+  }
+
+  const span<uint8_t> node(levels_[0].node.data(), page_size_);
+  if (BTreeNode::UsedSize(node) * 100 >= page_size_ * kFillPercent ||
+      !BTreeNode::LeafInsert(node, BTreeNode::EntryCount(node), key, value,
+                             is_overflow)) {
+    // The leaf is complete. The next leaf's page is reserved right away, so the
+    // complete leaf can link to it.
+    Status status;
+    if (leaf_page_id_ == 0) {
+      std::tie(status, leaf_page_id_) = ReservePage();
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+    size_t next_page_id;
+    std::tie(status, next_page_id) = ReservePage();
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    BTreeNode::SetLink64(next_page_id, node);
+    status = WritePage(leaf_page_id_, node);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    Buffer& separator = levels_[0].separator;
+    status = AddChild(1, span<const uint8_t>(separator.data(), separator.size()),
+                      leaf_page_id_);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+
+    leaf_page_id_ = next_page_id;
+    const size_t separator_size = SeparatorSize(
+        span<const uint8_t>(last_key_.data(), last_key_.size()), key);
+    separator.assign(key.data(), key.data() + separator_size);
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+    MAYBE_UNUSED const bool inserted =
+        BTreeNode::LeafInsert(node, 0, key, value, is_overflow);
+    BERRYDB_ASSUME(inserted);
+  }
+
+  last_key_.assign(key.data(), key.data() + key.size());
+  return Status::kSuccess;
+}
+
+Status BTreeBuilder::AddChild(size_t level, span<const uint8_t> separator,
+                              size_t page_id) {
+  BERRYDB_ASSUME_GT(level, 0U);
+  BERRYDB_ASSUME_LE(level, levels_.size());
+
+  if (level == levels_.size()) {
+    // The tree grows by one level. The new level's first node routes all its
+    // keys to its leftmost child.
+    //
+    // Inner nodes hold at least three children, so no store has enough pages
+    // to need more levels than levels_ has room for.
+    BERRYDB_ASSUME_LT(level, BTree::kMaxDepth);
+    levels_.emplace_back();
+    levels_[level].node.resize(page_size_);
+    BTreeNode::Initialize(
+        BTreeNode::Type::kInner, page_id,
+        span<uint8_t>(levels_[level].node.data(), page_size_));
+    levels_[level].separator.assign(separator.begin(), separator.end());
+    return Status::kSuccess;
+  }
+
+  const span<uint8_t> node(levels_[level].node.data(), page_size_);
+  if (BTreeNode::UsedSize(node) * 100 < page_size_ * kFillPercent &&
+      BTreeNode::InnerInsert(node, BTreeNode::EntryCount(node), separator,
+                             page_id)) {
+    return Status::kSuccess;
+  }
+
+  // The node is complete. The separator and the child start the next node, in
+  // the same way that inner node splits move the middle entry's key up.
+  Status status;
+  size_t node_page_id;
+  std::tie(status, node_page_id) = ReservePage();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  status = WritePage(node_page_id, node);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  Buffer& node_separator = levels_[level].separator;
+  status = AddChild(
+      level + 1,
+      span<const uint8_t>(node_separator.data(), node_separator.size()),
+      node_page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  node_separator.assign(separator.begin(), separator.end());
+  BTreeNode::Initialize(BTreeNode::Type::kInner, page_id, node);
+  return Status::kSuccess;
+}
+
+Status BTreeBuilder::Finish() {
+  // Each level's last node is complete. The top level's node is the root.
+  for (size_t level = 0; level + 1 < levels_.size(); ++level) {
+    Status status;
+    size_t page_id;
+    if (level == 0) {
+      // The leaf level has more than one node, so its last leaf has a page.
+      BERRYDB_ASSUME_NE(leaf_page_id_, 0U);
+      page_id = leaf_page_id_;
+    } else {
+      std::tie(status, page_id) = ReservePage();
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+    status = WritePage(
+        page_id, span<const uint8_t>(levels_[level].node.data(), page_size_));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const Buffer& separator = levels_[level].separator;
+    status = AddChild(level + 1,
+                      span<const uint8_t>(separator.data(), separator.size()),
+                      page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+
+  for (Run& run : runs_) {
+    const Status status = FlushRun(&run);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  const bool wrote_pages = levels_.size() > 1;
+  runs_.clear();
+  if (!wrote_pages)
+    return Status::kSuccess;
+
+  // The tree's pages must be durable before the root change is logged.
+  return transaction_->store()->SyncDataFile();
+}
+
+span<const uint8_t> BTreeBuilder::RootNode() const noexcept {
+  if (levels_.empty())
+    return span<const uint8_t>();
+  return span<const uint8_t>(levels_.back().node.data(), page_size_);
+}
+
+std::tuple<Status, size_t> BTreeBuilder::ReservePage() {
+  if (runs_.empty() || runs_.back().reserved_pages == run_page_count_) {
+    // The run is written straight to the data file, so it must not reuse free
+    // pages, which may be cached by the pool or have images in the log.
+    const size_t first_page_id =
+        transaction_->store()->free_page_manager()->AllocNewPages(
+            run_page_count_, transaction_, transaction_);
+    if (UNLIKELY(first_page_id == FreePageManager::kInvalidPageId))
+      return {Status::kIoError, 0};
+
+    runs_.emplace_back();
+    Run& run = runs_.back();
+    run.first_page_id = first_page_id;
+    run.reserved_pages = 0;
+    run.written_pages = 0;
+    if (!free_buffers_.empty()) {
+      run.data = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    }
+    run.data.resize(run_page_count_ * page_size_);
+  }
+
+  Run& run = runs_.back();
+  const size_t page_id = run.first_page_id + run.reserved_pages;
+  ++run.reserved_pages;
+  return {Status::kSuccess, page_id};
+}
+
+Status BTreeBuilder::WritePage(size_t page_id, span<const uint8_t> node) {
+  BERRYDB_ASSUME_EQ(node.size(), page_size_);
+
+  for (auto it = runs_.begin(); it != runs_.end(); ++it) {
+    if (page_id < it->first_page_id ||
+        page_id >= it->first_page_id + it->reserved_pages) {
+      continue;
+    }
+
+    CopySpan(node, span<uint8_t>(it->data.data() +
+                                     (page_id - it->first_page_id) * page_size_,
+                                 page_size_));
+    ++it->written_pages;
+    if (it->written_pages < run_page_count_)
+      return Status::kSuccess;
+
+    // All the run's pages were reserved and written.
+    const Status status = FlushRun(&*it);
+    runs_.erase(it);
+    return status;
+  }
+
+  // The page was not handed out by ReservePage().
+  BERRYDB_UNREACHABLE();
+}
+
+Status BTreeBuilder::FlushRun(Run* run) {
+  BERRYDB_ASSUME_EQ(run->written_pages, run->reserved_pages);
+
+  StoreImpl* const store = transaction_->store();
+  Status status = Status::kSuccess;
+  if (run->written_pages != 0) {
+    status = store->WriteDataFilePages(
+        run->first_page_id,
+        span<const uint8_t>(run->data.data(), run->written_pages * page_size_));
+  }
+  if (run->written_pages < run_page_count_) {
+    store->free_page_manager()->ReturnUnusedPages(
+        run->first_page_id + run->written_pages,
+        run_page_count_ - run->written_pages, transaction_, transaction_);
+  }
+  free_buffers_.push_back(std::move(run->data));
+  return status;
+}
+
+}  // namespace berrydb
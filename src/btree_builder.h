@@ -0,0 +1,156 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_BTREE_BUILDER_H_
+#define BERRYDB_BTREE_BUILDER_H_
+
+#include <tuple>
+#include <vector>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+enum class Status : int;
+class TransactionImpl;
+
+/** Builds a B+tree bottom-up, out of key/value pairs that arrive in order.
+ *
+ * Used by BTree::BulkLoad(). Each level of the tree has a node under
+ * construction. Entries are appended to the leaf under construction until it
+ * reaches the target fill factor. Completed nodes are handed to their parent
+ * level as (separator, page ID) entries, so the inner levels grow as the leaves
+ * are completed. Separators are the shortest keys that tell neighboring nodes
+ * apart.
+ *
+ * Completed nodes are assigned to runs of consecutive pages, which are written
+ * directly to the store's data file, using one I/O operation per run. This
+ * bypasses the page pool and the log, which is safe because the pages aren't
+ * reachable until the tree's root is updated. Finish() syncs the data file,
+ * and the caller then writes the root through the transaction, so the root
+ * change is logged after the tree's other pages are durable.
+ *
+ * The builder's memory usage is proportional to the tree's height, plus two
+ * page runs.
+ */
+class BTreeBuilder {
+ public:
+  /** The percentage of a node's capacity that is filled with entries.
+   *
+   * The remaining space absorbs future insertions, so the first few Put()s in
+   * a bulk-loaded node don't cause a split. */
+  static constexpr size_t kFillPercent = 90;
+
+  /** Sets up a builder that writes pages on behalf of a transaction. */
+  explicit BTreeBuilder(TransactionImpl* transaction);
+  ~BTreeBuilder();
+
+  BTreeBuilder(const BTreeBuilder&) = delete;
+  BTreeBuilder(BTreeBuilder&&) = delete;
+  BTreeBuilder& operator=(const BTreeBuilder&) = delete;
+  BTreeBuilder& operator=(BTreeBuilder&&) = delete;
+
+  /** Appends a key/value pair to the tree.
+   *
+   * @param  key         must be larger than all the keys added before it, and
+   *                     must fit in a node
+   * @param  value       the value stored in the leaf; the entry must fit in a
+   *                     leaf
+   * @param  is_overflow true if the value is a reference to overflow pages
+   * @return             kAlreadyExists if the key is not larger than the
+   *                     previous key; otherwise, most likely kSuccess or
+   *                     kIoError
+   */
+  Status Add(span<const uint8_t> key, span<const uint8_t> value,
+             bool is_overflow);
+
+  /** Writes out all the tree's nodes except for the root, and syncs them.
+   *
+   * After this succeeds, the caller can make the tree reachable by writing
+   * RootNode() to the tree's root page.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status Finish();
+
+  /** The tree's root node. Empty if no pair was added. Valid after Finish(). */
+  span<const uint8_t> RootNode() const noexcept;
+
+ private:
+  using Buffer = std::vector<uint8_t, PlatformAllocator<uint8_t>>;
+
+  /** The node under construction at a level of the tree. */
+  struct Level {
+    /** The node's content. Always a full page. */
+    Buffer node;
+    /** The smallest key that can be stored in the node. */
+    Buffer separator;
+  };
+
+  /** A run of consecutive pages that receives completed nodes. */
+  struct Run {
+    /** The ID of the run's first page. */
+    size_t first_page_id;
+    /** The number of pages handed out by ReservePage(). */
+    size_t reserved_pages;
+    /** The number of pages whose content was set by WritePage(). */
+    size_t written_pages;
+    /** The content of the run's pages. */
+    Buffer data;
+  };
+
+  /** Adds a completed node to its parent level.
+   *
+   * @param  level     the parent level; created if it does not exist
+   * @param  separator the smallest key that can be stored in the child
+   * @param  page_id   the child's page ID
+   * @return           most likely kSuccess or kIoError
+   */
+  Status AddChild(size_t level, span<const uint8_t> separator, size_t page_id);
+
+  /** Hands out the ID of the page that will receive a completed node.
+   *
+   * @return status  most likely kSuccess or kIoError
+   * @return page_id the ID of the reserved page
+   */
+  std::tuple<Status, size_t> ReservePage();
+
+  /** Sets the content of a reserved page.
+   *
+   * The page's run is written to the data file when all its pages are set.
+   *
+   * @param  page_id a page returned by ReservePage()
+   * @param  node    the page's content
+   * @return         most likely kSuccess or kIoError
+   */
+  Status WritePage(size_t page_id, span<const uint8_t> node);
+
+  /** Writes a run's pages to the data file, and returns its unused pages. */
+  Status FlushRun(Run* run);
+
+  TransactionImpl* const transaction_;
+  const size_t page_size_;
+  /** The number of pages in a run. */
+  const size_t run_page_count_;
+  /** The node under construction at each level. Leaves are at level 0. */
+  std::vector<Level, PlatformAllocator<Level>> levels_;
+  /** The last key passed to Add(). */
+  Buffer last_key_;
+  /** The page that receives the leaf under construction, or 0.
+   *
+   * The first leaf's page is reserved when the leaf is completed, because a
+   * lone leaf becomes the tree's root. The following leaves' pages are reserved
+   * when they are started, because the previous leaf links to them. */
+  size_t leaf_page_id_ = 0;
+  /** The runs with reserved pages that weren't written yet. At most two. */
+  std::vector<Run, PlatformAllocator<Run>> runs_;
+  /** Run buffers that can be reused. */
+  std::vector<Buffer, PlatformAllocator<Buffer>> free_buffers_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_BTREE_BUILDER_H_
@@ -0,0 +1,578 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree_node.h"
+
+#include <cstring>
+
+#include "berrydb/status.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+/** Three-way comparison of two keys, ordered lexicographically. */
+inline int CompareKeys(span<const uint8_t> lhs, span<const uint8_t> rhs)
+    noexcept {
+  const size_t common_size =
+      (lhs.size() < rhs.size()) ? lhs.size() : rhs.size();
+  const int compare = (common_size == 0) ? 0 :
+      std::memcmp(lhs.data(), rhs.data(), common_size);
+  if (compare != 0)
+    return compare;
+  if (lhs.size() == rhs.size())
+    return 0;
+  return (lhs.size() < rhs.size()) ? -1 : 1;
+}
+
+/** The size of the longest common prefix of two keys. */
+inline size_t CommonPrefixSize(span<const uint8_t> lhs,
+                               span<const uint8_t> rhs) noexcept {
+  const size_t max_size = (lhs.size() < rhs.size()) ? lhs.size() : rhs.size();
+  size_t size = 0;
+  while (size < max_size && lhs[size] == rhs[size])
+    ++size;
+  return size;
+}
+
+/** True if a key starts with the given prefix. */
+inline bool HasPrefix(span<const uint8_t> key, span<const uint8_t> prefix)
+    noexcept {
+  return key.size() >= prefix.size() && (prefix.empty() ||
+      std::memcmp(key.data(), prefix.data(), prefix.size()) == 0);
+}
+
+}  // namespace
+
+// static
+void BTreeNode::Initialize(Type type, uint64_t link64, span<uint8_t> node)
+    noexcept {
+  BERRYDB_ASSUME_GE(node.size(), kHeaderSize);
+
+  // The unused space is zeroed, so node pages don't depend on their history.
+  FillSpan(node, 0);
+  StoreUint16(static_cast<uint16_t>(type), node.subspan(kTypeOffset, 2));
+  StoreUint64(link64, node.subspan(kLinkOffset, 8));
+}
+
+// static
+void BTreeNode::SetPrefix(span<const uint8_t> prefix, span<uint8_t> node)
+    noexcept {
+  BERRYDB_ASSUME_EQ(EntryCount(node), 0U);
+  BERRYDB_ASSUME_EQ(HeapSize(node), 0U);
+  BERRYDB_ASSUME_LE(prefix.size(), MaxPrefixSize(node.size()));
+
+  StoreUint16(static_cast<uint16_t>(prefix.size()),
+              node.subspan(kPrefixSizeOffset, 2));
+  CopySpan(prefix, node.subspan(kHeaderSize, prefix.size()));
+}
+
+// static
+bool BTreeNode::IsCorrupt(span<const uint8_t> node) noexcept {
+  BERRYDB_ASSUME_GE(node.size(), kHeaderSize);
+  BERRYDB_ASSUME_EQ(node.size() & 7, 0U);
+
+  const Type type = NodeType(node);
+  if (UNLIKELY(type != Type::kLeaf && type != Type::kInner))
+    return true;
+  const size_t slots_offset = SlotsOffset(node);
+  if (UNLIKELY(slots_offset > node.size()))
+    return true;
+  // The entry count is checked by division, so it can't overflow.
+  const size_t entry_count = EntryCount(node);
+  if (UNLIKELY((node.size() - slots_offset) / kSlotSize < entry_count))
+    return true;
+  const size_t heap_size = HeapSize(node);
+  if (UNLIKELY(heap_size >
+               node.size() - slots_offset - entry_count * kSlotSize)) {
+    return true;
+  }
+  // Entry sizes are multiples of the entry alignment.
+  const size_t alignment_mask = (type == Type::kLeaf) ? 1 : 7;
+  if (UNLIKELY((heap_size & alignment_mask) != 0))
+    return true;
+  return false;
+}
+
+// static
+span<const uint8_t> BTreeNode::CheckedEntry(
+    span<const uint8_t> node, Type type, size_t index) noexcept {
+  const size_t entry_count = EntryCount(node);
+  BERRYDB_ASSUME_LT(index, entry_count);
+
+  const size_t offset_offset =
+      SlotsOffset(node) + (entry_count + index) * kKeyHintSize;
+  const size_t end_offset = LoadUint32(node.subspan(offset_offset, 4));
+  const size_t header_size = (type == Type::kLeaf)
+      ? kLeafEntryHeaderSize : kInnerEntryHeaderSize;
+  const size_t alignment_mask = (type == Type::kLeaf) ? 1 : 7;
+  if (UNLIKELY(end_offset > HeapSize(node) || end_offset < header_size ||
+               (end_offset & alignment_mask) != 0)) {
+    return span<const uint8_t>();
+  }
+
+  const span<const uint8_t> entry =
+      node.subspan(node.size() - end_offset, end_offset);
+  const size_t entry_size = (type == Type::kLeaf)
+      ? LeafEntrySize(LoadUint16(entry.subspan(0, 2)), LeafValueSize(entry))
+      : InnerEntrySize(LoadUint16(entry.subspan(8, 2)));
+  if (UNLIKELY(entry_size > end_offset))
+    return span<const uint8_t>();
+  return entry.first(entry_size);
+}
+
+// static
+span<const uint8_t> BTreeNode::EntryKey(span<const uint8_t> entry, Type type)
+    noexcept {
+  if (type == Type::kLeaf) {
+    return entry.subspan(kLeafEntryHeaderSize,
+                         LoadUint16(entry.subspan(0, 2)));
+  }
+  return entry.subspan(kInnerEntryHeaderSize, LoadUint16(entry.subspan(8, 2)));
+}
+
+// static
+void BTreeNode::WriteLeafEntry(span<const uint8_t> key,
+                               span<const uint8_t> value, bool is_overflow,
+                               span<uint8_t> entry) noexcept {
+  BERRYDB_ASSUME_EQ(entry.size(), LeafEntrySize(key.size(), value.size()));
+
+  StoreUint16(static_cast<uint16_t>(key.size()), entry.subspan(0, 2));
+  StoreUint16(static_cast<uint16_t>(value.size() |
+                                    (is_overflow ? kOverflowValueFlag : 0)),
+              entry.subspan(2, 2));
+  CopySpan(key, entry.subspan(kLeafEntryHeaderSize, key.size()));
+  CopySpan(value, entry.subspan(kLeafEntryHeaderSize + key.size(),
+                                value.size()));
+}
+
+// static
+void BTreeNode::WriteInnerEntry(span<const uint8_t> key, uint64_t child64,
+                                span<uint8_t> entry) noexcept {
+  BERRYDB_ASSUME_EQ(entry.size(), InnerEntrySize(key.size()));
+
+  StoreUint64(child64, entry.subspan(0, 8));
+  StoreUint16(static_cast<uint16_t>(key.size()), entry.subspan(8, 2));
+  CopySpan(key, entry.subspan(kInnerEntryHeaderSize, key.size()));
+}
+
+// static
+bool BTreeNode::HasValidEntries(span<const uint8_t> node,
+                                span<const uint8_t> lower,
+                                span<const uint8_t> upper) noexcept {
+  const span<const uint8_t> prefix = Prefix(node);
+  if (UNLIKELY(!HasPrefix(lower, prefix)))
+    return false;
+  // Nodes on the tree's right edge can hold arbitrarily large keys.
+  if (UNLIKELY(upper.empty() ? !prefix.empty() : !HasPrefix(upper, prefix)))
+    return false;
+  const span<const uint8_t> lower_suffix = lower.subspan(prefix.size());
+  const span<const uint8_t> upper_suffix = upper.subspan(prefix.size());
+
+  const Type type = NodeType(node);
+  const size_t entry_count = EntryCount(node);
+  const span<const uint8_t> hints = Hints(node);
+  span<const uint8_t> previous_key;
+  size_t heap_size = 0;
+  for (size_t i = 0; i < entry_count; ++i) {
+    const span<const uint8_t> entry = CheckedEntry(node, type, i);
+    if (UNLIKELY(entry.empty()))
+      return false;
+    heap_size += entry.size();
+
+    const span<const uint8_t> key = EntryKey(entry, type);
+    const uint32_t hint =
+        LoadUint32(hints.subspan(i * kKeyHintSize, kKeyHintSize));
+    if (UNLIKELY(hint != KeyHint(key)))
+      return false;
+    if (UNLIKELY((i == 0) ? CompareKeys(key, lower_suffix) < 0
+                          : CompareKeys(key, previous_key) <= 0)) {
+      return false;
+    }
+    previous_key = key;
+  }
+  if (UNLIKELY(entry_count > 0 && !upper.empty() &&
+               CompareKeys(previous_key, upper_suffix) >= 0)) {
+    return false;
+  }
+  // Overlapping entries would break the size computations done by Split().
+  return heap_size == HeapSize(node);
+}
+
+// static
+std::tuple<Status, bool, size_t> BTreeNode::Search(
+    span<const uint8_t> node, Type type, span<const uint8_t> key) noexcept {
+  // The tree only routes keys in a node's range to the node, and all the keys
+  // in the range have the node's prefix.
+  const span<const uint8_t> prefix = Prefix(node);
+  if (UNLIKELY(!HasPrefix(key, prefix)))
+    return {Status::kDataCorrupted, false, 0};
+  const span<const uint8_t> suffix = key.subspan(prefix.size());
+
+  // The hints narrow down the search to the entries whose keys have the same
+  // first bytes as the given key. Most searches end here.
+  const uint32_t hint = KeyHint(suffix);
+  const span<const uint8_t> hints = Hints(node);
+  const size_t entry_count = EntryCount(node);
+  size_t first = KeyHintLowerBound(hints, entry_count, hint);
+  if (first == entry_count ||
+      LoadUint32(hints.subspan(first * kKeyHintSize, kKeyHintSize)) != hint) {
+    return {Status::kSuccess, false, first};
+  }
+  size_t last = entry_count;
+  if (hint != UINT32_MAX) {
+    last = first + KeyHintLowerBound(
+        hints.subspan(first * kKeyHintSize,
+                      (entry_count - first) * kKeyHintSize),
+        entry_count - first, hint + 1);
+  }
+
+  while (first < last) {
+    const size_t middle = first + (last - first) / 2;
+    const span<const uint8_t> entry = CheckedEntry(node, type, middle);
+    if (UNLIKELY(entry.empty()))
+      return {Status::kDataCorrupted, false, 0};
+
+    const int compare = CompareKeys(suffix, EntryKey(entry, type));
+    if (compare == 0)
+      return {Status::kSuccess, true, middle};
+    if (compare < 0)
+      last = middle;
+    else
+      first = middle + 1;
+  }
+  return {Status::kSuccess, false, first};
+}
+
+// static
+span<uint8_t> BTreeNode::AddEntry(span<uint8_t> node, size_t index,
+                                  uint32_t hint, size_t entry_size) noexcept {
+  const size_t entry_count = EntryCount(node);
+  const size_t heap_size = HeapSize(node);
+  const size_t slots_offset = SlotsOffset(node);
+  BERRYDB_ASSUME_LE(index, entry_count);
+
+  if (slots_offset + (entry_count + 1) * kSlotSize + heap_size + entry_size >
+      node.size()) {
+    return span<uint8_t>();
+  }
+
+  // Both halves of the slot array grow by one element.
+  uint8_t* const hints = node.data() + slots_offset;
+  uint8_t* const offsets = hints + entry_count * kKeyHintSize;
+  std::memmove(offsets + (index + 2) * 4, offsets + index * 4,
+               (entry_count - index) * 4);
+  std::memmove(offsets + 4, offsets, index * 4);
+  std::memmove(hints + (index + 1) * kKeyHintSize, hints + index * kKeyHintSize,
+               (entry_count - index) * kKeyHintSize);
+
+  const size_t new_heap_size = heap_size + entry_size;
+  StoreUint32(hint, span<uint8_t>(hints + index * kKeyHintSize, kKeyHintSize));
+  StoreUint32(static_cast<uint32_t>(new_heap_size),
+              span<uint8_t>(offsets + 4 + index * 4, 4));
+  SetEntries(entry_count + 1, new_heap_size, node);
+
+  const span<uint8_t> entry =
+      node.subspan(node.size() - new_heap_size, entry_size);
+  FillSpan(entry, 0);
+  return entry;
+}
+
+// static
+void BTreeNode::RemoveEntry(span<uint8_t> node, Type type, size_t index)
+    noexcept {
+  const size_t entry_count = EntryCount(node);
+  const size_t heap_size = HeapSize(node);
+  const size_t slots_offset = SlotsOffset(node);
+  BERRYDB_ASSUME_LT(index, entry_count);
+
+  uint8_t* const hints = node.data() + slots_offset;
+  uint8_t* const offsets = hints + entry_count * kKeyHintSize;
+
+  // The entry was found by a search, which checked it.
+  const size_t entry_size = CheckedEntry(node, type, index).size();
+  BERRYDB_ASSUME_NE(entry_size, 0U);
+  const size_t end_offset = LoadUint32(span<uint8_t>(offsets + index * 4, 4));
+
+  // Close the gap in the heap, and update the offsets of the moved entries.
+  uint8_t* const heap = node.data() + node.size() - heap_size;
+  std::memmove(heap + entry_size, heap, heap_size - end_offset);
+  FillSpan(span<uint8_t>(heap, entry_size), 0);
+  for (size_t i = 0; i < entry_count; ++i) {
+    const span<uint8_t> offset(offsets + i * 4, 4);
+    const size_t entry_end_offset = LoadUint32(offset);
+    if (entry_end_offset > end_offset) {
+      StoreUint32(static_cast<uint32_t>(entry_end_offset - entry_size),
+                  offset);
+    }
+  }
+
+  // Both halves of the slot array shrink by one element.
+  std::memmove(hints + index * kKeyHintSize, hints + (index + 1) * kKeyHintSize,
+               (entry_count - index - 1) * kKeyHintSize);
+  std::memmove(offsets - 4, offsets, index * 4);
+  std::memmove(offsets - 4 + index * 4, offsets + (index + 1) * 4,
+               (entry_count - index - 1) * 4);
+  FillSpan(node.subspan(slots_offset + (entry_count - 1) * kSlotSize,
+                        kSlotSize), 0);
+
+  SetEntries(entry_count - 1, heap_size - entry_size, node);
+}
+
+// static
+std::tuple<Status, bool, size_t> BTreeNode::LeafFind(
+    span<const uint8_t> node, span<const uint8_t> key) noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kLeaf);
+  return Search(node, Type::kLeaf, key);
+}
+
+// static
+span<const uint8_t> BTreeNode::LeafValue(span<const uint8_t> node,
+                                         size_t index) noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kLeaf);
+
+  // The entry was found by a search, which checked it.
+  const span<const uint8_t> entry = CheckedEntry(node, Type::kLeaf, index);
+  BERRYDB_ASSUME(!entry.empty());
+  const size_t key_size = LoadUint16(entry.subspan(0, 2));
+  return entry.subspan(kLeafEntryHeaderSize + key_size, LeafValueSize(entry));
+}
+
+// static
+span<uint8_t> BTreeNode::LeafMutableValue(span<uint8_t> node, size_t index)
+    noexcept {
+  const span<const uint8_t> value = LeafValue(node, index);
+  const size_t value_offset = value.data() - node.data();
+  return node.subspan(value_offset, value.size());
+}
+
+// static
+bool BTreeNode::LeafHasOverflowValue(span<const uint8_t> node, size_t index)
+    noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kLeaf);
+
+  // The entry was found by a search, which checked it.
+  const span<const uint8_t> entry = CheckedEntry(node, Type::kLeaf, index);
+  BERRYDB_ASSUME(!entry.empty());
+  return (LoadUint16(entry.subspan(2, 2)) & kOverflowValueFlag) != 0;
+}
+
+// static
+bool BTreeNode::LeafInsert(span<uint8_t> node, size_t index,
+                           span<const uint8_t> key, span<const uint8_t> value,
+                           bool is_overflow) noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kLeaf);
+  BERRYDB_ASSUME_LE(key.size(), kMaxEncodableEntrySize);
+  BERRYDB_ASSUME_LE(value.size(), kMaxEncodableEntrySize);
+
+  // LeafFind() checked that the key has the node's prefix.
+  const size_t prefix_size = Prefix(node).size();
+  BERRYDB_ASSUME_LE(prefix_size, key.size());
+  const span<const uint8_t> suffix = key.subspan(prefix_size);
+
+  const span<uint8_t> entry = AddEntry(
+      node, index, KeyHint(suffix), LeafEntrySize(suffix.size(), value.size()));
+  if (entry.empty())
+    return false;
+  WriteLeafEntry(suffix, value, is_overflow, entry);
+  return true;
+}
+
+// static
+void BTreeNode::LeafRemove(span<uint8_t> node, size_t index) noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kLeaf);
+  RemoveEntry(node, Type::kLeaf, index);
+}
+
+// static
+std::tuple<Status, size_t> BTreeNode::InnerFind(
+    span<const uint8_t> node, span<const uint8_t> key) noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kInner);
+
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = Search(node, Type::kInner, key);
+  return {status, found ? index + 1 : index};
+}
+
+// static
+std::tuple<Status, uint64_t> BTreeNode::InnerChild(
+    span<const uint8_t> node, span<const uint8_t> key) noexcept {
+  Status status;
+  size_t index;
+  std::tie(status, index) = InnerFind(node, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  return InnerChildAt(node, index);
+}
+
+// static
+std::tuple<Status, uint64_t> BTreeNode::InnerChildAt(
+    span<const uint8_t> node, size_t index) noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kInner);
+
+  if (index == 0)
+    return {Status::kSuccess, Link64(node)};
+
+  const span<const uint8_t> entry =
+      CheckedEntry(node, Type::kInner, index - 1);
+  if (UNLIKELY(entry.empty()))
+    return {Status::kDataCorrupted, 0};
+  return {Status::kSuccess, LoadUint64(entry.first(8))};
+}
+
+// static
+std::tuple<Status, span<const uint8_t>> BTreeNode::KeySuffix(
+    span<const uint8_t> node, size_t index) noexcept {
+  const Type type = NodeType(node);
+  const span<const uint8_t> entry = CheckedEntry(node, type, index);
+  if (UNLIKELY(entry.empty()))
+    return {Status::kDataCorrupted, span<const uint8_t>()};
+  return {Status::kSuccess, EntryKey(entry, type)};
+}
+
+// static
+bool BTreeNode::InnerInsert(span<uint8_t> node, size_t index,
+                            span<const uint8_t> key, uint64_t child64)
+    noexcept {
+  BERRYDB_ASSUME(NodeType(node) == Type::kInner);
+  BERRYDB_ASSUME_LE(key.size(), kMaxEncodableEntrySize);
+
+  // InnerFind() checked that the key has the node's prefix.
+  const size_t prefix_size = Prefix(node).size();
+  BERRYDB_ASSUME_LE(prefix_size, key.size());
+  const span<const uint8_t> suffix = key.subspan(prefix_size);
+
+  const span<uint8_t> entry = AddEntry(
+      node, index, KeyHint(suffix), InnerEntrySize(suffix.size()));
+  if (entry.empty())
+    return false;
+  WriteInnerEntry(suffix, child64, entry);
+  return true;
+}
+
+// static
+void BTreeNode::CopyNode(span<const uint8_t> node, span<uint8_t> to) noexcept {
+  BERRYDB_ASSUME_GE(to.size(), node.size());
+
+  // Entry offsets are relative to the end of the node, so the heap is copied
+  // to the end of the new buffer.
+  const size_t slots_end = SlotsOffset(node) + EntryCount(node) * kSlotSize;
+  const size_t heap_size = HeapSize(node);
+  CopySpan(node.first(slots_end), to.first(slots_end));
+  FillSpan(to.subspan(slots_end, to.size() - slots_end - heap_size), 0);
+  CopySpan(node.subspan(node.size() - heap_size, heap_size),
+           to.subspan(to.size() - heap_size, heap_size));
+}
+
+// static
+void BTreeNode::CopyEntries(span<const uint8_t> node, size_t begin, size_t end,
+                            size_t strip_size, span<uint8_t> to) noexcept {
+  const Type type = NodeType(node);
+  for (size_t i = begin; i < end; ++i) {
+    // HasValidEntries() checked all the entries.
+    const span<const uint8_t> entry = CheckedEntry(node, type, i);
+    BERRYDB_ASSUME(!entry.empty());
+    const span<const uint8_t> key = EntryKey(entry, type);
+    BERRYDB_ASSUME_LE(strip_size, key.size());
+    const span<const uint8_t> suffix = key.subspan(strip_size);
+
+    const size_t index = EntryCount(to);
+    if (type == Type::kLeaf) {
+      const span<const uint8_t> value = entry.subspan(
+          kLeafEntryHeaderSize + key.size(), LeafValueSize(entry));
+      const bool is_overflow =
+          (LoadUint16(entry.subspan(2, 2)) & kOverflowValueFlag) != 0;
+      const span<uint8_t> to_entry = AddEntry(
+          to, index, KeyHint(suffix), LeafEntrySize(suffix.size(),
+                                                    value.size()));
+      BERRYDB_ASSUME(!to_entry.empty());
+      WriteLeafEntry(suffix, value, is_overflow, to_entry);
+    } else {
+      const span<uint8_t> to_entry = AddEntry(
+          to, index, KeyHint(suffix), InnerEntrySize(suffix.size()));
+      BERRYDB_ASSUME(!to_entry.empty());
+      WriteInnerEntry(suffix, LoadUint64(entry.first(8)), to_entry);
+    }
+  }
+}
+
+// static
+size_t BTreeNode::Split(span<const uint8_t> node, span<const uint8_t> lower,
+                        span<const uint8_t> upper, span<uint8_t> left,
+                        span<uint8_t> right, uint64_t right_page_id,
+                        span<uint8_t> separator) noexcept {
+  const Type type = NodeType(node);
+  const size_t entry_count = EntryCount(node);
+  BERRYDB_ASSUME_GE(entry_count, 2U);
+  BERRYDB_ASSUME_EQ(left.size(), right.size());
+
+  // The split entry is the first entry that doesn't fit in the left half. Both
+  // halves must end up with at least one entry.
+  const size_t total_size = HeapSize(node) + entry_count * kSlotSize;
+  size_t split_index = 0;
+  size_t left_size = 0;
+  while (split_index < entry_count - 1) {
+    const size_t entry_size =
+        CheckedEntry(node, type, split_index).size() + kSlotSize;
+    if (split_index > 0 && left_size + entry_size > total_size / 2)
+      break;
+    left_size += entry_size;
+    ++split_index;
+  }
+  const span<const uint8_t> split_entry =
+      CheckedEntry(node, type, split_index);
+  const span<const uint8_t> split_key = EntryKey(split_entry, type);
+
+  // Leaf separators only need enough bytes to tell the two halves apart.
+  // Inner separators are moved up as they are.
+  size_t separator_suffix_size = split_key.size();
+  if (type == Type::kLeaf) {
+    const span<const uint8_t> last_left_key =
+        EntryKey(CheckedEntry(node, type, split_index - 1), type);
+    separator_suffix_size = CommonPrefixSize(last_left_key, split_key) + 1;
+    BERRYDB_ASSUME_LE(separator_suffix_size, split_key.size());
+  }
+  const span<const uint8_t> prefix = Prefix(node);
+  const size_t separator_size = prefix.size() + separator_suffix_size;
+  BERRYDB_ASSUME_LE(separator_size, separator.size());
+  CopySpan(prefix, separator.first(prefix.size()));
+  CopySpan(split_key.first(separator_suffix_size),
+           separator.subspan(prefix.size(), separator_suffix_size));
+  const span<const uint8_t> separator_key =
+      span<const uint8_t>(separator).first(separator_size);
+
+  // The halves' key ranges are narrower than the node's range, so their
+  // prefixes are at least as long as the node's prefix.
+  const size_t max_prefix_size = MaxPrefixSize(left.size());
+  size_t left_prefix_size = CommonPrefixSize(lower, separator_key);
+  if (left_prefix_size > max_prefix_size)
+    left_prefix_size = max_prefix_size;
+  size_t right_prefix_size =
+      upper.empty() ? 0 : CommonPrefixSize(separator_key, upper);
+  if (right_prefix_size > max_prefix_size)
+    right_prefix_size = max_prefix_size;
+  BERRYDB_ASSUME_GE(left_prefix_size, prefix.size());
+  BERRYDB_ASSUME_GE(right_prefix_size, prefix.size());
+
+  if (type == Type::kLeaf) {
+    Initialize(Type::kLeaf, right_page_id, left);
+    Initialize(Type::kLeaf, Link64(node), right);
+  } else {
+    // The split entry's child becomes the right node's leftmost child.
+    Initialize(Type::kInner, Link64(node), left);
+    Initialize(Type::kInner, LoadUint64(split_entry.first(8)), right);
+  }
+  SetPrefix(separator_key.first(left_prefix_size), left);
+  SetPrefix(separator_key.first(right_prefix_size), right);
+
+  CopyEntries(node, 0, split_index, left_prefix_size - prefix.size(), left);
+  CopyEntries(node, (type == Type::kLeaf) ? split_index : split_index + 1,
+              entry_count, right_prefix_size - prefix.size(), right);
+  return separator_size;
+}
+
+}  // namespace berrydb
@@ -0,0 +1,476 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_BTREE_NODE_H_
+#define BERRYDB_BTREE_NODE_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./util/checks.h"
+#include "./util/endianness.h"
+#include "./util/key_hints.h"
+
+namespace berrydb {
+
+enum class Status : int;
+
+/** The layout of the pages that make up a space's B+tree.
+ *
+ * Nodes use a slotted layout. Each node page starts with a 24-byte header,
+ * followed by the node's key prefix, followed by a slot array. The entries are
+ * stored in a heap that grows down from the end of the node.
+ *
+ * Header layout:
+ * 0: 16-bit node type (Type::kLeaf or Type::kInner)
+ * 2: 16-bit size of the key prefix
+ * 4: 32-bit number of entries
+ * 8: 32-bit size of the entry heap, in bytes
+ * 12: reserved, must be zero
+ * 16: 64-bit link; leaves store the page ID of their right sibling, or 0 for
+ *     the last leaf; inner nodes store the page ID of the child that holds the
+ *     keys smaller than the node's first key
+ *
+ * The key prefix is shared by all the keys that can be stored in the node, and
+ * is stripped from the keys in the node's entries. The prefix is padded to a
+ * multiple of 4 bytes.
+ *
+ * The slot array has two parts. The first part holds the key hints of the
+ * entries, in key order. See KeyHint() for details. The second part holds the
+ * 32-bit offsets of the entries, in key order. Offsets are measured from the
+ * end of the node, so a node can be moved into a larger buffer without updating
+ * its offsets.
+ *
+ * Leaf entries are 2-byte-aligned, and consist of a 16-bit key size, a 16-bit
+ * value size, the key bytes, and the value bytes. The value size's top bit is
+ * set if the value is stored in overflow pages, in which case the entry holds
+ * a reference to the pages instead of the value. Inner entries are
+ * 8-byte-aligned, and consist of a 64-bit child page ID, a 16-bit key size, and
+ * the key bytes. An inner entry's child holds the keys that are greater than or
+ * equal to the entry's key, and smaller than the next entry's key. The key
+ * bytes exclude the node's prefix.
+ *
+ * Each node covers a range of keys, delimited by the separators in the node's
+ * ancestors. The node's prefix must be a common prefix of the range's lower and
+ * upper fences. The tree computes the fences when it splits a node, so it does
+ * not need to store them.
+ *
+ * An all-zero page is an empty leaf. This makes zero-filled pages valid empty
+ * trees.
+ *
+ * The node's capacity is the size of the span passed to the methods below. This
+ * lets the tree build an oversized node in a scratch buffer when a node must be
+ * split.
+ */
+class BTreeNode {
+ public:
+  /** The node types. */
+  enum class Type : uint16_t {
+    kLeaf = 0,
+    kInner = 1,
+  };
+
+  /** The size of the node header, in bytes. */
+  static constexpr size_t kHeaderSize = 24;
+
+  /** The size of an entry's slot, in bytes. */
+  static constexpr size_t kSlotSize = kKeyHintSize + 4;
+
+  /** The node's type. Only meaningful if the node passed IsCorrupt(). */
+  static inline Type NodeType(span<const uint8_t> node) noexcept {
+    return static_cast<Type>(LoadUint16(node.subspan(kTypeOffset, 2)));
+  }
+
+  /** The number of entries in a node. */
+  static inline size_t EntryCount(span<const uint8_t> node) noexcept {
+    return LoadUint32(node.subspan(kEntryCountOffset, 4));
+  }
+
+  /** The total size of a node's entries, in bytes. Excludes the slots. */
+  static inline size_t HeapSize(span<const uint8_t> node) noexcept {
+    return LoadUint32(node.subspan(kHeapSizeOffset, 4));
+  }
+
+  /** The number of bytes used by a node's header, prefix, slots and entries.
+   *
+   * The node must have passed IsCorrupt(). */
+  static inline size_t UsedSize(span<const uint8_t> node) noexcept {
+    return SlotsOffset(node) + EntryCount(node) * kSlotSize + HeapSize(node);
+  }
+
+  /** The key prefix shared by all the entries in a node.
+   *
+   * The node must have passed IsCorrupt(). */
+  static inline span<const uint8_t> Prefix(span<const uint8_t> node) noexcept {
+    return node.subspan(kHeaderSize,
+                        LoadUint16(node.subspan(kPrefixSizeOffset, 2)));
+  }
+
+  /** A leaf's right sibling, or an inner node's leftmost child.
+   *
+   * See the class comment for details. The return value is a 64-bit number, so
+   * the caller has to handle page IDs that don't fit in size_t.
+   */
+  static inline uint64_t Link64(span<const uint8_t> node) noexcept {
+    return LoadUint64(node.subspan(kLinkOffset, 8));
+  }
+
+  /** Changes a leaf's right sibling, or an inner node's leftmost child. */
+  static inline void SetLink64(uint64_t link64, span<uint8_t> node) noexcept {
+    StoreUint64(link64, node.subspan(kLinkOffset, 8));
+  }
+
+  /** Sets up an empty node with no key prefix.
+   *
+   * @param type   the node's type
+   * @param link64 see Link64()
+   * @param node   the buffer that will hold the node
+   */
+  static void Initialize(Type type, uint64_t link64, span<uint8_t> node)
+      noexcept;
+
+  /** The size of the largest entry that can be stored in a node.
+   *
+   * The size includes the entry's slot. Entries are limited to a quarter of the
+   * node's capacity, so a full node can always be split into two nodes that
+   * have room for a new entry.
+   */
+  static constexpr size_t MaxEntrySize(size_t page_size) noexcept {
+    return ((page_size - kHeaderSize) / 4 < kMaxEncodableEntrySize)
+        ? (page_size - kHeaderSize) / 4 : kMaxEncodableEntrySize;
+  }
+
+  /** The size of the largest key that can be stored in a tree. */
+  static constexpr size_t MaxKeySize(size_t page_size) noexcept {
+    // Keys must fit in inner entries, whose header is larger.
+    return (MaxEntrySize(page_size) & ~static_cast<size_t>(7)) -
+           kInnerEntryHeaderSize - kSlotSize;
+  }
+
+  /** The size of the longest key prefix that a node can have.
+   *
+   * Capping the prefix guarantees that split nodes fit in their pages. */
+  static constexpr size_t MaxPrefixSize(size_t page_size) noexcept {
+    return (MaxEntrySize(page_size) / 2) & ~static_cast<size_t>(3);
+  }
+
+  /** True if a key/value pair can be stored in a leaf. */
+  static constexpr bool FitsInLeaf(size_t key_size, size_t value_size,
+                                   size_t page_size) noexcept {
+    return key_size <= MaxKeySize(page_size) &&
+           value_size <= MaxEntrySize(page_size) &&
+           LeafEntrySize(key_size, value_size) + kSlotSize <=
+               MaxEntrySize(page_size);
+  }
+
+  /** True if a node's header is inconsistent with the node's buffer.
+   *
+   * Nodes read from the store must pass this check before they are handed to
+   * the other methods. The entries are checked as they are accessed. */
+  static bool IsCorrupt(span<const uint8_t> node) noexcept;
+
+  /** Thoroughly checks a node's entries against the node's key range.
+   *
+   * Nodes must pass this check before they are split. The check is too slow to
+   * be done on every access.
+   *
+   * @param  node  a node that passed IsCorrupt()
+   * @param  lower the smallest key that the node can hold
+   * @param  upper all the node's keys must be smaller than this; empty if the
+   *               node is on the tree's right edge
+   * @return       true if the entries are well-formed, sorted, consistent with
+   *               their hints, and within the node's key range
+   */
+  static bool HasValidEntries(span<const uint8_t> node,
+                              span<const uint8_t> lower,
+                              span<const uint8_t> upper) noexcept;
+
+  /** Looks up a key in a leaf.
+   *
+   * @param  node   a leaf node
+   * @param  key    the key to look for
+   * @return status kSuccess or kDataCorrupted
+   * @return found  true if the leaf has an entry for the key
+   * @return index  the index of the key's entry if the key was found, or of the
+   *                first entry with a larger key, or the number of entries;
+   *                can be passed to LeafInsert()
+   */
+  static std::tuple<Status, bool, size_t> LeafFind(
+      span<const uint8_t> node, span<const uint8_t> key) noexcept;
+
+  /** The value in a leaf entry.
+   *
+   * @param node  a leaf node
+   * @param index the index of an entry found by LeafFind()
+   */
+  static span<const uint8_t> LeafValue(span<const uint8_t> node, size_t index)
+      noexcept;
+
+  /** The value in a leaf entry, for modification.
+   *
+   * @param node  a leaf node
+   * @param index the index of an entry found by LeafFind()
+   */
+  static span<uint8_t> LeafMutableValue(span<uint8_t> node, size_t index)
+      noexcept;
+
+  /** True if a leaf entry's value is stored in overflow pages.
+   *
+   * The entry's LeafValue() is a reference to the overflow pages.
+   *
+   * @param node  a leaf node
+   * @param index the index of an entry found by LeafFind()
+   */
+  static bool LeafHasOverflowValue(span<const uint8_t> node, size_t index)
+      noexcept;
+
+  /** Adds an entry to a leaf, if it fits.
+   *
+   * @param  node        a leaf node
+   * @param  index       the entry's index, obtained from LeafFind()
+   * @param  key         the entry's key; must not be in the leaf already
+   * @param  value       the entry's value
+   * @param  is_overflow true if the value is a reference to overflow pages
+   * @return             false if the node does not have room for the entry; the
+   *                     node is not modified in that case
+   */
+  static bool LeafInsert(span<uint8_t> node, size_t index,
+                         span<const uint8_t> key, span<const uint8_t> value,
+                         bool is_overflow = false) noexcept;
+
+  /** True if LeafInsert() would find room for an entry in a leaf.
+   *
+   * This lets callers pick a leaf without asking for write access to it.
+   *
+   * @param node       a leaf node
+   * @param key_size   the size of the entry's key, which must have the leaf's
+   *                   prefix
+   * @param value_size the size of the entry's value
+   */
+  static inline bool LeafHasRoom(span<const uint8_t> node, size_t key_size,
+                                 size_t value_size) noexcept {
+    BERRYDB_ASSUME_LE(Prefix(node).size(), key_size);
+    return UsedSize(node) + kSlotSize +
+               LeafEntrySize(key_size - Prefix(node).size(), value_size) <=
+           node.size();
+  }
+
+  /** Removes an entry from a leaf.
+   *
+   * @param node  a leaf node
+   * @param index the index of an entry found by LeafFind()
+   */
+  static void LeafRemove(span<uint8_t> node, size_t index) noexcept;
+
+  /** Finds the child of an inner node that may hold a key.
+   *
+   * @param  node    an inner node
+   * @param  key     the key to look for
+   * @return status  kSuccess or kDataCorrupted
+   * @return child64 the page ID of the child that may hold the key
+   */
+  static std::tuple<Status, uint64_t> InnerChild(
+      span<const uint8_t> node, span<const uint8_t> key) noexcept;
+
+  /** The child of an inner node at a given position.
+   *
+   * @param  node    an inner node
+   * @param  index   0 for the node's leftmost child, or i for the child of the
+   *                 node's entry i - 1; at most EntryCount()
+   * @return status  kSuccess or kDataCorrupted
+   * @return child64 the page ID of the child
+   */
+  static std::tuple<Status, uint64_t> InnerChildAt(
+      span<const uint8_t> node, size_t index) noexcept;
+
+  /** Finds the entry of an inner node that routes a key.
+   *
+   * @param  node   an inner node
+   * @param  key    the key to look for
+   * @return status kSuccess or kDataCorrupted
+   * @return index  the number of entries whose keys are smaller than or equal
+   *                to the given key; 0 means that the key is routed to the
+   *                node's leftmost child
+   */
+  static std::tuple<Status, size_t> InnerFind(
+      span<const uint8_t> node, span<const uint8_t> key) noexcept;
+
+  /** The key in an entry, without the node's prefix.
+   *
+   * @param  node   a node
+   * @param  index  the entry's index
+   * @return status kSuccess or kDataCorrupted
+   * @return suffix the key's bytes after the node's prefix
+   */
+  static std::tuple<Status, span<const uint8_t>> KeySuffix(
+      span<const uint8_t> node, size_t index) noexcept;
+
+  /** Adds a separator key to an inner node, if it fits.
+   *
+   * @param  node    an inner node
+   * @param  index   the entry's index, obtained from InnerFind()
+   * @param  key     the smallest key in the child; must not be in the node
+   * @param  child64 the page ID of the child
+   * @return         false if the node does not have room for the entry; the
+   *                 node is not modified in that case
+   */
+  static bool InnerInsert(span<uint8_t> node, size_t index,
+                          span<const uint8_t> key, uint64_t child64) noexcept;
+
+  /** Copies a node into a buffer that may be larger than the node.
+   *
+   * @param node the node to be copied
+   * @param to   receives the node; must be at least as large as the node
+   */
+  static void CopyNode(span<const uint8_t> node, span<uint8_t> to) noexcept;
+
+  /** Splits a node's entries into two nodes of roughly equal size.
+   *
+   * Leaf splits keep all the entries. The right leaf becomes the left leaf's
+   * sibling. The separator is the shortest key that sorts between the halves.
+   * Inner node splits move the middle entry's key up to the parent, and the
+   * middle entry's child becomes the right node's leftmost child.
+   *
+   * Each half gets the longest key prefix allowed by its key range.
+   *
+   * @param  node           the node whose entries will be split; usually an
+   *                        oversized node built in a scratch buffer; must have
+   *                        at least two entries, must have passed
+   *                        HasValidEntries(), and must not overlap the other
+   *                        buffers
+   * @param  lower          the lower fence passed to HasValidEntries()
+   * @param  upper          the upper fence passed to HasValidEntries()
+   * @param  left           receives the node with the smaller keys
+   * @param  right          receives the node with the larger keys
+   * @param  right_page_id  the page ID of the right node
+   * @param  separator      receives the key that separates the two nodes in
+   *                        their parent; must have room for MaxKeySize() bytes
+   * @return                the size of the separator key
+   */
+  static size_t Split(span<const uint8_t> node, span<const uint8_t> lower,
+                      span<const uint8_t> upper, span<uint8_t> left,
+                      span<uint8_t> right, uint64_t right_page_id,
+                      span<uint8_t> separator) noexcept;
+
+ private:
+  static constexpr size_t kTypeOffset = 0;
+  static constexpr size_t kPrefixSizeOffset = 2;
+  static constexpr size_t kEntryCountOffset = 4;
+  static constexpr size_t kHeapSizeOffset = 8;
+  static constexpr size_t kLinkOffset = 16;
+
+  static constexpr size_t kLeafEntryHeaderSize = 4;
+  static constexpr size_t kInnerEntryHeaderSize = 10;
+
+  /** Entry sizes are stored in 16-bit fields. */
+  static constexpr size_t kMaxEncodableEntrySize = 0x7FF8;
+
+  /** Set in a leaf entry's value size if the value is in overflow pages. */
+  static constexpr uint16_t kOverflowValueFlag = 0x8000;
+
+  /** The size of the value in a leaf entry, without kOverflowValueFlag. */
+  static inline size_t LeafValueSize(span<const uint8_t> entry) noexcept {
+    return LoadUint16(entry.subspan(2, 2)) & (kOverflowValueFlag - 1);
+  }
+
+  /** The size of a leaf entry, including padding. */
+  static constexpr size_t LeafEntrySize(size_t key_size, size_t value_size)
+      noexcept {
+    return (kLeafEntryHeaderSize + key_size + value_size + 1) &
+           ~static_cast<size_t>(1);
+  }
+
+  /** The size of an inner entry, including padding. */
+  static constexpr size_t InnerEntrySize(size_t key_size) noexcept {
+    return (kInnerEntryHeaderSize + key_size + 7) & ~static_cast<size_t>(7);
+  }
+
+  /** The offset of a node's slot array. */
+  static inline size_t SlotsOffset(span<const uint8_t> node) noexcept {
+    return kHeaderSize +
+        ((LoadUint16(node.subspan(kPrefixSizeOffset, 2)) + 3) &
+         ~static_cast<size_t>(3));
+  }
+
+  /** A node's array of key hints. */
+  static inline span<const uint8_t> Hints(span<const uint8_t> node) noexcept {
+    return node.subspan(SlotsOffset(node), EntryCount(node) * kKeyHintSize);
+  }
+
+  /** The entry with the given index, or an empty span if it's corrupted. */
+  static span<const uint8_t> CheckedEntry(span<const uint8_t> node, Type type,
+                                          size_t index) noexcept;
+
+  /** The key suffix stored in an entry returned by CheckedEntry(). */
+  static span<const uint8_t> EntryKey(span<const uint8_t> entry, Type type)
+      noexcept;
+
+  /** Encodes a leaf entry into space reserved by AddEntry(). */
+  static void WriteLeafEntry(span<const uint8_t> key, span<const uint8_t> value,
+                             bool is_overflow, span<uint8_t> entry) noexcept;
+
+  /** Encodes an inner entry into space reserved by AddEntry(). */
+  static void WriteInnerEntry(span<const uint8_t> key, uint64_t child64,
+                              span<uint8_t> entry) noexcept;
+
+  /** Appends a range of a node's entries to another node.
+   *
+   * @param node       the node whose entries are copied
+   * @param begin      the index of the first entry to be copied
+   * @param end        the index after the last entry to be copied
+   * @param strip_size the number of key bytes to drop, because they are in the
+   *                   destination node's prefix
+   * @param to         receives the entries
+   */
+  static void CopyEntries(span<const uint8_t> node, size_t begin, size_t end,
+                          size_t strip_size, span<uint8_t> to) noexcept;
+
+  /** Binary search over a node's entries.
+   *
+   * @param  node   a node
+   * @param  type   the node's type
+   * @param  key    the key to look for, including the node's prefix
+   * @return status kSuccess or kDataCorrupted
+   * @return found  true if the node has an entry for the key
+   * @return index  the index of the first entry whose key is greater than or
+   *                equal to the given key
+   */
+  static std::tuple<Status, bool, size_t> Search(
+      span<const uint8_t> node, Type type, span<const uint8_t> key) noexcept;
+
+  /** Reserves room for a new entry in a node.
+   *
+   * @param  node       the node that receives the entry
+   * @param  index      the new entry's index
+   * @param  hint       the new entry's key hint
+   * @param  entry_size the size of the new entry, including padding
+   * @return            the zero-filled space for the entry, or an empty span
+   *                    if the node does not have room for the entry
+   */
+  static span<uint8_t> AddEntry(span<uint8_t> node, size_t index,
+                                uint32_t hint, size_t entry_size) noexcept;
+
+  /** Removes an entry from a node. */
+  static void RemoveEntry(span<uint8_t> node, Type type, size_t index)
+      noexcept;
+
+  /** Sets the key prefix of an empty node. */
+  static void SetPrefix(span<const uint8_t> prefix, span<uint8_t> node)
+      noexcept;
+
+  /** Updates the header fields that describe the entries. */
+  static inline void SetEntries(size_t entry_count, size_t heap_size,
+                                span<uint8_t> node) noexcept {
+    BERRYDB_ASSUME_LE(heap_size, node.size() - kHeaderSize);
+    StoreUint32(static_cast<uint32_t>(entry_count),
+                node.subspan(kEntryCountOffset, 4));
+    StoreUint32(static_cast<uint32_t>(heap_size),
+                node.subspan(kHeapSizeOffset, 4));
+  }
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_BTREE_NODE_H_
@@ -0,0 +1,496 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree_node.h"
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/status.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kNodeSize = 256;
+
+span<const uint8_t> StringSpan(const std::string& string) {
+  return span<const uint8_t>(reinterpret_cast<const uint8_t*>(string.data()),
+                             string.size());
+}
+
+std::string SpanString(span<const uint8_t> data) {
+  return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+/** Inserts an entry in a leaf, asserting that it fits. */
+void InsertInLeaf(span<uint8_t> node, const std::string& key,
+                  const std::string& value) {
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(node, StringSpan(key));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_FALSE(found);
+  ASSERT_TRUE(BTreeNode::LeafInsert(node, index, StringSpan(key),
+                                    StringSpan(value)));
+}
+
+/** Inserts an entry in an inner node, asserting that it fits. */
+void InsertInInner(span<uint8_t> node, const std::string& key,
+                   uint64_t child64) {
+  Status status;
+  size_t index;
+  std::tie(status, index) = BTreeNode::InnerFind(node, StringSpan(key));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(BTreeNode::InnerInsert(node, index, StringSpan(key), child64));
+}
+
+/** The value stored for a key in a leaf, or "(missing)". */
+std::string LeafLookup(span<const uint8_t> node, const std::string& key) {
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(node, StringSpan(key));
+  EXPECT_EQ(Status::kSuccess, status);
+  if (!found)
+    return "(missing)";
+  return SpanString(BTreeNode::LeafValue(node, index));
+}
+
+/** The child that an inner node routes a key to. */
+uint64_t InnerLookup(span<const uint8_t> node, const std::string& key) {
+  Status status;
+  uint64_t child64;
+  std::tie(status, child64) = BTreeNode::InnerChild(node, StringSpan(key));
+  EXPECT_EQ(Status::kSuccess, status);
+  return child64;
+}
+
+/** Splits a node, and returns the separator. */
+std::string SplitNode(span<const uint8_t> node, const std::string& lower,
+                      const std::string& upper, span<uint8_t> left,
+                      span<uint8_t> right, uint64_t right_page_id) {
+  EXPECT_TRUE(BTreeNode::HasValidEntries(node, StringSpan(lower),
+                                         StringSpan(upper)));
+  uint8_t separator[kNodeSize];
+  const size_t separator_size = BTreeNode::Split(
+      node, StringSpan(lower), StringSpan(upper), left, right, right_page_id,
+      span<uint8_t>(separator));
+  return SpanString(span<const uint8_t>(separator, separator_size));
+}
+
+}  // namespace
+
+TEST(BTreeNodeTest, ZeroedPageIsEmptyLeaf) {
+  alignas(8) uint8_t buffer[kNodeSize] = {};
+  span<uint8_t> node(buffer);
+
+  EXPECT_FALSE(BTreeNode::IsCorrupt(node));
+  EXPECT_EQ(BTreeNode::Type::kLeaf, BTreeNode::NodeType(node));
+  EXPECT_EQ(0U, BTreeNode::EntryCount(node));
+  EXPECT_EQ(0U, BTreeNode::Link64(node));
+  EXPECT_EQ("", SpanString(BTreeNode::Prefix(node)));
+  EXPECT_EQ("(missing)", LeafLookup(node, "key"));
+}
+
+TEST(BTreeNodeTest, LeafInsertFindRemove) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 42, node);
+
+  InsertInLeaf(node, "mango", "yellow");
+  InsertInLeaf(node, "apple", "red");
+  InsertInLeaf(node, "kiwi", "green");
+  InsertInLeaf(node, "", "empty");
+  EXPECT_EQ(4U, BTreeNode::EntryCount(node));
+  EXPECT_EQ(42U, BTreeNode::Link64(node));
+  EXPECT_FALSE(BTreeNode::IsCorrupt(node));
+  EXPECT_TRUE(BTreeNode::HasValidEntries(node, StringSpan(""),
+                                         StringSpan("")));
+
+  EXPECT_EQ("yellow", LeafLookup(node, "mango"));
+  EXPECT_EQ("red", LeafLookup(node, "apple"));
+  EXPECT_EQ("green", LeafLookup(node, "kiwi"));
+  EXPECT_EQ("empty", LeafLookup(node, ""));
+  EXPECT_EQ("(missing)", LeafLookup(node, "app"));
+  EXPECT_EQ("(missing)", LeafLookup(node, "apples"));
+
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) =
+      BTreeNode::LeafFind(node, StringSpan("kiwi"));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(found);
+  EXPECT_EQ(2U, index);
+  BTreeNode::LeafRemove(node, index);
+  EXPECT_EQ(3U, BTreeNode::EntryCount(node));
+  EXPECT_TRUE(BTreeNode::HasValidEntries(node, StringSpan(""),
+                                         StringSpan("")));
+  EXPECT_EQ("(missing)", LeafLookup(node, "kiwi"));
+  EXPECT_EQ("yellow", LeafLookup(node, "mango"));
+  EXPECT_EQ("red", LeafLookup(node, "apple"));
+  EXPECT_EQ("empty", LeafLookup(node, ""));
+}
+
+TEST(BTreeNodeTest, LeafRemoveZeroesFreedSpace) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  alignas(8) uint8_t expected_buffer[kNodeSize];
+  span<uint8_t> node(buffer), expected(expected_buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, expected);
+
+  InsertInLeaf(node, "apple", "red");
+  InsertInLeaf(node, "kiwi", "green");
+  InsertInLeaf(expected, "apple", "red");
+
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) =
+      BTreeNode::LeafFind(node, StringSpan("kiwi"));
+  ASSERT_EQ(Status::kSuccess, status);
+  ASSERT_TRUE(found);
+  BTreeNode::LeafRemove(node, index);
+  // The page only depends on its entries, not on its history.
+  EXPECT_EQ(SpanString(expected), SpanString(node));
+}
+
+TEST(BTreeNodeTest, LeafInsertRejectsEntriesThatDontFit) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+
+  const std::string value(50, 'v');
+  size_t inserted = 0;
+  while (true) {
+    const std::string key = "key" + std::to_string(inserted);
+    Status status;
+    bool found;
+    size_t index;
+    std::tie(status, found, index) =
+        BTreeNode::LeafFind(node, StringSpan(key));
+    ASSERT_EQ(Status::kSuccess, status);
+    const size_t heap_size = BTreeNode::HeapSize(node);
+    if (!BTreeNode::LeafInsert(node, index, StringSpan(key),
+                               StringSpan(value))) {
+      EXPECT_EQ(heap_size, BTreeNode::HeapSize(node));
+      break;
+    }
+    ++inserted;
+  }
+  EXPECT_EQ(inserted, BTreeNode::EntryCount(node));
+  // Each entry takes up 58 bytes in the heap and 8 bytes in the slot array.
+  EXPECT_EQ(3U, inserted);
+}
+
+TEST(BTreeNodeTest, LeafFindWithSharedHints) {
+  alignas(8) uint8_t buffer[kNodeSize * 4];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+
+  // Keys that are shorter than a hint, keys that share their hints, and keys
+  // whose hint is the largest possible value.
+  const std::string keys[] = {
+    "", "a", "ab", std::string("ab\0", 3), "abc", "abcd", "abcd0", "abcd1", "abcd10",
+    "abcd2", "abce", "\xff\xff\xff", "\xff\xff\xff\xff",
+    "\xff\xff\xff\xff\x01", "\xff\xff\xff\xff\xff",
+  };
+  // Insert in an order that differs from the key order.
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    const size_t key_index = (i * 7) % (sizeof(keys) / sizeof(keys[0]));
+    InsertInLeaf(node, keys[key_index], "v" + std::to_string(key_index));
+  }
+  EXPECT_TRUE(BTreeNode::HasValidEntries(node, StringSpan(""),
+                                         StringSpan("")));
+
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+    EXPECT_EQ("v" + std::to_string(i), LeafLookup(node, keys[i])) << i;
+  EXPECT_EQ("(missing)", LeafLookup(node, std::string("ab\0\0", 4)));
+  EXPECT_EQ("(missing)", LeafLookup(node, "abcd00"));
+  EXPECT_EQ("(missing)", LeafLookup(node, "abcd3"));
+  EXPECT_EQ("(missing)",
+            LeafLookup(node, std::string("\xff\xff\xff\xff\0", 5)));
+  EXPECT_EQ("(missing)", LeafLookup(node, "\xff\xff\xff\xff\xff\xff"));
+}
+
+TEST(BTreeNodeTest, InnerChildRouting) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kInner, 10, node);
+
+  InsertInInner(node, "m", 30);
+  InsertInInner(node, "f", 20);
+  InsertInInner(node, "t", 40);
+  EXPECT_EQ(3U, BTreeNode::EntryCount(node));
+  EXPECT_FALSE(BTreeNode::IsCorrupt(node));
+
+  EXPECT_EQ(10U, InnerLookup(node, ""));
+  EXPECT_EQ(10U, InnerLookup(node, "a"));
+  EXPECT_EQ(20U, InnerLookup(node, "f"));
+  EXPECT_EQ(20U, InnerLookup(node, "lzz"));
+  EXPECT_EQ(30U, InnerLookup(node, "m"));
+  EXPECT_EQ(40U, InnerLookup(node, "t"));
+  EXPECT_EQ(40U, InnerLookup(node, "zzz"));
+
+  Status status;
+  size_t index;
+  std::tie(status, index) = BTreeNode::InnerFind(node, StringSpan("m"));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(2U, index);
+  span<const uint8_t> suffix;
+  std::tie(status, suffix) = BTreeNode::KeySuffix(node, index - 1);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ("m", SpanString(suffix));
+}
+
+TEST(BTreeNodeTest, CopyNodeToLargerBuffer) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  alignas(8) uint8_t large_buffer[kNodeSize * 2];
+  span<uint8_t> node(buffer), large_node(large_buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  InsertInLeaf(node, "apple", "red");
+  InsertInLeaf(node, "kiwi", "green");
+
+  BTreeNode::CopyNode(node, large_node);
+  EXPECT_FALSE(BTreeNode::IsCorrupt(large_node));
+  EXPECT_EQ("red", LeafLookup(large_node, "apple"));
+  EXPECT_EQ("green", LeafLookup(large_node, "kiwi"));
+  InsertInLeaf(large_node, "mango", "yellow");
+  EXPECT_EQ("yellow", LeafLookup(large_node, "mango"));
+}
+
+TEST(BTreeNodeTest, SplitLeaf) {
+  alignas(8) uint8_t buffer[kNodeSize * 2];
+  alignas(8) uint8_t left_buffer[kNodeSize];
+  alignas(8) uint8_t right_buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 7, node);
+
+  for (int i = 0; i < 20; ++i)
+    InsertInLeaf(node, "key" + std::to_string(100 + i), std::to_string(i));
+
+  span<uint8_t> left(left_buffer), right(right_buffer);
+  const std::string separator = SplitNode(node, "", "", left, right, 99);
+  // The separator is the shortest key that tells the halves apart.
+  EXPECT_EQ("key11", separator);
+  EXPECT_FALSE(BTreeNode::IsCorrupt(left));
+  EXPECT_FALSE(BTreeNode::IsCorrupt(right));
+  EXPECT_EQ(10U, BTreeNode::EntryCount(left));
+  EXPECT_EQ(10U, BTreeNode::EntryCount(right));
+  EXPECT_EQ(99U, BTreeNode::Link64(left));
+  EXPECT_EQ(7U, BTreeNode::Link64(right));
+  // Nodes on the tree's edges can't have prefixes.
+  EXPECT_EQ("", SpanString(BTreeNode::Prefix(left)));
+  EXPECT_EQ("", SpanString(BTreeNode::Prefix(right)));
+
+  for (int i = 0; i < 20; ++i) {
+    const std::string key = "key" + std::to_string(100 + i);
+    if (key < separator) {
+      EXPECT_EQ(std::to_string(i), LeafLookup(left, key));
+      EXPECT_EQ("(missing)", LeafLookup(right, key));
+    } else {
+      EXPECT_EQ("(missing)", LeafLookup(left, key));
+      EXPECT_EQ(std::to_string(i), LeafLookup(right, key));
+    }
+  }
+}
+
+TEST(BTreeNodeTest, OverflowValueFlag) {
+  alignas(8) uint8_t buffer[kNodeSize * 2];
+  alignas(8) uint8_t left_buffer[kNodeSize];
+  alignas(8) uint8_t right_buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+
+  const std::string reference(16, 'r');
+  for (int i = 0; i < 10; ++i) {
+    const std::string key = "key" + std::to_string(100 + i);
+    Status status;
+    bool found;
+    size_t index;
+    std::tie(status, found, index) =
+        BTreeNode::LeafFind(node, StringSpan(key));
+    ASSERT_EQ(Status::kSuccess, status);
+    ASSERT_TRUE(BTreeNode::LeafInsert(node, index, StringSpan(key),
+                                      StringSpan(reference), i % 2 == 0));
+  }
+
+  span<uint8_t> left(left_buffer), right(right_buffer);
+  SplitNode(node, "", "", left, right, 99);
+  for (span<const uint8_t> half : {span<const uint8_t>(left),
+                                   span<const uint8_t>(right)}) {
+    EXPECT_FALSE(BTreeNode::IsCorrupt(half));
+    for (size_t index = 0; index < BTreeNode::EntryCount(half); ++index) {
+      // The flag doesn't change the value's size.
+      EXPECT_EQ(reference, SpanString(BTreeNode::LeafValue(half, index)));
+      // Nodes on the tree's edges can't have prefixes.
+      Status status;
+      span<const uint8_t> suffix;
+      std::tie(status, suffix) = BTreeNode::KeySuffix(half, index);
+      ASSERT_EQ(Status::kSuccess, status);
+      const std::string key = SpanString(suffix);
+      EXPECT_EQ((key.back() - '0') % 2 == 0,
+                BTreeNode::LeafHasOverflowValue(half, index)) << key;
+    }
+  }
+}
+
+TEST(BTreeNodeTest, SplitLeafTruncatesPrefixes) {
+  alignas(8) uint8_t buffer[kNodeSize * 2];
+  alignas(8) uint8_t left_buffer[kNodeSize];
+  alignas(8) uint8_t right_buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+
+  for (int i = 0; i < 20; ++i)
+    InsertInLeaf(node, "key" + std::to_string(100 + i), std::to_string(i));
+
+  span<uint8_t> left(left_buffer), right(right_buffer);
+  const std::string separator =
+      SplitNode(node, "key1", "key2", left, right, 99);
+  EXPECT_EQ("key11", separator);
+  EXPECT_EQ("key1", SpanString(BTreeNode::Prefix(left)));
+  // The prefix of the right half is limited by its upper fence.
+  EXPECT_EQ("key", SpanString(BTreeNode::Prefix(right)));
+  EXPECT_TRUE(BTreeNode::HasValidEntries(left, StringSpan("key1"),
+                                         StringSpan("key11")));
+  EXPECT_TRUE(BTreeNode::HasValidEntries(right, StringSpan("key11"),
+                                         StringSpan("key2")));
+  // The stripped prefix makes room for more entries.
+  EXPECT_LT(BTreeNode::HeapSize(left) + BTreeNode::HeapSize(right),
+            BTreeNode::HeapSize(node));
+
+  for (int i = 0; i < 20; ++i) {
+    const std::string key = "key" + std::to_string(100 + i);
+    EXPECT_EQ(std::to_string(i),
+              LeafLookup((key < separator) ? left : right, key));
+  }
+  // New keys in the ranges of the halves can be added.
+  InsertInLeaf(left, "key1", "first");
+  InsertInLeaf(right, "key199", "last");
+  EXPECT_EQ("first", LeafLookup(left, "key1"));
+  EXPECT_EQ("last", LeafLookup(right, "key199"));
+
+  // Keys outside a node's range indicate a corrupted tree.
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) =
+      BTreeNode::LeafFind(left, StringSpan("key0"));
+  EXPECT_EQ(Status::kDataCorrupted, status);
+}
+
+TEST(BTreeNodeTest, SplitInner) {
+  alignas(8) uint8_t buffer[kNodeSize * 2];
+  alignas(8) uint8_t left_buffer[kNodeSize];
+  alignas(8) uint8_t right_buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kInner, 1000, node);
+
+  for (int i = 0; i < 15; ++i)
+    InsertInInner(node, "key" + std::to_string(100 + i), 1001 + i);
+
+  span<uint8_t> left(left_buffer), right(right_buffer);
+  const std::string separator = SplitNode(node, "", "", left, right, 99);
+  EXPECT_FALSE(BTreeNode::IsCorrupt(left));
+  EXPECT_FALSE(BTreeNode::IsCorrupt(right));
+  // The separator moves up to the parent.
+  EXPECT_EQ(14U, BTreeNode::EntryCount(left) + BTreeNode::EntryCount(right));
+  EXPECT_EQ(1000U, BTreeNode::Link64(left));
+
+  EXPECT_EQ(1000U, InnerLookup(left, "a"));
+  for (int i = 0; i < 15; ++i) {
+    const std::string key = "key" + std::to_string(100 + i);
+    EXPECT_EQ(1001U + i,
+              InnerLookup((key < separator) ? left : right, key)) << key;
+  }
+}
+
+TEST(BTreeNodeTest, HasValidEntries) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  InsertInLeaf(node, "b", "1");
+  InsertInLeaf(node, "d", "2");
+
+  EXPECT_TRUE(BTreeNode::HasValidEntries(node, StringSpan(""),
+                                         StringSpan("")));
+  EXPECT_TRUE(BTreeNode::HasValidEntries(node, StringSpan("b"),
+                                         StringSpan("e")));
+  EXPECT_FALSE(BTreeNode::HasValidEntries(node, StringSpan("c"),
+                                          StringSpan("")));
+  EXPECT_FALSE(BTreeNode::HasValidEntries(node, StringSpan(""),
+                                          StringSpan("d")));
+
+  // Swapping the hints breaks the hint order.
+  const size_t hints_offset = BTreeNode::kHeaderSize;
+  std::swap_ranges(buffer + hints_offset, buffer + hints_offset + kKeyHintSize,
+                   buffer + hints_offset + kKeyHintSize);
+  EXPECT_FALSE(BTreeNode::HasValidEntries(node, StringSpan(""),
+                                          StringSpan("")));
+}
+
+TEST(BTreeNodeTest, CorruptHeaders) {
+  alignas(8) uint8_t buffer[kNodeSize] = {};
+  span<uint8_t> node(buffer);
+
+  buffer[0] = 7;  // Invalid type.
+  EXPECT_TRUE(BTreeNode::IsCorrupt(node));
+
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  buffer[9] = 0x10;  // The heap is larger than the node.
+  EXPECT_TRUE(BTreeNode::IsCorrupt(node));
+
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  buffer[7] = 0x10;  // The slot array is larger than the node.
+  EXPECT_TRUE(BTreeNode::IsCorrupt(node));
+
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  buffer[3] = 0x10;  // The prefix is larger than the node.
+  EXPECT_TRUE(BTreeNode::IsCorrupt(node));
+}
+
+TEST(BTreeNodeTest, CorruptEntries) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  InsertInLeaf(node, "key", "value");
+
+  // The entry claims a key that extends past the node's heap.
+  buffer[kNodeSize - BTreeNode::HeapSize(node)] = 200;
+  EXPECT_FALSE(BTreeNode::IsCorrupt(node));
+  Status status;
+  bool found;
+  size_t index;
+  std::tie(status, found, index) =
+      BTreeNode::LeafFind(node, StringSpan("key"));
+  EXPECT_EQ(Status::kDataCorrupted, status);
+
+  // The entry's offset points outside the heap.
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  InsertInLeaf(node, "key", "value");
+  buffer[BTreeNode::kHeaderSize + kKeyHintSize] = 100;
+  EXPECT_FALSE(BTreeNode::IsCorrupt(node));
+  std::tie(status, found, index) =
+      BTreeNode::LeafFind(node, StringSpan("key"));
+  EXPECT_EQ(Status::kDataCorrupted, status);
+}
+
+TEST(BTreeNodeTest, SizeLimits) {
+  EXPECT_EQ((4096U - 24U) / 4, BTreeNode::MaxEntrySize(4096));
+  EXPECT_EQ(0x7FF8U, BTreeNode::MaxEntrySize(1 << 20));
+  EXPECT_TRUE(BTreeNode::FitsInLeaf(8, 100, 4096));
+  EXPECT_FALSE(BTreeNode::FitsInLeaf(8, 2000, 4096));
+  EXPECT_FALSE(BTreeNode::FitsInLeaf(BTreeNode::MaxKeySize(4096) + 1, 0,
+                                     4096));
+  EXPECT_LE(BTreeNode::MaxPrefixSize(4096), BTreeNode::MaxKeySize(4096));
+}
+
+}  // namespace berrydb
@@ -0,0 +1,1563 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./btree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/catalog.h"
+#include "berrydb/cursor.h"
+#include "berrydb/options.h"
+#include "berrydb/pinned_value.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "berrydb/write_batch.h"
+#include "./btree_buffer.h"
+#include "./btree_node.h"
+#include "./test/space_helpers.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+/** A BulkLoadSource that produces the key/value pairs in a vector. */
+class PairSource {
+ public:
+  explicit PairSource(
+      const std::vector<std::pair<std::string, std::string>>* pairs)
+      : pairs_(pairs) {}
+
+  static bool Next(void* context, span<const uint8_t>* key,
+                   span<const uint8_t>* value) {
+    PairSource* const source = reinterpret_cast<PairSource*>(context);
+    if (source->next_ == source->pairs_->size())
+      return false;
+    const auto& pair = (*source->pairs_)[source->next_];
+    ++source->next_;
+    *key = StringSpan(pair.first);
+    *value = StringSpan(pair.second);
+    return true;
+  }
+
+ private:
+  const std::vector<std::pair<std::string, std::string>>* const pairs_;
+  size_t next_ = 0;
+};
+
+}  // namespace
+
+class BTreeTest : public SpaceTest {
+ protected:
+  BTreeTest() : SpaceTest("test_btree.berry") {}
+
+  /** The values of many keys read by MultiGet(), or "(missing)". */
+  std::vector<std::string> MultiGet(Transaction* transaction,
+                                    const std::vector<std::string>& keys) {
+    std::vector<span<const uint8_t>> key_spans;
+    for (const std::string& key : keys)
+      key_spans.push_back(StringSpan(key));
+    std::vector<Status> statuses(keys.size(), Status::kIoError);
+    std::vector<PinnedValue> values(keys.size());
+    const Status status = transaction->MultiGet(
+        space_.get(),
+        span<const span<const uint8_t>>(key_spans.data(), key_spans.size()),
+        span<Status>(statuses.data(), statuses.size()),
+        span<PinnedValue>(values.data(), values.size()));
+    EXPECT_EQ(Status::kSuccess, status);
+
+    std::vector<std::string> results;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (statuses[i] == Status::kNotFound) {
+        results.push_back("(missing)");
+        continue;
+      }
+      EXPECT_EQ(Status::kSuccess, statuses[i]);
+      results.push_back(SpanString(values[i].data()));
+    }
+    return results;
+  }
+
+  /** Reads a value in chunks of the given size, using ReadValue(). */
+  template <typename TransactionType>
+  std::string ReadValueInChunks(TransactionType* transaction,
+                                const std::string& key, size_t chunk_size) {
+    std::string value;
+    std::string chunk(chunk_size, ' ');
+    while (true) {
+      Status status;
+      size_t value_size;
+      std::tie(status, value_size) = transaction->ReadValue(
+          space_.get(), StringSpan(key), value.size(),
+          span<uint8_t>(reinterpret_cast<uint8_t*>(&chunk[0]), chunk.size()));
+      EXPECT_EQ(Status::kSuccess, status);
+      if (status != Status::kSuccess || value.size() >= value_size)
+        return value;
+      value.append(chunk, 0, std::min(chunk_size, value_size - value.size()));
+    }
+  }
+
+  /** Bulk-loads the pairs in a vector into the space. */
+  Status BulkLoad(Transaction* transaction,
+                  const std::vector<std::pair<std::string, std::string>>& pairs) {
+    PairSource source(&pairs);
+    return transaction->BulkLoad(space_.get(), &PairSource::Next, &source);
+  }
+
+  /** Overwrites and deletes large values, and checks that pages are reused.
+   *
+   * The store must be open, and the space must be empty. */
+  void ChurnLargeValues(size_t page_size) {
+    std::map<std::string, std::string> expected;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20; ++i)
+      keys.push_back("key" + std::to_string(1000 + i));
+
+    size_t warm_page_count = 0;
+    for (int round = 0; round < 60; ++round) {
+      if (round == 10)
+        warm_page_count = StorePageCount();
+
+      UniquePtr<Transaction> transaction(store_->CreateTransaction());
+      for (int i = 0; i < 5; ++i) {
+        const std::string& key = keys[rnd_() % keys.size()];
+        if (rnd_() % 4 == 0) {
+          Status status =
+              transaction->Delete(space_.get(), StringSpan(key));
+          ASSERT_TRUE(status == Status::kSuccess ||
+                      status == Status::kNotFound);
+          expected.erase(key);
+          continue;
+        }
+        const std::string value =
+            RandomValue(&rnd_, page_size + rnd_() % (3 * page_size));
+        ASSERT_EQ(Status::kSuccess, transaction->Put(
+            space_.get(), StringSpan(key), StringSpan(value)));
+        expected[key] = value;
+      }
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    }
+    ExpectSpaceMatches(expected, keys);
+
+    // 20 live values use at most 80 pages. Without page reuse, the 250 values
+    // written after warm-up would use about 600 pages.
+    EXPECT_LT(StorePageCount(), warm_page_count + 200);
+
+    space_.reset();
+    store_.reset();
+    OpenStore();
+    OpenSpace("space");
+    ExpectSpaceMatches(expected, keys);
+  }
+};
+
+/** Runs tests against write-buffered spaces. */
+class BufferedBTreeTest : public BTreeTest {
+ protected:
+  BufferedBTreeTest() { space_options_.write_buffered = true; }
+};
+
+TEST_F(BTreeTest, PutGetDelete) {
+  OpenStore();
+  CreateSpace("space");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("longer value")));
+  EXPECT_EQ("longer value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan(""), StringSpan("")));
+  EXPECT_EQ("", Get(transaction.get(), ""));
+
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan("key")));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  // Deleting a missing key succeeds.
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan("key")));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BTreeTest, WritersOnOneSpaceAreIsolated) {
+  // Locks held by transactions on the same thread can't be released while
+  // waiting, so conflicting requests fail right away despite the timeout.
+  store_options_.lock_timeout_ms = 10000;
+  OpenStore();
+  CreateSpace("space");
+
+  UniquePtr<Transaction> writer1(store_->CreateTransaction());
+  UniquePtr<Transaction> writer2(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, writer1->Put(
+      space_.get(), StringSpan("a"), StringSpan("value a")));
+  // Both keys are in the same leaf, which holds writer1's uncommitted change.
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(Status::kAlreadyLocked, writer2->Put(
+      space_.get(), StringSpan("b"), StringSpan("value b")));
+  EXPECT_EQ(Status::kAlreadyLocked,
+            writer2->Delete(space_.get(), StringSpan("b")));
+  EXPECT_GT(std::chrono::milliseconds(5000),
+            std::chrono::steady_clock::now() - start);
+  // Readers of the space would see writer1's uncommitted change.
+  Status status;
+  span<const uint8_t> value;
+  std::tie(status, value) = writer2->Get(space_.get(), StringSpan("a"));
+  EXPECT_EQ(Status::kAlreadyLocked, status);
+  ASSERT_EQ(Status::kSuccess, writer1->Rollback());
+  EXPECT_EQ("(missing)", Get(writer2.get(), "b"));
+  ASSERT_EQ(Status::kSuccess, writer2->Commit());
+
+  UniquePtr<Transaction> reader(store_->CreateTransaction());
+  EXPECT_EQ("(missing)", Get(reader.get(), "a"));
+  EXPECT_EQ("(missing)", Get(reader.get(), "b"));
+  ASSERT_EQ(Status::kSuccess, reader->Commit());
+
+  // The space is unlocked when its writer closes.
+  writer1.reset(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, writer1->Put(
+      space_.get(), StringSpan("b"), StringSpan("value b")));
+  ASSERT_EQ(Status::kSuccess, writer1->Commit());
+  reader.reset(store_->CreateTransaction());
+  EXPECT_EQ("value b", Get(reader.get(), "b"));
+  ASSERT_EQ(Status::kSuccess, reader->Commit());
+}
+
+TEST_F(BTreeTest, RandomOperationsMatchMap) {
+  // Small pages produce deep trees quickly.
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  std::uniform_int_distribution<size_t> key_size_distribution(0, 40);
+  std::uniform_int_distribution<size_t> value_size_distribution(0, 120);
+  std::uniform_int_distribution<int> byte_distribution('a', 'z');
+  std::uniform_int_distribution<int> operation_distribution(0, 9);
+
+  for (int round = 0; round < 20; ++round) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 500; ++i) {
+      const int operation = operation_distribution(rnd_);
+      if (operation < 2 && !keys.empty()) {
+        // Delete a key that was inserted earlier.
+        const std::string& key = keys[rnd_() % keys.size()];
+        ASSERT_EQ(Status::kSuccess,
+                  transaction->Delete(space_.get(), StringSpan(key)));
+        expected.erase(key);
+        continue;
+      }
+
+      std::string key(key_size_distribution(rnd_), ' ');
+      for (char& c : key)
+        c = static_cast<char>(byte_distribution(rnd_));
+      std::string value(value_size_distribution(rnd_), ' ');
+      for (char& c : value)
+        c = static_cast<char>(byte_distribution(rnd_));
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+      keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // The tree survives closing and reopening the store.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, keys);
+}
+
+TEST_F(BTreeTest, SequentialInsertsGrowTree) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  constexpr int kKeyCount = 20000;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < kKeyCount; ++i) {
+      const std::string key = "key" + std::to_string(1000000 + i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(std::to_string(i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < kKeyCount; ++i) {
+    const std::string key = "key" + std::to_string(1000000 + i);
+    ASSERT_EQ(std::to_string(i), Get(reader.get(), key));
+  }
+  EXPECT_EQ("(missing)", Get(reader.get(), "key"));
+  EXPECT_EQ("(missing)", Get(reader.get(), "kez"));
+}
+
+TEST_F(BTreeTest, MultiGet) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 5000; ++i) {
+      const std::string key = "key" + std::to_string(1000000 + i * 2);
+      // Some values are stored in overflow pages.
+      const std::string value =
+          (i % 500 == 0) ? RandomValue(&rnd_, 3000) : std::to_string(i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // The tree's pages are read from the data file, so they are prefetched.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 300; ++i)
+    keys.push_back("key" + std::to_string(1000000 + rnd_() % 10000));
+  keys.push_back(keys.front());
+  keys.push_back("");
+  keys.push_back("zzz");
+
+  auto expected_values = [&](const std::vector<std::string>& keys) {
+    std::vector<std::string> values;
+    for (const std::string& key : keys) {
+      const auto it = expected.find(key);
+      values.push_back(it == expected.end() ? "(missing)" : it->second);
+    }
+    return values;
+  };
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    EXPECT_EQ(expected_values(keys), MultiGet(transaction.get(), keys));
+
+    // MultiGet sees the transaction's changes.
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan(keys[0]), StringSpan("changed")));
+    ASSERT_EQ(Status::kSuccess,
+              transaction->Delete(space_.get(), StringSpan(keys[1])));
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("new")));
+    expected[keys[0]] = "changed";
+    expected.erase(keys[1]);
+    expected["key"] = "new";
+    keys.push_back("key");
+    EXPECT_EQ(expected_values(keys), MultiGet(transaction.get(), keys));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  TransactionOptions options;
+  options.optimistic = true;
+  UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+  EXPECT_EQ(expected_values(keys), MultiGet(transaction.get(), keys));
+  EXPECT_EQ(std::vector<std::string>(), MultiGet(transaction.get(), {}));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BTreeTest, WriteBatch) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; ++i) {
+      const std::string key = "key" + std::to_string(100000 + i * 4);
+      const std::string value =
+          (i % 200 == 0) ? RandomValue(&rnd_, 3000) : std::to_string(i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+      keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  for (int round = 0; round < 3; ++round) {
+    UniquePtr<WriteBatch> batch(WriteBatch::Create());
+    for (int i = 0; i < 3000; ++i) {
+      const std::string key = "key" + std::to_string(100000 + rnd_() % 8000);
+      keys.push_back(key);
+      if (rnd_() % 4 == 0) {
+        batch->Delete(space_.get(), StringSpan(key));
+        expected.erase(key);
+        continue;
+      }
+      // New keys split leaves, and some values are stored in overflow pages.
+      const std::string value =
+          (rnd_() % 100 == 0) ? RandomValue(&rnd_, 2000 + rnd_() % 2000)
+                              : RandomValue(&rnd_, rnd_() % 100);
+      batch->Put(space_.get(), StringSpan(key), StringSpan(value));
+      expected[key] = value;
+    }
+
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Write(batch.get()));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    ExpectSpaceMatches(expected, keys);
+  }
+
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, keys);
+}
+
+TEST_F(BTreeTest, KeysWithSharedPrefixes) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  // Long shared prefixes are stripped from the entries of inner nodes and
+  // leaves, so this exercises splits across nodes with different prefixes.
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 2000; ++i) {
+    const std::string id = std::to_string(100000 + i);
+    keys.push_back("users/" + id + "/profile");
+    keys.push_back("users/" + id + "/settings");
+  }
+  keys.push_back("users/");
+  keys.push_back("users0");
+  std::shuffle(keys.begin(), keys.end(), rnd_);
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const std::string value = std::to_string(i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(keys[i]), StringSpan(value)));
+      expected[keys[i]] = value;
+    }
+    for (size_t i = 0; i < keys.size(); i += 3) {
+      ASSERT_EQ(Status::kSuccess, transaction->Delete(
+          space_.get(), StringSpan(keys[i])));
+      expected.erase(keys[i]);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  keys.push_back("users");
+  keys.push_back("users/1");
+  keys.push_back("users/100000/");
+  keys.push_back("users/100000/profilf");
+  ExpectSpaceMatches(expected, keys);
+}
+
+TEST_F(BTreeTest, RolledBackChangesAreUndone) {
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("committed")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("rolled back")));
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)), StringSpan("value")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("committed", Get(transaction.get(), "key"));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "0"));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "999"));
+}
+
+TEST_F(BTreeTest, ReadTransactionsSeeSnapshots) {
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("old")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> old_reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("new")));
+    // Uncommitted changes are not visible to readers.
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    EXPECT_EQ("old", Get(reader.get(), "key"));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  EXPECT_EQ("old", Get(old_reader.get(), "key"));
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  EXPECT_EQ("new", Get(new_reader.get(), "key"));
+}
+
+TEST_F(BTreeTest, OptimisticTransactionsSeeTheirChanges) {
+  OpenStore();
+  CreateSpace("space");
+
+  TransactionOptions options;
+  options.optimistic = true;
+  UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+  for (int i = 0; i < 500; ++i) {
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan(std::to_string(i)), StringSpan("value")));
+  }
+  EXPECT_EQ("value", Get(transaction.get(), "42"));
+
+  // The changes are not visible before the transaction commits.
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    EXPECT_EQ("(missing)", Get(reader.get(), "42"));
+  }
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < 500; ++i)
+    ASSERT_EQ("value", Get(reader.get(), std::to_string(i)));
+}
+
+TEST_F(BTreeTest, OptimisticRetriesWithoutWritersCommit) {
+  // The transaction reads more pages than the pool holds, so some of them are
+  // evicted and fetched again while it runs.
+  CreatePool(10, 32);
+  OpenStore();
+  CreateSpace("space");
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan("key" + std::to_string(10000 + i)),
+          StringSpan(RandomValue(&rnd_, 50))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  TransactionOptions options;
+  options.optimistic = true;
+  for (int attempt = 0; attempt < 5; ++attempt) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_NE("(missing)",
+                Get(transaction.get(), "key" + std::to_string(10000 + i)));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("counter"),
+        StringSpan(std::to_string(attempt))));
+    // No other transaction ran, so there is nothing to conflict with.
+    EXPECT_EQ(Status::kSuccess, transaction->Commit()) << attempt;
+  }
+}
+
+TEST_F(BTreeTest, TooLarge) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string large_key(BTreeNode::MaxKeySize(page_size) + 1, 'k');
+  const std::string large_value(page_size, 'v');
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ(Status::kTooLarge, transaction->Put(
+      space_.get(), StringSpan(large_key), StringSpan("value")));
+  EXPECT_EQ(Status::kTooLarge, transaction->Put(
+      space_.get(), StringSpan(large_key), StringSpan(large_value)));
+  EXPECT_EQ(Status::kTooLarge, transaction->ReserveValue(
+      space_.get(), StringSpan(large_key), page_size));
+  EXPECT_EQ("(missing)", Get(transaction.get(), large_key));
+}
+
+TEST_F(BTreeTest, LargeValues) {
+  OpenStore();
+  CreateSpace("space");
+
+  // The largest value is bigger than the page pool, so its pages are stolen.
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::vector<size_t> value_sizes = {
+      page_size - 1, page_size, page_size + 1, 10 * page_size + 123,
+      100 * page_size};
+  std::map<std::string, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (size_t value_size : value_sizes) {
+      const std::string key = "key" + std::to_string(value_size);
+      const std::string value = RandomValue(&rnd_, value_size);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan("small" + key), StringSpan("value")));
+      expected["small" + key] = "value";
+    }
+    for (const auto& entry : expected)
+      ASSERT_EQ(entry.second, Get(transaction.get(), entry.first));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, {});
+
+  // Large values replace small values, and the other way around.
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    const std::string large_value = RandomValue(&rnd_, 3 * page_size);
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("smallkey4095"), StringSpan(large_value)));
+    expected["smallkey4095"] = large_value;
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key4097"), StringSpan("small")));
+    expected["key4097"] = "small";
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, {});
+
+  // Pages that are not cached are read from the data file.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, {});
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    const std::string& value = expected["key409600"];
+    EXPECT_EQ(value, ReadValueInChunks(reader.get(), "key409600", 5000));
+    EXPECT_EQ(value, ReadValueInChunks(reader.get(), "key409600", 65536));
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    EXPECT_EQ(value, ReadValueInChunks(transaction.get(), "key409600", 3000));
+    EXPECT_EQ(value, Get(transaction.get(), "key409600"));
+  }
+}
+
+TEST_F(BTreeTest, LargeValuePagesAreReused) {
+  OpenStore();
+  CreateSpace("space");
+  ChurnLargeValues(static_cast<size_t>(1) << kPageShift);
+
+  // The free page list survives reopening the store.
+  const size_t page_count = StorePageCount();
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  for (int i = 0; i < 10; ++i) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    const std::string key = "key" + std::to_string(1000 + i);
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan(key),
+        StringSpan(RandomValue(&rnd_, page_size))));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  EXPECT_LT(StorePageCount(), page_count + 20);
+}
+
+TEST_F(BTreeTest, SnapshotsKeepFreedPages) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string old_value = RandomValue(&rnd_, 3 * page_size);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan(old_value)));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // The reader's snapshot keeps the old value's pages from being reused.
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  const size_t page_count = StorePageCount();
+  for (int i = 0; i < 5; ++i) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"),
+        StringSpan(RandomValue(&rnd_, 3 * page_size))));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    EXPECT_EQ(old_value, Get(reader.get(), "key"));
+  }
+  EXPECT_GE(StorePageCount(), page_count + 5 * 3);
+  reader.reset();
+
+  // Once the reader is gone, the pages are reused.
+  const size_t released_page_count = StorePageCount();
+  std::string value;
+  for (int i = 0; i < 5; ++i) {
+    value = RandomValue(&rnd_, 3 * page_size);
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan(value)));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  EXPECT_EQ(released_page_count, StorePageCount());
+  ExpectSpaceMatches({{"key", value}}, {});
+}
+
+TEST_F(BTreeTest, RolledBackPagesAreReused) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const size_t page_count = StorePageCount();
+  for (int i = 0; i < 10; ++i) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"),
+        StringSpan(RandomValue(&rnd_, 3 * page_size))));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  EXPECT_LT(StorePageCount(), page_count + 2 * 3);
+  ExpectSpaceMatches({}, {"key"});
+}
+
+TEST_F(BTreeTest, ReadValue) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string large_value = RandomValue(&rnd_, 5 * page_size + 7);
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("small"), StringSpan("0123456789")));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("large"), StringSpan(large_value)));
+
+  std::string buffer(4, '.');
+  const span<uint8_t> buffer_span(reinterpret_cast<uint8_t*>(&buffer[0]),
+                                  buffer.size());
+  Status status;
+  size_t value_size;
+  std::tie(status, value_size) =
+      transaction->ReadValue(space_.get(), StringSpan("small"), 3, buffer_span);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(10U, value_size);
+  EXPECT_EQ("3456", buffer);
+
+  // Reads past the end of the value leave the rest of the buffer untouched.
+  buffer = "....";
+  std::tie(status, value_size) =
+      transaction->ReadValue(space_.get(), StringSpan("small"), 8, buffer_span);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ("89..", buffer);
+  buffer = "....";
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("small"), 20, buffer_span);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(10U, value_size);
+  EXPECT_EQ("....", buffer);
+
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("large"), page_size - 2, buffer_span);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(large_value.size(), value_size);
+  EXPECT_EQ(large_value.substr(page_size - 2, 4), buffer);
+  buffer = "....";
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("large"), large_value.size() - 2, buffer_span);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(large_value.substr(large_value.size() - 2) + "..", buffer);
+
+  // An empty buffer can be used to get the value's size.
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("large"), 0, span<uint8_t>());
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(large_value.size(), value_size);
+
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("missing"), 0, buffer_span);
+  EXPECT_EQ(Status::kNotFound, status);
+}
+
+TEST_F(BTreeTest, ReserveAndWriteValue) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string small_value = RandomValue(&rnd_, 100);
+  const std::string large_value = RandomValue(&rnd_, 50 * page_size + 3);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+        space_.get(), StringSpan("small"), small_value.size()));
+    ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+        space_.get(), StringSpan("large"), large_value.size()));
+    EXPECT_EQ(std::string(small_value.size(), '\0'),
+              Get(transaction.get(), "small"));
+    EXPECT_EQ(std::string(large_value.size(), '\0'),
+              Get(transaction.get(), "large"));
+
+    // Chunks that don't line up with pages.
+    for (size_t offset = 0; offset < large_value.size(); offset += 3000) {
+      const size_t size = std::min<size_t>(3000, large_value.size() - offset);
+      ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+          space_.get(), StringSpan("large"), offset,
+          StringSpan(large_value.substr(offset, size))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+        space_.get(), StringSpan("small"), 0, StringSpan(small_value)));
+
+    EXPECT_EQ(Status::kTooLarge, transaction->WriteValue(
+        space_.get(), StringSpan("small"), 99, StringSpan("ab")));
+    EXPECT_EQ(Status::kTooLarge, transaction->WriteValue(
+        space_.get(), StringSpan("large"), large_value.size() + 1,
+        StringSpan("")));
+    EXPECT_EQ(Status::kNotFound, transaction->WriteValue(
+        space_.get(), StringSpan("missing"), 0, StringSpan("ab")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches({{"small", small_value}, {"large", large_value}}, {});
+
+  // Readers don't see uncommitted writes, and rolled back writes are undone.
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    const std::string overwrite(2 * page_size, 'x');
+    ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+        space_.get(), StringSpan("large"), page_size / 2,
+        StringSpan(overwrite)));
+    EXPECT_EQ(large_value.substr(0, page_size / 2) + overwrite +
+                  large_value.substr(page_size / 2 + overwrite.size()),
+              Get(transaction.get(), "large"));
+    EXPECT_EQ(large_value, Get(reader.get(), "large"));
+    EXPECT_EQ(large_value, ReadValueInChunks(reader.get(), "large", 10000));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  ExpectSpaceMatches({{"small", small_value}, {"large", large_value}}, {});
+}
+
+TEST_F(BTreeTest, OptimisticTransactionsWriteLargeValues) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string value = RandomValue(&rnd_, 80 * page_size + 5);
+  TransactionOptions options;
+  options.optimistic = true;
+  UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan(value)));
+  EXPECT_EQ(value, Get(transaction.get(), "key"));
+  EXPECT_EQ(value, ReadValueInChunks(transaction.get(), "key", 7000));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  ExpectSpaceMatches({{"key", value}}, {});
+}
+
+TEST_F(BTreeTest, BulkLoad) {
+  // Small pages produce deep trees, and span multiple page runs.
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::vector<std::pair<std::string, std::string>> pairs;
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < 30000; ++i) {
+    pairs.emplace_back("key" + std::to_string(1000000 + i * 3),
+                       RandomValue(&rnd_, rnd_() % 40));
+    expected.insert(pairs.back());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, BulkLoad(transaction.get(), pairs));
+    EXPECT_EQ(pairs.front().second, Get(transaction.get(), pairs.front().first));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  std::vector<std::string> missing_keys = {"", "key", "kez", "key0"};
+  for (int i = 0; i < 1000; ++i)
+    missing_keys.push_back("key" + std::to_string(1000001 + i * 3));
+  ExpectSpaceMatches(expected, missing_keys);
+
+  // The bulk-loaded nodes can be modified and split.
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 5000; ++i) {
+      const std::string key = "key" + std::to_string(1000001 + i * 7);
+      const std::string value = RandomValue(&rnd_, rnd_() % 40);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+    }
+    for (int i = 0; i < 1000; ++i) {
+      const std::string& key = pairs[i * 11].first;
+      ASSERT_EQ(Status::kSuccess,
+                transaction->Delete(space_.get(), StringSpan(key)));
+      expected.erase(key);
+      missing_keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, missing_keys);
+
+  // The loaded pages were synced before the root change was logged.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, missing_keys);
+}
+
+TEST_F(BTreeTest, BulkLoadSmallAndLargeValues) {
+  OpenStore();
+  CreateSpace("space");
+
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (int i = 0; i < 500; ++i) {
+    const size_t value_size = (i % 50 == 0) ? 5000 + i * 10 : rnd_() % 100;
+    pairs.emplace_back("key" + std::to_string(1000 + i),
+                       RandomValue(&rnd_, value_size));
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, BulkLoad(transaction.get(), pairs));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(std::map<std::string, std::string>(pairs.begin(),
+                                                        pairs.end()),
+                     {"key", "key999"});
+}
+
+TEST_F(BTreeTest, BulkLoadSingleLeaf) {
+  OpenStore();
+  CreateSpace("space");
+
+  const std::vector<std::pair<std::string, std::string>> pairs = {
+      {"", "empty"}, {"apple", "red"}, {"kiwi", "green"}};
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, BulkLoad(transaction.get(), pairs));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(std::map<std::string, std::string>(pairs.begin(),
+                                                        pairs.end()),
+                     {"a", "banana"});
+  // Read transactions keep seeing their snapshots.
+  EXPECT_EQ("(missing)", Get(reader.get(), "apple"));
+
+  // Loading nothing succeeds, and leaves the tree empty.
+  CreateSpace("empty space");
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, BulkLoad(transaction.get(), {}));
+  EXPECT_EQ("(missing)", Get(transaction.get(), ""));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BTreeTest, BulkLoadErrors) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    // Keys must be strictly increasing.
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    EXPECT_EQ(Status::kAlreadyExists,
+              BulkLoad(transaction.get(), {{"b", "1"}, {"a", "2"}}));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    EXPECT_EQ(Status::kAlreadyExists,
+              BulkLoad(transaction.get(), {{"a", "1"}, {"a", "2"}}));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  {
+    // Keys must fit in nodes.
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    EXPECT_EQ(Status::kTooLarge,
+              BulkLoad(transaction.get(), {{std::string(2000, 'k'), "1"}}));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  // Rolling back a load discards it.
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (int i = 0; i < 5000; ++i)
+    pairs.emplace_back("key" + std::to_string(10000 + i), std::to_string(i));
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, BulkLoad(transaction.get(), pairs));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  ExpectSpaceMatches({}, {pairs.front().first, pairs.back().first});
+
+  // The space can only be loaded while it's empty.
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, BulkLoad(transaction.get(), pairs));
+    EXPECT_EQ(Status::kAlreadyExists, BulkLoad(transaction.get(), pairs));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(std::map<std::string, std::string>(pairs.begin(),
+                                                        pairs.end()),
+                     {});
+}
+
+TEST_F(BTreeTest, Catalogs) {
+  OpenStore();
+  Catalog* const root = store_->RootCatalog();
+
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) = root->OpenSpace(StringSpan("missing"));
+  EXPECT_EQ(Status::kNotFound, status);
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    Catalog* raw_catalog;
+    std::tie(status, raw_catalog) =
+        transaction->CreateCatalog(root, StringSpan("catalog"));
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<Catalog> catalog(raw_catalog);
+    std::tie(status, raw_space) =
+        transaction->CreateSpace(catalog.get(), StringSpan("space"));
+    ASSERT_EQ(Status::kSuccess, status);
+    space_.reset(raw_space);
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("value")));
+
+    std::tie(status, raw_space) =
+        transaction->CreateSpace(root, StringSpan("catalog"));
+    EXPECT_EQ(Status::kAlreadyExists, status);
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // Names refer to a specific kind of entry.
+  Catalog* raw_catalog;
+  std::tie(status, raw_space) = root->OpenSpace(StringSpan("catalog"));
+  EXPECT_EQ(Status::kNotFound, status);
+  std::tie(status, raw_catalog) = root->OpenCatalog(StringSpan("catalog"));
+  ASSERT_EQ(Status::kSuccess, status);
+  UniquePtr<Catalog> catalog(raw_catalog);
+  std::tie(status, raw_space) = catalog->OpenSpace(StringSpan("space"));
+  ASSERT_EQ(Status::kSuccess, status);
+  space_.reset(raw_space);
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    EXPECT_EQ("value", Get(reader.get(), "key"));
+  }
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    EXPECT_EQ(Status::kSuccess,
+              transaction->Delete(catalog.get(), StringSpan("space")));
+    EXPECT_EQ(Status::kNotFound,
+              transaction->Delete(catalog.get(), StringSpan("space")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  std::tie(status, raw_space) = catalog->OpenSpace(StringSpan("space"));
+  EXPECT_EQ(Status::kNotFound, status);
+}
+
+TEST_F(BTreeTest, DeletedSpacePagesAreReused) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  std::map<std::string, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 10; ++i) {
+      const std::string key = "key" + std::to_string(i);
+      const std::string value =
+          RandomValue(&rnd_, (i % 2 == 0) ? 2 * page_size : 10);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // Every kind of space is created in a catalog, and the catalog is deleted.
+  std::vector<SpaceOptions> all_options(5);
+  all_options[1].hashed = true;
+  all_options[2].integer_key_size = 8;
+  all_options[3].write_buffered = true;
+  all_options[4].bloom_filter_key_count = 1000;
+  all_options[4].value_log_threshold = 100;
+  size_t warm_page_count = 0;
+  for (int round = 0; round < 6; ++round) {
+    if (round == 2)
+      warm_page_count = StorePageCount();
+
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    Status status;
+    Catalog* raw_catalog;
+    std::tie(status, raw_catalog) = transaction->CreateCatalog(
+        store_->RootCatalog(), StringSpan("catalog"));
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<Catalog> catalog(raw_catalog);
+    std::tie(status, raw_catalog) = transaction->CreateCatalog(
+        catalog.get(), StringSpan("nested"));
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<Catalog> nested_catalog(raw_catalog);
+    for (size_t i = 0; i < all_options.size(); ++i) {
+      Space* raw_space;
+      std::tie(status, raw_space) = transaction->CreateSpace(
+          (i % 2 == 0) ? catalog.get() : nested_catalog.get(),
+          StringSpan("space" + std::to_string(i)), all_options[i]);
+      ASSERT_EQ(Status::kSuccess, status);
+      UniquePtr<Space> space(raw_space);
+      for (int j = 0; j < 200; ++j) {
+        // 8-byte keys work in every kind of space.
+        std::string key(8, '\0');
+        key[6] = static_cast<char>(j / 256);
+        key[7] = static_cast<char>(j % 256);
+        const std::string value =
+            RandomValue(&rnd_, (j % 10 == 0) ? 2 * page_size : 200);
+        ASSERT_EQ(Status::kSuccess, transaction->Put(
+            space.get(), StringSpan(key), StringSpan(value)));
+      }
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+    transaction.reset(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Delete(
+        store_->RootCatalog(), StringSpan("catalog")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  // Each round uses about 300 pages, so the 4 rounds after warm-up would use
+  // about 1200 pages without page reuse.
+  EXPECT_LT(StorePageCount(), warm_page_count + 100);
+  ExpectSpaceMatches(expected, {});
+
+  // Rolling back a deletion keeps the space's pages in use.
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Delete(
+        store_->RootCatalog(), StringSpan("space")));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    Status status;
+    Space* raw_space;
+    std::tie(status, raw_space) = transaction->CreateSpace(
+        store_->RootCatalog(), StringSpan("other"), SpaceOptions());
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<Space> other_space(raw_space);
+    for (int i = 0; i < 50; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          other_space.get(), StringSpan("key" + std::to_string(i)),
+          StringSpan(RandomValue(&rnd_, 2 * page_size))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, {});
+
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, {});
+}
+
+TEST_F(BufferedBTreeTest, PutGetDelete) {
+  OpenStore();
+  CreateSpace("space");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("longer value")));
+  EXPECT_EQ("longer value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan("key")));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  // Deletes are blind, so deleting a missing key succeeds.
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan("missing")));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BufferedBTreeTest, RandomOperationsMatchMap) {
+  // Small pages produce deep trees and frequent flushes quickly.
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  const size_t max_key_size = BTreeBuffer::MaxKeySize(1024);
+  std::uniform_int_distribution<size_t> key_size_distribution(0, max_key_size);
+  std::uniform_int_distribution<size_t> value_size_distribution(0, 120);
+  std::uniform_int_distribution<int> byte_distribution('a', 'z');
+  std::uniform_int_distribution<int> operation_distribution(0, 9);
+
+  for (int round = 0; round < 20; ++round) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 500; ++i) {
+      const int operation = operation_distribution(rnd_);
+      if (operation < 2 && !keys.empty()) {
+        const std::string& key = keys[rnd_() % keys.size()];
+        ASSERT_EQ(Status::kSuccess,
+                  transaction->Delete(space_.get(), StringSpan(key)));
+        expected.erase(key);
+        continue;
+      }
+      if (operation < 3 && !keys.empty()) {
+        const std::string& key = keys[rnd_() % keys.size()];
+        const auto it = expected.find(key);
+        ASSERT_EQ(it == expected.end() ? "(missing)" : it->second,
+                  Get(transaction.get(), key)) << key;
+        continue;
+      }
+
+      std::string key(key_size_distribution(rnd_), ' ');
+      for (char& c : key)
+        c = static_cast<char>(byte_distribution(rnd_));
+      std::string value(value_size_distribution(rnd_), ' ');
+      for (char& c : value)
+        c = static_cast<char>(byte_distribution(rnd_));
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+      keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // Messages that are still buffered survive closing and reopening the store.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, keys);
+}
+
+TEST_F(BufferedBTreeTest, SequentialInsertsGrowTree) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  constexpr int kKeyCount = 20000;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < kKeyCount; ++i) {
+      const std::string key = "key" + std::to_string(1000000 + i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(std::to_string(i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    // Overwrites and deletes shadow older messages and leaf entries.
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < kKeyCount; i += 3) {
+      const std::string key = "key" + std::to_string(1000000 + i);
+      ASSERT_EQ(Status::kSuccess,
+                transaction->Delete(space_.get(), StringSpan(key)));
+    }
+    for (int i = 1; i < kKeyCount; i += 3) {
+      const std::string key = "key" + std::to_string(1000000 + i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan("new")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < kKeyCount; ++i) {
+    const std::string key = "key" + std::to_string(1000000 + i);
+    const std::string expected = (i % 3 == 0) ? "(missing)"
+        : ((i % 3 == 1) ? "new" : std::to_string(i));
+    ASSERT_EQ(expected, Get(reader.get(), key)) << key;
+  }
+}
+
+TEST_F(BufferedBTreeTest, TooLarge) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string max_key(BTreeBuffer::MaxKeySize(page_size), 'k');
+  const std::string large_key(max_key.size() + 1, 'k');
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ(Status::kTooLarge, transaction->Put(
+      space_.get(), StringSpan(large_key), StringSpan("value")));
+  EXPECT_EQ(Status::kTooLarge, transaction->ReserveValue(
+      space_.get(), StringSpan(large_key), page_size));
+  // Keys that can't be stored are never in the space.
+  EXPECT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan(large_key)));
+  EXPECT_EQ("(missing)", Get(transaction.get(), large_key));
+
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan(max_key), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), max_key));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BufferedBTreeTest, LargeValues) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  // Values that don't fit in buffers are stored in overflow pages, and the
+  // messages carry references to them.
+  const size_t page_size = 1024;
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 600; ++i) {
+      const std::string key = "key" + std::to_string(1000 + i);
+      const std::string value =
+          RandomValue(&rnd_, (i % 7 == 0) ? 3 * page_size + i : i % 50);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+      keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // Large values replace small values, and the other way around.
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 600; i += 5) {
+      const std::string& key = keys[i];
+      const std::string value =
+          RandomValue(&rnd_, (i % 7 == 0) ? 10 : 2 * page_size + 1);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+    }
+    EXPECT_EQ(expected[keys[7]],
+              ReadValueInChunks(transaction.get(), keys[7], 100));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, keys);
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  EXPECT_EQ(expected[keys[14]],
+            ReadValueInChunks(reader.get(), keys[14], 333));
+}
+
+TEST_F(BufferedBTreeTest, LargeValuePagesAreReused) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+  ChurnLargeValues(1024);
+}
+
+TEST_F(BufferedBTreeTest, ReserveAndWriteValue) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string small_value = RandomValue(&rnd_, 100);
+  const std::string large_value = RandomValue(&rnd_, 5 * page_size + 3);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+        space_.get(), StringSpan("small"), small_value.size()));
+    ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+        space_.get(), StringSpan("large"), large_value.size()));
+    EXPECT_EQ(std::string(small_value.size(), '\0'),
+              Get(transaction.get(), "small"));
+
+    for (size_t offset = 0; offset < large_value.size(); offset += 3000) {
+      const size_t size = std::min<size_t>(3000, large_value.size() - offset);
+      ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+          space_.get(), StringSpan("large"), offset,
+          StringSpan(large_value.substr(offset, size))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+        space_.get(), StringSpan("small"), 0, StringSpan(small_value)));
+
+    EXPECT_EQ(Status::kTooLarge, transaction->WriteValue(
+        space_.get(), StringSpan("small"), 99, StringSpan("ab")));
+    EXPECT_EQ(Status::kNotFound, transaction->WriteValue(
+        space_.get(), StringSpan("missing"), 0, StringSpan("ab")));
+    ASSERT_EQ(Status::kSuccess, transaction->Delete(
+        space_.get(), StringSpan("deleted")));
+    EXPECT_EQ(Status::kNotFound, transaction->WriteValue(
+        space_.get(), StringSpan("deleted"), 0, StringSpan("ab")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches({{"small", small_value}, {"large", large_value}}, {});
+}
+
+TEST_F(BufferedBTreeTest, SnapshotsAndRollbacks) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; ++i) {
+      const std::string key = "key" + std::to_string(10000 + i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan("old")));
+      expected[key] = "old";
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // Flushes caused by the transaction below are invisible to the reader, and
+  // are undone by the rollback.
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; ++i) {
+      const std::string key = "key" + std::to_string(10000 + i);
+      if (i % 2 == 0) {
+        ASSERT_EQ(Status::kSuccess,
+                  transaction->Delete(space_.get(), StringSpan(key)));
+      } else {
+        ASSERT_EQ(Status::kSuccess, transaction->Put(
+            space_.get(), StringSpan(key), StringSpan("new")));
+      }
+    }
+    EXPECT_EQ("(missing)", Get(transaction.get(), "key10000"));
+    EXPECT_EQ("new", Get(transaction.get(), "key10001"));
+    EXPECT_EQ("old", Get(reader.get(), "key10000"));
+    EXPECT_EQ("old", Get(reader.get(), "key10001"));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  for (const auto& entry : expected)
+    ASSERT_EQ(entry.second, Get(reader.get(), entry.first)) << entry.first;
+  ExpectSpaceMatches(expected, {});
+}
+
+TEST_F(BufferedBTreeTest, MultiGet) {
+  OpenStore();
+  CreateSpace("space");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key1"), StringSpan("value1")));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key2"), StringSpan("value2")));
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Delete(space_.get(), StringSpan("key2")));
+  EXPECT_EQ(std::vector<std::string>({"(missing)", "value1", "(missing)"}),
+            MultiGet(transaction.get(), {"key2", "key1", "key3"}));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BufferedBTreeTest, MultiGetLargeBatch) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 5000; ++i) {
+      const std::string key = "key" + std::to_string(1000000 + i * 2);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(std::to_string(i))));
+      expected[key] = std::to_string(i);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // The batch finds more keys than the pool has pages, so the values can't all
+  // pin their pages.
+  std::vector<std::string> keys;
+  std::vector<std::string> expected_values;
+  for (int i = 0; i < 500; ++i) {
+    const std::string key = "key" + std::to_string(1000000 + rnd_() % 10000);
+    keys.push_back(key);
+    const auto it = expected.find(key);
+    expected_values.push_back(it == expected.end() ? "(missing)" : it->second);
+  }
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ(expected_values, MultiGet(transaction.get(), keys));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(BufferedBTreeTest, UnsupportedOperations) {
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("value")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+    EXPECT_EQ(Status::kNotSupported, cursor->SeekToFirst());
+    EXPECT_EQ(Status::kNotSupported, cursor->Seek(StringSpan("key")));
+    EXPECT_FALSE(cursor->Valid());
+  }
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) =
+      transaction->CreateSpace(store_->RootCatalog(), StringSpan("empty"),
+                               space_options_);
+  ASSERT_EQ(Status::kSuccess, status);
+  UniquePtr<Space> empty_space(raw_space);
+  std::vector<std::pair<std::string, std::string>> pairs = {{"a", "b"}};
+  PairSource source(&pairs);
+  EXPECT_EQ(Status::kNotSupported, transaction->BulkLoad(
+      empty_space.get(), &PairSource::Next, &source));
+
+  // Write buffers can't be combined with the other space options.
+  SpaceOptions options = space_options_;
+  options.hashed = true;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("hashed"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+  options = space_options_;
+  options.integer_key_size = 8;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("integer"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+  options = space_options_;
+  options.bloom_filter_key_count = 100;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("bloom"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+  options = space_options_;
+  options.value_log_threshold = 100;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("value_log"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+}  // namespace berrydb
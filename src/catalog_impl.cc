@@ -6,22 +6,35 @@
 
 #include "berrydb/platform.h"
 #include "berrydb/status.h"
+#include "./read_transaction_impl.h"
+#include "./space_impl.h"
+#include "./store_impl.h"
 #include "./util/checks.h"
+#include "./util/endianness.h"
+#include "./util/span_util.h"
 
 namespace berrydb {
 
+constexpr size_t CatalogImpl::kEntrySize;
+constexpr size_t CatalogImpl::kFilterEntrySize;
+constexpr size_t CatalogImpl::kValueLogEntrySize;
+
 static_assert(std::is_standard_layout<CatalogImpl>::value,
     "CatalogImpl must be a standard layout type so its public API can be "
     "exposed cheaply");
 
-CatalogImpl* CatalogImpl::Create() {
+CatalogImpl* CatalogImpl::Create(StoreImpl* store, size_t root_page_id) {
   void* const heap_block = Allocate(sizeof(CatalogImpl));
-  CatalogImpl* const catalog = new (heap_block) CatalogImpl();
+  CatalogImpl* const catalog =
+      new (heap_block) CatalogImpl(store, root_page_id);
   BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(catalog));
   return catalog;
 }
 
-CatalogImpl::CatalogImpl() = default;
+CatalogImpl::CatalogImpl(StoreImpl* store, size_t root_page_id)
+    : store_(store), tree_(root_page_id) {
+  BERRYDB_ASSUME(store != nullptr);
+}
 
 CatalogImpl::~CatalogImpl() = default;
 
@@ -31,14 +44,151 @@ void CatalogImpl::Release() {
   Deallocate(heap_block, sizeof(CatalogImpl));
 }
 
+// static
+void CatalogImpl::EncodeEntry(EntryType type, size_t root_page_id,
+                              const BloomFilter& filter,
+                              const ValueLog& value_log,
+                              span<uint8_t> entry) noexcept {
+  BERRYDB_ASSUME_EQ(entry.size(), EntrySize(filter, value_log));
+
+  FillSpan(entry, 0);
+  StoreUint64(static_cast<uint64_t>(root_page_id), entry.first(8));
+  entry[8] = static_cast<uint8_t>(type);
+  if (filter.exists()) {
+    StoreUint64(static_cast<uint64_t>(filter.first_page_id()),
+                entry.subspan(16, 8));
+    StoreUint64(static_cast<uint64_t>(filter.page_count()),
+                entry.subspan(24, 8));
+  }
+  if (value_log.exists()) {
+    StoreUint64(static_cast<uint64_t>(value_log.header_page_id()),
+                entry.subspan(32, 8));
+    StoreUint32(static_cast<uint32_t>(value_log.threshold()),
+                entry.subspan(40, 4));
+  }
+}
+
+// static
+std::tuple<Status, CatalogImpl::EntryType, size_t, BloomFilter, ValueLog>
+CatalogImpl::DecodeEntry(span<const uint8_t> entry) noexcept {
+  if (UNLIKELY(entry.size() != kEntrySize &&
+               entry.size() != kFilterEntrySize &&
+               entry.size() != kValueLogEntrySize)) {
+    return {Status::kDataCorrupted, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+
+  // Values stored in B+tree leaves are only 2-byte-aligned.
+  alignas(8) uint8_t buffer[kValueLogEntrySize];
+  const span<uint8_t> buffer_span(buffer, entry.size());
+  CopySpan(entry, buffer_span);
+
+  const EntryType type = static_cast<EntryType>(buffer[8]);
+  if (UNLIKELY(type != EntryType::kCatalog && type != EntryType::kSpace &&
+               type != EntryType::kHashedSpace &&
+               type != EntryType::kInteger32Space &&
+               type != EntryType::kInteger64Space &&
+               type != EntryType::kBufferedSpace)) {
+    return {Status::kDataCorrupted, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+  const uint64_t root_page_id64 =
+      LoadUint64(span<const uint8_t>(buffer, 8));
+  const size_t root_page_id = static_cast<size_t>(root_page_id64);
+  if (UNLIKELY(root_page_id != root_page_id64 || root_page_id == 0)) {
+    return {Status::kDataCorrupted, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+  if (entry.size() == kEntrySize)
+    return {Status::kSuccess, type, root_page_id, BloomFilter(), ValueLog()};
+
+  if (UNLIKELY(type != EntryType::kSpace)) {
+    return {Status::kDataCorrupted, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+  const uint64_t first_page_id64 =
+      LoadUint64(span<const uint8_t>(buffer + 16, 8));
+  const uint64_t page_count64 =
+      LoadUint64(span<const uint8_t>(buffer + 24, 8));
+  const size_t first_page_id = static_cast<size_t>(first_page_id64);
+  const size_t page_count = static_cast<size_t>(page_count64);
+  // The filter's pages are checked against the store's size when they are
+  // fetched. This only rules out values that can't be page IDs. Value log
+  // entries have zeroed filter fields if the space doesn't have a filter.
+  const bool has_filter =
+      entry.size() == kFilterEntrySize || page_count64 != 0;
+  if (UNLIKELY(first_page_id != first_page_id64 ||
+               page_count != page_count64 ||
+               first_page_id + page_count < first_page_id ||
+               (has_filter && (first_page_id == 0 || page_count == 0)) ||
+               (!has_filter && first_page_id != 0))) {
+    return {Status::kDataCorrupted, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+  const BloomFilter filter =
+      has_filter ? BloomFilter(first_page_id, page_count) : BloomFilter();
+  if (entry.size() == kFilterEntrySize)
+    return {Status::kSuccess, type, root_page_id, filter, ValueLog()};
+
+  const uint64_t header_page_id64 =
+      LoadUint64(span<const uint8_t>(buffer + 32, 8));
+  const size_t header_page_id = static_cast<size_t>(header_page_id64);
+  const size_t threshold = LoadUint32(span<const uint8_t>(buffer + 40, 4));
+  if (UNLIKELY(header_page_id != header_page_id64 || header_page_id == 0 ||
+               threshold == 0)) {
+    return {Status::kDataCorrupted, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+  return {Status::kSuccess, type, root_page_id, filter,
+          ValueLog(header_page_id, threshold)};
+}
+
+std::tuple<Status, CatalogImpl::EntryType, size_t, BloomFilter, ValueLog>
+CatalogImpl::FindEntry(span<const uint8_t> name) {
+  if (UNLIKELY(store_->IsClosed())) {
+    return {Status::kAlreadyClosed, EntryType::kSpace, 0, BloomFilter(),
+            ValueLog()};
+  }
+
+  // Catalog operations see the committed entries.
+  ReadTransactionImpl* const transaction = store_->CreateReadTransaction();
+  BTree::ValueBuffer entry;
+  const Status status = tree_.Get(transaction, name, &entry);
+  transaction->Release();
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, EntryType::kSpace, 0, BloomFilter(), ValueLog()};
+  return DecodeEntry(span<const uint8_t>(entry.data(), entry.size()));
+}
+
 std::tuple<Status, CatalogImpl*> CatalogImpl::OpenCatalog(
-    MAYBE_UNUSED span<const uint8_t> name) {
-  return {Status::kIoError, nullptr};
+    span<const uint8_t> name) {
+  Status status;
+  EntryType type;
+  size_t root_page_id;
+  BloomFilter filter;
+  ValueLog value_log;
+  std::tie(status, type, root_page_id, filter, value_log) = FindEntry(name);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, nullptr};
+  if (type != EntryType::kCatalog)
+    return {Status::kNotFound, nullptr};
+  return {Status::kSuccess, CatalogImpl::Create(store_, root_page_id)};
 }
 
 std::tuple<Status, SpaceImpl*> CatalogImpl::OpenSpace(
-    MAYBE_UNUSED span<const uint8_t> name) {
-  return {Status::kIoError, nullptr};
+    span<const uint8_t> name) {
+  Status status;
+  EntryType type;
+  size_t root_page_id;
+  BloomFilter filter;
+  ValueLog value_log;
+  std::tie(status, type, root_page_id, filter, value_log) = FindEntry(name);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, nullptr};
+  if (type == EntryType::kCatalog)
+    return {Status::kNotFound, nullptr};
+  return {Status::kSuccess,
+          SpaceImpl::Create(root_page_id, type, filter, value_log)};
 }
 
 }  // namespace berrydb
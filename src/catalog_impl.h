@@ -5,19 +5,90 @@
 #ifndef BERRYDB_CATALOG_IMPL_H_
 #define BERRYDB_CATALOG_IMPL_H_
 
+#include <tuple>
+
 #include "berrydb/catalog.h"
 #include "berrydb/span.h"
 #include "berrydb/types.h"
+#include "./bloom_filter.h"
+#include "./btree.h"
 #include "./util/checks.h"
+#include "./value_log.h"
 
 namespace berrydb {
 
 class SpaceImpl;
+class StoreImpl;
 
-/** Internal representation for the Catalog class in the public API. */
+/** Internal representation for the Catalog class in the public API.
+ *
+ * A catalog's entries are stored in a B+tree, which maps each name to an
+ * encoded entry. An entry records whether the name refers to a catalog or to a
+ * space, and the root page of the catalog's or space's B+tree. The entries of
+ * hashed spaces store the page that holds the header of the space's HashTable
+ * instead. The entries of integer-keyed spaces store the root page of an
+ * IntegerBTree. The entries of buffered spaces store the root page of a
+ * buffered BTree. The entries of spaces that have a BloomFilter also store the
+ * location of the filter's pages, and the entries of spaces that have a
+ * ValueLog also store the log's header page and threshold.
+ */
 class CatalogImpl {
  public:
-  static CatalogImpl* Create();
+  /** The kinds of entries in a catalog. */
+  enum class EntryType : uint8_t {
+    kCatalog = 1,
+    kSpace = 2,
+    /** A space backed by a HashTable instead of a B+tree. */
+    kHashedSpace = 3,
+    /** A space backed by an IntegerBTree with 32-bit keys. */
+    kInteger32Space = 4,
+    /** A space backed by an IntegerBTree with 64-bit keys. */
+    kInteger64Space = 5,
+    /** A space backed by a BTree that buffers writes in its inner nodes. */
+    kBufferedSpace = 6,
+  };
+
+  /** The size of an encoded catalog entry.
+   *
+   * Entry layout:
+   * 0: 64-bit root page ID of the catalog or space's B+tree
+   * 8: 8-bit EntryType
+   * 9: reserved, must be zero
+   */
+  static constexpr size_t kEntrySize = 16;
+
+  /** The size of an encoded entry for a space with a BloomFilter.
+   *
+   * The entry starts with the kEntrySize-byte layout above, followed by:
+   * 16: 64-bit ID of the filter's first page
+   * 24: 64-bit number of filter pages
+   *
+   * Only kSpace entries can have filters.
+   */
+  static constexpr size_t kFilterEntrySize = 32;
+
+  /** The size of an encoded entry for a space with a ValueLog.
+   *
+   * The entry starts with the kFilterEntrySize-byte layout above, whose filter
+   * fields are zero if the space does not have a filter, followed by:
+   * 32: 64-bit ID of the log's header page
+   * 40: 32-bit size of the smallest value stored in the log
+   * 44: reserved, must be zero
+   *
+   * Only kSpace entries can have value logs.
+   */
+  static constexpr size_t kValueLogEntrySize = 48;
+
+  /** The size of the encoded entry for a space's B+tree and auxiliary data. */
+  static inline constexpr size_t EntrySize(const BloomFilter& filter,
+                                           const ValueLog& value_log) noexcept {
+    return value_log.exists() ? kValueLogEntrySize
+                              : (filter.exists() ? kFilterEntrySize
+                                                 : kEntrySize);
+  }
+
+  /** Creates a handle for the catalog whose B+tree is rooted at a page. */
+  static CatalogImpl* Create(StoreImpl* store, size_t root_page_id);
 
   CatalogImpl(const CatalogImpl&) = delete;
   CatalogImpl(CatalogImpl&&) = delete;
@@ -40,6 +111,37 @@ class CatalogImpl {
   /** Computes the public API representation for this store. */
   inline constexpr Catalog* ToApi() noexcept { return &api_; }
 
+  /** The B+tree that holds the catalog's entries. */
+  inline constexpr BTree* tree() noexcept { return &tree_; }
+
+  /** Encodes a catalog entry.
+   *
+   * @param type         the kind of object that the entry refers to
+   * @param root_page_id the root page of the object's B+tree
+   * @param filter       the space's Bloom filter; may not exist
+   * @param value_log    the space's value log; may not exist
+   * @param entry        receives the encoded entry; must be 8-byte-aligned,
+   *                     and must have EntrySize() bytes
+   */
+  static void EncodeEntry(EntryType type, size_t root_page_id,
+                          const BloomFilter& filter, const ValueLog& value_log,
+                          span<uint8_t> entry) noexcept;
+
+  /** Decodes a catalog entry.
+   *
+   * @param  entry        an entry read from the catalog's B+tree; need not be
+   *                      aligned
+   * @return status       kSuccess or kDataCorrupted
+   * @return type         the kind of object that the entry refers to
+   * @return root_page_id the root page of the object's B+tree
+   * @return filter       the space's Bloom filter; does not exist if the entry
+   *                      does not have a filter
+   * @return value_log    the space's value log; does not exist if the entry
+   *                      does not have a log
+   */
+  static std::tuple<Status, EntryType, size_t, BloomFilter, ValueLog>
+  DecodeEntry(span<const uint8_t> entry) noexcept;
+
   // See the public API documention for details.
   void Release();
   std::tuple<Status, CatalogImpl*> OpenCatalog(span<const uint8_t> name);
@@ -47,12 +149,31 @@ class CatalogImpl {
 
  private:
   /** Use CatalogImpl::Create() to obtain SpaceImpl instances. */
-  CatalogImpl();
+  CatalogImpl(StoreImpl* store, size_t root_page_id);
   /** Use Release() to destroy StoreImpl instances. */
   ~CatalogImpl();
 
+  /** Looks up an entry, returning the root page of the entry's B+tree.
+   *
+   * @param  name         the name of the entry
+   * @return status       kNotFound if the catalog doesn't have an entry with
+   *                      the given name
+   * @return type         the kind of object that the entry refers to
+   * @return root_page_id the root page of the entry's B+tree
+   * @return filter       the space's Bloom filter, if it has one
+   * @return value_log    the space's value log, if it has one
+   */
+  std::tuple<Status, EntryType, size_t, BloomFilter, ValueLog> FindEntry(
+      span<const uint8_t> name);
+
   /* The public API version of this class. */
   Catalog api_;  // Must be the first class member.
+
+  /** The store that holds this catalog. */
+  StoreImpl* const store_;
+
+  /** See tree(). */
+  BTree tree_;
 };
 
 }  // namespace berrydb
@@ -0,0 +1,446 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./cursor_impl.h"
+
+#include <algorithm>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree_node.h"
+#include "./overflow_value.h"
+#include "./page_pool.h"
+#include "./page_versions.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./util/checks.h"
+#include "./util/span_util.h"
+#include "./value_log.h"
+
+namespace berrydb {
+
+static_assert(std::is_standard_layout<CursorImpl>::value,
+    "CursorImpl must be a standard layout type so its public API can be "
+    "exposed cheaply");
+
+namespace {
+
+/** The maximum number of leaves read by a prefetch.
+ *
+ * Small pools get smaller prefetches, so the prefetched leaves aren't evicted
+ * before the scan gets to them. */
+constexpr size_t kReadAheadLeaves = 16;
+
+/** The number of leaves that a scan crosses before it is considered large.
+ *
+ * Leaves crossed by large scans are unpinned using PagePool::kDiscardPage. */
+constexpr size_t kLargeScanLeaves = 16;
+
+}  // namespace
+
+CursorImpl* CursorImpl::Create(ReadTransactionImpl* transaction,
+                               size_t root_page_id) {
+  void* const heap_block = Allocate(sizeof(CursorImpl));
+  CursorImpl* const cursor =
+      new (heap_block) CursorImpl(transaction, root_page_id);
+  BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(cursor));
+  return cursor;
+}
+
+void CursorImpl::Release() {
+  if (!is_store_closed_)
+    UnpinNode();
+  transaction_->CursorReleased(this);
+
+  this->~CursorImpl();
+  void* const heap_block = static_cast<void*>(this);
+  Deallocate(heap_block, sizeof(CursorImpl));
+}
+
+CursorImpl::CursorImpl(ReadTransactionImpl* transaction, size_t root_page_id)
+    : transaction_(transaction), root_page_id_(root_page_id) {
+  BERRYDB_ASSUME(transaction != nullptr);
+}
+
+CursorImpl::~CursorImpl() = default;
+
+void CursorImpl::StoreWasClosed() noexcept {
+  UnpinNode();
+  // The store's page versions are freed when the store is released.
+  node_version_ = span<const uint8_t>();
+  is_valid_ = false;
+  is_store_closed_ = true;
+}
+
+span<const uint8_t> CursorImpl::NodeData() noexcept {
+  if (node_page_ == nullptr)
+    return node_version_;
+
+  // A writer may have modified the page after it was pinned, saving the
+  // content seen by the snapshot as a version. Versions don't change, so the
+  // pin is no longer needed.
+  StoreImpl* const store = transaction_->store();
+  const span<const uint8_t> version_data = store->page_versions()->Find(
+      node_page_id_, transaction_->snapshot());
+  if (version_data.empty())
+    return node_page_->data(store->page_pool()->page_size());
+  UnpinNode();
+  node_version_ = version_data;
+  return node_version_;
+}
+
+void CursorImpl::UnpinNode() noexcept {
+  if (node_page_ == nullptr)
+    return;
+
+  PagePool* const page_pool = transaction_->store()->page_pool();
+  const bool is_large_scan_leaf =
+      leaves_crossed_ >= kLargeScanLeaves &&
+      BTreeNode::NodeType(node_page_->data(page_pool->page_size())) ==
+          BTreeNode::Type::kLeaf;
+  if (is_large_scan_leaf)
+    page_pool->UnpinStorePage(node_page_, PagePool::kDiscardPage);
+  else
+    page_pool->UnpinStorePage(node_page_, PagePool::kCachePage);
+  node_page_ = nullptr;
+}
+
+Status CursorImpl::LoadNode(size_t page_id) {
+  UnpinNode();
+
+  StoreImpl* const store = transaction_->store();
+  node_page_id_ = page_id;
+  node_version_ = store->page_versions()->Find(page_id,
+                                               transaction_->snapshot());
+  if (node_version_.empty()) {
+    PagePool* const page_pool = store->page_pool();
+    Status status;
+    Page* page;
+    std::tie(status, page) = page_pool->StorePage(store, page_id,
+                                                  PagePool::kFetchPageData);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    node_page_ = page;
+  }
+
+  if (UNLIKELY(BTreeNode::IsCorrupt(NodeData())))
+    return Status::kDataCorrupted;
+  return Status::kSuccess;
+}
+
+Status CursorImpl::Descend(size_t page_id, size_t level, DescendMode mode,
+                           span<const uint8_t> key) {
+  StoreImpl* const store = transaction_->store();
+  for (; level < BTree::kMaxDepth; ++level) {
+    Status status = LoadNode(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const span<const uint8_t> node = NodeData();
+    if (BTreeNode::NodeType(node) == BTreeNode::Type::kLeaf) {
+      depth_ = level;
+      return Status::kSuccess;
+    }
+
+    const size_t entry_count = BTreeNode::EntryCount(node);
+    size_t index;
+    switch (mode) {
+      case DescendMode::kKey:
+        std::tie(status, index) = BTreeNode::InnerFind(node, key);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+        break;
+      case DescendMode::kFirst:
+        index = 0;
+        break;
+      case DescendMode::kLast:
+        index = entry_count;
+        break;
+      default:
+        BERRYDB_UNREACHABLE();
+    }
+
+    uint64_t child64;
+    std::tie(status, child64) = BTreeNode::InnerChildAt(node, index);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    path_[level] = {page_id, index, entry_count};
+    page_id = BTree::CheckedChildId(store, child64);
+    if (UNLIKELY(page_id == 0))
+      return Status::kDataCorrupted;
+  }
+  return Status::kDataCorrupted;
+}
+
+std::tuple<Status, bool> CursorImpl::StepLeaf(bool forward) {
+  // The deepest inner node on the path that has a child in the desired
+  // direction is the lowest common ancestor of the current leaf and the
+  // neighbor.
+  size_t level = depth_;
+  while (level > 0) {
+    const PathEntry& entry = path_[level - 1];
+    if (forward ? entry.index < entry.entry_count : entry.index > 0)
+      break;
+    --level;
+  }
+  if (level == 0)
+    return {Status::kSuccess, false};
+
+  PathEntry& entry = path_[level - 1];
+  entry.index = forward ? entry.index + 1 : entry.index - 1;
+  ++leaves_crossed_;
+
+  StoreImpl* const store = transaction_->store();
+  Status status;
+  uint64_t child64;
+  const bool is_sibling = forward && level == depth_;
+  if (is_sibling) {
+    // The sibling link saves reading the parent.
+    child64 = BTreeNode::Link64(NodeData());
+  } else {
+    span<const uint8_t> node;
+    std::tie(status, node) = transaction_->ReadPage(entry.page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, false};
+    if (UNLIKELY(BTreeNode::IsCorrupt(node) ||
+                 BTreeNode::NodeType(node) != BTreeNode::Type::kInner ||
+                 BTreeNode::EntryCount(node) != entry.entry_count)) {
+      return {Status::kDataCorrupted, false};
+    }
+    std::tie(status, child64) = BTreeNode::InnerChildAt(node, entry.index);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, false};
+  }
+  const size_t page_id = BTree::CheckedChildId(store, child64);
+  if (UNLIKELY(page_id == 0))
+    return {Status::kDataCorrupted, false};
+
+  if (is_sibling &&
+      store->page_pool()->CachedStorePage(store, page_id) == nullptr &&
+      store->page_versions()->Find(page_id,
+                                   transaction_->snapshot()).empty()) {
+    status = ReadAhead();
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, false};
+  }
+
+  status = Descend(page_id, level,
+                   forward ? DescendMode::kFirst : DescendMode::kLast,
+                   span<const uint8_t>());
+  return {status, true};
+}
+
+Status CursorImpl::ReadAhead() {
+  BERRYDB_ASSUME_GT(depth_, 0U);
+  const PathEntry& parent = path_[depth_ - 1];
+
+  Status status;
+  span<const uint8_t> node;
+  std::tie(status, node) = transaction_->ReadPage(parent.page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (UNLIKELY(BTreeNode::IsCorrupt(node) ||
+               BTreeNode::NodeType(node) != BTreeNode::Type::kInner ||
+               BTreeNode::EntryCount(node) != parent.entry_count)) {
+    return Status::kDataCorrupted;
+  }
+
+  StoreImpl* const store = transaction_->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t leaf_count =
+      std::min(kReadAheadLeaves, page_pool->page_capacity() / 4);
+
+  // Leaves are usually allocated in key order, so sorting their IDs turns the
+  // prefetch into a few large reads.
+  size_t page_ids[kReadAheadLeaves];
+  size_t page_count = 0;
+  const size_t end_index =
+      std::min(parent.entry_count + 1, parent.index + leaf_count);
+  for (size_t index = parent.index; index < end_index; ++index) {
+    uint64_t child64;
+    std::tie(status, child64) = BTreeNode::InnerChildAt(node, index);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const size_t page_id = BTree::CheckedChildId(store, child64);
+    if (UNLIKELY(page_id == 0))
+      return Status::kDataCorrupted;
+    page_ids[page_count] = page_id;
+    ++page_count;
+  }
+  std::sort(page_ids, page_ids + page_count);
+
+  size_t run_begin = 0;
+  for (size_t i = 1; i <= page_count; ++i) {
+    if (i < page_count && page_ids[i] == page_ids[i - 1] + 1)
+      continue;
+    status = page_pool->PrefetchStorePages(store, page_ids[run_begin],
+                                           i - run_begin);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    run_begin = i;
+  }
+  return Status::kSuccess;
+}
+
+Status CursorImpl::SetPosition(size_t index) {
+  const span<const uint8_t> node = NodeData();
+  BERRYDB_ASSUME_LT(index, BTreeNode::EntryCount(node));
+
+  Status status;
+  span<const uint8_t> suffix;
+  std::tie(status, suffix) = BTreeNode::KeySuffix(node, index);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  const span<const uint8_t> prefix = BTreeNode::Prefix(node);
+  key_.resize(prefix.size() + suffix.size());
+  const span<uint8_t> key(key_.data(), key_.size());
+  CopySpan(prefix, key.first(prefix.size()));
+  CopySpan(suffix, key.subspan(prefix.size()));
+  index_ = index;
+  is_valid_ = true;
+  return Status::kSuccess;
+}
+
+Status CursorImpl::PositionForward(size_t index) {
+  while (index >= BTreeNode::EntryCount(NodeData())) {
+    Status status;
+    bool found;
+    std::tie(status, found) = StepLeaf(true);
+    if (UNLIKELY(status != Status::kSuccess) || !found)
+      return status;
+    index = 0;
+  }
+  return SetPosition(index);
+}
+
+Status CursorImpl::PositionBackward() {
+  size_t entry_count;
+  while ((entry_count = BTreeNode::EntryCount(NodeData())) == 0) {
+    Status status;
+    bool found;
+    std::tie(status, found) = StepLeaf(false);
+    if (UNLIKELY(status != Status::kSuccess) || !found)
+      return status;
+  }
+  return SetPosition(entry_count - 1);
+}
+
+Status CursorImpl::Seek(span<const uint8_t> key) {
+  if (UNLIKELY(is_store_closed_))
+    return Status::kAlreadyClosed;
+  if (UNLIKELY(root_page_id_ == 0))
+    return Status::kNotSupported;
+
+  is_valid_ = false;
+  leaves_crossed_ = 0;
+  Status status = Descend(root_page_id_, 0, DescendMode::kKey, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(NodeData(), key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return PositionForward(index);
+}
+
+Status CursorImpl::SeekToFirst() {
+  if (UNLIKELY(is_store_closed_))
+    return Status::kAlreadyClosed;
+  if (UNLIKELY(root_page_id_ == 0))
+    return Status::kNotSupported;
+
+  is_valid_ = false;
+  leaves_crossed_ = 0;
+  const Status status = Descend(root_page_id_, 0, DescendMode::kFirst,
+                                span<const uint8_t>());
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return PositionForward(0);
+}
+
+Status CursorImpl::SeekToLast() {
+  if (UNLIKELY(is_store_closed_))
+    return Status::kAlreadyClosed;
+  if (UNLIKELY(root_page_id_ == 0))
+    return Status::kNotSupported;
+
+  is_valid_ = false;
+  leaves_crossed_ = 0;
+  const Status status = Descend(root_page_id_, 0, DescendMode::kLast,
+                                span<const uint8_t>());
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return PositionBackward();
+}
+
+Status CursorImpl::Next() {
+  if (UNLIKELY(is_store_closed_))
+    return Status::kAlreadyClosed;
+  if (UNLIKELY(!is_valid_))
+    return Status::kNotFound;
+
+  is_valid_ = false;
+  return PositionForward(index_ + 1);
+}
+
+Status CursorImpl::Prev() {
+  if (UNLIKELY(is_store_closed_))
+    return Status::kAlreadyClosed;
+  if (UNLIKELY(!is_valid_))
+    return Status::kNotFound;
+
+  is_valid_ = false;
+  if (index_ > 0)
+    return SetPosition(index_ - 1);
+
+  Status status;
+  bool found;
+  std::tie(status, found) = StepLeaf(false);
+  if (UNLIKELY(status != Status::kSuccess) || !found)
+    return status;
+  return PositionBackward();
+}
+
+std::tuple<Status, span<const uint8_t>> CursorImpl::Value() {
+  if (UNLIKELY(is_store_closed_))
+    return {Status::kAlreadyClosed, span<const uint8_t>()};
+  if (UNLIKELY(!is_valid_))
+    return {Status::kNotFound, span<const uint8_t>()};
+
+  // The value is copied, because the page holding it may be modified by a
+  // writer while the caller uses the value.
+  const span<const uint8_t> node = NodeData();
+  const span<const uint8_t> leaf_value = BTreeNode::LeafValue(node, index_);
+  if (!BTreeNode::LeafHasOverflowValue(node, index_)) {
+    value_buffer_.assign(leaf_value.begin(), leaf_value.end());
+    return {Status::kSuccess,
+            span<const uint8_t>(value_buffer_.data(), value_buffer_.size())};
+  }
+
+  Status status;
+  if (ValueLog::IsReference(leaf_value)) {
+    value_buffer_.assign(leaf_value.begin(), leaf_value.end());
+    status = ValueLog::ReadReferencedValue(transaction_, &value_buffer_);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, span<const uint8_t>()};
+    return {Status::kSuccess,
+            span<const uint8_t>(value_buffer_.data(), value_buffer_.size())};
+  }
+
+  size_t first_page_id, value_size;
+  std::tie(status, first_page_id, value_size) =
+      OverflowValue::DecodeReference(transaction_->store(), leaf_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, span<const uint8_t>()};
+  value_buffer_.resize(value_size);
+  const span<uint8_t> value(value_buffer_.data(), value_size);
+  status = OverflowValue::Read(transaction_, first_page_id, 0, value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, span<const uint8_t>()};
+  return {Status::kSuccess, value};
+}
+
+}  // namespace berrydb
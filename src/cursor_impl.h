@@ -0,0 +1,219 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_CURSOR_IMPL_H_
+#define BERRYDB_CURSOR_IMPL_H_
+
+#include <tuple>
+#include <vector>
+
+#include "berrydb/cursor.h"
+#include "berrydb/span.h"
+#include "./btree.h"
+#include "./util/checks.h"
+#include "./util/linked_list.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class Page;
+class ReadTransactionImpl;
+
+/** Internal representation for the Cursor class in the public API.
+ *
+ * A cursor walks the leaves of a B+tree, as seen by its read transaction's
+ * snapshot. The snapshot never changes, so the cursor remembers the path from
+ * the root to its current leaf, and uses it to find the neighboring leaves.
+ * Moving forward follows the leaves' sibling links. Moving backward goes
+ * through the current leaf's parent, because leaves are only linked to their
+ * right siblings.
+ *
+ * The cursor pins the page that holds its current node in the page pool, so
+ * the node stays in memory while the cursor is positioned on it. Writers do not
+ * wait for readers, so the pinned page may be modified. The cursor checks the
+ * store's page versions before each use of the node, and switches to the
+ * version seen by its snapshot once the page is modified.
+ *
+ * When a forward scan reaches a leaf that isn't cached, the cursor prefetches
+ * the leaf and the next few siblings under the same parent, grouping
+ * consecutive pages into a single read. After a scan crosses many leaves, the
+ * leaves it leaves behind are unpinned with PagePool::kDiscardPage, so large
+ * scans recycle their own pages instead of evicting the pool's working set.
+ */
+class CursorImpl {
+ public:
+  /** Create a CursorImpl instance. */
+  static CursorImpl* Create(ReadTransactionImpl* transaction,
+                            size_t root_page_id);
+
+  CursorImpl(const CursorImpl&) = delete;
+  CursorImpl(CursorImpl&&) = delete;
+  CursorImpl& operator=(const CursorImpl&) = delete;
+  CursorImpl& operator=(CursorImpl&&) = delete;
+
+  /** Computes the internal representation for a pointer from the public API. */
+  static inline CursorImpl* FromApi(Cursor* api) noexcept {
+    CursorImpl* const impl = reinterpret_cast<CursorImpl*>(api);
+    BERRYDB_ASSUME_EQ(api, &impl->api_);
+    return impl;
+  }
+  /** Computes the internal representation for a pointer from the public API. */
+  static inline const CursorImpl* FromApi(const Cursor* api) noexcept {
+    const CursorImpl* const impl = reinterpret_cast<const CursorImpl*>(api);
+    BERRYDB_ASSUME_EQ(api, &impl->api_);
+    return impl;
+  }
+
+  /** Computes the public API representation for this cursor. */
+  inline constexpr Cursor* ToApi() noexcept { return &api_; }
+
+  /** Called when the store of the cursor's transaction is closed.
+   *
+   * The cursor drops its page pin, and becomes invalid. */
+  void StoreWasClosed() noexcept;
+
+  // See the public API documention for details.
+  Status Seek(span<const uint8_t> key);
+  Status SeekToFirst();
+  Status SeekToLast();
+  Status Next();
+  Status Prev();
+  inline constexpr bool Valid() const noexcept { return is_valid_; }
+  inline span<const uint8_t> key() const noexcept {
+    BERRYDB_ASSUME(is_valid_);
+    return span<const uint8_t>(key_.data(), key_.size());
+  }
+  std::tuple<Status, span<const uint8_t>> Value();
+  void Release();
+
+ private:
+  /** Selects the child followed at each inner node by Descend(). */
+  enum class DescendMode {
+    /** The child that may hold a given key. */
+    kKey,
+    /** The leftmost child. */
+    kFirst,
+    /** The rightmost child. */
+    kLast,
+  };
+
+  /** An inner node on the path from the tree's root to the current leaf. */
+  struct PathEntry {
+    /** The node's page ID. */
+    size_t page_id;
+    /** The position of the child on the path. See BTreeNode::InnerChildAt(). */
+    size_t index;
+    /** The number of entries in the node. */
+    size_t entry_count;
+  };
+
+  /** Use CursorImpl::Create() to obtain instances. */
+  CursorImpl(ReadTransactionImpl* transaction, size_t root_page_id);
+  /** Use Release() to destroy CursorImpl instances. */
+  ~CursorImpl();
+
+  /** The content of the current node, as seen by the transaction's snapshot. */
+  span<const uint8_t> NodeData() noexcept;
+
+  /** Makes a page the current node, pinning it if necessary.
+   *
+   * @param  page_id the page that holds the node
+   * @return         kDataCorrupted if the page does not hold a valid node;
+   *                 otherwise, most likely kSuccess or kIoError
+   */
+  Status LoadNode(size_t page_id);
+
+  /** Drops the pin on the current node's page, if the cursor holds one. */
+  void UnpinNode() noexcept;
+
+  /** Descends from an inner node on the path to a leaf.
+   *
+   * The leaf becomes the current node, and the path is updated.
+   *
+   * @param  page_id the page where the descent starts
+   * @param  level   the page's depth in the tree; the root is at depth 0
+   * @param  mode    selects the child followed at each inner node
+   * @param  key     the key that routes the descent, in DescendMode::kKey
+   * @return         kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status Descend(size_t page_id, size_t level, DescendMode mode,
+                 span<const uint8_t> key);
+
+  /** Moves to the leaf next to the current leaf.
+   *
+   * @param  forward true to move to the right neighbor, false for the left one
+   * @return status  kSuccess, kDataCorrupted, or an I/O error
+   * @return found   false if the current leaf is at the tree's edge
+   */
+  std::tuple<Status, bool> StepLeaf(bool forward);
+
+  /** Prefetches the next leaves under the current leaf's parent. */
+  Status ReadAhead();
+
+  /** Positions the cursor at the first entry at or after an index.
+   *
+   * Empty leaves are skipped. The cursor becomes invalid if there are no
+   * entries left. */
+  Status PositionForward(size_t index);
+
+  /** Positions the cursor at the current leaf's last entry.
+   *
+   * Empty leaves are skipped, going backwards. The cursor becomes invalid if
+   * there are no entries left. */
+  Status PositionBackward();
+
+  /** Positions the cursor at an entry in the current leaf. */
+  Status SetPosition(size_t index);
+
+  /* The public API version of this class. */
+  Cursor api_;  // Must be the first class member.
+
+  friend class LinkedListBridge<CursorImpl>;
+  LinkedList<CursorImpl>::Node linked_list_node_;
+
+  /** The transaction whose snapshot is read by this cursor. */
+  ReadTransactionImpl* const transaction_;
+
+  /** The ID of the root page of the tree iterated by this cursor.
+   *
+   * 0 if the cursor was created for a space that can't be scanned. */
+  const size_t root_page_id_;
+
+  /** The ID of the page holding the current node. */
+  size_t node_page_id_ = 0;
+
+  /** The pool page holding the current node, if the cursor pinned it. */
+  Page* node_page_ = nullptr;
+
+  /** The current node's content, if it came from the store's page versions. */
+  span<const uint8_t> node_version_;
+
+  /** The inner nodes between the tree's root and the current leaf. */
+  PathEntry path_[BTree::kMaxDepth];
+
+  /** The number of inner nodes between the tree's root and the current leaf. */
+  size_t depth_ = 0;
+
+  /** The index of the entry that the cursor is positioned at. */
+  size_t index_ = 0;
+
+  /** The number of leaves crossed since the last Seek method call. */
+  size_t leaves_crossed_ = 0;
+
+  /** See key(). */
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> key_;
+
+  /** Holds the value returned by the last Value() call. */
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> value_buffer_;
+
+  /** See Valid(). */
+  bool is_valid_ = false;
+
+  /** See StoreWasClosed(). */
+  bool is_store_closed_ = false;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_CURSOR_IMPL_H_
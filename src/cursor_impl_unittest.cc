@@ -0,0 +1,332 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./cursor_impl.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/cursor.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "./test/space_helpers.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+/** A key whose order matches the order of the given number. */
+std::string NumberKey(size_t number) {
+  std::string key = std::to_string(number);
+  return "key" + std::string(8 - key.size(), '0') + key;
+}
+
+}  // namespace
+
+class CursorImplTest : public SpaceTest {
+ protected:
+  CursorImplTest() : SpaceTest("test_cursor_impl.berry") {}
+
+  void SetUp() override { CreatePool(kPageShift, 64); }
+
+  /** Writes the pairs in a map to the space, in random order. */
+  void PutAll(const std::map<std::string, std::string>& pairs) {
+    std::vector<const std::pair<const std::string, std::string>*> order;
+    for (const auto& pair : pairs)
+      order.push_back(&pair);
+    std::shuffle(order.begin(), order.end(), rnd_);
+
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (const auto* pair : order) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(pair->first), StringSpan(pair->second)));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  /** Removes a range of keys from the space and from a map. */
+  void DeleteRange(size_t begin, size_t end,
+                   std::map<std::string, std::string>* pairs) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (size_t i = begin; i < end; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Delete(
+          space_.get(), StringSpan(NumberKey(i))));
+      pairs->erase(NumberKey(i));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  /** The cursor's current value. */
+  std::string Value(Cursor* cursor) {
+    Status status;
+    span<const uint8_t> value;
+    std::tie(status, value) = cursor->Value();
+    EXPECT_EQ(Status::kSuccess, status);
+    return SpanString(value);
+  }
+
+  /** Scans the space forward and backward, and compares it to a map. */
+  void ExpectScansMatch(ReadTransaction* reader,
+                        const std::map<std::string, std::string>& expected) {
+    UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+
+    ASSERT_EQ(Status::kSuccess, cursor->SeekToFirst());
+    for (const auto& pair : expected) {
+      ASSERT_TRUE(cursor->Valid()) << pair.first;
+      ASSERT_EQ(pair.first, SpanString(cursor->key()));
+      ASSERT_EQ(pair.second, Value(cursor.get()));
+      ASSERT_EQ(Status::kSuccess, cursor->Next());
+    }
+    EXPECT_FALSE(cursor->Valid());
+
+    ASSERT_EQ(Status::kSuccess, cursor->SeekToLast());
+    for (auto it = expected.rbegin(); it != expected.rend(); ++it) {
+      ASSERT_TRUE(cursor->Valid()) << it->first;
+      ASSERT_EQ(it->first, SpanString(cursor->key()));
+      ASSERT_EQ(it->second, Value(cursor.get()));
+      ASSERT_EQ(Status::kSuccess, cursor->Prev());
+    }
+    EXPECT_FALSE(cursor->Valid());
+  }
+
+  /** Pairs whose values are large enough to fill many 1 KB leaves. */
+  std::map<std::string, std::string> NumberedPairs(size_t count) {
+    std::map<std::string, std::string> pairs;
+    for (size_t i = 0; i < count; ++i)
+      pairs[NumberKey(i)] = "value " + std::to_string(i * 7);
+    return pairs;
+  }
+
+  static constexpr size_t kPageShift = 10;
+};
+
+TEST_F(CursorImplTest, EmptySpace) {
+  OpenStore();
+  CreateSpace("space");
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  EXPECT_FALSE(cursor->Valid());
+  EXPECT_EQ(Status::kNotFound, cursor->Next());
+  EXPECT_EQ(Status::kNotFound, cursor->Prev());
+  EXPECT_EQ(Status::kNotFound, std::get<0>(cursor->Value()));
+
+  EXPECT_EQ(Status::kSuccess, cursor->SeekToFirst());
+  EXPECT_FALSE(cursor->Valid());
+  EXPECT_EQ(Status::kSuccess, cursor->SeekToLast());
+  EXPECT_FALSE(cursor->Valid());
+  EXPECT_EQ(Status::kSuccess, cursor->Seek(StringSpan("key")));
+  EXPECT_FALSE(cursor->Valid());
+}
+
+TEST_F(CursorImplTest, ScansMatchMap) {
+  OpenStore();
+  CreateSpace("space");
+
+  // Random keys of varying lengths spread over many leaves and a few levels.
+  std::map<std::string, std::string> pairs;
+  while (pairs.size() < 3000) {
+    std::string key(1 + rnd_() % 24, ' ');
+    for (char& c : key)
+      c = static_cast<char>('a' + rnd_() % 4);
+    pairs[key] = "value of " + key;
+  }
+  PutAll(pairs);
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  ExpectScansMatch(reader.get(), pairs);
+}
+
+TEST_F(CursorImplTest, Seek) {
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> pairs;
+  for (size_t i = 0; i < 4000; i += 2)
+    pairs[NumberKey(i)] = std::to_string(i);
+  PutAll(pairs);
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  for (size_t i = 0; i < 4002; i += 37) {
+    const std::string key = NumberKey(i);
+    ASSERT_EQ(Status::kSuccess, cursor->Seek(StringSpan(key)));
+    const auto it = pairs.lower_bound(key);
+    if (it == pairs.end()) {
+      EXPECT_FALSE(cursor->Valid()) << key;
+      continue;
+    }
+    ASSERT_TRUE(cursor->Valid()) << key;
+    EXPECT_EQ(it->first, SpanString(cursor->key()));
+    EXPECT_EQ(it->second, Value(cursor.get()));
+
+    // Stepping back from a Seek() result crosses into the previous leaf.
+    ASSERT_EQ(Status::kSuccess, cursor->Prev());
+    if (it == pairs.begin()) {
+      EXPECT_FALSE(cursor->Valid()) << key;
+    } else {
+      ASSERT_TRUE(cursor->Valid()) << key;
+      EXPECT_EQ(std::prev(it)->first, SpanString(cursor->key()));
+    }
+  }
+
+  ASSERT_EQ(Status::kSuccess, cursor->Seek(StringSpan("")));
+  ASSERT_TRUE(cursor->Valid());
+  EXPECT_EQ(pairs.begin()->first, SpanString(cursor->key()));
+  ASSERT_EQ(Status::kSuccess, cursor->Seek(StringSpan("zzz")));
+  EXPECT_FALSE(cursor->Valid());
+}
+
+TEST_F(CursorImplTest, SkipsEmptyLeaves) {
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> pairs = NumberedPairs(3000);
+  PutAll(pairs);
+  // Deleting keys leaves empty leaves in the tree, at its edges and inside.
+  DeleteRange(0, 400, &pairs);
+  DeleteRange(1000, 2000, &pairs);
+  DeleteRange(2600, 3000, &pairs);
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  ExpectScansMatch(reader.get(), pairs);
+
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  ASSERT_EQ(Status::kSuccess, cursor->Seek(StringSpan(NumberKey(1500))));
+  ASSERT_TRUE(cursor->Valid());
+  EXPECT_EQ(NumberKey(2000), SpanString(cursor->key()));
+  ASSERT_EQ(Status::kSuccess, cursor->Prev());
+  ASSERT_TRUE(cursor->Valid());
+  EXPECT_EQ(NumberKey(999), SpanString(cursor->key()));
+
+  DeleteRange(400, 1000, &pairs);
+  DeleteRange(2000, 2600, &pairs);
+  UniquePtr<ReadTransaction> empty_reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> empty_cursor(empty_reader->CreateCursor(space_.get()));
+  ASSERT_EQ(Status::kSuccess, empty_cursor->SeekToFirst());
+  EXPECT_FALSE(empty_cursor->Valid());
+  ASSERT_EQ(Status::kSuccess, empty_cursor->SeekToLast());
+  EXPECT_FALSE(empty_cursor->Valid());
+}
+
+TEST_F(CursorImplTest, SeesSnapshot) {
+  OpenStore();
+  CreateSpace("space");
+
+  const std::map<std::string, std::string> old_pairs = NumberedPairs(3000);
+  PutAll(old_pairs);
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  ASSERT_EQ(Status::kSuccess, cursor->SeekToFirst());
+  ASSERT_TRUE(cursor->Valid());
+
+  // The writer modifies the leaf pinned by the cursor, and splits nodes.
+  std::map<std::string, std::string> new_pairs = old_pairs;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (size_t i = 0; i < 3000; i += 3) {
+      const std::string key = NumberKey(i);
+      const std::string value = "a much longer replacement value " + key;
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      new_pairs[key] = value;
+    }
+    for (size_t i = 1; i < 3000; i += 3) {
+      ASSERT_EQ(Status::kSuccess, transaction->Delete(
+          space_.get(), StringSpan(NumberKey(i))));
+      new_pairs.erase(NumberKey(i));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  for (const auto& pair : old_pairs) {
+    ASSERT_TRUE(cursor->Valid()) << pair.first;
+    ASSERT_EQ(pair.first, SpanString(cursor->key()));
+    ASSERT_EQ(pair.second, Value(cursor.get()));
+    ASSERT_EQ(Status::kSuccess, cursor->Next());
+  }
+  EXPECT_FALSE(cursor->Valid());
+  ExpectScansMatch(reader.get(), old_pairs);
+
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  ExpectScansMatch(new_reader.get(), new_pairs);
+}
+
+TEST_F(CursorImplTest, LargeValues) {
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> pairs;
+  for (size_t i = 0; i < 100; ++i) {
+    const size_t size = (i % 3 == 0) ? 5000 + i * 13 : 10 + i;
+    std::string value(size, ' ');
+    for (char& c : value)
+      c = static_cast<char>('a' + rnd_() % 26);
+    pairs[NumberKey(i)] = value;
+  }
+  PutAll(pairs);
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  ExpectScansMatch(reader.get(), pairs);
+}
+
+TEST_F(CursorImplTest, ScanWithSmallPool) {
+  std::map<std::string, std::string> pairs = NumberedPairs(20000);
+  OpenStore();
+  CreateSpace("space");
+  PutAll(pairs);
+  space_.reset();
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+  store_.reset();
+
+  // The tree has hundreds of leaves. None of them are cached after the store
+  // is reopened, so the scans rely on prefetching.
+  CreatePool(kPageShift, 16);
+  OpenStore();
+  OpenSpace("space");
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  ExpectScansMatch(reader.get(), pairs);
+
+  // Point reads still work after a large scan went through the pool.
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  ASSERT_EQ(Status::kSuccess, cursor->Seek(StringSpan(NumberKey(12345))));
+  ASSERT_TRUE(cursor->Valid());
+  EXPECT_EQ(pairs[NumberKey(12345)], Value(cursor.get()));
+}
+
+TEST_F(CursorImplTest, StoreClosed) {
+  OpenStore();
+  CreateSpace("space");
+  PutAll(NumberedPairs(100));
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  ASSERT_EQ(Status::kSuccess, cursor->SeekToFirst());
+  ASSERT_TRUE(cursor->Valid());
+
+  ASSERT_EQ(Status::kSuccess, store_->Close());
+  EXPECT_FALSE(cursor->Valid());
+  EXPECT_EQ(Status::kAlreadyClosed, cursor->Next());
+  EXPECT_EQ(Status::kAlreadyClosed, cursor->SeekToFirst());
+  EXPECT_EQ(Status::kAlreadyClosed, std::get<0>(cursor->Value()));
+
+  UniquePtr<Cursor> late_cursor(reader->CreateCursor(space_.get()));
+  EXPECT_EQ(Status::kAlreadyClosed, late_cursor->Seek(StringSpan("key")));
+}
+
+}  // namespace berrydb
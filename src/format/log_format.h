@@ -0,0 +1,180 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_FORMAT_LOG_FORMAT_H_
+#define BERRYDB_FORMAT_LOG_FORMAT_H_
+
+#include "berrydb/platform.h"
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "../util/endianness.h"
+
+namespace berrydb {
+
+/** On-disk layout of the records in a store's log file.
+ *
+ * The log is a sequence of records. Each record starts with a fixed-size
+ * header, which may be followed by a payload whose size is determined by the
+ * record type. All header fields are 64-bit numbers, so records are 8-byte
+ * aligned as long as the payload sizes are multiples of 8.
+ *
+ * The header fields are:
+ *   0: checksum covering the rest of the record (header and payload)
+ *   8: record type, one of the LogFormat::RecordType values
+ *  16: the log epoch that the record was written in
+ *  24: type-specific field; the page ID for page image records, and the number
+ *      of page image records in the transaction for commit records
+ *
+ * A transaction's records are written contiguously: a page image record for
+ * each page modified by the transaction, followed by a commit record. Recovery
+ * only replays page images that are followed by a valid commit record.
+ *
+ * Stores opened with StoreOptions::compress_log may log a page's content in a
+ * compressed page image record instead. The record's payload starts with the
+ * 64-bit size of the compressed content, which is followed by the compressed
+ * content, zero-padded to a multiple of 8 bytes. Compressed records are only
+ * written when they are smaller than the page image record they replace, and
+ * count as page image records in commit records.
+ *
+ * The log is considered to end at the first record that is truncated, has a
+ * bad checksum, or has an epoch that does not match the store header's epoch.
+ * The epoch check rejects records left over from before the last checkpoint.
+ *
+ * The log file is allocated in fixed-size segments, which are zero-filled when
+ * they are added to the file. Segments are never released. After a checkpoint,
+ * the log is written from the beginning of the first segment again, reusing the
+ * existing segments. So, committing a transaction usually does not change the
+ * file's size, and the log sync only needs to flush data, not metadata. Zeroed
+ * space fails the epoch check, and recycled space holds records tagged with an
+ * older epoch, so neither is mistaken for live records.
+ */
+class LogFormat {
+ public:
+  /** The types of records that can show up in a log. */
+  enum class RecordType : uint64_t {
+    /** The content of a page, as modified by a transaction. */
+    kPageImage = 1,
+    /** Marks the end of a transaction's records. */
+    kCommit = 2,
+    /** The content of a page, compressed by the platform's compressor. */
+    kCompressedPageImage = 3,
+  };
+
+  /** The log file grows in multiples of this size. */
+  static constexpr size_t kSegmentSize = 4 << 20;
+
+  /** The size of a record's header. */
+  static constexpr size_t kRecordHeaderSize = 32;
+
+  static constexpr size_t kChecksumOffset = 0;
+  static constexpr size_t kTypeOffset = 8;
+  static constexpr size_t kEpochOffset = 16;
+  static constexpr size_t kPageIdOffset = 24;
+  /** Commit records store the record count where the page ID would go. */
+  static constexpr size_t kPageCountOffset = 24;
+
+  /** The size of a page image record, including the header.
+   *
+   * @param  page_shift base-2 log of the store's page size
+   * @return            the number of bytes taken up by a page image record
+   */
+  static inline constexpr size_t PageImageRecordSize(
+      size_t page_shift) noexcept {
+    return kRecordHeaderSize + (static_cast<size_t>(1) << page_shift);
+  }
+
+  /** The size of the compressed size field in compressed page image records.
+   *
+   * The field is at the beginning of the payload, right after the header. */
+  static constexpr size_t kCompressedSizeFieldSize = 8;
+
+  /** The size of a compressed page image record, including the header.
+   *
+   * @param  compressed_size the size of the page's compressed content
+   * @return                 the number of bytes taken up by the record
+   */
+  static inline constexpr size_t CompressedPageImageRecordSize(
+      size_t compressed_size) noexcept {
+    return kRecordHeaderSize + kCompressedSizeFieldSize +
+           ((compressed_size + 7) & ~static_cast<size_t>(7));
+  }
+
+  /** Reads the compressed content size in a compressed page image record.
+   *
+   * @param record the record's header, followed by at least the compressed
+   *               size field; the size has not been validated
+   */
+  static inline constexpr uint64_t CompressedSize64(
+      span<const uint8_t> record) noexcept {
+    return LoadUint64(
+        record.subspan(kRecordHeaderSize, kCompressedSizeFieldSize));
+  }
+
+  /** The size of a commit record. Commit records have no payload. */
+  static constexpr size_t kCommitRecordSize = kRecordHeaderSize;
+
+  /** Reads a record's type. The type has not been validated. */
+  static inline constexpr uint64_t Type64(
+      span<const uint8_t> record) noexcept {
+    return LoadUint64(record.subspan(kTypeOffset, 8));
+  }
+
+  /** Reads a record's epoch. */
+  static inline constexpr uint64_t Epoch(span<const uint8_t> record) noexcept {
+    return LoadUint64(record.subspan(kEpochOffset, 8));
+  }
+
+  /** Reads the type-specific field of a record header.
+   *
+   * This is the page ID for page images, and the transaction's record count for
+   * commit records. The caller must handle 64-bit values on 32-bit systems. */
+  static inline constexpr uint64_t Argument64(
+      span<const uint8_t> record) noexcept {
+    return LoadUint64(record.subspan(kPageIdOffset, 8));
+  }
+
+  /** Writes a record's header, except for the checksum.
+   *
+   * @param type     the record's type
+   * @param epoch    the log epoch that the record is written in
+   * @param argument the page ID for page images, the record count for commits
+   * @param record   the buffer holding the record; must be 8-byte aligned
+   */
+  static inline void SetHeader(RecordType type, uint64_t epoch,
+                               uint64_t argument,
+                               span<uint8_t> record) noexcept {
+    StoreUint64(static_cast<uint64_t>(type),
+                record.subspan(kTypeOffset, 8));
+    StoreUint64(epoch, record.subspan(kEpochOffset, 8));
+    StoreUint64(argument, record.subspan(kPageIdOffset, 8));
+  }
+
+  /** Computes and stores a record's checksum.
+   *
+   * This must be called after the record's header and payload are written.
+   *
+   * @param record the buffer holding the entire record, including the payload
+   */
+  static void SetChecksum(span<uint8_t> record) noexcept;
+
+  /** True if a record's checksum matches its content.
+   *
+   * @param record the buffer holding the entire record, including the payload
+   */
+  static bool HasValidChecksum(span<const uint8_t> record) noexcept;
+
+  /** Checksum over a buffer whose size is a multiple of 8 bytes.
+   *
+   * The checksum is not cryptographically secure. It is intended to catch torn
+   * writes and random corruption. The buffer must be 8-byte aligned.
+   *
+   * @param  data the buffer to be checksummed
+   * @return      the buffer's checksum
+   */
+  static uint64_t Checksum(span<const uint8_t> data) noexcept;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_FORMAT_LOG_FORMAT_H_
@@ -0,0 +1,92 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./log_format.h"
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "../util/span_util.h"
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(LogFormatTest, PageImageRecordSize) {
+  EXPECT_EQ(32U + 4096U, LogFormat::PageImageRecordSize(12));
+  EXPECT_EQ(32U + 32768U, LogFormat::PageImageRecordSize(15));
+}
+
+TEST(LogFormatTest, CompressedPageImageRecordSize) {
+  EXPECT_EQ(32U + 8U, LogFormat::CompressedPageImageRecordSize(0));
+  EXPECT_EQ(32U + 8U + 8U, LogFormat::CompressedPageImageRecordSize(1));
+  EXPECT_EQ(32U + 8U + 8U, LogFormat::CompressedPageImageRecordSize(8));
+  EXPECT_EQ(32U + 8U + 1000U, LogFormat::CompressedPageImageRecordSize(995));
+}
+
+TEST(LogFormatTest, SetHeader) {
+  alignas(8) uint8_t buffer_bytes[LogFormat::kRecordHeaderSize + 64];
+  span<uint8_t> buffer(buffer_bytes);
+  FillSpan(buffer, 0xCD);
+
+  LogFormat::SetHeader(LogFormat::RecordType::kPageImage, 0x0123456789abcdef,
+                       0xc0decdef, buffer);
+  EXPECT_EQ(static_cast<uint64_t>(LogFormat::RecordType::kPageImage),
+            LogFormat::Type64(buffer));
+  EXPECT_EQ(0x0123456789abcdefU, LogFormat::Epoch(buffer));
+  EXPECT_EQ(0xc0decdefU, LogFormat::Argument64(buffer));
+
+  // The payload must not be touched.
+  for (size_t i = LogFormat::kRecordHeaderSize; i < buffer.size(); ++i)
+    EXPECT_EQ(0xCD, buffer[i]);
+}
+
+TEST(LogFormatTest, ChecksumRoundTrip) {
+  alignas(8) uint8_t buffer_bytes[LogFormat::kRecordHeaderSize + 256];
+  span<uint8_t> buffer(buffer_bytes);
+  for (size_t i = 0; i < buffer.size(); ++i)
+    buffer[i] = static_cast<uint8_t>(i * 7);
+
+  LogFormat::SetHeader(LogFormat::RecordType::kPageImage, 1, 3, buffer);
+  LogFormat::SetChecksum(buffer);
+  EXPECT_TRUE(LogFormat::HasValidChecksum(buffer));
+
+  LogFormat::SetHeader(LogFormat::RecordType::kCommit, 1, 1,
+                       buffer.first(LogFormat::kCommitRecordSize));
+  LogFormat::SetChecksum(buffer.first(LogFormat::kCommitRecordSize));
+  EXPECT_TRUE(LogFormat::HasValidChecksum(
+      buffer.first(LogFormat::kCommitRecordSize)));
+}
+
+TEST(LogFormatTest, ChecksumCatchesBitFlips) {
+  alignas(8) uint8_t buffer_bytes[LogFormat::kRecordHeaderSize + 128];
+  span<uint8_t> buffer(buffer_bytes);
+  FillSpan(buffer, 0);
+
+  LogFormat::SetHeader(LogFormat::RecordType::kPageImage, 5, 9, buffer);
+  LogFormat::SetChecksum(buffer);
+  ASSERT_TRUE(LogFormat::HasValidChecksum(buffer));
+
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    for (size_t j = 0; j < 8; ++j) {
+      uint8_t mask = 1 << j;
+      buffer[i] ^= mask;
+      EXPECT_FALSE(LogFormat::HasValidChecksum(buffer));
+      buffer[i] ^= mask;
+    }
+  }
+  EXPECT_TRUE(LogFormat::HasValidChecksum(buffer));
+}
+
+TEST(LogFormatTest, ChecksumDependsOnSize) {
+  alignas(8) uint8_t buffer_bytes[64];
+  span<uint8_t> buffer(buffer_bytes);
+  FillSpan(buffer, 0);
+
+  EXPECT_NE(LogFormat::Checksum(buffer.first(32)),
+            LogFormat::Checksum(buffer.first(40)));
+  EXPECT_NE(LogFormat::Checksum(buffer.first(40)),
+            LogFormat::Checksum(buffer));
+}
+
+}  // namespace berrydb
@@ -18,6 +18,7 @@ namespace berrydb {
 // 32: 8-byte page index of the head of the free page list
 // 40: 1-byte page shift (log2 of the page size)
 // 41: 7-byte padding - reserved for future expansion, must be set to zero
+// 48: 8-byte log epoch - tags the records in the log file that are not stale
 //
 // The format version number is a mechanism for future expansion. The number
 // will remain at 0 until the format is stabilized. At that point, the version
@@ -28,7 +29,7 @@ StoreHeader::StoreHeader(size_t page_shift, size_t page_count)
 #if BERRYDB_CHECK_IS_ON()
     , free_list_head_page(kInvalidFreeListHeadPage)
 #endif  // BERRYDB_CHECK_IS_ON()
-    , page_shift(page_shift)
+    , page_shift(page_shift), log_epoch(0)
     {
   BERRYDB_ASSUME_GT(page_shift, 0U);
 }
@@ -44,6 +45,8 @@ void StoreHeader::Serialize(span<uint8_t> to) {
   StoreUint64(0, to.subspan(40, 8));
   DCHECK_LT(page_shift, 32U);
   to[40] = static_cast<uint8_t>(page_shift);
+
+  StoreUint64(log_epoch, to.subspan(48, 8));
 }
 
 bool StoreHeader::Deserialize(span<const uint8_t> from) {
@@ -74,8 +77,10 @@ bool StoreHeader::Deserialize(span<const uint8_t> from) {
     // corruption or a difficult-to-debug crash.
     return false;
   }
-  if (UNLIKELY(free_list_head_page == kInvalidFreeListHeadPage)) {
-    // Another data corruption case that is best caught early on.
+  if (UNLIKELY(free_list_head_page >= page_count)) {
+    // Another data corruption case that is best caught early on. An empty free
+    // list is represented by a head page ID of 0, which is always smaller than
+    // the page count, because the store header takes up the first page.
     return false;
   }
 
@@ -87,6 +92,7 @@ bool StoreHeader::Deserialize(span<const uint8_t> from) {
     return false;
   }
 
+  log_epoch = LoadUint64(from.subspan(48, 8));
   return true;
 }
 
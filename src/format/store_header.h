@@ -61,10 +61,17 @@ struct StoreHeader {
    * 2 ** page_shift. */
   size_t page_shift;
 
+  /** The epoch of the records in the store's log file.
+   *
+   * The epoch is bumped at every checkpoint, when all the changes recorded in
+   * the log have been written to the data file. Log records tagged with other
+   * epochs are stale, and are ignored by recovery. */
+  uint64_t log_epoch;
+
   /** The size of a serialized store header, in bytes.
    *
    * This is a constant because the store header only has fixed-width fields. */
-  static constexpr size_t kSerializedSize = 48;
+  static constexpr size_t kSerializedSize = 56;
 
   /** Magic number used to tag all BerryDB files.
    *
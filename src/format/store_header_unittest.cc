@@ -21,6 +21,7 @@ TEST(StoreHeaderTest, SerializeDeserialize) {
   header.page_shift = 12;
   header.page_count = 0xc0decdef;
   header.free_list_head_page = 0x12345678;
+  header.log_epoch = 0x0123456789abcdef;
   header.Serialize(buffer);
 
   for (size_t i = StoreHeader::kSerializedSize; i < buffer.size(); ++i)
@@ -31,6 +32,28 @@ TEST(StoreHeaderTest, SerializeDeserialize) {
   EXPECT_EQ(header.page_shift, header2.page_shift);
   EXPECT_EQ(header.page_count, header2.page_count);
   EXPECT_EQ(header.free_list_head_page, header2.free_list_head_page);
+  EXPECT_EQ(header.log_epoch, header2.log_epoch);
+}
+
+TEST(StoreHeaderTest, EmptyFreeList) {
+  alignas(8) uint8_t buffer_bytes[StoreHeader::kSerializedSize];
+  span<uint8_t> buffer(buffer_bytes);
+
+  StoreHeader header;
+  header.page_shift = 12;
+  header.page_count = 2;
+  header.free_list_head_page = 0;
+  header.log_epoch = 1;
+  header.Serialize(buffer);
+
+  StoreHeader header2;
+  ASSERT_EQ(true, header2.Deserialize(buffer));
+  EXPECT_EQ(0U, header2.free_list_head_page);
+
+  // The free list head must point inside the data file.
+  header.free_list_head_page = 2;
+  header.Serialize(buffer);
+  EXPECT_FALSE(header2.Deserialize(buffer));
 }
 
 TEST(StoreHeaderTest, HeaderErrors) {
@@ -40,6 +63,7 @@ TEST(StoreHeaderTest, HeaderErrors) {
   header.page_shift = 12;
   header.free_list_head_page = 0x12345678;
   header.page_count = 0xc0decdef;
+  header.log_epoch = 42;
   header.Serialize(buffer);
 
   StoreHeader header2;
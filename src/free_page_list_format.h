@@ -10,9 +10,10 @@
 
 namespace berrydb {
 
-/** Implementation details for FreePageList.
+/** Implementation details for FreePageList and FreePageManager.
  *
- * This class should only be used by the FreePageList implementation and tests.
+ * This class should only be used by the FreePageList and FreePageManager
+ * implementations, and by tests.
  */
 class FreePageListFormat {
  public:
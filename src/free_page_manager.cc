@@ -4,51 +4,396 @@
 
 #include "./free_page_manager.h"
 
+#include <algorithm>
+
 #include "berrydb/platform.h"
+#include "berrydb/status.h"
 #include "./free_page_list.h"
+#include "./free_page_list_format.h"
 #include "./page.h"
 #include "./page_pool.h"
 #include "./store_impl.h"
 #include "./transaction_impl.h"
 #include "./util/checks.h"
+#include "./util/span_util.h"
 
 namespace berrydb {
 
+constexpr size_t FreePageManager::kInvalidPageId;
+
 static_assert(
     FreePageManager::kInvalidPageId == FreePageList::kInvalidPageId,
     "kInvalidPageId must be the same in FreePageManager and FreePageList");
 
-FreePageManager::FreePageManager(MAYBE_UNUSED StoreImpl* store)
-#if BERRYDB_CHECK_IS_ON()
-    : store_(store)
-#endif  // BERRYDB_CHECK_IS_ON()
-    {
+FreePageManager::FreePageManager(StoreImpl* store) : store_(store) {
   BERRYDB_ASSUME(store != nullptr);
 }
 
 FreePageManager::~FreePageManager() = default;
 
 size_t FreePageManager::AllocPage(
-    MAYBE_UNUSED TransactionImpl* transaction,
+    TransactionImpl* transaction,
     MAYBE_UNUSED TransactionImpl* alloc_transaction) {
+  return AllocPages(1, transaction, alloc_transaction);
+}
+
+size_t FreePageManager::AllocPages(
+    size_t page_count, TransactionImpl* transaction,
+    MAYBE_UNUSED TransactionImpl* alloc_transaction) {
+  BERRYDB_ASSUME_GT(page_count, 0U);
 #if BERRYDB_CHECK_IS_ON()
   BERRYDB_CHECK_EQ(store_, transaction->store());
   BERRYDB_CHECK_EQ(store_, alloc_transaction->store());
 #endif  // BERRYDB_CHECK_IS_ON()
 
-  // TODO(pwnall): Check for free pages scoped to the transaction.
+  const size_t first_page_id = TakeFreeRun(page_count);
+  if (first_page_id == kInvalidPageId)
+    return AllocNewPages(page_count, transaction, alloc_transaction);
 
-  // TODO(pwnall): Check for free pages scoped to the store.
-  // TODO(pwnall): Write the new header to the db using alloc_transaction.
+  transaction->PagesAllocated(first_page_id, page_count);
+  return first_page_id;
+}
 
-  return kInvalidPageId;
+size_t FreePageManager::AllocNewPages(
+    size_t page_count, TransactionImpl* transaction,
+    MAYBE_UNUSED TransactionImpl* alloc_transaction) {
+  BERRYDB_ASSUME_GT(page_count, 0U);
+#if BERRYDB_CHECK_IS_ON()
+  BERRYDB_CHECK_EQ(store_, transaction->store());
+  BERRYDB_CHECK_EQ(store_, alloc_transaction->store());
+#endif  // BERRYDB_CHECK_IS_ON()
+
+  // Growing the store is always possible. The page count is saved in the
+  // store's header by checkpoints, and recovery derives it from the log, so it
+  // doesn't need to be logged here. Pages past the end of the store are always
+  // consecutive.
+  const size_t first_page_id =
+      page_count_.fetch_add(page_count, std::memory_order_relaxed);
+  if (UNLIKELY(first_page_id + page_count < first_page_id))
+    return kInvalidPageId;
+
+  transaction->PagesAllocated(first_page_id, page_count);
+  return first_page_id;
+}
+
+void FreePageManager::ReturnUnusedPages(
+    size_t first_page_id, size_t page_count, TransactionImpl* transaction,
+    MAYBE_UNUSED TransactionImpl* alloc_transaction) {
+#if BERRYDB_CHECK_IS_ON()
+  BERRYDB_CHECK_EQ(store_, transaction->store());
+  BERRYDB_CHECK_EQ(store_, alloc_transaction->store());
+#endif  // BERRYDB_CHECK_IS_ON()
+  BERRYDB_ASSUME_NE(first_page_id, kInvalidPageId);
+
+  transaction->PagesReturned(first_page_id, page_count);
+
+  // The store shrinks back if nothing was allocated after the run. Otherwise,
+  // the pages were never used, so they can be handed out right away.
+  size_t run_end = first_page_id + page_count;
+  if (!page_count_.compare_exchange_strong(run_end, first_page_id,
+                                           std::memory_order_relaxed)) {
+    AddFreeRun(first_page_id, page_count);
+  }
 }
 
 Status FreePageManager::FreePage(
-    MAYBE_UNUSED size_t page_id, MAYBE_UNUSED TransactionImpl *transaction,
-    MAYBE_UNUSED TransactionImpl *alloc_transaction) {
+    size_t page_id, TransactionImpl* transaction,
+    TransactionImpl* alloc_transaction) {
+  return FreePages(page_id, 1, transaction, alloc_transaction);
+}
+
+Status FreePageManager::FreePages(
+    size_t first_page_id, size_t page_count, TransactionImpl* transaction,
+    MAYBE_UNUSED TransactionImpl* alloc_transaction) {
+  BERRYDB_ASSUME_GT(page_count, 0U);
+  BERRYDB_ASSUME_NE(first_page_id, kInvalidPageId);
+  BERRYDB_ASSUME_LE(first_page_id + page_count, page_count_.load());
+#if BERRYDB_CHECK_IS_ON()
+  BERRYDB_CHECK_EQ(store_, transaction->store());
+  BERRYDB_CHECK_EQ(store_, alloc_transaction->store());
+#endif  // BERRYDB_CHECK_IS_ON()
+
+  transaction->WillFreePages(first_page_id, page_count);
+  return Status::kSuccess;
+}
+
+void FreePageManager::TransactionClosed(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction->IsClosed());
+
+  if (transaction->IsCommitted()) {
+    const uint64_t commit_timestamp = transaction->commit_timestamp();
+    for (const PageRun& run : transaction->freed_page_runs())
+      freed_runs_.push_back({run, commit_timestamp});
+    return;
+  }
 
-  return Status::kIoError;
+  for (const PageRun& run : transaction->allocated_page_runs()) {
+    if (run.page_count != 0)
+      AddFreeRun(run.first_page_id, run.page_count);
+  }
+}
+
+void FreePageManager::ReleaseFreedPages(uint64_t oldest_snapshot) {
+  // A snapshot taken right after a commit does not see the freed pages.
+  auto it = freed_runs_.begin();
+  while (it != freed_runs_.end() && it->commit_timestamp <= oldest_snapshot) {
+    AddFreeRun(it->run.first_page_id, it->run.page_count);
+    ++it;
+  }
+  freed_runs_.erase(freed_runs_.begin(), it);
+}
+
+Status FreePageManager::ReadList(size_t head_page_id) {
+  BERRYDB_ASSUME(free_runs_.empty());
+  BERRYDB_ASSUME(list_pages_.empty());
+
+  if (head_page_id == kInvalidPageId)
+    return Status::kSuccess;
+
+  const size_t page_size = store_->page_pool()->page_size();
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  const span<uint8_t> page_data(buffer, page_size);
+
+  // A list page can't hold fewer than one entry, so a list that is longer than
+  // the store has a cycle.
+  const size_t page_count = page_count_.load(std::memory_order_relaxed);
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids;
+  Status status = Status::kSuccess;
+  size_t page_id = head_page_id;
+  while (page_id != kInvalidPageId) {
+    if (UNLIKELY(page_id >= page_count || list_pages_.size() >= page_count)) {
+      status = Status::kDataCorrupted;
+      break;
+    }
+    status = store_->ReadDataFilePage(page_id, page_data);
+    if (UNLIKELY(status != Status::kSuccess))
+      break;
+    list_pages_.push_back(page_id);
+
+    const size_t end_offset = FreePageListFormat::NextEntryOffset(page_data);
+    if (UNLIKELY(end_offset < FreePageListFormat::kFirstEntryOffset ||
+                 end_offset > page_size ||
+                 (end_offset & (FreePageListFormat::kEntrySize - 1)) != 0)) {
+      status = Status::kDataCorrupted;
+      break;
+    }
+    for (size_t offset = FreePageListFormat::kFirstEntryOffset;
+         offset < end_offset; offset += FreePageListFormat::kEntrySize) {
+      const uint64_t entry64 = LoadUint64(
+          page_data.subspan(offset, FreePageListFormat::kEntrySize));
+      if (UNLIKELY(entry64 == kInvalidPageId || entry64 >= page_count)) {
+        status = Status::kDataCorrupted;
+        break;
+      }
+      page_ids.push_back(static_cast<size_t>(entry64));
+    }
+    if (UNLIKELY(status != Status::kSuccess))
+      break;
+
+    const uint64_t next_page_id64 = FreePageListFormat::NextPageId64(page_data);
+    page_id = static_cast<size_t>(next_page_id64);
+    if (UNLIKELY(page_id != next_page_id64)) {
+      status = Status::kDatabaseTooLarge;
+      break;
+    }
+  }
+  Deallocate(buffer, page_size);
+
+  if (LIKELY(status == Status::kSuccess)) {
+    // The list pages hold the list, so they can't be on it. Each free page
+    // must be on the list once.
+    page_ids.insert(page_ids.end(), list_pages_.begin(), list_pages_.end());
+    std::sort(page_ids.begin(), page_ids.end());
+    if (UNLIKELY(std::adjacent_find(page_ids.begin(), page_ids.end()) !=
+                 page_ids.end())) {
+      status = Status::kDataCorrupted;
+    }
+  }
+  if (UNLIKELY(status != Status::kSuccess)) {
+    list_pages_.clear();
+    return status;
+  }
+
+  // The IDs are sorted, so each page extends the last run or starts a new one.
+  for (size_t free_page_id : page_ids) {
+    if (!free_runs_.empty() && free_runs_.back().first_page_id +
+                               free_runs_.back().page_count == free_page_id) {
+      ++free_runs_.back().page_count;
+    } else {
+      free_runs_.push_back({free_page_id, 1});
+    }
+  }
+  free_page_count_ = page_ids.size();
+  RemovePages(span<const size_t>(list_pages_.data(), list_pages_.size()));
+  return Status::kSuccess;
+}
+
+void FreePageManager::RemovePages(span<const size_t> page_ids) {
+  for (size_t page_id : page_ids) {
+    auto it = RunAfter(page_id);
+    if (it == free_runs_.begin())
+      continue;
+    --it;
+    const size_t run_end = it->first_page_id + it->page_count;
+    if (page_id >= run_end)
+      continue;
+
+    // The page splits its run in two. Either half may be empty.
+    const PageRun before = {it->first_page_id, page_id - it->first_page_id};
+    const PageRun after = {page_id + 1, run_end - page_id - 1};
+    it = free_runs_.erase(it);
+    if (after.page_count != 0)
+      it = free_runs_.insert(it, after);
+    if (before.page_count != 0)
+      free_runs_.insert(it, before);
+    --free_page_count_;
+  }
+}
+
+std::tuple<Status, size_t> FreePageManager::WriteList() {
+  // The pages of a list written by a failed checkpoint are free again.
+  for (size_t page_id : written_list_pages_)
+    AddFreeRun(page_id, 1);
+  written_list_pages_.clear();
+
+  // After a restart, the pages waiting for old snapshots and the pages holding
+  // the current list will be free.
+  size_t entry_count = free_page_count_ + list_pages_.size();
+  for (const FreedPageRun& freed_run : freed_runs_)
+    entry_count += freed_run.run.page_count;
+  if (entry_count == 0)
+    return {Status::kSuccess, kInvalidPageId};
+
+  const size_t page_size = store_->page_pool()->page_size();
+  const size_t entries_per_page =
+      (page_size - FreePageListFormat::kFirstEntryOffset) /
+      FreePageListFormat::kEntrySize;
+  const size_t list_page_count =
+      (entry_count + entries_per_page - 1) / entries_per_page;
+
+  // The list pages are taken from the free pages, so they are not entries. The
+  // store grows if there aren't enough free pages. The pool may cache stale
+  // copies of the list pages, which is harmless, because the content of free
+  // pages is never read.
+  written_list_pages_.reserve(list_page_count);
+  while (written_list_pages_.size() < list_page_count) {
+    size_t page_id = TakeFreeRun(1);
+    if (page_id == kInvalidPageId)
+      page_id = page_count_.fetch_add(1, std::memory_order_relaxed);
+    written_list_pages_.push_back(page_id);
+  }
+
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  const span<uint8_t> page_data(buffer, page_size);
+
+  // The list pages are filled in reverse order, because each page points to
+  // the page filled before it.
+  Status status = Status::kSuccess;
+  size_t list_page_index = written_list_pages_.size();
+  size_t next_page_id = kInvalidPageId;
+  size_t offset = FreePageListFormat::kFirstEntryOffset;
+  auto flush_page = [&]() {
+    --list_page_index;
+    const size_t page_id = written_list_pages_[list_page_index];
+    FillSpan(page_data.subspan(offset), 0);
+    FreePageListFormat::SetNextEntryOffset(offset, page_data);
+    FreePageListFormat::SetNextPageId64(next_page_id, page_data);
+    if (LIKELY(status == Status::kSuccess))
+      status = store_->WriteDataFilePages(page_id, page_data);
+    next_page_id = page_id;
+    offset = FreePageListFormat::kFirstEntryOffset;
+  };
+  auto add_entries = [&](size_t first_page_id, size_t page_count) {
+    for (size_t i = 0; i < page_count; ++i) {
+      if (offset == page_size)
+        flush_page();
+      StoreUint64(static_cast<uint64_t>(first_page_id + i),
+                  page_data.subspan(offset, FreePageListFormat::kEntrySize));
+      offset += FreePageListFormat::kEntrySize;
+    }
+  };
+  for (const PageRun& free_run : free_runs_)
+    add_entries(free_run.first_page_id, free_run.page_count);
+  for (const FreedPageRun& freed_run : freed_runs_)
+    add_entries(freed_run.run.first_page_id, freed_run.run.page_count);
+  for (size_t page_id : list_pages_)
+    add_entries(page_id, 1);
+  // Taking the list pages out of the free pages may leave the last list pages
+  // without entries.
+  while (list_page_index != 0)
+    flush_page();
+
+  Deallocate(buffer, page_size);
+  return {status, next_page_id};
+}
+
+void FreePageManager::ListWritten() {
+  for (size_t page_id : list_pages_)
+    AddFreeRun(page_id, 1);
+  list_pages_.swap(written_list_pages_);
+  written_list_pages_.clear();
+}
+
+void FreePageManager::AddFreeRun(size_t first_page_id, size_t page_count) {
+  BERRYDB_ASSUME_GT(page_count, 0U);
+
+  auto next = RunAfter(first_page_id);
+  BERRYDB_ASSUME(next == free_runs_.end() ||
+                 next->first_page_id >= first_page_id + page_count);
+  free_page_count_ += page_count;
+
+  // The new run is merged with its neighbors when they are adjacent.
+  if (next != free_runs_.begin()) {
+    PageRun& previous = *std::prev(next);
+    BERRYDB_ASSUME_LE(previous.first_page_id + previous.page_count,
+                      first_page_id);
+    if (previous.first_page_id + previous.page_count == first_page_id) {
+      previous.page_count += page_count;
+      if (next != free_runs_.end() &&
+          next->first_page_id == first_page_id + page_count) {
+        previous.page_count += next->page_count;
+        free_runs_.erase(next);
+      }
+      return;
+    }
+  }
+  if (next != free_runs_.end() &&
+      next->first_page_id == first_page_id + page_count) {
+    next->first_page_id = first_page_id;
+    next->page_count += page_count;
+    return;
+  }
+  free_runs_.insert(next, {first_page_id, page_count});
+}
+
+std::vector<FreePageManager::PageRun,
+            PlatformAllocator<FreePageManager::PageRun>>::iterator
+FreePageManager::RunAfter(size_t page_id) noexcept {
+  return std::upper_bound(
+      free_runs_.begin(), free_runs_.end(), page_id,
+      [](size_t id, const PageRun& run) { return id < run.first_page_id; });
+}
+
+size_t FreePageManager::TakeFreeRun(size_t page_count) {
+  BERRYDB_ASSUME_GT(page_count, 0U);
+
+  // First fit favors low page IDs, so the pages at the store's end are the
+  // most likely to stay free.
+  for (auto it = free_runs_.begin(); it != free_runs_.end(); ++it) {
+    if (it->page_count < page_count)
+      continue;
+
+    const size_t first_page_id = it->first_page_id;
+    if (it->page_count == page_count) {
+      free_runs_.erase(it);
+    } else {
+      it->first_page_id += page_count;
+      it->page_count -= page_count;
+    }
+    free_page_count_ -= page_count;
+    return first_page_id;
+  }
+  return kInvalidPageId;
 }
 
 }  // namespace berrydb
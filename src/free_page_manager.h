@@ -5,7 +5,13 @@
 #ifndef BERRYDB_FREE_PAGE_MANAGER_H
 #define BERRYDB_FREE_PAGE_MANAGER_H
 
+#include <atomic>
+#include <tuple>
+#include <vector>
+
+#include "berrydb/span.h"
 #include "./util/checks.h"
+#include "./util/platform_allocator.h"
 
 namespace berrydb {
 
@@ -21,6 +27,18 @@ class TransactionImpl;
  * of pages. Instead, the page IDs for free pages are stored in a list, so they
  * can be reused. The free page list entries are stored in pages that are
  * exclusively allocated for this purpose.
+ *
+ * While the store is open, the free pages are tracked in memory, as runs of
+ * consecutive pages sorted by page ID, so runs can be handed out to large
+ * values. Checkpoints write the list to free pages, in the format described by
+ * FreePageListFormat, and point the store header at the list's head page. The
+ * pages holding the list are not handed out until the next checkpoint replaces
+ * the list, so a crash always leaves behind the list named by the header.
+ *
+ * A page freed by a transaction may still be read by the read transactions
+ * whose snapshots predate the transaction's commit, so it is only reused after
+ * these snapshots are gone. Pages freed after the last checkpoint are not on
+ * the persisted list, so they are leaked if the store is not closed cleanly.
  */
 class FreePageManager {
  public:
@@ -43,6 +61,12 @@ class FreePageManager {
    */
   static constexpr size_t kInvalidPageId = 0;
 
+  /** A run of consecutive pages. */
+  struct PageRun {
+    size_t first_page_id;
+    size_t page_count;
+  };
+
   /** Allocates a page and assigns it to a transaction.
    *
    * The page allocation is bound to the given transaction's lifecycle. The page
@@ -63,6 +87,52 @@ class FreePageManager {
   size_t AllocPage(TransactionImpl* transaction,
                    TransactionImpl* alloc_transaction);
 
+  /** Allocates a run of consecutive pages and assigns it to a transaction.
+   *
+   * Runs hold data that is read sequentially, such as large values, so the data
+   * can be read using a few large I/O operations. The allocation is bound to
+   * the transaction's lifecycle, like in AllocPage().
+   *
+   * @param  page_count        the number of pages in the run; must be positive
+   * @param  transaction       the transaction that will use the pages
+   * @param  alloc_transaction the transaction used to change allocation data
+   * @return                   the ID of the run's first page, or
+   *                           kInvalidPageId if the allocation fails
+   */
+  size_t AllocPages(size_t page_count, TransactionImpl* transaction,
+                    TransactionImpl* alloc_transaction);
+
+  /** Allocates a run of pages that were never used by the store.
+   *
+   * The run is carved out of the end of the store, like when the free list is
+   * empty. The pages are not cached by the page pool, and the log has no
+   * records for them, so they can be written straight to the data file. This
+   * is used by the bulk loader, which bypasses the pool and the log. The
+   * allocation is bound to the transaction's lifecycle, like in AllocPage().
+   *
+   * @param  page_count        the number of pages in the run; must be positive
+   * @param  transaction       the transaction that will use the pages
+   * @param  alloc_transaction the transaction used to change allocation data
+   * @return                   the ID of the run's first page, or
+   *                           kInvalidPageId if the allocation fails
+   */
+  size_t AllocNewPages(size_t page_count, TransactionImpl* transaction,
+                       TransactionImpl* alloc_transaction);
+
+  /** Gives back the unused pages at the end of a run obtained by AllocPages().
+   *
+   * This is used by callers that allocate runs before knowing how many pages
+   * they will need. The pages must not have been used.
+   *
+   * @param first_page_id     the ID of the first page that was not used
+   * @param page_count        the number of unused pages at the end of the run
+   * @param transaction       the transaction that allocated the run
+   * @param alloc_transaction the transaction used to change allocation data
+   */
+  void ReturnUnusedPages(size_t first_page_id, size_t page_count,
+                         TransactionImpl* transaction,
+                         TransactionImpl* alloc_transaction);
+
   /** Queues up a page to be freed when a transaction commits.
    *
    * The free operation is bound to the given transaction's lifecycle. The page
@@ -78,10 +148,143 @@ class FreePageManager {
                   TransactionImpl* transaction,
                   TransactionImpl* alloc_transaction);
 
+  /** Queues up a run of pages to be freed when a transaction commits.
+   *
+   * This is the equivalent of calling FreePage() for each page in the run.
+   *
+   * @param  first_page_id     the ID of the run's first page
+   * @param  page_count        the number of pages in the run; must be positive
+   * @param  transaction       the transaction whose commit will free the pages
+   * @param  alloc_transaction the transaction used to change allocation data
+   * @return                   most likely kSuccess or kIoError
+   */
+  Status FreePages(size_t first_page_id, size_t page_count,
+                   TransactionImpl* transaction,
+                   TransactionImpl* alloc_transaction);
+
+  /** Settles the allocations and frees of a transaction that was closed.
+   *
+   * The pages freed by a committed transaction become available once no read
+   * snapshot predates the transaction's commit. The pages allocated by a rolled
+   * back transaction are available right away, because they were never visible
+   * outside the transaction.
+   *
+   * @param transaction a transaction that was just committed or rolled back
+   */
+  void TransactionClosed(TransactionImpl* transaction);
+
+  /** Makes available the pages freed by commits that no snapshot predates.
+   *
+   * @param oldest_snapshot the snapshot of the oldest read transaction, or
+   *                        PageVersions::kPendingTimestamp if there are none
+   */
+  void ReleaseFreedPages(uint64_t oldest_snapshot);
+
+  /** Loads the free page list persisted by the last checkpoint.
+   *
+   * Called when the store is opened, after set_page_count().
+   *
+   * @param  head_page_id the ID of the list's head page, from the store header;
+   *                      kInvalidPageId if the list is empty
+   * @return              most likely kSuccess or kIoError; kDataCorrupted if
+   *                      the list is inconsistent
+   */
+  Status ReadList(size_t head_page_id);
+
+  /** Takes pages out of the free list loaded by ReadList().
+   *
+   * Called by recovery with the pages written by the replayed transactions,
+   * which may have been allocated after the list was persisted.
+   *
+   * @param page_ids sorted IDs of pages that must not be handed out
+   */
+  void RemovePages(span<const size_t> page_ids);
+
+  /** Writes the free page list to the data file. Called by checkpoints.
+   *
+   * The list is written to free pages. The caller must sync the data file, then
+   * write a store header that points to the list, and then call ListWritten().
+   *
+   * @return status       most likely kSuccess or kIoError
+   * @return head_page_id the ID of the list's head page, or kInvalidPageId if
+   *                      there are no free pages
+   */
+  std::tuple<Status, size_t> WriteList();
+
+  /** Called after the list written by WriteList() is named by the header.
+   *
+   * The pages holding the previous list become available. */
+  void ListWritten();
+
+  /** The number of pages that can be handed out without growing the store.
+   *
+   * Pages freed by transactions are only counted after they are released. */
+  inline constexpr size_t free_page_count() const noexcept {
+    return free_page_count_;
+  }
+
+  /** One past the largest page ID handed out by AllocPage().
+   *
+   * The store's header persists this number at checkpoints. */
+  inline size_t page_count() const noexcept {
+    return page_count_.load(std::memory_order_relaxed);
+  }
+
+  /** Sets the number of pages in use. Called when the store is opened.
+   *
+   * @param page_count the number of pages used by the store's data; must be
+   *                   positive, because the header page is always used
+   */
+  inline void set_page_count(size_t page_count) noexcept {
+    BERRYDB_ASSUME_GT(page_count, kInvalidPageId);
+    page_count_.store(page_count, std::memory_order_relaxed);
+  }
+
  private:
-#if BERRYDB_CHECK_IS_ON()
-  const StoreImpl* store_;
-#endif  // BERRYDB_CHECK_IS_ON()
+  /** Pages freed by a committed transaction, waiting for old snapshots. */
+  struct FreedPageRun {
+    PageRun run;
+    /** The commit timestamp of the transaction that freed the pages. */
+    uint64_t commit_timestamp;
+  };
+
+  /** Makes a run of pages available. The run must not overlap free pages. */
+  void AddFreeRun(size_t first_page_id, size_t page_count);
+
+  /** The first run of available pages that starts after the given page. */
+  std::vector<PageRun, PlatformAllocator<PageRun>>::iterator RunAfter(
+      size_t page_id) noexcept;
+
+  /** Takes a run of pages out of the available pages.
+   *
+   * @return the ID of the run's first page, or kInvalidPageId if there is no
+   *         run of the given size */
+  size_t TakeFreeRun(size_t page_count);
+
+  StoreImpl* const store_;
+
+  /** See page_count(). Atomic so concurrent transactions can allocate. */
+  std::atomic<size_t> page_count_{1};
+
+  /** The pages that can be handed out, as runs sorted by their first page ID.
+   *
+   * Adjacent runs are merged, so each run is as long as possible. */
+  std::vector<PageRun, PlatformAllocator<PageRun>> free_runs_;
+
+  /** See free_page_count(). */
+  size_t free_page_count_ = 0;
+
+  /** Pages freed by committed transactions, from oldest to newest commit. */
+  std::vector<FreedPageRun, PlatformAllocator<FreedPageRun>> freed_runs_;
+
+  /** The pages holding the free list named by the store header. */
+  std::vector<size_t, PlatformAllocator<size_t>> list_pages_;
+
+  /** The pages holding the list written by the last WriteList() call.
+   *
+   * They replace list_pages_ when ListWritten() is called. If the checkpoint
+   * fails before that, they are reclaimed by the next WriteList() call. */
+  std::vector<size_t, PlatformAllocator<size_t>> written_list_pages_;
 };
 
 }  // namespace berrydb
@@ -0,0 +1,914 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./hash_table.h"
+
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree_node.h"
+#include "./free_page_manager.h"
+#include "./overflow_value.h"
+#include "./page_pool.h"
+#include "./pinned_page.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/endianness.h"
+#include "./util/key_hash.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kLevelOffset = 0;
+constexpr size_t kSplitOffset = 8;
+constexpr size_t kSegmentsOffset = 16;
+
+/** The highest level that a table can reach.
+ *
+ * The header must have room for the segments of the level's buckets, and for
+ * the segment that receives the buckets split off at that level. Bucket
+ * indexes must fit in size_t.
+ */
+constexpr size_t MaxLevel(size_t page_size) noexcept {
+  return ((page_size - kSegmentsOffset) / 8 - 2 < sizeof(size_t) * 8 - 2)
+      ? (page_size - kSegmentsOffset) / 8 - 2 : sizeof(size_t) * 8 - 2;
+}
+
+/** Allocates and pins a page that will be added to a bucket's chain. */
+std::tuple<Status, Page*> AllocTablePage(TransactionImpl* transaction) {
+  StoreImpl* const store = transaction->store();
+  const size_t page_id =
+      store->free_page_manager()->AllocPage(transaction, transaction);
+  if (UNLIKELY(page_id == FreePageManager::kInvalidPageId))
+    return {Status::kIoError, nullptr};
+  return store->page_pool()->StorePage(store, page_id,
+                                       PagePool::kIgnorePageData);
+}
+
+/** True if a page cannot be a part of a bucket's chain.
+ *
+ * Bucket pages are leaves without a key prefix. */
+bool IsBucketCorrupt(span<const uint8_t> node) noexcept {
+  return BTreeNode::IsCorrupt(node) ||
+         BTreeNode::NodeType(node) != BTreeNode::Type::kLeaf ||
+         !BTreeNode::Prefix(node).empty();
+}
+
+/** Reads a table's level and split pointer from its header page.
+ *
+ * @return status kSuccess or kDataCorrupted
+ * @return level  the table has at least 2^level buckets
+ * @return split  the number of buckets split at the current level
+ */
+std::tuple<Status, size_t, size_t> DecodeHeader(span<const uint8_t> header)
+    noexcept {
+  const size_t level = LoadUint32(header.subspan(kLevelOffset, 4));
+  if (UNLIKELY(level > MaxLevel(header.size())))
+    return {Status::kDataCorrupted, 0, 0};
+  const uint64_t split64 = LoadUint64(header.subspan(kSplitOffset, 8));
+  if (UNLIKELY(split64 >= (static_cast<uint64_t>(1) << level)))
+    return {Status::kDataCorrupted, 0, 0};
+  return {Status::kSuccess, level, static_cast<size_t>(split64)};
+}
+
+/** Computes the ID of a bucket's first page.
+ *
+ * @param  store  the store that holds the table
+ * @param  header the table's header page
+ * @param  bucket the bucket's index; the bucket's segment must be allocated
+ * @return        the page ID, or 0 if the header is corrupted
+ */
+size_t BucketPageId(StoreImpl* store, span<const uint8_t> header,
+                    size_t bucket) noexcept {
+  size_t segment = 0, segment_bucket = 0;
+  if (bucket != 0) {
+    segment = 1;
+    segment_bucket = 1;
+    while (bucket - segment_bucket >= segment_bucket) {
+      segment_bucket <<= 1;
+      ++segment;
+    }
+  }
+  const uint64_t segment_page_id64 =
+      LoadUint64(header.subspan(kSegmentsOffset + segment * 8, 8));
+  return BTree::CheckedChildId(
+      store, segment_page_id64 + (bucket - segment_bucket));
+}
+
+/** Computes the ID of the first page in a key's bucket.
+ *
+ * @param  store   the store that holds the table
+ * @param  header  the table's header page
+ * @param  key     the key whose bucket is computed
+ * @return status  kSuccess or kDataCorrupted
+ * @return page_id the ID of the bucket's first page
+ */
+std::tuple<Status, size_t> KeyBucketPageId(
+    StoreImpl* store, span<const uint8_t> header, span<const uint8_t> key)
+    noexcept {
+  Status status;
+  size_t level, split;
+  std::tie(status, level, split) = DecodeHeader(header);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+
+  // Buckets below the split pointer were split at this level, so their keys
+  // are spread over twice as many buckets.
+  const uint64_t hash = KeyHash(key);
+  const uint64_t mask = (static_cast<uint64_t>(1) << level) - 1;
+  size_t bucket = static_cast<size_t>(hash & mask);
+  if (bucket < split)
+    bucket = static_cast<size_t>(hash & ((mask << 1) | 1));
+
+  const size_t page_id = BucketPageId(store, header, bucket);
+  if (UNLIKELY(page_id == 0))
+    return {Status::kDataCorrupted, 0};
+  return {Status::kSuccess, page_id};
+}
+
+/** Finds the page in a bucket's chain that holds a key.
+ *
+ * @param  transaction    the transaction whose view of the table is used
+ * @param  bucket_page_id the ID of the bucket's first page
+ * @param  key            the key to look for
+ * @return status         kNotFound if the bucket does not contain the key;
+ *                        otherwise, most likely kSuccess or kIoError
+ * @return page           the pool page holding the key's entry; the caller
+ *                        owns a pin on the page
+ * @return index          the index of the key's entry in the page
+ */
+std::tuple<Status, Page*, size_t> FindEntry(
+    TransactionImpl* transaction, size_t bucket_page_id,
+    span<const uint8_t> key) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  // Chains can't have more pages than the store, so longer chains have cycles.
+  const size_t max_chain_size = store->free_page_manager()->page_count();
+  size_t page_id = bucket_page_id;
+  for (size_t chain_size = 0; chain_size < max_chain_size; ++chain_size) {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, nullptr, 0};
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> node =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(IsBucketCorrupt(node)))
+      return {Status::kDataCorrupted, nullptr, 0};
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, nullptr, 0};
+    if (found) {
+      // The caller takes over the pin.
+      page_pool->PinStorePage(raw_page);
+      return {Status::kSuccess, raw_page, index};
+    }
+
+    const uint64_t next_page_id64 = BTreeNode::Link64(node);
+    if (next_page_id64 == 0)
+      return {Status::kNotFound, nullptr, 0};
+    page_id = BTree::CheckedChildId(store, next_page_id64);
+    if (UNLIKELY(page_id == 0))
+      return {Status::kDataCorrupted, nullptr, 0};
+  }
+  return {Status::kDataCorrupted, nullptr, 0};
+}
+
+/** Adds an entry to the end of a bucket's chain, while a bucket is split.
+ *
+ * @param  transaction    the transaction that splits the bucket
+ * @param  tail_page_id   the ID of the chain's last page; updated if the chain
+ *                        grows
+ * @param  spare_page_ids pages from the split bucket's old chain, which are
+ *                        reused before new pages are allocated
+ * @param  key            the entry's key
+ * @param  value          the value stored in the bucket
+ * @param  is_overflow    true if the value is a reference to overflow pages
+ * @return                kSuccess, kDataCorrupted, or an I/O error
+ */
+Status AppendEntry(
+    TransactionImpl* transaction, size_t* tail_page_id,
+    std::vector<size_t, PlatformAllocator<size_t>>* spare_page_ids,
+    span<const uint8_t> key, span<const uint8_t> value, bool is_overflow) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  Status status;
+  Page* raw_tail_page;
+  std::tie(status, raw_tail_page) = store->FetchPage(*tail_page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage tail_page(raw_tail_page, page_pool);
+
+  const span<uint8_t> tail_node =
+      transaction->MutablePageData(tail_page.get(), page_size);
+  bool found;
+  size_t index;
+  std::tie(status, found, index) = BTreeNode::LeafFind(tail_node, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  BERRYDB_ASSUME(!found);
+  if (BTreeNode::LeafInsert(tail_node, index, key, value, is_overflow))
+    return Status::kSuccess;
+
+  Page* raw_page;
+  if (!spare_page_ids->empty()) {
+    // The spare pages hold data that older snapshots may read, so they must be
+    // modified like any other page.
+    std::tie(status, raw_page) = store->FetchPage(spare_page_ids->back());
+    spare_page_ids->pop_back();
+  } else {
+    std::tie(status, raw_page) = AllocTablePage(transaction);
+  }
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<uint8_t> node =
+      transaction->MutablePageData(page.get(), page_size);
+  BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+  const bool inserted = BTreeNode::LeafInsert(node, 0, key, value,
+                                              is_overflow);
+  BERRYDB_ASSUME(inserted);
+  BTreeNode::SetLink64(page->page_id(), tail_node);
+  *tail_page_id = page->page_id();
+  return Status::kSuccess;
+}
+
+/** An entry copied out of a bucket that is being split. */
+struct SplitEntry {
+  /** The position of the entry's key in the buffer holding the copies. */
+  size_t offset;
+  size_t key_size;
+  /** The value follows the key in the buffer holding the copies. */
+  size_t value_size;
+  bool is_overflow;
+};
+
+}  // namespace
+
+// static
+std::tuple<Status, size_t> HashTable::Create(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  PagePool* const page_pool = transaction->store()->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+  Page* raw_bucket_page;
+  std::tie(status, raw_bucket_page) = AllocTablePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage bucket_page(raw_bucket_page, page_pool);
+  BTreeNode::Initialize(
+      BTreeNode::Type::kLeaf, 0,
+      transaction->NewPageData(bucket_page.get(), page_size));
+
+  Page* raw_header_page;
+  std::tie(status, raw_header_page) = AllocTablePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage header_page(raw_header_page, page_pool);
+  const span<uint8_t> header =
+      transaction->NewPageData(header_page.get(), page_size);
+  FillSpan(header, 0);
+  StoreUint64(bucket_page->page_id(), header.subspan(kSegmentsOffset, 8));
+  return {Status::kSuccess, header_page->page_id()};
+}
+
+std::tuple<Status, size_t> HashTable::FindBucket(
+    TransactionImpl* transaction, span<const uint8_t> key) const {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  Status status;
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(header_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage page(raw_page, page_pool);
+
+  return KeyBucketPageId(
+      store, transaction->PageData(page.get(), page_pool->page_size()), key);
+}
+
+Status HashTable::Get(TransactionImpl* transaction, span<const uint8_t> key,
+                      ValueBuffer* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, value);
+  if (UNLIKELY(status != Status::kSuccess) || !is_overflow)
+    return status;
+  return OverflowValue::ReadReferencedValue(transaction, value);
+}
+
+Status HashTable::Get(ReadTransactionImpl* transaction,
+                      span<const uint8_t> key, ValueBuffer* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, value);
+  if (UNLIKELY(status != Status::kSuccess) || !is_overflow)
+    return status;
+  return OverflowValue::ReadReferencedValue(transaction, value);
+}
+
+std::tuple<Status, size_t> HashTable::ReadValue(
+    TransactionImpl* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  ValueBuffer entry_value;
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, &entry_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  return OverflowValue::ReadEntryValueRange(
+      transaction, span<const uint8_t>(entry_value.data(), entry_value.size()),
+      is_overflow, offset, buffer);
+}
+
+std::tuple<Status, size_t> HashTable::ReadValue(
+    ReadTransactionImpl* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  ValueBuffer entry_value;
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) = FindValue(transaction, key, &entry_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  return OverflowValue::ReadEntryValueRange(
+      transaction, span<const uint8_t>(entry_value.data(), entry_value.size()),
+      is_overflow, offset, buffer);
+}
+
+std::tuple<Status, bool> HashTable::FindValue(
+    TransactionImpl* transaction, span<const uint8_t> key,
+    ValueBuffer* value) const {
+  Status status;
+  size_t bucket_page_id;
+  std::tie(status, bucket_page_id) = FindBucket(transaction, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+
+  PagePool* const page_pool = transaction->store()->page_pool();
+  Page* raw_page;
+  size_t index;
+  std::tie(status, raw_page, index) =
+      FindEntry(transaction, bucket_page_id, key);
+  if (status != Status::kSuccess)
+    return {status, false};
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_pool->page_size());
+  const span<const uint8_t> entry_value = BTreeNode::LeafValue(node, index);
+  value->assign(entry_value.begin(), entry_value.end());
+  return {Status::kSuccess, BTreeNode::LeafHasOverflowValue(node, index)};
+}
+
+std::tuple<Status, bool> HashTable::FindValue(
+    ReadTransactionImpl* transaction, span<const uint8_t> key,
+    ValueBuffer* value) const {
+  StoreImpl* const store = transaction->store();
+
+  // Each ReadPage() call invalidates the data returned by the previous call,
+  // so the bucket's page ID must be computed before the bucket is read.
+  Status status;
+  span<const uint8_t> header;
+  std::tie(status, header) = transaction->ReadPage(header_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+  size_t page_id;
+  std::tie(status, page_id) = KeyBucketPageId(store, header, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+
+  // Chains can't have more pages than the store, so longer chains have cycles.
+  const size_t max_chain_size = store->free_page_manager()->page_count();
+  for (size_t chain_size = 0; chain_size < max_chain_size; ++chain_size) {
+    span<const uint8_t> node;
+    std::tie(status, node) = transaction->ReadPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, false};
+    if (UNLIKELY(IsBucketCorrupt(node)))
+      return {Status::kDataCorrupted, false};
+
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, false};
+    if (found) {
+      const span<const uint8_t> entry_value =
+          BTreeNode::LeafValue(node, index);
+      value->assign(entry_value.begin(), entry_value.end());
+      return {Status::kSuccess, BTreeNode::LeafHasOverflowValue(node, index)};
+    }
+
+    const uint64_t next_page_id64 = BTreeNode::Link64(node);
+    if (next_page_id64 == 0)
+      return {Status::kNotFound, false};
+    page_id = BTree::CheckedChildId(store, next_page_id64);
+    if (UNLIKELY(page_id == 0))
+      return {Status::kDataCorrupted, false};
+  }
+  return {Status::kDataCorrupted, false};
+}
+
+Status HashTable::Put(TransactionImpl* transaction, span<const uint8_t> key,
+                      span<const uint8_t> value) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (BTreeNode::FitsInLeaf(key.size(), value.size(), page_size))
+    return PutEntry(transaction, key, value, false);
+  return PutOverflow(transaction, key, value.size(), value);
+}
+
+Status HashTable::ReserveValue(TransactionImpl* transaction,
+                               span<const uint8_t> key, size_t value_size) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (BTreeNode::FitsInLeaf(key.size(), value_size, page_size)) {
+    const ValueBuffer zeros(value_size, 0);
+    return PutEntry(transaction, key,
+                    span<const uint8_t>(zeros.data(), zeros.size()), false);
+  }
+  return PutOverflow(transaction, key, value_size, span<const uint8_t>());
+}
+
+Status HashTable::WriteValue(TransactionImpl* transaction,
+                             span<const uint8_t> key, size_t offset,
+                             span<const uint8_t> data) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  Status status;
+  size_t bucket_page_id;
+  std::tie(status, bucket_page_id) = FindBucket(transaction, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Page* raw_page;
+  size_t index;
+  std::tie(status, raw_page, index) =
+      FindEntry(transaction, bucket_page_id, key);
+  if (status != Status::kSuccess)
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_size);
+  const span<const uint8_t> entry_value = BTreeNode::LeafValue(node, index);
+  if (BTreeNode::LeafHasOverflowValue(node, index)) {
+    // The bucket is not modified, because the reference stays the same.
+    size_t first_page_id, value_size;
+    std::tie(status, first_page_id, value_size) =
+        OverflowValue::DecodeReference(store, entry_value);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (UNLIKELY(offset > value_size || data.size() > value_size - offset))
+      return Status::kTooLarge;
+    return OverflowValue::Write(transaction, first_page_id, offset, data);
+  }
+
+  if (UNLIKELY(offset > entry_value.size() ||
+               data.size() > entry_value.size() - offset)) {
+    return Status::kTooLarge;
+  }
+  CopySpan(data, BTreeNode::LeafMutableValue(
+      transaction->MutablePageData(page.get(), page_size), index).subspan(
+          offset, data.size()));
+  return Status::kSuccess;
+}
+
+Status HashTable::PutOverflow(TransactionImpl* transaction,
+                              span<const uint8_t> key, size_t value_size,
+                              span<const uint8_t> data) {
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (UNLIKELY(!BTreeNode::FitsInLeaf(
+          key.size(), OverflowValue::kReferenceSize, page_size))) {
+    return Status::kTooLarge;
+  }
+
+  Status status;
+  size_t first_page_id;
+  std::tie(status, first_page_id) =
+      OverflowValue::Create(transaction, value_size, data);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  uint8_t reference[OverflowValue::kReferenceSize];
+  OverflowValue::EncodeReference(first_page_id, value_size,
+                                 span<uint8_t>(reference));
+  return PutEntry(transaction, key, span<const uint8_t>(reference), true);
+}
+
+Status HashTable::PutEntry(TransactionImpl* transaction,
+                           span<const uint8_t> key, span<const uint8_t> value,
+                           bool is_overflow) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  BERRYDB_ASSUME(BTreeNode::FitsInLeaf(key.size(), value.size(), page_size));
+
+  Status status;
+  size_t page_id;
+  std::tie(status, page_id) = FindBucket(transaction, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The chain is walked once, removing the key's old entry, and looking for a
+  // page with room for the new entry. Pages are only modified if they have the
+  // key.
+  size_t room_page_id = 0, last_page_id = 0;
+  const size_t max_chain_size = store->free_page_manager()->page_count();
+  for (size_t chain_size = 0; last_page_id == 0; ++chain_size) {
+    if (UNLIKELY(chain_size == max_chain_size))
+      return Status::kDataCorrupted;
+
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    span<const uint8_t> node = transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(IsBucketCorrupt(node)))
+      return Status::kDataCorrupted;
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (found) {
+      // The removed entry's index is the insertion point for the new entry.
+      if (BTreeNode::LeafHasOverflowValue(node, index)) {
+        status = OverflowValue::FreeReferencedValue(
+            transaction, BTreeNode::LeafValue(node, index));
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+      const span<uint8_t> mutable_node =
+          transaction->MutablePageData(page.get(), page_size);
+      BTreeNode::LeafRemove(mutable_node, index);
+      if (BTreeNode::LeafInsert(mutable_node, index, key, value, is_overflow))
+        return Status::kSuccess;
+      node = mutable_node;
+    }
+    if (room_page_id == 0 &&
+        BTreeNode::LeafHasRoom(node, key.size(), value.size())) {
+      room_page_id = page_id;
+    }
+
+    const uint64_t next_page_id64 = BTreeNode::Link64(node);
+    if (next_page_id64 == 0) {
+      last_page_id = page_id;
+    } else {
+      page_id = BTree::CheckedChildId(store, next_page_id64);
+      if (UNLIKELY(page_id == 0))
+        return Status::kDataCorrupted;
+    }
+  }
+
+  if (room_page_id != 0) {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(room_page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<uint8_t> node =
+        transaction->MutablePageData(page.get(), page_size);
+    bool found;
+    size_t index;
+    std::tie(status, found, index) = BTreeNode::LeafFind(node, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    BERRYDB_ASSUME(!found);
+    const bool inserted =
+        BTreeNode::LeafInsert(node, index, key, value, is_overflow);
+    BERRYDB_ASSUME(inserted);
+    return Status::kSuccess;
+  }
+
+  // All the pages in the bucket's chain are full, so the chain grows.
+  {
+    Page* raw_page;
+    std::tie(status, raw_page) = AllocTablePage(transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    const span<uint8_t> node = transaction->NewPageData(page.get(), page_size);
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0, node);
+    const bool inserted =
+        BTreeNode::LeafInsert(node, 0, key, value, is_overflow);
+    BERRYDB_ASSUME(inserted);
+
+    Page* raw_last_page;
+    std::tie(status, raw_last_page) = store->FetchPage(last_page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage last_page(raw_last_page, page_pool);
+    BTreeNode::SetLink64(
+        page->page_id(),
+        transaction->MutablePageData(last_page.get(), page_size));
+  }
+
+  // A growing chain means that the table is getting full, so it grows by a
+  // bucket. The bucket that is split is usually not the bucket whose chain
+  // grew, but every bucket gets split once per level.
+  return SplitBucket(transaction);
+}
+
+Status HashTable::SplitBucket(TransactionImpl* transaction) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  Status status;
+  Page* raw_header_page;
+  std::tie(status, raw_header_page) = store->FetchPage(header_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage header_page(raw_header_page, page_pool);
+
+  size_t level, split;
+  std::tie(status, level, split) =
+      DecodeHeader(transaction->PageData(header_page.get(), page_size));
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  // The header has no room for more segments. The table keeps working, but
+  // its chains get longer.
+  if (level == MaxLevel(page_size))
+    return Status::kSuccess;
+
+  const span<uint8_t> header =
+      transaction->MutablePageData(header_page.get(), page_size);
+  const size_t level_bucket_count = static_cast<size_t>(1) << level;
+  if (split == 0) {
+    // The first split at a level allocates the segment that receives all the
+    // buckets split off at the level.
+    const size_t segment_page_id = store->free_page_manager()->AllocPages(
+        level_bucket_count, transaction, transaction);
+    if (UNLIKELY(segment_page_id == FreePageManager::kInvalidPageId))
+      return Status::kIoError;
+    StoreUint64(segment_page_id,
+                header.subspan(kSegmentsOffset + (level + 1) * 8, 8));
+  }
+  const size_t old_page_id = BucketPageId(store, header, split);
+  const size_t new_page_id =
+      BucketPageId(store, header, split + level_bucket_count);
+  if (UNLIKELY(old_page_id == 0 || new_page_id == 0))
+    return Status::kDataCorrupted;
+
+  // The old bucket's entries are copied out, so its chain can be rebuilt.
+  ValueBuffer entry_data;
+  std::vector<SplitEntry, PlatformAllocator<SplitEntry>> entries;
+  std::vector<size_t, PlatformAllocator<size_t>> spare_page_ids;
+  size_t page_id = old_page_id;
+  const size_t max_chain_size = store->free_page_manager()->page_count();
+  for (size_t chain_size = 0; page_id != 0; ++chain_size) {
+    if (UNLIKELY(chain_size == max_chain_size))
+      return Status::kDataCorrupted;
+    if (page_id != old_page_id)
+      spare_page_ids.push_back(page_id);
+
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> node =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(IsBucketCorrupt(node)))
+      return Status::kDataCorrupted;
+    const size_t entry_count = BTreeNode::EntryCount(node);
+    for (size_t i = 0; i < entry_count; ++i) {
+      span<const uint8_t> key;
+      std::tie(status, key) = BTreeNode::KeySuffix(node, i);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const span<const uint8_t> value = BTreeNode::LeafValue(node, i);
+      entries.push_back({entry_data.size(), key.size(), value.size(),
+                         BTreeNode::LeafHasOverflowValue(node, i)});
+      entry_data.insert(entry_data.end(), key.begin(), key.end());
+      entry_data.insert(entry_data.end(), value.begin(), value.end());
+    }
+
+    const uint64_t next_page_id64 = BTreeNode::Link64(node);
+    if (next_page_id64 == 0) {
+      page_id = 0;
+    } else {
+      page_id = BTree::CheckedChildId(store, next_page_id64);
+      if (UNLIKELY(page_id == 0))
+        return Status::kDataCorrupted;
+    }
+  }
+
+  {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(old_page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0,
+                          transaction->MutablePageData(page.get(), page_size));
+  }
+  {
+    // The new bucket's page was never used, so its content is not read.
+    Page* raw_page;
+    std::tie(status, raw_page) = page_pool->StorePage(
+        store, new_page_id, PagePool::kIgnorePageData);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    BTreeNode::Initialize(BTreeNode::Type::kLeaf, 0,
+                          transaction->NewPageData(page.get(), page_size));
+  }
+
+  // The hash bit above the current level's bits selects the entry's bucket.
+  size_t tail_page_ids[2] = {old_page_id, new_page_id};
+  for (const SplitEntry& entry : entries) {
+    const span<const uint8_t> key(entry_data.data() + entry.offset,
+                                  entry.key_size);
+    const span<const uint8_t> value(
+        entry_data.data() + entry.offset + entry.key_size, entry.value_size);
+    const size_t target = static_cast<size_t>((KeyHash(key) >> level) & 1);
+    status = AppendEntry(transaction, &tail_page_ids[target], &spare_page_ids,
+                         key, value, entry.is_overflow);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  for (size_t spare_page_id : spare_page_ids) {
+    status = store->free_page_manager()->FreePage(spare_page_id, transaction,
+                                                  transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+
+  ++split;
+  if (split == level_bucket_count) {
+    ++level;
+    split = 0;
+  }
+  StoreUint32(static_cast<uint32_t>(level), header.subspan(kLevelOffset, 4));
+  StoreUint64(split, header.subspan(kSplitOffset, 8));
+  return Status::kSuccess;
+}
+
+Status HashTable::Delete(TransactionImpl* transaction,
+                         span<const uint8_t> key) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  Status status;
+  size_t bucket_page_id;
+  std::tie(status, bucket_page_id) = FindBucket(transaction, key);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  PagePool* const page_pool = transaction->store()->page_pool();
+  Page* raw_page;
+  size_t index;
+  std::tie(status, raw_page, index) =
+      FindEntry(transaction, bucket_page_id, key);
+  if (status != Status::kSuccess)
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const size_t page_size = page_pool->page_size();
+  const span<const uint8_t> node = transaction->PageData(page.get(), page_size);
+  if (BTreeNode::LeafHasOverflowValue(node, index)) {
+    status = OverflowValue::FreeReferencedValue(
+        transaction, BTreeNode::LeafValue(node, index));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+
+  // Emptied pages stay in the bucket's chain, and are reused by later
+  // insertions into the bucket.
+  BTreeNode::LeafRemove(transaction->MutablePageData(page.get(), page_size),
+                        index);
+  return Status::kSuccess;
+}
+
+Status HashTable::Free(TransactionImpl* transaction) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  FreePageManager* const free_page_manager = store->free_page_manager();
+
+  Status status;
+  Page* raw_header_page;
+  std::tie(status, raw_header_page) = store->FetchPage(header_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage header_page(raw_header_page, page_pool);
+  const span<const uint8_t> header =
+      transaction->PageData(header_page.get(), page_size);
+  size_t level, split;
+  std::tie(status, level, split) = DecodeHeader(header);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The first page of each bucket's chain is in a segment, and is freed with
+  // the segment. The other chain pages are freed one at a time.
+  const size_t bucket_count = (static_cast<size_t>(1) << level) + split;
+  const size_t max_chain_size = free_page_manager->page_count();
+  for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+    size_t page_id = BucketPageId(store, header, bucket);
+    if (UNLIKELY(page_id == 0))
+      return Status::kDataCorrupted;
+    for (size_t chain_size = 0; page_id != 0; ++chain_size) {
+      if (UNLIKELY(chain_size == max_chain_size))
+        return Status::kDataCorrupted;
+
+      Page* raw_page;
+      std::tie(status, raw_page) = store->FetchPage(page_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+      const span<const uint8_t> node =
+          transaction->PageData(page.get(), page_size);
+      if (UNLIKELY(IsBucketCorrupt(node)))
+        return Status::kDataCorrupted;
+
+      const size_t entry_count = BTreeNode::EntryCount(node);
+      for (size_t i = 0; i < entry_count; ++i) {
+        if (!BTreeNode::LeafHasOverflowValue(node, i))
+          continue;
+        status = OverflowValue::FreeReferencedValue(
+            transaction, BTreeNode::LeafValue(node, i));
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+      if (chain_size != 0) {
+        status = free_page_manager->FreePage(page_id, transaction,
+                                             transaction);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+
+      const uint64_t next_page_id64 = BTreeNode::Link64(node);
+      if (next_page_id64 == 0) {
+        page_id = 0;
+      } else {
+        page_id = BTree::CheckedChildId(store, next_page_id64);
+        if (UNLIKELY(page_id == 0))
+          return Status::kDataCorrupted;
+      }
+    }
+  }
+
+  // Segment 0 holds one bucket, and segment s > 0 holds 2^(s-1) buckets. The
+  // segment that receives the current level's splits exists once a bucket
+  // was split at the level.
+  const size_t segment_count = level + ((split != 0) ? 2 : 1);
+  for (size_t segment = 0; segment < segment_count; ++segment) {
+    const size_t segment_page_count =
+        (segment == 0) ? 1 : static_cast<size_t>(1) << (segment - 1);
+    const uint64_t first_page_id64 =
+        LoadUint64(header.subspan(kSegmentsOffset + segment * 8, 8));
+    const size_t first_page_id = BTree::CheckedChildId(store, first_page_id64);
+    if (UNLIKELY(first_page_id == 0 ||
+                 BTree::CheckedChildId(
+                     store, first_page_id64 + segment_page_count - 1) == 0)) {
+      return Status::kDataCorrupted;
+    }
+    status = free_page_manager->FreePages(first_page_id, segment_page_count,
+                                          transaction, transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  return free_page_manager->FreePage(header_page_id_, transaction,
+                                     transaction);
+}
+
+}  // namespace berrydb
@@ -0,0 +1,166 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_HASH_TABLE_H_
+#define BERRYDB_HASH_TABLE_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./btree.h"
+
+namespace berrydb {
+
+class ReadTransactionImpl;
+enum class Status : int;
+class StoreImpl;
+class TransactionImpl;
+
+/** A linear hash table stored in a store's pages. Backs hashed spaces.
+ *
+ * Keys are placed in buckets according to the low bits of their KeyHash(), so
+ * looking up a key reads the table's header page and the key's bucket page,
+ * regardless of the table's size. The table does not keep its keys in order,
+ * so it cannot be scanned by cursors.
+ *
+ * A bucket is a chain of pages, linked by their Link64() fields. Bucket pages
+ * use the BTreeNode leaf layout, so they share the key/value encoding, the
+ * in-page binary search and the overflow value references with B+tree leaves.
+ * Most buckets consist of a single page.
+ *
+ * The table grows one bucket at a time, using linear hashing. The table has
+ * 2^level + split buckets. A key's bucket is given by the hash's low level
+ * bits, or by the low (level + 1) bits if the former points to a bucket below
+ * the split pointer. Whenever a bucket needs an extra page in its chain, the
+ * bucket at the split pointer is split, by moving the keys that have the
+ * (level + 1)th hash bit set into a new bucket. Once all the buckets of a
+ * level are split, the level goes up and the split pointer goes back to zero.
+ * Splitting only happens when a chain grows, so most writes do not modify the
+ * header page, and do not conflict with optimistic transactions.
+ *
+ * The bucket pages are allocated in segments of consecutive pages. Segment 0
+ * holds bucket 0, and segment s > 0 holds the buckets in [2^(s-1), 2^s). The
+ * header page stores the segments' first page IDs, so a bucket's page ID is
+ * computed without reading any other page.
+ *
+ * Header page layout:
+ * 0: 32-bit level
+ * 4: reserved, must be zero
+ * 8: 64-bit split pointer
+ * 16: array of 64-bit segment first page IDs, for segments [0, level + 1];
+ *     the last segment is only allocated if the split pointer is not zero
+ *
+ * This class does not synchronize access to the table's pages. Transactions
+ * follow the concurrency rules documented in Space, and read transactions see
+ * the pages' old versions.
+ */
+class HashTable {
+ public:
+  /** The buffer that receives the values read by Get(). */
+  using ValueBuffer = BTree::ValueBuffer;
+
+  /** Sets up access to the table whose header is stored in the given page. */
+  explicit constexpr HashTable(size_t header_page_id) noexcept
+      : header_page_id_(header_page_id) {}
+
+  /** Creates an empty table, with a single bucket.
+   *
+   * @param  transaction    the transaction that allocates the table's pages
+   * @return status         most likely kSuccess or kIoError
+   * @return header_page_id the ID of the new table's header page
+   */
+  static std::tuple<Status, size_t> Create(TransactionImpl* transaction);
+
+  /** The ID of the table's header page. */
+  inline constexpr size_t header_page_id() const noexcept {
+    return header_page_id_;
+  }
+
+  // The methods below behave like their BTree counterparts.
+
+  Status Get(TransactionImpl* transaction, span<const uint8_t> key,
+             ValueBuffer* value) const;
+  Status Get(ReadTransactionImpl* transaction, span<const uint8_t> key,
+             ValueBuffer* value) const;
+  std::tuple<Status, size_t> ReadValue(TransactionImpl* transaction,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer) const;
+  std::tuple<Status, size_t> ReadValue(ReadTransactionImpl* transaction,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer) const;
+  Status Put(TransactionImpl* transaction, span<const uint8_t> key,
+             span<const uint8_t> value);
+  Status ReserveValue(TransactionImpl* transaction, span<const uint8_t> key,
+                      size_t value_size);
+  Status WriteValue(TransactionImpl* transaction, span<const uint8_t> key,
+                    size_t offset, span<const uint8_t> data);
+  Status Delete(TransactionImpl* transaction, span<const uint8_t> key);
+  Status Free(TransactionImpl* transaction) const;
+
+ private:
+  /** Finds the first page of a key's bucket, on behalf of a write transaction.
+   *
+   * @param  transaction the transaction whose view of the table is used
+   * @param  key         the key whose bucket is computed
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return page_id     the ID of the bucket's first page
+   */
+  std::tuple<Status, size_t> FindBucket(TransactionImpl* transaction,
+                                        span<const uint8_t> key) const;
+
+  /** Copies the value stored in a key's bucket entry, for a write transaction.
+   *
+   * @return status      kNotFound if the table does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return is_overflow if true, the bucket stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  std::tuple<Status, bool> FindValue(TransactionImpl* transaction,
+                                     span<const uint8_t> key,
+                                     ValueBuffer* value) const;
+
+  /** Copies the value stored in a key's bucket entry, as of a read snapshot.
+   *
+   * @return status      kNotFound if the table does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return is_overflow if true, the bucket stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  std::tuple<Status, bool> FindValue(ReadTransactionImpl* transaction,
+                                     span<const uint8_t> key,
+                                     ValueBuffer* value) const;
+
+  /** Creates or updates a key's bucket entry.
+   *
+   * @param  transaction the transaction that modifies the table
+   * @param  key         the entry's key
+   * @param  value       the value stored in the bucket; must fit in a leaf
+   * @param  is_overflow true if the value is a reference to overflow pages
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status PutEntry(TransactionImpl* transaction, span<const uint8_t> key,
+                  span<const uint8_t> value, bool is_overflow);
+
+  /** Creates or updates a key whose value is stored in overflow pages.
+   *
+   * @return kTooLarge if the key does not fit in a bucket page; otherwise,
+   *         most likely kSuccess or kIoError
+   */
+  Status PutOverflow(TransactionImpl* transaction, span<const uint8_t> key,
+                     size_t value_size, span<const uint8_t> data);
+
+  /** Splits the bucket at the split pointer, and advances the pointer.
+   *
+   * @param  transaction the transaction that modifies the table
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status SplitBucket(TransactionImpl* transaction);
+
+  const size_t header_page_id_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_HASH_TABLE_H_
@@ -0,0 +1,356 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./hash_table.h"
+
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/cursor.h"
+#include "berrydb/options.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "./btree_node.h"
+#include "./store_impl.h"
+#include "./test/space_helpers.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+bool NoPairs(void*, span<const uint8_t>*, span<const uint8_t>*) {
+  return false;
+}
+
+}  // namespace
+
+class HashTableTest : public SpaceTest {
+ protected:
+  HashTableTest() : SpaceTest("test_hash_table.berry") {
+    space_options_.hashed = true;
+  }
+};
+
+TEST_F(HashTableTest, PutGetDelete) {
+  OpenStore();
+  CreateSpace("space");
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("longer value")));
+  EXPECT_EQ("longer value", Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan(""), StringSpan("")));
+  EXPECT_EQ("", Get(transaction.get(), ""));
+
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan("key")));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "key"));
+  // Deleting a missing key succeeds.
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan("key")));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(HashTableTest, RandomOperationsMatchMap) {
+  // Small pages fill up buckets quickly, so the table splits many times.
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  std::uniform_int_distribution<size_t> key_size_distribution(0, 40);
+  std::uniform_int_distribution<size_t> value_size_distribution(0, 120);
+  std::uniform_int_distribution<int> operation_distribution(0, 9);
+
+  for (int round = 0; round < 20; ++round) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 500; ++i) {
+      const int operation = operation_distribution(rnd_);
+      if (operation < 2 && !keys.empty()) {
+        // Delete a key that was inserted earlier.
+        const std::string& key = keys[rnd_() % keys.size()];
+        ASSERT_EQ(Status::kSuccess,
+                  transaction->Delete(space_.get(), StringSpan(key)));
+        expected.erase(key);
+        continue;
+      }
+
+      const std::string key = RandomValue(&rnd_, key_size_distribution(rnd_));
+      const std::string value =
+          RandomValue(&rnd_, value_size_distribution(rnd_));
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+      keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // The table survives closing and reopening the store.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  ExpectSpaceMatches(expected, keys);
+}
+
+TEST_F(HashTableTest, SequentialInsertsGrowTable) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  constexpr int kKeyCount = 20000;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < kKeyCount; ++i) {
+      const std::string key = "key" + std::to_string(1000000 + i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(std::to_string(i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < kKeyCount; ++i) {
+    const std::string key = "key" + std::to_string(1000000 + i);
+    ASSERT_EQ(std::to_string(i), Get(reader.get(), key));
+  }
+  EXPECT_EQ("(missing)", Get(reader.get(), "key"));
+  EXPECT_EQ("(missing)", Get(reader.get(), "kez"));
+}
+
+TEST_F(HashTableTest, RolledBackChangesAreUndone) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("committed")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    // The transaction splits buckets, which must be undone as well.
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("rolled back")));
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)), StringSpan("value")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("committed", Get(transaction.get(), "key"));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "0"));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "999"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("0"), StringSpan("value")));
+  EXPECT_EQ("value", Get(transaction.get(), "0"));
+}
+
+TEST_F(HashTableTest, ReadTransactionsSeeSnapshots) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)), StringSpan("old")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // The writer splits the buckets that the old reader's keys are in.
+  UniquePtr<ReadTransaction> old_reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)), StringSpan("new")));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ("old", Get(old_reader.get(), std::to_string(i)));
+  EXPECT_EQ("(missing)", Get(old_reader.get(), "1999"));
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  for (int i = 0; i < 2000; ++i)
+    ASSERT_EQ("new", Get(new_reader.get(), std::to_string(i)));
+}
+
+TEST_F(HashTableTest, OptimisticTransactionsSeeTheirChanges) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  TransactionOptions options;
+  options.optimistic = true;
+  UniquePtr<Transaction> transaction(store_->CreateTransaction(options));
+  for (int i = 0; i < 500; ++i) {
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan(std::to_string(i)), StringSpan("value")));
+  }
+  EXPECT_EQ("value", Get(transaction.get(), "42"));
+
+  // The changes are not visible before the transaction commits.
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    EXPECT_EQ("(missing)", Get(reader.get(), "42"));
+  }
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < 500; ++i)
+    ASSERT_EQ("value", Get(reader.get(), std::to_string(i)));
+}
+
+TEST_F(HashTableTest, TooLarge) {
+  OpenStore();
+  CreateSpace("space");
+
+  const size_t page_size = static_cast<size_t>(1) << kPageShift;
+  const std::string large_key(BTreeNode::MaxKeySize(page_size) + 1, 'k');
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ(Status::kTooLarge, transaction->Put(
+      space_.get(), StringSpan(large_key), StringSpan("value")));
+  EXPECT_EQ(Status::kTooLarge, transaction->ReserveValue(
+      space_.get(), StringSpan(large_key), page_size));
+  EXPECT_EQ("(missing)", Get(transaction.get(), large_key));
+}
+
+TEST_F(HashTableTest, LargeValues) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+
+  // Large values are stored in overflow pages, and move with their keys when
+  // buckets are split.
+  std::map<std::string, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 500; ++i) {
+      const std::string key = std::to_string(i);
+      const std::string value = RandomValue(&rnd_, (i % 7 == 0) ? 3000 : 40);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, {});
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+      space_.get(), StringSpan("reserved"), 5000));
+  ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+      space_.get(), StringSpan("reserved"), 4000, StringSpan("hello")));
+  EXPECT_EQ(Status::kTooLarge, transaction->WriteValue(
+      space_.get(), StringSpan("reserved"), 4998, StringSpan("hello")));
+  ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+      space_.get(), StringSpan("0"), 10, StringSpan("hello")));
+  EXPECT_EQ(Status::kNotFound, transaction->WriteValue(
+      space_.get(), StringSpan("missing"), 0, StringSpan("hello")));
+
+  std::string reserved(5000, '\0');
+  reserved.replace(4000, 5, "hello");
+  EXPECT_EQ(reserved, Get(transaction.get(), "reserved"));
+  EXPECT_EQ(expected["0"].replace(10, 5, "hello"), Get(transaction.get(), "0"));
+
+  char buffer[8];
+  Status status;
+  size_t value_size;
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("reserved"), 3998,
+      span<uint8_t>(reinterpret_cast<uint8_t*>(buffer), sizeof(buffer)));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(5000U, value_size);
+  EXPECT_EQ(std::string("\0\0hello\0", 8), std::string(buffer, 8));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(HashTableTest, LargeValuePagesAreReused) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space");
+  FreePageManager* free_page_manager =
+      StoreImpl::FromApi(store_.get())->free_page_manager();
+
+  std::map<std::string, std::string> expected;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20; ++i)
+    keys.push_back(std::to_string(i));
+  size_t warm_page_count = 0;
+  for (int round = 0; round < 60; ++round) {
+    if (round == 10)
+      warm_page_count = free_page_manager->page_count();
+
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 5; ++i) {
+      const std::string& key = keys[rnd_() % keys.size()];
+      if (rnd_() % 4 == 0) {
+        const Status status =
+            transaction->Delete(space_.get(), StringSpan(key));
+        ASSERT_TRUE(status == Status::kSuccess || status == Status::kNotFound);
+        expected.erase(key);
+        continue;
+      }
+      const std::string value = RandomValue(&rnd_, 1024 + rnd_() % 3000);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(key), StringSpan(value)));
+      expected[key] = value;
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // 20 live values use at most 80 pages. Without page reuse, the 250 values
+  // written after warm-up would use about 600 pages.
+  EXPECT_LT(free_page_manager->page_count(), warm_page_count + 200);
+}
+
+TEST_F(HashTableTest, ScansAndBulkLoadsNotSupported) {
+  OpenStore();
+  CreateSpace("space");
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan("value")));
+    EXPECT_EQ(Status::kNotSupported,
+              transaction->BulkLoad(space_.get(), &NoPairs, nullptr));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  EXPECT_EQ(Status::kNotSupported, cursor->SeekToFirst());
+  EXPECT_EQ(Status::kNotSupported, cursor->SeekToLast());
+  EXPECT_EQ(Status::kNotSupported, cursor->Seek(StringSpan("key")));
+  EXPECT_FALSE(cursor->Valid());
+  EXPECT_EQ(Status::kNotFound, cursor->Next());
+}
+
+}  // namespace berrydb
@@ -0,0 +1,637 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./integer_btree.h"
+
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./free_page_manager.h"
+#include "./overflow_value.h"
+#include "./page_pool.h"
+#include "./pinned_page.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+/** Allocates and pins a page for a new tree node. */
+std::tuple<Status, Page*> AllocTreePage(TransactionImpl* transaction) {
+  StoreImpl* const store = transaction->store();
+  const size_t page_id =
+      store->free_page_manager()->AllocPage(transaction, transaction);
+  if (UNLIKELY(page_id == FreePageManager::kInvalidPageId))
+    return {Status::kIoError, nullptr};
+  return store->page_pool()->StorePage(store, page_id,
+                                       PagePool::kIgnorePageData);
+}
+
+}  // namespace
+
+// static
+template <typename KeyType>
+std::tuple<Status, size_t> IntegerBTree<KeyType>::Create(
+    TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  PagePool* const page_pool = transaction->store()->page_pool();
+  Status status;
+  Page* raw_page;
+  std::tie(status, raw_page) = AllocTreePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  const PinnedPage page(raw_page, page_pool);
+
+  Node::Initialize(
+      Node::Type::kLeaf, 0,
+      transaction->MutablePageData(page.get(), page_pool->page_size()));
+  return {Status::kSuccess, page->page_id()};
+}
+
+template <typename KeyType>
+std::tuple<Status, size_t, size_t> IntegerBTree<KeyType>::FindLeaf(
+    TransactionImpl* transaction, KeyType key, size_t* path) const {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  size_t page_id = root_page_id_;
+  for (size_t depth = 0; depth < BTree::kMaxDepth; ++depth) {
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<const uint8_t> node =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(Node::IsCorrupt(node)))
+      return {Status::kDataCorrupted, 0, 0};
+    if (Node::NodeType(node) == Node::Type::kLeaf)
+      return {Status::kSuccess, depth, page_id};
+
+    if (path != nullptr)
+      path[depth] = page_id;
+    page_id = BTree::CheckedChildId(store, Node::InnerChild(node, key));
+    if (UNLIKELY(page_id == 0))
+      return {Status::kDataCorrupted, 0, 0};
+  }
+  return {Status::kDataCorrupted, 0, 0};
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::Get(
+    TransactionImpl* transaction, span<const uint8_t> key,
+    ValueBuffer* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return Status::kNotSupported;
+
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) =
+      FindValue(transaction, Node::DecodeKey(key), value);
+  if (UNLIKELY(status != Status::kSuccess) || !is_overflow)
+    return status;
+  return OverflowValue::ReadReferencedValue(transaction, value);
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::Get(
+    ReadTransactionImpl* transaction, span<const uint8_t> key,
+    ValueBuffer* value) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return Status::kNotSupported;
+
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) =
+      FindValue(transaction, Node::DecodeKey(key), value);
+  if (UNLIKELY(status != Status::kSuccess) || !is_overflow)
+    return status;
+  return OverflowValue::ReadReferencedValue(transaction, value);
+}
+
+template <typename KeyType>
+std::tuple<Status, size_t> IntegerBTree<KeyType>::ReadValue(
+    TransactionImpl* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return {Status::kNotSupported, 0};
+
+  ValueBuffer leaf_value;
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) =
+      FindValue(transaction, Node::DecodeKey(key), &leaf_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  return OverflowValue::ReadEntryValueRange(
+      transaction, span<const uint8_t>(leaf_value.data(), leaf_value.size()),
+      is_overflow, offset, buffer);
+}
+
+template <typename KeyType>
+std::tuple<Status, size_t> IntegerBTree<KeyType>::ReadValue(
+    ReadTransactionImpl* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return {Status::kNotSupported, 0};
+
+  ValueBuffer leaf_value;
+  Status status;
+  bool is_overflow;
+  std::tie(status, is_overflow) =
+      FindValue(transaction, Node::DecodeKey(key), &leaf_value);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+  return OverflowValue::ReadEntryValueRange(
+      transaction, span<const uint8_t>(leaf_value.data(), leaf_value.size()),
+      is_overflow, offset, buffer);
+}
+
+template <typename KeyType>
+std::tuple<Status, bool> IntegerBTree<KeyType>::FindValue(
+    TransactionImpl* transaction, KeyType key, ValueBuffer* value) const {
+  Status status;
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) = FindLeaf(transaction, key, nullptr);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(leaf_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_pool->page_size());
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node::LeafFind(node, key);
+  if (!found)
+    return {Status::kNotFound, false};
+
+  span<const uint8_t> leaf_value;
+  bool is_overflow;
+  std::tie(status, leaf_value, is_overflow) = Node::LeafValue(node, index);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, false};
+  value->assign(leaf_value.begin(), leaf_value.end());
+  return {Status::kSuccess, is_overflow};
+}
+
+template <typename KeyType>
+std::tuple<Status, bool> IntegerBTree<KeyType>::FindValue(
+    ReadTransactionImpl* transaction, KeyType key, ValueBuffer* value) const {
+  StoreImpl* const store = transaction->store();
+  size_t page_id = root_page_id_;
+  for (size_t depth = 0; depth < BTree::kMaxDepth; ++depth) {
+    // Each ReadPage() call invalidates the data returned by the previous call,
+    // so the child's ID must be extracted before descending.
+    Status status;
+    span<const uint8_t> node;
+    std::tie(status, node) = transaction->ReadPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, false};
+    if (UNLIKELY(Node::IsCorrupt(node)))
+      return {Status::kDataCorrupted, false};
+
+    if (Node::NodeType(node) == Node::Type::kLeaf) {
+      bool found;
+      size_t index;
+      std::tie(found, index) = Node::LeafFind(node, key);
+      if (!found)
+        return {Status::kNotFound, false};
+
+      span<const uint8_t> leaf_value;
+      bool is_overflow;
+      std::tie(status, leaf_value, is_overflow) = Node::LeafValue(node, index);
+      if (UNLIKELY(status != Status::kSuccess))
+        return {status, false};
+      value->assign(leaf_value.begin(), leaf_value.end());
+      return {Status::kSuccess, is_overflow};
+    }
+
+    page_id = BTree::CheckedChildId(store, Node::InnerChild(node, key));
+    if (UNLIKELY(page_id == 0))
+      return {Status::kDataCorrupted, false};
+  }
+  return {Status::kDataCorrupted, false};
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::Put(TransactionImpl* transaction,
+                                  span<const uint8_t> key,
+                                  span<const uint8_t> value) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return Status::kNotSupported;
+
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (value.size() <= Node::MaxValueSize(page_size))
+    return PutEntry(transaction, Node::DecodeKey(key), value, false);
+  return PutOverflow(transaction, Node::DecodeKey(key), value.size(), value);
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::ReserveValue(TransactionImpl* transaction,
+                                           span<const uint8_t> key,
+                                           size_t value_size) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return Status::kNotSupported;
+
+  const size_t page_size = transaction->store()->page_pool()->page_size();
+  if (value_size <= Node::MaxValueSize(page_size)) {
+    const ValueBuffer zeros(value_size, 0);
+    return PutEntry(transaction, Node::DecodeKey(key),
+                    span<const uint8_t>(zeros.data(), zeros.size()), false);
+  }
+  return PutOverflow(transaction, Node::DecodeKey(key), value_size,
+                     span<const uint8_t>());
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::WriteValue(TransactionImpl* transaction,
+                                         span<const uint8_t> key,
+                                         size_t offset,
+                                         span<const uint8_t> data) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return Status::kNotSupported;
+
+  const KeyType integer_key = Node::DecodeKey(key);
+  Status status;
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) =
+      FindLeaf(transaction, integer_key, nullptr);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(leaf_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_size);
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node::LeafFind(node, integer_key);
+  if (!found)
+    return Status::kNotFound;
+
+  span<const uint8_t> leaf_value;
+  bool is_overflow;
+  std::tie(status, leaf_value, is_overflow) = Node::LeafValue(node, index);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (is_overflow) {
+    // The leaf is not modified, because the reference stays the same.
+    size_t first_page_id, value_size;
+    std::tie(status, first_page_id, value_size) =
+        OverflowValue::DecodeReference(store, leaf_value);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (UNLIKELY(offset > value_size || data.size() > value_size - offset))
+      return Status::kTooLarge;
+    return OverflowValue::Write(transaction, first_page_id, offset, data);
+  }
+
+  if (UNLIKELY(offset > leaf_value.size() ||
+               data.size() > leaf_value.size() - offset)) {
+    return Status::kTooLarge;
+  }
+  CopySpan(data, Node::LeafMutableValue(
+      transaction->MutablePageData(page.get(), page_size), index).subspan(
+          offset, data.size()));
+  return Status::kSuccess;
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::PutOverflow(TransactionImpl* transaction,
+                                          KeyType key, size_t value_size,
+                                          span<const uint8_t> data) {
+  Status status;
+  size_t first_page_id;
+  std::tie(status, first_page_id) =
+      OverflowValue::Create(transaction, value_size, data);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  uint8_t reference[OverflowValue::kReferenceSize];
+  OverflowValue::EncodeReference(first_page_id, value_size,
+                                 span<uint8_t>(reference));
+  return PutEntry(transaction, key, span<const uint8_t>(reference), true);
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::PutEntry(TransactionImpl* transaction,
+                                       KeyType key, span<const uint8_t> value,
+                                       bool is_overflow) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  BERRYDB_ASSUME_LE(value.size(), Node::MaxValueSize(page_size));
+
+  size_t path[BTree::kMaxDepth];
+  Status status;
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) = FindLeaf(transaction, key, path);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The leaf is built in a scratch buffer if it overflows. The buffer can hold
+  // two pages, so the new entry always fits.
+  const size_t scratch_size = page_size * 2;
+  uint8_t* const scratch_buffer =
+      reinterpret_cast<uint8_t*>(Allocate(scratch_size));
+  const span<uint8_t> scratch(scratch_buffer, scratch_size);
+  {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(leaf_id);
+    if (UNLIKELY(status != Status::kSuccess)) {
+      Deallocate(scratch_buffer, scratch_size);
+      return status;
+    }
+    const PinnedPage page(raw_page, page_pool);
+
+    const span<uint8_t> node =
+        transaction->MutablePageData(page.get(), page_size);
+    bool found;
+    size_t index;
+    std::tie(found, index) = Node::LeafFind(node, key);
+    if (found) {
+      // The removed entry's index is the insertion point for the new entry.
+      span<const uint8_t> old_value;
+      bool old_is_overflow;
+      std::tie(status, old_value, old_is_overflow) =
+          Node::LeafValue(node, index);
+      if (LIKELY(status == Status::kSuccess) && old_is_overflow)
+        status = OverflowValue::FreeReferencedValue(transaction, old_value);
+      if (UNLIKELY(status != Status::kSuccess)) {
+        Deallocate(scratch_buffer, scratch_size);
+        return status;
+      }
+      Node::LeafRemove(node, index);
+    }
+    if (Node::LeafInsert(node, index, key, value, is_overflow)) {
+      Deallocate(scratch_buffer, scratch_size);
+      return Status::kSuccess;
+    }
+
+    Node::CopyNode(node, scratch);
+    const bool inserted =
+        Node::LeafInsert(scratch, index, key, value, is_overflow);
+    BERRYDB_ASSUME(inserted);
+  }
+
+  KeyType separator;
+  size_t right_page_id;
+  std::tie(status, separator, right_page_id) =
+      SplitNode(transaction, leaf_id, scratch);
+  if (LIKELY(status == Status::kSuccess) && right_page_id != 0) {
+    status = InsertSeparator(transaction, path, depth, separator,
+                             right_page_id, scratch);
+  }
+  Deallocate(scratch_buffer, scratch_size);
+  return status;
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::Delete(TransactionImpl* transaction,
+                                     span<const uint8_t> key) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  if (UNLIKELY(key.size() != kKeySize))
+    return Status::kNotSupported;
+
+  const KeyType integer_key = Node::DecodeKey(key);
+  Status status;
+  size_t depth, leaf_id;
+  std::tie(status, depth, leaf_id) =
+      FindLeaf(transaction, integer_key, nullptr);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(leaf_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  // The leaf is only modified if it has the key.
+  const span<const uint8_t> node =
+      transaction->PageData(page.get(), page_size);
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node::LeafFind(node, integer_key);
+  if (!found)
+    return Status::kNotFound;
+  span<const uint8_t> value;
+  bool is_overflow;
+  std::tie(status, value, is_overflow) = Node::LeafValue(node, index);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (is_overflow) {
+    status = OverflowValue::FreeReferencedValue(transaction, value);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+
+  // Underflowing leaves are not merged with their siblings. Emptied leaves
+  // stay in the tree, and are reused by later insertions in their key range.
+  Node::LeafRemove(transaction->MutablePageData(page.get(), page_size),
+                   index);
+  return Status::kSuccess;
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::Free(TransactionImpl* transaction) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  FreePageManager* const free_page_manager = store->free_page_manager();
+
+  // The tree is walked depth-first. A tree with more nodes than the store has
+  // pages has a cycle.
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids;
+  page_ids.push_back(root_page_id_);
+  const size_t max_node_count = free_page_manager->page_count();
+  for (size_t node_count = 0; !page_ids.empty(); ++node_count) {
+    if (UNLIKELY(node_count >= max_node_count))
+      return Status::kDataCorrupted;
+    const size_t page_id = page_ids.back();
+    page_ids.pop_back();
+
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+    const span<const uint8_t> node =
+        transaction->PageData(page.get(), page_size);
+    if (UNLIKELY(Node::IsCorrupt(node)))
+      return Status::kDataCorrupted;
+
+    const size_t entry_count = Node::EntryCount(node);
+    if (Node::NodeType(node) == Node::Type::kLeaf) {
+      for (size_t i = 0; i < entry_count; ++i) {
+        span<const uint8_t> value;
+        bool is_overflow;
+        std::tie(status, value, is_overflow) = Node::LeafValue(node, i);
+        if (LIKELY(status == Status::kSuccess) && is_overflow)
+          status = OverflowValue::FreeReferencedValue(transaction, value);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+    } else {
+      for (size_t i = 0; i <= entry_count; ++i) {
+        const size_t child_id =
+            BTree::CheckedChildId(store, Node::InnerChildAt(node, i));
+        if (UNLIKELY(child_id == 0))
+          return Status::kDataCorrupted;
+        page_ids.push_back(child_id);
+      }
+    }
+
+    status = free_page_manager->FreePage(page_id, transaction, transaction);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  return Status::kSuccess;
+}
+
+template <typename KeyType>
+std::tuple<Status, KeyType, size_t> IntegerBTree<KeyType>::SplitNode(
+    TransactionImpl* transaction, size_t page_id, span<const uint8_t> node) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  if (UNLIKELY(!Node::HasValidEntries(node)))
+    return {Status::kDataCorrupted, 0, 0};
+
+  Status status;
+  Page* raw_right_page;
+  std::tie(status, raw_right_page) = AllocTreePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0, 0};
+  const PinnedPage right_page(raw_right_page, page_pool);
+  const size_t right_page_id = right_page->page_id();
+  const span<uint8_t> right =
+      transaction->MutablePageData(right_page.get(), page_size);
+
+  if (page_id != root_page_id_) {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, 0};
+    const PinnedPage page(raw_page, page_pool);
+
+    const KeyType separator = Node::Split(
+        node, transaction->MutablePageData(page.get(), page_size), right,
+        right_page_id);
+    return {Status::kSuccess, separator, right_page_id};
+  }
+
+  // The root page stays in place, so it gets two new children.
+  Page* raw_left_page;
+  std::tie(status, raw_left_page) = AllocTreePage(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0, 0};
+  const PinnedPage left_page(raw_left_page, page_pool);
+  const size_t left_page_id = left_page->page_id();
+
+  const KeyType separator = Node::Split(
+      node, transaction->MutablePageData(left_page.get(), page_size), right,
+      right_page_id);
+
+  Page* raw_root_page;
+  std::tie(status, raw_root_page) = store->FetchPage(root_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0, 0};
+  const PinnedPage root_page(raw_root_page, page_pool);
+
+  const span<uint8_t> root =
+      transaction->MutablePageData(root_page.get(), page_size);
+  Node::Initialize(Node::Type::kInner, left_page_id, root);
+  const bool inserted = Node::InnerInsert(root, 0, separator, right_page_id);
+  BERRYDB_ASSUME(inserted);
+  return {Status::kSuccess, separator, 0};
+}
+
+template <typename KeyType>
+Status IntegerBTree<KeyType>::InsertSeparator(
+    TransactionImpl* transaction, const size_t* path, size_t depth,
+    KeyType separator, size_t right_page_id, span<uint8_t> scratch) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+
+  while (depth > 0) {
+    --depth;
+    const size_t page_id = path[depth];
+    {
+      Status status;
+      Page* raw_page;
+      std::tie(status, raw_page) = store->FetchPage(page_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage page(raw_page, page_pool);
+
+      // FindLeaf() checked the page's header.
+      const span<uint8_t> node =
+          transaction->MutablePageData(page.get(), page_size);
+      const size_t index = Node::UpperBound(node, separator);
+      if (Node::InnerInsert(node, index, separator, right_page_id))
+        return Status::kSuccess;
+
+      Node::CopyNode(node, scratch);
+      const bool inserted =
+          Node::InnerInsert(scratch, index, separator, right_page_id);
+      BERRYDB_ASSUME(inserted);
+    }
+
+    Status status;
+    std::tie(status, separator, right_page_id) =
+        SplitNode(transaction, page_id, scratch);
+    if (UNLIKELY(status != Status::kSuccess) || right_page_id == 0)
+      return status;
+  }
+
+  // The root's split does not produce a separator, so the loop always returns.
+  BERRYDB_UNREACHABLE();
+}
+
+template class IntegerBTree<uint32_t>;
+template class IntegerBTree<uint64_t>;
+
+}  // namespace berrydb
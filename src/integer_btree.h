@@ -0,0 +1,188 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_INTEGER_BTREE_H_
+#define BERRYDB_INTEGER_BTREE_H_
+
+#include <tuple>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./btree.h"
+#include "./integer_btree_node.h"
+
+namespace berrydb {
+
+class ReadTransactionImpl;
+enum class Status : int;
+class StoreImpl;
+class TransactionImpl;
+
+/** A B+tree whose keys are fixed-width unsigned integers. Backs spaces created
+ * with SpaceOptions::integer_key_size.
+ *
+ * The tree is specialized at compile time on the key type, which must be
+ * uint32_t or uint64_t. See IntegerBTreeNode for the page layout. The public
+ * API passes keys as big-endian byte strings, so the tree's key order matches
+ * the order of a BTree holding the same keys. Keys of any other size are
+ * rejected.
+ *
+ * Apart from the node layout, the tree works like BTree. The root page never
+ * changes, nodes are not merged when keys are deleted, and values that don't
+ * fit in a leaf are stored in overflow pages.
+ *
+ * This class does not synchronize access to the tree's pages. Transactions
+ * follow the concurrency rules documented in Space, and read transactions see
+ * the pages' old versions.
+ */
+template <typename KeyType>
+class IntegerBTree {
+ public:
+  /** The page layout used by the tree. */
+  using Node = IntegerBTreeNode<KeyType>;
+
+  /** The buffer that receives the values read by Get(). */
+  using ValueBuffer = BTree::ValueBuffer;
+
+  /** The size of the tree's keys, in bytes. */
+  static constexpr size_t kKeySize = sizeof(KeyType);
+
+  /** Sets up access to the tree rooted at the given page. */
+  explicit constexpr IntegerBTree(size_t root_page_id) noexcept
+      : root_page_id_(root_page_id) {}
+
+  /** Creates an empty tree.
+   *
+   * @param  transaction  the transaction that allocates the tree's root page
+   * @return status       most likely kSuccess or kIoError
+   * @return root_page_id the ID of the new tree's root page
+   */
+  static std::tuple<Status, size_t> Create(TransactionImpl* transaction);
+
+  /** The ID of the tree's root page. */
+  inline constexpr size_t root_page_id() const noexcept {
+    return root_page_id_;
+  }
+
+  // The methods below behave like their BTree counterparts, and return
+  // kNotSupported if the key does not have kKeySize bytes.
+
+  Status Get(TransactionImpl* transaction, span<const uint8_t> key,
+             ValueBuffer* value) const;
+  Status Get(ReadTransactionImpl* transaction, span<const uint8_t> key,
+             ValueBuffer* value) const;
+  std::tuple<Status, size_t> ReadValue(TransactionImpl* transaction,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer) const;
+  std::tuple<Status, size_t> ReadValue(ReadTransactionImpl* transaction,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer) const;
+  Status Put(TransactionImpl* transaction, span<const uint8_t> key,
+             span<const uint8_t> value);
+  Status ReserveValue(TransactionImpl* transaction, span<const uint8_t> key,
+                      size_t value_size);
+  Status WriteValue(TransactionImpl* transaction, span<const uint8_t> key,
+                    size_t offset, span<const uint8_t> data);
+  Status Delete(TransactionImpl* transaction, span<const uint8_t> key);
+  Status Free(TransactionImpl* transaction) const;
+
+ private:
+  /** Copies the value stored in a key's leaf entry, for a write transaction.
+   *
+   * @return status      kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return is_overflow if true, the leaf stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  std::tuple<Status, bool> FindValue(TransactionImpl* transaction,
+                                     KeyType key, ValueBuffer* value) const;
+
+  /** Copies the value stored in a key's leaf entry, as of a read snapshot.
+   *
+   * @return status      kNotFound if the tree does not contain the key;
+   *                     otherwise, most likely kSuccess or kIoError
+   * @return is_overflow if true, the leaf stores a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  std::tuple<Status, bool> FindValue(ReadTransactionImpl* transaction,
+                                     KeyType key, ValueBuffer* value) const;
+
+  /** Creates or updates a key's leaf entry.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  key         the entry's key
+   * @param  value       the value stored in the leaf; at most
+   *                     Node::MaxValueSize() bytes
+   * @param  is_overflow true if the value is a reference to overflow pages
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status PutEntry(TransactionImpl* transaction, KeyType key,
+                  span<const uint8_t> value, bool is_overflow);
+
+  /** Creates or updates a key whose value is stored in overflow pages.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status PutOverflow(TransactionImpl* transaction, KeyType key,
+                     size_t value_size, span<const uint8_t> data);
+
+  /** Finds the leaf that may hold a key, on behalf of a write transaction.
+   *
+   * @param  transaction the transaction whose view of the tree is used
+   * @param  key         the key to look for
+   * @param  path        if not null, receives the IDs of the inner pages on the
+   *                     way to the leaf, starting at the root; must have room
+   *                     for BTree::kMaxDepth entries
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return depth       the number of inner pages on the way to the leaf
+   * @return leaf_id     the ID of the leaf page
+   */
+  std::tuple<Status, size_t, size_t> FindLeaf(
+      TransactionImpl* transaction, KeyType key, size_t* path) const;
+
+  /** Splits an overflowing node built in a scratch buffer.
+   *
+   * @param  transaction the transaction that modifies the tree
+   * @param  page_id     the page that will receive the node's left half; if
+   *                     this is the root page, the halves go to two new pages,
+   *                     and the root becomes their parent
+   * @param  node        the overflowing node
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return separator   the smallest key in the right half
+   * @return right_id    the page that received the node's right half, which
+   *                     needs a separator in the node's parent; 0 if the root
+   *                     page was split, because the root has no parent
+   */
+  std::tuple<Status, KeyType, size_t> SplitNode(
+      TransactionImpl* transaction, size_t page_id, span<const uint8_t> node);
+
+  /** Adds the separator for a new page to the ancestors of a split node.
+   *
+   * Inner nodes that overflow are split, going up the path as needed.
+   *
+   * @param  transaction   the transaction that modifies the tree
+   * @param  path          the IDs of the inner pages on the way to the split
+   *                       node, starting at the root
+   * @param  depth         the number of entries in path
+   * @param  separator     the smallest key in the new page
+   * @param  right_page_id the new page
+   * @param  scratch       buffer that can hold two pages
+   * @return               kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status InsertSeparator(TransactionImpl* transaction, const size_t* path,
+                         size_t depth, KeyType separator, size_t right_page_id,
+                         span<uint8_t> scratch);
+
+  const size_t root_page_id_;
+};
+
+template <typename KeyType>
+constexpr size_t IntegerBTree<KeyType>::kKeySize;
+
+extern template class IntegerBTree<uint32_t>;
+extern template class IntegerBTree<uint64_t>;
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_INTEGER_BTREE_H_
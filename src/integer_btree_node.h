@@ -0,0 +1,601 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_INTEGER_BTREE_NODE_H_
+#define BERRYDB_INTEGER_BTREE_NODE_H_
+
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#include "berrydb/platform.h"
+#include "berrydb/span.h"
+#include "berrydb/status.h"
+#include "berrydb/types.h"
+#include "./util/checks.h"
+#include "./util/endianness.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+/** The layout of the pages that make up an integer-keyed space's B+tree.
+ *
+ * The layout is specialized at compile time on the key type, which must be
+ * uint32_t or uint64_t. Keys are stored as integers in a packed array, without
+ * per-key sizes, so inner nodes have a much higher fanout than BTreeNode inner
+ * nodes, and lookups are branchless binary searches over the array.
+ *
+ * Each node page starts with a 24-byte header, followed by the key array.
+ *
+ * Header layout:
+ * 0: 16-bit node type (Type::kLeaf or Type::kInner)
+ * 2: reserved, must be zero
+ * 4: 32-bit number of entries
+ * 8: 32-bit size of the value heap, in bytes; always zero in inner nodes
+ * 12: reserved, must be zero
+ * 16: 64-bit link; leaves store the page ID of their right sibling, or 0 for
+ *     the last leaf; inner nodes store the page ID of the child that holds the
+ *     keys smaller than the node's first key
+ *
+ * Inner nodes store their 64-bit child page IDs in an array that grows down
+ * from the end of the node. The child at position i holds the keys that are
+ * greater than or equal to the key at position i, and smaller than the next
+ * key.
+ *
+ * Leaf nodes store 32-bit value offsets right after the key array. The values
+ * are stored in a heap that grows down from the end of the node. Offsets are
+ * measured from the end of the node, so a node can be moved into a larger
+ * buffer without updating its offsets. Values are 2-byte-aligned, and consist
+ * of a 16-bit value size followed by the value bytes. The value size's top bit
+ * is set if the value is stored in overflow pages, in which case the leaf holds
+ * a reference to the pages instead of the value.
+ *
+ * An all-zero page is an empty leaf. This makes zero-filled pages valid empty
+ * trees.
+ *
+ * The node's capacity is the size of the span passed to the methods below. This
+ * lets the tree build an oversized node in a scratch buffer when a node must be
+ * split.
+ */
+template <typename KeyType>
+class IntegerBTreeNode {
+  static_assert(std::is_same<KeyType, uint32_t>::value ||
+                std::is_same<KeyType, uint64_t>::value,
+                "Integer keys must be uint32_t or uint64_t");
+
+ public:
+  /** The node types. */
+  enum class Type : uint16_t {
+    kLeaf = 0,
+    kInner = 1,
+  };
+
+  /** The size of the node header, in bytes. */
+  static constexpr size_t kHeaderSize = 24;
+
+  /** The size of a key, in bytes. */
+  static constexpr size_t kKeySize = sizeof(KeyType);
+
+  /** The space used by each leaf entry, in addition to its value's bytes. */
+  static constexpr size_t kLeafEntryOverhead =
+      kKeySize + 4 + 2;  // Key, value offset, value size.
+
+  /** The space used by each inner entry, in bytes. */
+  static constexpr size_t kInnerEntrySize = kKeySize + 8;
+
+  /** The node's type. */
+  static inline Type NodeType(span<const uint8_t> node) noexcept {
+    return static_cast<Type>(LoadUint16(node.subspan(kTypeOffset, 2)));
+  }
+
+  /** The number of entries in the node. */
+  static inline size_t EntryCount(span<const uint8_t> node) noexcept {
+    return LoadUint32(node.subspan(kEntryCountOffset, 4));
+  }
+
+  /** The number of bytes used by a leaf's values. */
+  static inline size_t HeapSize(span<const uint8_t> node) noexcept {
+    return LoadUint32(node.subspan(kHeapSizeOffset, 4));
+  }
+
+  /** The node's link. See the class comment for details. */
+  static inline uint64_t Link64(span<const uint8_t> node) noexcept {
+    return LoadUint64(node.subspan(kLinkOffset, 8));
+  }
+
+  /** Changes the node's link. See the class comment for details. */
+  static inline void SetLink64(uint64_t link64, span<uint8_t> node) noexcept {
+    StoreUint64(link64, node.subspan(kLinkOffset, 8));
+  }
+
+  /** Sets up an empty node. */
+  static inline void Initialize(Type type, uint64_t link64, span<uint8_t> node)
+      noexcept {
+    BERRYDB_ASSUME_GE(node.size(), kHeaderSize);
+
+    // The unused space is zeroed, so node pages don't depend on their history.
+    FillSpan(node, 0);
+    StoreUint16(static_cast<uint16_t>(type), node.subspan(kTypeOffset, 2));
+    SetLink64(link64, node);
+  }
+
+  /** Converts a key from the public API into an integer.
+   *
+   * Keys are big-endian, so the integers' order matches the order of the keys'
+   * bytes. Only meaningful for keys of kKeySize bytes.
+   */
+  static inline KeyType DecodeKey(span<const uint8_t> key) noexcept {
+    BERRYDB_ASSUME_EQ(key.size(), kKeySize);
+    KeyType value = 0;
+    for (size_t i = 0; i < kKeySize; ++i)
+      value = static_cast<KeyType>((value << 8) | key[i]);
+    return value;
+  }
+
+  /** The size of the largest value that can be stored in a leaf.
+   *
+   * Entries are limited to a quarter of the node's capacity, so a full node can
+   * always be split into two nodes that have room for a new entry.
+   */
+  static constexpr size_t MaxValueSize(size_t page_size) noexcept {
+    return ((((page_size - kHeaderSize) / 4 - kLeafEntryOverhead) &
+             ~static_cast<size_t>(1)) < kMaxEncodableValueSize)
+        ? (((page_size - kHeaderSize) / 4 - kLeafEntryOverhead) &
+           ~static_cast<size_t>(1))
+        : kMaxEncodableValueSize;
+  }
+
+  /** The maximum number of entries in an inner node. */
+  static constexpr size_t InnerCapacity(size_t node_size) noexcept {
+    return (node_size - kHeaderSize) / kInnerEntrySize;
+  }
+
+  /** True if a node's header is inconsistent with the node's buffer.
+   *
+   * Nodes read from the store must pass this check before they are handed to
+   * the other methods. Leaf values are checked when they are read.
+   */
+  static inline bool IsCorrupt(span<const uint8_t> node) noexcept {
+    BERRYDB_ASSUME_GE(node.size(), kHeaderSize);
+    BERRYDB_ASSUME_EQ(node.size() & 7, 0U);
+
+    const Type type = NodeType(node);
+    // The entry count is checked by division, so it can't overflow.
+    const size_t entry_count = EntryCount(node);
+    const size_t heap_size = HeapSize(node);
+    if (type == Type::kInner)
+      return entry_count > InnerCapacity(node.size()) || heap_size != 0;
+    if (UNLIKELY(type != Type::kLeaf))
+      return true;
+    const size_t capacity = node.size() - kHeaderSize;
+    if (UNLIKELY(capacity / (kKeySize + 4) < entry_count))
+      return true;
+    return heap_size > capacity - entry_count * (kKeySize + 4) ||
+           (heap_size & 1) != 0;
+  }
+
+  /** True if a node's entries are consistent with each other.
+   *
+   * The keys must be strictly increasing, and the values of leaf entries must
+   * pass LeafValue()'s checks. This is checked before a node is split. */
+  static inline bool HasValidEntries(span<const uint8_t> node) noexcept {
+    const size_t entry_count = EntryCount(node);
+    for (size_t i = 1; i < entry_count; ++i) {
+      if (UNLIKELY(KeyAt(node, i - 1) >= KeyAt(node, i)))
+        return false;
+    }
+    if (NodeType(node) == Type::kInner)
+      return true;
+    for (size_t i = 0; i < entry_count; ++i) {
+      if (UNLIKELY(std::get<0>(LeafValue(node, i)) != Status::kSuccess))
+        return false;
+    }
+    return true;
+  }
+
+  /** The key at a position in the node. */
+  static inline KeyType KeyAt(span<const uint8_t> node, size_t index)
+      noexcept {
+    return LoadKey(node.subspan(kHeaderSize + index * kKeySize, kKeySize));
+  }
+
+  /** The number of keys in the node that are smaller than the given key.
+   *
+   * This is the position of the key, or the position where the key would be
+   * inserted. The binary search compiles down to conditional moves, so its
+   * running time does not depend on the keys' values.
+   */
+  static inline size_t LowerBound(span<const uint8_t> node, KeyType key)
+      noexcept {
+    const size_t entry_count = EntryCount(node);
+    if (entry_count == 0)
+      return 0;
+    size_t first = 0;
+    size_t size = entry_count;
+    while (size > 1) {
+      const size_t half = size / 2;
+      first = (KeyAt(node, first + half - 1) < key) ? first + half : first;
+      size -= half;
+    }
+    return first + (KeyAt(node, first) < key ? 1 : 0);
+  }
+
+  /** The number of keys in the node that are smaller than or equal to a key.
+   *
+   * See LowerBound() for details.
+   */
+  static inline size_t UpperBound(span<const uint8_t> node, KeyType key)
+      noexcept {
+    const size_t entry_count = EntryCount(node);
+    if (entry_count == 0)
+      return 0;
+    size_t first = 0;
+    size_t size = entry_count;
+    while (size > 1) {
+      const size_t half = size / 2;
+      first = (KeyAt(node, first + half - 1) <= key) ? first + half : first;
+      size -= half;
+    }
+    return first + (KeyAt(node, first) <= key ? 1 : 0);
+  }
+
+  /** Looks up a key in a leaf.
+   *
+   * @return found true if the leaf contains the key
+   * @return index the key's position, or the position where the key would be
+   *               inserted
+   */
+  static inline std::tuple<bool, size_t> LeafFind(span<const uint8_t> node,
+                                                  KeyType key) noexcept {
+    BERRYDB_ASSUME(NodeType(node) == Type::kLeaf);
+    const size_t index = LowerBound(node, key);
+    return {index < EntryCount(node) && KeyAt(node, index) == key, index};
+  }
+
+  /** The value stored in a leaf entry.
+   *
+   * @return status      kSuccess, or kDataCorrupted if the entry's value does
+   *                     not fit in the node's heap
+   * @return value       the value bytes
+   * @return is_overflow if true, the entry holds a reference to the value's
+   *                     overflow pages, instead of the value
+   */
+  static inline std::tuple<Status, span<const uint8_t>, bool> LeafValue(
+      span<const uint8_t> node, size_t index) noexcept {
+    BERRYDB_ASSUME_LT(index, EntryCount(node));
+    const size_t offset = ValueOffset(node, index);
+    if (UNLIKELY(offset < 2 || offset > HeapSize(node) || (offset & 1) != 0))
+      return {Status::kDataCorrupted, span<const uint8_t>(), false};
+    const size_t value_header = LoadUint16(
+        node.subspan(node.size() - offset, 2));
+    const size_t value_size = value_header & ~kOverflowValueFlag;
+    if (UNLIKELY(value_size > offset - 2))
+      return {Status::kDataCorrupted, span<const uint8_t>(), false};
+    return {Status::kSuccess,
+            node.subspan(node.size() - offset + 2, value_size),
+            (value_header & kOverflowValueFlag) != 0};
+  }
+
+  /** The value stored in a leaf entry, for in-place updates.
+   *
+   * The entry must have passed LeafValue()'s checks. */
+  static inline span<uint8_t> LeafMutableValue(span<uint8_t> node,
+                                               size_t index) noexcept {
+    const size_t offset = ValueOffset(node, index);
+    const size_t value_size = LoadUint16(
+        node.subspan(node.size() - offset, 2)) & ~kOverflowValueFlag;
+    return node.subspan(node.size() - offset + 2, value_size);
+  }
+
+  /** Adds an entry to a leaf.
+   *
+   * @param  node        the leaf that receives the entry
+   * @param  index       the entry's position; must preserve the key order
+   * @param  key         the entry's key
+   * @param  value       the entry's value; at most MaxValueSize() bytes
+   * @param  is_overflow true if the value is a reference to overflow pages
+   * @return             false if the leaf does not have room for the entry
+   */
+  static inline bool LeafInsert(span<uint8_t> node, size_t index, KeyType key,
+                                span<const uint8_t> value, bool is_overflow)
+      noexcept {
+    const size_t entry_count = EntryCount(node);
+    const size_t heap_size = HeapSize(node);
+    BERRYDB_ASSUME_LE(index, entry_count);
+    BERRYDB_ASSUME_LE(value.size(), kMaxEncodableValueSize);
+
+    const size_t value_entry_size = ValueEntrySize(value.size());
+    const size_t used_size =
+        kHeaderSize + entry_count * (kKeySize + 4) + heap_size;
+    if (used_size + kKeySize + 4 + value_entry_size > node.size())
+      return false;
+
+    // The offset array moves right to make room for the new key. The tail of
+    // the array moves first, because it moves further than the head.
+    uint8_t* const keys = node.data() + kHeaderSize;
+    uint8_t* const old_offsets = keys + entry_count * kKeySize;
+    uint8_t* const offsets = old_offsets + kKeySize;
+    std::memmove(offsets + (index + 1) * 4, old_offsets + index * 4,
+                 (entry_count - index) * 4);
+    std::memmove(offsets, old_offsets, index * 4);
+    std::memmove(keys + (index + 1) * kKeySize, keys + index * kKeySize,
+                 (entry_count - index) * kKeySize);
+    StoreKey(key, node.subspan(kHeaderSize + index * kKeySize, kKeySize));
+
+    const size_t new_heap_size = heap_size + value_entry_size;
+    StoreUint32(static_cast<uint32_t>(new_heap_size),
+                span<uint8_t>(offsets + index * 4, 4));
+    const span<uint8_t> value_entry =
+        node.subspan(node.size() - new_heap_size, value_entry_size);
+    StoreUint16(static_cast<uint16_t>(
+                    value.size() | (is_overflow ? kOverflowValueFlag : 0)),
+                value_entry.subspan(0, 2));
+    if (!value.empty())
+      std::memcpy(value_entry.data() + 2, value.data(), value.size());
+    if ((value.size() & 1) != 0)
+      value_entry[value_entry_size - 1] = 0;
+
+    SetEntries(entry_count + 1, new_heap_size, node);
+    return true;
+  }
+
+  /** Removes an entry from a leaf, compacting the leaf's heap.
+   *
+   * The entry must have passed LeafValue()'s checks. */
+  static inline void LeafRemove(span<uint8_t> node, size_t index) noexcept {
+    const size_t entry_count = EntryCount(node);
+    const size_t heap_size = HeapSize(node);
+    BERRYDB_ASSUME_LT(index, entry_count);
+
+    // The values stored below the removed value move up to fill the gap.
+    const size_t offset = ValueOffset(node, index);
+    const size_t value_entry_size = ValueEntrySize(LoadUint16(
+        node.subspan(node.size() - offset, 2)) & ~kOverflowValueFlag);
+    uint8_t* const heap = node.data() + node.size() - heap_size;
+    std::memmove(heap + value_entry_size, heap, heap_size - offset);
+    for (size_t i = 0; i < entry_count; ++i) {
+      const size_t entry_offset = ValueOffset(node, i);
+      if (entry_offset > offset) {
+        StoreUint32(static_cast<uint32_t>(entry_offset - value_entry_size),
+                    OffsetSpan(node, entry_count, i));
+      }
+    }
+
+    uint8_t* const keys = node.data() + kHeaderSize;
+    uint8_t* const old_offsets = keys + entry_count * kKeySize;
+    uint8_t* const offsets = old_offsets - kKeySize;
+    std::memmove(keys + index * kKeySize, keys + (index + 1) * kKeySize,
+                 (entry_count - index - 1) * kKeySize);
+    std::memmove(offsets, old_offsets, index * 4);
+    std::memmove(offsets + index * 4, old_offsets + (index + 1) * 4,
+                 (entry_count - index - 1) * 4);
+    FillSpan(span<uint8_t>(heap, value_entry_size), 0);
+    FillSpan(node.subspan(kHeaderSize + (entry_count - 1) * (kKeySize + 4),
+                          kKeySize + 4), 0);
+
+    SetEntries(entry_count - 1, heap_size - value_entry_size, node);
+  }
+
+  /** The child page that may hold a key.
+   *
+   * The returned page ID must be validated before use. */
+  static inline uint64_t InnerChild(span<const uint8_t> node, KeyType key)
+      noexcept {
+    BERRYDB_ASSUME(NodeType(node) == Type::kInner);
+    return InnerChildAt(node, UpperBound(node, key));
+  }
+
+  /** The child page at a position in an inner node.
+   *
+   * Position 0 is the node's link, and position i > 0 is the child of the
+   * entry at position i - 1. */
+  static inline uint64_t InnerChildAt(span<const uint8_t> node,
+                                      size_t position) noexcept {
+    BERRYDB_ASSUME_LE(position, EntryCount(node));
+    if (position == 0)
+      return Link64(node);
+    return LoadUint64(node.subspan(node.size() - position * 8, 8));
+  }
+
+  /** Adds an entry to an inner node.
+   *
+   * @param  node    the node that receives the entry
+   * @param  index   the entry's position; must preserve the key order
+   * @param  key     the entry's key
+   * @param  child64 the page ID of the child holding the keys >= the key
+   * @return         false if the node does not have room for the entry
+   */
+  static inline bool InnerInsert(span<uint8_t> node, size_t index, KeyType key,
+                                 uint64_t child64) noexcept {
+    const size_t entry_count = EntryCount(node);
+    BERRYDB_ASSUME_LE(index, entry_count);
+    if (entry_count >= InnerCapacity(node.size()))
+      return false;
+
+    uint8_t* const keys = node.data() + kHeaderSize;
+    std::memmove(keys + (index + 1) * kKeySize, keys + index * kKeySize,
+                 (entry_count - index) * kKeySize);
+    StoreKey(key, node.subspan(kHeaderSize + index * kKeySize, kKeySize));
+
+    // The children array grows down, so the children after the new entry move
+    // down by one slot.
+    uint8_t* const children_end = node.data() + node.size();
+    std::memmove(children_end - (entry_count + 1) * 8,
+                 children_end - entry_count * 8, (entry_count - index) * 8);
+    StoreUint64(child64, node.subspan(node.size() - (index + 1) * 8, 8));
+
+    SetEntries(entry_count + 1, 0, node);
+    return true;
+  }
+
+  /** Moves the entries of an overflowing node into two nodes.
+   *
+   * Leaves are split so that the halves use about the same amount of space.
+   * The key that separates inner halves moves up to the parent, so it is not
+   * stored in either half.
+   *
+   * @param  node          the overflowing node, usually in a scratch buffer;
+   *                       must pass HasValidEntries()
+   * @param  left          receives the entries smaller than the separator
+   * @param  right         receives the remaining entries
+   * @param  right_page_id the ID of the page that will hold the right half
+   * @return               the smallest key in the right half
+   */
+  static inline KeyType Split(span<const uint8_t> node, span<uint8_t> left,
+                              span<uint8_t> right, size_t right_page_id)
+      noexcept {
+    const size_t entry_count = EntryCount(node);
+    BERRYDB_ASSUME_GE(entry_count, 2U);
+
+    if (NodeType(node) == Type::kInner) {
+      const size_t middle = entry_count / 2;
+      Initialize(Type::kInner, Link64(node), left);
+      Initialize(Type::kInner, InnerChildAt(node, middle + 1), right);
+      for (size_t i = 0; i < middle; ++i)
+        InnerInsert(left, i, KeyAt(node, i), InnerChildAt(node, i + 1));
+      for (size_t i = middle + 1; i < entry_count; ++i) {
+        InnerInsert(right, i - middle - 1, KeyAt(node, i),
+                    InnerChildAt(node, i + 1));
+      }
+      return KeyAt(node, middle);
+    }
+
+    // The left half gets the entries that fill up half of the used space.
+    const size_t total_size = entry_count * (kKeySize + 4) + HeapSize(node);
+    size_t left_size = 0;
+    size_t middle = 0;
+    while (middle < entry_count - 1 && left_size * 2 < total_size) {
+      left_size += kKeySize + 4 + ValueEntrySize(std::get<1>(
+          LeafValue(node, middle)).size());
+      ++middle;
+    }
+    if (middle == 0)
+      middle = 1;
+
+    Initialize(Type::kLeaf, right_page_id, left);
+    Initialize(Type::kLeaf, Link64(node), right);
+    for (size_t i = 0; i < entry_count; ++i) {
+      Status status;
+      span<const uint8_t> value;
+      bool is_overflow;
+      std::tie(status, value, is_overflow) = LeafValue(node, i);
+      BERRYDB_ASSUME(status == Status::kSuccess);
+      if (i < middle)
+        LeafInsert(left, i, KeyAt(node, i), value, is_overflow);
+      else
+        LeafInsert(right, i - middle, KeyAt(node, i), value, is_overflow);
+    }
+    return KeyAt(node, middle);
+  }
+
+  /** Copies a node into a buffer that is at least as large. */
+  static inline void CopyNode(span<const uint8_t> node, span<uint8_t> to)
+      noexcept {
+    BERRYDB_ASSUME_GE(to.size(), node.size());
+    FillSpan(to, 0);
+    const size_t entry_count = EntryCount(node);
+    if (NodeType(node) == Type::kInner) {
+      std::memcpy(to.data(), node.data(),
+                  kHeaderSize + entry_count * kKeySize);
+      std::memcpy(to.data() + to.size() - entry_count * 8,
+                  node.data() + node.size() - entry_count * 8,
+                  entry_count * 8);
+      return;
+    }
+    const size_t heap_size = HeapSize(node);
+    std::memcpy(to.data(), node.data(),
+                kHeaderSize + entry_count * (kKeySize + 4));
+    std::memcpy(to.data() + to.size() - heap_size,
+                node.data() + node.size() - heap_size, heap_size);
+  }
+
+ private:
+  static constexpr size_t kTypeOffset = 0;
+  static constexpr size_t kEntryCountOffset = 4;
+  static constexpr size_t kHeapSizeOffset = 8;
+  static constexpr size_t kLinkOffset = 16;
+
+  /** The value size limit imposed by the 15-bit value size field. */
+  static constexpr size_t kMaxEncodableValueSize = 0x7FF8;
+
+  /** Set in a value's size field if the value is stored in overflow pages. */
+  static constexpr size_t kOverflowValueFlag = 0x8000;
+
+  /** The heap space used by a value, including the value's size field. */
+  static constexpr size_t ValueEntrySize(size_t value_size) noexcept {
+    return (2 + value_size + 1) & ~static_cast<size_t>(1);
+  }
+
+  static inline KeyType LoadKey(span<const uint8_t> from) noexcept {
+    return LoadKeyOfSize(from, std::integral_constant<size_t, kKeySize>());
+  }
+  static inline uint32_t LoadKeyOfSize(
+      span<const uint8_t> from, std::integral_constant<size_t, 4>) noexcept {
+    return LoadUint32(from);
+  }
+  static inline uint64_t LoadKeyOfSize(
+      span<const uint8_t> from, std::integral_constant<size_t, 8>) noexcept {
+    return LoadUint64(from);
+  }
+
+  static inline void StoreKey(KeyType key, span<uint8_t> to) noexcept {
+    StoreKeyOfSize(key, to, std::integral_constant<size_t, kKeySize>());
+  }
+  static inline void StoreKeyOfSize(
+      uint32_t key, span<uint8_t> to, std::integral_constant<size_t, 4>)
+      noexcept {
+    StoreUint32(key, to);
+  }
+  static inline void StoreKeyOfSize(
+      uint64_t key, span<uint8_t> to, std::integral_constant<size_t, 8>)
+      noexcept {
+    StoreUint64(key, to);
+  }
+
+  /** The location of a leaf entry's value offset. */
+  static inline span<uint8_t> OffsetSpan(
+      span<uint8_t> node, size_t entry_count, size_t index) noexcept {
+    return node.subspan(kHeaderSize + entry_count * kKeySize + index * 4, 4);
+  }
+
+  /** A leaf entry's value offset, measured from the end of the node. */
+  static inline size_t ValueOffset(span<const uint8_t> node, size_t index)
+      noexcept {
+    return LoadUint32(node.subspan(
+        kHeaderSize + EntryCount(node) * kKeySize + index * 4, 4));
+  }
+
+  static inline void SetEntries(size_t entry_count, size_t heap_size,
+                                span<uint8_t> node) noexcept {
+    StoreUint32(static_cast<uint32_t>(entry_count),
+                node.subspan(kEntryCountOffset, 4));
+    StoreUint32(static_cast<uint32_t>(heap_size),
+                node.subspan(kHeapSizeOffset, 4));
+  }
+};
+
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kHeaderSize;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kKeySize;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kLeafEntryOverhead;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kInnerEntrySize;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kTypeOffset;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kEntryCountOffset;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kHeapSizeOffset;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kLinkOffset;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kMaxEncodableValueSize;
+template <typename KeyType>
+constexpr size_t IntegerBTreeNode<KeyType>::kOverflowValueFlag;
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_INTEGER_BTREE_NODE_H_
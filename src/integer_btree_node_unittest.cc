@@ -0,0 +1,319 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./integer_btree_node.h"
+
+#include <string>
+#include <tuple>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/status.h"
+
+namespace berrydb {
+
+namespace {
+
+constexpr size_t kNodeSize = 256;
+
+using Node64 = IntegerBTreeNode<uint64_t>;
+using Node32 = IntegerBTreeNode<uint32_t>;
+
+span<const uint8_t> StringSpan(const std::string& string) {
+  return span<const uint8_t>(reinterpret_cast<const uint8_t*>(string.data()),
+                             string.size());
+}
+
+std::string SpanString(span<const uint8_t> data) {
+  return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+/** Inserts an entry in a leaf, asserting that it fits. */
+template <typename Node, typename KeyType>
+void InsertInLeaf(span<uint8_t> node, KeyType key, const std::string& value) {
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node::LeafFind(node, key);
+  ASSERT_FALSE(found);
+  ASSERT_TRUE(Node::LeafInsert(node, index, key, StringSpan(value), false));
+}
+
+/** The value stored for a key in a leaf, or "(missing)". */
+template <typename Node, typename KeyType>
+std::string LeafLookup(span<const uint8_t> node, KeyType key) {
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node::LeafFind(node, key);
+  if (!found)
+    return "(missing)";
+  Status status;
+  span<const uint8_t> value;
+  bool is_overflow;
+  std::tie(status, value, is_overflow) = Node::LeafValue(node, index);
+  EXPECT_EQ(Status::kSuccess, status);
+  EXPECT_FALSE(is_overflow);
+  return SpanString(value);
+}
+
+}  // namespace
+
+TEST(IntegerBTreeNodeTest, ZeroedPageIsEmptyLeaf) {
+  alignas(8) uint8_t buffer[kNodeSize] = {};
+  span<uint8_t> node(buffer);
+
+  EXPECT_FALSE(Node64::IsCorrupt(node));
+  EXPECT_EQ(Node64::Type::kLeaf, Node64::NodeType(node));
+  EXPECT_EQ(0U, Node64::EntryCount(node));
+  EXPECT_EQ(0U, Node64::Link64(node));
+  EXPECT_EQ("(missing)", (LeafLookup<Node64, uint64_t>(node, 42)));
+}
+
+TEST(IntegerBTreeNodeTest, DecodeKeyIsBigEndian) {
+  EXPECT_EQ(0x0102030405060708U,
+            Node64::DecodeKey(StringSpan("\x01\x02\x03\x04\x05\x06\x07\x08")));
+  EXPECT_EQ(0xFF000001U, Node32::DecodeKey(StringSpan(
+      std::string("\xFF\x00\x00\x01", 4))));
+}
+
+TEST(IntegerBTreeNodeTest, LeafInsertFindRemove) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node64::Initialize(Node64::Type::kLeaf, 42, node);
+
+  InsertInLeaf<Node64, uint64_t>(node, 300, "yellow");
+  InsertInLeaf<Node64, uint64_t>(node, 1, "red");
+  InsertInLeaf<Node64, uint64_t>(node, 20, "green");
+  InsertInLeaf<Node64, uint64_t>(node, 0, "");
+  InsertInLeaf<Node64, uint64_t>(node, ~static_cast<uint64_t>(0), "max");
+  EXPECT_EQ(5U, Node64::EntryCount(node));
+  EXPECT_EQ(42U, Node64::Link64(node));
+  EXPECT_FALSE(Node64::IsCorrupt(node));
+  EXPECT_TRUE(Node64::HasValidEntries(node));
+
+  EXPECT_EQ("yellow", (LeafLookup<Node64, uint64_t>(node, 300)));
+  EXPECT_EQ("red", (LeafLookup<Node64, uint64_t>(node, 1)));
+  EXPECT_EQ("green", (LeafLookup<Node64, uint64_t>(node, 20)));
+  EXPECT_EQ("", (LeafLookup<Node64, uint64_t>(node, 0)));
+  EXPECT_EQ("max", (LeafLookup<Node64, uint64_t>(
+      node, ~static_cast<uint64_t>(0))));
+  EXPECT_EQ("(missing)", (LeafLookup<Node64, uint64_t>(node, 2)));
+  EXPECT_EQ("(missing)", (LeafLookup<Node64, uint64_t>(node, 301)));
+
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node64::LeafFind(node, 20);
+  ASSERT_TRUE(found);
+  EXPECT_EQ(2U, index);
+  Node64::LeafRemove(node, index);
+  EXPECT_EQ(4U, Node64::EntryCount(node));
+  EXPECT_TRUE(Node64::HasValidEntries(node));
+  EXPECT_EQ("(missing)", (LeafLookup<Node64, uint64_t>(node, 20)));
+  EXPECT_EQ("yellow", (LeafLookup<Node64, uint64_t>(node, 300)));
+  EXPECT_EQ("red", (LeafLookup<Node64, uint64_t>(node, 1)));
+  EXPECT_EQ("", (LeafLookup<Node64, uint64_t>(node, 0)));
+}
+
+TEST(IntegerBTreeNodeTest, LeafRemoveZeroesFreedSpace) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  alignas(8) uint8_t expected_buffer[kNodeSize];
+  span<uint8_t> node(buffer), expected(expected_buffer);
+  Node32::Initialize(Node32::Type::kLeaf, 0, node);
+  Node32::Initialize(Node32::Type::kLeaf, 0, expected);
+
+  InsertInLeaf<Node32, uint32_t>(node, 5, "apple");
+  InsertInLeaf<Node32, uint32_t>(node, 3, "kiwi");
+  InsertInLeaf<Node32, uint32_t>(node, 7, "mango");
+  InsertInLeaf<Node32, uint32_t>(expected, 5, "apple");
+  InsertInLeaf<Node32, uint32_t>(expected, 7, "mango");
+
+  bool found;
+  size_t index;
+  std::tie(found, index) = Node32::LeafFind(node, 3);
+  ASSERT_TRUE(found);
+  Node32::LeafRemove(node, index);
+  // The page only depends on its entries, not on its history.
+  EXPECT_EQ(SpanString(expected), SpanString(node));
+}
+
+TEST(IntegerBTreeNodeTest, LeafInsertRejectsEntriesThatDontFit) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node64::Initialize(Node64::Type::kLeaf, 0, node);
+
+  const std::string value(Node64::MaxValueSize(kNodeSize), 'v');
+  uint64_t key = 0;
+  while (Node64::LeafInsert(node, key, key, StringSpan(value), false))
+    ++key;
+  // Values are limited to a quarter of the node.
+  EXPECT_EQ(4U, key);
+  EXPECT_FALSE(Node64::IsCorrupt(node));
+  EXPECT_TRUE(Node64::HasValidEntries(node));
+}
+
+TEST(IntegerBTreeNodeTest, SearchMatchesLinearScan) {
+  alignas(8) uint8_t buffer[kNodeSize * 16];
+  span<uint8_t> node(buffer);
+  Node32::Initialize(Node32::Type::kInner, 1, node);
+
+  // Node sizes that are and aren't powers of two exercise the search's edges.
+  for (uint32_t count = 0; count < 40; ++count) {
+    for (uint32_t key = 0; key < count * 3 + 3; ++key) {
+      size_t lower = 0, upper = 0;
+      for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t node_key = i * 3 + 1;
+        if (node_key < key)
+          ++lower;
+        if (node_key <= key)
+          ++upper;
+      }
+      EXPECT_EQ(lower, Node32::LowerBound(node, key));
+      EXPECT_EQ(upper, Node32::UpperBound(node, key));
+    }
+    ASSERT_TRUE(Node32::InnerInsert(node, count, count * 3 + 1, count + 2));
+  }
+}
+
+TEST(IntegerBTreeNodeTest, InnerChildRouting) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node64::Initialize(Node64::Type::kInner, 100, node);
+
+  ASSERT_TRUE(Node64::InnerInsert(node, 0, 50, 102));
+  ASSERT_TRUE(Node64::InnerInsert(node, 0, 10, 101));
+  ASSERT_TRUE(Node64::InnerInsert(node, 2, 90, 103));
+  EXPECT_FALSE(Node64::IsCorrupt(node));
+  EXPECT_TRUE(Node64::HasValidEntries(node));
+
+  EXPECT_EQ(100U, Node64::InnerChild(node, 0));
+  EXPECT_EQ(100U, Node64::InnerChild(node, 9));
+  EXPECT_EQ(101U, Node64::InnerChild(node, 10));
+  EXPECT_EQ(101U, Node64::InnerChild(node, 49));
+  EXPECT_EQ(102U, Node64::InnerChild(node, 50));
+  EXPECT_EQ(103U, Node64::InnerChild(node, 90));
+  EXPECT_EQ(103U, Node64::InnerChild(node, ~static_cast<uint64_t>(0)));
+}
+
+TEST(IntegerBTreeNodeTest, InnerCapacity) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node64::Initialize(Node64::Type::kInner, 0, node);
+
+  // Entries only hold a key and a child ID.
+  const size_t capacity = (kNodeSize - Node64::kHeaderSize) / 16;
+  EXPECT_EQ(capacity, Node64::InnerCapacity(kNodeSize));
+  for (size_t i = 0; i < capacity; ++i)
+    ASSERT_TRUE(Node64::InnerInsert(node, i, i * 2, i + 1));
+  EXPECT_FALSE(Node64::InnerInsert(node, capacity, capacity * 2, 1));
+  EXPECT_FALSE(Node64::IsCorrupt(node));
+  for (size_t i = 0; i < capacity; ++i)
+    EXPECT_EQ(i + 1, Node64::InnerChild(node, i * 2 + 1));
+}
+
+TEST(IntegerBTreeNodeTest, CopyNodeToLargerBuffer) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  alignas(8) uint8_t large_buffer[kNodeSize * 2];
+  span<uint8_t> node(buffer), large_node(large_buffer);
+  Node64::Initialize(Node64::Type::kInner, 7, node);
+  ASSERT_TRUE(Node64::InnerInsert(node, 0, 10, 8));
+  ASSERT_TRUE(Node64::InnerInsert(node, 1, 20, 9));
+
+  Node64::CopyNode(node, large_node);
+  EXPECT_FALSE(Node64::IsCorrupt(large_node));
+  EXPECT_EQ(7U, Node64::InnerChild(large_node, 5));
+  EXPECT_EQ(8U, Node64::InnerChild(large_node, 15));
+  EXPECT_EQ(9U, Node64::InnerChild(large_node, 25));
+
+  Node64::Initialize(Node64::Type::kLeaf, 0, node);
+  InsertInLeaf<Node64, uint64_t>(node, 1, "red");
+  InsertInLeaf<Node64, uint64_t>(node, 2, "green");
+  Node64::CopyNode(node, large_node);
+  EXPECT_FALSE(Node64::IsCorrupt(large_node));
+  EXPECT_EQ("red", (LeafLookup<Node64, uint64_t>(large_node, 1)));
+  EXPECT_EQ("green", (LeafLookup<Node64, uint64_t>(large_node, 2)));
+  InsertInLeaf<Node64, uint64_t>(large_node, 3, "yellow");
+  EXPECT_EQ("yellow", (LeafLookup<Node64, uint64_t>(large_node, 3)));
+}
+
+TEST(IntegerBTreeNodeTest, SplitLeaf) {
+  alignas(8) uint8_t buffer[kNodeSize * 2];
+  alignas(8) uint8_t left_buffer[kNodeSize];
+  alignas(8) uint8_t right_buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node64::Initialize(Node64::Type::kLeaf, 7, node);
+
+  for (uint64_t i = 0; i < 20; ++i)
+    InsertInLeaf<Node64, uint64_t>(node, 100 + i, std::to_string(i));
+  ASSERT_TRUE(Node64::HasValidEntries(node));
+
+  span<uint8_t> left(left_buffer), right(right_buffer);
+  const uint64_t separator = Node64::Split(node, left, right, 99);
+  EXPECT_EQ(110U, separator);
+  EXPECT_FALSE(Node64::IsCorrupt(left));
+  EXPECT_FALSE(Node64::IsCorrupt(right));
+  EXPECT_EQ(10U, Node64::EntryCount(left));
+  EXPECT_EQ(10U, Node64::EntryCount(right));
+  EXPECT_EQ(99U, Node64::Link64(left));
+  EXPECT_EQ(7U, Node64::Link64(right));
+
+  for (uint64_t i = 0; i < 20; ++i) {
+    const uint64_t key = 100 + i;
+    if (key < separator) {
+      EXPECT_EQ(std::to_string(i), (LeafLookup<Node64, uint64_t>(left, key)));
+      EXPECT_EQ("(missing)", (LeafLookup<Node64, uint64_t>(right, key)));
+    } else {
+      EXPECT_EQ("(missing)", (LeafLookup<Node64, uint64_t>(left, key)));
+      EXPECT_EQ(std::to_string(i), (LeafLookup<Node64, uint64_t>(right, key)));
+    }
+  }
+}
+
+TEST(IntegerBTreeNodeTest, SplitInner) {
+  alignas(8) uint8_t buffer[kNodeSize * 2];
+  alignas(8) uint8_t left_buffer[kNodeSize];
+  alignas(8) uint8_t right_buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node32::Initialize(Node32::Type::kInner, 1000, node);
+  for (uint32_t i = 0; i < 21; ++i)
+    ASSERT_TRUE(Node32::InnerInsert(node, i, i * 10, 1001 + i));
+
+  span<uint8_t> left(left_buffer), right(right_buffer);
+  const uint32_t separator = Node32::Split(node, left, right, 99);
+  // The separator moves up to the parent, and its child becomes the right
+  // half's link.
+  EXPECT_EQ(100U, separator);
+  EXPECT_EQ(10U, Node32::EntryCount(left));
+  EXPECT_EQ(10U, Node32::EntryCount(right));
+  EXPECT_EQ(1000U, Node32::Link64(left));
+  EXPECT_EQ(1011U, Node32::Link64(right));
+  for (uint32_t i = 0; i < 21; ++i) {
+    const uint32_t key = i * 10 + 5;
+    if (key < separator)
+      EXPECT_EQ(1001U + i, Node32::InnerChild(left, key));
+    else
+      EXPECT_EQ(1001U + i, Node32::InnerChild(right, key));
+  }
+}
+
+TEST(IntegerBTreeNodeTest, CorruptNodes) {
+  alignas(8) uint8_t buffer[kNodeSize];
+  span<uint8_t> node(buffer);
+  Node64::Initialize(Node64::Type::kLeaf, 0, node);
+  InsertInLeaf<Node64, uint64_t>(node, 1, "red");
+
+  // Value offsets that point outside the heap are caught by LeafValue().
+  StoreUint32(0x1000, node.subspan(Node64::kHeaderSize + 8, 4));
+  EXPECT_FALSE(Node64::IsCorrupt(node));
+  EXPECT_EQ(Status::kDataCorrupted, std::get<0>(Node64::LeafValue(node, 0)));
+  EXPECT_FALSE(Node64::HasValidEntries(node));
+
+  // Entry counts that don't fit in the node are caught by IsCorrupt().
+  Node64::Initialize(Node64::Type::kInner, 0, node);
+  StoreUint32(static_cast<uint32_t>(Node64::InnerCapacity(kNodeSize) + 1),
+              node.subspan(4, 4));
+  EXPECT_TRUE(Node64::IsCorrupt(node));
+  StoreUint16(2, node.subspan(0, 2));
+  EXPECT_TRUE(Node64::IsCorrupt(node));
+}
+
+}  // namespace berrydb
@@ -0,0 +1,374 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./integer_btree.h"
+
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/catalog.h"
+#include "berrydb/cursor.h"
+#include "berrydb/options.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "./store_impl.h"
+#include "./test/space_helpers.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+bool NoPairs(void*, span<const uint8_t>*, span<const uint8_t>*) {
+  return false;
+}
+
+}  // namespace
+
+class IntegerBTreeTest : public SpaceTest {
+ protected:
+  IntegerBTreeTest() : SpaceTest("test_integer_btree.berry") {}
+
+  /** Creates an integer-keyed space in the root catalog, and commits it. */
+  void CreateSpace(const std::string& name, size_t key_size) {
+    key_size_ = key_size;
+    space_options_.integer_key_size = key_size;
+    SpaceTest::CreateSpace(name);
+  }
+
+  /** The big-endian encoding of an integer key. */
+  std::string Key(uint64_t key) {
+    std::string encoded(key_size_, '\0');
+    for (size_t i = key_size_; i-- > 0; key >>= 8)
+      encoded[i] = static_cast<char>(key & 0xFF);
+    return encoded;
+  }
+
+  /** The value of a key, or "(missing)". */
+  template <typename TransactionType>
+  std::string Get(TransactionType* transaction, uint64_t key) {
+    return SpaceGet(transaction, space_.get(), StringSpan(Key(key)));
+  }
+
+  Status Put(Transaction* transaction, uint64_t key, const std::string& value) {
+    return transaction->Put(space_.get(), StringSpan(Key(key)),
+                            StringSpan(value));
+  }
+
+  /** Checks that the space's content matches a map. */
+  void ExpectSpaceMatches(const std::map<uint64_t, std::string>& expected,
+                          const std::vector<uint64_t>& missing_keys) {
+    std::map<std::string, std::string> encoded_expected;
+    for (const auto& entry : expected)
+      encoded_expected.emplace(Key(entry.first), entry.second);
+    std::vector<std::string> encoded_missing_keys;
+    for (uint64_t key : missing_keys)
+      encoded_missing_keys.push_back(Key(key));
+    SpaceTest::ExpectSpaceMatches(encoded_expected, encoded_missing_keys);
+  }
+
+  size_t key_size_ = 8;
+};
+
+TEST_F(IntegerBTreeTest, PutGetDelete) {
+  OpenStore();
+  CreateSpace("space", 8);
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("(missing)", Get(transaction.get(), 42));
+  ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 42, "value"));
+  EXPECT_EQ("value", Get(transaction.get(), 42));
+  ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 42, "longer value"));
+  EXPECT_EQ("longer value", Get(transaction.get(), 42));
+  ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 0, ""));
+  EXPECT_EQ("", Get(transaction.get(), 0));
+  ASSERT_EQ(Status::kSuccess,
+            Put(transaction.get(), ~static_cast<uint64_t>(0), "max"));
+  EXPECT_EQ("max", Get(transaction.get(), ~static_cast<uint64_t>(0)));
+
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan(Key(42))));
+  EXPECT_EQ("(missing)", Get(transaction.get(), 42));
+  // Deleting a missing key succeeds.
+  ASSERT_EQ(Status::kSuccess, transaction->Delete(
+      space_.get(), StringSpan(Key(42))));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(IntegerBTreeTest, RandomOperationsMatchMap) {
+  // Small pages fill up quickly, so the tree grows several levels.
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space", 4);
+
+  std::map<uint64_t, std::string> expected;
+  std::vector<uint64_t> keys;
+  std::uniform_int_distribution<uint64_t> key_distribution(0, 0xFFFFFFFF);
+  std::uniform_int_distribution<size_t> value_size_distribution(0, 120);
+  std::uniform_int_distribution<int> operation_distribution(0, 9);
+
+  for (int round = 0; round < 20; ++round) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 500; ++i) {
+      const int operation = operation_distribution(rnd_);
+      if (operation < 2 && !keys.empty()) {
+        // Delete a key that was inserted earlier.
+        const uint64_t key = keys[rnd_() % keys.size()];
+        ASSERT_EQ(Status::kSuccess,
+                  transaction->Delete(space_.get(), StringSpan(Key(key))));
+        expected.erase(key);
+        continue;
+      }
+
+      const uint64_t key = key_distribution(rnd_);
+      const std::string value =
+          RandomValue(&rnd_, value_size_distribution(rnd_));
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), key, value));
+      expected[key] = value;
+      keys.push_back(key);
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // The tree survives closing and reopening the store.
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  OpenSpace("space");
+  key_size_ = 4;
+  ExpectSpaceMatches(expected, keys);
+}
+
+TEST_F(IntegerBTreeTest, SequentialInsertsGrowTree) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space", 8);
+
+  // Ascending and descending inserts split the tree's edges over and over.
+  constexpr uint64_t kKeyCount = 20000;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (uint64_t i = 0; i < kKeyCount; ++i) {
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), kKeyCount + i,
+                                      std::to_string(i)));
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), kKeyCount - i,
+                                      std::to_string(i)));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (uint64_t i = 0; i < kKeyCount; ++i) {
+    ASSERT_EQ(std::to_string(i), Get(reader.get(), kKeyCount + i));
+    ASSERT_EQ(std::to_string(i), Get(reader.get(), kKeyCount - i));
+  }
+  EXPECT_EQ("(missing)", Get(reader.get(), 0));
+  EXPECT_EQ("(missing)", Get(reader.get(), kKeyCount * 2));
+}
+
+TEST_F(IntegerBTreeTest, RolledBackChangesAreUndone) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space", 8);
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 5000, "committed"));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    // The transaction splits nodes, which must be undone as well.
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 5000, "rolled back"));
+    for (uint64_t i = 0; i < 1000; ++i)
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), i, "value"));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  EXPECT_EQ("committed", Get(transaction.get(), 5000));
+  EXPECT_EQ("(missing)", Get(transaction.get(), 0));
+  EXPECT_EQ("(missing)", Get(transaction.get(), 999));
+  ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 0, "value"));
+  EXPECT_EQ("value", Get(transaction.get(), 0));
+}
+
+TEST_F(IntegerBTreeTest, ReadTransactionsSeeSnapshots) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space", 4);
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (uint64_t i = 0; i < 100; ++i)
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), i, "old"));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  // The writer splits the root, which the old reader's lookups start at.
+  UniquePtr<ReadTransaction> old_reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (uint64_t i = 0; i < 2000; ++i)
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), i, "new"));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  for (uint64_t i = 0; i < 100; ++i)
+    ASSERT_EQ("old", Get(old_reader.get(), i));
+  EXPECT_EQ("(missing)", Get(old_reader.get(), 1999));
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  for (uint64_t i = 0; i < 2000; ++i)
+    ASSERT_EQ("new", Get(new_reader.get(), i));
+}
+
+TEST_F(IntegerBTreeTest, WrongKeySizesNotSupported) {
+  OpenStore();
+  CreateSpace("space", 8);
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 1, "value"));
+  EXPECT_EQ(Status::kNotSupported, transaction->Put(
+      space_.get(), StringSpan("key"), StringSpan("value")));
+  EXPECT_EQ(Status::kNotSupported, transaction->ReserveValue(
+      space_.get(), StringSpan("123456789"), 10));
+  EXPECT_EQ(Status::kNotSupported, transaction->WriteValue(
+      space_.get(), StringSpan(""), 0, StringSpan("value")));
+  EXPECT_EQ(Status::kNotSupported, transaction->Delete(
+      space_.get(), StringSpan("key")));
+  EXPECT_EQ(Status::kNotSupported, std::get<0>(transaction->Get(
+      space_.get(), StringSpan(Key(1).substr(1)))));
+  EXPECT_EQ("value", Get(transaction.get(), 1));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  // Key sizes other than 4 and 8 are rejected when the space is created, and
+  // integer keys can't be combined with hashing.
+  transaction.reset(store_->CreateTransaction());
+  SpaceOptions options;
+  options.integer_key_size = 2;
+  EXPECT_EQ(Status::kNotSupported, std::get<0>(transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("short"), options)));
+  options.integer_key_size = 8;
+  options.hashed = true;
+  EXPECT_EQ(Status::kNotSupported, std::get<0>(transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("hashed"), options)));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(IntegerBTreeTest, LargeValues) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space", 8);
+
+  // Large values are stored in overflow pages, and move with their keys when
+  // leaves are split.
+  std::map<uint64_t, std::string> expected;
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (uint64_t i = 0; i < 500; ++i) {
+      const std::string value = RandomValue(&rnd_, (i % 7 == 0) ? 3000 : 40);
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), i * 3, value));
+      expected[i * 3] = value;
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, {1, 2, 4});
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+      space_.get(), StringSpan(Key(10000)), 5000));
+  ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+      space_.get(), StringSpan(Key(10000)), 4000, StringSpan("hello")));
+  EXPECT_EQ(Status::kTooLarge, transaction->WriteValue(
+      space_.get(), StringSpan(Key(10000)), 4998, StringSpan("hello")));
+  ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+      space_.get(), StringSpan(Key(3)), 10, StringSpan("hello")));
+  EXPECT_EQ(Status::kNotFound, transaction->WriteValue(
+      space_.get(), StringSpan(Key(1)), 0, StringSpan("hello")));
+
+  std::string reserved(5000, '\0');
+  reserved.replace(4000, 5, "hello");
+  EXPECT_EQ(reserved, Get(transaction.get(), 10000));
+  EXPECT_EQ(expected[3].replace(10, 5, "hello"), Get(transaction.get(), 3));
+
+  char buffer[8];
+  Status status;
+  size_t value_size;
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan(Key(10000)), 3998,
+      span<uint8_t>(reinterpret_cast<uint8_t*>(buffer), sizeof(buffer)));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(5000U, value_size);
+  EXPECT_EQ(std::string("\0\0hello\0", 8), std::string(buffer, 8));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+TEST_F(IntegerBTreeTest, LargeValuePagesAreReused) {
+  CreatePool(10, 64);
+  OpenStore();
+  CreateSpace("space", 8);
+  FreePageManager* free_page_manager =
+      StoreImpl::FromApi(store_.get())->free_page_manager();
+
+  std::map<uint64_t, std::string> expected;
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < 20; ++i)
+    keys.push_back(i * 3);
+  size_t warm_page_count = 0;
+  for (int round = 0; round < 60; ++round) {
+    if (round == 10)
+      warm_page_count = free_page_manager->page_count();
+
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 5; ++i) {
+      const uint64_t key = keys[rnd_() % keys.size()];
+      if (rnd_() % 4 == 0) {
+        const Status status =
+            transaction->Delete(space_.get(), StringSpan(Key(key)));
+        ASSERT_TRUE(status == Status::kSuccess || status == Status::kNotFound);
+        expected.erase(key);
+        continue;
+      }
+      const std::string value = RandomValue(&rnd_, 1024 + rnd_() % 3000);
+      ASSERT_EQ(Status::kSuccess, Put(transaction.get(), key, value));
+      expected[key] = value;
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  ExpectSpaceMatches(expected, keys);
+
+  // 20 live values use at most 80 pages. Without page reuse, the 250 values
+  // written after warm-up would use about 600 pages.
+  EXPECT_LT(free_page_manager->page_count(), warm_page_count + 200);
+}
+
+TEST_F(IntegerBTreeTest, ScansAndBulkLoadsNotSupported) {
+  OpenStore();
+  CreateSpace("space", 8);
+
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, Put(transaction.get(), 1, "value"));
+    EXPECT_EQ(Status::kNotSupported,
+              transaction->BulkLoad(space_.get(), &NoPairs, nullptr));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  EXPECT_EQ(Status::kNotSupported, cursor->SeekToFirst());
+  EXPECT_EQ(Status::kNotSupported, cursor->Seek(StringSpan(Key(1))));
+  EXPECT_FALSE(cursor->Valid());
+}
+
+}  // namespace berrydb
@@ -0,0 +1,212 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./lock_manager.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "berrydb/status.h"
+
+namespace berrydb {
+
+LockManager::LockManager(size_t timeout_ms) noexcept
+    : timeout_(timeout_ms) {}
+
+LockManager::~LockManager() {
+#if BERRYDB_CHECK_IS_ON()
+  for (const Shard& shard : shards_)
+    DCHECK(shard.entries.empty());
+  DCHECK(wait_graph_.empty());
+#endif  // BERRYDB_CHECK_IS_ON()
+}
+
+// static
+uint64_t LockManager::RecordId(const void* space,
+                               span<const uint8_t> key) noexcept {
+  // FNV-1a over the key, seeded with the space, followed by a finalizer that
+  // mixes the low bits into the high bits used by ShardFor().
+  uint64_t hash = 0xcbf29ce484222325 ^ reinterpret_cast<uintptr_t>(space);
+  for (uint8_t byte : key) {
+    hash ^= byte;
+    hash *= 0x100000001b3;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// static
+uint64_t LockManager::SpaceId(const void* space) noexcept {
+  // Scrambling the seed keeps the ID apart from the ID of the space's empty
+  // key, which RecordId() computes by finalizing the seed directly.
+  uint64_t hash = 0xcbf29ce484222325 ^ reinterpret_cast<uintptr_t>(space);
+  hash *= 0x9e3779b97f4a7c15;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+LockManager::Holder* LockManager::LockEntry::FindHolder(
+    const Owner* owner) noexcept {
+  for (Holder& holder : holders) {
+    if (holder.owner == owner)
+      return &holder;
+  }
+  return nullptr;
+}
+
+bool LockManager::LockEntry::IsCompatible(const Owner* owner, Mode mode) const
+    noexcept {
+  for (const Holder& holder : holders) {
+    if (holder.owner == owner)
+      continue;
+    if (mode == Mode::kExclusive || holder.mode == Mode::kExclusive)
+      return false;
+  }
+  return true;
+}
+
+bool LockManager::LockEntry::IsBlockedOnThread(
+    const Owner* owner, Mode mode, std::thread::id thread_id) const noexcept {
+  for (const Holder& holder : holders) {
+    if (holder.owner == owner || holder.thread_id != thread_id)
+      continue;
+    if (mode == Mode::kExclusive || holder.mode == Mode::kExclusive)
+      return true;
+  }
+  return false;
+}
+
+Status LockManager::Lock(Owner* owner, uint64_t resource, Mode mode) {
+  BERRYDB_ASSUME(owner != nullptr);
+
+  Shard* const shard = ShardFor(resource);
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  // References to unordered_map values remain valid while other entries are
+  // added and removed.
+  LockEntry& entry = shard->entries[resource];
+  Holder* holder = entry.FindHolder(owner);
+  if (holder != nullptr && holder->mode >= mode)
+    return Status::kSuccess;
+
+  const std::thread::id thread_id = std::this_thread::get_id();
+  Status status = Status::kSuccess;
+  if (!entry.IsCompatible(owner, mode)) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout_;
+    ++entry.waiter_count;
+    do {
+      // The holders may have changed since the last check, so the wait-for
+      // graph is updated every time the owner starts waiting.
+      if (StartWaiting(owner, entry)) {
+        status = Status::kDeadlock;
+        break;
+      }
+      if (entry.IsBlockedOnThread(owner, mode, thread_id)) {
+        status = Status::kAlreadyLocked;
+        break;
+      }
+      if (shard->lock_released.wait_until(lock, deadline) ==
+          std::cv_status::timeout && !entry.IsCompatible(owner, mode)) {
+        status = Status::kAlreadyLocked;
+        break;
+      }
+    } while (!entry.IsCompatible(owner, mode));
+    --entry.waiter_count;
+    StopWaiting(owner);
+
+    if (status != Status::kSuccess) {
+      if (entry.holders.empty() && entry.waiter_count == 0)
+        shard->entries.erase(resource);
+      return status;
+    }
+    // Other owners may have been added to the holder list while waiting, which
+    // can invalidate pointers into it.
+    holder = entry.FindHolder(owner);
+  }
+
+  if (holder != nullptr) {
+    holder->mode = mode;  // Upgrade.
+    holder->thread_id = thread_id;
+  } else {
+    entry.holders.push_back({owner, mode, thread_id});
+    owner->resources_.push_back(resource);
+  }
+  return Status::kSuccess;
+}
+
+void LockManager::UnlockAll(Owner* owner) noexcept {
+  BERRYDB_ASSUME(owner != nullptr);
+
+  for (uint64_t resource : owner->resources_) {
+    Shard* const shard = ShardFor(resource);
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    const auto it = shard->entries.find(resource);
+    BERRYDB_ASSUME(it != shard->entries.end());
+    LockEntry& entry = it->second;
+
+    Holder* const holder = entry.FindHolder(owner);
+    BERRYDB_ASSUME(holder != nullptr);
+    *holder = entry.holders.back();
+    entry.holders.pop_back();
+
+    if (entry.waiter_count == 0) {
+      if (entry.holders.empty())
+        shard->entries.erase(it);
+      continue;
+    }
+    lock.unlock();
+    shard->lock_released.notify_all();
+  }
+  owner->resources_.clear();
+
+  // The owners waiting for this owner will recompute their edges when they
+  // wake up. Removing the stale edges right away keeps them from causing false
+  // deadlock reports in the meantime.
+  std::lock_guard<std::mutex> graph_lock(wait_graph_mutex_);
+  for (auto& node : wait_graph_) {
+    OwnerList& waited_owners = node.second;
+    waited_owners.erase(
+        std::remove(waited_owners.begin(), waited_owners.end(), owner),
+        waited_owners.end());
+  }
+}
+
+bool LockManager::StartWaiting(const Owner* owner, const LockEntry& entry) {
+  std::lock_guard<std::mutex> graph_lock(wait_graph_mutex_);
+
+  OwnerList& waited_owners = wait_graph_[owner];
+  waited_owners.clear();
+  for (const Holder& holder : entry.holders) {
+    if (holder.owner != owner)
+      waited_owners.push_back(holder.owner);
+  }
+
+  // Depth-first search for a path from the waited owners back to the owner.
+  OwnerList pending(waited_owners.begin(), waited_owners.end());
+  OwnerList visited;
+  while (!pending.empty()) {
+    const Owner* const current = pending.back();
+    pending.pop_back();
+    if (current == owner)
+      return true;
+    if (std::find(visited.begin(), visited.end(), current) != visited.end())
+      continue;
+    visited.push_back(current);
+
+    const auto it = wait_graph_.find(current);
+    if (it != wait_graph_.end())
+      pending.insert(pending.end(), it->second.begin(), it->second.end());
+  }
+  return false;
+}
+
+void LockManager::StopWaiting(const Owner* owner) {
+  std::lock_guard<std::mutex> graph_lock(wait_graph_mutex_);
+  wait_graph_.erase(owner);
+}
+
+}  // namespace berrydb
@@ -0,0 +1,210 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_LOCK_MANAGER_H_
+#define BERRYDB_LOCK_MANAGER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./util/checks.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+enum class Status : int;
+
+/** Transactional locks that isolate transactions whose lifetimes overlap.
+ *
+ * Each store has a LockManager. Pessimistic transactions lock the spaces and
+ * catalogs they access before using them, and hold the locks until they commit
+ * or roll back (strict two-phase locking). Resources are identified by 64-bit
+ * hashes. Hash collisions cause unnecessary conflicts, but never break
+ * isolation. RecordId() computes finer-grained IDs for individual keys, which
+ * the store doesn't use yet, because the keys of a space share pages.
+ *
+ * Deadlocks are detected when a transaction is about to wait, by looking for a
+ * cycle in the graph of transactions waiting for each other. The transaction
+ * that would close the cycle fails with Status::kDeadlock. The graph's edges
+ * are computed from the lock holders when a transaction starts (or resumes)
+ * waiting, so a few cycles may go unnoticed. Waits are bounded by a timeout,
+ * which breaks these cycles, and fails with Status::kAlreadyLocked.
+ *
+ * The lock table is split into shards, each with its own mutex, so threads that
+ * lock different resources rarely contend.
+ *
+ * The lock manager is thread-safe, but the page pool and the store's
+ * transaction lists are not. So a store's transactions run on one thread at a
+ * time, writers never run in parallel, and lock conflicts between a store's
+ * transactions are reported right away instead of waited on.
+ */
+class LockManager {
+ public:
+  /** The ways in which a record can be locked. */
+  enum class Mode {
+    /** Lets other transactions acquire shared locks. Used by readers. */
+    kShared = 0,
+    /** Excludes all other locks. Used by writers. */
+    kExclusive = 1,
+  };
+
+  /** The set of locks held by a transaction. */
+  class Owner {
+   public:
+    Owner() noexcept = default;
+    inline ~Owner() noexcept { BERRYDB_ASSUME(resources_.empty()); }
+
+    Owner(const Owner&) = delete;
+    Owner(Owner&&) = delete;
+    Owner& operator=(const Owner&) = delete;
+    Owner& operator=(Owner&&) = delete;
+
+    /** Number of records locked by this owner. */
+    inline size_t lock_count() const noexcept { return resources_.size(); }
+
+   private:
+    friend class LockManager;
+
+    /** The IDs of the locked resources, in acquisition order. */
+    std::vector<uint64_t, PlatformAllocator<uint64_t>> resources_;
+  };
+
+  /** Sets up a lock manager with no locks held.
+   *
+   * @param timeout_ms the longest time that Lock() waits for a lock; 0 means
+   *                   that Lock() never waits
+   */
+  explicit LockManager(size_t timeout_ms) noexcept;
+  ~LockManager();
+
+  LockManager(const LockManager&) = delete;
+  LockManager(LockManager&&) = delete;
+  LockManager& operator=(const LockManager&) = delete;
+  LockManager& operator=(LockManager&&) = delete;
+
+  /** The resource ID used to lock a record.
+   *
+   * @param space identifies the record's (key/value name)space
+   * @param key   the record's key
+   */
+  static uint64_t RecordId(const void* space, span<const uint8_t> key) noexcept;
+
+  /** The resource ID used to lock a whole space or catalog.
+   *
+   * Transactions lock the spaces that they modify, because the records in a
+   * space share pages. IDs are computed differently from record IDs, so
+   * locking a space does not lock any of its records.
+   *
+   * @param space identifies the (key/value name)space, like in RecordId()
+   */
+  static uint64_t SpaceId(const void* space) noexcept;
+
+  /** Acquires a lock, waiting for conflicting locks to be released if needed.
+   *
+   * Locks are re-entrant. Requesting an exclusive lock on a resource that the
+   * owner has locked in shared mode upgrades the lock.
+   *
+   * A wait for a lock that was acquired on the calling thread can't succeed,
+   * because the lock's owner can't release it while the thread waits. So such
+   * requests fail right away, as if the wait had timed out.
+   *
+   * @param  owner    the transaction that will hold the lock
+   * @param  resource the ID of the locked resource, e.g. from RecordId()
+   * @param  mode     the kind of lock needed
+   * @return          kSuccess, kDeadlock if waiting would deadlock, or
+   *                  kAlreadyLocked if the wait timed out or could never end;
+   *                  the owner should be rolled back when locking fails
+   */
+  Status Lock(Owner* owner, uint64_t resource, Mode mode);
+
+  /** Releases all the locks held by a transaction.
+   *
+   * This must be called when the transaction is closed.
+   */
+  void UnlockAll(Owner* owner) noexcept;
+
+ private:
+  /** An owner's hold on a resource. */
+  struct Holder {
+    Owner* owner;
+    Mode mode;
+    /** The thread that acquired the lock. */
+    std::thread::id thread_id;
+  };
+
+  /** The state of a locked resource. */
+  struct LockEntry {
+    std::vector<Holder, PlatformAllocator<Holder>> holders;
+    /** The number of owners waiting to lock the resource. */
+    size_t waiter_count = 0;
+
+    /** The owner's hold on the resource, or null if it doesn't hold it. */
+    Holder* FindHolder(const Owner* owner) noexcept;
+    /** True if the owner could acquire the lock right away. */
+    bool IsCompatible(const Owner* owner, Mode mode) const noexcept;
+    /** True if a lock that blocks the owner was acquired on a thread. */
+    bool IsBlockedOnThread(const Owner* owner, Mode mode,
+                           std::thread::id thread_id) const noexcept;
+  };
+
+  using EntryMap = std::unordered_map<
+      uint64_t, LockEntry, std::hash<uint64_t>, std::equal_to<uint64_t>,
+      PlatformAllocator<std::pair<const uint64_t, LockEntry>>>;
+
+  /** A slice of the lock table. Aligned to avoid false sharing. */
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    /** Signaled when a lock in the shard is released. */
+    std::condition_variable lock_released;
+    EntryMap entries;
+  };
+
+  using OwnerList = std::vector<const Owner*, PlatformAllocator<const Owner*>>;
+  using WaitGraph = std::unordered_map<
+      const Owner*, OwnerList, std::hash<const Owner*>,
+      std::equal_to<const Owner*>,
+      PlatformAllocator<std::pair<const Owner* const, OwnerList>>>;
+
+  static constexpr size_t kShardCount = 64;
+
+  inline Shard* ShardFor(uint64_t resource) noexcept {
+    // The resource IDs are hashes, so their high bits are well mixed.
+    return &shards_[resource >> 58];
+  }
+
+  /** Records that an owner is waiting, and checks for deadlocks.
+   *
+   * @param  owner the owner that is about to wait
+   * @param  entry the resource that the owner is waiting for
+   * @return       true if waiting would cause a deadlock
+   */
+  bool StartWaiting(const Owner* owner, const LockEntry& entry);
+
+  /** Removes an owner from the wait-for graph. */
+  void StopWaiting(const Owner* owner);
+
+  const std::chrono::milliseconds timeout_;
+
+  Shard shards_[kShardCount];
+
+  /** Guards wait_graph_. Acquired after shard mutexes, never before. */
+  std::mutex wait_graph_mutex_;
+
+  /** The owners that each waiting owner is waiting for. */
+  WaitGraph wait_graph_;
+};
+
+static_assert(LockManager::Mode::kShared < LockManager::Mode::kExclusive,
+              "Lock() relies on stronger modes comparing greater");
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_LOCK_MANAGER_H_
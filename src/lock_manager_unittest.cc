@@ -0,0 +1,174 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./lock_manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/status.h"
+
+namespace berrydb {
+
+TEST(LockManagerTest, RecordIdDependsOnSpaceAndKey) {
+  const uint8_t key1[] = {'a', 'b'};
+  const uint8_t key2[] = {'a', 'c'};
+  int space1 = 0, space2 = 0;
+
+  EXPECT_EQ(LockManager::RecordId(&space1, make_span(key1)),
+            LockManager::RecordId(&space1, make_span(key1)));
+  EXPECT_NE(LockManager::RecordId(&space1, make_span(key1)),
+            LockManager::RecordId(&space1, make_span(key2)));
+  EXPECT_NE(LockManager::RecordId(&space1, make_span(key1)),
+            LockManager::RecordId(&space2, make_span(key1)));
+}
+
+TEST(LockManagerTest, SpaceIdDiffersFromRecordIds) {
+  const uint8_t key[] = {'a'};
+  int space1 = 0, space2 = 0;
+
+  EXPECT_EQ(LockManager::SpaceId(&space1), LockManager::SpaceId(&space1));
+  EXPECT_NE(LockManager::SpaceId(&space1), LockManager::SpaceId(&space2));
+  EXPECT_NE(LockManager::SpaceId(&space1),
+            LockManager::RecordId(&space1, span<const uint8_t>()));
+  EXPECT_NE(LockManager::SpaceId(&space1),
+            LockManager::RecordId(&space1, make_span(key)));
+}
+
+TEST(LockManagerTest, SharedLocksAreCompatible) {
+  LockManager lock_manager(0);
+  LockManager::Owner owner1, owner2;
+
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner1, 1, LockManager::Mode::kShared));
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kShared));
+  // Without a timeout, conflicting requests fail right away.
+  EXPECT_EQ(Status::kAlreadyLocked,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kExclusive));
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner2, 2, LockManager::Mode::kExclusive));
+
+  lock_manager.UnlockAll(&owner1);
+  EXPECT_EQ(0U, owner1.lock_count());
+  // The only holder can upgrade its lock.
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kExclusive));
+  EXPECT_EQ(Status::kAlreadyLocked,
+            lock_manager.Lock(&owner1, 1, LockManager::Mode::kShared));
+  EXPECT_EQ(2U, owner2.lock_count());
+
+  lock_manager.UnlockAll(&owner2);
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner1, 1, LockManager::Mode::kExclusive));
+  lock_manager.UnlockAll(&owner1);
+}
+
+TEST(LockManagerTest, LocksAreReentrant) {
+  LockManager lock_manager(0);
+  LockManager::Owner owner;
+
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner, 1, LockManager::Mode::kExclusive));
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner, 1, LockManager::Mode::kShared));
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner, 1, LockManager::Mode::kExclusive));
+  EXPECT_EQ(1U, owner.lock_count());
+  lock_manager.UnlockAll(&owner);
+}
+
+TEST(LockManagerTest, WaiterGetsLockWhenReleased) {
+  LockManager lock_manager(10000);
+  LockManager::Owner owner1, owner2;
+
+  ASSERT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner1, 1, LockManager::Mode::kExclusive));
+  std::atomic<bool> waiter_done(false);
+  Status waiter_status = Status::kIoError;
+  std::thread waiter([&] {
+    waiter_status = lock_manager.Lock(&owner2, 1, LockManager::Mode::kShared);
+    waiter_done.store(true);
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(waiter_done.load());
+  lock_manager.UnlockAll(&owner1);
+  waiter.join();
+  EXPECT_EQ(Status::kSuccess, waiter_status);
+  lock_manager.UnlockAll(&owner2);
+}
+
+TEST(LockManagerTest, WaitTimesOut) {
+  LockManager lock_manager(20);
+  LockManager::Owner owner1, owner2;
+
+  // The lock is acquired on another thread, so the main thread waits for it.
+  Status holder_status = Status::kIoError;
+  std::thread holder([&] {
+    holder_status = lock_manager.Lock(&owner1, 1, LockManager::Mode::kShared);
+  });
+  holder.join();
+  ASSERT_EQ(Status::kSuccess, holder_status);
+
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(Status::kAlreadyLocked,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kExclusive));
+  EXPECT_LE(std::chrono::milliseconds(20),
+            std::chrono::steady_clock::now() - start);
+  EXPECT_EQ(0U, owner2.lock_count());
+  lock_manager.UnlockAll(&owner1);
+}
+
+TEST(LockManagerTest, LockHeldOnCallingThreadFailsRightAway) {
+  LockManager lock_manager(10000);
+  LockManager::Owner owner1, owner2;
+
+  ASSERT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner1, 1, LockManager::Mode::kExclusive));
+  // Waiting would block the only thread that can release the lock.
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(Status::kAlreadyLocked,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kShared));
+  EXPECT_GT(std::chrono::milliseconds(5000),
+            std::chrono::steady_clock::now() - start);
+  EXPECT_EQ(0U, owner2.lock_count());
+
+  lock_manager.UnlockAll(&owner1);
+  EXPECT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kShared));
+  lock_manager.UnlockAll(&owner2);
+}
+
+TEST(LockManagerTest, DeadlockIsDetected) {
+  LockManager lock_manager(10000);
+  LockManager::Owner owner1, owner2;
+
+  ASSERT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner1, 1, LockManager::Mode::kExclusive));
+  ASSERT_EQ(Status::kSuccess,
+            lock_manager.Lock(&owner2, 2, LockManager::Mode::kExclusive));
+
+  Status waiter_status = Status::kIoError;
+  std::thread waiter([&] {
+    waiter_status = lock_manager.Lock(&owner1, 2, LockManager::Mode::kShared);
+  });
+  // Wait until the other thread is blocked on the lock. The deadlock is found
+  // regardless of which thread starts waiting first, but the test checks that
+  // the second waiter is the victim.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(Status::kDeadlock,
+            lock_manager.Lock(&owner2, 1, LockManager::Mode::kShared));
+
+  // Rolling back the victim lets the other transaction proceed.
+  lock_manager.UnlockAll(&owner2);
+  waiter.join();
+  EXPECT_EQ(Status::kSuccess, waiter_status);
+  lock_manager.UnlockAll(&owner1);
+}
+
+}  // namespace berrydb
@@ -0,0 +1,464 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./log_recovery.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "berrydb/status.h"
+#include "berrydb/vfs.h"
+#include "./format/log_format.h"
+#include "./util/checks.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+/** The size of the reads issued by the log scanner. */
+constexpr size_t kScanBufferSize = 1 << 20;
+
+/** Memory shared by the workers for caching page images.
+ *
+ * Each worker gets an equal share. A worker writes its cached images to the
+ * data file when it runs out of memory, and again when the log is exhausted.
+ */
+constexpr size_t kWorkerCacheBudget = 64 << 20;
+
+}  // namespace
+
+/** Page images sent from the scanner to a worker. */
+struct LogRecovery::PageImageBatch {
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids;
+  /** The page images, concatenated. Image i belongs to page_ids[i]. */
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> images;
+
+  inline void Clear() noexcept {
+    page_ids.clear();
+    images.clear();
+  }
+};
+
+/** Applies the page images whose IDs hash to a partition. */
+class LogRecovery::Worker {
+ public:
+  static Worker* Create(LogRecovery* recovery, size_t cache_page_capacity) {
+    void* const heap_block = Allocate(sizeof(Worker));
+    Worker* const worker =
+        new (heap_block) Worker(recovery, cache_page_capacity);
+    BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(worker));
+    return worker;
+  }
+
+  void Release() {
+    this->~Worker();
+    void* const heap_block = static_cast<void*>(this);
+    Deallocate(heap_block, sizeof(Worker));
+  }
+
+  /** Starts the worker's thread. */
+  void Start() {
+    thread_ = std::thread(&Worker::Run, this);
+  }
+
+  /** Queues up page images to be applied by this worker.
+   *
+   * Blocks if the worker is too far behind the scanner. This keeps the memory
+   * used by the queue bounded.
+   *
+   * @param batch the images to be applied; the batch is emptied
+   */
+  void Enqueue(PageImageBatch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() {
+      return inbox_.page_ids.size() < cache_page_capacity_;
+    });
+
+    if (inbox_.page_ids.empty()) {
+      std::swap(inbox_.page_ids, batch->page_ids);
+      std::swap(inbox_.images, batch->images);
+    } else {
+      inbox_.page_ids.insert(inbox_.page_ids.end(), batch->page_ids.begin(),
+                             batch->page_ids.end());
+      inbox_.images.insert(inbox_.images.end(), batch->images.begin(),
+                           batch->images.end());
+    }
+    batch->Clear();
+    condition_.notify_all();
+  }
+
+  /** Waits for the worker to apply all the images queued up so far.
+   *
+   * @return the first error encountered by the worker */
+  Status Finish() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      is_finishing_ = true;
+      condition_.notify_all();
+    }
+    thread_.join();
+    return status_;
+  }
+
+ private:
+  Worker(LogRecovery* recovery, size_t cache_page_capacity)
+      : recovery_(recovery), cache_page_capacity_(cache_page_capacity),
+        page_size_(static_cast<size_t>(1) << recovery->page_shift_) {
+    BERRYDB_ASSUME_GT(cache_page_capacity, 0U);
+  }
+  ~Worker() = default;
+
+  /** The worker thread's main loop. */
+  void Run() {
+    PageImageBatch batch;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this]() {
+          return is_finishing_ || !inbox_.page_ids.empty();
+        });
+        if (inbox_.page_ids.empty()) {
+          // is_finishing_ is set, and the scanner will not enqueue more images.
+          break;
+        }
+        std::swap(inbox_.page_ids, batch.page_ids);
+        std::swap(inbox_.images, batch.images);
+        condition_.notify_all();
+      }
+
+      // After an I/O error, the worker keeps draining its inbox so the scanner
+      // does not get blocked, but stops applying images.
+      if (status_ == Status::kSuccess)
+        ApplyBatch(batch);
+      batch.Clear();
+    }
+
+    if (status_ == Status::kSuccess)
+      status_ = WriteCachedImages();
+  }
+
+  /** Caches the images in a batch, replacing older images of the same pages. */
+  void ApplyBatch(const PageImageBatch& batch) {
+    const size_t image_count = batch.page_ids.size();
+    BERRYDB_ASSUME_EQ(batch.images.size(), image_count * page_size_);
+
+    for (size_t i = 0; i < image_count; ++i) {
+      const size_t page_id = batch.page_ids[i];
+      const span<const uint8_t> image(batch.images.data() + i * page_size_,
+                                      page_size_);
+
+      const auto it = cache_slots_.find(page_id);
+      if (it != cache_slots_.end()) {
+        CopySpan(image, span<uint8_t>(
+            cache_images_.data() + it->second * page_size_, page_size_));
+        continue;
+      }
+
+      if (cache_page_ids_.size() == cache_page_capacity_) {
+        status_ = WriteCachedImages();
+        if (UNLIKELY(status_ != Status::kSuccess))
+          return;
+      }
+
+      cache_slots_.emplace(page_id, cache_page_ids_.size());
+      cache_page_ids_.push_back(page_id);
+      cache_images_.insert(cache_images_.end(), image.begin(), image.end());
+    }
+  }
+
+  /** Writes the cached images to the data file, in page ID order. */
+  Status WriteCachedImages() {
+    const size_t slot_count = cache_page_ids_.size();
+    write_order_.resize(slot_count);
+    for (size_t i = 0; i < slot_count; ++i)
+      write_order_[i] = i;
+    std::sort(write_order_.begin(), write_order_.end(),
+              [this](size_t lhs, size_t rhs) {
+                return cache_page_ids_[lhs] < cache_page_ids_[rhs];
+              });
+
+    Status status = Status::kSuccess;
+    for (size_t slot : write_order_) {
+      status = recovery_->WritePageImage(
+          cache_page_ids_[slot],
+          span<const uint8_t>(cache_images_.data() + slot * page_size_,
+                              page_size_));
+      if (UNLIKELY(status != Status::kSuccess))
+        break;
+    }
+
+    cache_slots_.clear();
+    cache_page_ids_.clear();
+    cache_images_.clear();
+    return status;
+  }
+
+  LogRecovery* const recovery_;
+  /** The maximum number of page images cached by this worker. */
+  const size_t cache_page_capacity_;
+  const size_t page_size_;
+
+  std::thread thread_;
+
+  /** Guards the members shared between the scanner and the worker thread. */
+  std::mutex mutex_;
+  /** Signaled when the inbox changes, and when the worker must finish. */
+  std::condition_variable condition_;
+  /** Page images queued up by the scanner. Guarded by mutex_. */
+  PageImageBatch inbox_;
+  /** Set when the scanner is done. Guarded by mutex_. */
+  bool is_finishing_ = false;
+
+  // The members below are only accessed by the worker thread, until the thread
+  // is joined.
+
+  /** Maps page IDs to indexes in cache_page_ids_ and cache_images_. */
+  std::unordered_map<size_t, size_t, std::hash<size_t>, std::equal_to<size_t>,
+                     PlatformAllocator<std::pair<const size_t, size_t>>>
+      cache_slots_;
+  std::vector<size_t, PlatformAllocator<size_t>> cache_page_ids_;
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> cache_images_;
+  /** Scratch space used by WriteCachedImages(). */
+  std::vector<size_t, PlatformAllocator<size_t>> write_order_;
+
+  Status status_ = Status::kSuccess;
+};
+
+LogRecovery::LogRecovery(
+    RandomAccessFile* log_file, size_t log_file_size,
+    BlockAccessFile* data_file, size_t page_shift, uint64_t epoch) noexcept
+    : log_file_(log_file), log_file_size_(log_file_size),
+      data_file_(data_file), page_shift_(page_shift), epoch_(epoch) {
+  BERRYDB_ASSUME(log_file != nullptr);
+  BERRYDB_ASSUME(data_file != nullptr);
+}
+
+LogRecovery::~LogRecovery() {
+  if (scan_buffer_ != nullptr)
+    Deallocate(scan_buffer_, scan_buffer_capacity_);
+}
+
+Status LogRecovery::Run(size_t thread_count) {
+  BERRYDB_ASSUME_GT(thread_count, 0U);
+
+  const size_t page_size = static_cast<size_t>(1) << page_shift_;
+  const size_t cache_page_capacity =
+      std::max<size_t>(kWorkerCacheBudget / thread_count / page_size, 1);
+
+  std::vector<Worker*, PlatformAllocator<Worker*>> workers;
+  workers.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    Worker* const worker = Worker::Create(this, cache_page_capacity);
+    worker->Start();
+    workers.push_back(worker);
+  }
+
+  Status result = Scan(span<Worker*>(workers.data(), workers.size()));
+
+  // The workers must be finished even if the scan fails, so their threads are
+  // joined. The images applied before the failure are harmless, because the
+  // log will be replayed again.
+  for (Worker* worker : workers) {
+    const Status worker_status = worker->Finish();
+    if (UNLIKELY(worker_status != Status::kSuccess) &&
+        result == Status::kSuccess) {
+      result = worker_status;
+    }
+    worker->Release();
+  }
+
+  std::sort(page_ids_.begin(), page_ids_.end());
+  page_ids_.erase(std::unique(page_ids_.begin(), page_ids_.end()),
+                  page_ids_.end());
+  return result;
+}
+
+Status LogRecovery::Scan(span<Worker*> workers) {
+  const size_t worker_count = workers.size();
+  const size_t page_size = static_cast<size_t>(1) << page_shift_;
+  const size_t page_image_record_size =
+      LogFormat::PageImageRecordSize(page_shift_);
+
+  scan_buffer_capacity_ = std::max(kScanBufferSize, page_image_record_size);
+  scan_buffer_ = reinterpret_cast<uint8_t*>(Allocate(scan_buffer_capacity_));
+
+  // The images of the transaction whose commit record hasn't been seen yet.
+  // Each worker's images are kept separately, so they can be handed off
+  // without copying.
+  std::vector<PageImageBatch, PlatformAllocator<PageImageBatch>> pending(
+      worker_count);
+  size_t pending_count = 0;
+  // One past the largest page ID in the pending page images.
+  size_t pending_page_count = 0;
+
+  size_t record_offset = 0;
+  while (true) {
+    // Make sure the buffer holds the record's header.
+    if (record_offset + LogFormat::kRecordHeaderSize >
+        scan_buffer_offset_ + scan_buffer_size_) {
+      if (record_offset + LogFormat::kRecordHeaderSize > log_file_size_)
+        break;
+      const Status status = FillScanBuffer(record_offset);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+    span<const uint8_t> header(
+        scan_buffer_ + (record_offset - scan_buffer_offset_),
+        LogFormat::kRecordHeaderSize);
+
+    if (LogFormat::Epoch(header) != epoch_)
+      break;
+    const uint64_t type64 = LogFormat::Type64(header);
+    const bool is_compressed = type64 == static_cast<uint64_t>(
+        LogFormat::RecordType::kCompressedPageImage);
+    size_t record_size;
+    if (type64 == static_cast<uint64_t>(LogFormat::RecordType::kPageImage)) {
+      record_size = page_image_record_size;
+    } else if (type64 ==
+               static_cast<uint64_t>(LogFormat::RecordType::kCommit)) {
+      record_size = LogFormat::kCommitRecordSize;
+    } else if (is_compressed) {
+      // The record's size depends on the compressed size field, which follows
+      // the header.
+      const size_t size_end = record_offset + LogFormat::kRecordHeaderSize +
+                              LogFormat::kCompressedSizeFieldSize;
+      if (size_end > scan_buffer_offset_ + scan_buffer_size_) {
+        if (size_end > log_file_size_)
+          break;
+        const Status status = FillScanBuffer(record_offset);
+        if (UNLIKELY(status != Status::kSuccess))
+          return status;
+      }
+      const uint64_t compressed_size64 = LogFormat::CompressedSize64(
+          span<const uint8_t>(
+              scan_buffer_ + (record_offset - scan_buffer_offset_),
+              LogFormat::kRecordHeaderSize +
+              LogFormat::kCompressedSizeFieldSize));
+      // Writers only log compressed images that are smaller than uncompressed
+      // ones. Larger sizes come from garbage, and would overflow the buffer.
+      if (compressed_size64 >= page_image_record_size)
+        break;
+      record_size = LogFormat::CompressedPageImageRecordSize(
+          static_cast<size_t>(compressed_size64));
+      if (record_size >= page_image_record_size)
+        break;
+    } else {
+      break;
+    }
+
+    // Make sure the buffer holds the entire record.
+    if (record_offset + record_size > scan_buffer_offset_ + scan_buffer_size_) {
+      if (record_offset + record_size > log_file_size_)
+        break;
+      const Status status = FillScanBuffer(record_offset);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+    span<const uint8_t> record(
+        scan_buffer_ + (record_offset - scan_buffer_offset_), record_size);
+    if (!LogFormat::HasValidChecksum(record))
+      break;
+
+    const uint64_t argument64 = LogFormat::Argument64(record);
+    if (type64 != static_cast<uint64_t>(LogFormat::RecordType::kCommit)) {
+      const size_t page_id = static_cast<size_t>(argument64);
+      if (UNLIKELY(page_id != argument64)) {
+        // This can happen on 32-bit systems that try to load a large database.
+        return Status::kDatabaseTooLarge;
+      }
+
+      // Page IDs are sequential, so a modulo spreads them well enough.
+      PageImageBatch& batch = pending[page_id % worker_count];
+      batch.page_ids.push_back(page_id);
+      if (!is_compressed) {
+        const span<const uint8_t> image =
+            record.subspan(LogFormat::kRecordHeaderSize);
+        batch.images.insert(batch.images.end(), image.begin(), image.end());
+      } else {
+        // The checksum matched, so the record was written by a store that
+        // compresses its log.
+        if (!kPlatformHasCompression)
+          return Status::kNotSupported;
+
+        const size_t image_offset = batch.images.size();
+        batch.images.resize(image_offset + page_size);
+        const size_t compressed_size =
+            static_cast<size_t>(LogFormat::CompressedSize64(record));
+        if (UNLIKELY(!PlatformDecompress(
+                record.data() + LogFormat::kRecordHeaderSize +
+                    LogFormat::kCompressedSizeFieldSize,
+                compressed_size, batch.images.data() + image_offset,
+                page_size))) {
+          return Status::kDataCorrupted;
+        }
+      }
+      page_ids_.push_back(page_id);
+      ++pending_count;
+      if (pending_page_count <= page_id)
+        pending_page_count = page_id + 1;
+    } else {
+      if (UNLIKELY(argument64 != pending_count)) {
+        // The checksum matched, so this is not a torn write.
+        return Status::kDataCorrupted;
+      }
+
+      for (size_t i = 0; i < worker_count; ++i) {
+        if (!pending[i].page_ids.empty())
+          workers[i]->Enqueue(&pending[i]);
+      }
+      ++transaction_count_;
+      page_image_count_ += pending_count;
+      if (page_count_ < pending_page_count)
+        page_count_ = pending_page_count;
+      pending_count = 0;
+      pending_page_count = 0;
+      log_end_ = record_offset + record_size;
+    }
+
+    record_offset += record_size;
+  }
+
+  // Any pending images belong to a transaction that did not commit.
+  page_ids_.resize(page_ids_.size() - pending_count);
+  return Status::kSuccess;
+}
+
+Status LogRecovery::FillScanBuffer(size_t log_offset) {
+  BERRYDB_ASSUME_GE(log_offset, scan_buffer_offset_);
+  BERRYDB_ASSUME_LE(log_offset, scan_buffer_offset_ + scan_buffer_size_);
+
+  // Move the bytes that must be kept to the beginning of the buffer.
+  const size_t kept_size = scan_buffer_offset_ + scan_buffer_size_ - log_offset;
+  if (kept_size != 0) {
+    std::copy(scan_buffer_ + (log_offset - scan_buffer_offset_),
+              scan_buffer_ + (log_offset - scan_buffer_offset_) + kept_size,
+              scan_buffer_);
+  }
+  scan_buffer_offset_ = log_offset;
+  scan_buffer_size_ = kept_size;
+
+  const size_t read_offset = log_offset + kept_size;
+  const size_t read_size = std::min(scan_buffer_capacity_ - kept_size,
+                                    log_file_size_ - read_offset);
+  const Status status = log_file_->Read(
+      read_offset, span<uint8_t>(scan_buffer_ + kept_size, read_size));
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  scan_buffer_size_ += read_size;
+  return Status::kSuccess;
+}
+
+Status LogRecovery::WritePageImage(size_t page_id, span<const uint8_t> image) {
+  std::lock_guard<std::mutex> lock(data_file_mutex_);
+  return data_file_->Write(image, page_id << page_shift_);
+}
+
+}  // namespace berrydb
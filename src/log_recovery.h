@@ -0,0 +1,148 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_LOG_RECOVERY_H_
+#define BERRYDB_LOG_RECOVERY_H_
+
+#include <mutex>
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class BlockAccessFile;
+class RandomAccessFile;
+enum class Status : int;
+
+/** Replays a store's log into its data file.
+ *
+ * Recovery reads the log file once, sequentially, in large chunks. The scanner
+ * validates each record, and holds on to a transaction's page images until it
+ * sees the transaction's commit record. Page images belonging to committed
+ * transactions are handed off to worker threads.
+ *
+ * Each page is owned by a single worker, selected by hashing the page ID. A
+ * worker receives the images of its pages in log order, so the last image of
+ * a page wins, which matches the outcome of replaying the log serially. Workers
+ * only keep the latest image of each page, so a page that was modified by many
+ * transactions is only written once. Images are written to the data file in
+ * page ID order, in batches bounded by a memory budget.
+ *
+ * Instances are used once, during store initialization.
+ */
+class LogRecovery {
+ public:
+  /** Sets up recovery for a store.
+   *
+   * @param log_file      the store's log file
+   * @param log_file_size the size of the log file, in bytes
+   * @param data_file     the store's data file; receives the replayed pages
+   * @param page_shift    base-2 log of the store's page size
+   * @param epoch         the log epoch in the store header; records tagged with
+   *                      other epochs are not replayed
+   */
+  LogRecovery(RandomAccessFile* log_file, size_t log_file_size,
+              BlockAccessFile* data_file, size_t page_shift,
+              uint64_t epoch) noexcept;
+  ~LogRecovery();
+
+  LogRecovery(const LogRecovery&) = delete;
+  LogRecovery(LogRecovery&&) = delete;
+  LogRecovery& operator=(const LogRecovery&) = delete;
+  LogRecovery& operator=(LogRecovery&&) = delete;
+
+  /** Replays the committed transactions in the log.
+   *
+   * @param  thread_count the number of worker threads used to apply pages;
+   *                      must be positive
+   * @return              most likely kSuccess or kIoError; kDataCorrupted if
+   *                      the log contains records that pass integrity checks,
+   *                      but are inconsistent; kNotSupported if the log holds
+   *                      compressed page images, and the build does not have a
+   *                      compressor
+   */
+  Status Run(size_t thread_count);
+
+  /** The number of committed transactions found in the log. */
+  inline constexpr size_t transaction_count() const noexcept {
+    return transaction_count_;
+  }
+
+  /** The number of page images in the committed transactions. */
+  inline constexpr size_t page_image_count() const noexcept {
+    return page_image_count_;
+  }
+
+  /** One past the largest page ID written by the committed transactions.
+   *
+   * Zero if the log has no committed page images. The replayed pages may be
+   * past the page count in the store header, which is only updated by
+   * checkpoints. */
+  inline constexpr size_t page_count() const noexcept { return page_count_; }
+
+  /** The IDs of the pages written by the committed transactions, sorted. */
+  inline span<const size_t> page_ids() const noexcept {
+    return span<const size_t>(page_ids_.data(), page_ids_.size());
+  }
+
+  /** The log offset right after the last committed transaction's records. */
+  inline constexpr size_t log_end() const noexcept { return log_end_; }
+
+ private:
+  class Worker;
+  struct PageImageBatch;
+
+  /** Reads the log and dispatches committed page images to workers.
+   *
+   * @param workers the workers that will receive the page images
+   */
+  Status Scan(span<Worker*> workers);
+
+  /** Reads more log data into the scan buffer.
+   *
+   * The buffered data starting at the given offset is preserved.
+   *
+   * @param  log_offset the first log byte that must be kept in the buffer
+   * @return            most likely kSuccess or kIoError
+   */
+  Status FillScanBuffer(size_t log_offset);
+
+  /** Writes a page image to the data file. Called by workers. */
+  Status WritePageImage(size_t page_id, span<const uint8_t> image);
+
+  RandomAccessFile* const log_file_;
+  const size_t log_file_size_;
+  BlockAccessFile* const data_file_;
+  const size_t page_shift_;
+  const uint64_t epoch_;
+
+  /** Serializes the workers' data file writes.
+   *
+   * The Vfs interface does not require implementations to be thread-safe. */
+  std::mutex data_file_mutex_;
+
+  /** Holds the log data being scanned. */
+  uint8_t* scan_buffer_ = nullptr;
+  size_t scan_buffer_capacity_ = 0;
+  /** The number of valid bytes in the scan buffer. */
+  size_t scan_buffer_size_ = 0;
+  /** The log offset of the first byte in the scan buffer. */
+  size_t scan_buffer_offset_ = 0;
+
+  size_t transaction_count_ = 0;
+  size_t page_image_count_ = 0;
+  size_t page_count_ = 0;
+  size_t log_end_ = 0;
+
+  /** See page_ids(). Unsorted, and has duplicates, until Run() is done. */
+  std::vector<size_t, PlatformAllocator<size_t>> page_ids_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_LOG_RECOVERY_H_
@@ -0,0 +1,334 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./log_recovery.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/status.h"
+#include "berrydb/vfs.h"
+#include "./format/log_format.h"
+#include "./log_writer.h"
+#include "./test/file_deleter.h"
+#include "./util/span_util.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+class LogRecoveryTest : public ::testing::Test {
+ protected:
+  LogRecoveryTest()
+      : vfs_(DefaultVfs()), data_file_deleter_(kDataFileName),
+        log_file_deleter_(kLogFileName) { }
+
+  void SetUp() override {
+    Status status;
+    BlockAccessFile* raw_data_file;
+    size_t data_file_size;
+    std::tie(status, raw_data_file, data_file_size) = vfs_->OpenForBlockAccess(
+        data_file_deleter_.path(), kPageShift, true, false);
+    ASSERT_EQ(Status::kSuccess, status);
+    data_file_.reset(raw_data_file);
+    RandomAccessFile* raw_log_file;
+    size_t log_file_size;
+    std::tie(status, raw_log_file, log_file_size) = vfs_->OpenForRandomAccess(
+        log_file_deleter_.path(), true, false);
+    ASSERT_EQ(Status::kSuccess, status);
+    log_file_.reset(raw_log_file);
+  }
+
+  /** Logs a transaction that fills each page with a byte value. */
+  void LogTransaction(LogWriter* writer,
+                      const std::vector<std::pair<size_t, uint8_t>>& pages) {
+    for (const auto& page : pages) {
+      FillSpan(span<uint8_t>(page_buffer_), page.second);
+      writer->AppendPageImage(page.first, span<const uint8_t>(page_buffer_));
+    }
+    writer->AppendCommit(pages.size());
+    ASSERT_EQ(Status::kSuccess, writer->Flush());
+  }
+
+  /** Checks that a data file page is filled with a byte value. */
+  void ExpectPage(size_t page_id, uint8_t value) {
+    ASSERT_EQ(Status::kSuccess, data_file_->Read(
+        page_id << kPageShift, span<uint8_t>(page_buffer_)));
+    for (size_t i = 0; i < kPageSize; ++i) {
+      ASSERT_EQ(value, page_buffer_[i]) << "page " << page_id << " byte " << i;
+    }
+  }
+
+  const std::string kDataFileName = "test_log_recovery.berry";
+  const std::string kLogFileName = "test_log_recovery.berry.log";
+  constexpr static size_t kPageShift = 12;
+  constexpr static size_t kPageSize = 1 << kPageShift;
+
+  Vfs* vfs_;
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  UniquePtr<BlockAccessFile> data_file_;
+  UniquePtr<RandomAccessFile> log_file_;
+  alignas(8) uint8_t page_buffer_[kPageSize];
+};
+
+TEST_F(LogRecoveryTest, EmptyLog) {
+  LogRecovery recovery(log_file_.get(), 0, data_file_.get(), kPageShift, 1);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(2));
+  EXPECT_EQ(0U, recovery.transaction_count());
+  EXPECT_EQ(0U, recovery.page_image_count());
+  EXPECT_EQ(0U, recovery.page_count());
+  EXPECT_EQ(0U, recovery.log_end());
+}
+
+TEST_F(LogRecoveryTest, ReplaysCommittedTransactions) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(7);
+  LogTransaction(&writer, {{1, 'a'}, {2, 'b'}});
+  LogTransaction(&writer, {{1, 'c'}, {5, 'd'}});
+  LogTransaction(&writer, {{0, 'e'}});
+
+  for (size_t thread_count : {1, 2, 4}) {
+    LogRecovery recovery(log_file_.get(), writer.file_offset(),
+                         data_file_.get(), kPageShift, 7);
+    ASSERT_EQ(Status::kSuccess, recovery.Run(thread_count));
+    EXPECT_EQ(3U, recovery.transaction_count());
+    EXPECT_EQ(5U, recovery.page_image_count());
+    EXPECT_EQ(6U, recovery.page_count());
+    EXPECT_EQ(writer.file_offset(), recovery.log_end());
+
+    ExpectPage(0, 'e');
+    ExpectPage(1, 'c');
+    ExpectPage(2, 'b');
+    ExpectPage(5, 'd');
+  }
+}
+
+TEST_F(LogRecoveryTest, StopsAtPreallocatedSpace) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  LogTransaction(&writer, {{1, 'a'}});
+  ASSERT_LT(writer.file_offset(), writer.file_size());
+
+  LogRecovery recovery(log_file_.get(), writer.file_size(), data_file_.get(),
+                       kPageShift, 1);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(2));
+  EXPECT_EQ(1U, recovery.transaction_count());
+  EXPECT_EQ(writer.file_offset(), recovery.log_end());
+  ExpectPage(1, 'a');
+}
+
+TEST_F(LogRecoveryTest, IgnoresUncommittedTransaction) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  LogTransaction(&writer, {{1, 'a'}});
+  const size_t committed_end = writer.file_offset();
+
+  FillSpan(span<uint8_t>(page_buffer_), 'z');
+  writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  writer.AppendPageImage(2, span<const uint8_t>(page_buffer_));
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+
+  LogRecovery recovery(log_file_.get(), writer.file_offset(), data_file_.get(),
+                       kPageShift, 1);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(2));
+  EXPECT_EQ(1U, recovery.transaction_count());
+  // Pages written by uncommitted transactions don't count.
+  EXPECT_EQ(2U, recovery.page_count());
+  EXPECT_EQ(committed_end, recovery.log_end());
+  ExpectPage(1, 'a');
+}
+
+TEST_F(LogRecoveryTest, IgnoresTruncatedRecord) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  LogTransaction(&writer, {{1, 'a'}});
+  const size_t committed_end = writer.file_offset();
+  LogTransaction(&writer, {{1, 'b'}});
+
+  // Cut off the last transaction's commit record.
+  LogRecovery recovery(log_file_.get(), writer.file_offset() - 8,
+                       data_file_.get(), kPageShift, 1);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(1));
+  EXPECT_EQ(1U, recovery.transaction_count());
+  EXPECT_EQ(committed_end, recovery.log_end());
+  ExpectPage(1, 'a');
+}
+
+TEST_F(LogRecoveryTest, StopsAtCorruptedRecord) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  LogTransaction(&writer, {{1, 'a'}});
+  const size_t committed_end = writer.file_offset();
+  LogTransaction(&writer, {{1, 'b'}, {2, 'b'}});
+  LogTransaction(&writer, {{3, 'c'}});
+
+  // Flip a byte in the middle of the second transaction's first page image.
+  alignas(8) uint8_t byte_buffer[1];
+  const size_t corrupted_offset = committed_end + 100;
+  ASSERT_EQ(Status::kSuccess,
+            log_file_->Read(corrupted_offset, span<uint8_t>(byte_buffer)));
+  byte_buffer[0] ^= 0x10;
+  ASSERT_EQ(Status::kSuccess, log_file_->Write(
+      span<const uint8_t>(byte_buffer), corrupted_offset));
+
+  FillSpan(span<uint8_t>(page_buffer_), 0);
+  ASSERT_EQ(Status::kSuccess, data_file_->Write(
+      span<const uint8_t>(page_buffer_), 3 << kPageShift));
+
+  LogRecovery recovery(log_file_.get(), writer.file_offset(), data_file_.get(),
+                       kPageShift, 1);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(3));
+  EXPECT_EQ(1U, recovery.transaction_count());
+  EXPECT_EQ(committed_end, recovery.log_end());
+  ExpectPage(1, 'a');
+  ExpectPage(3, 0);
+}
+
+TEST_F(LogRecoveryTest, IgnoresStaleEpoch) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  LogTransaction(&writer, {{1, 'a'}});
+  LogTransaction(&writer, {{2, 'a'}});
+  LogTransaction(&writer, {{3, 'a'}});
+  const size_t stale_end = writer.file_offset();
+
+  // A checkpoint resets the log, and the new records only overwrite a prefix
+  // of the old records.
+  writer.Reset(2);
+  LogTransaction(&writer, {{1, 'b'}});
+  const size_t fresh_end = writer.file_offset();
+  ASSERT_LT(fresh_end, stale_end);
+
+  {
+    LogRecovery recovery(log_file_.get(), stale_end, data_file_.get(),
+                         kPageShift, 2);
+    ASSERT_EQ(Status::kSuccess, recovery.Run(2));
+    EXPECT_EQ(1U, recovery.transaction_count());
+    EXPECT_EQ(fresh_end, recovery.log_end());
+    ExpectPage(1, 'b');
+  }
+
+  {
+    LogRecovery recovery(log_file_.get(), stale_end, data_file_.get(),
+                         kPageShift, 3);
+    ASSERT_EQ(Status::kSuccess, recovery.Run(2));
+    EXPECT_EQ(0U, recovery.transaction_count());
+    EXPECT_EQ(0U, recovery.log_end());
+  }
+}
+
+TEST_F(LogRecoveryTest, CommitRecordCountMismatch) {
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  FillSpan(span<uint8_t>(page_buffer_), 'a');
+  writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  writer.AppendCommit(2);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+
+  LogRecovery recovery(log_file_.get(), writer.file_offset(), data_file_.get(),
+                       kPageShift, 1);
+  EXPECT_EQ(Status::kDataCorrupted, recovery.Run(2));
+}
+
+TEST_F(LogRecoveryTest, ReplaysCompressedPageImages) {
+  if (!kPlatformHasCompression)
+    return;
+
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.set_compresses_page_images(true);
+  writer.Reset(3);
+  LogTransaction(&writer, {{1, 'a'}, {2, 'b'}});
+
+  // Random bytes don't shrink, so this page is logged uncompressed.
+  std::mt19937 rnd(7);
+  for (uint8_t& byte : page_buffer_)
+    byte = static_cast<uint8_t>(rnd());
+  writer.AppendPageImage(3, span<const uint8_t>(page_buffer_));
+  writer.AppendCommit(1);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  std::vector<uint8_t> random_page(page_buffer_, page_buffer_ + kPageSize);
+
+  // Only the first two images shrank.
+  const LogWriter::CompressionStats stats = writer.compression_stats();
+  EXPECT_EQ(3U, stats.page_count);
+  EXPECT_LT(LogFormat::PageImageRecordSize(kPageShift), stats.record_bytes);
+  EXPECT_GT(2 * LogFormat::PageImageRecordSize(kPageShift), stats.record_bytes);
+
+  LogRecovery recovery(log_file_.get(), writer.file_offset(), data_file_.get(),
+                       kPageShift, 3);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(2));
+  EXPECT_EQ(2U, recovery.transaction_count());
+  EXPECT_EQ(3U, recovery.page_image_count());
+  EXPECT_EQ(writer.file_offset(), recovery.log_end());
+  ExpectPage(1, 'a');
+  ExpectPage(2, 'b');
+  ASSERT_EQ(Status::kSuccess, data_file_->Read(
+      3 << kPageShift, span<uint8_t>(page_buffer_)));
+  EXPECT_EQ(random_page,
+            std::vector<uint8_t>(page_buffer_, page_buffer_ + kPageSize));
+}
+
+TEST_F(LogRecoveryTest, CompressedPageImageWithoutCompressor) {
+  if (kPlatformHasCompression)
+    return;
+
+  // Build systems without a compressor can't produce compressed payloads, so
+  // the record is assembled by hand.
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(1);
+  alignas(8) uint8_t payload_bytes[LogFormat::kCompressedSizeFieldSize + 8];
+  span<uint8_t> payload(payload_bytes);
+  FillSpan(payload, 0);
+  StoreUint64(8, payload.first(LogFormat::kCompressedSizeFieldSize));
+  const uint64_t lsn = writer.Reserve(
+      LogFormat::CompressedPageImageRecordSize(8) +
+      LogFormat::kCommitRecordSize);
+  writer.WriteCompressedPageImage(lsn, 1, payload);
+  writer.WriteCommit(lsn + LogFormat::CompressedPageImageRecordSize(8), 1);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+
+  LogRecovery recovery(log_file_.get(), writer.file_offset(), data_file_.get(),
+                       kPageShift, 1);
+  EXPECT_EQ(Status::kNotSupported, recovery.Run(2));
+}
+
+TEST_F(LogRecoveryTest, RandomTransactionsMatchSerialReplay) {
+  constexpr size_t kPageCount = 64;
+  std::vector<uint8_t> expected(kPageCount, 0);
+
+  FillSpan(span<uint8_t>(page_buffer_), 0);
+  for (size_t i = 0; i < kPageCount; ++i) {
+    ASSERT_EQ(Status::kSuccess, data_file_->Write(
+        span<const uint8_t>(page_buffer_), i << kPageShift));
+  }
+
+  std::mt19937 rnd(42);
+  LogWriter writer(log_file_.get(), 0, kPageShift);
+  writer.Reset(5);
+  for (size_t i = 0; i < 200; ++i) {
+    std::vector<std::pair<size_t, uint8_t>> pages;
+    const size_t transaction_page_count = 1 + rnd() % 6;
+    for (size_t j = 0; j < transaction_page_count; ++j) {
+      const size_t page_id = rnd() % kPageCount;
+      const uint8_t value = static_cast<uint8_t>(1 + rnd() % 255);
+      pages.emplace_back(page_id, value);
+      expected[page_id] = value;
+    }
+    LogTransaction(&writer, pages);
+  }
+
+  LogRecovery recovery(log_file_.get(), writer.file_offset(), data_file_.get(),
+                       kPageShift, 5);
+  ASSERT_EQ(Status::kSuccess, recovery.Run(3));
+  EXPECT_EQ(200U, recovery.transaction_count());
+  for (size_t i = 0; i < kPageCount; ++i)
+    ExpectPage(i, expected[i]);
+}
+
+}  // namespace berrydb
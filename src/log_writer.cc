@@ -0,0 +1,610 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./log_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#include "berrydb/status.h"
+#include "berrydb/vfs.h"
+#include "./format/log_format.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+/** The ring buffer size used for a page size.
+ *
+ * The buffer must be able to hold a few page images, so that large
+ * transactions don't have to wait for the flusher after every record. */
+size_t BufferCapacity(size_t page_shift) noexcept {
+  size_t capacity = 4 << 20;
+  while (capacity < 8 * LogFormat::PageImageRecordSize(page_shift))
+    capacity *= 2;
+  return capacity;
+}
+
+}  // namespace
+
+constexpr size_t LogWriter::kBlockSize;
+constexpr uint64_t LogWriter::kFirstLsn;
+
+LogWriter::LogWriter(RandomAccessFile* log_file, size_t log_file_size,
+                     size_t page_shift) noexcept
+    : log_file_(log_file), page_shift_(page_shift),
+      buffer_(reinterpret_cast<uint8_t*>(
+          Allocate(BufferCapacity(page_shift)))),
+      buffer_capacity_(BufferCapacity(page_shift)),
+      block_counters_(reinterpret_cast<std::atomic<size_t>*>(Allocate(
+          (buffer_capacity_ / kBlockSize) * sizeof(std::atomic<size_t>)))),
+      reserved_lsn_(kFirstLsn), flushed_lsn_(kFirstLsn),
+      synced_lsn_(kFirstLsn),
+      compressed_payload_capacity_(
+          LogFormat::kCompressedSizeFieldSize +
+          ((PlatformMaxCompressedSize(static_cast<size_t>(1) << page_shift) +
+            7) & ~static_cast<size_t>(7))),
+      compressed_page_count_(0), compressed_record_bytes_(0),
+      compression_ns_(0),
+      // A partial segment at the end of the file is overwritten when the file
+      // is grown. This can only happen if a crash interrupts GrowFile().
+      file_size_(log_file_size - log_file_size % LogFormat::kSegmentSize),
+      has_io_errors_(false), background_status_(Status::kSuccess) {
+  BERRYDB_ASSUME(log_file != nullptr);
+  static_assert((kBlockSize & (kBlockSize - 1)) == 0,
+                "The block size must be a power of two");
+
+  const size_t block_count = buffer_capacity_ / kBlockSize;
+  for (size_t i = 0; i < block_count; ++i)
+    new (&block_counters_[i]) std::atomic<size_t>(0);
+}
+
+LogWriter::~LogWriter() {
+  BERRYDB_ASSUME(!sync_thread_.joinable());
+  BERRYDB_ASSUME(pending_sync_callbacks_.empty());
+
+  Deallocate(buffer_, buffer_capacity_);
+  // std::atomic<size_t> is trivially destructible.
+  Deallocate(block_counters_,
+             (buffer_capacity_ / kBlockSize) * sizeof(std::atomic<size_t>));
+}
+
+void LogWriter::Reset(uint64_t epoch) noexcept {
+  std::unique_lock<std::mutex> io_lock(io_mutex_);
+
+  // Discarding the buffered records leaves the block counters consistent, as
+  // long as no records are being copied. Every reserved byte before the new
+  // flush position counts as copied.
+  const uint64_t reserved_lsn = reserved_lsn_.load(std::memory_order_relaxed);
+  uint64_t block_start = flushed_lsn_.load(std::memory_order_relaxed) &
+                         ~static_cast<uint64_t>(kBlockSize - 1);
+  while (block_start + kBlockSize <= reserved_lsn) {
+    BlockCounter(block_start)->store(0, std::memory_order_relaxed);
+    block_start += kBlockSize;
+  }
+
+  epoch_ = epoch;
+  reset_lsn_ = reserved_lsn;
+  synced_lsn_.store(reserved_lsn, std::memory_order_relaxed);
+  flushed_lsn_.store(reserved_lsn, std::memory_order_release);
+  io_lock.unlock();
+
+  // Resets happen after the data covered by the log is durable, so any records
+  // that weren't synced don't need to be.
+  RunSyncCallbacks(Status::kSuccess);
+}
+
+bool LogWriter::WaitForBufferSpace(uint64_t end_lsn) {
+  while (true) {
+    // Buffer blocks are only recycled after they are completely flushed.
+    const uint64_t flushed_block_start =
+        flushed_lsn_.load(std::memory_order_acquire) &
+        ~static_cast<uint64_t>(kBlockSize - 1);
+    if (LIKELY(end_lsn <= flushed_block_start + buffer_capacity_))
+      return true;
+    if (UNLIKELY(has_io_errors_.load(std::memory_order_relaxed)))
+      return false;
+
+    // Help drain the buffer, unless another thread is already doing that.
+    if (io_mutex_.try_lock()) {
+      FlushLocked();
+      io_mutex_.unlock();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void LogWriter::WriteRecord(uint64_t lsn, LogFormat::RecordType type,
+                            uint64_t argument, span<const uint8_t> payload) {
+  const size_t record_size = LogFormat::kRecordHeaderSize + payload.size();
+  if (UNLIKELY(!WaitForBufferSpace(lsn + record_size)))
+    return;  // The error is reported when the log is synced.
+
+  const size_t buffer_offset =
+      static_cast<size_t>(lsn & (buffer_capacity_ - 1));
+  if (LIKELY(buffer_offset + record_size <= buffer_capacity_)) {
+    const span<uint8_t> record(buffer_ + buffer_offset, record_size);
+    LogFormat::SetHeader(type, epoch_, argument, record);
+    CopySpan(payload, record.subspan(LogFormat::kRecordHeaderSize));
+    LogFormat::SetChecksum(record);
+  } else {
+    // The record wraps around the end of the ring. This is rare enough that
+    // building the record in a separate buffer is fine.
+    uint8_t* const scratch = reinterpret_cast<uint8_t*>(Allocate(record_size));
+    const span<uint8_t> record(scratch, record_size);
+    LogFormat::SetHeader(type, epoch_, argument, record);
+    CopySpan(payload, record.subspan(LogFormat::kRecordHeaderSize));
+    LogFormat::SetChecksum(record);
+
+    const size_t head_size = buffer_capacity_ - buffer_offset;
+    CopySpan(record.first(head_size),
+             span<uint8_t>(buffer_ + buffer_offset, head_size));
+    CopySpan(record.subspan(head_size),
+             span<uint8_t>(buffer_, record_size - head_size));
+    Deallocate(scratch, record_size);
+  }
+
+  PublishRange(lsn, record_size);
+}
+
+void LogWriter::PublishRange(uint64_t lsn, size_t byte_count) {
+  const uint64_t end_lsn = lsn + byte_count;
+  while (lsn < end_lsn) {
+    const uint64_t block_end =
+        (lsn | static_cast<uint64_t>(kBlockSize - 1)) + 1;
+    const uint64_t chunk_end = std::min(end_lsn, block_end);
+    // The release pairs with the flusher's acquire, so the flusher sees the
+    // copied bytes.
+    BlockCounter(lsn)->fetch_add(static_cast<size_t>(chunk_end - lsn),
+                                 std::memory_order_release);
+    lsn = chunk_end;
+  }
+}
+
+void LogWriter::WritePageImage(uint64_t lsn, size_t page_id,
+                               span<const uint8_t> page_data) {
+  BERRYDB_ASSUME_EQ(page_data.size(), static_cast<size_t>(1) << page_shift_);
+  WriteRecord(lsn, LogFormat::RecordType::kPageImage,
+              static_cast<uint64_t>(page_id), page_data);
+}
+
+void LogWriter::WriteCompressedPageImage(uint64_t lsn, size_t page_id,
+                                         span<const uint8_t> payload) {
+  BERRYDB_ASSUME_GT(payload.size(), LogFormat::kCompressedSizeFieldSize);
+  BERRYDB_ASSUME_EQ(payload.size() & 7, 0U);
+  WriteRecord(lsn, LogFormat::RecordType::kCompressedPageImage,
+              static_cast<uint64_t>(page_id), payload);
+}
+
+void LogWriter::WriteCommit(uint64_t lsn, size_t page_count) {
+  WriteRecord(lsn, LogFormat::RecordType::kCommit,
+              static_cast<uint64_t>(page_count), span<const uint8_t>());
+
+  // Commit records end transactions, so they are a good time to check whether
+  // the background thread should kick in. The notification is sent without
+  // holding the thread's mutex, so it may occasionally be missed. The sync
+  // interval bounds the resulting delay.
+  if (sync_byte_threshold_ != 0 && BufferedBytes() >= sync_byte_threshold_)
+    sync_condition_.notify_one();
+}
+
+void LogWriter::set_compresses_page_images(
+    bool compresses_page_images) noexcept {
+  BERRYDB_ASSUME(!compresses_page_images || kPlatformHasCompression);
+  compresses_page_images_ = compresses_page_images;
+}
+
+size_t LogWriter::CompressPageImage(span<const uint8_t> page_data,
+                                    span<uint8_t> payload) {
+  BERRYDB_ASSUME(compresses_page_images_);
+  BERRYDB_ASSUME_EQ(page_data.size(), static_cast<size_t>(1) << page_shift_);
+  BERRYDB_ASSUME_EQ(payload.size(), compressed_payload_capacity_);
+
+  const auto start_time = std::chrono::steady_clock::now();
+  const size_t compressed_size = PlatformCompress(
+      page_data.data(), page_data.size(),
+      payload.data() + LogFormat::kCompressedSizeFieldSize);
+  const auto compression_time = std::chrono::steady_clock::now() - start_time;
+
+  size_t payload_size = 0;
+  const size_t record_size =
+      LogFormat::CompressedPageImageRecordSize(compressed_size);
+  if (record_size < LogFormat::PageImageRecordSize(page_shift_)) {
+    payload_size = record_size - LogFormat::kRecordHeaderSize;
+    StoreUint64(static_cast<uint64_t>(compressed_size),
+                payload.first(LogFormat::kCompressedSizeFieldSize));
+    // The padding is covered by the record's checksum, so it must not hold
+    // stale buffer content.
+    const size_t data_end =
+        LogFormat::kCompressedSizeFieldSize + compressed_size;
+    FillSpan(payload.subspan(data_end, payload_size - data_end), 0);
+  }
+
+  compressed_page_count_.fetch_add(1, std::memory_order_relaxed);
+  compressed_record_bytes_.fetch_add(PageImageRecordSize(payload_size),
+                                     std::memory_order_relaxed);
+  compression_ns_.fetch_add(
+      static_cast<uint64_t>(std::chrono::duration_cast<
+          std::chrono::nanoseconds>(compression_time).count()),
+      std::memory_order_relaxed);
+  return payload_size;
+}
+
+LogWriter::CompressionStats LogWriter::compression_stats() const noexcept {
+  CompressionStats stats;
+  stats.page_count = compressed_page_count_.load(std::memory_order_relaxed);
+  stats.record_bytes =
+      compressed_record_bytes_.load(std::memory_order_relaxed);
+  stats.compression_ns = compression_ns_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+uint64_t LogWriter::AppendPageImage(size_t page_id,
+                                    span<const uint8_t> page_data) {
+  if (!compresses_page_images_) {
+    const uint64_t lsn = Reserve(LogFormat::PageImageRecordSize(page_shift_));
+    WritePageImage(lsn, page_id, page_data);
+    return lsn;
+  }
+
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(
+      Allocate(compressed_payload_capacity_));
+  const span<uint8_t> payload(buffer, compressed_payload_capacity_);
+  const size_t payload_size = CompressPageImage(page_data, payload);
+  const uint64_t lsn = Reserve(PageImageRecordSize(payload_size));
+  if (payload_size == 0)
+    WritePageImage(lsn, page_id, page_data);
+  else
+    WriteCompressedPageImage(lsn, page_id, payload.first(payload_size));
+  Deallocate(buffer, compressed_payload_capacity_);
+  return lsn;
+}
+
+uint64_t LogWriter::AppendCommit(size_t page_count) {
+  const uint64_t lsn = Reserve(LogFormat::kCommitRecordSize);
+  WriteCommit(lsn, page_count);
+  return lsn + LogFormat::kCommitRecordSize;
+}
+
+Status LogWriter::Flush() {
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+  return FlushLocked();
+}
+
+Status LogWriter::FlushLocked() {
+  if (UNLIKELY(has_io_errors_.load(std::memory_order_relaxed)))
+    return Status::kIoError;
+
+  // Find the longest prefix of fully copied buffered records.
+  const uint64_t flush_start = flushed_lsn_.load(std::memory_order_relaxed);
+  const uint64_t flush_limit =
+      (flush_start & ~static_cast<uint64_t>(kBlockSize - 1)) +
+      buffer_capacity_;
+  uint64_t flush_end = flush_start;
+  while (flush_end < flush_limit) {
+    const uint64_t block_start =
+        flush_end & ~static_cast<uint64_t>(kBlockSize - 1);
+    const size_t copied_bytes =
+        BlockCounter(block_start)->load(std::memory_order_acquire);
+    if (copied_bytes == kBlockSize) {
+      flush_end = block_start + kBlockSize;
+      continue;
+    }
+
+    // The block is partially filled. It can be flushed if all the space
+    // reserved in it has been copied. The reservation counter must be read
+    // after the block counter. Otherwise, bytes copied into a later
+    // reservation could make up for bytes that haven't been copied yet.
+    const uint64_t reserved_lsn = reserved_lsn_.load(std::memory_order_acquire);
+    if (reserved_lsn < block_start + kBlockSize &&
+        copied_bytes == reserved_lsn - block_start) {
+      flush_end = reserved_lsn;
+    }
+    break;
+  }
+  if (flush_end == flush_start)
+    return Status::kSuccess;
+
+  const size_t file_offset = static_cast<size_t>(flush_start - reset_lsn_);
+  const size_t flush_size = static_cast<size_t>(flush_end - flush_start);
+  Status status = Status::kSuccess;
+  if (UNLIKELY(file_offset + flush_size > file_size_))
+    status = GrowFile(file_offset + flush_size);
+
+  if (LIKELY(status == Status::kSuccess)) {
+    const size_t buffer_offset =
+        static_cast<size_t>(flush_start & (buffer_capacity_ - 1));
+    const size_t head_size =
+        std::min(flush_size, buffer_capacity_ - buffer_offset);
+    status = log_file_->Write(
+        span<const uint8_t>(buffer_ + buffer_offset, head_size), file_offset);
+    if (LIKELY(status == Status::kSuccess) && head_size != flush_size) {
+      status = log_file_->Write(
+          span<const uint8_t>(buffer_, flush_size - head_size),
+          file_offset + head_size);
+    }
+  }
+  if (UNLIKELY(status != Status::kSuccess)) {
+    has_io_errors_.store(true, std::memory_order_relaxed);
+    return status;
+  }
+
+  // Recycle the blocks that were completely written out. This must happen
+  // before the new flush position is published, because the position lets
+  // committers reuse the blocks.
+  uint64_t block_start = flush_start & ~static_cast<uint64_t>(kBlockSize - 1);
+  while (block_start + kBlockSize <= flush_end) {
+    BlockCounter(block_start)->store(0, std::memory_order_relaxed);
+    block_start += kBlockSize;
+  }
+  flushed_lsn_.store(flush_end, std::memory_order_release);
+  return Status::kSuccess;
+}
+
+Status LogWriter::Sync() {
+  return SyncTo(reserved_lsn_.load(std::memory_order_acquire));
+}
+
+Status LogWriter::SyncTo(uint64_t lsn) {
+  if (synced_lsn_.load(std::memory_order_acquire) >= lsn)
+    return Status::kSuccess;
+
+  Status status;
+  std::unique_lock<std::mutex> io_lock(io_mutex_);
+  while (true) {
+    // Another thread may have synced the records while this thread waited for
+    // the lock. This is how concurrent commits share log syncs.
+    if (synced_lsn_.load(std::memory_order_relaxed) >= lsn)
+      return Status::kSuccess;
+
+    status = FlushLocked();
+    if (UNLIKELY(status != Status::kSuccess))
+      break;
+
+    const uint64_t flushed_lsn = flushed_lsn_.load(std::memory_order_relaxed);
+    if (flushed_lsn >= lsn) {
+      status = log_file_->Sync();
+      if (UNLIKELY(status != Status::kSuccess)) {
+        // After a failed sync, there is no telling which writes made it to
+        // disk.
+        has_io_errors_.store(true, std::memory_order_relaxed);
+        break;
+      }
+      synced_lsn_.store(flushed_lsn, std::memory_order_release);
+      break;
+    }
+
+    // Records before the LSN are still being copied by other threads.
+    io_lock.unlock();
+    std::this_thread::yield();
+    io_lock.lock();
+  }
+  io_lock.unlock();
+
+  RunSyncCallbacks(status);
+  return status;
+}
+
+void LogWriter::WhenSynced(uint64_t lsn, SyncCallback callback,
+                           void* context) {
+  BERRYDB_ASSUME(callback != nullptr);
+
+  Status status = Status::kSuccess;
+  {
+    std::lock_guard<std::mutex> callback_lock(callback_mutex_);
+
+    // Syncs update synced_lsn_ before they take callback_mutex_ to collect the
+    // callbacks, so a callback registered here cannot be missed.
+    if (UNLIKELY(has_io_errors_.load(std::memory_order_relaxed))) {
+      status = Status::kIoError;
+    } else if (synced_lsn_.load(std::memory_order_acquire) < lsn) {
+      pending_sync_callbacks_.push_back({lsn, callback, context});
+      return;
+    }
+  }
+  callback(status, context);
+}
+
+void LogWriter::AbandonSyncCallbacks(Status status) {
+  BERRYDB_ASSUME_NE(status, Status::kSuccess);
+  RunSyncCallbacks(status);
+}
+
+void LogWriter::RunSyncCallbacks(Status status) {
+  std::vector<PendingSyncCallback, PlatformAllocator<PendingSyncCallback>>
+      ready_callbacks;
+  {
+    std::lock_guard<std::mutex> callback_lock(callback_mutex_);
+    if (pending_sync_callbacks_.empty())
+      return;
+
+    if (UNLIKELY(status != Status::kSuccess)) {
+      ready_callbacks.swap(pending_sync_callbacks_);
+    } else {
+      const uint64_t synced_lsn = synced_lsn_.load(std::memory_order_acquire);
+      auto ready_begin = std::stable_partition(
+          pending_sync_callbacks_.begin(), pending_sync_callbacks_.end(),
+          [synced_lsn](const PendingSyncCallback& pending) {
+            return pending.lsn > synced_lsn;
+          });
+      ready_callbacks.assign(ready_begin, pending_sync_callbacks_.end());
+      pending_sync_callbacks_.erase(ready_begin,
+                                    pending_sync_callbacks_.end());
+    }
+  }
+
+  for (const PendingSyncCallback& pending : ready_callbacks)
+    pending.callback(status, pending.context);
+}
+
+Status LogWriter::ReadPageImage(uint64_t lsn, span<uint8_t> page_data) {
+  BERRYDB_ASSUME_EQ(page_data.size(), static_cast<size_t>(1) << page_shift_);
+  BERRYDB_ASSUME_GE(lsn, reset_lsn_);
+
+  // Holding io_mutex_ stops the flusher from recycling the buffer blocks.
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+
+  // Pages are at least as large as the compressed size field, so this does not
+  // read past the end of an uncompressed record.
+  alignas(8) uint8_t header_bytes[LogFormat::kRecordHeaderSize +
+                                  LogFormat::kCompressedSizeFieldSize];
+  const span<uint8_t> header(header_bytes);
+  Status status = ReadLockedRange(lsn, header);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  const uint64_t data_lsn = lsn + LogFormat::kRecordHeaderSize;
+  if (LogFormat::Type64(header) !=
+      static_cast<uint64_t>(LogFormat::RecordType::kCompressedPageImage)) {
+    BERRYDB_ASSUME_EQ(
+        LogFormat::Type64(header),
+        static_cast<uint64_t>(LogFormat::RecordType::kPageImage));
+    return ReadLockedRange(data_lsn, page_data);
+  }
+
+  const size_t compressed_size =
+      static_cast<size_t>(LogFormat::CompressedSize64(header));
+  BERRYDB_ASSUME_LE(compressed_size, page_data.size());
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(compressed_size));
+  const span<uint8_t> compressed(buffer, compressed_size);
+  status = ReadLockedRange(data_lsn + LogFormat::kCompressedSizeFieldSize,
+                           compressed);
+  if (LIKELY(status == Status::kSuccess) &&
+      UNLIKELY(!PlatformDecompress(compressed.data(), compressed.size(),
+                                   page_data.data(), page_data.size()))) {
+    status = Status::kDataCorrupted;
+  }
+  Deallocate(buffer, compressed_size);
+  return status;
+}
+
+Status LogWriter::ReadLockedRange(uint64_t lsn, span<uint8_t> output) {
+  // The bytes before the flush position were written to the file. The bytes
+  // after it are still in the buffer, whose blocks are only recycled after they
+  // are completely flushed.
+  const uint64_t flushed_lsn = flushed_lsn_.load(std::memory_order_relaxed);
+  if (lsn < flushed_lsn) {
+    const size_t file_size = static_cast<size_t>(
+        std::min<uint64_t>(flushed_lsn - lsn, output.size()));
+    const Status status = log_file_->Read(
+        static_cast<size_t>(lsn - reset_lsn_), output.first(file_size));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    lsn += file_size;
+    output = output.subspan(file_size);
+  }
+  if (output.empty())
+    return Status::kSuccess;
+
+  const size_t buffer_offset =
+      static_cast<size_t>(lsn & (buffer_capacity_ - 1));
+  const size_t head_size =
+      std::min(output.size(), buffer_capacity_ - buffer_offset);
+  CopySpan(span<const uint8_t>(buffer_ + buffer_offset, head_size),
+           output.first(head_size));
+  CopySpan(span<const uint8_t>(buffer_, output.size() - head_size),
+           output.subspan(head_size));
+  return Status::kSuccess;
+}
+
+void LogWriter::StartBackgroundSync(size_t interval_ms,
+                                    size_t byte_threshold) {
+  BERRYDB_ASSUME(!sync_thread_.joinable());
+  BERRYDB_ASSUME_GT(interval_ms, 0U);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sync_interval_ms_ = interval_ms;
+    sync_byte_threshold_ = byte_threshold;
+    sync_thread_stopping_ = false;
+  }
+  sync_thread_ = std::thread(&LogWriter::BackgroundSyncLoop, this);
+}
+
+Status LogWriter::StopBackgroundSync() {
+  if (!sync_thread_.joinable())
+    return Sync();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sync_thread_stopping_ = true;
+  }
+  sync_condition_.notify_one();
+  sync_thread_.join();
+
+  const Status status = background_status();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return Sync();
+}
+
+Status LogWriter::background_status() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return background_status_;
+}
+
+void LogWriter::BackgroundSyncLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    sync_condition_.wait_for(
+        lock, std::chrono::milliseconds(sync_interval_ms_), [this] {
+          return sync_thread_stopping_ ||
+                 (sync_byte_threshold_ != 0 &&
+                  BufferedBytes() >= sync_byte_threshold_);
+        });
+    if (sync_thread_stopping_)
+      return;
+    if (BufferedBytes() == 0)
+      continue;
+
+    lock.unlock();
+    const Status status = Sync();
+    lock.lock();
+    if (UNLIKELY(status != Status::kSuccess)) {
+      if (background_status_ == Status::kSuccess)
+        background_status_ = status;
+      // Syncing will keep failing, so the thread is not useful anymore.
+      return;
+    }
+  }
+}
+
+Status LogWriter::GrowFile(size_t min_file_size) {
+  constexpr size_t kSegmentSize = LogFormat::kSegmentSize;
+  const size_t new_file_size =
+      (min_file_size + kSegmentSize - 1) / kSegmentSize * kSegmentSize;
+
+  // Zeroes are written in chunks, to avoid allocating a whole segment.
+  constexpr size_t kChunkSize = 64 * 1024;
+  static_assert(kSegmentSize % kChunkSize == 0,
+                "Segments must consist of whole chunks");
+  uint8_t* const zeros = reinterpret_cast<uint8_t*>(Allocate(kChunkSize));
+  const span<uint8_t> chunk(zeros, kChunkSize);
+  FillSpan(chunk, 0);
+
+  Status status = Status::kSuccess;
+  for (size_t offset = file_size_; offset < new_file_size;
+       offset += kChunkSize) {
+    status = log_file_->Write(chunk, offset);
+    if (UNLIKELY(status != Status::kSuccess))
+      break;
+  }
+  Deallocate(zeros, kChunkSize);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // This sync covers the file size change, so commit syncs won't have to.
+  status = log_file_->Sync();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  file_size_ = new_file_size;
+  return Status::kSuccess;
+}
+
+}  // namespace berrydb
@@ -0,0 +1,469 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_LOG_WRITER_H_
+#define BERRYDB_LOG_WRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./format/log_format.h"
+#include "./util/checks.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class RandomAccessFile;
+enum class Status : int;
+
+/** Appends records to a store's log file.
+ *
+ * Records are accumulated in an in-memory buffer, and are written to the log
+ * file by Flush(). This turns the records produced by a transaction commit into
+ * a single large write.
+ *
+ * Each store has a LogWriter. The writer's state is reset at every checkpoint,
+ * when all the data covered by the log has made it to the store's data file.
+ * After a reset, records are written at the beginning of the log file, and are
+ * tagged with a new epoch, so recovery can tell them apart from any stale
+ * records that might follow them.
+ *
+ * The writer grows the log file in zero-filled segments, and syncs the file
+ * after growing it. Flushes that fit in the existing segments only overwrite
+ * data, so the syncs issued by commits don't have to update the file size.
+ *
+ * Each appended record is identified by a log sequence number (LSN), which is
+ * the number of bytes appended before the record, plus a fixed offset. Unlike
+ * file offsets, LSNs keep growing across Reset() calls, so they can be compared
+ * to tell whether a record has reached persistent storage. 0 is never a valid
+ * LSN, so it is used to mean "no record".
+ *
+ * Records can be appended by multiple threads without locking. The buffer is a
+ * ring indexed by LSN. A committer reserves buffer space for all its records
+ * with a single atomic add, copies its records into the buffer, and then adds
+ * the number of copied bytes to the completion counters of the buffer blocks
+ * that the records landed in. A single flusher at a time (serialized by a
+ * mutex) writes out the longest prefix of the buffered data whose blocks are
+ * complete. Committers only wait when the ring is full, or when they need
+ * their records synced.
+ *
+ * The writer can optionally run a background thread that flushes and syncs
+ * the buffered records periodically, or when the buffer grows past a threshold.
+ * This is used by stores that opt into relaxed durability, whose commits do not
+ * wait for the log to be synced.
+ *
+ * Callers that don't want to wait for a sync can register a callback that runs
+ * once the log is synced past an LSN. The callbacks run on the thread that
+ * completes the sync, after the writer's locks are released.
+ *
+ * The writer can optionally compress page images. Record sizes must be known
+ * before log space is reserved, so committers compress their pages with
+ * CompressPageImage() ahead of calling Reserve(). Pages that don't shrink are
+ * logged as is.
+ */
+class LogWriter {
+ public:
+  /** Work done by the page image compressor since the writer was created. */
+  struct CompressionStats {
+    /** The number of page images that went through the compressor. */
+    uint64_t page_count;
+    /** The total size of the records that log the compressed pages.
+     *
+     * Pages that did not shrink are counted with their uncompressed size. */
+    uint64_t record_bytes;
+    /** The total time spent compressing pages, in nanoseconds. */
+    uint64_t compression_ns;
+  };
+
+  /** Called when the log is synced past an LSN registered with WhenSynced().
+   *
+   * @param status  kSuccess if the records before the LSN are durable,
+   *                otherwise the error that stopped the log from being synced
+   * @param context the value passed to WhenSynced()
+   */
+  using SyncCallback = void (*)(Status status, void* context);
+
+  /** Sets up a writer for a log file.
+   *
+   * The writer must be Reset() before it can be used.
+   *
+   * @param log_file      the store's log file
+   * @param log_file_size the log file's current size, in bytes
+   * @param page_shift    base-2 log of the store's page size
+   */
+  LogWriter(RandomAccessFile* log_file, size_t log_file_size,
+            size_t page_shift) noexcept;
+  ~LogWriter();
+
+  LogWriter(const LogWriter&) = delete;
+  LogWriter(LogWriter&&) = delete;
+  LogWriter& operator=(const LogWriter&) = delete;
+  LogWriter& operator=(LogWriter&&) = delete;
+
+  /** Starts writing records at the beginning of the log file.
+   *
+   * Any buffered records are discarded. This must not be called while other
+   * threads are appending records.
+   *
+   * @param epoch the epoch that will tag the records written from now on
+   */
+  void Reset(uint64_t epoch) noexcept;
+
+  /** Reserves log space for records that will be written later.
+   *
+   * The records that will be written in the reserved space are guaranteed to be
+   * contiguous in the log, even if other threads append records concurrently.
+   * Every reserved byte must be written by WritePageImage(),
+   * WriteCompressedPageImage() or WriteCommit(), otherwise the log cannot be
+   * flushed past the reservation.
+   *
+   * @param  byte_count the total size of the records that will be written
+   * @return            the LSN of the first reserved byte
+   */
+  inline uint64_t Reserve(size_t byte_count) noexcept {
+    return reserved_lsn_.fetch_add(byte_count, std::memory_order_relaxed);
+  }
+
+  /** Writes a record holding a page's new content into reserved space.
+   *
+   * @param lsn       the record's LSN, in space obtained from Reserve()
+   * @param page_id   the ID of the page whose content is logged
+   * @param page_data the page's content; must be exactly one page
+   */
+  void WritePageImage(uint64_t lsn, size_t page_id,
+                      span<const uint8_t> page_data);
+
+  /** Writes a record holding a page's compressed content into reserved space.
+   *
+   * @param lsn     the record's LSN, in space obtained from Reserve()
+   * @param page_id the ID of the page whose content is logged
+   * @param payload the record's payload, built by CompressPageImage()
+   */
+  void WriteCompressedPageImage(uint64_t lsn, size_t page_id,
+                                span<const uint8_t> payload);
+
+  /** Writes a record marking the end of a transaction into reserved space.
+   *
+   * @param lsn        the record's LSN, in space obtained from Reserve()
+   * @param page_count the number of page image records in the transaction
+   */
+  void WriteCommit(uint64_t lsn, size_t page_count);
+
+  /** Compresses a page's content, ahead of logging it.
+   *
+   * Must only be called if compresses_page_images() is true.
+   *
+   * @param  page_data the page's content; must be exactly one page
+   * @param  payload   receives the payload of a compressed page image record;
+   *                   must have compressed_payload_capacity() bytes
+   * @return           the payload's size; 0 if the page does not shrink, and
+   *                   should be logged by WritePageImage()
+   */
+  size_t CompressPageImage(span<const uint8_t> page_data,
+                           span<uint8_t> payload);
+
+  /** The size of the record that logs a page image.
+   *
+   * @param payload_size the size returned by CompressPageImage(); 0 for pages
+   *                     logged without compression
+   */
+  inline constexpr size_t PageImageRecordSize(size_t payload_size) const
+      noexcept {
+    return (payload_size == 0) ?
+        LogFormat::PageImageRecordSize(page_shift_) :
+        LogFormat::kRecordHeaderSize + payload_size;
+  }
+
+  /** Buffers a record holding a page's new content.
+   *
+   * The page is compressed if compresses_page_images() is true.
+   *
+   * @param  page_id   the ID of the page whose content is logged
+   * @param  page_data the page's content; must be exactly one page
+   * @return           the LSN of the new record
+   */
+  uint64_t AppendPageImage(size_t page_id, span<const uint8_t> page_data);
+
+  /** Buffers a record marking the end of a transaction's page images.
+   *
+   * @param  page_count the number of page image records in the transaction
+   * @return            the LSN right past the new record; the transaction is
+   *                    durable once the log is synced up to this LSN
+   */
+  uint64_t AppendCommit(size_t page_count);
+
+  /** Writes the fully copied buffered records to the log file.
+   *
+   * A failed write leaves the writer unusable, because the LSNs of the records
+   * that follow would not match their file offsets. All subsequent Flush() and
+   * Sync() calls fail.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status Flush();
+
+  /** Writes all the records reserved so far, and syncs the log file.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status Sync();
+
+  /** Makes sure that the log is synced at least up to the given LSN.
+   *
+   * This is cheap when the records were already synced. Otherwise, this waits
+   * for any records before the LSN that are still being copied by other
+   * threads. Concurrent callers share the same log file sync.
+   *
+   * @param  lsn the log is synced up to (but not including) this LSN
+   * @return     most likely kSuccess or kIoError
+   */
+  Status SyncTo(uint64_t lsn);
+
+  /** Runs a callback once the log is synced at least up to the given LSN.
+   *
+   * The callback runs right away if the records were already synced, or if the
+   * log file failed. Otherwise, it runs on the thread that completes the next
+   * sync covering the LSN.
+   *
+   * @param lsn      the log must be synced up to (but not including) this LSN
+   * @param callback called exactly once
+   * @param context  passed to the callback
+   */
+  void WhenSynced(uint64_t lsn, SyncCallback callback, void* context);
+
+  /** Runs all the callbacks waiting for a sync, reporting a failure.
+   *
+   * This is used when the log will not be synced anymore, such as when the
+   * store is closed after an error.
+   *
+   * @param status the error reported to the callbacks
+   */
+  void AbandonSyncCallbacks(Status status);
+
+  /** Reads back the content in a page image record.
+   *
+   * The record may be buffered or flushed, and may be compressed. It must have
+   * been appended after the last Reset().
+   *
+   * @param  lsn       the page image record's LSN
+   * @param  page_data receives the page's content; must be exactly one page
+   * @return           kDataCorrupted if a compressed image cannot be
+   *                   decompressed; otherwise, most likely kSuccess or kIoError
+   */
+  Status ReadPageImage(uint64_t lsn, span<uint8_t> page_data);
+
+  /** Starts a thread that flushes and syncs the buffered records.
+   *
+   * @param interval_ms    the thread syncs at least this often, if there are
+   *                       buffered records
+   * @param byte_threshold the thread syncs soon after there are this many
+   *                       buffered bytes; 0 disables size-based syncs
+   */
+  void StartBackgroundSync(size_t interval_ms, size_t byte_threshold);
+
+  /** Stops the background sync thread and syncs any remaining records.
+   *
+   * @return the first error encountered by the background thread, or the
+   *         result of the final sync
+   */
+  Status StopBackgroundSync();
+
+  /** The first error encountered by the background sync thread.
+   *
+   * Committed transactions may have been lost if this is not kSuccess.
+   */
+  Status background_status();
+
+  /** True if page images are compressed before they are logged. */
+  inline constexpr bool compresses_page_images() const noexcept {
+    return compresses_page_images_;
+  }
+
+  /** Turns page image compression on or off.
+   *
+   * This must not be called while other threads are appending records.
+   * Compression requires a platform compressor (kPlatformHasCompression).
+   */
+  void set_compresses_page_images(bool compresses_page_images) noexcept;
+
+  /** The size of the buffer passed to CompressPageImage(). */
+  inline constexpr size_t compressed_payload_capacity() const noexcept {
+    return compressed_payload_capacity_;
+  }
+
+  /** Work done by the page image compressor so far. */
+  CompressionStats compression_stats() const noexcept;
+
+  /** The epoch that tags the records produced by this writer. */
+  inline constexpr uint64_t epoch() const noexcept { return epoch_; }
+
+  /** The log file offset where the next flushed record will be written. */
+  inline size_t file_offset() const noexcept {
+    return static_cast<size_t>(
+        flushed_lsn_.load(std::memory_order_acquire) - reset_lsn_);
+  }
+
+  /** The log file's size. Always a multiple of the segment size. */
+  inline constexpr size_t file_size() const noexcept { return file_size_; }
+
+  /** The number of bytes appended (or reserved) since the last Reset(). */
+  inline size_t log_size() const noexcept {
+    return static_cast<size_t>(
+        reserved_lsn_.load(std::memory_order_relaxed) - reset_lsn_);
+  }
+
+  /** True if records were appended since the last Reset(). */
+  inline bool has_records() const noexcept {
+    return reserved_lsn_.load(std::memory_order_relaxed) != reset_lsn_;
+  }
+
+ private:
+  /** Granularity of the buffer's completion tracking. */
+  static constexpr size_t kBlockSize = 4096;
+
+  /** The LSN of the first record appended by the writer.
+   *
+   * This must be positive, because 0 means "no record". Starting at a block
+   * boundary keeps the block counters simple, and keeps the records in the
+   * buffer 8-byte aligned. */
+  static constexpr uint64_t kFirstLsn = kBlockSize;
+
+  /** Waits until the buffer has room for the records ending at an LSN.
+   *
+   * @param  end_lsn the LSN right past the records that will be written
+   * @return         false if the log file failed, so the records would never be
+   *                 written out
+   */
+  bool WaitForBufferSpace(uint64_t end_lsn);
+
+  /** Copies a record into reserved buffer space, and publishes it. */
+  void WriteRecord(uint64_t lsn, LogFormat::RecordType type, uint64_t argument,
+                   span<const uint8_t> payload);
+
+  /** Copies logged bytes that may be buffered or flushed.
+   *
+   * The caller must hold io_mutex_.
+   *
+   * @param  lsn    the LSN of the first byte to be copied
+   * @param  output receives the bytes
+   * @return        most likely kSuccess or kIoError
+   */
+  Status ReadLockedRange(uint64_t lsn, span<uint8_t> output);
+
+  /** Marks reserved buffer space as holding fully copied records. */
+  void PublishRange(uint64_t lsn, size_t byte_count);
+
+  /** The completion counter for the buffer block holding an LSN. */
+  inline std::atomic<size_t>* BlockCounter(uint64_t lsn) noexcept {
+    return &block_counters_[
+        static_cast<size_t>(lsn & (buffer_capacity_ - 1)) / kBlockSize];
+  }
+
+  /** The number of reserved bytes that haven't been written to the file. */
+  inline size_t BufferedBytes() const noexcept {
+    return static_cast<size_t>(
+        reserved_lsn_.load(std::memory_order_relaxed) -
+        flushed_lsn_.load(std::memory_order_relaxed));
+  }
+
+  /** Flush() implementation. The caller must hold io_mutex_. */
+  Status FlushLocked();
+
+  /** Adds zero-filled segments to the log file, and syncs it.
+   *
+   * The caller must hold io_mutex_.
+   *
+   * @param  min_file_size the file will be grown to at least this size
+   * @return               most likely kSuccess or kIoError
+   */
+  Status GrowFile(size_t min_file_size);
+
+  /** The background sync thread's body. */
+  void BackgroundSyncLoop();
+
+  /** A callback registered by WhenSynced(). */
+  struct PendingSyncCallback {
+    uint64_t lsn;
+    SyncCallback callback;
+    void* context;
+  };
+
+  /** Runs the callbacks whose LSNs were covered by a sync.
+   *
+   * The caller must not hold io_mutex_, so the callbacks can use the writer.
+   *
+   * @param status the result of the sync; if it failed, all the registered
+   *               callbacks run, because the log won't be synced again
+   */
+  void RunSyncCallbacks(Status status);
+
+  RandomAccessFile* const log_file_;
+  const size_t page_shift_;
+
+  /** Guards the background thread's control state. */
+  std::mutex mutex_;
+
+  /** Serializes flushes and syncs, and guards the file state. */
+  std::mutex io_mutex_;
+
+  /** The ring buffer holding records that haven't been flushed yet.
+   *
+   * The capacity is a power of two, so LSNs can be mapped to buffer offsets
+   * cheaply. */
+  uint8_t* const buffer_;
+  const size_t buffer_capacity_;
+
+  /** The number of fully copied bytes in each kBlockSize buffer block.
+   *
+   * A block's counter is reset by the flusher when the whole block has been
+   * written out. Committers cannot write to a block again until then. */
+  std::atomic<size_t>* const block_counters_;
+
+  /** The LSN that will be handed out by the next reservation. */
+  std::atomic<uint64_t> reserved_lsn_;
+  /** The LSN of the first byte that has not been written to the file. */
+  std::atomic<uint64_t> flushed_lsn_;
+  /** The LSN of the first byte that has not been synced. */
+  std::atomic<uint64_t> synced_lsn_;
+  /** The LSN of the first record written at the log file's beginning. */
+  uint64_t reset_lsn_ = kFirstLsn;
+
+  bool compresses_page_images_ = false;
+  /** Room for the payload of a compressed page image record. */
+  const size_t compressed_payload_capacity_;
+  /** Counters reported by compression_stats(). */
+  std::atomic<uint64_t> compressed_page_count_;
+  std::atomic<uint64_t> compressed_record_bytes_;
+  std::atomic<uint64_t> compression_ns_;
+
+  /** The log file's size, rounded down to a segment boundary. */
+  size_t file_size_;
+  uint64_t epoch_ = 0;
+
+  /** Set when a log file write fails. Flushes fail afterwards. */
+  std::atomic<bool> has_io_errors_;
+
+  std::thread sync_thread_;
+  std::condition_variable sync_condition_;
+  size_t sync_interval_ms_ = 0;
+  size_t sync_byte_threshold_ = 0;
+  bool sync_thread_stopping_ = false;
+  /** The first error encountered by the background sync thread. */
+  Status background_status_;
+
+  /** Guards pending_sync_callbacks_. */
+  std::mutex callback_mutex_;
+  std::vector<PendingSyncCallback, PlatformAllocator<PendingSyncCallback>>
+      pending_sync_callbacks_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_LOG_WRITER_H_
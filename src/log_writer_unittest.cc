@@ -0,0 +1,369 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./log_writer.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/status.h"
+#include "berrydb/vfs.h"
+#include "./format/log_format.h"
+#include "./test/file_deleter.h"
+#include "./util/span_util.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+class LogWriterTest : public ::testing::Test {
+ protected:
+  LogWriterTest() : vfs_(DefaultVfs()), log_file_deleter_(kLogFileName) { }
+
+  void SetUp() override { OpenLogFile(); }
+
+  void OpenLogFile() {
+    Status status;
+    RandomAccessFile* raw_log_file;
+    std::tie(status, raw_log_file, log_file_size_) = vfs_->OpenForRandomAccess(
+        log_file_deleter_.path(), true, false);
+    ASSERT_EQ(Status::kSuccess, status);
+    log_file_.reset(raw_log_file);
+  }
+
+  void AppendTransaction(LogWriter* writer, size_t page_count) {
+    FillSpan(span<uint8_t>(page_buffer_), 0xAB);
+    for (size_t i = 0; i < page_count; ++i)
+      writer->AppendPageImage(i, span<const uint8_t>(page_buffer_));
+    writer->AppendCommit(page_count);
+  }
+
+  const std::string kLogFileName = "test_log_writer.berry.log";
+  constexpr static size_t kPageShift = 12;
+  constexpr static size_t kPageSize = 1 << kPageShift;
+
+  Vfs* vfs_;
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter log_file_deleter_;
+
+  UniquePtr<RandomAccessFile> log_file_;
+  size_t log_file_size_;
+  alignas(8) uint8_t page_buffer_[kPageSize];
+};
+
+TEST_F(LogWriterTest, FlushWritesRecords) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(42);
+  EXPECT_FALSE(writer.has_records());
+
+  AppendTransaction(&writer, 2);
+  EXPECT_TRUE(writer.has_records());
+  EXPECT_EQ(0U, writer.file_offset());
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+
+  const size_t record_size = LogFormat::PageImageRecordSize(kPageShift);
+  EXPECT_EQ(2 * record_size + LogFormat::kCommitRecordSize,
+            writer.file_offset());
+
+  alignas(8) uint8_t record_bytes[LogFormat::kCommitRecordSize];
+  span<uint8_t> record(record_bytes);
+  ASSERT_EQ(Status::kSuccess, log_file_->Read(2 * record_size, record));
+  EXPECT_TRUE(LogFormat::HasValidChecksum(record));
+  EXPECT_EQ(static_cast<uint64_t>(LogFormat::RecordType::kCommit),
+            LogFormat::Type64(record));
+  EXPECT_EQ(42U, LogFormat::Epoch(record));
+  EXPECT_EQ(2U, LogFormat::Argument64(record));
+}
+
+TEST_F(LogWriterTest, GrowsFileInSegments) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+  EXPECT_EQ(0U, writer.file_size());
+
+  AppendTransaction(&writer, 1);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_EQ(LogFormat::kSegmentSize, writer.file_size());
+
+  // Fill up the first segment, and spill into the second one.
+  const size_t page_count =
+      LogFormat::kSegmentSize / LogFormat::PageImageRecordSize(kPageShift);
+  AppendTransaction(&writer, page_count);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_EQ(2 * LogFormat::kSegmentSize, writer.file_size());
+
+  OpenLogFile();
+  EXPECT_EQ(2 * LogFormat::kSegmentSize, log_file_size_);
+}
+
+TEST_F(LogWriterTest, ResetReusesSegments) {
+  {
+    LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+    writer.Reset(1);
+    AppendTransaction(&writer, 3);
+    ASSERT_EQ(Status::kSuccess, writer.Flush());
+    ASSERT_EQ(LogFormat::kSegmentSize, writer.file_size());
+    const size_t first_end = writer.file_offset();
+
+    writer.Reset(2);
+    EXPECT_FALSE(writer.has_records());
+    EXPECT_EQ(0U, writer.file_offset());
+    AppendTransaction(&writer, 3);
+    ASSERT_EQ(Status::kSuccess, writer.Flush());
+    EXPECT_EQ(first_end, writer.file_offset());
+    EXPECT_EQ(LogFormat::kSegmentSize, writer.file_size());
+  }
+
+  // A writer opened on the existing file reuses its segments.
+  OpenLogFile();
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  EXPECT_EQ(LogFormat::kSegmentSize, writer.file_size());
+  writer.Reset(3);
+  AppendTransaction(&writer, 1);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_EQ(LogFormat::kSegmentSize, writer.file_size());
+}
+
+TEST_F(LogWriterTest, ReadPageImage) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+
+  FillSpan(span<uint8_t>(page_buffer_), 'a');
+  const uint64_t flushed_lsn =
+      writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  writer.AppendCommit(1);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+
+  FillSpan(span<uint8_t>(page_buffer_), 'b');
+  const uint64_t buffered_lsn =
+      writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  const uint64_t commit_lsn = writer.AppendCommit(1);
+  EXPECT_LT(flushed_lsn, buffered_lsn);
+  EXPECT_LT(buffered_lsn, commit_lsn);
+
+  alignas(8) uint8_t image[kPageSize];
+  ASSERT_EQ(Status::kSuccess,
+            writer.ReadPageImage(flushed_lsn, span<uint8_t>(image)));
+  for (uint8_t byte : image)
+    ASSERT_EQ('a', byte);
+  ASSERT_EQ(Status::kSuccess,
+            writer.ReadPageImage(buffered_lsn, span<uint8_t>(image)));
+  for (uint8_t byte : image)
+    ASSERT_EQ('b', byte);
+
+  // LSNs keep growing after a reset, even though file offsets start over.
+  ASSERT_EQ(Status::kSuccess, writer.SyncTo(commit_lsn));
+  writer.Reset(2);
+  FillSpan(span<uint8_t>(page_buffer_), 'c');
+  const uint64_t reset_lsn =
+      writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  EXPECT_EQ(commit_lsn, reset_lsn);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  ASSERT_EQ(Status::kSuccess,
+            writer.ReadPageImage(reset_lsn, span<uint8_t>(image)));
+  for (uint8_t byte : image)
+    ASSERT_EQ('c', byte);
+}
+
+TEST_F(LogWriterTest, ReadCompressedPageImage) {
+  if (!kPlatformHasCompression)
+    return;
+
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.set_compresses_page_images(true);
+  writer.Reset(1);
+
+  FillSpan(span<uint8_t>(page_buffer_), 'a');
+  const uint64_t flushed_lsn =
+      writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  writer.AppendCommit(1);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_GT(LogFormat::PageImageRecordSize(kPageShift) +
+                LogFormat::kCommitRecordSize,
+            writer.file_offset());
+
+  FillSpan(span<uint8_t>(page_buffer_), 'b');
+  const uint64_t buffered_lsn =
+      writer.AppendPageImage(1, span<const uint8_t>(page_buffer_));
+  writer.AppendCommit(1);
+
+  alignas(8) uint8_t image[kPageSize];
+  ASSERT_EQ(Status::kSuccess,
+            writer.ReadPageImage(flushed_lsn, span<uint8_t>(image)));
+  for (uint8_t byte : image)
+    ASSERT_EQ('a', byte);
+  ASSERT_EQ(Status::kSuccess,
+            writer.ReadPageImage(buffered_lsn, span<uint8_t>(image)));
+  for (uint8_t byte : image)
+    ASSERT_EQ('b', byte);
+
+  const LogWriter::CompressionStats stats = writer.compression_stats();
+  EXPECT_EQ(2U, stats.page_count);
+  EXPECT_EQ(writer.log_size() - 2 * LogFormat::kCommitRecordSize,
+            stats.record_bytes);
+}
+
+TEST_F(LogWriterTest, BackgroundSyncFlushesRecords) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+  // A large interval, so the thread is woken up by the byte threshold.
+  writer.StartBackgroundSync(60 * 1000,
+                             LogFormat::PageImageRecordSize(kPageShift));
+
+  AppendTransaction(&writer, 1);
+  const size_t transaction_size =
+      LogFormat::PageImageRecordSize(kPageShift) + LogFormat::kCommitRecordSize;
+  for (size_t i = 0; i < 1000 && writer.file_offset() == 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  ASSERT_EQ(Status::kSuccess, writer.StopBackgroundSync());
+  EXPECT_EQ(transaction_size, writer.file_offset());
+  EXPECT_EQ(Status::kSuccess, writer.background_status());
+
+  // The thread's final sync picks up records below the threshold.
+  writer.StartBackgroundSync(60 * 1000, 0);
+  writer.AppendCommit(0);
+  ASSERT_EQ(Status::kSuccess, writer.StopBackgroundSync());
+  EXPECT_EQ(transaction_size + LogFormat::kCommitRecordSize,
+            writer.file_offset());
+}
+
+namespace {
+
+/** Counts the sync callbacks that report success. */
+void CountSuccessfulSync(Status status, void* context) {
+  if (status == Status::kSuccess)
+    ++*reinterpret_cast<int*>(context);
+}
+
+}  // namespace
+
+TEST_F(LogWriterTest, WhenSyncedRunsCallbacksAfterSync) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+
+  int first_count = 0, second_count = 0;
+  const uint64_t first_lsn = writer.AppendCommit(0);
+  writer.WhenSynced(first_lsn, &CountSuccessfulSync, &first_count);
+  const uint64_t second_lsn = writer.AppendCommit(0);
+  writer.WhenSynced(second_lsn, &CountSuccessfulSync, &second_count);
+
+  // Flushing does not make the records durable.
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_EQ(0, first_count);
+  EXPECT_EQ(0, second_count);
+
+  // The sync needed by the first record also covers the second record.
+  ASSERT_EQ(Status::kSuccess, writer.SyncTo(first_lsn));
+  EXPECT_EQ(1, first_count);
+  EXPECT_EQ(1, second_count);
+
+  // Callbacks for synced records run right away.
+  writer.WhenSynced(first_lsn, &CountSuccessfulSync, &first_count);
+  EXPECT_EQ(2, first_count);
+
+  int third_count = 0;
+  writer.WhenSynced(writer.AppendCommit(0), &CountSuccessfulSync,
+                    &third_count);
+  EXPECT_EQ(0, third_count);
+  ASSERT_EQ(Status::kSuccess, writer.Sync());
+  EXPECT_EQ(1, third_count);
+  EXPECT_EQ(2, first_count);
+  EXPECT_EQ(1, second_count);
+}
+
+TEST_F(LogWriterTest, AbandonSyncCallbacks) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+
+  Status callback_status = Status::kSuccess;
+  writer.WhenSynced(writer.AppendCommit(0), [](Status status, void* context) {
+    *reinterpret_cast<Status*>(context) = status;
+  }, &callback_status);
+  writer.AbandonSyncCallbacks(Status::kIoError);
+  EXPECT_EQ(Status::kIoError, callback_status);
+
+  // The abandoned callback does not run again.
+  callback_status = Status::kSuccess;
+  ASSERT_EQ(Status::kSuccess, writer.Sync());
+  EXPECT_EQ(Status::kSuccess, callback_status);
+}
+
+TEST_F(LogWriterTest, FlushStopsAtUncopiedReservation) {
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+
+  AppendTransaction(&writer, 1);
+  const size_t first_end =
+      LogFormat::PageImageRecordSize(kPageShift) + LogFormat::kCommitRecordSize;
+  const uint64_t reserved_lsn = writer.Reserve(LogFormat::kCommitRecordSize);
+  writer.AppendCommit(0);
+
+  // The records after the reservation must wait for it to be filled. Records
+  // before the reservation may be held back too, because completion is tracked
+  // at block granularity.
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_LE(writer.file_offset(), first_end);
+
+  writer.WriteCommit(reserved_lsn, 0);
+  ASSERT_EQ(Status::kSuccess, writer.Flush());
+  EXPECT_EQ(first_end + 2 * LogFormat::kCommitRecordSize, writer.file_offset());
+}
+
+TEST_F(LogWriterTest, ConcurrentTransactionsAreContiguous) {
+  constexpr size_t kThreadCount = 4;
+  constexpr size_t kTransactionCount = 300;
+  const size_t image_size = LogFormat::PageImageRecordSize(kPageShift);
+  const size_t transaction_size = 2 * image_size + LogFormat::kCommitRecordSize;
+
+  LogWriter writer(log_file_.get(), log_file_size_, kPageShift);
+  writer.Reset(1);
+  // Enough data to wrap around the writer's buffer a few times.
+  writer.StartBackgroundSync(1, 1 << 20);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&writer, i, image_size, transaction_size] {
+      alignas(8) uint8_t page[kPageSize];
+      for (size_t j = 0; j < kTransactionCount; ++j) {
+        FillSpan(span<uint8_t>(page), static_cast<uint8_t>(i * 16 + j % 16));
+        const uint64_t lsn = writer.Reserve(transaction_size);
+        writer.WritePageImage(lsn, i, span<const uint8_t>(page));
+        writer.WritePageImage(lsn + image_size, i, span<const uint8_t>(page));
+        writer.WriteCommit(lsn + 2 * image_size, 2);
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  ASSERT_EQ(Status::kSuccess, writer.StopBackgroundSync());
+  ASSERT_EQ(kThreadCount * kTransactionCount * transaction_size,
+            writer.file_offset());
+
+  // Each transaction's records must be intact and adjacent.
+  std::vector<uint8_t> transaction_bytes(transaction_size);
+  const span<uint8_t> transaction(transaction_bytes.data(), transaction_size);
+  for (size_t offset = 0; offset < writer.file_offset();
+       offset += transaction_size) {
+    ASSERT_EQ(Status::kSuccess, log_file_->Read(offset, transaction));
+    const span<uint8_t> first_image = transaction.first(image_size);
+    const span<uint8_t> second_image =
+        transaction.subspan(image_size, image_size);
+    const span<uint8_t> commit = transaction.subspan(2 * image_size);
+    ASSERT_TRUE(LogFormat::HasValidChecksum(first_image));
+    ASSERT_TRUE(LogFormat::HasValidChecksum(second_image));
+    ASSERT_TRUE(LogFormat::HasValidChecksum(commit));
+    ASSERT_EQ(LogFormat::Argument64(first_image),
+              LogFormat::Argument64(second_image));
+    ASSERT_EQ(first_image[LogFormat::kRecordHeaderSize],
+              second_image[LogFormat::kRecordHeaderSize]);
+    ASSERT_EQ(static_cast<uint64_t>(LogFormat::RecordType::kCommit),
+              LogFormat::Type64(commit));
+    ASSERT_EQ(2U, LogFormat::Argument64(commit));
+  }
+}
+
+}  // namespace berrydb
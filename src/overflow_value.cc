@@ -0,0 +1,333 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./overflow_value.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./free_page_manager.h"
+#include "./page_pool.h"
+#include "./page_versions.h"
+#include "./pinned_page.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/endianness.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+namespace {
+
+/** Reads a range of the value stored in an extent.
+ *
+ * The pages that the pool doesn't need to handle are read from the data file.
+ * Consecutive whole pages are read directly into the buffer, using a single I/O
+ * operation. Only the range's first and last pages can be partial.
+ *
+ * @param  store            the store that holds the extent
+ * @param  first_page_id    the ID of the extent's first page
+ * @param  offset           the position of the first value byte to be read
+ * @param  buffer           receives the value bytes
+ * @param  copy_pooled_page called with a page ID, an offset in the page, and a
+ *                          destination span; if the page must be read through
+ *                          the pool, copies the page's bytes and returns true;
+ *                          otherwise, returns false
+ * @return                  most likely kSuccess or kIoError
+ */
+template <typename CopyPooledPage>
+Status ReadExtent(StoreImpl* store, size_t first_page_id, size_t offset,
+                  span<uint8_t> buffer, CopyPooledPage&& copy_pooled_page) {
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_shift = page_pool->page_shift();
+  const size_t page_size = page_pool->page_size();
+
+  // The run of whole pages that will be read from the data file.
+  size_t run_page_id = 0;
+  size_t run_begin = 0;
+  size_t run_end = 0;
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> partial_page;
+
+  size_t buffer_offset = 0;
+  while (buffer_offset < buffer.size()) {
+    const size_t value_offset = offset + buffer_offset;
+    const size_t page_id = first_page_id + (value_offset >> page_shift);
+    const size_t page_offset = value_offset & (page_size - 1);
+    const size_t size =
+        std::min(page_size - page_offset, buffer.size() - buffer_offset);
+    const span<uint8_t> destination = buffer.subspan(buffer_offset, size);
+
+    Status status;
+    bool copied;
+    std::tie(status, copied) =
+        copy_pooled_page(page_id, page_offset, destination);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+
+    if (!copied && size == page_size) {
+      // Runs are read as soon as they're interrupted, so they're contiguous.
+      if (run_begin == run_end) {
+        run_page_id = page_id;
+        run_begin = run_end = buffer_offset;
+      }
+      BERRYDB_ASSUME_EQ(run_end, buffer_offset);
+      run_end = buffer_offset + size;
+      buffer_offset += size;
+      continue;
+    }
+
+    if (run_begin != run_end) {
+      status = store->ReadDataFilePages(
+          run_page_id, buffer.subspan(run_begin, run_end - run_begin));
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      run_begin = run_end;
+    }
+    if (!copied) {
+      partial_page.resize(page_size);
+      const span<uint8_t> page_data(partial_page.data(), page_size);
+      status = store->ReadDataFilePage(page_id, page_data);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      CopySpan(page_data.subspan(page_offset, size), destination);
+    }
+    buffer_offset += size;
+  }
+
+  if (run_begin != run_end) {
+    return store->ReadDataFilePages(
+        run_page_id, buffer.subspan(run_begin, run_end - run_begin));
+  }
+  return Status::kSuccess;
+}
+
+}  // namespace
+
+// static
+void OverflowValue::EncodeReference(size_t first_page_id, size_t value_size,
+                                    span<uint8_t> reference) noexcept {
+  BERRYDB_ASSUME_EQ(reference.size(), kReferenceSize);
+
+  // References are stored in leaf entries, which are not 8-byte aligned.
+  alignas(8) uint8_t buffer[kReferenceSize];
+  const span<uint8_t> aligned(buffer);
+  StoreUint64(static_cast<uint64_t>(first_page_id), aligned.subspan(0, 8));
+  StoreUint64(static_cast<uint64_t>(value_size), aligned.subspan(8, 8));
+  CopySpan(aligned, reference);
+}
+
+// static
+std::tuple<Status, size_t, size_t> OverflowValue::DecodeReference(
+    StoreImpl* store, span<const uint8_t> reference) noexcept {
+  if (UNLIKELY(reference.size() != kReferenceSize))
+    return {Status::kDataCorrupted, 0, 0};
+  alignas(8) uint8_t buffer[kReferenceSize];
+  const span<uint8_t> aligned(buffer);
+  CopySpan(reference, aligned);
+  const uint64_t first_page_id64 = LoadUint64(aligned.subspan(0, 8));
+  const uint64_t value_size64 = LoadUint64(aligned.subspan(8, 8));
+  const size_t first_page_id = static_cast<size_t>(first_page_id64);
+  const size_t value_size = static_cast<size_t>(value_size64);
+  if (UNLIKELY(first_page_id != first_page_id64 ||
+               value_size != value_size64)) {
+    return {Status::kDatabaseTooLarge, 0, 0};
+  }
+
+  // Page 0 is the store's header. The extent must be inside the store.
+  const size_t page_shift = store->page_pool()->page_shift();
+  const size_t page_count = store->free_page_manager()->page_count();
+  if (UNLIKELY(first_page_id == 0 || first_page_id >= page_count ||
+               value_size == 0 ||
+               ((value_size - 1) >> page_shift) >= page_count - first_page_id)) {
+    return {Status::kDataCorrupted, 0, 0};
+  }
+  return {Status::kSuccess, first_page_id, value_size};
+}
+
+// static
+std::tuple<Status, size_t> OverflowValue::Create(
+    TransactionImpl* transaction, size_t value_size,
+    span<const uint8_t> data) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME_GT(value_size, 0U);
+  BERRYDB_ASSUME_LE(data.size(), value_size);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_shift = page_pool->page_shift();
+  const size_t page_size = page_pool->page_size();
+
+  // The extent's pages must have valid file offsets.
+  const size_t page_count = ((value_size - 1) >> page_shift) + 1;
+  if (UNLIKELY(page_count > (std::numeric_limits<size_t>::max() >>
+                             (page_shift + 1)))) {
+    return {Status::kTooLarge, 0};
+  }
+  const size_t first_page_id = store->free_page_manager()->AllocPages(
+      page_count, transaction, transaction);
+  if (UNLIKELY(first_page_id == FreePageManager::kInvalidPageId))
+    return {Status::kIoError, 0};
+
+  for (size_t i = 0; i < page_count; ++i) {
+    Status status;
+    Page* page;
+    std::tie(status, page) = page_pool->StorePage(
+        store, first_page_id + i, PagePool::kIgnorePageData);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0};
+
+    const span<uint8_t> page_data = transaction->NewPageData(page, page_size);
+    const size_t data_offset = i << page_shift;
+    const span<const uint8_t> page_source = (data.size() > data_offset)
+        ? data.subspan(data_offset,
+                       std::min(page_size, data.size() - data_offset))
+        : span<const uint8_t>();
+    CopySpan(page_source, page_data.first(page_source.size()));
+    FillSpan(page_data.subspan(page_source.size()), 0);
+
+    // The extent's pages are written once, and are unlikely to be read soon,
+    // so they should leave the pool before the pages of the B+trees.
+    page_pool->UnpinStorePage(page, PagePool::kDiscardPage);
+  }
+  return {Status::kSuccess, first_page_id};
+}
+
+// static
+Status OverflowValue::Free(TransactionImpl* transaction, size_t first_page_id,
+                           size_t value_size) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME_GT(value_size, 0U);
+
+  StoreImpl* const store = transaction->store();
+  const size_t page_count =
+      ((value_size - 1) >> store->page_pool()->page_shift()) + 1;
+  return store->free_page_manager()->FreePages(first_page_id, page_count,
+                                               transaction, transaction);
+}
+
+// static
+Status OverflowValue::FreeReferencedValue(TransactionImpl* transaction,
+                                          span<const uint8_t> reference) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  Status status;
+  size_t first_page_id, value_size;
+  std::tie(status, first_page_id, value_size) =
+      DecodeReference(transaction->store(), reference);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return Free(transaction, first_page_id, value_size);
+}
+
+// static
+Status OverflowValue::Write(
+    TransactionImpl* transaction, size_t first_page_id, size_t offset,
+    span<const uint8_t> data) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_shift = page_pool->page_shift();
+  const size_t page_size = page_pool->page_size();
+
+  size_t data_offset = 0;
+  while (data_offset < data.size()) {
+    const size_t value_offset = offset + data_offset;
+    const size_t page_id = first_page_id + (value_offset >> page_shift);
+    const size_t page_offset = value_offset & (page_size - 1);
+    const size_t size =
+        std::min(page_size - page_offset, data.size() - data_offset);
+
+    Status status;
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    const PinnedPage page(raw_page, page_pool);
+
+    CopySpan(data.subspan(data_offset, size),
+             transaction->MutablePageData(page.get(), page_size).subspan(
+                 page_offset, size));
+    data_offset += size;
+  }
+  return Status::kSuccess;
+}
+
+// static
+Status OverflowValue::Read(
+    TransactionImpl* transaction, size_t first_page_id, size_t offset,
+    span<uint8_t> buffer) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  return ReadExtent(
+      store, first_page_id, offset, buffer,
+      [transaction, store, page_pool, page_size](
+          size_t page_id, size_t page_offset,
+          span<uint8_t> destination) -> std::tuple<Status, bool> {
+        // The data file has the latest version of the pages that aren't in the
+        // pool. Optimistic transactions keep their changes on the side, and
+        // record the pages they read, so they always go through the pool.
+        if (!transaction->is_optimistic() &&
+            page_id < store->data_page_count() &&
+            page_pool->CachedStorePage(store, page_id) == nullptr) {
+          return {Status::kSuccess, false};
+        }
+
+        Status status;
+        Page* raw_page;
+        std::tie(status, raw_page) = store->FetchPage(page_id);
+        if (UNLIKELY(status != Status::kSuccess))
+          return {status, false};
+        const PinnedPage page(raw_page, page_pool);
+        CopySpan(transaction->PageData(page.get(), page_size).subspan(
+                     page_offset, destination.size()),
+                 destination);
+        return {Status::kSuccess, true};
+      });
+}
+
+// static
+Status OverflowValue::Read(
+    ReadTransactionImpl* transaction, size_t first_page_id, size_t offset,
+    span<uint8_t> buffer) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  return ReadExtent(
+      store, first_page_id, offset, buffer,
+      [transaction, store, page_pool](
+          size_t page_id, size_t page_offset,
+          span<uint8_t> destination) -> std::tuple<Status, bool> {
+        // Pages modified after the snapshot was taken have their old content in
+        // the store's page versions. Pages in the pool may be newer than their
+        // content in the data file.
+        if (page_id < store->data_page_count() &&
+            page_pool->CachedStorePage(store, page_id) == nullptr &&
+            store->page_versions()->Find(
+                page_id, transaction->snapshot()).empty()) {
+          return {Status::kSuccess, false};
+        }
+
+        Status status;
+        span<const uint8_t> page_data;
+        std::tie(status, page_data) = transaction->ReadPage(page_id);
+        if (UNLIKELY(status != Status::kSuccess))
+          return {status, false};
+        CopySpan(page_data.subspan(page_offset, destination.size()),
+                 destination);
+        return {Status::kSuccess, true};
+      });
+}
+
+}  // namespace berrydb
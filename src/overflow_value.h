@@ -0,0 +1,202 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_OVERFLOW_VALUE_H_
+#define BERRYDB_OVERFLOW_VALUE_H_
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include "berrydb/platform.h"
+#include "berrydb/span.h"
+#include "berrydb/status.h"
+#include "berrydb/types.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+class ReadTransactionImpl;
+class StoreImpl;
+class TransactionImpl;
+
+/** Values that are too large to be stored in B+tree leaves.
+ *
+ * A large value is stored in an extent, which is a run of consecutive pages
+ * that are allocated together. The pages hold the value's bytes, and the end of
+ * the last page is zero-filled. The value's leaf entry holds a reference to the
+ * extent, made up of the 64-bit ID of the extent's first page and the 64-bit
+ * size of the value.
+ *
+ * Extents are written through the page pool, like all the other pages, so they
+ * are logged and rolled back together with the transactions that write them.
+ * Reads go through the pool for the pages that it caches, and read the other
+ * pages straight from the data file, so a run of pages that are not cached is
+ * read using a single I/O operation. The pages read from the data file are not
+ * added to the pool, so reading a large value does not evict the pool's
+ * working set.
+ */
+class OverflowValue {
+ public:
+  /** The size of a reference to an extent, stored in a leaf entry. */
+  static constexpr size_t kReferenceSize = 16;
+
+  /** Encodes a reference to an extent.
+   *
+   * @param first_page_id the ID of the extent's first page
+   * @param value_size    the size of the value stored in the extent
+   * @param reference     receives the reference; must be kReferenceSize bytes
+   */
+  static void EncodeReference(size_t first_page_id, size_t value_size,
+                              span<uint8_t> reference) noexcept;
+
+  /** Decodes a reference to an extent, checking it against a store.
+   *
+   * @param  store         the store that holds the extent
+   * @param  reference     a reference produced by EncodeReference()
+   * @return status        kSuccess or kDataCorrupted
+   * @return first_page_id the ID of the extent's first page
+   * @return value_size    the size of the value stored in the extent
+   */
+  static std::tuple<Status, size_t, size_t> DecodeReference(
+      StoreImpl* store, span<const uint8_t> reference) noexcept;
+
+  /** Allocates an extent and writes a value into it.
+   *
+   * @param  transaction   the transaction that allocates the extent
+   * @param  value_size    the size of the value stored in the extent
+   * @param  data          the value's first bytes; the rest of the value is
+   *                       zero-filled
+   * @return status        kTooLarge if the value can't be addressed; otherwise,
+   *                       most likely kSuccess or kIoError
+   * @return first_page_id the ID of the extent's first page
+   */
+  static std::tuple<Status, size_t> Create(TransactionImpl* transaction,
+                                           size_t value_size,
+                                           span<const uint8_t> data);
+
+  /** Frees an extent when a transaction commits.
+   *
+   * The extent's pages are reused after the read snapshots that may still see
+   * the value are gone.
+   *
+   * @param  transaction   the transaction that stops referencing the extent
+   * @param  first_page_id the ID of the extent's first page
+   * @param  value_size    the size of the value stored in the extent
+   * @return               most likely kSuccess or kIoError
+   */
+  static Status Free(TransactionImpl* transaction, size_t first_page_id,
+                     size_t value_size);
+
+  /** Frees the extent referenced by a leaf entry when a transaction commits.
+   *
+   * @param  transaction the transaction that removes or replaces the entry
+   * @param  reference   the reference stored in the leaf entry
+   * @return             kDataCorrupted if the reference is invalid; otherwise,
+   *                     most likely kSuccess or kIoError
+   */
+  static Status FreeReferencedValue(TransactionImpl* transaction,
+                                    span<const uint8_t> reference);
+
+  /** Overwrites a range of the value stored in an extent.
+   *
+   * @param  transaction   the transaction that modifies the value
+   * @param  first_page_id the ID of the extent's first page
+   * @param  offset        the position of the first value byte to be written
+   * @param  data          the bytes to be written; the caller must ensure that
+   *                       they fit in the value
+   * @return               most likely kSuccess or kIoError
+   */
+  static Status Write(TransactionImpl* transaction, size_t first_page_id,
+                      size_t offset, span<const uint8_t> data);
+
+  /** Reads a range of the value stored in an extent.
+   *
+   * @param  transaction   sees the changes that it made to the value
+   * @param  first_page_id the ID of the extent's first page
+   * @param  offset        the position of the first value byte to be read
+   * @param  buffer        receives the value bytes; the caller must ensure that
+   *                       the range is inside the value
+   * @return               most likely kSuccess or kIoError
+   */
+  static Status Read(TransactionImpl* transaction, size_t first_page_id,
+                     size_t offset, span<uint8_t> buffer);
+
+  /** Reads a range of the value stored in an extent, as of a read snapshot.
+   *
+   * @param  transaction   determines the snapshot that is read
+   * @param  first_page_id the ID of the extent's first page
+   * @param  offset        the position of the first value byte to be read
+   * @param  buffer        receives the value bytes; the caller must ensure that
+   *                       the range is inside the value
+   * @return               most likely kSuccess or kIoError
+   */
+  static Status Read(ReadTransactionImpl* transaction, size_t first_page_id,
+                     size_t offset, span<uint8_t> buffer);
+
+  /** Replaces a reference copied from a leaf entry with the value it refers to.
+   *
+   * @param  transaction the transaction that reads the value
+   * @param  value       holds a reference copied from a leaf entry; receives the
+   *                     value
+   * @return             most likely kSuccess or kIoError
+   */
+  template <typename TransactionType>
+  static Status ReadReferencedValue(
+      TransactionType* transaction,
+      std::vector<uint8_t, PlatformAllocator<uint8_t>>* value) {
+    Status status;
+    size_t first_page_id, value_size;
+    std::tie(status, first_page_id, value_size) = DecodeReference(
+        transaction->store(),
+        span<const uint8_t>(value->data(), value->size()));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+
+    value->resize(value_size);
+    return Read(transaction, first_page_id, 0,
+                span<uint8_t>(value->data(), value_size));
+  }
+
+  /** Reads a range of a value, given the data in the value's leaf entry.
+   *
+   * @param  transaction the transaction that reads the value
+   * @param  entry_value the value stored in the leaf entry
+   * @param  is_overflow true if the leaf stores a reference to an extent
+   * @param  offset      the position of the first value byte to be read
+   * @param  buffer      receives the value bytes
+   * @return status      most likely kSuccess or kIoError
+   * @return value_size  the size of the value
+   */
+  template <typename TransactionType>
+  static std::tuple<Status, size_t> ReadEntryValueRange(
+      TransactionType* transaction, span<const uint8_t> entry_value,
+      bool is_overflow, size_t offset, span<uint8_t> buffer) {
+    if (!is_overflow) {
+      if (offset < entry_value.size()) {
+        const size_t size =
+            std::min(buffer.size(), entry_value.size() - offset);
+        CopySpan(entry_value.subspan(offset, size), buffer.first(size));
+      }
+      return {Status::kSuccess, entry_value.size()};
+    }
+
+    Status status;
+    size_t first_page_id, value_size;
+    std::tie(status, first_page_id, value_size) =
+        DecodeReference(transaction->store(), entry_value);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0};
+    if (offset < value_size) {
+      const size_t size = std::min(buffer.size(), value_size - offset);
+      status = Read(transaction, first_page_id, offset, buffer.first(size));
+    }
+    return {status, value_size};
+  }
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_OVERFLOW_VALUE_H_
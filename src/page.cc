@@ -63,8 +63,11 @@ void Page::DcheckTransactionAssignmentIsValid(
 }
 
 void Page::DcheckNewDirtyValueIsValid(bool is_dirty) noexcept {
-  // Dirty page pool entries must be assigned to non-init transactions.
-  DCHECK(!is_dirty || (transaction_ != nullptr && !transaction_->IsInit()));
+  // Dirty page pool entries must be assigned to transactions. Pages assigned
+  // to init transactions can only be dirty if they hold committed changes that
+  // have been logged, but haven't been written to the data file yet.
+  DCHECK(!is_dirty || (transaction_ != nullptr &&
+                       (!transaction_->IsInit() || commit_lsn_ != 0)));
 
   // A page pool entry that just became non-dirty must have been re-assigned to
   // an init transaction, or must have been unassigned from a store.
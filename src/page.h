@@ -14,6 +14,7 @@
 // #include "./transaction_impl.h" would cause a cycle
 #include "./util/checks.h"
 #include "./util/linked_list.h"
+#include "./util/reader_writer_latch.h"
 
 namespace berrydb {
 
@@ -101,6 +102,42 @@ class Page {
     return is_dirty_;
   }
 
+  /** The LSN of the log record holding the page's latest committed content.
+   *
+   * This is 0 when the data file (or the pool entry's clean content) reflects
+   * all the committed changes to the page. Otherwise, the page is dirty, and
+   * its committed content can be read back from the log, which is needed when a
+   * transaction that modifies the page is rolled back.
+   */
+  inline constexpr uint64_t image_lsn() const noexcept { return image_lsn_; }
+
+  /** The log must be synced up to this LSN before the page is written.
+   *
+   * This is the LSN right past the commit record of the last transaction that
+   * modified the page. Writing the page earlier could put changes on disk that
+   * would not be undone if the transaction's commit record is lost.
+   */
+  inline constexpr uint64_t commit_lsn() const noexcept { return commit_lsn_; }
+
+  /** The commit timestamp of the last transaction that modified the page.
+   *
+   * Pages fetched from the data file don't know which transaction modified them
+   * last. They get the newest timestamp of the pages that left the pool, which
+   * is conservative. Optimistic transactions use this to detect that a page
+   * they read was modified by a transaction that committed after the read.
+   */
+  inline constexpr uint64_t commit_timestamp() const noexcept {
+    return commit_timestamp_;
+  }
+
+  /** Commit timestamp setter for PagePool and TransactionImpl.
+   *
+   * @param commit_timestamp see commit_timestamp()
+   */
+  inline void set_commit_timestamp(uint64_t commit_timestamp) noexcept {
+    commit_timestamp_ = commit_timestamp;
+  }
+
   /** The page's data buffer.
    *
    * Prefer using data() when the page's size is readily computed. */
@@ -146,6 +183,15 @@ class Page {
     return span<uint8_t>(mutable_buffer(), page_size);
   }
 
+  /** Protects the page's data while it is copied in bulk.
+   *
+   * The latch is held in shared mode while the page's data is copied into the
+   * log or saved as a version, and in exclusive mode while the data is replaced
+   * wholesale, e.g. when a rollback restores it. Transactional isolation comes
+   * from the store's LockManager, not from page latches.
+   */
+  inline ReaderWriterLatch* latch() noexcept { return &latch_; }
+
 #if BERRYDB_CHECK_IS_ON()
   /** The pool that this page belongs to. Solely intended for use in DCHECKs. */
   inline constexpr const PagePool* page_pool() const noexcept {
@@ -193,6 +239,8 @@ class Page {
 
     transaction_ = transaction;
     page_id_ = page_id;
+    image_lsn_ = 0;
+    commit_lsn_ = 0;
   }
 
   /** Track the fact that the pool page entry no longer caches a store page.
@@ -233,6 +281,22 @@ class Page {
     is_dirty_ = is_dirty;
   }
 
+  /** Records where the page's latest committed content is in the log.
+   *
+   * This should not be used directly in most cases. It is exposed for use by
+   * StoreImpl and by TransactionImpl.
+   *
+   * @param image_lsn  the LSN of the page's image record; 0 after the page is
+   *                   written to the data file
+   * @param commit_lsn the LSN right past the commit record covering the image
+   */
+  inline void SetLogLsns(uint64_t image_lsn, uint64_t commit_lsn) noexcept {
+    DCHECK(image_lsn < commit_lsn || (image_lsn == 0 && commit_lsn == 0));
+
+    image_lsn_ = image_lsn;
+    commit_lsn_ = commit_lsn;
+  }
+
   /** Called when the Page is reassigned to a new transaction in the same store.
    *
    * This should not be used directly in most cases. It is exposed for use by
@@ -317,6 +381,16 @@ class Page {
   size_t pin_count_;
   bool is_dirty_ = false;
 
+  /** See image_lsn(). */
+  uint64_t image_lsn_ = 0;
+  /** See commit_lsn(). */
+  uint64_t commit_lsn_ = 0;
+  /** See commit_timestamp(). */
+  uint64_t commit_timestamp_ = 0;
+
+  /** See latch(). */
+  ReaderWriterLatch latch_;
+
 #if BERRYDB_CHECK_IS_ON()
   PagePool* const page_pool_;
 #endif  // BERRYDB_CHECK_IS_ON()
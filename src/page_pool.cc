@@ -5,6 +5,7 @@
 #include "./page_pool.h"
 
 #include <algorithm>
+#include <vector>
 
 #include "./store_impl.h"
 #include "./util/checks.h"
@@ -67,8 +68,12 @@ void PagePool::UnassignPageFromStore(Page* page) {
   BERRYDB_ASSUME_EQ(1U,
                     page_map_.count(std::make_pair(store, page->page_id())));
   page_map_.erase(std::make_pair(store, page->page_id()));
+  store->PageWillLeavePool(page);
   if (page->is_dirty()) {
-    const Status write_status = store->WritePage(page);
+    // Pages modified by running transactions can be stolen, which writes their
+    // uncommitted changes to the data file.
+    const Status write_status = (transaction == store->init_transaction())
+        ? store->WritePage(page) : store->StealPage(page);
     transaction->UnassignPersistedPage(page);
     if (UNLIKELY(write_status != Status::kSuccess))
       store->Close();
@@ -77,6 +82,26 @@ void PagePool::UnassignPageFromStore(Page* page) {
   }
 }
 
+void PagePool::DiscardPageFromStore(Page* page) {
+  BERRYDB_ASSUME(page != nullptr);
+  BERRYDB_ASSUME(page->transaction() != nullptr);
+  BERRYDB_ASSUME(page->transaction()->store() != nullptr);
+#if BERRYDB_CHECK_IS_ON()
+  BERRYDB_CHECK_EQ(page->page_pool(), this);
+#endif  // BERRYDB_CHECK_IS_ON()
+
+  TransactionImpl* const transaction = page->transaction();
+  StoreImpl* const store = transaction->store();
+  BERRYDB_ASSUME_EQ(1U,
+                    page_map_.count(std::make_pair(store, page->page_id())));
+  page_map_.erase(std::make_pair(store, page->page_id()));
+  store->PageWillLeavePool(page);
+  transaction->UnassignPage(page);
+  // The dirty flag can only be cleared after the page is unassigned, because
+  // dirty pages must belong to non-init transactions.
+  page->SetDirty(false);
+}
+
 Page* PagePool::AllocPage() {
   if (!free_list_.empty()) {
     // The free list is used as a stack (LIFO), because the last used free page
@@ -106,6 +131,84 @@ Page* PagePool::AllocPage() {
   return nullptr;
 }
 
+Page* PagePool::CachedStorePage(StoreImpl* store, size_t page_id) {
+  BERRYDB_ASSUME(store != nullptr);
+
+  auto it = page_map_.find(std::make_pair(store, page_id));
+  if (it == page_map_.end())
+    return nullptr;
+
+  Page* const page = it->second;
+  BERRYDB_ASSUME(page != nullptr);
+  BERRYDB_ASSUME_EQ(store, page->transaction()->store());
+  BERRYDB_ASSUME_EQ(page_id, page->page_id());
+  return page;
+}
+
+Status PagePool::PrefetchStorePages(StoreImpl* store, size_t first_page_id,
+                                    size_t page_count) {
+  BERRYDB_ASSUME(store != nullptr);
+
+  const size_t data_page_count = store->data_page_count();
+  if (first_page_id >= data_page_count)
+    return Status::kSuccess;
+  page_count = std::min(page_count, data_page_count - first_page_id);
+
+  // Cached pages at the range's ends don't need to be read.
+  while (page_count > 0 &&
+         page_map_.count(std::make_pair(store, first_page_id)) != 0) {
+    ++first_page_id;
+    --page_count;
+  }
+  while (page_count > 0 &&
+         page_map_.count(std::make_pair(
+             store, first_page_id + page_count - 1)) != 0) {
+    --page_count;
+  }
+  if (page_count == 0)
+    return Status::kSuccess;
+
+  // All the entries are pinned before any of them is unpinned, so allocating
+  // an entry never evicts a page that was just prefetched. Cached pages in the
+  // middle of the range are read anyway, to keep the I/O contiguous, but their
+  // entries are not touched, because they may hold newer data.
+  std::vector<Page*, PlatformAllocator<Page*>> pages;
+  pages.reserve(page_count);
+  for (size_t i = 0; i < page_count; ++i) {
+    if (page_map_.count(std::make_pair(store, first_page_id + i)) != 0) {
+      pages.push_back(nullptr);
+      continue;
+    }
+    Page* const page = AllocPage();
+    if (page == nullptr)
+      break;
+    pages.push_back(page);
+  }
+  page_count = pages.size();
+
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> data(
+      page_count << page_shift_);
+  const Status status = store->ReadDataFilePages(
+      first_page_id, span<uint8_t>(data.data(), data.size()));
+
+  for (size_t i = 0; i < page_count; ++i) {
+    Page* const page = pages[i];
+    if (page == nullptr)
+      continue;
+    if (UNLIKELY(status != Status::kSuccess)) {
+      UnpinUnassignedPage(page);
+      continue;
+    }
+
+    // The entry receives the page's on-disk content, so it stays clean.
+    AssignPageToStore(page, store, first_page_id + i, kIgnorePageData);
+    CopySpan(span<const uint8_t>(data.data() + (i << page_shift_), page_size_),
+             page->mutable_data(page_size_));
+    UnpinStorePage(page);
+  }
+  return status;
+}
+
 Status PagePool::FetchStorePage(Page *page, PageFetchMode fetch_mode) {
   BERRYDB_ASSUME(page != nullptr);
   BERRYDB_ASSUME(page->transaction() != nullptr);
@@ -145,6 +248,7 @@ Status PagePool::AssignPageToStore(
   transaction->AssignPage(page, page_id);
   const Status fetch_status = FetchStorePage(page, fetch_mode);
   if (LIKELY(fetch_status == Status::kSuccess)) {
+    page->set_commit_timestamp(store->evicted_commit_timestamp());
     page_map_[std::make_pair(store, page_id)] = page;
     return Status::kSuccess;
   }
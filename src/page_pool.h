@@ -143,6 +143,34 @@ class PagePool {
   std::tuple<Status, Page*> StorePage(StoreImpl* store, size_t page_id,
                                       PageFetchMode fetch_mode);
 
+  /** Looks up the pool entry caching a store page, without fetching the page.
+   *
+   * This method is intended for internal use. The returned entry is not pinned,
+   * so it must be used before the pool can evict any page.
+   *
+   * @param  store   the store whose page is looked up
+   * @param  page_id the page that is looked up
+   * @return         the pool entry caching the page, or nullptr if the page is
+   *                 not cached in this pool
+   */
+  Page* CachedStorePage(StoreImpl* store, size_t page_id);
+
+  /** Reads consecutive store pages into the pool, ahead of their use.
+   *
+   * The pages that aren't cached are read from the store's data file using a
+   * single I/O operation, and are left unpinned in the LRU list, so they can be
+   * pinned cheaply by StorePage() soon afterwards. Pages past the end of the
+   * data file are skipped, because they have no content to read. The pool may
+   * prefetch fewer pages than requested, if it runs out of entries.
+   *
+   * @param  store         the store whose pages are prefetched
+   * @param  first_page_id the first page that will be prefetched
+   * @param  page_count    the number of pages that will be prefetched
+   * @return               most likely kSuccess or kIoError
+   */
+  Status PrefetchStorePages(StoreImpl* store, size_t first_page_id,
+                            size_t page_count);
+
   /** Releases a Page previously obtained by StorePage().
    *
    * The method removes the caller's pin from this pool page entry. The page
@@ -291,6 +319,16 @@ class PagePool {
    */
   void UnassignPageFromStore(Page* page);
 
+  /** Frees up a page pool entry, discarding any changes to the cached page.
+   *
+   * This is used when rolling back transactions. Unlike UnassignPageFromStore(),
+   * dirty pages are not written back, so the store's data file keeps the page's
+   * last committed content.
+   *
+   * @param page the page pool entry to be freed
+   */
+  void DiscardPageFromStore(Page* page);
+
   /** Adds a pin to a pool entry that is currently caching a store page.
    *
    * This is intended for internal use and for testing.
@@ -552,4 +552,62 @@ TEST_F(PagePoolTest, StorePage) {
   EXPECT_EQ(0U, page_pool->pinned_pages());
 }
 
+TEST_F(PagePoolTest, PrefetchStorePages) {
+  uint8_t buffer[4][1 << kStorePageShift];
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 0; j < 1 << kStorePageShift; ++j)
+      buffer[i][j] = static_cast<uint8_t>(rnd_());
+  }
+
+  CreatePool(kStorePageShift, 4);
+  PagePool* page_pool = pool_->page_pool();
+  BlockAccessFileWrapper data_file_wrapper(data_file1_.release());
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      &data_file_wrapper, data_file1_size_, log_file1_.release(),
+      log_file1_size_, page_pool, StoreOptions()));
+
+  for (size_t i = 0; i < 4; ++i)
+    WriteStorePage(store.get(), i, buffer[i]);
+  ASSERT_EQ(4U, store->data_page_count());
+
+  Status status;
+  Page* page2;
+  std::tie(status, page2) = page_pool->StorePage(store.get(), 2,
+                                                 PagePool::kFetchPageData);
+  ASSERT_EQ(Status::kSuccess, status);
+
+  // Pages past the end of the data file are skipped. The cached page is not
+  // touched.
+  EXPECT_EQ(Status::kSuccess,
+            page_pool->PrefetchStorePages(store.get(), 1, 8));
+  EXPECT_EQ(3U, page_pool->allocated_pages());
+  EXPECT_EQ(1U, page_pool->pinned_pages());
+  EXPECT_EQ(page2, page_pool->CachedStorePage(store.get(), 2));
+  for (size_t i = 1; i < 4; i += 2) {
+    Page* page = page_pool->CachedStorePage(store.get(), i);
+    ASSERT_TRUE(page != nullptr);
+    EXPECT_FALSE(page->is_dirty());
+    EXPECT_TRUE(page->IsUnpinned());
+    EXPECT_EQ(store->init_transaction(), page->transaction());
+    EXPECT_EQ(page->data(1 << kStorePageShift), make_span(buffer[i]));
+  }
+
+  // Prefetched pages are cache hits.
+  Page* page3;
+  std::tie(status, page3) = page_pool->StorePage(store.get(), 3,
+                                                 PagePool::kFetchPageData);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(page_pool->CachedStorePage(store.get(), 3), page3);
+  EXPECT_EQ(2U, page_pool->pinned_pages());
+  page_pool->UnpinStorePage(page3);
+
+  data_file_wrapper.SetAccessError(Status::kIoError);
+  EXPECT_EQ(Status::kIoError,
+            page_pool->PrefetchStorePages(store.get(), 0, 1));
+  EXPECT_EQ(nullptr, page_pool->CachedStorePage(store.get(), 0));
+  EXPECT_EQ(1U, page_pool->pinned_pages());
+
+  page_pool->UnpinStorePage(page2);
+}
+
 }  // namespace berrydb
@@ -0,0 +1,128 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./page_versions.h"
+
+#include "berrydb/platform.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+PageVersions::PageVersions(size_t page_size) noexcept
+    : page_size_(page_size) {}
+
+PageVersions::~PageVersions() {
+  for (const auto& entry : newest_versions_) {
+    PageVersion* version = entry.second;
+    while (version != nullptr) {
+      PageVersion* const older = version->older;
+      Deallocate(version, sizeof(PageVersion) + page_size_);
+      version = older;
+    }
+  }
+}
+
+PageVersion* PageVersions::Save(size_t page_id,
+                                span<const uint8_t> page_data) {
+  BERRYDB_ASSUME_EQ(page_data.size(), page_size_);
+
+  void* const heap_block = Allocate(sizeof(PageVersion) + page_size_);
+  PageVersion* const version = new (heap_block) PageVersion();
+  version->page_id = page_id;
+  version->end_timestamp = kPendingTimestamp;
+  version->next_committed = nullptr;
+  CopySpan(page_data, span<uint8_t>(reinterpret_cast<uint8_t*>(version + 1),
+                                    page_size_));
+
+  PageVersion*& newest_version = newest_versions_[page_id];
+  // A page cannot be modified by two transactions at the same time, so the
+  // page's newest version must have been committed.
+  BERRYDB_ASSUME(newest_version == nullptr ||
+                 newest_version->end_timestamp != kPendingTimestamp);
+  version->older = newest_version;
+  newest_version = version;
+  ++version_count_;
+  return version;
+}
+
+void PageVersions::Commit(PageVersion* version, uint64_t timestamp) noexcept {
+  BERRYDB_ASSUME(version != nullptr);
+  BERRYDB_ASSUME_EQ(version->end_timestamp, kPendingTimestamp);
+  BERRYDB_ASSUME_NE(timestamp, kPendingTimestamp);
+  BERRYDB_ASSUME(newest_committed_ == nullptr ||
+                 newest_committed_->end_timestamp <= timestamp);
+
+  version->end_timestamp = timestamp;
+  if (newest_committed_ == nullptr)
+    oldest_committed_ = version;
+  else
+    newest_committed_->next_committed = version;
+  newest_committed_ = version;
+}
+
+void PageVersions::Discard(PageVersion* version) noexcept {
+  BERRYDB_ASSUME(version != nullptr);
+  BERRYDB_ASSUME_EQ(version->end_timestamp, kPendingTimestamp);
+
+  Free(version);
+}
+
+span<const uint8_t> PageVersions::Find(size_t page_id, uint64_t snapshot)
+    const noexcept {
+  const auto it = newest_versions_.find(page_id);
+  if (it == newest_versions_.end())
+    return span<const uint8_t>();
+
+  // The snapshot sees the oldest version that was replaced after the snapshot
+  // was taken. Pending versions count as replaced in the future.
+  const PageVersion* visible_version = nullptr;
+  for (const PageVersion* version = it->second; version != nullptr;
+       version = version->older) {
+    if (version->end_timestamp <= snapshot)
+      break;
+    visible_version = version;
+  }
+  if (visible_version == nullptr)
+    return span<const uint8_t>();
+  return visible_version->data(page_size_);
+}
+
+void PageVersions::CollectGarbage(uint64_t oldest_snapshot) noexcept {
+  // A version is visible to the snapshots taken before it was replaced.
+  while (oldest_committed_ != nullptr &&
+         oldest_committed_->end_timestamp <= oldest_snapshot) {
+    PageVersion* const version = oldest_committed_;
+    oldest_committed_ = version->next_committed;
+    if (oldest_committed_ == nullptr)
+      newest_committed_ = nullptr;
+    Free(version);
+  }
+}
+
+void PageVersions::Free(PageVersion* version) noexcept {
+  const auto it = newest_versions_.find(version->page_id);
+  BERRYDB_ASSUME(it != newest_versions_.end());
+
+  // Discarded versions are at the head of their chains, and garbage-collected
+  // versions are at the tail. Chains are short, because versions are collected
+  // as soon as the snapshots that can see them are released.
+  if (it->second == version) {
+    if (version->older == nullptr)
+      newest_versions_.erase(it);
+    else
+      it->second = version->older;
+  } else {
+    PageVersion* newer = it->second;
+    while (newer->older != version) {
+      newer = newer->older;
+      BERRYDB_ASSUME(newer != nullptr);
+    }
+    newer->older = version->older;
+  }
+
+  --version_count_;
+  Deallocate(version, sizeof(PageVersion) + page_size_);
+}
+
+}  // namespace berrydb
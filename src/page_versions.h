@@ -0,0 +1,138 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_PAGE_VERSIONS_H_
+#define BERRYDB_PAGE_VERSIONS_H_
+
+#include <functional>
+#include <limits>
+#include <unordered_map>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./util/checks.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+/** The content of a page before it was modified by a transaction.
+ *
+ * The page data follows the structure in memory. */
+struct PageVersion {
+  /** The page whose content is held by this version. */
+  size_t page_id;
+
+  /** The commit timestamp of the transaction that replaced this content.
+   *
+   * PageVersions::kPendingTimestamp while the transaction is running. */
+  uint64_t end_timestamp;
+
+  /** The next older version of the same page. */
+  PageVersion* older;
+
+  /** The version that was committed right after this one, across all pages. */
+  PageVersion* next_committed;
+
+  /** The version's page data. */
+  inline span<const uint8_t> data(size_t page_size) const noexcept {
+    return span<const uint8_t>(reinterpret_cast<const uint8_t*>(this + 1),
+                               page_size);
+  }
+};
+
+/** Keeps the old page content that is still visible to read snapshots.
+ *
+ * Each store has a PageVersions instance. Before a transaction modifies a page
+ * for the first time, the page's committed content is saved as a version. When
+ * the transaction commits, the version is stamped with the commit's timestamp,
+ * so snapshots taken before the commit keep seeing the old content, while the
+ * modified page is used by everyone else. Versions are freed once all the
+ * snapshots that could see them are gone.
+ *
+ * The versions of a page form a chain, sorted from newest to oldest. Committed
+ * versions are also kept on a list sorted by commit timestamp, which makes
+ * garbage collection cheap.
+ */
+class PageVersions {
+ public:
+  /** Timestamp of versions replaced by transactions that haven't committed. */
+  static constexpr uint64_t kPendingTimestamp =
+      std::numeric_limits<uint64_t>::max();
+
+  /** Sets up an empty version store for pages of the given size. */
+  PageVersions(size_t page_size) noexcept;
+  /** Frees all versions. */
+  ~PageVersions();
+
+  PageVersions(const PageVersions&) = delete;
+  PageVersions(PageVersions&&) = delete;
+  PageVersions& operator=(const PageVersions&) = delete;
+  PageVersions& operator=(PageVersions&&) = delete;
+
+  /** Saves a page's committed content, before a transaction modifies it.
+   *
+   * @param  page_id   the page that will be modified
+   * @param  page_data the page's committed content
+   * @return           a pending version; must be passed to Commit() or
+   *                   Discard() when the modifying transaction is closed
+   */
+  PageVersion* Save(size_t page_id, span<const uint8_t> page_data);
+
+  /** Called when the transaction that replaced a version commits.
+   *
+   * @param version   a pending version obtained from Save()
+   * @param timestamp the commit's timestamp; must not be smaller than the
+   *                  timestamps passed to earlier Commit() calls
+   */
+  void Commit(PageVersion* version, uint64_t timestamp) noexcept;
+
+  /** Frees a version whose modifying transaction was rolled back.
+   *
+   * @param version a pending version obtained from Save()
+   */
+  void Discard(PageVersion* version) noexcept;
+
+  /** The content of a page, as seen by a snapshot.
+   *
+   * @param  page_id  the page whose content is needed
+   * @param  snapshot the timestamp of the last commit visible to the snapshot
+   * @return          the page's content, or an empty span if the snapshot sees
+   *                  the page's current committed content
+   */
+  span<const uint8_t> Find(size_t page_id, uint64_t snapshot) const noexcept;
+
+  /** Frees the committed versions that cannot be seen by any snapshot.
+   *
+   * @param oldest_snapshot the timestamp of the oldest live snapshot; pass
+   *                        kPendingTimestamp if there are no live snapshots
+   */
+  void CollectGarbage(uint64_t oldest_snapshot) noexcept;
+
+  /** Number of versions kept in memory. Exposed for testing. */
+  inline constexpr size_t version_count() const noexcept {
+    return version_count_;
+  }
+
+ private:
+  /** Unlinks a version from its page's chain, and frees it. */
+  void Free(PageVersion* version) noexcept;
+
+  const size_t page_size_;
+
+  /** The newest version of each page that has versions. */
+  std::unordered_map<size_t, PageVersion*, std::hash<size_t>,
+                     std::equal_to<size_t>,
+                     PlatformAllocator<std::pair<const size_t, PageVersion*>>>
+      newest_versions_;
+
+  /** The committed versions, from oldest to newest commit timestamp. */
+  PageVersion* oldest_committed_ = nullptr;
+  PageVersion* newest_committed_ = nullptr;
+
+  size_t version_count_ = 0;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_PAGE_VERSIONS_H_
@@ -0,0 +1,107 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./page_versions.h"
+
+#include "berrydb/span.h"
+#include "./util/span_util.h"
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+class PageVersionsTest : public ::testing::Test {
+ protected:
+  PageVersionsTest() : versions_(kPageSize) { }
+
+  /** Saves a page version whose bytes are all set to a value. */
+  PageVersion* SaveFilled(size_t page_id, uint8_t value) {
+    FillSpan(span<uint8_t>(page_buffer_), value);
+    return versions_.Save(page_id, span<const uint8_t>(page_buffer_));
+  }
+
+  /** The first byte of the page content seen by a snapshot, or 0 if the
+   * snapshot sees the current content. */
+  uint8_t FindFirstByte(size_t page_id, uint64_t snapshot) {
+    span<const uint8_t> data = versions_.Find(page_id, snapshot);
+    if (data.empty())
+      return 0;
+    EXPECT_EQ(sizeof(page_buffer_), data.size());
+    return data[0];
+  }
+
+  constexpr static size_t kPageSize = 256;
+
+  PageVersions versions_;
+  alignas(8) uint8_t page_buffer_[kPageSize];
+};
+
+TEST_F(PageVersionsTest, PendingVersionIsVisibleToAllSnapshots) {
+  PageVersion* version = SaveFilled(3, 'a');
+  EXPECT_EQ(1U, versions_.version_count());
+  EXPECT_EQ('a', FindFirstByte(3, 0));
+  EXPECT_EQ('a', FindFirstByte(3, 100));
+  EXPECT_EQ(0, FindFirstByte(4, 0));
+
+  versions_.Discard(version);
+  EXPECT_EQ(0U, versions_.version_count());
+  EXPECT_EQ(0, FindFirstByte(3, 0));
+}
+
+TEST_F(PageVersionsTest, CommittedVersionsAreVisibleToOlderSnapshots) {
+  versions_.Commit(SaveFilled(3, 'a'), 5);
+  versions_.Commit(SaveFilled(3, 'b'), 7);
+  versions_.Commit(SaveFilled(4, 'c'), 7);
+  EXPECT_EQ(3U, versions_.version_count());
+
+  EXPECT_EQ('a', FindFirstByte(3, 4));
+  EXPECT_EQ('b', FindFirstByte(3, 5));
+  EXPECT_EQ('b', FindFirstByte(3, 6));
+  EXPECT_EQ(0, FindFirstByte(3, 7));
+  EXPECT_EQ('c', FindFirstByte(4, 6));
+  EXPECT_EQ(0, FindFirstByte(4, 7));
+
+  // A pending version sits on top of the committed ones.
+  PageVersion* pending = SaveFilled(3, 'd');
+  EXPECT_EQ('a', FindFirstByte(3, 4));
+  EXPECT_EQ('d', FindFirstByte(3, 7));
+  versions_.Discard(pending);
+  EXPECT_EQ(0, FindFirstByte(3, 7));
+  EXPECT_EQ('b', FindFirstByte(3, 6));
+
+  versions_.CollectGarbage(PageVersions::kPendingTimestamp);
+  EXPECT_EQ(0U, versions_.version_count());
+}
+
+TEST_F(PageVersionsTest, CollectGarbageKeepsVisibleVersions) {
+  versions_.Commit(SaveFilled(3, 'a'), 5);
+  versions_.Commit(SaveFilled(4, 'b'), 6);
+  versions_.Commit(SaveFilled(3, 'c'), 8);
+  PageVersion* pending = SaveFilled(4, 'd');
+
+  versions_.CollectGarbage(4);
+  EXPECT_EQ(4U, versions_.version_count());
+
+  // Snapshot 5 can't see the version replaced at timestamp 5.
+  versions_.CollectGarbage(5);
+  EXPECT_EQ(3U, versions_.version_count());
+  EXPECT_EQ('b', FindFirstByte(4, 5));
+  EXPECT_EQ('c', FindFirstByte(3, 5));
+
+  versions_.CollectGarbage(7);
+  EXPECT_EQ(2U, versions_.version_count());
+  EXPECT_EQ('c', FindFirstByte(3, 7));
+  EXPECT_EQ('d', FindFirstByte(4, 7));
+
+  // Pending versions survive garbage collection.
+  versions_.CollectGarbage(PageVersions::kPendingTimestamp);
+  EXPECT_EQ(1U, versions_.version_count());
+  EXPECT_EQ('d', FindFirstByte(4, 7));
+
+  versions_.Commit(pending, 9);
+  EXPECT_EQ('d', FindFirstByte(4, 8));
+  EXPECT_EQ(0, FindFirstByte(4, 9));
+}
+
+}  // namespace berrydb
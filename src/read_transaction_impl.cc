@@ -0,0 +1,135 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./read_transaction_impl.h"
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree.h"
+#include "./cursor_impl.h"
+#include "./page_pool.h"
+#include "./page_versions.h"
+#include "./space_impl.h"
+#include "./store_impl.h"
+#include "./util/checks.h"
+
+namespace berrydb {
+
+static_assert(std::is_standard_layout<ReadTransactionImpl>::value,
+    "ReadTransactionImpl must be a standard layout type so its public API can "
+    "be exposed cheaply");
+
+ReadTransactionImpl* ReadTransactionImpl::Create(StoreImpl* store,
+                                                 uint64_t snapshot) {
+  void* const heap_block = Allocate(sizeof(ReadTransactionImpl));
+  ReadTransactionImpl* const transaction =
+      new (heap_block) ReadTransactionImpl(store, snapshot);
+  BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(transaction));
+  return transaction;
+}
+
+void ReadTransactionImpl::Release() {
+  BERRYDB_ASSUME(cursors_.empty());
+
+  if (!is_store_closed_) {
+    UnpinPage();
+    store_->ReadTransactionReleased(this);
+  }
+
+  this->~ReadTransactionImpl();
+  void* const heap_block = static_cast<void*>(this);
+  Deallocate(heap_block, sizeof(ReadTransactionImpl));
+}
+
+ReadTransactionImpl::ReadTransactionImpl(StoreImpl* store, uint64_t snapshot)
+    : store_(store), snapshot_(snapshot) {
+  BERRYDB_ASSUME(store != nullptr);
+}
+
+ReadTransactionImpl::~ReadTransactionImpl() = default;
+
+void ReadTransactionImpl::StoreWasClosed() noexcept {
+  for (CursorImpl* cursor : cursors_)
+    cursor->StoreWasClosed();
+  UnpinPage();
+  is_store_closed_ = true;
+}
+
+void ReadTransactionImpl::CursorReleased(CursorImpl* cursor) noexcept {
+  cursors_.erase(cursor);
+}
+
+void ReadTransactionImpl::UnpinPage() noexcept {
+  if (pinned_page_ == nullptr)
+    return;
+  store_->page_pool()->UnpinStorePage(pinned_page_);
+  pinned_page_ = nullptr;
+}
+
+std::tuple<Status, span<const uint8_t>> ReadTransactionImpl::ReadPage(
+    size_t page_id) {
+  if (UNLIKELY(is_store_closed_))
+    return {Status::kAlreadyClosed, span<const uint8_t>()};
+
+  UnpinPage();
+
+  // Pages modified after the snapshot was taken have their old content saved.
+  const span<const uint8_t> version_data =
+      store_->page_versions()->Find(page_id, snapshot_);
+  if (!version_data.empty())
+    return {Status::kSuccess, version_data};
+
+  PagePool* const page_pool = store_->page_pool();
+  Status status;
+  Page* page;
+  std::tie(status, page) = page_pool->StorePage(store_, page_id,
+                                                PagePool::kFetchPageData);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, span<const uint8_t>()};
+  pinned_page_ = page;
+  return {Status::kSuccess, page->data(page_pool->page_size())};
+}
+
+std::tuple<Status, span<const uint8_t>> ReadTransactionImpl::Get(
+    SpaceImpl* space, span<const uint8_t> key) {
+  if (UNLIKELY(is_store_closed_))
+    return {Status::kAlreadyClosed, span<const uint8_t>()};
+
+  // The value is copied, because the page holding it may be modified by a
+  // writer after it is unpinned.
+  const Status status = space->Get(this, key, &value_buffer_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, span<const uint8_t>()};
+  return {Status::kSuccess,
+          span<const uint8_t>(value_buffer_.data(), value_buffer_.size())};
+}
+
+Status ReadTransactionImpl::Get(SpaceImpl* space, span<const uint8_t> key,
+                                PinnedValue* value) {
+  if (UNLIKELY(is_store_closed_))
+    return Status::kAlreadyClosed;
+  return space->Get(this, key, value);
+}
+
+std::tuple<Status, size_t> ReadTransactionImpl::ReadValue(
+    SpaceImpl* space, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) {
+  if (UNLIKELY(is_store_closed_))
+    return {Status::kAlreadyClosed, 0};
+
+  return space->ReadValue(this, key, offset, buffer);
+}
+
+CursorImpl* ReadTransactionImpl::CreateCursor(SpaceImpl* space) {
+  // Cursors walk BTree leaves. The cursors of other spaces report that scans
+  // are not supported.
+  CursorImpl* const cursor = CursorImpl::Create(
+      this, space->has_btree() ? space->tree()->root_page_id() : 0);
+  cursors_.push_back(cursor);
+  if (UNLIKELY(is_store_closed_))
+    cursor->StoreWasClosed();
+  return cursor;
+}
+
+}  // namespace berrydb
@@ -0,0 +1,147 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_READ_TRANSACTION_IMPL_H_
+#define BERRYDB_READ_TRANSACTION_IMPL_H_
+
+#include <tuple>
+#include <vector>
+
+#include "berrydb/read_transaction.h"
+#include "berrydb/span.h"
+// #include "./store_impl.h" would cause a cycle
+#include "./util/checks.h"
+#include "./util/linked_list.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class CursorImpl;
+class Page;
+class PinnedValue;
+class SpaceImpl;
+class StoreImpl;
+
+/** Internal representation for the ReadTransaction class in the public API.
+ *
+ * Unlike TransactionImpl, read transactions don't have a page list. The pages
+ * they read stay assigned to the store's init transaction, so reads never move
+ * pages between transaction lists.
+ *
+ * Each read transaction sees a snapshot of the store, made up of the
+ * transactions that committed before the read transaction was created. Pages
+ * modified by later transactions are read from the store's PageVersions. The
+ * store keeps a list of read transactions, sorted by snapshot, so it knows
+ * which page versions are still needed.
+ */
+class ReadTransactionImpl {
+ public:
+  /** Create a ReadTransactionImpl instance. */
+  static ReadTransactionImpl* Create(StoreImpl* store, uint64_t snapshot);
+
+  ReadTransactionImpl(const ReadTransactionImpl&) = delete;
+  ReadTransactionImpl(ReadTransactionImpl&&) = delete;
+  ReadTransactionImpl& operator=(const ReadTransactionImpl&) = delete;
+  ReadTransactionImpl& operator=(ReadTransactionImpl&&) = delete;
+
+  /** Computes the internal representation for a pointer from the public API. */
+  static inline ReadTransactionImpl* FromApi(ReadTransaction* api) noexcept {
+    ReadTransactionImpl* const impl =
+        reinterpret_cast<ReadTransactionImpl*>(api);
+    BERRYDB_ASSUME_EQ(api, &impl->api_);
+    return impl;
+  }
+  /** Computes the internal representation for a pointer from the public API. */
+  static inline const ReadTransactionImpl* FromApi(
+      const ReadTransaction* api) noexcept {
+    const ReadTransactionImpl* const impl =
+        reinterpret_cast<const ReadTransactionImpl*>(api);
+    BERRYDB_ASSUME_EQ(api, &impl->api_);
+    return impl;
+  }
+
+  /** Computes the public API representation for this transaction. */
+  inline constexpr ReadTransaction* ToApi() noexcept { return &api_; }
+
+  /** The store this transaction is running against. */
+  inline constexpr StoreImpl* store() const noexcept { return store_; }
+
+  /** The timestamp of the last commit seen by this transaction. */
+  inline constexpr uint64_t snapshot() const noexcept { return snapshot_; }
+
+  /** Reads a page's content, as seen by this transaction's snapshot.
+   *
+   * The returned data is valid until the next ReadPage() call, and until the
+   * next write to the store. Writers do not wait for readers, so a page read
+   * earlier may be modified in place afterwards.
+   *
+   * @param  page_id the page to be read
+   * @return status  kAlreadyClosed if the store was closed; otherwise, most
+   *                 likely kSuccess or kIoError
+   * @return data    the page's content
+   */
+  std::tuple<Status, span<const uint8_t>> ReadPage(size_t page_id);
+
+  /** The pool page holding the data returned by the last ReadPage() call.
+   *
+   * Null if the data came from a saved page version. The page stays pinned
+   * until the next ReadPage() call. */
+  inline constexpr Page* pinned_page() const noexcept { return pinned_page_; }
+
+  /** Called when the transaction's store is closed.
+   *
+   * The transaction and its cursors drop their page pins, and stop accessing
+   * the store's page pool. */
+  void StoreWasClosed() noexcept;
+
+  /** Called when one of the transaction's cursors is released. */
+  void CursorReleased(CursorImpl* cursor) noexcept;
+
+  // See the public API documention for details.
+  std::tuple<Status, span<const uint8_t>> Get(SpaceImpl* space,
+                                              span<const uint8_t> key);
+  Status Get(SpaceImpl* space, span<const uint8_t> key, PinnedValue* value);
+  std::tuple<Status, size_t> ReadValue(SpaceImpl* space,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer);
+  CursorImpl* CreateCursor(SpaceImpl* space);
+  void Release();
+
+ private:
+  /** Use ReadTransactionImpl::Create() to obtain instances. */
+  ReadTransactionImpl(StoreImpl* store, uint64_t snapshot);
+  /** Use Release() to destroy ReadTransactionImpl instances. */
+  ~ReadTransactionImpl();
+
+  /** Drops the pin on the page returned by the last ReadPage() call. */
+  void UnpinPage() noexcept;
+
+  /* The public API version of this class. */
+  ReadTransaction api_;  // Must be the first class member.
+
+  friend class LinkedListBridge<ReadTransactionImpl>;
+  LinkedList<ReadTransactionImpl>::Node linked_list_node_;
+
+  /** The store this transaction runs against. */
+  StoreImpl* const store_;
+
+  /** See snapshot(). */
+  const uint64_t snapshot_;
+
+  /** The cursors created by this transaction that weren't released yet. */
+  LinkedList<CursorImpl> cursors_;
+
+  /** The pool page returned by the last ReadPage() call, if any. */
+  Page* pinned_page_ = nullptr;
+
+  /** Holds the value returned by the last Get(). */
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> value_buffer_;
+
+  /** See StoreWasClosed(). */
+  bool is_store_closed_ = false;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_READ_TRANSACTION_IMPL_H_
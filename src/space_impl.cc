@@ -4,7 +4,18 @@
 
 #include "./space_impl.h"
 
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "berrydb/pinned_value.h"
+#include "berrydb/platform.h"
+#include "./page_pool.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
 #include "./util/checks.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
 
 namespace berrydb {
 
@@ -12,17 +23,106 @@ static_assert(std::is_standard_layout<SpaceImpl>::value,
     "SpaceImpl must be a standard layout type so its public API can be "
     "exposed cheaply");
 
-SpaceImpl* SpaceImpl::Create() {
+SpaceImpl* SpaceImpl::Create(size_t root_page_id, CatalogImpl::EntryType type,
+                             const BloomFilter& filter,
+                             const ValueLog& value_log) {
+  BERRYDB_ASSUME(type != CatalogImpl::EntryType::kCatalog);
+  BERRYDB_ASSUME(!filter.exists() || type == CatalogImpl::EntryType::kSpace);
+  BERRYDB_ASSUME(!value_log.exists() ||
+                 type == CatalogImpl::EntryType::kSpace);
+
   void* const heap_block = Allocate(sizeof(SpaceImpl));
-  SpaceImpl* const space = new (heap_block) SpaceImpl();
+  SpaceImpl* const space =
+      new (heap_block) SpaceImpl(root_page_id, type, filter, value_log);
   BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(space));
   return space;
 }
 
-SpaceImpl::SpaceImpl() = default;
+SpaceImpl::SpaceImpl(size_t root_page_id, CatalogImpl::EntryType type,
+                     const BloomFilter& filter, const ValueLog& value_log)
+    : tree_(root_page_id, value_log,
+            type == CatalogImpl::EntryType::kBufferedSpace),
+      hash_table_(root_page_id),
+      integer32_tree_(root_page_id), integer64_tree_(root_page_id),
+      filter_(filter), type_(type) {}
 
 SpaceImpl::~SpaceImpl() = default;
 
+Status SpaceImpl::RebuildFilter(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(has_filter());
+
+  Status status = filter_.Clear(transaction);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  std::pair<BloomFilter*, TransactionImpl*> context(&filter_, transaction);
+  return tree_.ForEachKey(
+      transaction,
+      [](void* raw_context, span<const uint8_t> key) {
+        auto* const context =
+            static_cast<std::pair<BloomFilter*, TransactionImpl*>*>(
+                raw_context);
+        return context->first->Add(context->second, key);
+      },
+      &context);
+}
+
+Status SpaceImpl::MultiGet(TransactionImpl* transaction,
+                           span<const span<const uint8_t>> keys,
+                           span<Status> statuses,
+                           span<PinnedValue> values) const {
+  BERRYDB_ASSUME_EQ(statuses.size(), keys.size());
+  BERRYDB_ASSUME_EQ(values.size(), keys.size());
+
+  // Other structures don't benefit from sorting the keys, and buffered trees
+  // may answer lookups from their inner nodes.
+  if (!has_btree()) {
+    // Each lookup pins at most one page. Like BTree::MultiGet(), values are
+    // copied once the batch may have pinned a quarter of the page pool.
+    size_t pinned_value_budget =
+        transaction->store()->page_pool()->page_capacity() / 4;
+    BTree::ValueBuffer buffer;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      Status status;
+      if (pinned_value_budget > 0) {
+        --pinned_value_budget;
+        status = Get(transaction, keys[i], &values[i]);
+      } else {
+        values[i].Reset();
+        status = Get(transaction, keys[i], &buffer);
+        if (status == Status::kSuccess) {
+          CopySpan(span<const uint8_t>(buffer.data(), buffer.size()),
+                   values[i].AllocateCopy(buffer.size()));
+        }
+      }
+      if (UNLIKELY(status != Status::kSuccess && status != Status::kNotFound))
+        return status;
+      statuses[i] = status;
+    }
+    return Status::kSuccess;
+  }
+
+  std::vector<size_t, PlatformAllocator<size_t>> indexes;
+  indexes.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    values[i].Reset();
+    statuses[i] = Status::kNotFound;
+    if (has_filter()) {
+      Status status;
+      bool may_contain;
+      std::tie(status, may_contain) = filter_.MayContain(transaction, keys[i]);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      if (!may_contain)
+        continue;
+    }
+    indexes.push_back(i);
+  }
+  return tree_.MultiGet(transaction, keys,
+                        span<size_t>(indexes.data(), indexes.size()),
+                        statuses, values);
+}
+
 void SpaceImpl::Release() {
   this->~SpaceImpl();
   void* const heap_block = static_cast<void*>(this);
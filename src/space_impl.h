@@ -5,15 +5,55 @@
 #ifndef BERRYDB_SPACE_IMPL_H_
 #define BERRYDB_SPACE_IMPL_H_
 
+#include <tuple>
+#include <vector>
+
+#include "berrydb/pinned_value.h"
+#include "berrydb/platform.h"
 #include "berrydb/space.h"
+#include "berrydb/span.h"
+#include "berrydb/status.h"
+#include "./bloom_filter.h"
+#include "./btree.h"
+#include "./catalog_impl.h"
+#include "./hash_table.h"
+#include "./integer_btree.h"
 #include "./util/checks.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+#include "./write_batch_impl.h"
 
 namespace berrydb {
 
-/** Internal representation for the Space class in the public API. */
+/** Internal representation for the Space class in the public API.
+ *
+ * A space's keys and values are stored in a B+tree, in a hash table for hashed
+ * spaces, or in an integer-keyed B+tree for spaces with fixed-width integer
+ * keys. The key/value methods below forward to the right structure.
+ *
+ * Spaces created with SpaceOptions::bloom_filter_key_count also have a
+ * BloomFilter. Lookups consult the filter before the B+tree, and writes that
+ * create keys add the keys to the filter.
+ *
+ * Spaces created with SpaceOptions::value_log_threshold have a B+tree that
+ * keeps its mid-sized values in a ValueLog. Spaces created with
+ * SpaceOptions::write_buffered have a B+tree that buffers writes in its inner
+ * nodes.
+ */
 class SpaceImpl {
  public:
-  static SpaceImpl* Create();
+  /** Creates a handle for a space.
+   *
+   * @param root_page_id the root page of the space's B+tree, or the header page
+   *                     of the space's hash table
+   * @param type         the space's catalog entry type, which determines the
+   *                     structure that holds the space's keys and values
+   * @param filter       the space's Bloom filter; may not exist
+   * @param value_log    the space's value log; may not exist
+   */
+  static SpaceImpl* Create(size_t root_page_id, CatalogImpl::EntryType type,
+                           const BloomFilter& filter,
+                           const ValueLog& value_log);
 
   SpaceImpl(const SpaceImpl&) = delete;
   SpaceImpl(SpaceImpl&&) = delete;
@@ -36,19 +76,280 @@ class SpaceImpl {
   /** Computes the public API representation for this store. */
   inline constexpr Space* ToApi() noexcept { return &api_; }
 
+  /** True if the space's keys and values are stored in a BTree.
+   *
+   * Only BTree-backed spaces support cursors and bulk loading. Buffered spaces
+   * are also backed by a BTree, but their leaves may not have the latest
+   * writes, so they don't count. */
+  inline constexpr bool has_btree() const noexcept {
+    return type_ == CatalogImpl::EntryType::kSpace;
+  }
+
+  /** The B+tree that holds the space's keys and values.
+   *
+   * Only meaningful if has_btree() is true. */
+  inline BTree* tree() noexcept {
+    BERRYDB_ASSUME(has_btree());
+    return &tree_;
+  }
+
+  /** True if the space has a Bloom filter. */
+  inline constexpr bool has_filter() const noexcept {
+    return filter_.exists();
+  }
+
+  /** The space's Bloom filter. Only meaningful if has_filter() is true. */
+  inline constexpr const BloomFilter& filter() const noexcept {
+    return filter_;
+  }
+
+  /** True if the space keeps its mid-sized values in a ValueLog. */
+  inline constexpr bool has_value_log() const noexcept {
+    return type_ == CatalogImpl::EntryType::kSpace &&
+           tree_.value_log().exists();
+  }
+
+  /** Rebuilds the space's Bloom filter from the keys in the space's B+tree.
+   *
+   * This drops the bits set by deleted keys. Only meaningful if has_filter()
+   * is true.
+   *
+   * @return kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status RebuildFilter(TransactionImpl* transaction);
+
+  // See the BTree methods with the same names.
+  template <typename TransactionType>
+  inline Status Get(TransactionType* transaction, span<const uint8_t> key,
+                    BTree::ValueBuffer* value) const;
+  template <typename TransactionType>
+  inline Status Get(TransactionType* transaction, span<const uint8_t> key,
+                    PinnedValue* value) const;
+  Status MultiGet(TransactionImpl* transaction,
+                  span<const span<const uint8_t>> keys, span<Status> statuses,
+                  span<PinnedValue> values) const;
+  template <typename TransactionType>
+  inline std::tuple<Status, size_t> ReadValue(
+      TransactionType* transaction, span<const uint8_t> key, size_t offset,
+      span<uint8_t> buffer) const;
+  inline Status Put(TransactionImpl* transaction, span<const uint8_t> key,
+                    span<const uint8_t> value);
+  inline Status ReserveValue(TransactionImpl* transaction,
+                             span<const uint8_t> key, size_t value_size);
+  inline Status WriteValue(TransactionImpl* transaction,
+                           span<const uint8_t> key, size_t offset,
+                           span<const uint8_t> data);
+  inline Status Delete(TransactionImpl* transaction, span<const uint8_t> key);
+
+  /** Applies a write batch's operations on this space, in order.
+   *
+   * @param  transaction the transaction that modifies the space
+   * @param  operations  operations on this space, sorted by key
+   * @return             kTooLarge if a key does not fit; otherwise, most likely
+   *                     kSuccess or kIoError
+   */
+  inline Status ApplyBatch(TransactionImpl* transaction,
+                           span<const WriteBatchImpl::Operation> operations);
+
   // See the public API documention for details.
   void Release();
 
  private:
+  /** Calls a function on the structure that holds the space's keys. */
+  template <typename Function>
+  inline auto Visit(Function&& function) {
+    switch (type_) {
+      case CatalogImpl::EntryType::kHashedSpace:
+        return function(hash_table_);
+      case CatalogImpl::EntryType::kInteger32Space:
+        return function(integer32_tree_);
+      case CatalogImpl::EntryType::kInteger64Space:
+        return function(integer64_tree_);
+      default:
+        return function(tree_);
+    }
+  }
+  template <typename Function>
+  inline auto Visit(Function&& function) const {
+    switch (type_) {
+      case CatalogImpl::EntryType::kHashedSpace:
+        return function(hash_table_);
+      case CatalogImpl::EntryType::kInteger32Space:
+        return function(integer32_tree_);
+      case CatalogImpl::EntryType::kInteger64Space:
+        return function(integer64_tree_);
+      default:
+        return function(tree_);
+    }
+  }
+
   /** Use SpaceImpl::Create() to obtain SpaceImpl instances. */
-  SpaceImpl();
+  SpaceImpl(size_t root_page_id, CatalogImpl::EntryType type,
+            const BloomFilter& filter, const ValueLog& value_log);
   /** Use Release() to destroy StoreImpl instances. */
   ~SpaceImpl();
 
   /* The public API version of this class. */
   Space api_;  // Must be the first class member.
+
+  /** See tree(). */
+  BTree tree_;
+
+  /** Holds the keys and values of hashed spaces. */
+  HashTable hash_table_;
+
+  /** Holds the keys and values of spaces with 32-bit integer keys. */
+  IntegerBTree<uint32_t> integer32_tree_;
+
+  /** Holds the keys and values of spaces with 64-bit integer keys. */
+  IntegerBTree<uint64_t> integer64_tree_;
+
+  /** Short-circuits lookups for missing keys. May not exist. */
+  BloomFilter filter_;
+
+  /** Determines which structure holds the space's keys and values. */
+  const CatalogImpl::EntryType type_;
 };
 
+// The key/value methods are defined after the class, because they use
+// Visit(), whose return type is deduced.
+
+template <typename TransactionType>
+inline Status SpaceImpl::Get(TransactionType* transaction,
+                             span<const uint8_t> key,
+                             BTree::ValueBuffer* value) const {
+  if (has_filter()) {
+    Status status;
+    bool may_contain;
+    std::tie(status, may_contain) = filter_.MayContain(transaction, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (!may_contain)
+      return Status::kNotFound;
+  }
+  return Visit([&](const auto& store) {
+    return store.Get(transaction, key, value);
+  });
+}
+
+template <typename TransactionType>
+inline Status SpaceImpl::Get(TransactionType* transaction,
+                             span<const uint8_t> key,
+                             PinnedValue* value) const {
+  value->Reset();
+  if (has_filter()) {
+    Status status;
+    bool may_contain;
+    std::tie(status, may_contain) = filter_.MayContain(transaction, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    if (!may_contain)
+      return Status::kNotFound;
+  }
+  if (type_ == CatalogImpl::EntryType::kSpace ||
+      type_ == CatalogImpl::EntryType::kBufferedSpace) {
+    return tree_.Get(transaction, key, value);
+  }
+
+  // Hashed and integer-keyed spaces copy their values.
+  BTree::ValueBuffer buffer;
+  const Status status = Visit([&](const auto& store) {
+    return store.Get(transaction, key, &buffer);
+  });
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  CopySpan(span<const uint8_t>(buffer.data(), buffer.size()),
+           value->AllocateCopy(buffer.size()));
+  return Status::kSuccess;
+}
+
+template <typename TransactionType>
+inline std::tuple<Status, size_t> SpaceImpl::ReadValue(
+    TransactionType* transaction, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) const {
+  if (has_filter()) {
+    Status status;
+    bool may_contain;
+    std::tie(status, may_contain) = filter_.MayContain(transaction, key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0};
+    if (!may_contain)
+      return {Status::kNotFound, 0};
+  }
+  return Visit([&](const auto& store) {
+    return store.ReadValue(transaction, key, offset, buffer);
+  });
+}
+
+inline Status SpaceImpl::Put(TransactionImpl* transaction,
+                             span<const uint8_t> key,
+                             span<const uint8_t> value) {
+  const Status status = Visit([&](auto& store) {
+    return store.Put(transaction, key, value);
+  });
+  if (UNLIKELY(status != Status::kSuccess) || !has_filter())
+    return status;
+  return filter_.Add(transaction, key);
+}
+
+inline Status SpaceImpl::ReserveValue(TransactionImpl* transaction,
+                                      span<const uint8_t> key,
+                                      size_t value_size) {
+  const Status status = Visit([&](auto& store) {
+    return store.ReserveValue(transaction, key, value_size);
+  });
+  if (UNLIKELY(status != Status::kSuccess) || !has_filter())
+    return status;
+  return filter_.Add(transaction, key);
+}
+
+inline Status SpaceImpl::WriteValue(TransactionImpl* transaction,
+                                    span<const uint8_t> key, size_t offset,
+                                    span<const uint8_t> data) {
+  return Visit([&](auto& store) {
+    return store.WriteValue(transaction, key, offset, data);
+  });
+}
+
+inline Status SpaceImpl::Delete(TransactionImpl* transaction,
+                                span<const uint8_t> key) {
+  return Visit([&](auto& store) { return store.Delete(transaction, key); });
+}
+
+inline Status SpaceImpl::ApplyBatch(
+    TransactionImpl* transaction,
+    span<const WriteBatchImpl::Operation> operations) {
+  // Only unbuffered B+trees keep the keys sorted in their leaves.
+  if (!has_btree()) {
+    for (const WriteBatchImpl::Operation& operation : operations) {
+      Status status;
+      if (operation.type == WriteBatchImpl::OperationType::kPut) {
+        status = Put(transaction, operation.key, operation.value);
+      } else {
+        // Deleting a missing key is not an error.
+        status = Delete(transaction, operation.key);
+        if (status == Status::kNotFound)
+          status = Status::kSuccess;
+      }
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+    return Status::kSuccess;
+  }
+
+  Status status = tree_.ApplyBatch(transaction, operations);
+  if (UNLIKELY(status != Status::kSuccess) || !has_filter())
+    return status;
+  for (const WriteBatchImpl::Operation& operation : operations) {
+    if (operation.type != WriteBatchImpl::OperationType::kPut)
+      continue;
+    status = filter_.Add(transaction, operation.key);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+  }
+  return Status::kSuccess;
+}
+
 }  // namespace berrydb
 
 #endif  // BERRYDB_SPACE_IMPL_H_
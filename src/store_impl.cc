@@ -7,14 +7,21 @@
 #if BERRYDB_CHECK_IS_ON()
 #include <ostream>  // Needed by BERRYDB_ASSUME_EQ(State, State).
 #endif  // BERRYDB_CHECK_IS_ON()
+#include <algorithm>
+#include <random>
+#include <thread>
 #include <tuple>
 
 #include "berrydb/options.h"
 #include "berrydb/platform.h"
 #include "berrydb/vfs.h"
+#include "./catalog_impl.h"
+#include "./format/log_format.h"
 #include "./free_page_list.h"
+#include "./log_recovery.h"
 #include "./pinned_page.h"
 #include "./pool_impl.h"
+#include "./read_transaction_impl.h"
 #include "./transaction_impl.h"
 #include "./util/checks.h"
 #include "./util/span_util.h"
@@ -72,15 +79,17 @@ void StoreImpl::Release() {
 
 StoreImpl::StoreImpl(
     BlockAccessFile* data_file, size_t data_file_size,
-    RandomAccessFile* log_file,
-    // This will be used when we implement log recovery.
-    MAYBE_UNUSED size_t log_file_size,
-    PagePool* page_pool,
-    // This will be used when we implement creating/loading the metadata page.
-    MAYBE_UNUSED const StoreOptions& options)
-    : data_file_(data_file), log_file_(log_file), page_pool_(page_pool),
-      init_transaction_(this, true), header_(
-          page_pool->page_shift(), data_file_size >> page_pool->page_shift()) {
+    RandomAccessFile* log_file, size_t log_file_size,
+    PagePool* page_pool, const StoreOptions& options)
+    : data_file_(data_file), log_file_(log_file),
+      log_file_size_(log_file_size), page_pool_(page_pool),
+      page_versions_(page_pool->page_size()),
+      lock_manager_(options.lock_timeout_ms), init_transaction_(this, true),
+      header_(
+          page_pool->page_shift(), data_file_size >> page_pool->page_shift()),
+      free_page_manager_(this),
+      log_writer_(log_file, log_file_size, page_pool->page_shift()),
+      data_page_count_(data_file_size >> page_pool->page_shift()) {
   BERRYDB_ASSUME(data_file != nullptr);
   BERRYDB_ASSUME(log_file != nullptr);
   BERRYDB_ASSUME(page_pool != nullptr);
@@ -91,20 +100,95 @@ StoreImpl::~StoreImpl() {
     Close();
 
   BERRYDB_ASSUME_EQ(state_, State::kClosed);
+  if (root_catalog_ != nullptr)
+    root_catalog_->Release();
 }
 
 Status StoreImpl::Initialize(const StoreOptions &options) {
-  // TODO(pwnall): Check the log and attempt recovery.
-
-  if (options.create_if_missing && header_.page_count < 3) {
-    const Status status = Bootstrap();
-    if (UNLIKELY(status != Status::kSuccess))
-      return status;
+  if (options.compress_log && !kPlatformHasCompression)
+    return Status::kNotSupported;
+  log_writer_.set_compresses_page_images(options.compress_log);
+  checkpoint_log_size_ = options.checkpoint_log_size;
+
+  Status status;
+  if (header_.page_count == 0) {
+    if (!options.create_if_missing)
+      return Status::kDataCorrupted;
+
+    // The log file may hold records left over from an earlier store with the
+    // same name. A random epoch makes it very unlikely that recovery will
+    // mistake those records for records written by this store.
+    std::random_device random_device;
+    header_.log_epoch = (static_cast<uint64_t>(random_device()) << 32) |
+                        static_cast<uint64_t>(random_device());
+    log_writer_.Reset(header_.log_epoch);
+    status = Bootstrap();
+  } else {
+    status = ReadHeader();
+    if (LIKELY(status == Status::kSuccess)) {
+      // The data file may have pages past the header's page count, if pages
+      // were written after the last checkpoint.
+      free_page_manager_.set_page_count(
+          std::max(header_.page_count, data_page_count_));
+      status = free_page_manager_.ReadList(header_.free_list_head_page);
+    }
+    if (LIKELY(status == Status::kSuccess)) {
+      status = Recover(options);
+    }
+    if (LIKELY(status == Status::kSuccess))
+      log_writer_.Reset(header_.log_epoch);
   }
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  root_catalog_ = CatalogImpl::Create(this, kRootCatalogPageId);
 
+  relaxed_durability_ = options.relaxed_durability;
+  if (relaxed_durability_) {
+    log_writer_.StartBackgroundSync(options.log_sync_interval_ms,
+                                    options.log_sync_byte_threshold);
+  }
   return Status::kSuccess;
 }
 
+Status StoreImpl::Recover(const StoreOptions& options) {
+  if (log_file_size_ == 0)
+    return Status::kSuccess;
+
+  size_t thread_count = options.recovery_thread_count;
+  if (thread_count == 0) {
+    thread_count = std::thread::hardware_concurrency();
+    // hardware_concurrency() returns 0 if the number is not computable.
+    if (thread_count == 0)
+      thread_count = 1;
+  }
+
+  LogRecovery recovery(log_file_, log_file_size_, data_file_,
+                       header_.page_shift, header_.log_epoch);
+  Status status = recovery.Run(thread_count);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (recovery.transaction_count() == 0)
+    return Status::kSuccess;
+
+  // The replayed transactions may have changed the header page.
+  status = ReadHeader();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  // The replayed transactions may also have extended the data file. The
+  // header's page count is only updated by checkpoints, so it may not cover
+  // the pages allocated by the replayed transactions.
+  data_page_count_ = std::max(
+      data_page_count_, std::max(header_.page_count, recovery.page_count()));
+  if (free_page_manager_.page_count() < data_page_count_)
+    free_page_manager_.set_page_count(data_page_count_);
+  // The pages on the checkpoint's free list may have been allocated by the
+  // replayed transactions.
+  free_page_manager_.RemovePages(recovery.page_ids());
+
+  return Checkpoint();
+}
+
 Status StoreImpl::Bootstrap() {
   BERRYDB_ASSUME_EQ(page_pool_->page_shift(), header_.page_shift);
 
@@ -126,15 +210,16 @@ Status StoreImpl::Bootstrap() {
     const span<uint8_t> header_page_data = header_page.mutable_data();
     FillSpan(header_page_data, 0);
     header_.free_list_head_page = FreePageList::kInvalidPageId;
-    header_.page_count = 2;
+    header_.page_count = kRootCatalogPageId + 1;
     // header.page_shift is already set correctly by the constructor.
     header_.Serialize(header_page_data);
+    free_page_manager_.set_page_count(header_.page_count);
   }
 
   {
     Page* raw_root_catalog_page;
     std::tie(fetch_status, raw_root_catalog_page) = page_pool_->StorePage(
-        this, 1, PagePool::kIgnorePageData);
+        this, kRootCatalogPageId, PagePool::kIgnorePageData);
     if (UNLIKELY(fetch_status != Status::kSuccess)) {
       BERRYDB_ASSUME(raw_root_catalog_page == nullptr);
       transaction->Release();  // Rolls back the transaction.
@@ -145,8 +230,8 @@ Status StoreImpl::Bootstrap() {
     transaction->WillModifyPage(root_catalog_page.get());
     const span<uint8_t> root_catalog_page_data =
         root_catalog_page.mutable_data();
+    // A zero-filled page is an empty B+tree leaf.
     FillSpan(root_catalog_page_data, 0);
-    // TODO(pwnall): Bootstrap the root catalog here.
   }
 
   const Status commit_status = transaction->Commit();
@@ -154,15 +239,107 @@ Status StoreImpl::Bootstrap() {
     return commit_status;
 
   transaction->Release();
+
+  // Committed pages only reach the log, so the data file would stay empty until
+  // the first checkpoint. Opening a store whose data file is empty bootstraps a
+  // new store, which would discard the log, along with every transaction
+  // committed after the bootstrap.
+  return Checkpoint();
+}
+
+Status StoreImpl::Checkpoint() {
+  if (UNLIKELY(has_write_errors_))
+    return Status::kIoError;
+
+  // Syncing the whole log up front is cheaper than having WritePage() sync the
+  // log for each page.
+  Status status = log_writer_.Sync();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  status = init_transaction_.WriteLoggedPages();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  size_t free_list_head_page;
+  std::tie(status, free_list_head_page) = free_page_manager_.WriteList();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  status = data_file_->Sync();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The header must reach the disk before the log is overwritten. Otherwise, a
+  // crash could leave a log with records from two epochs, and a header that
+  // points to the old epoch.
+  ++header_.log_epoch;
+  header_.free_list_head_page = free_list_head_page;
+  status = WriteHeader();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  status = data_file_->Sync();
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  free_page_manager_.ListWritten();
+  log_writer_.Reset(header_.log_epoch);
   return Status::kSuccess;
 }
 
+Status StoreImpl::ReadHeader() {
+  const size_t page_size = static_cast<size_t>(1) << header_.page_shift;
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  const span<uint8_t> page_data(buffer, page_size);
+
+  Status status = data_file_->Read(0, page_data);
+  if (LIKELY(status == Status::kSuccess)) {
+    const size_t page_shift = header_.page_shift;
+    if (UNLIKELY(!header_.Deserialize(page_data) ||
+                 header_.page_shift != page_shift)) {
+      // The pool's page size is used to read the header, so a store that was
+      // created with a different page size must be opened by a matching pool.
+      header_.page_shift = page_shift;
+      status = Status::kDataCorrupted;
+    }
+  }
+
+  Deallocate(buffer, page_size);
+  return status;
+}
+
+Status StoreImpl::WriteHeader() {
+  const size_t page_size = static_cast<size_t>(1) << header_.page_shift;
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  const span<uint8_t> page_data(buffer, page_size);
+
+  FillSpan(page_data, 0);
+  header_.page_count = free_page_manager_.page_count();
+  header_.Serialize(page_data);
+  const Status status = data_file_->Write(page_data, 0);
+
+  Deallocate(buffer, page_size);
+  return status;
+}
+
 TransactionImpl* StoreImpl::CreateTransaction() {
-  TransactionImpl* const transaction = TransactionImpl::Create(this);
+  return CreateTransaction(TransactionOptions());
+}
+
+TransactionImpl* StoreImpl::CreateTransaction(
+    const TransactionOptions& options) {
+  TransactionImpl* const transaction = TransactionImpl::Create(this, options);
   transactions_.push_back(transaction);
   return transaction;
 }
 
+ReadTransactionImpl* StoreImpl::CreateReadTransaction() {
+  // Snapshots never decrease, so appending keeps the list sorted.
+  ReadTransactionImpl* const transaction =
+      ReadTransactionImpl::Create(this, last_commit_timestamp_);
+  read_transactions_.push_back(transaction);
+  return transaction;
+}
+
 Status StoreImpl::Close() {
   if (UNLIKELY(state_ != State::kOpen)) {
     if (state_ == State::kClosed)
@@ -175,11 +352,19 @@ Status StoreImpl::Close() {
   // roll back the live transactions cleanly, assuming no I/O errors.
   state_ = State::kClosing;
 
+  // Read transactions must drop their page pins before the pages are released.
+  for (ReadTransactionImpl* transaction : read_transactions_)
+    transaction->StoreWasClosed();
+
+  // The background thread must be stopped before the log is checkpointed.
+  Status result = Status::kSuccess;
+  if (relaxed_durability_)
+    result = log_writer_.StopBackgroundSync();
+
   // Replace the entire transaction list so TransactionClosed() doesn't
   // invalidate our iterator.
   LinkedList<TransactionImpl> rollback_queue = std::move(transactions_);
 
-  Status result = Status::kSuccess;
   for (TransactionImpl* transaction : rollback_queue) {
     Status rollback_status = transaction->Rollback();
 
@@ -193,7 +378,36 @@ Status StoreImpl::Close() {
     }
   }
 
-  // Rollback the init transaction to get the store's pages released.
+  // Stores that didn't log any transaction since they were opened don't need a
+  // checkpoint. This also covers stores that failed to initialize.
+  if (log_writer_.has_records()) {
+    const Status checkpoint_status = Checkpoint();
+    if (UNLIKELY(checkpoint_status != Status::kSuccess) &&
+        result == Status::kSuccess) {
+      result = checkpoint_status;
+    }
+  }
+  // The checkpoint syncs the log, unless it fails early. The log won't be
+  // synced again, so the transactions waiting for a sync are not durable.
+  log_writer_.AbandonSyncCallbacks(Status::kIoError);
+
+  // The transactions may outlive the store, so they must not access it anymore.
+  for (TransactionImpl* transaction : rollback_queue)
+    transaction->StoreWasClosed();
+  for (TransactionImpl* transaction : closed_transactions_)
+    transaction->StoreWasClosed();
+
+  page_versions_.CollectGarbage(PageVersions::kPendingTimestamp);
+
+  while (free_transaction_blocks_ != nullptr) {
+    void* const heap_block = TakeTransactionBlock();
+    Deallocate(heap_block, sizeof(TransactionImpl));
+  }
+
+  // Rollback the init transaction to get the store's pages released. This
+  // must happen after the checkpoint, which writes the pages that hold logged
+  // changes. If the checkpoint fails, the changes are recovered from the log
+  // when the store is opened again.
   Status rollback_status = init_transaction_.Rollback();
   if (UNLIKELY(rollback_status != Status::kSuccess)
       && result == Status::kSuccess)
@@ -220,6 +434,47 @@ Status StoreImpl::ReadPage(Page* page) {
   return data_file_->Read(file_offset, page->mutable_data(page_size));
 }
 
+std::tuple<Status, Page*> StoreImpl::FetchPage(size_t page_id) {
+  const PagePool::PageFetchMode fetch_mode =
+      page_id < data_page_count_ ? PagePool::kFetchPageData
+                                 : PagePool::kIgnorePageData;
+  return page_pool_->StorePage(this, page_id, fetch_mode);
+}
+
+Status StoreImpl::ReadDataFilePage(size_t page_id, span<uint8_t> page_data) {
+  BERRYDB_ASSUME_EQ(page_data.size(),
+                    static_cast<size_t>(1) << header_.page_shift);
+
+  return data_file_->Read(page_id << header_.page_shift, page_data);
+}
+
+Status StoreImpl::ReadDataFilePages(size_t first_page_id,
+                                     span<uint8_t> data) {
+  BERRYDB_ASSUME_EQ(data.size() & ((static_cast<size_t>(1) <<
+                                    header_.page_shift) - 1), 0U);
+
+  return data_file_->Read(first_page_id << header_.page_shift, data);
+}
+
+Status StoreImpl::WriteDataFilePages(size_t first_page_id,
+                                      span<const uint8_t> data) {
+  BERRYDB_ASSUME_EQ(data.size() & ((static_cast<size_t>(1) <<
+                                    header_.page_shift) - 1), 0U);
+
+  const Status status =
+      data_file_->Write(data, first_page_id << header_.page_shift);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const size_t end_page_id = first_page_id + (data.size() >> header_.page_shift);
+  if (data_page_count_ < end_page_id)
+    data_page_count_ = end_page_id;
+  return Status::kSuccess;
+}
+
+Status StoreImpl::SyncDataFile() {
+  return data_file_->Sync();
+}
+
 Status StoreImpl::WritePage(Page* page) {
   BERRYDB_ASSUME(page != nullptr);
   BERRYDB_ASSUME(page->transaction() != nullptr);
@@ -227,9 +482,149 @@ Status StoreImpl::WritePage(Page* page) {
   BERRYDB_ASSUME(page->is_dirty());
   // BERRYDB_ASSUME(!page->IsUnpinned());
 
+  // Write-ahead logging: the commit record covering the page's changes must be
+  // durable before the changes can reach the data file.
+  Status status = log_writer_.SyncTo(page->commit_lsn());
+  if (UNLIKELY(status != Status::kSuccess)) {
+    has_write_errors_ = true;
+    return status;
+  }
+
   const size_t file_offset = page->page_id() << header_.page_shift;
   const size_t page_size = static_cast<size_t>(1) << header_.page_shift;
-  return data_file_->Write(page->data(page_size), file_offset);
+  status = data_file_->Write(page->data(page_size), file_offset);
+  if (UNLIKELY(status != Status::kSuccess)) {
+    has_write_errors_ = true;
+    return status;
+  }
+  if (data_page_count_ <= page->page_id())
+    data_page_count_ = page->page_id() + 1;
+  page->SetLogLsns(0, 0);
+  return Status::kSuccess;
+}
+
+Status StoreImpl::StealPage(Page* page) {
+  BERRYDB_ASSUME(page != nullptr);
+  BERRYDB_ASSUME(page->transaction() != nullptr);
+  BERRYDB_ASSUME_EQ(this, page->transaction()->store());
+  BERRYDB_ASSUME_NE(page->transaction(), &init_transaction_);
+  BERRYDB_ASSUME(page->is_dirty());
+
+  TransactionImpl* const transaction = page->transaction();
+  const size_t page_id = page->page_id();
+
+  // The page's committed content only needs to be saved the first time it is
+  // stolen. Afterwards, the data file holds uncommitted changes.
+  if (!transaction->HasStolenPage(page_id)) {
+    // Pages holding logged changes already have their committed content in the
+    // log. WritePage() syncs the log past the content's commit record.
+    if (page->image_lsn() == 0 && page_id < data_page_count_) {
+      const size_t page_size = static_cast<size_t>(1) << header_.page_shift;
+      uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+      const span<uint8_t> page_data(buffer, page_size);
+
+      const Status status = ReadDataFilePage(page_id, page_data);
+      if (LIKELY(status == Status::kSuccess)) {
+        // The compressed payload is built before log space is reserved,
+        // because its size determines the record's size.
+        const size_t payload_capacity = log_writer_.compresses_page_images() ?
+            log_writer_.compressed_payload_capacity() : 0;
+        uint8_t* const payload_buffer = (payload_capacity == 0) ? nullptr :
+            reinterpret_cast<uint8_t*>(Allocate(payload_capacity));
+        const span<uint8_t> payload(payload_buffer, payload_capacity);
+        const size_t payload_size = (payload_capacity == 0) ? 0 :
+            log_writer_.CompressPageImage(page_data, payload);
+
+        const uint64_t image_record_size =
+            log_writer_.PageImageRecordSize(payload_size);
+        const uint64_t image_lsn = log_writer_.Reserve(
+            image_record_size + LogFormat::kCommitRecordSize);
+        if (payload_size == 0) {
+          log_writer_.WritePageImage(image_lsn, page_id, page_data);
+        } else {
+          log_writer_.WriteCompressedPageImage(image_lsn, page_id,
+                                               payload.first(payload_size));
+        }
+        log_writer_.WriteCommit(image_lsn + image_record_size, 1);
+        page->SetLogLsns(image_lsn, image_lsn + image_record_size +
+                                    LogFormat::kCommitRecordSize);
+        if (payload_buffer != nullptr)
+          Deallocate(payload_buffer, payload_capacity);
+      }
+
+      Deallocate(buffer, page_size);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+    transaction->WillStealPage(page_id, page->image_lsn());
+  }
+
+  return WritePage(page);
+}
+
+Status StoreImpl::RestoreStolenPage(size_t page_id, uint64_t image_lsn) {
+  BERRYDB_ASSUME_NE(image_lsn, 0U);
+
+  const size_t page_size = static_cast<size_t>(1) << header_.page_shift;
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  const span<uint8_t> page_data(buffer, page_size);
+
+  // The log was synced past the content's commit record when the page was
+  // stolen, so the content can be written right away.
+  Status status = log_writer_.ReadPageImage(image_lsn, page_data);
+  if (LIKELY(status == Status::kSuccess))
+    status = data_file_->Write(page_data, page_id << header_.page_shift);
+
+  if (LIKELY(status == Status::kSuccess)) {
+    // The pool may have cached the page's uncommitted content if the
+    // transaction fetched the page after it was stolen.
+    Page* const page = page_pool_->CachedStorePage(this, page_id);
+    if (page != nullptr) {
+      BERRYDB_ASSUME(!page->is_dirty());
+      // The entry may be sitting in the LRU list without any pins.
+      page_pool_->PinStorePage(page);
+      {
+        ExclusiveLatchGuard latch_guard(page->latch());
+        CopySpan(span<const uint8_t>(page_data),
+                 page->mutable_data(page_size));
+      }
+      page_pool_->UnpinStorePage(page);
+    }
+  } else {
+    // The data file holds uncommitted changes. Skipping the checkpoint gets the
+    // page's committed content replayed from the log when the store is opened
+    // again.
+    has_write_errors_ = true;
+  }
+
+  Deallocate(buffer, page_size);
+  return status;
+}
+
+Status StoreImpl::RestoreLoggedPage(Page* page) {
+  BERRYDB_ASSUME(page != nullptr);
+  BERRYDB_ASSUME(page->transaction() != nullptr);
+  BERRYDB_ASSUME_EQ(this, page->transaction()->store());
+  BERRYDB_ASSUME(!page->IsUnpinned());
+  BERRYDB_ASSUME_NE(page->image_lsn(), 0U);
+
+  const size_t page_size = static_cast<size_t>(1) << header_.page_shift;
+  const Status status = log_writer_.ReadPageImage(
+      page->image_lsn(), page->mutable_data(page_size));
+  if (UNLIKELY(status != Status::kSuccess)) {
+    // The pool entry will be discarded, so the data file's stale copy of the
+    // page must not be trusted. Skipping the checkpoint gets the page replayed
+    // from the log when the store is opened again.
+    has_write_errors_ = true;
+  }
+  return status;
+}
+
+Status StoreImpl::SyncLog() {
+  if (UNLIKELY(state_ != State::kOpen))
+    return Status::kAlreadyClosed;
+
+  return log_writer_.Sync();
 }
 
 void StoreImpl::TransactionClosed(TransactionImpl* transaction) {
@@ -244,6 +639,50 @@ void StoreImpl::TransactionClosed(TransactionImpl* transaction) {
     return;
 
   transactions_.erase(transaction);
+  closed_transactions_.push_back(transaction);
+  if (transaction->IsCommitted())
+    CollectPageVersions();
+
+  // A checkpoint resets the log, so it must wait until no running transaction
+  // relies on log records to roll back its changes.
+  if (transaction->IsCommitted() && checkpoint_log_size_ != 0 &&
+      transactions_.empty() &&
+      log_writer_.log_size() >= checkpoint_log_size_) {
+    // The transaction is already committed, so a failed checkpoint does not
+    // impact it. Failed page writes prevent future checkpoints, and the log is
+    // replayed when the store is opened again.
+    Checkpoint();
+  }
+}
+
+void StoreImpl::ReadTransactionReleased(ReadTransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME_EQ(state_, State::kOpen);
+  BERRYDB_ASSUME_EQ(this, transaction->store());
+
+  read_transactions_.erase(transaction);
+  CollectPageVersions();
+}
+
+void StoreImpl::CollectPageVersions() noexcept {
+  // The versions seen by the oldest snapshot include all the versions seen by
+  // the newer snapshots.
+  const uint64_t oldest_snapshot = read_transactions_.empty()
+      ? PageVersions::kPendingTimestamp
+      : read_transactions_.front()->snapshot();
+  page_versions_.CollectGarbage(oldest_snapshot);
+  free_page_manager_.ReleaseFreedPages(oldest_snapshot);
+}
+
+void StoreImpl::TransactionReleased(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(transaction->IsClosed());
+  BERRYDB_ASSUME_EQ(state_, State::kOpen);
+#if BERRYDB_CHECK_IS_ON()
+  BERRYDB_CHECK_EQ(this, transaction->store());
+#endif  // BERRYDB_CHECK_IS_ON()
+
+  closed_transactions_.erase(transaction);
 }
 
 std::string StoreImpl::LogFilePath(const std::string& store_path) {
@@ -6,10 +6,15 @@
 #define BERRYDB_STORE_IMPL_H_
 
 #include <functional>
+#include <tuple>
 #include <unordered_set>
 
 #include "./format/store_header.h"
+#include "./free_page_manager.h"
+#include "./lock_manager.h"
+#include "./log_writer.h"
 #include "./page.h"
+#include "./page_versions.h"
 #include "berrydb/platform.h"
 #include "berrydb/pool.h"
 #include "berrydb/store.h"
@@ -24,6 +29,8 @@ class BlockAccessFile;
 class CatalogImpl;
 class PagePool;
 class PoolImpl;
+class ReadTransactionImpl;
+struct TransactionOptions;
 
 /** Internal representation for the Store class in the public API. */
 class StoreImpl {
@@ -48,6 +55,9 @@ class StoreImpl {
                            PagePool* page_pool,
                            const StoreOptions& options);
 
+  /** The page holding the root of the root catalog's B+tree. */
+  static constexpr size_t kRootCatalogPageId = 1;
+
   StoreImpl(const StoreImpl&) = delete;
   StoreImpl(StoreImpl&&) = delete;
   StoreImpl& operator=(const StoreImpl&) = delete;
@@ -81,11 +91,76 @@ class StoreImpl {
   /** The page pool used by this store. */
   inline constexpr PagePool* page_pool() const noexcept { return page_pool_; }
 
+  /** Appends records to this store's log. Used by committing transactions. */
+  inline constexpr LogWriter* log_writer() noexcept { return &log_writer_; }
+
+  /** Old page content that is still visible to read transactions. */
+  inline constexpr PageVersions* page_versions() noexcept {
+    return &page_versions_;
+  }
+
+  /** The timestamp of the last committed write transaction.
+   *
+   * Commit timestamps order the write transactions that modified pages. Read
+   * transactions use them to tell which changes are in their snapshots. */
+  inline constexpr uint64_t last_commit_timestamp() const noexcept {
+    return last_commit_timestamp_;
+  }
+
+  /** The newest commit timestamp of the pages that left the pool.
+   *
+   * This is an upper bound for the commit timestamps of the pages that are not
+   * cached in the pool. See Page::commit_timestamp(). */
+  inline constexpr uint64_t evicted_commit_timestamp() const noexcept {
+    return evicted_commit_timestamp_;
+  }
+
+  /** The number of pages known to exist in the data file.
+   *
+   * Pages past this point that are not cached in the pool have no committed
+   * content. */
+  inline constexpr size_t data_page_count() const noexcept {
+    return data_page_count_;
+  }
+
+  /** Called when a page stops being cached in the pool. */
+  inline void PageWillLeavePool(const Page* page) noexcept {
+    if (evicted_commit_timestamp_ < page->commit_timestamp())
+      evicted_commit_timestamp_ = page->commit_timestamp();
+  }
+
+  /** Assigns a timestamp to a committing transaction. */
+  inline uint64_t AdvanceCommitTimestamp() noexcept {
+    return ++last_commit_timestamp_;
+  }
+
+  /** Isolates the transactions that access the same records. */
+  inline constexpr LockManager* lock_manager() noexcept {
+    return &lock_manager_;
+  }
+
+  /** Hands out the pages used by the store's B+trees. */
+  inline constexpr FreePageManager* free_page_manager() noexcept {
+    return &free_page_manager_;
+  }
+
+  /** True if commits return before their log records are synced.
+   *
+   * See StoreOptions::relaxed_durability for details. */
+  inline constexpr bool relaxed_durability() const noexcept {
+    return relaxed_durability_;
+  }
+
   // See the public API documention for details.
   static std::string LogFilePath(const std::string& store_path);
   TransactionImpl* CreateTransaction();
-  inline constexpr CatalogImpl* RootCatalog() noexcept { return nullptr; }
+  TransactionImpl* CreateTransaction(const TransactionOptions& options);
+  ReadTransactionImpl* CreateReadTransaction();
+  inline constexpr CatalogImpl* RootCatalog() noexcept {
+    return root_catalog_;
+  }
   Status Close();
+  Status SyncLog();
   inline constexpr bool IsClosed() const noexcept {
     return state_ == State::kClosed;
   }
@@ -104,9 +179,29 @@ class StoreImpl {
    */
   Status Initialize(const StoreOptions& options);
 
-  /** Builds a new store on the currently opened files. */
+  /** Builds a new store on the currently opened files.
+   *
+   * The new store's pages are written to the data file before this returns, so
+   * the store is recognized even if it is not closed cleanly. */
   Status Bootstrap();
 
+  /** Makes the data file reflect all the transactions in the log.
+   *
+   * After the data file is synced, the store header's log epoch is bumped, so
+   * the records currently in the log become stale, and the log can be reused
+   * from the beginning.
+   *
+   * Pages holding changes that were logged, but not written to the data file,
+   * are written out before the data file is synced.
+   *
+   * Checkpointing is not possible after a page write fails, because the data
+   * file may be missing committed changes. The log is kept around, so it can be
+   * replayed when the store is opened again.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status Checkpoint();
+
   /** Reads a page from the store into the page pool.
    *
    * The page pool entry must have already been assigned to store, and must not
@@ -116,20 +211,147 @@ class StoreImpl {
    * @return      most likely kSuccess or kIoError */
   Status ReadPage(Page* page);
 
+  /** Pins one of this store's pages on behalf of a write transaction.
+   *
+   * Pages past the end of the data file that aren't cached were allocated by
+   * transactions that haven't written them yet. Optimistic transactions keep
+   * the content of such pages on the side, so the pages aren't read.
+   *
+   * @param  page_id the ID of the page to be pinned
+   * @return status  most likely kSuccess or kIoError
+   * @return page    the pinned page; the caller must unpin it
+   */
+  std::tuple<Status, Page*> FetchPage(size_t page_id);
+
+  /** Reads a page's content from the data file, bypassing the pool.
+   *
+   * @param  page_id   the page that will be read
+   * @param  page_data receives the page's content; must be exactly one page
+   * @return           most likely kSuccess or kIoError */
+  Status ReadDataFilePage(size_t page_id, span<uint8_t> page_data);
+
+  /** Reads consecutive pages from the data file, bypassing the pool.
+   *
+   * This issues a single I/O operation, so it is faster than reading the pages
+   * one by one. The caller must ensure that the pool does not hold newer
+   * versions of the pages.
+   *
+   * @param  first_page_id the first page that will be read
+   * @param  data          receives the pages' content; must be a whole number
+   *                       of pages
+   * @return               most likely kSuccess or kIoError */
+  Status ReadDataFilePages(size_t first_page_id, span<uint8_t> data);
+
+  /** Writes consecutive pages directly to the data file, bypassing the pool.
+   *
+   * The writes are not logged, so they can only target freshly allocated pages
+   * that no committed data refers to yet. If the process crashes, the pages are
+   * unreachable. The data file must be synced using SyncDataFile() before a
+   * logged change makes the pages reachable.
+   *
+   * @param  first_page_id the first page that will be written; the pool must
+   *                       not cache any of the pages
+   * @param  data          the pages' content; must be a whole number of pages
+   * @return               most likely kSuccess or kIoError */
+  Status WriteDataFilePages(size_t first_page_id, span<const uint8_t> data);
+
+  /** Syncs the data file. See WriteDataFilePages().
+   *
+   * @return most likely kSuccess or kIoError */
+  Status SyncDataFile();
+
   /** Writes a page to the store.
    *
    * The page pool entry must be flagged as dirty. The caller is responsible for
-   * clearing the page entry's dirty flag if this method succeeds.
+   * clearing the page entry's dirty flag if this method succeeds. If the page
+   * holds logged changes, the log is synced past their commit record before the
+   * page is written.
    *
    * @param  page the page pool entry caching the store page to be written
    * @return      most likely kSuccess or kIoError */
   Status WritePage(Page* page);
 
+  /** Reverts a page to the committed content in its latest log record.
+   *
+   * This is used to roll back changes to a page whose committed content has
+   * been logged, but has not been written to the data file.
+   *
+   * @param  page the page pool entry caching the store page; must be pinned,
+   *              and must have a non-zero image_lsn()
+   * @return      most likely kSuccess or kIoError */
+  Status RestoreLoggedPage(Page* page);
+
+  /** Writes a page holding a running transaction's changes to the store.
+   *
+   * This is used by the page pool to evict pages modified by transactions that
+   * haven't committed yet. Before the data file's copy of the page is
+   * overwritten for the first time, the page's committed content is logged as a
+   * transaction of its own, and the log is synced. If the transaction that
+   * modified the page doesn't commit, the committed content is restored from
+   * the log, either by RestoreStolenPage() or by recovery.
+   *
+   * The page pool entry must be flagged as dirty, and must be assigned to a
+   * non-init transaction. The caller is responsible for clearing the page
+   * entry's dirty flag if this method succeeds.
+   *
+   * @param  page the page pool entry caching the store page to be written
+   * @return      most likely kSuccess or kIoError */
+  Status StealPage(Page* page);
+
+  /** Reverts a stolen page's data file copy to its committed content.
+   *
+   * The page's pool entry is updated too, if the page is cached.
+   *
+   * @param  page_id   the page that was stolen from a rolled back transaction
+   * @param  image_lsn the LSN of the log record holding the committed content
+   * @return           most likely kSuccess or kIoError */
+  Status RestoreStolenPage(size_t page_id, uint64_t image_lsn);
+
+  /** Takes the memory of a released transaction, for reuse.
+   *
+   * @return a memory block of sizeof(TransactionImpl) bytes, or nullptr if the
+   *         store does not have any released transaction */
+  inline void* TakeTransactionBlock() noexcept {
+    void* const heap_block = free_transaction_blocks_;
+    if (heap_block != nullptr)
+      free_transaction_blocks_ = *reinterpret_cast<void**>(heap_block);
+    return heap_block;
+  }
+
+  /** Keeps the memory of a released transaction around, for reuse.
+   *
+   * @param heap_block the memory of a destroyed TransactionImpl instance that
+   *                   was created against this store */
+  inline void RecycleTransactionBlock(void* heap_block) noexcept {
+    BERRYDB_ASSUME(heap_block != nullptr);
+    BERRYDB_ASSUME_NE(state_, State::kClosed);
+
+    *reinterpret_cast<void**>(heap_block) = free_transaction_blocks_;
+    free_transaction_blocks_ = heap_block;
+  }
+
   /** Updates the store to reflect a transaction's commit / roll back.
+   *
+   * Committing transactions may trigger a checkpoint, if the log has grown past
+   * StoreOptions::checkpoint_log_size.
    *
    * @param transaction must be associated with this store, and closed */
   void TransactionClosed(TransactionImpl* transaction);
 
+  /** Updates the store to reflect a read transaction's release.
+   *
+   * Frees the page versions that were only visible to the transaction.
+   *
+   * @param transaction must be associated with this store; the store must not
+   *                    have been closed */
+  void ReadTransactionReleased(ReadTransactionImpl* transaction);
+
+  /** Updates the store to reflect a transaction's release.
+   *
+   * @param transaction must be associated with this store, and closed; the
+   *                    store must not have been closed */
+  void TransactionReleased(TransactionImpl* transaction);
+
 #if BERRYDB_CHECK_IS_ON()
   /** Number of pool pages assigned to this store. For use in CHECKs only.
    *
@@ -148,6 +370,28 @@ class StoreImpl {
   /** Use Release() to destroy StoreImpl instances. */
   ~StoreImpl();
 
+  /** Frees the page versions that are not visible to any read transaction.
+   *
+   * The pages freed by transactions that all the read snapshots include are
+   * handed to the free page manager. */
+  void CollectPageVersions() noexcept;
+
+  /** Reads the store header directly from the data file, bypassing the pool.
+   *
+   * @return most likely kSuccess, kIoError, or kDataCorrupted */
+  Status ReadHeader();
+
+  /** Writes the store header directly to the data file, bypassing the pool.
+   *
+   * @return most likely kSuccess or kIoError */
+  Status WriteHeader();
+
+  /** Replays the log into the data file, if the log has any transactions.
+   *
+   * @param  options used to size the recovery thread pool
+   * @return         most likely kSuccess, kIoError, or kDataCorrupted */
+  Status Recover(const StoreOptions& options);
+
   /* The public API version of this class. */
   Store api_;  // Must be the first class member.
 
@@ -157,12 +401,44 @@ class StoreImpl {
   /** Handle to the store's log file. */
   RandomAccessFile* const log_file_;
 
+  /** The log file's size when the store was opened. Used by recovery. */
+  const size_t log_file_size_;
+
   /** The page pool used by this store to interact with its data file. */
   PagePool* const page_pool_;
 
   /** The transactions opened on this store. */
   LinkedList<TransactionImpl> transactions_;
 
+  /** The transactions that were closed, but haven't been released yet.
+   *
+   * When the store is closed, these transactions are told to stop accessing
+   * the store, as the store may be released before them. */
+  LinkedList<TransactionImpl> closed_transactions_;
+
+  /** The read transactions opened on this store, sorted by snapshot. */
+  LinkedList<ReadTransactionImpl> read_transactions_;
+
+  /** See page_versions(). */
+  PageVersions page_versions_;
+
+  /** See last_commit_timestamp(). */
+  uint64_t last_commit_timestamp_ = 0;
+
+  /** See evicted_commit_timestamp(). */
+  uint64_t evicted_commit_timestamp_ = 0;
+
+  /** See lock_manager(). */
+  LockManager lock_manager_;
+
+  /** Memory blocks of released transactions, reused by CreateTransaction().
+   *
+   * Each free block stores a pointer to the next free block. Running many short
+   * transactions would otherwise call the platform allocator for each of them.
+   * The number of free blocks is bounded by the peak number of transactions
+   * that were alive at the same time. */
+  void* free_transaction_blocks_ = nullptr;
+
   /** The store's init transaction.
    *
    * Each store has a transaction that plays a similar role to the init process
@@ -175,6 +451,30 @@ class StoreImpl {
   /** Metadata in the data file's header. */
   StoreHeader header_;
 
+  /** See free_page_manager(). */
+  FreePageManager free_page_manager_;
+
+  /** See RootCatalog(). Set by Initialize(). */
+  CatalogImpl* root_catalog_ = nullptr;
+
+  /** Appends transaction records to the store's log file. */
+  LogWriter log_writer_;
+
+  /** See data_page_count().
+   *
+   * Stealing pages past this point does not require logging their data file
+   * copies. */
+  size_t data_page_count_;
+
+  /** See StoreOptions::checkpoint_log_size. Set by Initialize(). */
+  size_t checkpoint_log_size_ = 0;
+
+  /** Set when a page write fails. Prevents checkpointing. */
+  bool has_write_errors_ = false;
+
+  /** See relaxed_durability(). Set by Initialize(). */
+  bool relaxed_durability_ = false;
+
   State state_ = State::kOpen;
 };
 
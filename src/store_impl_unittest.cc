@@ -6,13 +6,21 @@
 
 #include <random>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "berrydb/options.h"
 #include "berrydb/vfs.h"
+#include "./catalog_impl.h"
+#include "./format/log_format.h"
+#include "./format/store_header.h"
+#include "./log_writer.h"
 #include "./page_pool.h"
 #include "./pool_impl.h"
+#include "./read_transaction_impl.h"
+#include "./space_impl.h"
 #include "./test/block_access_file_wrapper.h"
 #include "./test/file_deleter.h"
 #include "./util/span_util.h"
@@ -20,13 +28,24 @@
 
 namespace berrydb {
 
+namespace {
+
+span<const uint8_t> StringSpan(const std::string& string) {
+  return span<const uint8_t>(reinterpret_cast<const uint8_t*>(string.data()),
+                             string.size());
+}
+
+}  // namespace
+
 class StoreImplTest : public ::testing::Test {
  protected:
   StoreImplTest()
       : vfs_(DefaultVfs()), data_file_deleter_(kStoreFileName),
         log_file_deleter_(StoreImpl::LogFilePath(kStoreFileName)) { }
 
-  void SetUp() override {
+  void SetUp() override { OpenFiles(); }
+
+  void OpenFiles() {
     Status status;
     BlockAccessFile* raw_data_file;
     std::tie(status, raw_data_file, data_file_size_) = vfs_->OpenForBlockAccess(
@@ -50,6 +69,30 @@ class StoreImplTest : public ::testing::Test {
     pool_ = PoolImpl::Create(options);
   }
 
+  /** Copies a file's content, like a crash would leave it on disk. */
+  void CopyFile(const std::string& from_path, const std::string& to_path) {
+    Status status;
+    RandomAccessFile* raw_from_file;
+    size_t file_size;
+    std::tie(status, raw_from_file, file_size) =
+        vfs_->OpenForRandomAccess(from_path, false, false);
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<RandomAccessFile> from_file(raw_from_file);
+    RandomAccessFile* raw_to_file;
+    std::tie(status, raw_to_file, std::ignore) =
+        vfs_->OpenForRandomAccess(to_path, true, false);
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<RandomAccessFile> to_file(raw_to_file);
+
+    if (file_size == 0)
+      return;
+    std::vector<uint8_t> buffer(file_size);
+    ASSERT_EQ(Status::kSuccess,
+              from_file->Read(0, span<uint8_t>(buffer.data(), file_size)));
+    ASSERT_EQ(Status::kSuccess,
+              to_file->Write(span<const uint8_t>(buffer.data(), file_size), 0));
+  }
+
   Vfs* vfs_;
   // Must precede UniquePtr members, because on Windows all file handles must be
   // closed before the files can be deleted.
@@ -184,4 +227,754 @@ TEST_F(StoreImplTest, CloseUnassignsPages) {
   EXPECT_EQ(0U, page_pool->pinned_pages());
 }
 
+TEST_F(StoreImplTest, ReleasedTransactionsAreRecycled) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  StoreImpl* store = StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions());
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  TransactionImpl* transaction = store->CreateTransaction();
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  transaction->Release();
+  TransactionImpl* recycled_transaction = store->CreateTransaction();
+  EXPECT_EQ(transaction, recycled_transaction);
+  EXPECT_FALSE(recycled_transaction->IsClosed());
+
+  // Closed transactions may be released after their store is released.
+  ASSERT_EQ(Status::kSuccess, recycled_transaction->Commit());
+  TransactionImpl* open_transaction = store->CreateTransaction();
+  EXPECT_NE(recycled_transaction, open_transaction);
+  EXPECT_EQ(Status::kSuccess, store->Close());
+  store->Release();
+  EXPECT_TRUE(open_transaction->IsRolledBack());
+  open_transaction->Release();
+  recycled_transaction->Release();
+}
+
+TEST_F(StoreImplTest, RollbackDiscardsChanges) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  Page* page;
+  std::tie(std::ignore, page) = page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData);
+  ASSERT_TRUE(page != nullptr);
+  uint8_t original_data[1 << kStorePageShift];
+  CopySpan(page->data(1 << kStorePageShift), span<uint8_t>(original_data));
+
+  UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+  transaction->WillModifyPage(page);
+  FillSpan(page->mutable_data(1 << kStorePageShift), 0xAB);
+  page_pool->UnpinStorePage(page);
+  ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+
+  std::tie(std::ignore, page) = page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData);
+  ASSERT_TRUE(page != nullptr);
+  EXPECT_EQ(page->data(1 << kStorePageShift), make_span(original_data));
+  page_pool->UnpinStorePage(page);
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, InitializeReplaysLog) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  {
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Close());
+  }
+
+  // Simulate a crash right after a transaction's log records were synced, but
+  // before its pages made it to the data file.
+  OpenFiles();
+  alignas(8) uint8_t page_buffer[1 << kStorePageShift];
+  ASSERT_EQ(Status::kSuccess,
+            data_file_->Read(0, span<uint8_t>(page_buffer)));
+  StoreHeader header;
+  ASSERT_TRUE(header.Deserialize(span<const uint8_t>(page_buffer)));
+  const uint64_t log_epoch = header.log_epoch;
+  {
+    LogWriter log_writer(log_file_.get(), log_file_size_, kStorePageShift);
+    log_writer.Reset(log_epoch);
+    FillSpan(span<uint8_t>(page_buffer), 0xAB);
+    log_writer.AppendPageImage(1, span<const uint8_t>(page_buffer));
+    log_writer.AppendCommit(1);
+    ASSERT_EQ(Status::kSuccess, log_writer.Flush());
+    // The store's first session already preallocated the log.
+    EXPECT_EQ(log_file_size_, log_writer.file_size());
+  }
+
+  StoreOptions options;
+  options.recovery_thread_count = 2;
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, options));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+
+  Page* page;
+  std::tie(std::ignore, page) = page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData);
+  ASSERT_TRUE(page != nullptr);
+  for (uint8_t byte : page->data(1 << kStorePageShift))
+    ASSERT_EQ(0xAB, byte);
+  page_pool->UnpinStorePage(page);
+
+  // Recovery ends with a checkpoint, which retires the replayed records.
+  std::tie(std::ignore, page) = page_pool->StorePage(
+      store.get(), 0, PagePool::kFetchPageData);
+  ASSERT_TRUE(page != nullptr);
+  ASSERT_TRUE(header.Deserialize(page->data(1 << kStorePageShift)));
+  EXPECT_EQ(log_epoch + 1, header.log_epoch);
+  page_pool->UnpinStorePage(page);
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, CommitsSurviveCrashBeforeFirstCheckpoint) {
+  const std::string kCopyFileName = "test_store_impl_copy.berry";
+  FileDeleter copy_data_file_deleter(kCopyFileName);
+  FileDeleter copy_log_file_deleter(StoreImpl::LogFilePath(kCopyFileName));
+  const std::string key = "key", value = "value";
+
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  {
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    Status status;
+    SpaceImpl* raw_space;
+    std::tie(status, raw_space) = transaction->CreateSpace(
+        store->RootCatalog(), StringSpan("space"), SpaceOptions());
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<SpaceImpl> space(raw_space);
+    ASSERT_EQ(Status::kSuccess,
+              transaction->Put(space.get(), StringSpan(key),
+                               StringSpan(value)));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+    // Copying the files while the store is open simulates a crash.
+    CopyFile(data_file_deleter_.path(), kCopyFileName);
+    CopyFile(log_file_deleter_.path(), StoreImpl::LogFilePath(kCopyFileName));
+    EXPECT_EQ(Status::kSuccess, store->Close());
+  }
+
+  for (bool create_if_missing : {false, true}) {
+    Status status;
+    BlockAccessFile* raw_data_file;
+    std::tie(status, raw_data_file, data_file_size_) = vfs_->OpenForBlockAccess(
+        kCopyFileName, kStorePageShift, false, false);
+    ASSERT_EQ(Status::kSuccess, status);
+    RandomAccessFile* raw_log_file;
+    std::tie(status, raw_log_file, log_file_size_) = vfs_->OpenForRandomAccess(
+        StoreImpl::LogFilePath(kCopyFileName), false, false);
+    ASSERT_EQ(Status::kSuccess, status);
+
+    StoreOptions options;
+    options.create_if_missing = create_if_missing;
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        raw_data_file, data_file_size_, raw_log_file, log_file_size_,
+        page_pool, options));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+
+    SpaceImpl* raw_space;
+    std::tie(status, raw_space) =
+        store->RootCatalog()->OpenSpace(StringSpan("space"));
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<SpaceImpl> space(raw_space);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    span<const uint8_t> stored_value;
+    std::tie(status, stored_value) =
+        transaction->Get(space.get(), StringSpan(key));
+    ASSERT_EQ(Status::kSuccess, status);
+    EXPECT_EQ(value,
+              std::string(reinterpret_cast<const char*>(stored_value.data()),
+                          stored_value.size()));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    EXPECT_EQ(Status::kSuccess, store->Close());
+  }
+}
+
+TEST_F(StoreImplTest, RecoveryKeepsReusedFreePages) {
+  const std::string kCopyFileName = "test_store_impl_copy.berry";
+  FileDeleter copy_data_file_deleter(kCopyFileName);
+  FileDeleter copy_log_file_deleter(StoreImpl::LogFilePath(kCopyFileName));
+  const std::string old_value(5 << kStorePageShift, 'o');
+  const std::string new_value(3 << kStorePageShift, 'n');
+  const std::string last_value(3 << kStorePageShift, 'l');
+
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  {
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    Status status;
+    SpaceImpl* raw_space;
+    std::tie(status, raw_space) = transaction->CreateSpace(
+        store->RootCatalog(), StringSpan("space"), SpaceOptions());
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<SpaceImpl> space(raw_space);
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space.get(), StringSpan("old"), StringSpan(old_value)));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+    transaction.reset(store->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess,
+              transaction->Delete(space.get(), StringSpan("old")));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    space.reset();
+    // Closing the store persists the free page list.
+    EXPECT_EQ(Status::kSuccess, store->Close());
+  }
+
+  OpenFiles();
+  {
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+    const size_t page_count = store->free_page_manager()->page_count();
+    EXPECT_LE(4U, store->free_page_manager()->free_page_count());
+
+    Status status;
+    SpaceImpl* raw_space;
+    std::tie(status, raw_space) =
+        store->RootCatalog()->OpenSpace(StringSpan("space"));
+    ASSERT_EQ(Status::kSuccess, status);
+    UniquePtr<SpaceImpl> space(raw_space);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space.get(), StringSpan("new"), StringSpan(new_value)));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    // The new value was stored in free pages.
+    EXPECT_EQ(page_count, store->free_page_manager()->page_count());
+    space.reset();
+
+    // Copying the files while the store is open simulates a crash.
+    CopyFile(data_file_deleter_.path(), kCopyFileName);
+    CopyFile(log_file_deleter_.path(), StoreImpl::LogFilePath(kCopyFileName));
+    EXPECT_EQ(Status::kSuccess, store->Close());
+  }
+
+  // The checkpointed free page list still has the pages that hold the new
+  // value. Recovery must not hand them out again.
+  Status status;
+  BlockAccessFile* raw_data_file;
+  std::tie(status, raw_data_file, data_file_size_) = vfs_->OpenForBlockAccess(
+      kCopyFileName, kStorePageShift, false, false);
+  ASSERT_EQ(Status::kSuccess, status);
+  RandomAccessFile* raw_log_file;
+  std::tie(status, raw_log_file, log_file_size_) = vfs_->OpenForRandomAccess(
+      StoreImpl::LogFilePath(kCopyFileName), false, false);
+  ASSERT_EQ(Status::kSuccess, status);
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      raw_data_file, data_file_size_, raw_log_file, log_file_size_,
+      page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  SpaceImpl* raw_space;
+  std::tie(status, raw_space) =
+      store->RootCatalog()->OpenSpace(StringSpan("space"));
+  ASSERT_EQ(Status::kSuccess, status);
+  UniquePtr<SpaceImpl> space(raw_space);
+  UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space.get(), StringSpan("last"), StringSpan(last_value)));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  transaction.reset(store->CreateTransaction());
+  span<const uint8_t> stored_value;
+  for (const auto& entry : {std::make_pair("new", &new_value),
+                            std::make_pair("last", &last_value)}) {
+    std::tie(status, stored_value) =
+        transaction->Get(space.get(), StringSpan(entry.first));
+    ASSERT_EQ(Status::kSuccess, status);
+    EXPECT_EQ(*entry.second,
+              std::string(reinterpret_cast<const char*>(stored_value.data()),
+                          stored_value.size()));
+  }
+  std::tie(status, std::ignore) =
+      transaction->Get(space.get(), StringSpan("old"));
+  EXPECT_EQ(Status::kNotFound, status);
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  space.reset();
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, RelaxedCommitDefersPageWrites) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  StoreOptions options;
+  options.relaxed_durability = true;
+  {
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, options));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+    ASSERT_EQ(Status::kSuccess, store->SyncLog());
+    ASSERT_EQ(Status::kSuccess, store->Checkpoint());
+
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    transaction->WillModifyPage(page);
+    FillSpan(page->mutable_data(1 << kStorePageShift), 0xAB);
+    page_pool->UnpinStorePage(page);
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+    // The committed page stays in the pool, and has not been written yet.
+    EXPECT_TRUE(page->is_dirty());
+    EXPECT_EQ(store->init_transaction(), page->transaction());
+    EXPECT_NE(0U, page->commit_lsn());
+    OpenFiles();
+    alignas(8) uint8_t page_buffer[1 << kStorePageShift];
+    ASSERT_EQ(Status::kSuccess, data_file_->Read(
+        1 << kStorePageShift, span<uint8_t>(page_buffer)));
+    EXPECT_NE(0xAB, page_buffer[0]);
+
+    EXPECT_EQ(Status::kSuccess, store->SyncLog());
+    EXPECT_EQ(Status::kSuccess, store->Close());
+    EXPECT_EQ(Status::kAlreadyClosed, store->SyncLog());
+  }
+
+  // Closing the store writes the page.
+  alignas(8) uint8_t page_buffer[1 << kStorePageShift];
+  ASSERT_EQ(Status::kSuccess, data_file_->Read(
+      1 << kStorePageShift, span<uint8_t>(page_buffer)));
+  for (uint8_t byte : page_buffer)
+    ASSERT_EQ(0xAB, byte);
+}
+
+TEST_F(StoreImplTest, CommitAsyncRunsCallbackAfterSync) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  auto count_durable_commits = [](Status status, void* context) {
+    if (status == Status::kSuccess)
+      ++*reinterpret_cast<int*>(context);
+  };
+
+  // Several commits are sequenced without waiting for a sync.
+  int durable_commits = 0;
+  for (size_t page_id : {1, 2, 3}) {
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), page_id, PagePool::kIgnorePageData);
+    ASSERT_TRUE(page != nullptr);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    transaction->WillModifyPage(page);
+    FillSpan(page->mutable_data(1 << kStorePageShift), 0xAB);
+    page_pool->UnpinStorePage(page);
+    ASSERT_EQ(Status::kSuccess, transaction->CommitAsync(
+        count_durable_commits, &durable_commits));
+    EXPECT_TRUE(transaction->IsCommitted());
+    EXPECT_EQ(store->init_transaction(), page->transaction());
+  }
+  EXPECT_EQ(0, durable_commits);
+
+  // A single sync makes all of them durable.
+  ASSERT_EQ(Status::kSuccess, store->SyncLog());
+  EXPECT_EQ(3, durable_commits);
+
+  // Transactions that don't modify any page are durable right away.
+  {
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->CommitAsync(
+        count_durable_commits, &durable_commits));
+    EXPECT_EQ(4, durable_commits);
+    EXPECT_EQ(Status::kAlreadyClosed, transaction->CommitAsync(
+        count_durable_commits, &durable_commits));
+    EXPECT_EQ(4, durable_commits);
+  }
+
+  // Closing the store syncs the log.
+  {
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    transaction->WillModifyPage(page);
+    FillSpan(page->mutable_data(1 << kStorePageShift), 0xCD);
+    page_pool->UnpinStorePage(page);
+    ASSERT_EQ(Status::kSuccess, transaction->CommitAsync(
+        count_durable_commits, &durable_commits));
+  }
+  EXPECT_EQ(4, durable_commits);
+  EXPECT_EQ(Status::kSuccess, store->Close());
+  EXPECT_EQ(5, durable_commits);
+}
+
+TEST_F(StoreImplTest, RollbackRestoresLoggedPage) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  StoreOptions options;
+  options.relaxed_durability = true;
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, options));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+
+  for (uint8_t value : {0xAB, 0xCD}) {
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    transaction->WillModifyPage(page);
+    FillSpan(page->mutable_data(1 << kStorePageShift), value);
+    page_pool->UnpinStorePage(page);
+    if (value == 0xAB)
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    else
+      ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  Page* page;
+  std::tie(std::ignore, page) = page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData);
+  ASSERT_TRUE(page != nullptr);
+  EXPECT_TRUE(page->is_dirty());
+  for (uint8_t byte : page->data(1 << kStorePageShift))
+    ASSERT_EQ(0xAB, byte);
+  page_pool->UnpinStorePage(page);
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, CommitAbsorbsRepeatedPageUpdates) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  {
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Checkpoint());
+
+    for (uint8_t value : {0xAB, 0xCD, 0xEF}) {
+      Page* page;
+      std::tie(std::ignore, page) = page_pool->StorePage(
+          store.get(), 1, PagePool::kFetchPageData);
+      ASSERT_TRUE(page != nullptr);
+      UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+      transaction->WillModifyPage(page);
+      FillSpan(page->mutable_data(1 << kStorePageShift), value);
+      page_pool->UnpinStorePage(page);
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+      // The committed page stays dirty in the pool, and has not been written.
+      EXPECT_TRUE(page->is_dirty());
+      EXPECT_EQ(store->init_transaction(), page->transaction());
+      EXPECT_NE(0U, page->image_lsn());
+    }
+
+    OpenFiles();
+    alignas(8) uint8_t page_buffer[1 << kStorePageShift];
+    ASSERT_EQ(Status::kSuccess, data_file_->Read(
+        1 << kStorePageShift, span<uint8_t>(page_buffer)));
+    for (uint8_t byte : page_buffer)
+      ASSERT_EQ(0, byte);
+
+    EXPECT_EQ(Status::kSuccess, store->Close());
+  }
+
+  // Closing the store checkpoints it, which writes the page's latest content.
+  alignas(8) uint8_t page_buffer[1 << kStorePageShift];
+  ASSERT_EQ(Status::kSuccess, data_file_->Read(
+      1 << kStorePageShift, span<uint8_t>(page_buffer)));
+  for (uint8_t byte : page_buffer)
+    ASSERT_EQ(0xEF, byte);
+}
+
+TEST_F(StoreImplTest, CommitCheckpointsLargeLog) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  StoreOptions options;
+  options.checkpoint_log_size = 1;
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, options));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+  // The bootstrap transaction already triggered a checkpoint.
+  EXPECT_EQ(0U, store->log_writer()->log_size());
+
+  Page* page;
+  std::tie(std::ignore, page) = page_pool->StorePage(
+      store.get(), 1, PagePool::kFetchPageData);
+  ASSERT_TRUE(page != nullptr);
+  UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+  transaction->WillModifyPage(page);
+  FillSpan(page->mutable_data(1 << kStorePageShift), 0xAB);
+  page_pool->UnpinStorePage(page);
+
+  // Checkpoints wait for running transactions.
+  UniquePtr<TransactionImpl> other_transaction(store->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  EXPECT_NE(0U, store->log_writer()->log_size());
+  EXPECT_TRUE(page->is_dirty());
+
+  ASSERT_EQ(Status::kSuccess, other_transaction->Commit());
+  EXPECT_EQ(0U, store->log_writer()->log_size());
+  EXPECT_FALSE(page->is_dirty());
+
+  OpenFiles();
+  alignas(8) uint8_t page_buffer[1 << kStorePageShift];
+  ASSERT_EQ(Status::kSuccess, data_file_->Read(
+      1 << kStorePageShift, span<uint8_t>(page_buffer)));
+  for (uint8_t byte : page_buffer)
+    ASSERT_EQ(0xAB, byte);
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
+TEST_F(StoreImplTest, StolenPages) {
+  for (bool commit : {false, true}) {
+    CreatePool(kStorePageShift, 2);
+    PagePool* page_pool = pool_->page_pool();
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, StoreOptions()));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    const uint8_t base_value = commit ? 0x10 : 0x20;
+    for (size_t page_id = 1; page_id < 4; ++page_id) {
+      Page* page;
+      std::tie(std::ignore, page) = page_pool->StorePage(
+          store.get(), page_id, page_id == 1 ? PagePool::kFetchPageData
+                                             : PagePool::kIgnorePageData);
+      ASSERT_TRUE(page != nullptr);
+      transaction->WillModifyPage(page);
+      FillSpan(page->mutable_data(1 << kStorePageShift),
+               static_cast<uint8_t>(base_value + page_id));
+      page_pool->UnpinStorePage(page);
+    }
+    // The pool only has room for two pages, so page 1 was stolen.
+    EXPECT_TRUE(transaction->HasStolenPage(1));
+
+    if (commit)
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    else
+      ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    const uint8_t expected_value = commit ? base_value + 1 : 0;
+    for (uint8_t byte : page->data(1 << kStorePageShift))
+      ASSERT_EQ(expected_value, byte);
+    page_pool->UnpinStorePage(page);
+
+    EXPECT_EQ(Status::kSuccess, store->Close());
+    OpenFiles();
+  }
+}
+
+TEST_F(StoreImplTest, CompressedLog) {
+  StoreOptions options;
+  options.compress_log = true;
+  if (!kPlatformHasCompression) {
+    CreatePool(kStorePageShift, 16);
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, pool_->page_pool(), options));
+    EXPECT_EQ(Status::kNotSupported, store->Initialize(options));
+    return;
+  }
+
+  // Stolen pages exercise all the paths that log and read back page images.
+  for (bool commit : {false, true}) {
+    CreatePool(kStorePageShift, 2);
+    PagePool* page_pool = pool_->page_pool();
+    UniquePtr<StoreImpl> store(StoreImpl::Create(
+        data_file_.release(), data_file_size_, log_file_.release(),
+        log_file_size_, page_pool, options));
+    ASSERT_EQ(Status::kSuccess, store->Initialize(options));
+    ASSERT_TRUE(store->log_writer()->compresses_page_images());
+
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    const uint8_t base_value = commit ? 0x10 : 0x20;
+    for (size_t page_id = 1; page_id < 4; ++page_id) {
+      Page* page;
+      std::tie(std::ignore, page) = page_pool->StorePage(
+          store.get(), page_id, page_id == 1 ? PagePool::kFetchPageData
+                                             : PagePool::kIgnorePageData);
+      ASSERT_TRUE(page != nullptr);
+      transaction->WillModifyPage(page);
+      FillSpan(page->mutable_data(1 << kStorePageShift),
+               static_cast<uint8_t>(base_value + page_id));
+      page_pool->UnpinStorePage(page);
+    }
+    EXPECT_TRUE(transaction->HasStolenPage(1));
+
+    if (commit)
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    else
+      ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    const uint8_t expected_value = commit ? base_value + 1 : 0;
+    for (uint8_t byte : page->data(1 << kStorePageShift))
+      ASSERT_EQ(expected_value, byte);
+    page_pool->UnpinStorePage(page);
+
+    if (commit) {
+      const LogWriter::CompressionStats stats =
+          store->log_writer()->compression_stats();
+      EXPECT_LT(0U, stats.page_count);
+      EXPECT_GT(stats.page_count * LogFormat::PageImageRecordSize(
+                                       kStorePageShift),
+                stats.record_bytes);
+    }
+
+    EXPECT_EQ(Status::kSuccess, store->Close());
+    OpenFiles();
+  }
+}
+
+TEST_F(StoreImplTest, ReadTransactionsSeeSnapshots) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+
+  UniquePtr<ReadTransactionImpl> old_reader(store->CreateReadTransaction());
+  for (uint8_t value : {0xAB, 0xCD}) {
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction());
+    transaction->WillModifyPage(page);
+    FillSpan(page->mutable_data(1 << kStorePageShift), value);
+    page_pool->UnpinStorePage(page);
+
+    // Uncommitted changes are not visible to readers.
+    UniquePtr<ReadTransactionImpl> reader(store->CreateReadTransaction());
+    Status status;
+    span<const uint8_t> data;
+    std::tie(status, data) = reader->ReadPage(1);
+    ASSERT_EQ(Status::kSuccess, status);
+    ASSERT_EQ(1U << kStorePageShift, data.size());
+    EXPECT_NE(value, data[0]);
+
+    if (value == 0xAB)
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    else
+      ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+
+  Status status;
+  span<const uint8_t> data;
+  std::tie(status, data) = old_reader->ReadPage(1);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(0, data[0]);
+
+  UniquePtr<ReadTransactionImpl> new_reader(store->CreateReadTransaction());
+  std::tie(status, data) = new_reader->ReadPage(1);
+  ASSERT_EQ(Status::kSuccess, status);
+  for (uint8_t byte : data)
+    ASSERT_EQ(0xAB, byte);
+
+  // The old content is freed when the last reader that can see it is gone.
+  EXPECT_EQ(1U, store->page_versions()->version_count());
+  old_reader.reset();
+  EXPECT_EQ(0U, store->page_versions()->version_count());
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+  EXPECT_EQ(Status::kAlreadyClosed, std::get<0>(new_reader->ReadPage(1)));
+}
+
+TEST_F(StoreImplTest, OptimisticTransactions) {
+  CreatePool(kStorePageShift, 16);
+  PagePool* page_pool = pool_->page_pool();
+  UniquePtr<StoreImpl> store(StoreImpl::Create(
+      data_file_.release(), data_file_size_, log_file_.release(),
+      log_file_size_, page_pool, StoreOptions()));
+  ASSERT_EQ(Status::kSuccess, store->Initialize(StoreOptions()));
+  constexpr size_t kPageSize = 1 << kStorePageShift;
+
+  TransactionOptions options;
+  options.optimistic = true;
+  for (bool has_conflict : {true, false}) {
+    UniquePtr<TransactionImpl> transaction(store->CreateTransaction(options));
+    EXPECT_TRUE(transaction->is_optimistic());
+
+    Page* page;
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 1, PagePool::kFetchPageData);
+    ASSERT_TRUE(page != nullptr);
+    const uint8_t old_value = transaction->PageData(page, kPageSize)[0];
+    page_pool->UnpinStorePage(page);
+
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 2, PagePool::kIgnorePageData);
+    ASSERT_TRUE(page != nullptr);
+    FillSpan(transaction->MutablePageData(page, kPageSize), old_value + 1);
+    // The change is private until the transaction commits.
+    EXPECT_EQ(old_value + 1, transaction->PageData(page, kPageSize)[0]);
+    EXPECT_NE(old_value + 1, page->data(kPageSize)[0]);
+    page_pool->UnpinStorePage(page);
+
+    if (has_conflict) {
+      std::tie(std::ignore, page) = page_pool->StorePage(
+          store.get(), 1, PagePool::kFetchPageData);
+      ASSERT_TRUE(page != nullptr);
+      UniquePtr<TransactionImpl> writer(store->CreateTransaction());
+      FillSpan(writer->MutablePageData(page, kPageSize), 0xAB);
+      page_pool->UnpinStorePage(page);
+      ASSERT_EQ(Status::kSuccess, writer->Commit());
+
+      EXPECT_EQ(Status::kConflict, transaction->Commit());
+      EXPECT_TRUE(transaction->IsRolledBack());
+    } else {
+      ASSERT_EQ(Status::kSuccess, transaction->Commit());
+    }
+
+    // Page 2 is past the end of the data file, so its only copy is in the pool.
+    std::tie(std::ignore, page) = page_pool->StorePage(
+        store.get(), 2, PagePool::kIgnorePageData);
+    ASSERT_TRUE(page != nullptr);
+    if (has_conflict) {
+      EXPECT_NE(old_value + 1, page->data(kPageSize)[0]);
+    } else {
+      for (uint8_t byte : page->data(kPageSize))
+        ASSERT_EQ(old_value + 1, byte);
+    }
+    page_pool->UnpinStorePage(page);
+  }
+
+  EXPECT_EQ(Status::kSuccess, store->Close());
+}
+
 }  // namespace berrydb
@@ -0,0 +1,134 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./space_helpers.h"
+
+#include <tuple>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/catalog.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/status.h"
+#include "berrydb/transaction.h"
+#include "../free_page_manager.h"
+#include "../store_impl.h"
+
+namespace berrydb {
+
+namespace {
+
+template <typename TransactionType>
+std::string SpaceGetImpl(TransactionType* transaction, Space* space,
+                         span<const uint8_t> key) {
+  Status status;
+  span<const uint8_t> value;
+  std::tie(status, value) = transaction->Get(space, key);
+  if (status == Status::kNotFound)
+    return "(missing)";
+  EXPECT_EQ(Status::kSuccess, status);
+  return SpanString(value);
+}
+
+}  // namespace
+
+span<const uint8_t> StringSpan(const std::string& string) {
+  return span<const uint8_t>(reinterpret_cast<const uint8_t*>(string.data()),
+                             string.size());
+}
+
+std::string SpanString(span<const uint8_t> data) {
+  return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+std::string SpaceGet(Transaction* transaction, Space* space,
+                     span<const uint8_t> key) {
+  return SpaceGetImpl(transaction, space, key);
+}
+
+std::string SpaceGet(ReadTransaction* transaction, Space* space,
+                     span<const uint8_t> key) {
+  return SpaceGetImpl(transaction, space, key);
+}
+
+std::string RandomValue(std::mt19937* rnd, size_t size) {
+  std::string value(size, ' ');
+  for (char& c : value)
+    c = static_cast<char>('a' + (*rnd)() % 26);
+  return value;
+}
+
+void ExpectSpaceMatches(Store* store, Space* space,
+                        const std::map<std::string, std::string>& expected,
+                        const std::vector<std::string>& missing_keys) {
+  UniquePtr<ReadTransaction> reader(store->CreateReadTransaction());
+  for (const auto& entry : expected) {
+    ASSERT_EQ(entry.second,
+              SpaceGet(reader.get(), space, StringSpan(entry.first)))
+        << entry.first;
+  }
+  for (const std::string& key : missing_keys) {
+    if (expected.count(key) == 0) {
+      ASSERT_EQ("(missing)", SpaceGet(reader.get(), space, StringSpan(key)))
+          << key;
+    }
+  }
+}
+
+constexpr size_t SpaceTest::kPageShift;
+
+SpaceTest::SpaceTest(const std::string& file_name)
+    : data_file_deleter_(file_name),
+      log_file_deleter_(Store::LogFilePath(file_name)) {}
+
+void SpaceTest::SetUp() { CreatePool(kPageShift, 64); }
+
+void SpaceTest::CreatePool(size_t page_shift, size_t page_capacity) {
+  PoolOptions options;
+  options.page_shift = page_shift;
+  options.page_pool_size = page_capacity;
+  pool_ = Pool::Create(options);
+}
+
+void SpaceTest::OpenStore() {
+  Status status;
+  Store* raw_store;
+  std::tie(status, raw_store) =
+      pool_->OpenStore(data_file_deleter_.path(), store_options_);
+  ASSERT_EQ(Status::kSuccess, status);
+  store_.reset(raw_store);
+}
+
+void SpaceTest::CreateSpace(const std::string& name) {
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan(name), space_options_);
+  ASSERT_EQ(Status::kSuccess, status);
+  space_.reset(raw_space);
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+void SpaceTest::OpenSpace(const std::string& name) {
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) =
+      store_->RootCatalog()->OpenSpace(StringSpan(name));
+  ASSERT_EQ(Status::kSuccess, status);
+  space_.reset(raw_space);
+}
+
+void SpaceTest::ExpectSpaceMatches(
+    const std::map<std::string, std::string>& expected,
+    const std::vector<std::string>& missing_keys) {
+  berrydb::ExpectSpaceMatches(store_.get(), space_.get(), expected,
+                              missing_keys);
+}
+
+size_t SpaceTest::StorePageCount() {
+  return StoreImpl::FromApi(store_.get())->free_page_manager()->page_count();
+}
+
+}  // namespace berrydb
@@ -0,0 +1,113 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_TEST_SPACE_HELPERS_H_
+#define BERRYDB_TEST_SPACE_HELPERS_H_
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/options.h"
+#include "berrydb/pool.h"
+#include "berrydb/space.h"
+#include "berrydb/span.h"
+#include "berrydb/store.h"
+#include "berrydb/types.h"
+#include "./file_deleter.h"
+#include "../util/unique_ptr.h"
+
+namespace berrydb {
+
+class ReadTransaction;
+class Transaction;
+
+/** The bytes of a string, for passing keys and values to the API. */
+span<const uint8_t> StringSpan(const std::string& string);
+
+/** A copy of the bytes in a span. */
+std::string SpanString(span<const uint8_t> data);
+
+/** The value of a key in a space, or "(missing)" if the key doesn't exist.
+ *
+ * Errors other than kNotFound are reported as test failures. */
+std::string SpaceGet(Transaction* transaction, Space* space,
+                     span<const uint8_t> key);
+std::string SpaceGet(ReadTransaction* transaction, Space* space,
+                     span<const uint8_t> key);
+
+/** A value of the given size, with random lowercase letters. */
+std::string RandomValue(std::mt19937* rnd, size_t size);
+
+/** Checks that a space's committed content matches a map.
+ *
+ * @param store        the store that holds the space
+ * @param space        the space whose content is checked
+ * @param expected     the keys that must exist, and their values
+ * @param missing_keys keys that must not exist, unless they are in expected
+ */
+void ExpectSpaceMatches(Store* store, Space* space,
+                        const std::map<std::string, std::string>& expected,
+                        const std::vector<std::string>& missing_keys);
+
+/** Base for fixtures that exercise a space in a store created by each test.
+ *
+ * SetUp() creates a pool of 64 pages of 4 KB. Tests open the store with
+ * OpenStore(), and create or open the space under test with CreateSpace() or
+ * OpenSpace(). Derived fixtures customize the store and the spaces they create
+ * by changing store_options_ and space_options_.
+ */
+class SpaceTest : public ::testing::Test {
+ protected:
+  /** @param file_name the store's data file; removed before and after tests */
+  explicit SpaceTest(const std::string& file_name);
+
+  void SetUp() override;
+
+  /** Replaces the pool. The store and space must not be open. */
+  void CreatePool(size_t page_shift, size_t page_capacity);
+
+  /** Opens the store, creating it if it doesn't exist. */
+  void OpenStore();
+
+  /** Creates a space in the root catalog, and commits its creation. */
+  void CreateSpace(const std::string& name);
+
+  /** Opens a space in the root catalog. */
+  void OpenSpace(const std::string& name);
+
+  /** The value of a key, or "(missing)". */
+  template <typename TransactionType>
+  std::string Get(TransactionType* transaction, const std::string& key) {
+    return SpaceGet(transaction, space_.get(), StringSpan(key));
+  }
+
+  /** Checks that the space's committed content matches a map. */
+  void ExpectSpaceMatches(const std::map<std::string, std::string>& expected,
+                          const std::vector<std::string>& missing_keys);
+
+  /** The number of pages used by the store's data file. */
+  size_t StorePageCount();
+
+  static constexpr size_t kPageShift = 12;
+
+  // Must precede UniquePtr members, because on Windows all file handles must be
+  // closed before the files can be deleted.
+  FileDeleter data_file_deleter_, log_file_deleter_;
+
+  std::unique_ptr<Pool> pool_;
+  UniquePtr<Store> store_;
+  UniquePtr<Space> space_;
+  StoreOptions store_options_;
+  SpaceOptions space_options_;
+  std::mt19937 rnd_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_TEST_SPACE_HELPERS_H_
@@ -4,14 +4,28 @@
 
 #include "./transaction_impl.h"
 
+#include <algorithm>
+#include <vector>
+
+#include "berrydb/options.h"
 #include "berrydb/platform.h"
 #include "berrydb/status.h"
+#include "./bloom_filter.h"
+#include "./btree.h"
+#include "./catalog_impl.h"
+#include "./format/log_format.h"
+#include "./hash_table.h"
+#include "./integer_btree.h"
+#include "./log_writer.h"
 #include "./page_pool.h"
+#include "./page_versions.h"
+#include "./space_impl.h"
 #include "./store_impl.h"
 #include "./util/checks.h"
-
-// TODO(pwnall): Remove this once we don't need to CHECK a Status value.
-#include "berrydb/ostream_ops.h"
+#include "./util/platform_allocator.h"
+#include "./util/span_util.h"
+#include "./value_log.h"
+#include "./write_batch_impl.h"
 
 namespace berrydb {
 
@@ -19,21 +33,141 @@ static_assert(std::is_standard_layout<TransactionImpl>::value,
     "TransactionImpl must be a standard layout type so its public API can be "
     "exposed cheaply");
 
-TransactionImpl* TransactionImpl::Create(StoreImpl* store) {
-  void* const heap_block = Allocate(sizeof(TransactionImpl));
-  TransactionImpl* const transaction = new (heap_block) TransactionImpl(store);
+namespace {
+
+/** The root pages of catalogs whose pages will be freed. */
+using CatalogRootIds = std::vector<size_t, PlatformAllocator<size_t>>;
+
+/** Frees the pages of a space removed from its catalog.
+ *
+ * Catalog entries are queued up instead, because they are freed together with
+ * the entries that they hold.
+ *
+ * @param  transaction      the transaction that removes the entry
+ * @param  entry            the removed entry
+ * @param  catalog_root_ids receives the root page of a removed catalog
+ * @return                  kSuccess, kDataCorrupted, or an I/O error
+ */
+Status FreeEntry(TransactionImpl* transaction, span<const uint8_t> entry,
+                 CatalogRootIds* catalog_root_ids) {
+  Status status;
+  CatalogImpl::EntryType type;
+  size_t root_page_id;
+  BloomFilter filter;
+  ValueLog value_log;
+  std::tie(status, type, root_page_id, filter, value_log) =
+      CatalogImpl::DecodeEntry(entry);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (UNLIKELY(BTree::CheckedChildId(transaction->store(), root_page_id) == 0))
+    return Status::kDataCorrupted;
+
+  switch (type) {
+    case CatalogImpl::EntryType::kCatalog:
+      catalog_root_ids->push_back(root_page_id);
+      return Status::kSuccess;
+    case CatalogImpl::EntryType::kHashedSpace:
+      status = HashTable(root_page_id).Free(transaction);
+      break;
+    case CatalogImpl::EntryType::kInteger32Space:
+      status = IntegerBTree<uint32_t>(root_page_id).Free(transaction);
+      break;
+    case CatalogImpl::EntryType::kInteger64Space:
+      status = IntegerBTree<uint64_t>(root_page_id).Free(transaction);
+      break;
+    default:
+      status = BTree(root_page_id, value_log,
+                     type == CatalogImpl::EntryType::kBufferedSpace)
+          .Free(transaction);
+      break;
+  }
+  if (LIKELY(status == Status::kSuccess) && filter.exists())
+    status = filter.Free(transaction);
+  if (LIKELY(status == Status::kSuccess) && value_log.exists())
+    status = value_log.Free(transaction);
+  return status;
+}
+
+/** Frees the pages of a catalog or space removed from its catalog.
+ *
+ * A catalog is freed together with all the catalogs and spaces that it holds.
+ * Nested catalogs are handled using a work list instead of recursion, so deep
+ * hierarchies don't overflow the stack.
+ *
+ * @param  transaction the transaction that removes the entry
+ * @param  entry       the removed entry
+ * @return             kSuccess, kDataCorrupted, or an I/O error
+ */
+Status FreeEntryTree(TransactionImpl* transaction, span<const uint8_t> entry) {
+  CatalogRootIds catalog_root_ids;
+  Status status = FreeEntry(transaction, entry, &catalog_root_ids);
+  while (LIKELY(status == Status::kSuccess) && !catalog_root_ids.empty()) {
+    const BTree catalog_tree(catalog_root_ids.back());
+    catalog_root_ids.pop_back();
+
+    struct Context {
+      TransactionImpl* transaction;
+      const BTree* catalog_tree;
+      CatalogRootIds* catalog_root_ids;
+      BTree::ValueBuffer entry;
+    } context = {transaction, &catalog_tree, &catalog_root_ids,
+                 BTree::ValueBuffer()};
+    status = catalog_tree.ForEachKey(
+        transaction,
+        [](void* raw_context, span<const uint8_t> key) {
+          Context* const context = reinterpret_cast<Context*>(raw_context);
+          const Status get_status = context->catalog_tree->Get(
+              context->transaction, key, &context->entry);
+          if (UNLIKELY(get_status != Status::kSuccess))
+            return get_status;
+          return FreeEntry(context->transaction,
+                           span<const uint8_t>(context->entry.data(),
+                                               context->entry.size()),
+                           context->catalog_root_ids);
+        },
+        &context);
+    if (LIKELY(status == Status::kSuccess))
+      status = catalog_tree.Free(transaction);
+  }
+  return status;
+}
+
+}  // namespace
+
+TransactionImpl* TransactionImpl::Create(StoreImpl* store,
+                                         const TransactionOptions& options) {
+  void* heap_block = store->TakeTransactionBlock();
+  if (heap_block == nullptr)
+    heap_block = Allocate(sizeof(TransactionImpl));
+  TransactionImpl* const transaction =
+      new (heap_block) TransactionImpl(store, options);
   BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(transaction));
   return transaction;
 }
 
 void TransactionImpl::Release() {
+  // The rollback must happen before the store is notified, because it moves the
+  // transaction to the store's list of closed transactions.
+  if (!is_closed_)
+    Rollback();
+
+  StoreImpl* const store = is_store_closed_ ? nullptr : store_;
+  if (store != nullptr)
+    store->TransactionReleased(this);
+
   this->~TransactionImpl();
   void* const heap_block = static_cast<void*>(this);
-  Deallocate(heap_block, sizeof(TransactionImpl));
+  if (store != nullptr)
+    store->RecycleTransactionBlock(heap_block);
+  else
+    Deallocate(heap_block, sizeof(TransactionImpl));
 }
 
-TransactionImpl::TransactionImpl(StoreImpl* store)
-    : store_(store)
+TransactionImpl::TransactionImpl(StoreImpl* store,
+                                 const TransactionOptions& options)
+    : store_(store),
+      start_commit_timestamp_(store->last_commit_timestamp()),
+      is_optimistic_(options.optimistic)
 #if BERRYDB_CHECK_IS_ON()
     , is_init_(false)
 #endif  // BERRYDB_CHECK_IS_ON()
@@ -42,7 +176,7 @@ TransactionImpl::TransactionImpl(StoreImpl* store)
 }
 
 TransactionImpl::TransactionImpl(StoreImpl* store, MAYBE_UNUSED bool is_init)
-    : store_(store)
+    : store_(store), start_commit_timestamp_(0), is_optimistic_(false)
 #if BERRYDB_CHECK_IS_ON()
     , is_init_(true)
 #endif  // BERRYDB_CHECK_IS_ON()
@@ -70,28 +204,207 @@ bool TransactionImpl::IsInit() const noexcept {
 #endif  // BERRYDB_CHECK_IS_ON()
 
 std::tuple<Status, span<const uint8_t>> TransactionImpl::Get(
-    MAYBE_UNUSED SpaceImpl* space, MAYBE_UNUSED span<const uint8_t> key) {
+    SpaceImpl* space, span<const uint8_t> key) {
   if (UNLIKELY(is_closed_))
     return {Status::kAlreadyClosed, span<const uint8_t>()};
 
-  return {Status::kIoError, span<const uint8_t>()};
+  const Status lock_status = LockForRead(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return {lock_status, span<const uint8_t>()};
+
+  const Status status = space->Get(this, key, &value_buffer_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, span<const uint8_t>()};
+  return {Status::kSuccess,
+          span<const uint8_t>(value_buffer_.data(), value_buffer_.size())};
 }
 
-Status TransactionImpl::Put(MAYBE_UNUSED SpaceImpl* space,
-                            MAYBE_UNUSED span<const uint8_t> key,
-                            MAYBE_UNUSED span<const uint8_t> value) {
+Status TransactionImpl::Get(SpaceImpl* space, span<const uint8_t> key,
+                            PinnedValue* value) {
   if (UNLIKELY(is_closed_))
     return Status::kAlreadyClosed;
 
-  return Status::kIoError;
+  const Status lock_status = LockForRead(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  return space->Get(this, key, value);
 }
 
-Status TransactionImpl::Delete(MAYBE_UNUSED SpaceImpl* space,
-                               MAYBE_UNUSED span<const uint8_t> key) {
+Status TransactionImpl::MultiGet(SpaceImpl* space,
+                                 span<const span<const uint8_t>> keys,
+                                 span<Status> statuses,
+                                 span<PinnedValue> values) {
   if (UNLIKELY(is_closed_))
     return Status::kAlreadyClosed;
 
-  return Status::kIoError;
+  const Status lock_status = LockForRead(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  return space->MultiGet(this, keys, statuses, values);
+}
+
+std::tuple<Status, size_t> TransactionImpl::ReadValue(
+    SpaceImpl* space, span<const uint8_t> key, size_t offset,
+    span<uint8_t> buffer) {
+  if (UNLIKELY(is_closed_))
+    return {Status::kAlreadyClosed, 0};
+
+  const Status lock_status = LockForRead(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return {lock_status, 0};
+
+  return space->ReadValue(this, key, offset, buffer);
+}
+
+Status TransactionImpl::Put(SpaceImpl* space, span<const uint8_t> key,
+                            span<const uint8_t> value) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  const Status lock_status = LockForWrite(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  return space->Put(this, key, value);
+}
+
+Status TransactionImpl::ReserveValue(SpaceImpl* space, span<const uint8_t> key,
+                                     size_t value_size) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  const Status lock_status = LockForWrite(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  return space->ReserveValue(this, key, value_size);
+}
+
+Status TransactionImpl::WriteValue(SpaceImpl* space, span<const uint8_t> key,
+                                   size_t offset, span<const uint8_t> data) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  const Status lock_status = LockForWrite(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  return space->WriteValue(this, key, offset, data);
+}
+
+Status TransactionImpl::Delete(SpaceImpl* space, span<const uint8_t> key) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  const Status lock_status = LockForWrite(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  // Deleting a missing key is not an error.
+  const Status status = space->Delete(this, key);
+  if (status == Status::kNotFound)
+    return Status::kSuccess;
+  return status;
+}
+
+Status TransactionImpl::Write(WriteBatchImpl* batch) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  // The operations on each space are applied together, in key order. B+tree
+  // spaces apply consecutive operations on the same leaf without descending
+  // the tree again. All the modified pages are logged together when the
+  // transaction commits.
+  std::vector<WriteBatchImpl::Operation,
+              PlatformAllocator<WriteBatchImpl::Operation>> operations;
+  batch->SortedOperations(&operations);
+  size_t begin = 0;
+  while (begin < operations.size()) {
+    SpaceImpl* const space = operations[begin].space;
+    size_t end = begin + 1;
+    while (end < operations.size() && operations[end].space == space)
+      ++end;
+
+    Status status = LockForWrite(space);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    status = space->ApplyBatch(
+        this, span<const WriteBatchImpl::Operation>(&operations[begin],
+                                                    end - begin));
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    begin = end;
+  }
+  return Status::kSuccess;
+}
+
+Status TransactionImpl::BulkLoad(SpaceImpl* space, BulkLoadSource source,
+                                 void* context) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  // Bulk loading builds BTree nodes bottom-up, from sorted keys.
+  if (UNLIKELY(!space->has_btree()))
+    return Status::kNotSupported;
+
+  // The space lock gives pessimistic transactions exclusive access to the
+  // space while its tree is built.
+  Status status = LockForWrite(space);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  status = space->tree()->BulkLoad(this, source, context);
+  if (UNLIKELY(status != Status::kSuccess) || !space->has_filter())
+    return status;
+
+  // The builder writes the tree's pages directly, so the loaded keys must be
+  // added to the filter separately.
+  return space->RebuildFilter(this);
+}
+
+Status TransactionImpl::RebuildFilter(SpaceImpl* space) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  if (UNLIKELY(!space->has_filter()))
+    return Status::kNotSupported;
+
+  // Like bulk loading, rebuilding reads every key in the space, which the space
+  // lock keeps other pessimistic transactions from changing.
+  const Status lock_status = LockForWrite(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+  return space->RebuildFilter(this);
+}
+
+Status TransactionImpl::CompactValueLog(SpaceImpl* space) {
+  if (UNLIKELY(is_closed_))
+    return Status::kAlreadyClosed;
+
+  if (UNLIKELY(!space->has_value_log()))
+    return Status::kNotSupported;
+
+  // Compaction rewrites the entries of arbitrary keys, so it needs exclusive
+  // access to the space, like rebuilding a filter.
+  const Status lock_status = LockForWrite(space);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+  return space->tree()->CompactValueLog(this);
+}
+
+Status TransactionImpl::LockForRead(const void* space) {
+  if (is_optimistic_)
+    return Status::kSuccess;
+  return store_->lock_manager()->Lock(
+      &lock_owner_, LockManager::SpaceId(space), LockManager::Mode::kShared);
+}
+
+Status TransactionImpl::LockForWrite(const void* space) {
+  if (is_optimistic_)
+    return Status::kSuccess;
+  return store_->lock_manager()->Lock(
+      &lock_owner_, LockManager::SpaceId(space), LockManager::Mode::kExclusive);
 }
 
 Status TransactionImpl::Close() {
@@ -100,30 +413,348 @@ Status TransactionImpl::Close() {
   is_closed_ = true;
 
   // Unassign the pages that are assigned to this transaction.
+  Status status = Status::kSuccess;
 
   PagePool* const page_pool = store_->page_pool();
   page_pool->PinTransactionPages(&pool_pages_);
 
+  PageVersions* const page_versions = store_->page_versions();
+  const size_t page_size = page_pool->page_size();
+  const uint64_t last_commit_timestamp = store_->last_commit_timestamp();
+  TransactionImpl* const init_transaction = store_->init_transaction();
+
   // We cannot use C++11's range-based for loop because the iterator would get
   // invalidated when we remove the page it's pointing to from the list.
   for (auto it = pool_pages_.begin(); it != pool_pages_.end(); ) {
     Page* page = *it;
     ++it;
-    page_pool->UnassignPageFromStore(page);
+    // Committed transactions have no pages left at this point. The pages of
+    // rolled back transactions hold uncommitted changes, which are undone.
+    if (this != init_transaction) {
+      // The committed content saved before the page was modified is visible
+      // right after the last commit. Restoring it keeps the pool entry, which
+      // may be pinned by read transactions.
+      const span<const uint8_t> committed_data =
+          page_versions->Find(page->page_id(), last_commit_timestamp);
+      if (!committed_data.empty()) {
+        {
+          ExclusiveLatchGuard latch_guard(page->latch());
+          CopySpan(committed_data, page->mutable_data(page_size));
+        }
+        // Pages that hold logged changes which haven't made it to the data file
+        // stay dirty.
+        if (page->image_lsn() != 0)
+          PageWasLogged(page, init_transaction);
+        else
+          PageWasPersisted(page, init_transaction);
+        page_pool->UnpinStorePage(page);
+        continue;
+      }
+    }
+
+    // Without a saved version, the pages are discarded. Pages that hold logged
+    // changes get their committed content back from the log.
+    if (page->image_lsn() != 0 && this != init_transaction) {
+      const Status restore_status = store_->RestoreLoggedPage(page);
+      if (LIKELY(restore_status == Status::kSuccess)) {
+        PageWasLogged(page, init_transaction);
+        page_pool->UnpinStorePage(page);
+        continue;
+      }
+      if (status == Status::kSuccess)
+        status = restore_status;
+    }
+    page_pool->DiscardPageFromStore(page);
     page_pool->UnpinUnassignedPage(page);
   }
 
+  // Committed transactions have no stolen pages left at this point either. The
+  // data file copies of the pages stolen from rolled back transactions hold
+  // uncommitted changes, and are overwritten with the committed content.
+  for (const StolenPage& stolen_page : stolen_pages_) {
+    // Pages that did not exist in the data file have no committed content.
+    if (stolen_page.image_lsn == 0)
+      continue;
+    const Status restore_status = store_->RestoreStolenPage(
+        stolen_page.page_id, stolen_page.image_lsn);
+    if (UNLIKELY(restore_status != Status::kSuccess) &&
+        status == Status::kSuccess) {
+      status = restore_status;
+    }
+  }
+  stolen_pages_.clear();
+
+  // Transactions whose pages were persisted without being logged don't get a
+  // timestamp in Commit(). The timestamp orders the transaction's changes
+  // against read snapshots.
+  if (is_committed_ && commit_timestamp_ == 0 &&
+      (!saved_versions_.empty() || !freed_page_runs_.empty())) {
+    commit_timestamp_ = store_->AdvanceCommitTimestamp();
+  }
+
+  // The saved versions must be finalized after the pages are restored, because
+  // restoring reads them.
+  if (!saved_versions_.empty()) {
+    if (is_committed_) {
+      for (PageVersion* version : saved_versions_)
+        page_versions->Commit(version, commit_timestamp_);
+    } else {
+      for (PageVersion* version : saved_versions_)
+        page_versions->Discard(version);
+    }
+    saved_versions_.clear();
+  }
+
+  if (!page_writes_.empty()) {
+    for (const auto& page_write : page_writes_)
+      Deallocate(page_write.second, page_size);
+    page_writes_.clear();
+  }
+  page_reads_.clear();
+
+  if (!allocated_page_runs_.empty() || !freed_page_runs_.empty()) {
+    store_->free_page_manager()->TransactionClosed(this);
+    allocated_page_runs_.clear();
+    freed_page_runs_.clear();
+  }
+
+  // Strict two-phase locking: the locks are only released after the changes
+  // are committed or undone.
+  if (lock_owner_.lock_count() != 0)
+    store_->lock_manager()->UnlockAll(&lock_owner_);
+
   store_->TransactionClosed(this);
+  return status;
+}
+
+void TransactionImpl::SaveCommittedContent(Page* page) {
+  BERRYDB_ASSUME(page != nullptr);
+  BERRYDB_ASSUME_NE(page->transaction(), this);
+
+  // A stolen page that was fetched again holds this transaction's changes. Its
+  // committed content was saved before it was modified for the first time.
+  if (!stolen_pages_.empty() && HasStolenPage(page->page_id()))
+    return;
+
+  const size_t page_size = store_->page_pool()->page_size();
+  SharedLatchGuard latch_guard(page->latch());
+  saved_versions_.push_back(store_->page_versions()->Save(
+      page->page_id(), page->data(page_size)));
+}
+
+span<const uint8_t> TransactionImpl::OptimisticPageData(Page* page,
+                                                       size_t page_size) {
+  BERRYDB_ASSUME(is_optimistic_);
+  BERRYDB_ASSUME_NE(page->transaction(), this);
+
+  const size_t page_id = page->page_id();
+  const auto it = page_writes_.find(page_id);
+  if (it != page_writes_.end())
+    return span<const uint8_t>(it->second, page_size);
+
+  // Consecutive reads of the same page are common, and are only recorded once.
+  // Other duplicates are harmless.
+  if (page_reads_.empty() || page_reads_.back().page_id != page_id)
+    page_reads_.push_back({page_id, page->commit_timestamp()});
+
+  // A page modified by a running transaction holds uncommitted changes. Its
+  // committed content was saved as a version.
+  if (page->transaction() != store_->init_transaction()) {
+    const span<const uint8_t> committed_data = store_->page_versions()->Find(
+        page_id, store_->last_commit_timestamp());
+    if (!committed_data.empty())
+      return committed_data;
+  }
+  return page->data(page_size);
+}
+
+span<uint8_t> TransactionImpl::OptimisticMutablePageData(Page* page,
+                                                        size_t page_size) {
+  BERRYDB_ASSUME(is_optimistic_);
+
+  const auto it = page_writes_.find(page->page_id());
+  if (it != page_writes_.end())
+    return span<uint8_t>(it->second, page_size);
+
+  // The private copy starts out with the data seen by the transaction, so the
+  // page counts as read.
+  const span<const uint8_t> page_data = OptimisticPageData(page, page_size);
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  const span<uint8_t> buffer_span(buffer, page_size);
+  CopySpan(page_data, buffer_span);
+  page_writes_.emplace(page->page_id(), buffer);
+  return buffer_span;
+}
+
+span<uint8_t> TransactionImpl::OptimisticNewPageData(Page* page,
+                                                    size_t page_size) {
+  BERRYDB_ASSUME(is_optimistic_);
+
+  const auto it = page_writes_.find(page->page_id());
+  if (it != page_writes_.end())
+    return span<uint8_t>(it->second, page_size);
+
+  // The caller overwrites the page, so its current content is not copied.
+  uint8_t* const buffer = reinterpret_cast<uint8_t*>(Allocate(page_size));
+  page_writes_.emplace(page->page_id(), buffer);
+  return span<uint8_t>(buffer, page_size);
+}
+
+Status TransactionImpl::ValidatePageReads() const noexcept {
+  BERRYDB_ASSUME(is_optimistic_);
+
+  PagePool* const page_pool = store_->page_pool();
+  TransactionImpl* const init_transaction = store_->init_transaction();
+  for (const PageRead& page_read : page_reads_) {
+    // Pages that are fetched from the data file get the eviction watermark as
+    // their commit timestamp, which can be newer than their content. The data
+    // read by the transaction is at least as new as its start, so the page was
+    // only modified after it was read if its timestamp passed both bounds.
+    const uint64_t read_timestamp =
+        std::max(page_read.commit_timestamp, start_commit_timestamp_);
+
+    const Page* const page =
+        page_pool->CachedStorePage(store_, page_read.page_id);
+    if (page == nullptr) {
+      // The page left the pool, so its commit timestamp is gone. The newest
+      // timestamp of the pages that left the pool is a safe upper bound.
+      if (store_->evicted_commit_timestamp() > read_timestamp)
+        return Status::kConflict;
+      continue;
+    }
+
+    // Pages modified by running transactions are treated as conflicts, because
+    // the changes may be committed before this transaction's changes.
+    if (page->transaction() != init_transaction ||
+        page->commit_timestamp() > read_timestamp) {
+      return Status::kConflict;
+    }
+  }
+  return Status::kSuccess;
+}
+
+Status TransactionImpl::InstallPageWrites() {
+  BERRYDB_ASSUME(is_optimistic_);
+
+  PagePool* const page_pool = store_->page_pool();
+  const size_t page_size = page_pool->page_size();
+  for (const auto& page_write : page_writes_) {
+    // The page's data is fetched, because WillModifyPage() saves the committed
+    // content for readers. Pages past the end of the data file that aren't
+    // cached have no committed content.
+    const PagePool::PageFetchMode fetch_mode =
+        page_write.first < store_->data_page_count()
+            ? PagePool::kFetchPageData : PagePool::kIgnorePageData;
+    Status status;
+    Page* page;
+    std::tie(status, page) =
+        page_pool->StorePage(store_, page_write.first, fetch_mode);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+
+    WillModifyPage(page);
+    {
+      ExclusiveLatchGuard latch_guard(page->latch());
+      CopySpan(span<const uint8_t>(page_write.second, page_size),
+               page->mutable_data(page_size));
+    }
+    page_pool->UnpinStorePage(page);
+  }
+  return Status::kSuccess;
+}
+
+void TransactionImpl::PagesReturned(size_t first_page_id,
+                                    size_t page_count) noexcept {
+  // The pages are usually returned right after their run is allocated.
+  for (auto it = allocated_page_runs_.rbegin();
+       it != allocated_page_runs_.rend(); ++it) {
+    if (it->first_page_id + it->page_count != first_page_id + page_count)
+      continue;
+    BERRYDB_ASSUME_LE(it->first_page_id, first_page_id);
+    it->page_count -= page_count;
+    return;
+  }
+  BERRYDB_UNREACHABLE();
+}
+
+bool TransactionImpl::HasStolenPage(size_t page_id) const noexcept {
+  for (const StolenPage& stolen_page : stolen_pages_) {
+    if (stolen_page.page_id == page_id)
+      return true;
+  }
+  return false;
+}
+
+Status TransactionImpl::WriteLoggedPages() {
+  BERRYDB_ASSUME_EQ(this, store_->init_transaction());
+
+  for (Page* page : pool_pages_) {
+    if (!page->is_dirty())
+      continue;
+
+    const Status status = store_->WritePage(page);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    page->SetDirty(false);
+  }
   return Status::kSuccess;
 }
 
 Status TransactionImpl::Commit() {
+  // With relaxed durability, the commit record will be synced by the background
+  // thread, by an explicit Store::SyncLog() call, or before any of the pages is
+  // written.
+  uint64_t commit_lsn;
+  return Sequence(!store_->relaxed_durability(), &commit_lsn);
+}
+
+Status TransactionImpl::CommitAsync(CommitCallback callback, void* context) {
+  BERRYDB_ASSUME(callback != nullptr);
+
+  uint64_t commit_lsn;
+  const Status status = Sequence(false, &commit_lsn);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  if (commit_lsn == 0) {
+    // Transactions that did not log anything are durable right away.
+    callback(Status::kSuccess, context);
+  } else {
+    store_->log_writer()->WhenSynced(commit_lsn, callback, context);
+  }
+  return Status::kSuccess;
+}
+
+Status TransactionImpl::Sequence(bool sync_log, uint64_t* commit_lsn) {
   BERRYDB_ASSUME_NE(this, store_->init_transaction());
+  BERRYDB_ASSUME(commit_lsn != nullptr);
 
+  *commit_lsn = 0;
   if (UNLIKELY(is_closed_))
     return Status::kAlreadyClosed;
 
-  // Write the pages modified by this transaction.
+  if (is_optimistic_) {
+    // The store runs one commit at a time, so no other transaction can commit
+    // between the validation and the installation of the changes.
+    Status status = ValidatePageReads();
+    if (LIKELY(status == Status::kSuccess))
+      status = InstallPageWrites();
+    if (UNLIKELY(status != Status::kSuccess)) {
+      Close();  // Rolls back the transaction.
+      return status;
+    }
+  }
+
+  if (pool_pages_.empty() && stolen_pages_.empty()) {
+    // Transactions that did not modify any page have nothing to persist.
+    is_committed_ = true;
+    return Close();
+  }
+
+  // Log the pages modified by this transaction, followed by a commit record.
+  // The pages are not written to the data file. They stay dirty in the pool,
+  // so later transactions that modify them don't cause extra writes. The pages
+  // are written when they are evicted from the pool, or by a checkpoint.
   //
   // This must be a non-init transaction, because only non-init transactions can
   // commit. So, all the pages assigned to this transaction must be pages that
@@ -132,22 +763,145 @@ Status TransactionImpl::Commit() {
   PagePool* const page_pool = store_->page_pool();
   page_pool->PinTransactionPages(&pool_pages_);
 
+  const size_t page_size = page_pool->page_size();
+  LogWriter* const log_writer = store_->log_writer();
+
+  // Records appended after the background sync thread failed would never make
+  // it to the log file.
+  Status status = log_writer->background_status();
+
+  // Stolen pages that weren't fetched again only have the transaction's
+  // changes in the data file. Their content is read before any log space is
+  // reserved, because the reserved space must be filled even if a read fails.
+  std::vector<size_t, PlatformAllocator<size_t>> stolen_page_ids;
+  for (const StolenPage& stolen_page : stolen_pages_) {
+    Page* const page = page_pool->CachedStorePage(store_, stolen_page.page_id);
+    if (page == nullptr || page->transaction() != this)
+      stolen_page_ids.push_back(stolen_page.page_id);
+  }
+  const size_t stolen_images_size = stolen_page_ids.size() * page_size;
+  uint8_t* const stolen_images = stolen_page_ids.empty() ? nullptr :
+      reinterpret_cast<uint8_t*>(Allocate(stolen_images_size));
+  for (size_t i = 0; i < stolen_page_ids.size(); ++i) {
+    if (UNLIKELY(status != Status::kSuccess))
+      break;
+    status = store_->ReadDataFilePage(
+        stolen_page_ids[i],
+        span<uint8_t>(stolen_images + i * page_size, page_size));
+  }
+
+  if (UNLIKELY(status != Status::kSuccess)) {
+    if (stolen_images != nullptr)
+      Deallocate(stolen_images, stolen_images_size);
+    for (Page* page : pool_pages_)
+      page_pool->UnpinStorePage(page);
+    Close();  // Rolls back the transaction.
+    return status;
+  }
+
+  // Compressed record sizes depend on the pages' content, so the pages must be
+  // compressed before any log space is reserved. The payloads are concatenated
+  // in compressed_payloads. payload_sizes has an entry for each image, in the
+  // order the images are logged, and is empty if the log is not compressed.
+  const size_t page_count = pool_pages_.size() + stolen_page_ids.size();
+  std::vector<size_t, PlatformAllocator<size_t>> payload_sizes;
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> compressed_payloads;
+  uint64_t images_size =
+      page_count * LogFormat::PageImageRecordSize(page_pool->page_shift());
+  if (log_writer->compresses_page_images()) {
+    const size_t payload_capacity = log_writer->compressed_payload_capacity();
+    uint8_t* const payload_buffer =
+        reinterpret_cast<uint8_t*>(Allocate(payload_capacity));
+    const span<uint8_t> payload(payload_buffer, payload_capacity);
+    payload_sizes.reserve(page_count);
+    images_size = 0;
+    auto compress_image = [&](span<const uint8_t> page_data) {
+      const size_t payload_size =
+          log_writer->CompressPageImage(page_data, payload);
+      payload_sizes.push_back(payload_size);
+      compressed_payloads.insert(compressed_payloads.end(), payload_buffer,
+                                 payload_buffer + payload_size);
+      images_size += log_writer->PageImageRecordSize(payload_size);
+    };
+    for (Page* page : pool_pages_) {
+      SharedLatchGuard latch_guard(page->latch());
+      compress_image(page->data(page_size));
+    }
+    for (size_t i = 0; i < stolen_page_ids.size(); ++i) {
+      compress_image(span<const uint8_t>(stolen_images + i * page_size,
+                                         page_size));
+    }
+    Deallocate(payload_buffer, payload_capacity);
+  }
+  auto image_payload_size = [&payload_sizes](size_t image_index) {
+    return payload_sizes.empty() ? 0 : payload_sizes[image_index];
+  };
+
+  // The transaction's records are reserved together, so they are contiguous in
+  // the log even if other transactions commit concurrently. The pages' LSNs are
+  // only updated after the commit succeeds, because rollbacks rely on the old
+  // values.
+  const uint64_t first_image_lsn = log_writer->Reserve(
+      images_size + LogFormat::kCommitRecordSize);
+  uint64_t image_lsn = first_image_lsn;
+  size_t image_index = 0;
+  size_t payload_offset = 0;
+  auto write_image = [&](size_t page_id, span<const uint8_t> page_data) {
+    const size_t payload_size = image_payload_size(image_index);
+    if (payload_size == 0) {
+      log_writer->WritePageImage(image_lsn, page_id, page_data);
+    } else {
+      log_writer->WriteCompressedPageImage(
+          image_lsn, page_id,
+          span<const uint8_t>(compressed_payloads.data() + payload_offset,
+                              payload_size));
+      payload_offset += payload_size;
+    }
+    image_lsn += log_writer->PageImageRecordSize(payload_size);
+    ++image_index;
+  };
+  for (Page* page : pool_pages_) {
+    SharedLatchGuard latch_guard(page->latch());
+    write_image(page->page_id(), page->data(page_size));
+  }
+  for (size_t i = 0; i < stolen_page_ids.size(); ++i) {
+    write_image(stolen_page_ids[i],
+                span<const uint8_t>(stolen_images + i * page_size, page_size));
+  }
+  log_writer->WriteCommit(image_lsn, page_count);
+  const uint64_t commit_end_lsn = image_lsn + LogFormat::kCommitRecordSize;
+  if (stolen_images != nullptr)
+    Deallocate(stolen_images, stolen_images_size);
+
+  // Pages are never written to the data file before the log is synced past
+  // their commit records, so skipping the sync only affects durability.
+  if (sync_log) {
+    status = log_writer->SyncTo(commit_end_lsn);
+    if (UNLIKELY(status != Status::kSuccess)) {
+      for (Page* page : pool_pages_)
+        page_pool->UnpinStorePage(page);
+      Close();  // Rolls back the transaction.
+      return status;
+    }
+  }
+
   TransactionImpl* const init_transaction = store_->init_transaction();
+  commit_timestamp_ = store_->AdvanceCommitTimestamp();
 
   // We cannot use C++11's range-based for loop because the iterator would get
   // invalidated when we remove the page it's pointing to from the list.
+  image_lsn = first_image_lsn;
+  image_index = 0;
   for (auto it = pool_pages_.begin(); it != pool_pages_.end(); ) {
     Page* page = *it;
     ++it;
 
-    // TODO(pwnall): Write REDO records for the pages to the log instead. The
-    //               log write status handling code will remain the same.
-    MAYBE_UNUSED Status status = store_->WritePage(page);
-
-    // TODO(pwnall): Handle errors, once we have logging in place.
-    BERRYDB_ASSUME_EQ(status, Status::kSuccess);
-
-    PageWasPersisted(page, init_transaction);
+    page->SetLogLsns(image_lsn, commit_end_lsn);
+    page->set_commit_timestamp(commit_timestamp_);
+    image_lsn += log_writer->PageImageRecordSize(
+        image_payload_size(image_index));
+    ++image_index;
+    PageWasLogged(page, init_transaction);
     page_pool->UnpinStorePage(page);
   }
 
@@ -155,6 +909,10 @@ Status TransactionImpl::Commit() {
   //               one, we could insert the committed transaction list into the
   //               init transaction list in O(1).
 
+  // The stolen pages' data file copies now hold committed content.
+  stolen_pages_.clear();
+
+  *commit_lsn = commit_end_lsn;
   is_committed_ = true;
   return Close();
 }
@@ -167,27 +925,150 @@ Status TransactionImpl::Rollback() {
 }
 
 std::tuple<Status, SpaceImpl*> TransactionImpl::CreateSpace(
-    MAYBE_UNUSED CatalogImpl* catalog, MAYBE_UNUSED span<const uint8_t> name) {
-  if (UNLIKELY(is_closed_))
-    return {Status::kAlreadyClosed, nullptr};
+    CatalogImpl* catalog, span<const uint8_t> name,
+    const SpaceOptions& options) {
+  CatalogImpl::EntryType type;
+  switch (options.integer_key_size) {
+    case 0:
+      type = options.hashed ? CatalogImpl::EntryType::kHashedSpace
+                            : CatalogImpl::EntryType::kSpace;
+      break;
+    case 4:
+      type = CatalogImpl::EntryType::kInteger32Space;
+      break;
+    case 8:
+      type = CatalogImpl::EntryType::kInteger64Space;
+      break;
+    default:
+      return {Status::kNotSupported, nullptr};
+  }
+  // Hash tables don't benefit from fixed-width keys.
+  if (UNLIKELY(options.hashed && options.integer_key_size != 0))
+    return {Status::kNotSupported, nullptr};
+  // Only regular B+trees have buffered inner nodes.
+  if (options.write_buffered) {
+    if (UNLIKELY(type != CatalogImpl::EntryType::kSpace))
+      return {Status::kNotSupported, nullptr};
+    type = CatalogImpl::EntryType::kBufferedSpace;
+  }
+  // Filters are rebuilt by walking the leaves of a regular B+tree.
+  if (UNLIKELY(options.bloom_filter_key_count != 0 &&
+               type != CatalogImpl::EntryType::kSpace)) {
+    return {Status::kNotSupported, nullptr};
+  }
+  // Log records store 16-bit value sizes, and are found by compaction using
+  // a regular B+tree's keys.
+  if (UNLIKELY(options.value_log_threshold != 0 &&
+               (type != CatalogImpl::EntryType::kSpace ||
+                options.value_log_threshold > 0xFFFF))) {
+    return {Status::kNotSupported, nullptr};
+  }
 
-  return {Status::kIoError, nullptr};
+  Status status;
+  size_t root_page_id;
+  BloomFilter filter;
+  ValueLog value_log;
+  std::tie(status, root_page_id, filter, value_log) = CreateCatalogEntry(
+      catalog, name, type, options.bloom_filter_key_count,
+      options.value_log_threshold);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, nullptr};
+  return {Status::kSuccess,
+          SpaceImpl::Create(root_page_id, type, filter, value_log)};
 }
 
 std::tuple<Status, CatalogImpl*> TransactionImpl::CreateCatalog(
-    MAYBE_UNUSED CatalogImpl* catalog, MAYBE_UNUSED span<const uint8_t> name) {
+    CatalogImpl* catalog, span<const uint8_t> name) {
+  Status status;
+  size_t root_page_id;
+  BloomFilter filter;
+  ValueLog value_log;
+  std::tie(status, root_page_id, filter, value_log) = CreateCatalogEntry(
+      catalog, name, CatalogImpl::EntryType::kCatalog, 0, 0);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, nullptr};
+  return {Status::kSuccess, CatalogImpl::Create(store_, root_page_id)};
+}
+
+std::tuple<Status, size_t, BloomFilter, ValueLog>
+TransactionImpl::CreateCatalogEntry(
+    CatalogImpl* catalog, span<const uint8_t> name,
+    CatalogImpl::EntryType type, size_t filter_key_count,
+    size_t value_log_threshold) {
   if (UNLIKELY(is_closed_))
-    return {Status::kAlreadyClosed, nullptr};
+    return {Status::kAlreadyClosed, 0, BloomFilter(), ValueLog()};
 
-  return {Status::kIoError, nullptr};
+  // Locking the catalog keeps concurrent transactions from creating the same
+  // name.
+  const Status lock_status = LockForWrite(catalog);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return {lock_status, 0, BloomFilter(), ValueLog()};
+
+  BTree* const catalog_tree = catalog->tree();
+  Status status = catalog_tree->Get(this, name, &value_buffer_);
+  if (status == Status::kSuccess)
+    return {Status::kAlreadyExists, 0, BloomFilter(), ValueLog()};
+  if (UNLIKELY(status != Status::kNotFound))
+    return {status, 0, BloomFilter(), ValueLog()};
+
+  size_t root_page_id;
+  switch (type) {
+    case CatalogImpl::EntryType::kHashedSpace:
+      std::tie(status, root_page_id) = HashTable::Create(this);
+      break;
+    case CatalogImpl::EntryType::kInteger32Space:
+      std::tie(status, root_page_id) = IntegerBTree<uint32_t>::Create(this);
+      break;
+    case CatalogImpl::EntryType::kInteger64Space:
+      std::tie(status, root_page_id) = IntegerBTree<uint64_t>::Create(this);
+      break;
+    default:
+      std::tie(status, root_page_id) = BTree::Create(this);
+      break;
+  }
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0, BloomFilter(), ValueLog()};
+
+  BloomFilter filter;
+  if (filter_key_count != 0) {
+    std::tie(status, filter) = BloomFilter::Create(this, filter_key_count);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, BloomFilter(), ValueLog()};
+  }
+  ValueLog value_log;
+  if (value_log_threshold != 0) {
+    std::tie(status, value_log) = ValueLog::Create(this, value_log_threshold);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0, BloomFilter(), ValueLog()};
+  }
+
+  alignas(8) uint8_t entry[CatalogImpl::kValueLogEntrySize];
+  const span<uint8_t> entry_span(
+      entry, CatalogImpl::EntrySize(filter, value_log));
+  CatalogImpl::EncodeEntry(type, root_page_id, filter, value_log, entry_span);
+  status = catalog_tree->Put(this, name, entry_span);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0, BloomFilter(), ValueLog()};
+  return {Status::kSuccess, root_page_id, filter, value_log};
 }
 
-Status TransactionImpl::Delete(MAYBE_UNUSED CatalogImpl* catalog,
-                               MAYBE_UNUSED span<const uint8_t> name) {
+Status TransactionImpl::Delete(CatalogImpl* catalog, span<const uint8_t> name) {
   if (UNLIKELY(is_closed_))
     return Status::kAlreadyClosed;
 
-  return Status::kIoError;
+  const Status lock_status = LockForWrite(catalog);
+  if (UNLIKELY(lock_status != Status::kSuccess))
+    return lock_status;
+
+  BTree* const catalog_tree = catalog->tree();
+  Status status = catalog_tree->Get(this, name, &value_buffer_);
+  if (status != Status::kSuccess)
+    return status;
+  status = FreeEntryTree(
+      this, span<const uint8_t>(value_buffer_.data(), value_buffer_.size()));
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return catalog_tree->Delete(this, name);
 }
 
 }  // namespace berrydb
@@ -5,23 +5,36 @@
 #ifndef BERRYDB_TRANSACTION_IMPL_H_
 #define BERRYDB_TRANSACTION_IMPL_H_
 
+#include <functional>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "berrydb/span.h"
 #include "berrydb/transaction.h"
+#include "./bloom_filter.h"
+#include "./catalog_impl.h"
+#include "./free_page_manager.h"
+#include "./lock_manager.h"
 #include "./page.h"
 // #include "./page_pool.h" would cause a cycle
 // #include "./store_impl.h" would cause a cycle
 #include "./util/checks.h"
 #include "./util/linked_list.h"
+#include "./util/platform_allocator.h"
+#include "./value_log.h"
 
 namespace berrydb {
 
 class BlockAccessFile;
-class CatalogImpl;
+struct PageVersion;
+class PinnedValue;
 class SpaceImpl;
+struct SpaceOptions;
 class StoreImpl;
 class TransactionImpl;
+struct TransactionOptions;
+class WriteBatchImpl;
 
 /** Internal representation for the Transaction class in the public API.
  *
@@ -44,8 +57,12 @@ class TransactionImpl {
   TransactionImpl& operator=(const TransactionImpl&) = delete;
   TransactionImpl& operator=(TransactionImpl&&) = delete;
 
-  /** Create a TransactionImpl instance. */
-  static TransactionImpl* Create(StoreImpl* store);
+  /** Create a TransactionImpl instance.
+   *
+   * The instance reuses the memory of a released transaction, if the store has
+   * any. */
+  static TransactionImpl* Create(StoreImpl* store,
+                                 const TransactionOptions& options);
 
   /** Computes the internal representation for a pointer from the public API. */
   static inline TransactionImpl* FromApi(Transaction* api) noexcept {
@@ -68,6 +85,16 @@ class TransactionImpl {
   /** The store this transaction is running against. */
   inline constexpr StoreImpl* store() const noexcept { return store_; }
 
+  /** Called when the transaction's store is closed.
+   *
+   * The transaction must be closed. Afterwards, the transaction does not access
+   * the store anymore, because the store may be released before the
+   * transaction. */
+  inline void StoreWasClosed() noexcept {
+    BERRYDB_ASSUME(is_closed_);
+    is_store_closed_ = true;
+  }
+
 #if BERRYDB_CHECK_IS_ON()
   /** Number of pool pages assigned to this transaction. CHECKs use only.
    *
@@ -106,6 +133,59 @@ class TransactionImpl {
     pool_pages_.push_back(page);
   }
 
+  /** Called after pages are allocated on behalf of this transaction.
+   *
+   * The pages are handed back to the store's free page manager if the
+   * transaction is rolled back.
+   *
+   * @param first_page_id the ID of the first allocated page
+   * @param page_count    the number of consecutive pages that were allocated
+   */
+  inline void PagesAllocated(size_t first_page_id, size_t page_count) {
+    allocated_page_runs_.push_back({first_page_id, page_count});
+  }
+
+  /** Called when unused pages at the end of an allocated run are given back.
+   *
+   * @param first_page_id the ID of the first page that was given back
+   * @param page_count    the number of pages given back; they must be at the end
+   *                      of a run that was passed to PagesAllocated()
+   */
+  void PagesReturned(size_t first_page_id, size_t page_count) noexcept;
+
+  /** Called when this transaction stops referencing a run of pages.
+   *
+   * The pages are handed to the store's free page manager when the transaction
+   * commits, and stay in use if the transaction is rolled back.
+   *
+   * @param first_page_id the ID of the first page in the run
+   * @param page_count    the number of consecutive pages in the run
+   */
+  inline void WillFreePages(size_t first_page_id, size_t page_count) {
+    freed_page_runs_.push_back({first_page_id, page_count});
+  }
+
+  /** The page runs allocated by this transaction. See PagesAllocated(). */
+  inline const std::vector<FreePageManager::PageRun,
+                           PlatformAllocator<FreePageManager::PageRun>>&
+  allocated_page_runs() const noexcept {
+    return allocated_page_runs_;
+  }
+
+  /** The page runs freed by this transaction. See WillFreePages(). */
+  inline const std::vector<FreePageManager::PageRun,
+                           PlatformAllocator<FreePageManager::PageRun>>&
+  freed_page_runs() const noexcept {
+    return freed_page_runs_;
+  }
+
+  /** The timestamp assigned to the transaction when it committed.
+   *
+   * 0 if the transaction did not commit. */
+  inline constexpr uint64_t commit_timestamp() const noexcept {
+    return commit_timestamp_;
+  }
+
   /** Prepares a Page that will not be caching a page in this transaction store.
    *
    * The caller must have a pin on the page pool entry. The page pool entry must
@@ -153,17 +233,21 @@ class TransactionImpl {
     TransactionImpl* const page_transaction = page->transaction();
     if (page_transaction != this) {
 // A page may not be modified by two transactions at the same time. This
-// follows from the concurrency model, which states that a Space modified
-// by a transaction must not be accessed by any concurrent transaction.
+// follows from LockForWrite(), which makes transactions that modify the
+// same space or catalog wait for each other.
 #if BERRYDB_CHECK_IS_ON()
       BERRYDB_CHECK(page->transaction()->is_init_);
 #endif  // BERRYDB_CHECK_IS_ON()
-      BERRYDB_ASSUME(!page->is_dirty());
+      // The page may be dirty if it holds committed changes that haven't been
+      // written to the data file yet. In that case, the page's image_lsn() can
+      // be used to undo this transaction's changes.
 
       // TODO(pwnall): Once logging is done, consider if it's possible for a
       //     page not to be dirty while it is assigned to a non-init
       //     transaction. If not, this check can be turned into an early return
       //     when the page is already assigned to this transaction.
+      SaveCommittedContent(page);
+
       page_transaction->pool_pages_.erase(page);
       pool_pages_.push_back(page);
       page->ReassignToTransaction(this);
@@ -172,6 +256,78 @@ class TransactionImpl {
     page->SetDirty(true);
   }
 
+  /** The page data seen by this transaction.
+   *
+   * Code that reads pages on behalf of the transaction must use this instead of
+   * Page::data(). Optimistic transactions see their buffered changes, and
+   * remember the pages they read, so Commit() can validate them.
+   *
+   * The caller must have a pin on the page pool entry. The returned span is
+   * valid until the transaction is closed or the page is unpinned.
+   *
+   * @param page      a pool page caching a page in this transaction's store
+   * @param page_size must match the page size of the store's PagePool
+   */
+  inline span<const uint8_t> PageData(Page* page, size_t page_size) {
+    BERRYDB_ASSUME(page != nullptr);
+    BERRYDB_ASSUME(!page->IsUnpinned());
+
+    if (LIKELY(!is_optimistic_))
+      return page->data(page_size);
+    return OptimisticPageData(page, page_size);
+  }
+
+  /** The page data that this transaction can modify.
+   *
+   * Code that modifies pages on behalf of the transaction must use this instead
+   * of calling WillModifyPage() and Page::mutable_data(). The changes of
+   * optimistic transactions go to a private copy of the page, which replaces
+   * the pool page's content when the transaction commits.
+   *
+   * The caller must have a pin on the page pool entry. The returned span is
+   * valid until the transaction is closed or the page is unpinned.
+   *
+   * @param page      a pool page caching a page in this transaction's store
+   * @param page_size must match the page size of the store's PagePool
+   */
+  inline span<uint8_t> MutablePageData(Page* page, size_t page_size) {
+    BERRYDB_ASSUME(page != nullptr);
+    BERRYDB_ASSUME(!page->IsUnpinned());
+
+    if (LIKELY(!is_optimistic_)) {
+      WillModifyPage(page);
+      return page->mutable_data(page_size);
+    }
+    return OptimisticMutablePageData(page, page_size);
+  }
+
+  /** The data of a page allocated by this transaction, for initialization.
+   *
+   * This is like MutablePageData(), but the caller must overwrite the entire
+   * page. Optimistic transactions don't treat the page as read, because no
+   * other transaction can use a page allocated by a running transaction.
+   *
+   * @param page      a pool page caching a page allocated by this transaction
+   * @param page_size must match the page size of the store's PagePool
+   */
+  inline span<uint8_t> NewPageData(Page* page, size_t page_size) {
+    BERRYDB_ASSUME(page != nullptr);
+    BERRYDB_ASSUME(!page->IsUnpinned());
+
+    if (LIKELY(!is_optimistic_)) {
+      WillModifyPage(page);
+      return page->mutable_data(page_size);
+    }
+    return OptimisticNewPageData(page, page_size);
+  }
+
+  /** True if the transaction uses optimistic concurrency control.
+   *
+   * See TransactionOptions::optimistic. */
+  inline constexpr bool is_optimistic() const noexcept {
+    return is_optimistic_;
+  }
+
   /** Called when a page assigned to this transaction was persisted.
    *
    * Pages should only be persisted when they are dirty. Persisting a page
@@ -202,13 +358,80 @@ class TransactionImpl {
     init_transaction->pool_pages_.push_back(page);
     page->ReassignToTransaction(init_transaction);
     page->SetDirty(false);
+    page->SetLogLsns(0, 0);
+  }
+
+  /** Called when a page assigned to this transaction was logged but not written.
+   *
+   * The page is handed over to the init transaction, but stays dirty, because
+   * the data file does not reflect the logged changes. The caller must have
+   * recorded the page's log LSNs, so the page can be written back safely.
+   *
+   * @param page the Page whose data buffer was logged
+   */
+  inline void PageWasLogged(Page* page,
+                            TransactionImpl* init_transaction) noexcept {
+    BERRYDB_ASSUME(page != nullptr);
+    BERRYDB_ASSUME(!page->IsUnpinned());
+    BERRYDB_ASSUME_EQ(page->transaction(), this);
+    BERRYDB_ASSUME(page->is_dirty());
+    BERRYDB_ASSUME_NE(page->commit_lsn(), 0U);
+
+    BERRYDB_ASSUME(init_transaction != nullptr);
+    BERRYDB_ASSUME_EQ(init_transaction->store(), store_);
+    BERRYDB_ASSUME_NE(this, init_transaction);
+#if BERRYDB_CHECK_IS_ON()
+    BERRYDB_CHECK(init_transaction->is_init_);
+#endif  // BERRYDB_CHECK_IS_ON()
+
+    pool_pages_.erase(page);
+    init_transaction->pool_pages_.push_back(page);
+    page->ReassignToTransaction(init_transaction);
+  }
+
+  /** Writes the dirty pages owned by the init transaction to the data file.
+   *
+   * Must only be called on a store's init transaction. The dirty pages hold
+   * committed changes that were logged, but not written yet. The log must be
+   * synced past the changes' commit records.
+   *
+   * @return most likely kSuccess or kIoError
+   */
+  Status WriteLoggedPages();
+
+  /** True if the page pool wrote this transaction's changes to a page.
+   *
+   * @param page_id the ID of a page in this transaction's store
+   */
+  bool HasStolenPage(size_t page_id) const noexcept;
+
+  /** Called before a page modified by this transaction is stolen.
+   *
+   * Stealing a page writes its uncommitted changes to the store's data file, so
+   * the page can be evicted from the pool. The transaction remembers the page,
+   * so it can log the page's content when it commits, and so it can put back
+   * the page's committed content when it is rolled back.
+   *
+   * @param page_id   the ID of the page that will be stolen; the page must not
+   *                  have been stolen by this transaction before
+   * @param image_lsn the LSN of the log record holding the page's committed
+   *                  content; 0 if the page has no committed content
+   */
+  inline void WillStealPage(size_t page_id, uint64_t image_lsn) {
+#if BERRYDB_CHECK_IS_ON()
+    BERRYDB_CHECK(!is_init_);
+    BERRYDB_CHECK(!HasStolenPage(page_id));
+#endif  // BERRYDB_CHECK_IS_ON()
+
+    stolen_pages_.push_back({page_id, image_lsn});
   }
 
   /** Prepares a Page that will not be caching a page in this transaction store.
    *
    * The caller must have a pin on the page pool entry. The page pool entry must
    * be currently caching a page in this transaction's store, and must be
-   * assigned to this transaction. The page must have been recently
+   * assigned to this transaction. The page must have been recently written to
+   * the store's data file.
    *
    * @param page a page pool entry that was caching a page in this transaction's
    *             store, and will not be caching the page anymore
@@ -218,9 +441,6 @@ class TransactionImpl {
     BERRYDB_ASSUME(!page->IsUnpinned());
     BERRYDB_ASSUME_EQ(page->transaction(), this);
     BERRYDB_ASSUME(page->is_dirty());
-#if BERRYDB_CHECK_IS_ON()
-    BERRYDB_CHECK(!is_init_);
-#endif  // BERRYDB_CHECK_IS_ON()
 
     pool_pages_.erase(page);
     page->DoesNotCacheStoreData();
@@ -230,13 +450,29 @@ class TransactionImpl {
   // See the public API documention for details.
   std::tuple<Status, span<const uint8_t>> Get(SpaceImpl* space,
                                               span<const uint8_t> key);
+  Status Get(SpaceImpl* space, span<const uint8_t> key, PinnedValue* value);
+  Status MultiGet(SpaceImpl* space, span<const span<const uint8_t>> keys,
+                  span<Status> statuses, span<PinnedValue> values);
+  std::tuple<Status, size_t> ReadValue(SpaceImpl* space,
+                                       span<const uint8_t> key, size_t offset,
+                                       span<uint8_t> buffer);
   Status Put(SpaceImpl* space, span<const uint8_t> key,
              span<const uint8_t> value);
+  Status ReserveValue(SpaceImpl* space, span<const uint8_t> key,
+                      size_t value_size);
+  Status WriteValue(SpaceImpl* space, span<const uint8_t> key, size_t offset,
+                    span<const uint8_t> data);
   Status Delete(SpaceImpl* space, span<const uint8_t> key);
+  Status Write(WriteBatchImpl* batch);
+  Status BulkLoad(SpaceImpl* space, BulkLoadSource source, void* context);
+  Status RebuildFilter(SpaceImpl* space);
+  Status CompactValueLog(SpaceImpl* space);
   Status Commit();
+  Status CommitAsync(CommitCallback callback, void* context);
   Status Rollback();
   std::tuple<Status, SpaceImpl*> CreateSpace(CatalogImpl* catalog,
-                                             span<const uint8_t> name);
+                                             span<const uint8_t> name,
+                                             const SpaceOptions& options);
   std::tuple<Status, CatalogImpl*> CreateCatalog(CatalogImpl* catalog,
                                                  span<const uint8_t> name);
   Status Delete(CatalogImpl* catalog, span<const uint8_t> name);
@@ -257,12 +493,122 @@ class TransactionImpl {
   void Release();
 
  private:
+  /** A page read by an optimistic transaction. */
+  struct PageRead {
+    size_t page_id;
+    /** The page's commit timestamp when it was read. */
+    uint64_t commit_timestamp;
+  };
+
   /** Use TransactionImpl::Create() to obtain TransactionImpl instances. */
-  TransactionImpl(StoreImpl* store);
+  TransactionImpl(StoreImpl* store, const TransactionOptions& options);
+
+  /** Common functionality in Commit() and CommitAsync().
+   *
+   * Validates the transaction, if it is optimistic, logs the pages it modified,
+   * and makes its changes visible to other transactions.
+   *
+   * @param  sync_log   if true, the log is synced past the commit record before
+   *                    the changes become visible
+   * @param  commit_lsn receives the LSN right past the commit record, or 0 if
+   *                    the transaction did not log anything
+   * @return            most likely kSuccess, kConflict or kIoError
+   */
+  Status Sequence(bool sync_log, uint64_t* commit_lsn);
 
   /** Common functionality in Commit() and Rollback(). */
   Status Close();
 
+  /** Locks a space that this transaction is about to read.
+   *
+   * Pessimistic transactions lock the spaces they read in shared mode, so they
+   * don't see the uncommitted changes of other transactions, and the values
+   * they read stay the same until they close. Optimistic transactions validate
+   * their reads when they commit instead.
+   *
+   * @param  space the SpaceImpl that will be read
+   * @return       kSuccess, or the lock manager's error
+   */
+  Status LockForRead(const void* space);
+
+  /** Locks a space or catalog that this transaction is about to modify.
+   *
+   * The records in a space share pages, and a page can only hold the
+   * uncommitted changes of one transaction. So pessimistic transactions lock
+   * the spaces they modify in exclusive mode. Individual records aren't locked,
+   * because the space lock already excludes all other readers and writers.
+   * Optimistic transactions don't modify pages until they commit, so they
+   * don't need the lock.
+   *
+   * @param  space the SpaceImpl or CatalogImpl that will be modified
+   * @return       kSuccess, or the lock manager's error
+   */
+  Status LockForWrite(const void* space);
+
+  /** Adds an entry for a new catalog or space to a catalog.
+   *
+   * @param  catalog      the catalog that receives the entry
+   * @param  name         the entry's name
+   * @param  type         the kind of object that the entry refers to
+   * @param  filter_key_count if not zero, the space gets a Bloom filter sized
+   *                      for this many keys
+   * @param  value_log_threshold if not zero, the space gets a value log that
+   *                      holds the values of at least this size
+   * @return status       kAlreadyExists if the catalog already has an entry
+   *                      with the given name; otherwise, most likely kSuccess or
+   *                      kIoError
+   * @return root_page_id the root page of the new object's B+tree, or the
+   *                      header page of a hashed space's table
+   * @return filter       the new space's Bloom filter, if it has one
+   * @return value_log    the new space's value log, if it has one
+   */
+  std::tuple<Status, size_t, BloomFilter, ValueLog> CreateCatalogEntry(
+      CatalogImpl* catalog, span<const uint8_t> name,
+      CatalogImpl::EntryType type, size_t filter_key_count,
+      size_t value_log_threshold);
+
+  /** PageData() implementation for optimistic transactions. */
+  span<const uint8_t> OptimisticPageData(Page* page, size_t page_size);
+
+  /** MutablePageData() implementation for optimistic transactions. */
+  span<uint8_t> OptimisticMutablePageData(Page* page, size_t page_size);
+
+  /** NewPageData() implementation for optimistic transactions. */
+  span<uint8_t> OptimisticNewPageData(Page* page, size_t page_size);
+
+  /** Checks that the pages read by an optimistic transaction are unchanged.
+   *
+   * @return kSuccess or kConflict
+   */
+  Status ValidatePageReads() const noexcept;
+
+  /** Copies an optimistic transaction's buffered changes into the pool.
+   *
+   * This is called after the transaction is validated. Afterwards, the
+   * transaction commits like any other transaction.
+   *
+   * @return most likely kSuccess, kIoError or kPoolFull
+   */
+  Status InstallPageWrites();
+
+  /** Saves a page's committed content before this transaction modifies it.
+   *
+   * The content is used by read transactions whose snapshots don't include this
+   * transaction, and by Rollback().
+   *
+   * @param page a page that is not assigned to this transaction yet
+   */
+  void SaveCommittedContent(Page* page);
+
+  /** A page whose uncommitted changes were written to the data file. */
+  struct StolenPage {
+    size_t page_id;
+    /** The LSN of the log record holding the page's committed content.
+     *
+     * 0 if the page did not exist in the data file when it was stolen. */
+    uint64_t image_lsn;
+  };
+
 #if BERRYDB_CHECK_IS_ON()
   /** CHECKs that the given page pool entry was assigned to this transaction.
    *
@@ -287,15 +633,70 @@ class TransactionImpl {
    * that are assigned to the store, but are not on a transaction's list. This
    * means the init transaction's list will contain the page pool entries
    * assigned to the store that have not been modified by an ongoing
-   * transaction, or have already been written back to the store.
+   * transaction. Entries that hold committed changes which were logged, but not
+   * written back to the store yet, are dirty.
    */
   LinkedList<Page, Page::TransactionLinkedListBridge> pool_pages_;
 
+  /** Pages modified by this transaction that were evicted from the pool.
+   *
+   * Stolen pages are usually rare, so a vector is good enough for lookups. */
+  std::vector<StolenPage, PlatformAllocator<StolenPage>> stolen_pages_;
+
+  /** The committed content of the pages modified by this transaction.
+   *
+   * The versions are stamped with the transaction's commit timestamp when the
+   * transaction commits, and are discarded if the transaction is rolled back.
+   */
+  std::vector<PageVersion*, PlatformAllocator<PageVersion*>> saved_versions_;
+
+  /** The page runs allocated by this transaction. See PagesAllocated(). */
+  std::vector<FreePageManager::PageRun,
+              PlatformAllocator<FreePageManager::PageRun>>
+      allocated_page_runs_;
+
+  /** The page runs freed by this transaction. See WillFreePages(). */
+  std::vector<FreePageManager::PageRun,
+              PlatformAllocator<FreePageManager::PageRun>>
+      freed_page_runs_;
+
+  /** The space and catalog locks held by this transaction. Released by
+   * Close(). */
+  LockManager::Owner lock_owner_;
+
+  /** The pages read by an optimistic transaction. Checked by Commit(). */
+  std::vector<PageRead, PlatformAllocator<PageRead>> page_reads_;
+
+  /** The private page copies holding an optimistic transaction's changes.
+   *
+   * The keys are page IDs. The buffers are allocated by the platform allocator,
+   * and are freed when the transaction is closed. */
+  std::unordered_map<size_t, uint8_t*, std::hash<size_t>, std::equal_to<size_t>,
+                     PlatformAllocator<std::pair<const size_t, uint8_t*>>>
+      page_writes_;
+
+  /** Holds the value returned by the last Get(). */
+  std::vector<uint8_t, PlatformAllocator<uint8_t>> value_buffer_;
+
   /** The store this transaction runs against. */
   StoreImpl* const store_;
 
+  /** The timestamp assigned to the transaction by Commit(). */
+  uint64_t commit_timestamp_ = 0;
+
+  /** The store's last commit timestamp when the transaction was created.
+   *
+   * The data read by the transaction includes all the changes committed up to
+   * this point. Used by ValidatePageReads(). */
+  const uint64_t start_commit_timestamp_;
+
+  /** See is_optimistic(). */
+  const bool is_optimistic_;
+
   bool is_closed_ = false;
   bool is_committed_ = false;
+  /** See StoreWasClosed(). */
+  bool is_store_closed_ = false;
 
 #if BERRYDB_CHECK_IS_ON()
   /** True if this is the store's init transaction. */
@@ -12,6 +12,74 @@
 
 namespace berrydb {
 
+/** Reads a 16-bit unsigned integer from an aligned buffer.
+ *
+ * See LoadUint64() for details on the storage format.
+ *
+ * @param  from memory holding the integer; must be 2-byte-aligned
+ * @return      the integer stored at the given location
+ */
+template <typename ElementType>
+inline constexpr uint16_t LoadUint16(span<ElementType> from) noexcept {
+  BERRYDB_ASSUME(from.data() != nullptr);
+  BERRYDB_ASSUME_EQ((reinterpret_cast<uintptr_t>(from.data()) & 1), 0U);
+  BERRYDB_ASSUME_EQ(from.size_bytes(), 2U);
+
+  return PlatformLoadUint16(from.data());
+}
+
+/** Stores a 16-bit unsigned integer to an aligned buffer.
+ *
+ * See StoreUint64() for details on the storage format.
+ *
+ * @param  value the value to be stored
+ * @param  to    memory that will receive the integer; must be 2-byte-aligned
+ */
+template <
+    typename ElementType,
+    typename = std::enable_if_t<!std::is_const<ElementType>::value>>
+inline void StoreUint16(uint16_t value, span<ElementType> to) noexcept {
+  BERRYDB_ASSUME(to.data() != nullptr);
+  BERRYDB_ASSUME_EQ((reinterpret_cast<uintptr_t>(to.data()) & 1), 0U);
+  BERRYDB_ASSUME_EQ(to.size_bytes(), 2U);
+
+  return PlatformStoreUint16(value, to.data());
+}
+
+/** Reads a 32-bit unsigned integer from an aligned buffer.
+ *
+ * See LoadUint64() for details on the storage format.
+ *
+ * @param  from memory holding the integer; must be 4-byte-aligned
+ * @return      the integer stored at the given location
+ */
+template <typename ElementType>
+inline constexpr uint32_t LoadUint32(span<ElementType> from) noexcept {
+  BERRYDB_ASSUME(from.data() != nullptr);
+  BERRYDB_ASSUME_EQ((reinterpret_cast<uintptr_t>(from.data()) & 3), 0U);
+  BERRYDB_ASSUME_EQ(from.size_bytes(), 4U);
+
+  return PlatformLoadUint32(from.data());
+}
+
+/** Stores a 32-bit unsigned integer to an aligned buffer.
+ *
+ * See StoreUint64() for details on the storage format.
+ *
+ * @param  value the value to be stored
+ * @param  to    memory that will receive the integer; must be 4-byte-aligned
+ */
+template <
+    typename ElementType,
+    typename = std::enable_if_t<!std::is_const<ElementType>::value>>
+inline void StoreUint32(uint32_t value, span<ElementType> to) noexcept {
+  BERRYDB_ASSUME(to.data() != nullptr);
+  BERRYDB_ASSUME_EQ((reinterpret_cast<uintptr_t>(to.data()) & 3), 0U);
+  BERRYDB_ASSUME_EQ(to.size_bytes(), 4U);
+
+  return PlatformStoreUint32(value, to.data());
+}
+
 /** Reads a 64-bit unsigned integer from an aligned buffer.
  *
  * Consumers should assume that the integer is stored in a cross-platform
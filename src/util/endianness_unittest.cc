@@ -40,4 +40,19 @@ TEST(EndiannessTest, LoadMatchesStore) {
   EXPECT_EQ(0xCDCDCDCDCDCDCDCDU, LoadUint64(buffer.subspan(24, 8)));
 }
 
+TEST(EndiannessTest, NarrowLoadsMatchStores) {
+  alignas(8) uint8_t buffer_bytes[16];
+  span<uint8_t> buffer(buffer_bytes);
+  FillSpan(make_span(buffer_bytes), 0xCD);
+
+  StoreUint16(0x4265, buffer.subspan(2, 2));
+  StoreUint32(0x72727944, buffer.subspan(4, 4));
+  EXPECT_EQ(0x4265U, LoadUint16(buffer.subspan(2, 2)));
+  EXPECT_EQ(0x72727944U, LoadUint32(buffer.subspan(4, 4)));
+
+  EXPECT_EQ(0xCDCDU, LoadUint16(buffer.subspan(0, 2)));
+  EXPECT_EQ(0xCDCDCDCDU, LoadUint32(buffer.subspan(8, 4)));
+  EXPECT_EQ(0xCDCDCDCDU, LoadUint32(buffer.subspan(12, 4)));
+}
+
 }  // namespace berrydb
@@ -0,0 +1,72 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_KEY_HASH_H_
+#define BERRYDB_UTIL_KEY_HASH_H_
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+
+namespace berrydb {
+
+/** Key hashes place keys in the buckets of hashed spaces.
+ *
+ * Hashes are stored implicitly in the store's data, because they determine the
+ * bucket that holds each key. So, unlike the hashes in berrydb/platform.h, a
+ * key's hash must not depend on the platform or on the build. The key is read
+ * in 8-byte little-endian chunks, assembled byte by byte, and the result goes
+ * through the 64-bit finalizer from MurmurHash3, so all the hash's bits depend
+ * on all the key's bits. Hashed spaces use the hash's low bits.
+ */
+
+namespace key_hash_internal {
+
+/** Rotates a 64-bit number to the left. */
+inline constexpr uint64_t RotateLeft(uint64_t value, int bits) noexcept {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+/** The 64-bit finalizer from MurmurHash3. Mixes all the bits together. */
+inline constexpr uint64_t Finalize(uint64_t value) noexcept {
+  value ^= value >> 33;
+  value *= 0xFF51AFD7ED558CCDULL;
+  value ^= value >> 33;
+  value *= 0xC4CEB9FE1A85EC53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+/** Scrambles a chunk of the key before it is combined into the hash. */
+inline constexpr uint64_t MixChunk(uint64_t chunk) noexcept {
+  return RotateLeft(chunk * 0x87C37B91114253D5ULL, 31) * 0x4CF5AD432745937FULL;
+}
+
+}  // namespace key_hash_internal
+
+/** Computes the hash of a key. */
+inline uint64_t KeyHash(span<const uint8_t> key) noexcept {
+  using namespace key_hash_internal;
+
+  uint64_t hash = static_cast<uint64_t>(key.size()) * 0x9E3779B97F4A7C15ULL;
+  const size_t chunked_size = key.size() & ~static_cast<size_t>(7);
+  for (size_t i = 0; i < chunked_size; i += 8) {
+    uint64_t chunk = 0;
+    for (size_t j = 0; j < 8; ++j)
+      chunk |= static_cast<uint64_t>(key[i + j]) << (8 * j);
+    hash ^= MixChunk(chunk);
+    hash = RotateLeft(hash, 27) * 5 + 0x52DCE729;
+  }
+
+  if (chunked_size < key.size()) {
+    uint64_t chunk = 0;
+    for (size_t j = 0; chunked_size + j < key.size(); ++j)
+      chunk |= static_cast<uint64_t>(key[chunked_size + j]) << (8 * j);
+    hash ^= MixChunk(chunk);
+  }
+  return Finalize(hash);
+}
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_KEY_HASH_H_
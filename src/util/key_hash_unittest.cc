@@ -0,0 +1,57 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./key_hash.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+namespace {
+
+uint64_t StringHash(const std::string& key) {
+  return KeyHash(span<const uint8_t>(
+      reinterpret_cast<const uint8_t*>(key.data()), key.size()));
+}
+
+}  // namespace
+
+TEST(KeyHashTest, KnownValues) {
+  // The hashes are stored implicitly in hashed spaces, so they must never
+  // change.
+  EXPECT_EQ(0x0000000000000000ULL, StringHash(""));
+  EXPECT_EQ(0x64C54CB7755628AAULL, StringHash("a"));
+  EXPECT_EQ(0x2478D803A0F2FB47ULL, StringHash("abcdefgh"));
+  EXPECT_EQ(0xD61C28EA9FFC5E10ULL, StringHash("abcdefghi"));
+  EXPECT_EQ(0x8E52A254CDF45D92ULL, StringHash("The quick brown fox"));
+}
+
+TEST(KeyHashTest, ZeroBytesChangeHash) {
+  // Keys made of zeros differ only in their sizes.
+  std::set<uint64_t> hashes;
+  for (size_t size = 0; size < 32; ++size)
+    hashes.insert(StringHash(std::string(size, '\0')));
+  EXPECT_EQ(32U, hashes.size());
+}
+
+TEST(KeyHashTest, LowBitsSpreadKeys) {
+  // Hashed spaces use the hashes' low bits to pick buckets, so sequential keys
+  // must be spread evenly across buckets.
+  constexpr size_t kBucketCount = 64;
+  constexpr size_t kKeyCount = kBucketCount * 256;
+  std::vector<size_t> bucket_sizes(kBucketCount, 0);
+  for (size_t i = 0; i < kKeyCount; ++i)
+    ++bucket_sizes[StringHash("key " + std::to_string(i)) % kBucketCount];
+
+  for (size_t bucket_size : bucket_sizes) {
+    EXPECT_LT(256U / 2, bucket_size);
+    EXPECT_GT(256U * 2, bucket_size);
+  }
+}
+
+}  // namespace berrydb
@@ -0,0 +1,188 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_KEY_HINTS_H_
+#define BERRYDB_UTIL_KEY_HINTS_H_
+
+#include "berrydb/platform.h"
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./checks.h"
+#include "./endianness.h"
+
+#if defined(__AVX2__)
+#define BERRYDB_KEY_HINTS_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BERRYDB_KEY_HINTS_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define BERRYDB_KEY_HINTS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace berrydb {
+
+/** Key hints are fixed-width integers that summarize variable-length keys.
+ *
+ * A key's hint is its first 4 bytes, read as a big-endian number. Shorter keys
+ * are padded with zeros. Hints preserve key order, in the sense that a key with
+ * a smaller hint is always smaller. Keys with equal hints must be compared in
+ * full.
+ *
+ * B+tree nodes store a sorted array of hints next to their entries. Searches
+ * narrow down the candidate entries by scanning the hint array, which is dense
+ * and can be compared using vector instructions.
+ */
+
+/** The number of bytes in a key hint. */
+constexpr size_t kKeyHintSize = 4;
+
+/** Computes the hint for a key. */
+inline uint32_t KeyHint(span<const uint8_t> key) noexcept {
+  uint32_t hint = 0;
+  const size_t size = (key.size() < kKeyHintSize) ? key.size() : kKeyHintSize;
+  for (size_t i = 0; i < size; ++i)
+    hint |= static_cast<uint32_t>(key[i]) << (24 - 8 * i);
+  return hint;
+}
+
+/** Number of hints that the vectorized search compares linearly.
+ *
+ * The search uses binary search to narrow down larger arrays. */
+constexpr size_t kKeyHintScanSize = 16;
+
+/** Counts the hints in a sorted array that are smaller than a given hint.
+ *
+ * This is the portable implementation of KeyHintLowerBound(). It is always
+ * available, so it can serve as a reference in tests and benchmarks.
+ *
+ * @param  hints the hint array; must be 4-byte-aligned
+ * @param  count the number of hints in the array
+ * @param  hint  the hint to look for
+ * @return       the index of the first hint that is not smaller than the given
+ *               hint, or count if all the hints are smaller
+ */
+inline size_t KeyHintLowerBoundPortable(
+    span<const uint8_t> hints, size_t count, uint32_t hint) noexcept {
+  BERRYDB_ASSUME_LE(count * kKeyHintSize, hints.size());
+
+  size_t first = 0;
+  while (count > 0) {
+    const size_t half = count / 2;
+    const size_t middle = first + half;
+    if (LoadUint32(hints.subspan(middle * kKeyHintSize, kKeyHintSize)) <
+        hint) {
+      first = middle + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+/** Counts the hints in a small block that are smaller than a given hint.
+ *
+ * @param  hints points to the first hint in the block
+ * @param  count the number of hints in the block
+ * @param  hint  the hint to look for
+ * @return       the number of hints in the block that are smaller than hint
+ */
+inline size_t CountSmallerKeyHints(const uint8_t* hints, size_t count,
+                                   uint32_t hint) noexcept {
+  size_t smaller = 0;
+  size_t i = 0;
+#if defined(BERRYDB_KEY_HINTS_AVX2)
+  // AVX2 only has signed comparisons. Flipping the sign bits turns unsigned
+  // order into signed order.
+  const __m256i sign_bits = _mm256_set1_epi32(INT32_MIN);
+  const __m256i needle = _mm256_xor_si256(
+      _mm256_set1_epi32(static_cast<int32_t>(hint)), sign_bits);
+  __m256i totals = _mm256_setzero_si256();
+  for (; i + 8 <= count; i += 8) {
+    const __m256i block = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hints + i * 4)),
+        sign_bits);
+    // Each lane is -1 if the lane's hint is smaller than the needle.
+    totals = _mm256_sub_epi32(totals, _mm256_cmpgt_epi32(needle, block));
+  }
+  alignas(32) uint32_t lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), totals);
+  for (size_t lane = 0; lane < 8; ++lane)
+    smaller += lanes[lane];
+#elif defined(BERRYDB_KEY_HINTS_SSE2)
+  // SSE2 only has signed comparisons. Flipping the sign bits turns unsigned
+  // order into signed order.
+  const __m128i sign_bits = _mm_set1_epi32(INT32_MIN);
+  const __m128i needle = _mm_xor_si128(
+      _mm_set1_epi32(static_cast<int32_t>(hint)), sign_bits);
+  __m128i totals = _mm_setzero_si128();
+  for (; i + 4 <= count; i += 4) {
+    const __m128i block = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hints + i * 4)),
+        sign_bits);
+    // Each lane is -1 if the lane's hint is smaller than the needle.
+    totals = _mm_sub_epi32(totals, _mm_cmplt_epi32(block, needle));
+  }
+  alignas(16) uint32_t lanes[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), totals);
+  smaller += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(BERRYDB_KEY_HINTS_NEON)
+  const uint32x4_t needle = vdupq_n_u32(hint);
+  uint32x4_t totals = vdupq_n_u32(0);
+  for (; i + 4 <= count; i += 4) {
+    const uint32x4_t block =
+        vld1q_u32(reinterpret_cast<const uint32_t*>(hints + i * 4));
+    // Each lane is all ones (-1) if the lane's hint is smaller than the needle.
+    totals = vsubq_u32(totals, vcltq_u32(block, needle));
+  }
+  smaller += vaddvq_u32(totals);
+#endif  // defined(BERRYDB_KEY_HINTS_AVX2)
+
+  for (; i < count; ++i) {
+    if (LoadUint32(span<const uint8_t>(hints + i * 4, kKeyHintSize)) < hint)
+      ++smaller;
+  }
+  return smaller;
+}
+
+/** Counts the hints in a sorted array that are smaller than a given hint.
+ *
+ * Large arrays are narrowed down using binary search. The last
+ * kKeyHintScanSize candidates are compared using vector instructions, when the
+ * platform has them.
+ *
+ * @param  hints the hint array; must be 4-byte-aligned
+ * @param  count the number of hints in the array
+ * @param  hint  the hint to look for
+ * @return       the index of the first hint that is not smaller than the given
+ *               hint, or count if all the hints are smaller
+ */
+inline size_t KeyHintLowerBound(span<const uint8_t> hints, size_t count,
+                                uint32_t hint) noexcept {
+  BERRYDB_ASSUME_LE(count * kKeyHintSize, hints.size());
+  if (!kPlatformUint32IsNative)
+    return KeyHintLowerBoundPortable(hints, count, hint);
+
+  size_t first = 0;
+  while (count > kKeyHintScanSize) {
+    const size_t half = count / 2;
+    const size_t middle = first + half;
+    if (LoadUint32(hints.subspan(middle * kKeyHintSize, kKeyHintSize)) <
+        hint) {
+      first = middle + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first + CountSmallerKeyHints(hints.data() + first * kKeyHintSize,
+                                      count, hint);
+}
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_KEY_HINTS_H_
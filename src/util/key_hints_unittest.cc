@@ -0,0 +1,82 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./key_hints.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "./endianness.h"
+
+namespace berrydb {
+
+namespace {
+
+uint32_t StringHint(const std::string& key) {
+  return KeyHint(span<const uint8_t>(
+      reinterpret_cast<const uint8_t*>(key.data()), key.size()));
+}
+
+}  // namespace
+
+TEST(KeyHintsTest, KeyHint) {
+  EXPECT_EQ(0U, StringHint(""));
+  EXPECT_EQ(0x61000000U, StringHint("a"));
+  EXPECT_EQ(0x61626364U, StringHint("abcd"));
+  EXPECT_EQ(0x61626364U, StringHint("abcdef"));
+  EXPECT_EQ(0xFFFFFFFFU, StringHint("\xff\xff\xff\xff"));
+}
+
+TEST(KeyHintsTest, KeyHintPreservesOrder) {
+  const std::string keys[] = {
+    "", "a", "ab", "abc", "abcd", "abcde", "abd", "b", "ba", "\x7f", "\x80",
+    "\xff",
+  };
+  for (size_t i = 1; i < sizeof(keys) / sizeof(keys[0]); ++i)
+    EXPECT_LE(StringHint(keys[i - 1]), StringHint(keys[i])) << i;
+  EXPECT_LT(StringHint("\x7f"), StringHint("\x80"));
+}
+
+TEST(KeyHintsTest, LowerBoundMatchesPortableVersion) {
+  std::mt19937 rnd;
+  // Small values produce duplicate hints. Large values exercise the sign bit,
+  // which vector instructions treat specially.
+  std::uniform_int_distribution<uint32_t> small_distribution(0, 20);
+  std::uniform_int_distribution<uint32_t> large_distribution(
+      0x7FFFFFF0, 0x80000010);
+
+  for (size_t count = 0; count < 100; ++count) {
+    for (int round = 0; round < 2; ++round) {
+      std::vector<uint32_t> values(count);
+      for (uint32_t& value : values) {
+        value = (round == 0) ? small_distribution(rnd)
+                             : large_distribution(rnd);
+      }
+      std::sort(values.begin(), values.end());
+
+      alignas(4) uint8_t buffer[100 * kKeyHintSize];
+      const span<uint8_t> hints(buffer, count * kKeyHintSize);
+      for (size_t i = 0; i < count; ++i)
+        StoreUint32(values[i], hints.subspan(i * kKeyHintSize, kKeyHintSize));
+
+      for (int probe = 0; probe < 30; ++probe) {
+        const uint32_t hint = (round == 0) ? small_distribution(rnd)
+                                           : large_distribution(rnd);
+        const size_t expected = static_cast<size_t>(
+            std::lower_bound(values.begin(), values.end(), hint) -
+            values.begin());
+        EXPECT_EQ(expected, KeyHintLowerBoundPortable(hints, count, hint));
+        EXPECT_EQ(expected, KeyHintLowerBound(hints, count, hint));
+      }
+      EXPECT_EQ(0U, KeyHintLowerBound(hints, count, 0));
+      EXPECT_EQ(count, KeyHintLowerBound(hints, count, 0xFFFFFFFF));
+    }
+  }
+}
+
+}  // namespace berrydb
@@ -0,0 +1,124 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_UTIL_READER_WRITER_LATCH_H_
+#define BERRYDB_UTIL_READER_WRITER_LATCH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "berrydb/platform.h"
+#include "./checks.h"
+
+namespace berrydb {
+
+/** Short-term lock protecting the physical consistency of a data structure.
+ *
+ * A latch can be held by any number of readers, or by a single writer. Unlike
+ * transactional locks, latches are held for very short periods, such as while
+ * copying a page's data, so waiters spin instead of sleeping. The latch does not
+ * detect deadlocks, so latches must be acquired in a consistent order.
+ *
+ * Latches do not prefer writers, so a steady stream of readers can delay a
+ * writer. This is acceptable because latches are not held across I/O.
+ */
+class ReaderWriterLatch {
+ public:
+  inline constexpr ReaderWriterLatch() noexcept : state_(0) {}
+  inline ~ReaderWriterLatch() noexcept {
+    BERRYDB_ASSUME_EQ(state_.load(std::memory_order_relaxed), 0U);
+  }
+
+  ReaderWriterLatch(const ReaderWriterLatch&) = delete;
+  ReaderWriterLatch(ReaderWriterLatch&&) = delete;
+  ReaderWriterLatch& operator=(const ReaderWriterLatch&) = delete;
+  ReaderWriterLatch& operator=(ReaderWriterLatch&&) = delete;
+
+  /** Attempts to acquire the latch in shared mode, without waiting. */
+  inline bool TryLockShared() noexcept {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return (state & kWriterBit) == 0 &&
+        state_.compare_exchange_weak(state, state + 1,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed);
+  }
+
+  /** Acquires the latch in shared mode. */
+  inline void LockShared() noexcept {
+    while (UNLIKELY(!TryLockShared()))
+      std::this_thread::yield();
+  }
+
+  /** Releases a latch acquired in shared mode. */
+  inline void UnlockShared() noexcept {
+    MAYBE_UNUSED const uint32_t old_state =
+        state_.fetch_sub(1, std::memory_order_release);
+    BERRYDB_ASSUME_NE(old_state & kReaderMask, 0U);
+  }
+
+  /** Attempts to acquire the latch in exclusive mode, without waiting. */
+  inline bool TryLockExclusive() noexcept {
+    uint32_t state = 0;
+    return state_.compare_exchange_weak(state, kWriterBit,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed);
+  }
+
+  /** Acquires the latch in exclusive mode. */
+  inline void LockExclusive() noexcept {
+    while (UNLIKELY(!TryLockExclusive()))
+      std::this_thread::yield();
+  }
+
+  /** Releases a latch acquired in exclusive mode. */
+  inline void UnlockExclusive() noexcept {
+    BERRYDB_ASSUME_EQ(state_.load(std::memory_order_relaxed), kWriterBit);
+    state_.store(0, std::memory_order_release);
+  }
+
+ private:
+  /** Set while the latch is held in exclusive mode. */
+  static constexpr uint32_t kWriterBit = 0x80000000;
+  /** The bits counting the readers that hold the latch. */
+  static constexpr uint32_t kReaderMask = kWriterBit - 1;
+
+  std::atomic<uint32_t> state_;
+};
+
+/** Holds a latch in shared mode for the lifetime of the instance. */
+class SharedLatchGuard {
+ public:
+  inline explicit SharedLatchGuard(ReaderWriterLatch* latch) noexcept
+      : latch_(latch) {
+    latch_->LockShared();
+  }
+  inline ~SharedLatchGuard() noexcept { latch_->UnlockShared(); }
+
+  SharedLatchGuard(const SharedLatchGuard&) = delete;
+  SharedLatchGuard& operator=(const SharedLatchGuard&) = delete;
+
+ private:
+  ReaderWriterLatch* const latch_;
+};
+
+/** Holds a latch in exclusive mode for the lifetime of the instance. */
+class ExclusiveLatchGuard {
+ public:
+  inline explicit ExclusiveLatchGuard(ReaderWriterLatch* latch) noexcept
+      : latch_(latch) {
+    latch_->LockExclusive();
+  }
+  inline ~ExclusiveLatchGuard() noexcept { latch_->UnlockExclusive(); }
+
+  ExclusiveLatchGuard(const ExclusiveLatchGuard&) = delete;
+  ExclusiveLatchGuard& operator=(const ExclusiveLatchGuard&) = delete;
+
+ private:
+  ReaderWriterLatch* const latch_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_UTIL_READER_WRITER_LATCH_H_
@@ -0,0 +1,65 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./reader_writer_latch.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+TEST(ReaderWriterLatchTest, SharedExcludesExclusive) {
+  ReaderWriterLatch latch;
+  EXPECT_TRUE(latch.TryLockShared());
+  EXPECT_TRUE(latch.TryLockShared());
+  EXPECT_FALSE(latch.TryLockExclusive());
+  latch.UnlockShared();
+  EXPECT_FALSE(latch.TryLockExclusive());
+  latch.UnlockShared();
+
+  EXPECT_TRUE(latch.TryLockExclusive());
+  EXPECT_FALSE(latch.TryLockShared());
+  EXPECT_FALSE(latch.TryLockExclusive());
+  latch.UnlockExclusive();
+  EXPECT_TRUE(latch.TryLockShared());
+  latch.UnlockShared();
+}
+
+TEST(ReaderWriterLatchTest, ExclusiveSectionsDoNotInterleave) {
+  constexpr size_t kThreadCount = 4;
+  constexpr size_t kIterations = 10000;
+
+  ReaderWriterLatch latch;
+  // The writers keep the two counters equal. Readers check that they never see
+  // a half-finished update.
+  size_t counters[2] = {0, 0};
+  bool readers_saw_mismatch = false;
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&latch, &counters, &readers_saw_mismatch, i] {
+      for (size_t j = 0; j < kIterations; ++j) {
+        if (i % 2 == 0) {
+          ExclusiveLatchGuard guard(&latch);
+          ++counters[0];
+          ++counters[1];
+        } else {
+          SharedLatchGuard guard(&latch);
+          if (counters[0] != counters[1])
+            readers_saw_mismatch = true;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  EXPECT_FALSE(readers_saw_mismatch);
+  EXPECT_EQ(kIterations * (kThreadCount / 2), counters[0]);
+  EXPECT_EQ(counters[0], counters[1]);
+}
+
+}  // namespace berrydb
@@ -0,0 +1,568 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./value_log.h"
+
+#include <algorithm>
+
+#include "berrydb/platform.h"
+#include "berrydb/status.h"
+#include "./btree.h"
+#include "./free_page_manager.h"
+#include "./page_pool.h"
+#include "./pinned_page.h"
+#include "./read_transaction_impl.h"
+#include "./store_impl.h"
+#include "./transaction_impl.h"
+#include "./util/checks.h"
+#include "./util/endianness.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+constexpr size_t ValueLog::kReferenceSize;
+constexpr size_t ValueLog::kSegmentPageCount;
+constexpr size_t ValueLog::kPageHeaderSize;
+constexpr size_t ValueLog::kRecordHeaderSize;
+
+namespace {
+
+constexpr size_t kOldestSegmentOffset = 0;
+constexpr size_t kNewestSegmentOffset = 8;
+constexpr size_t kAppendPageOffset = 16;
+constexpr size_t kReusableSegmentOffset = 24;
+
+constexpr size_t kUsedSizeOffset = 0;
+constexpr size_t kNextSegmentOffset = 8;
+
+/** Calls a function on a log page's content, as seen by a write transaction.
+ *
+ * @return the function's result, or the error encountered while fetching the
+ *         page
+ */
+template <typename Function>
+Status VisitLogPage(TransactionImpl* transaction, size_t page_id,
+                    Function&& function) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  Status status;
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+  return function(transaction->PageData(page.get(), page_pool->page_size()));
+}
+
+/** Calls a function on a log page's content, as of a read snapshot.
+ *
+ * @return the function's result, or the error encountered while reading the
+ *         page
+ */
+template <typename Function>
+Status VisitLogPage(ReadTransactionImpl* transaction, size_t page_id,
+                    Function&& function) {
+  Status status;
+  span<const uint8_t> page_data;
+  std::tie(status, page_data) = transaction->ReadPage(page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  return function(page_data);
+}
+
+/** ValueLog::ReadReferencedValue() implementation. */
+template <typename TransactionType>
+Status ReadReferencedValueImpl(TransactionType* transaction,
+                               ValueLog::ValueBuffer* value) {
+  Status status;
+  size_t page_id, record_offset;
+  std::tie(status, page_id, record_offset) = ValueLog::DecodeReference(
+      transaction->store(), span<const uint8_t>(value->data(), value->size()));
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  return VisitLogPage(transaction, page_id,
+                      [&](span<const uint8_t> page) -> Status {
+    Status record_status;
+    span<const uint8_t> record_key, record_value;
+    std::tie(record_status, record_key, record_value) =
+        ValueLog::DecodeRecord(page, record_offset);
+    if (UNLIKELY(record_status != Status::kSuccess))
+      return record_status;
+    value->assign(record_value.begin(), record_value.end());
+    return Status::kSuccess;
+  });
+}
+
+/** ValueLog::ReadRange() implementation. */
+template <typename TransactionType>
+std::tuple<Status, size_t> ReadRangeImpl(
+    TransactionType* transaction, span<const uint8_t> reference,
+    size_t offset, span<uint8_t> buffer) {
+  Status status;
+  size_t page_id, record_offset;
+  std::tie(status, page_id, record_offset) =
+      ValueLog::DecodeReference(transaction->store(), reference);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, 0};
+
+  size_t value_size = 0;
+  status = VisitLogPage(transaction, page_id,
+                        [&](span<const uint8_t> page) -> Status {
+    Status record_status;
+    span<const uint8_t> record_key, record_value;
+    std::tie(record_status, record_key, record_value) =
+        ValueLog::DecodeRecord(page, record_offset);
+    if (UNLIKELY(record_status != Status::kSuccess))
+      return record_status;
+    value_size = record_value.size();
+    if (offset < value_size) {
+      const size_t size = std::min(buffer.size(), value_size - offset);
+      CopySpan(record_value.subspan(offset, size), buffer.first(size));
+    }
+    return Status::kSuccess;
+  });
+  return {status, value_size};
+}
+
+}  // namespace
+
+// static
+std::tuple<Status, ValueLog> ValueLog::Create(TransactionImpl* transaction,
+                                              size_t threshold) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME_GT(threshold, 0U);
+
+  // The log's segments are allocated by the first append.
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t header_page_id =
+      store->free_page_manager()->AllocPage(transaction, transaction);
+  if (UNLIKELY(header_page_id == FreePageManager::kInvalidPageId))
+    return {Status::kIoError, ValueLog()};
+  Status status;
+  Page* raw_page;
+  std::tie(status, raw_page) = page_pool->StorePage(
+      store, header_page_id, PagePool::kIgnorePageData);
+  if (UNLIKELY(status != Status::kSuccess))
+    return {status, ValueLog()};
+  const PinnedPage page(raw_page, page_pool);
+  FillSpan(transaction->NewPageData(page.get(), page_pool->page_size()), 0);
+  return {Status::kSuccess, ValueLog(header_page_id, threshold)};
+}
+
+Status ValueLog::Append(TransactionImpl* transaction, span<const uint8_t> key,
+                        size_t value_size, span<const uint8_t> data,
+                        span<uint8_t> reference) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+  BERRYDB_ASSUME_LE(data.size(), value_size);
+  BERRYDB_ASSUME_EQ(reference.size(), kReferenceSize);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  const size_t record_size = kRecordHeaderSize + key.size() + value_size;
+  BERRYDB_ASSUME_LE(kPageHeaderSize + record_size, page_size);
+
+  Status status;
+  Page* raw_header_page;
+  std::tie(status, raw_header_page) = store->FetchPage(header_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage header_page(raw_header_page, page_pool);
+  const span<const uint8_t> header =
+      transaction->PageData(header_page.get(), page_size);
+
+  size_t newest_segment_id, append_page_id;
+  if (LoadUint64(header.subspan(kOldestSegmentOffset, 8)) == 0) {
+    const span<uint8_t> mutable_header =
+        transaction->MutablePageData(header_page.get(), page_size);
+    std::tie(status, newest_segment_id) =
+        TakeSegment(transaction, mutable_header);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    append_page_id = newest_segment_id;
+    StoreUint64(newest_segment_id,
+                mutable_header.subspan(kOldestSegmentOffset, 8));
+    StoreUint64(newest_segment_id,
+                mutable_header.subspan(kNewestSegmentOffset, 8));
+    StoreUint64(append_page_id, mutable_header.subspan(kAppendPageOffset, 8));
+  } else {
+    newest_segment_id = BTree::CheckedChildId(
+        store, LoadUint64(header.subspan(kNewestSegmentOffset, 8)));
+    append_page_id = BTree::CheckedChildId(
+        store, LoadUint64(header.subspan(kAppendPageOffset, 8)));
+    if (UNLIKELY(newest_segment_id == 0 ||
+                 append_page_id < newest_segment_id ||
+                 append_page_id - newest_segment_id >= kSegmentPageCount)) {
+      return Status::kDataCorrupted;
+    }
+  }
+
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(append_page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  size_t used_size = LoadUint32(transaction->PageData(raw_page, page_size)
+                                    .subspan(kUsedSizeOffset, 4));
+  if (UNLIKELY(used_size > page_size - kPageHeaderSize)) {
+    page_pool->UnpinStorePage(raw_page);
+    return Status::kDataCorrupted;
+  }
+
+  if (kPageHeaderSize + used_size + record_size > page_size) {
+    // The record goes to the next page, which may be in a new segment.
+    page_pool->UnpinStorePage(raw_page);
+    const span<uint8_t> mutable_header =
+        transaction->MutablePageData(header_page.get(), page_size);
+    if (append_page_id - newest_segment_id + 1 < kSegmentPageCount) {
+      ++append_page_id;
+    } else {
+      size_t segment_id;
+      std::tie(status, segment_id) = TakeSegment(transaction, mutable_header);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+
+      Page* raw_segment_page;
+      std::tie(status, raw_segment_page) = store->FetchPage(newest_segment_id);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      const PinnedPage segment_page(raw_segment_page, page_pool);
+      StoreUint64(segment_id,
+                  transaction->MutablePageData(segment_page.get(), page_size)
+                      .subspan(kNextSegmentOffset, 8));
+      StoreUint64(segment_id, mutable_header.subspan(kNewestSegmentOffset, 8));
+      append_page_id = segment_id;
+    }
+    StoreUint64(append_page_id, mutable_header.subspan(kAppendPageOffset, 8));
+
+    // Segment pages are zeroed when the segment is taken, so the page is empty.
+    std::tie(status, raw_page) = store->FetchPage(append_page_id);
+    if (UNLIKELY(status != Status::kSuccess))
+      return status;
+    used_size = 0;
+  }
+  const PinnedPage page(raw_page, page_pool);
+
+  const size_t record_offset = kPageHeaderSize + used_size;
+  const span<uint8_t> record =
+      transaction->MutablePageData(page.get(), page_size)
+          .subspan(record_offset, record_size);
+  // Records are not aligned, so their headers are built in an aligned buffer.
+  alignas(4) uint8_t record_header[kRecordHeaderSize];
+  const span<uint8_t> aligned_header(record_header);
+  StoreUint16(static_cast<uint16_t>(key.size()), aligned_header.subspan(0, 2));
+  StoreUint16(static_cast<uint16_t>(value_size), aligned_header.subspan(2, 2));
+  CopySpan(aligned_header, record.subspan(0, kRecordHeaderSize));
+  CopySpan(key, record.subspan(kRecordHeaderSize, key.size()));
+  const span<uint8_t> value =
+      record.subspan(kRecordHeaderSize + key.size(), value_size);
+  CopySpan(data, value.first(data.size()));
+  FillSpan(value.subspan(data.size()), 0);
+  StoreUint32(static_cast<uint32_t>(used_size + record_size),
+              transaction->MutablePageData(page.get(), page_size)
+                  .subspan(kUsedSizeOffset, 4));
+
+  EncodeReference(append_page_id, record_offset, reference);
+  return Status::kSuccess;
+}
+
+// static
+Status ValueLog::ReadReferencedValue(TransactionImpl* transaction,
+                                     ValueBuffer* value) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+  return ReadReferencedValueImpl(transaction, value);
+}
+
+// static
+Status ValueLog::ReadReferencedValue(ReadTransactionImpl* transaction,
+                                     ValueBuffer* value) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(value != nullptr);
+  return ReadReferencedValueImpl(transaction, value);
+}
+
+// static
+std::tuple<Status, size_t> ValueLog::ReadRange(
+    TransactionImpl* transaction, span<const uint8_t> reference, size_t offset,
+    span<uint8_t> buffer) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  return ReadRangeImpl(transaction, reference, offset, buffer);
+}
+
+// static
+std::tuple<Status, size_t> ValueLog::ReadRange(
+    ReadTransactionImpl* transaction, span<const uint8_t> reference,
+    size_t offset, span<uint8_t> buffer) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  return ReadRangeImpl(transaction, reference, offset, buffer);
+}
+
+// static
+Status ValueLog::Write(TransactionImpl* transaction,
+                       span<const uint8_t> reference, size_t offset,
+                       span<const uint8_t> data) {
+  BERRYDB_ASSUME(transaction != nullptr);
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+  size_t page_id, record_offset;
+  std::tie(status, page_id, record_offset) =
+      DecodeReference(store, reference);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  Page* raw_page;
+  std::tie(status, raw_page) = store->FetchPage(page_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage page(raw_page, page_pool);
+
+  const span<const uint8_t> page_data =
+      transaction->PageData(page.get(), page_size);
+  span<const uint8_t> record_key, record_value;
+  std::tie(status, record_key, record_value) =
+      DecodeRecord(page_data, record_offset);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  if (UNLIKELY(offset > record_value.size() ||
+               data.size() > record_value.size() - offset)) {
+    return Status::kTooLarge;
+  }
+
+  const size_t value_offset = static_cast<size_t>(
+      record_value.data() - page_data.data());
+  CopySpan(data, transaction->MutablePageData(page.get(), page_size).subspan(
+      value_offset + offset, data.size()));
+  return Status::kSuccess;
+}
+
+// static
+void ValueLog::EncodeReference(size_t page_id, size_t offset,
+                               span<uint8_t> reference) noexcept {
+  BERRYDB_ASSUME_EQ(reference.size(), kReferenceSize);
+
+  // References are stored in leaf entries, which are not 8-byte aligned.
+  alignas(8) uint8_t buffer[kReferenceSize];
+  const span<uint8_t> aligned(buffer);
+  StoreUint64(static_cast<uint64_t>(page_id), aligned.subspan(0, 8));
+  StoreUint32(static_cast<uint32_t>(offset), aligned.subspan(8, 4));
+  CopySpan(aligned, reference);
+}
+
+// static
+std::tuple<Status, size_t, size_t> ValueLog::DecodeReference(
+    StoreImpl* store, span<const uint8_t> reference) noexcept {
+  if (UNLIKELY(reference.size() != kReferenceSize))
+    return {Status::kDataCorrupted, 0, 0};
+
+  alignas(8) uint8_t buffer[kReferenceSize];
+  const span<uint8_t> aligned(buffer);
+  CopySpan(reference, aligned);
+  const size_t page_id =
+      BTree::CheckedChildId(store, LoadUint64(aligned.subspan(0, 8)));
+  const size_t offset = LoadUint32(aligned.subspan(8, 4));
+  if (UNLIKELY(page_id == 0 || offset < kPageHeaderSize))
+    return {Status::kDataCorrupted, 0, 0};
+  return {Status::kSuccess, page_id, offset};
+}
+
+// static
+std::tuple<Status, span<const uint8_t>, span<const uint8_t>>
+ValueLog::DecodeRecord(span<const uint8_t> page, size_t offset) noexcept {
+  const size_t end = PageEnd(page);
+  if (UNLIKELY(end > page.size() || offset < kPageHeaderSize ||
+               offset >= end || end - offset < kRecordHeaderSize)) {
+    return {Status::kDataCorrupted, span<const uint8_t>(),
+            span<const uint8_t>()};
+  }
+
+  const span<const uint8_t> record = page.subspan(offset, end - offset);
+  alignas(4) uint8_t record_header[kRecordHeaderSize];
+  const span<uint8_t> aligned_header(record_header);
+  CopySpan(record.first(kRecordHeaderSize), aligned_header);
+  const size_t key_size = LoadUint16(aligned_header.subspan(0, 2));
+  const size_t value_size = LoadUint16(aligned_header.subspan(2, 2));
+  if (UNLIKELY(kRecordHeaderSize + key_size + value_size > record.size())) {
+    return {Status::kDataCorrupted, span<const uint8_t>(),
+            span<const uint8_t>()};
+  }
+  return {Status::kSuccess, record.subspan(kRecordHeaderSize, key_size),
+          record.subspan(kRecordHeaderSize + key_size, value_size)};
+}
+
+// static
+size_t ValueLog::PageEnd(span<const uint8_t> page) noexcept {
+  return kPageHeaderSize + LoadUint32(page.subspan(kUsedSizeOffset, 4));
+}
+
+std::tuple<Status, size_t, size_t> ValueLog::Segments(
+    TransactionImpl* transaction) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  StoreImpl* const store = transaction->store();
+  size_t oldest_segment_id = 0, newest_segment_id = 0;
+  const Status status = VisitLogPage(transaction, header_page_id_,
+                                     [&](span<const uint8_t> header) {
+    const uint64_t oldest_segment_id64 =
+        LoadUint64(header.subspan(kOldestSegmentOffset, 8));
+    if (oldest_segment_id64 == 0)
+      return Status::kSuccess;
+    oldest_segment_id = BTree::CheckedChildId(store, oldest_segment_id64);
+    newest_segment_id = BTree::CheckedChildId(
+        store, LoadUint64(header.subspan(kNewestSegmentOffset, 8)));
+    if (UNLIKELY(oldest_segment_id == 0 || newest_segment_id == 0))
+      return Status::kDataCorrupted;
+    return Status::kSuccess;
+  });
+  return {status, oldest_segment_id, newest_segment_id};
+}
+
+Status ValueLog::RecycleOldestSegment(TransactionImpl* transaction) {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+  Page* raw_header_page;
+  std::tie(status, raw_header_page) = store->FetchPage(header_page_id_);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage header_page(raw_header_page, page_pool);
+  const span<const uint8_t> header =
+      transaction->PageData(header_page.get(), page_size);
+
+  const size_t segment_id = BTree::CheckedChildId(
+      store, LoadUint64(header.subspan(kOldestSegmentOffset, 8)));
+  if (UNLIKELY(segment_id == 0 ||
+               segment_id == LoadUint64(
+                   header.subspan(kNewestSegmentOffset, 8)))) {
+    return Status::kDataCorrupted;
+  }
+  const uint64_t reusable_segment_id64 =
+      LoadUint64(header.subspan(kReusableSegmentOffset, 8));
+
+  Page* raw_segment_page;
+  std::tie(status, raw_segment_page) = store->FetchPage(segment_id);
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+  const PinnedPage segment_page(raw_segment_page, page_pool);
+  const uint64_t next_segment_id64 = LoadUint64(
+      transaction->PageData(segment_page.get(), page_size)
+          .subspan(kNextSegmentOffset, 8));
+  if (UNLIKELY(BTree::CheckedChildId(store, next_segment_id64) == 0))
+    return Status::kDataCorrupted;
+
+  // The segment's next link is reused to chain the reusable segments.
+  StoreUint64(reusable_segment_id64,
+              transaction->MutablePageData(segment_page.get(), page_size)
+                  .subspan(kNextSegmentOffset, 8));
+  const span<uint8_t> mutable_header =
+      transaction->MutablePageData(header_page.get(), page_size);
+  StoreUint64(next_segment_id64,
+              mutable_header.subspan(kOldestSegmentOffset, 8));
+  StoreUint64(segment_id, mutable_header.subspan(kReusableSegmentOffset, 8));
+  return Status::kSuccess;
+}
+
+Status ValueLog::Free(TransactionImpl* transaction) const {
+  BERRYDB_ASSUME(transaction != nullptr);
+  BERRYDB_ASSUME(exists());
+
+  StoreImpl* const store = transaction->store();
+  FreePageManager* const free_page_manager = store->free_page_manager();
+  uint64_t chain_heads64[2] = {0, 0};
+  Status status = VisitLogPage(transaction, header_page_id_,
+                               [&](span<const uint8_t> header) {
+    chain_heads64[0] = LoadUint64(header.subspan(kOldestSegmentOffset, 8));
+    chain_heads64[1] = LoadUint64(header.subspan(kReusableSegmentOffset, 8));
+    return Status::kSuccess;
+  });
+  if (UNLIKELY(status != Status::kSuccess))
+    return status;
+
+  // The log's chain and the reusable segments' chain both end with a 0 link.
+  // A chain with more segments than the store has pages has a cycle.
+  const size_t max_chain_size = free_page_manager->page_count();
+  for (uint64_t segment_id64 : chain_heads64) {
+    for (size_t chain_size = 0; segment_id64 != 0; ++chain_size) {
+      if (UNLIKELY(chain_size == max_chain_size))
+        return Status::kDataCorrupted;
+      const size_t segment_id = BTree::CheckedChildId(store, segment_id64);
+      if (UNLIKELY(segment_id == 0 ||
+                   BTree::CheckedChildId(
+                       store, segment_id64 + kSegmentPageCount - 1) == 0)) {
+        return Status::kDataCorrupted;
+      }
+      status = VisitLogPage(transaction, segment_id,
+                            [&](span<const uint8_t> page) {
+        segment_id64 = LoadUint64(page.subspan(kNextSegmentOffset, 8));
+        return Status::kSuccess;
+      });
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+      status = free_page_manager->FreePages(segment_id, kSegmentPageCount,
+                                            transaction, transaction);
+      if (UNLIKELY(status != Status::kSuccess))
+        return status;
+    }
+  }
+  return free_page_manager->FreePage(header_page_id_, transaction,
+                                     transaction);
+}
+
+std::tuple<Status, size_t> ValueLog::TakeSegment(TransactionImpl* transaction,
+                                                 span<uint8_t> header) {
+  StoreImpl* const store = transaction->store();
+  PagePool* const page_pool = store->page_pool();
+  const size_t page_size = page_pool->page_size();
+  Status status;
+
+  size_t segment_id;
+  const uint64_t reusable_segment_id64 =
+      LoadUint64(header.subspan(kReusableSegmentOffset, 8));
+  if (reusable_segment_id64 != 0) {
+    segment_id = BTree::CheckedChildId(store, reusable_segment_id64);
+    if (UNLIKELY(segment_id == 0))
+      return {Status::kDataCorrupted, 0};
+    uint64_t next_segment_id64 = 0;
+    status = VisitLogPage(transaction, segment_id,
+                          [&](span<const uint8_t> page) {
+      next_segment_id64 = LoadUint64(page.subspan(kNextSegmentOffset, 8));
+      return Status::kSuccess;
+    });
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0};
+    StoreUint64(next_segment_id64,
+                header.subspan(kReusableSegmentOffset, 8));
+  } else {
+    segment_id = store->free_page_manager()->AllocPages(
+        kSegmentPageCount, transaction, transaction);
+    if (UNLIKELY(segment_id == FreePageManager::kInvalidPageId))
+      return {Status::kIoError, 0};
+  }
+  if (UNLIKELY(BTree::CheckedChildId(
+          store, segment_id + kSegmentPageCount - 1) == 0)) {
+    return {Status::kDataCorrupted, 0};
+  }
+
+  for (size_t i = 0; i < kSegmentPageCount; ++i) {
+    Page* raw_page;
+    std::tie(status, raw_page) = store->FetchPage(segment_id + i);
+    if (UNLIKELY(status != Status::kSuccess))
+      return {status, 0};
+    const PinnedPage page(raw_page, page_pool);
+    FillSpan(transaction->NewPageData(page.get(), page_size), 0);
+  }
+  return {Status::kSuccess, segment_id};
+}
+
+}  // namespace berrydb
@@ -0,0 +1,263 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_VALUE_LOG_H_
+#define BERRYDB_VALUE_LOG_H_
+
+#include <tuple>
+#include <vector>
+
+#include "berrydb/span.h"
+#include "berrydb/types.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class ReadTransactionImpl;
+enum class Status : int;
+class StoreImpl;
+class TransactionImpl;
+
+/** An append-only log that holds a space's mid-sized values.
+ *
+ * Spaces created with SpaceOptions::value_log_threshold keep the values of at
+ * least that size out of their B+tree leaves. A value is appended to the log as
+ * a record, and the value's leaf entry holds a kReferenceSize-byte reference to
+ * the record. The reference is stored like an overflow value reference, and is
+ * told apart by its size, which differs from OverflowValue::kReferenceSize.
+ * Records must fit in a log page, so larger values are still stored in extents.
+ *
+ * The log is made up of segments, which are runs of kSegmentPageCount
+ * consecutive pages. Records are appended to the newest segment, and segments
+ * are chained from oldest to newest. Overwriting or deleting a value leaves its
+ * record behind as garbage. Compaction rewrites the live records of the older
+ * segments at the log's end, and puts the emptied segments on a list of
+ * segments that are reused before new pages are allocated.
+ *
+ * Header page layout:
+ * 0: 64-bit first page ID of the oldest segment; 0 if the log is empty
+ * 8: 64-bit first page ID of the newest segment
+ * 16: 64-bit ID of the page that receives appends, in the newest segment
+ * 24: 64-bit first page ID of the first reusable segment; 0 if there are none
+ *
+ * Log page layout:
+ * 0: 32-bit number of record bytes used in the page
+ * 4: reserved, must be zero
+ * 8: 64-bit first page ID of the next segment in the chain; only used in the
+ *    first page of each segment, 0 for the last segment
+ * 16: records
+ *
+ * Records are not aligned, and consist of a 16-bit key size, a 16-bit value
+ * size, the key bytes, and the value bytes. The key is used by compaction to
+ * find the record's leaf entry. A reference consists of the 64-bit ID of the
+ * record's page, and the 32-bit offset of the record in the page.
+ *
+ * Log pages go through the page pool, so appends are logged and rolled back
+ * together with the transactions that make them, and read transactions see the
+ * pages' old versions. Every append writes the same page, so optimistic
+ * transactions that write logged values conflict with each other.
+ */
+class ValueLog {
+ public:
+  /** The buffer that receives the values read by ReadReferencedValue(). */
+  using ValueBuffer = std::vector<uint8_t, PlatformAllocator<uint8_t>>;
+
+  /** The size of a reference to a record, stored in a leaf entry. */
+  static constexpr size_t kReferenceSize = 12;
+
+  /** The number of pages in a log segment. */
+  static constexpr size_t kSegmentPageCount = 16;
+
+  /** The size of the header at the start of each log page. */
+  static constexpr size_t kPageHeaderSize = 16;
+
+  /** The size of the header at the start of each record. */
+  static constexpr size_t kRecordHeaderSize = 4;
+
+  /** Sets up a handle that does not refer to any log. */
+  constexpr ValueLog() noexcept : header_page_id_(0), threshold_(0) {}
+
+  /** Sets up access to the log whose header is stored in the given page. */
+  constexpr ValueLog(size_t header_page_id, size_t threshold) noexcept
+      : header_page_id_(header_page_id), threshold_(threshold) {}
+
+  /** Creates an empty log.
+   *
+   * @param  transaction the transaction that allocates the log's header page
+   * @param  threshold   the size of the smallest value stored in the log; must
+   *                     be positive
+   * @return status      most likely kSuccess or kIoError
+   * @return value_log   a handle to the new log
+   */
+  static std::tuple<Status, ValueLog> Create(TransactionImpl* transaction,
+                                             size_t threshold);
+
+  /** True if the handle refers to a log. */
+  inline constexpr bool exists() const noexcept { return header_page_id_ != 0; }
+
+  /** The ID of the log's header page. */
+  inline constexpr size_t header_page_id() const noexcept {
+    return header_page_id_;
+  }
+
+  /** The size of the smallest value stored in the log. */
+  inline constexpr size_t threshold() const noexcept { return threshold_; }
+
+  /** True if a value should be stored in the log.
+   *
+   * @param key_size   the size of the value's key
+   * @param value_size the size of the value
+   * @param page_size  the store's page size
+   */
+  inline constexpr bool ShouldStore(size_t key_size, size_t value_size,
+                                    size_t page_size) const noexcept {
+    return exists() && value_size >= threshold_ && key_size <= 0xFFFF &&
+           value_size <= 0xFFFF &&
+           kPageHeaderSize + kRecordHeaderSize + key_size + value_size <=
+               page_size;
+  }
+
+  /** True if the value in a leaf entry is a reference to a log record.
+   *
+   * @param entry_value the value in a leaf entry whose overflow flag is set
+   */
+  static inline constexpr bool IsReference(span<const uint8_t> entry_value)
+      noexcept {
+    return entry_value.size() == kReferenceSize;
+  }
+
+  /** Appends a record to the log.
+   *
+   * @param  transaction the transaction that modifies the log
+   * @param  key         the record's key
+   * @param  value_size  the size of the record's value; ShouldStore() must
+   *                     have accepted the key and value sizes
+   * @param  data        the value's first bytes; the rest of the value is
+   *                     zero-filled
+   * @param  reference   receives a reference to the record; must have
+   *                     kReferenceSize bytes
+   * @return             kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status Append(TransactionImpl* transaction, span<const uint8_t> key,
+                size_t value_size, span<const uint8_t> data,
+                span<uint8_t> reference);
+
+  /** Replaces a reference copied from a leaf entry with the value it refers to.
+   *
+   * @return kSuccess, kDataCorrupted, or an I/O error
+   */
+  static Status ReadReferencedValue(TransactionImpl* transaction,
+                                    ValueBuffer* value);
+  static Status ReadReferencedValue(ReadTransactionImpl* transaction,
+                                    ValueBuffer* value);
+
+  /** Reads a range of the value stored in a record.
+   *
+   * @param  transaction the transaction that reads the value
+   * @param  reference   a reference copied from a leaf entry
+   * @param  offset      the position of the first value byte to be read
+   * @param  buffer      receives the value bytes
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return value_size  the size of the value
+   */
+  static std::tuple<Status, size_t> ReadRange(
+      TransactionImpl* transaction, span<const uint8_t> reference,
+      size_t offset, span<uint8_t> buffer);
+  static std::tuple<Status, size_t> ReadRange(
+      ReadTransactionImpl* transaction, span<const uint8_t> reference,
+      size_t offset, span<uint8_t> buffer);
+
+  /** Overwrites a range of the value stored in a record.
+   *
+   * @param  transaction the transaction that modifies the value
+   * @param  reference   a reference copied from a leaf entry
+   * @param  offset      the position of the first value byte to be written
+   * @param  data        the bytes to be written
+   * @return             kTooLarge if the bytes don't fit in the value;
+   *                     otherwise, kSuccess, kDataCorrupted, or an I/O error
+   */
+  static Status Write(TransactionImpl* transaction,
+                      span<const uint8_t> reference, size_t offset,
+                      span<const uint8_t> data);
+
+  /** Encodes a reference to a record.
+   *
+   * @param page_id   the ID of the page holding the record
+   * @param offset    the record's offset in the page
+   * @param reference receives the reference; must have kReferenceSize bytes
+   */
+  static void EncodeReference(size_t page_id, size_t offset,
+                              span<uint8_t> reference) noexcept;
+
+  /** Decodes a reference to a record, checking it against a store.
+   *
+   * @return status  kSuccess or kDataCorrupted
+   * @return page_id the ID of the page holding the record
+   * @return offset  the record's offset in the page
+   */
+  static std::tuple<Status, size_t, size_t> DecodeReference(
+      StoreImpl* store, span<const uint8_t> reference) noexcept;
+
+  /** Decodes the record at a given offset in a log page.
+   *
+   * @param  page   a log page
+   * @param  offset the record's offset in the page
+   * @return status kSuccess or kDataCorrupted
+   * @return key    the record's key
+   * @return value  the record's value
+   */
+  static std::tuple<Status, span<const uint8_t>, span<const uint8_t>>
+  DecodeRecord(span<const uint8_t> page, size_t offset) noexcept;
+
+  /** The offset past the last record in a log page. */
+  static size_t PageEnd(span<const uint8_t> page) noexcept;
+
+  /** The oldest and newest segments in the log.
+   *
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return oldest_id   the first page ID of the oldest segment; 0 if the log
+   *                     is empty
+   * @return newest_id   the first page ID of the newest segment
+   */
+  std::tuple<Status, size_t, size_t> Segments(
+      TransactionImpl* transaction) const;
+
+  /** Moves the oldest segment to the list of reusable segments.
+   *
+   * The segment must not hold any live records, and must not be the newest
+   * segment.
+   *
+   * @return kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status RecycleOldestSegment(TransactionImpl* transaction);
+
+  /** Frees the log's header page and segments when the transaction commits.
+   *
+   * The reusable segments are freed together with the log's chain.
+   *
+   * @return kSuccess, kDataCorrupted, or an I/O error
+   */
+  Status Free(TransactionImpl* transaction) const;
+
+ private:
+  /** Obtains a segment for appends, reusing a compacted segment if possible.
+   *
+   * The segment's pages are zeroed.
+   *
+   * @param  transaction the transaction that modifies the log
+   * @param  header      the log's header page; the list of reusable segments
+   *                     is updated
+   * @return status      kSuccess, kDataCorrupted, or an I/O error
+   * @return segment_id  the first page ID of the segment
+   */
+  std::tuple<Status, size_t> TakeSegment(TransactionImpl* transaction,
+                                         span<uint8_t> header);
+
+  size_t header_page_id_;
+  size_t threshold_;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_VALUE_LOG_H_
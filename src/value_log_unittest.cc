@@ -0,0 +1,391 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./value_log.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "berrydb/catalog.h"
+#include "berrydb/cursor.h"
+#include "berrydb/options.h"
+#include "berrydb/read_transaction.h"
+#include "berrydb/space.h"
+#include "berrydb/status.h"
+#include "berrydb/store.h"
+#include "berrydb/transaction.h"
+#include "./space_impl.h"
+#include "./test/space_helpers.h"
+#include "./transaction_impl.h"
+#include "./util/unique_ptr.h"
+
+namespace berrydb {
+
+namespace {
+
+/** A value of a given size that depends on a seed. */
+std::string TestValue(size_t size, int seed) {
+  std::string value(size, 'a');
+  for (size_t i = 0; i < size; ++i)
+    value[i] = static_cast<char>('a' + (i * 7 + seed) % 26);
+  return value;
+}
+
+}  // namespace
+
+TEST(ValueLogTest, ShouldStore) {
+  const ValueLog value_log(1, 100);
+  EXPECT_FALSE(value_log.ShouldStore(10, 99, 4096));
+  EXPECT_TRUE(value_log.ShouldStore(10, 100, 4096));
+  EXPECT_TRUE(value_log.ShouldStore(
+      10, 4096 - ValueLog::kPageHeaderSize - ValueLog::kRecordHeaderSize - 10,
+      4096));
+  EXPECT_FALSE(value_log.ShouldStore(
+      10, 4097 - ValueLog::kPageHeaderSize - ValueLog::kRecordHeaderSize - 10,
+      4096));
+  EXPECT_FALSE(value_log.ShouldStore(10, 0x10000, 1 << 20));
+  EXPECT_FALSE(ValueLog().ShouldStore(10, 1000, 4096));
+}
+
+TEST(ValueLogTest, DecodeRecord) {
+  alignas(8) uint8_t page[64] = {};
+  EXPECT_EQ(ValueLog::kPageHeaderSize,
+            ValueLog::PageEnd(span<const uint8_t>(page)));
+
+  // A record with a 3-byte key and a 5-byte value.
+  page[0] = 12;
+  page[16] = 3;
+  page[18] = 5;
+  for (size_t i = 0; i < 8; ++i)
+    page[20 + i] = static_cast<uint8_t>('a' + i);
+  EXPECT_EQ(28U, ValueLog::PageEnd(span<const uint8_t>(page)));
+
+  Status status;
+  span<const uint8_t> key, value;
+  std::tie(status, key, value) =
+      ValueLog::DecodeRecord(span<const uint8_t>(page), 16);
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ("abc", SpanString(key));
+  EXPECT_EQ("defgh", SpanString(value));
+
+  std::tie(status, key, value) =
+      ValueLog::DecodeRecord(span<const uint8_t>(page), 28);
+  EXPECT_EQ(Status::kDataCorrupted, status);
+  page[18] = 6;
+  std::tie(status, key, value) =
+      ValueLog::DecodeRecord(span<const uint8_t>(page), 16);
+  EXPECT_EQ(Status::kDataCorrupted, status);
+}
+
+class ValueLogSpaceTest : public SpaceTest {
+ protected:
+  ValueLogSpaceTest() : SpaceTest("test_value_log.berry") {}
+
+  void SetUp() override {
+    SpaceTest::SetUp();
+    OpenStore();
+  }
+
+  /** Creates a space with a value log, and commits its creation. */
+  void CreateSpace(const std::string& name, size_t threshold) {
+    space_options_.value_log_threshold = threshold;
+    SpaceTest::CreateSpace(name);
+  }
+
+  /** The oldest and newest segments in the space's value log. */
+  std::tuple<size_t, size_t> Segments() {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    const ValueLog& value_log =
+        SpaceImpl::FromApi(space_.get())->tree()->value_log();
+    Status status;
+    size_t oldest_segment_id, newest_segment_id;
+    std::tie(status, oldest_segment_id, newest_segment_id) =
+        value_log.Segments(TransactionImpl::FromApi(transaction.get()));
+    EXPECT_EQ(Status::kSuccess, status);
+    EXPECT_EQ(Status::kSuccess, transaction->Rollback());
+    return {oldest_segment_id, newest_segment_id};
+  }
+};
+
+TEST_F(ValueLogSpaceTest, PutGetDelete) {
+  CreateSpace("space", 100);
+  ASSERT_TRUE(SpaceImpl::FromApi(space_.get())->has_value_log());
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  const std::string small_value = "small";
+  const std::string logged_value = TestValue(1000, 1);
+  const std::string large_value = TestValue(10000, 2);
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("small"), StringSpan(small_value)));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("logged"), StringSpan(logged_value)));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("large"), StringSpan(large_value)));
+  EXPECT_EQ(small_value, Get(transaction.get(), "small"));
+  EXPECT_EQ(logged_value, Get(transaction.get(), "logged"));
+  EXPECT_EQ(large_value, Get(transaction.get(), "large"));
+
+  // Overwriting a logged value with a small one stores it in the leaf.
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("logged"), StringSpan("now small")));
+  EXPECT_EQ("now small", Get(transaction.get(), "logged"));
+  ASSERT_EQ(Status::kSuccess, transaction->Put(
+      space_.get(), StringSpan("small"), StringSpan(logged_value)));
+  EXPECT_EQ(logged_value, Get(transaction.get(), "small"));
+
+  ASSERT_EQ(Status::kSuccess,
+            transaction->Delete(space_.get(), StringSpan("small")));
+  EXPECT_EQ("(missing)", Get(transaction.get(), "small"));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  EXPECT_EQ("now small", Get(reader.get(), "logged"));
+  EXPECT_EQ(large_value, Get(reader.get(), "large"));
+  EXPECT_EQ("(missing)", Get(reader.get(), "small"));
+}
+
+TEST_F(ValueLogSpaceTest, ReserveWriteReadValue) {
+  CreateSpace("space", 100);
+
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  ASSERT_EQ(Status::kSuccess, transaction->ReserveValue(
+      space_.get(), StringSpan("key"), 500));
+  EXPECT_EQ(std::string(500, '\0'), Get(transaction.get(), "key"));
+  ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+      space_.get(), StringSpan("key"), 495, StringSpan("hello")));
+  EXPECT_EQ(Status::kTooLarge, transaction->WriteValue(
+      space_.get(), StringSpan("key"), 496, StringSpan("hello")));
+
+  uint8_t buffer[8];
+  Status status;
+  size_t value_size;
+  std::tie(status, value_size) = transaction->ReadValue(
+      space_.get(), StringSpan("key"), 493, span<uint8_t>(buffer));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(500U, value_size);
+  EXPECT_EQ(std::string(2, '\0') + "hello",
+            SpanString(span<const uint8_t>(buffer, 7)));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  std::tie(status, value_size) = reader->ReadValue(
+      space_.get(), StringSpan("key"), 495, span<uint8_t>(buffer));
+  ASSERT_EQ(Status::kSuccess, status);
+  EXPECT_EQ(500U, value_size);
+  EXPECT_EQ("hello", SpanString(span<const uint8_t>(buffer, 5)));
+}
+
+TEST_F(ValueLogSpaceTest, LogSurvivesReopening) {
+  CreateSpace("space", 100);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 200; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)),
+          StringSpan(TestValue(300 + i, i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  space_.reset();
+  store_.reset();
+  OpenStore();
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) =
+      store_->RootCatalog()->OpenSpace(StringSpan("space"));
+  ASSERT_EQ(Status::kSuccess, status);
+  space_.reset(raw_space);
+  ASSERT_TRUE(SpaceImpl::FromApi(space_.get())->has_value_log());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < 200; ++i)
+    ASSERT_EQ(TestValue(300 + i, i), Get(reader.get(), std::to_string(i)));
+}
+
+TEST_F(ValueLogSpaceTest, CompactionKeepsLiveValuesAndReusesSegments) {
+  CreateSpace("space", 100);
+
+  // Each 4KB log page holds 3 of these records, so the values span several
+  // 16-page segments.
+  for (int round = 0; round < 4; ++round) {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)),
+          StringSpan(TestValue(1200, round * 100 + i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 100; i += 2) {
+      ASSERT_EQ(Status::kSuccess, transaction->Delete(
+          space_.get(), StringSpan(std::to_string(i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  size_t oldest_segment_id, newest_segment_id;
+  std::tie(oldest_segment_id, newest_segment_id) = Segments();
+  ASSERT_NE(oldest_segment_id, newest_segment_id);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->CompactValueLog(space_.get()));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  size_t compacted_oldest_segment_id, compacted_newest_segment_id;
+  std::tie(compacted_oldest_segment_id, compacted_newest_segment_id) =
+      Segments();
+  EXPECT_EQ(newest_segment_id, compacted_oldest_segment_id);
+
+  {
+    UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+    for (int i = 0; i < 100; ++i) {
+      const std::string expected =
+          (i % 2 == 0) ? "(missing)" : TestValue(1200, 300 + i);
+      ASSERT_EQ(expected, Get(reader.get(), std::to_string(i))) << i;
+    }
+  }
+
+  // Rewriting the values uses the compacted segments instead of growing the
+  // store.
+  const size_t page_count = StorePageCount();
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan(std::to_string(i)),
+          StringSpan(TestValue(1200, 500 + i))));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  EXPECT_EQ(page_count, StorePageCount());
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(TestValue(1200, 500 + i), Get(reader.get(), std::to_string(i)));
+}
+
+TEST_F(ValueLogSpaceTest, RolledBackAppendsAreUndone) {
+  CreateSpace("space", 100);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan(TestValue(500, 1))));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan(TestValue(500, 2))));
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("other"), StringSpan(TestValue(500, 3))));
+    ASSERT_EQ(Status::kSuccess, transaction->Rollback());
+  }
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("other"), StringSpan(TestValue(500, 4))));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  EXPECT_EQ(TestValue(500, 1), Get(reader.get(), "key"));
+  EXPECT_EQ(TestValue(500, 4), Get(reader.get(), "other"));
+}
+
+TEST_F(ValueLogSpaceTest, ReadTransactionsSeeSnapshots) {
+  CreateSpace("space", 100);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("key"), StringSpan(TestValue(500, 1))));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> old_reader(store_->CreateReadTransaction());
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    ASSERT_EQ(Status::kSuccess, transaction->WriteValue(
+        space_.get(), StringSpan("key"), 0, StringSpan("changed")));
+    ASSERT_EQ(Status::kSuccess, transaction->Put(
+        space_.get(), StringSpan("new"), StringSpan(TestValue(500, 2))));
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  EXPECT_EQ(TestValue(500, 1), Get(old_reader.get(), "key"));
+  EXPECT_EQ("(missing)", Get(old_reader.get(), "new"));
+  UniquePtr<ReadTransaction> new_reader(store_->CreateReadTransaction());
+  EXPECT_EQ("changed" + TestValue(500, 1).substr(7),
+            Get(new_reader.get(), "key"));
+  EXPECT_EQ(TestValue(500, 2), Get(new_reader.get(), "new"));
+}
+
+TEST_F(ValueLogSpaceTest, CursorsReadLoggedValues) {
+  CreateSpace("space", 100);
+  {
+    UniquePtr<Transaction> transaction(store_->CreateTransaction());
+    for (int i = 0; i < 50; ++i) {
+      const std::string value =
+          (i % 2 == 0) ? std::to_string(i) : TestValue(400, i);
+      ASSERT_EQ(Status::kSuccess, transaction->Put(
+          space_.get(), StringSpan("key" + std::to_string(100 + i)),
+          StringSpan(value)));
+    }
+    ASSERT_EQ(Status::kSuccess, transaction->Commit());
+  }
+
+  UniquePtr<ReadTransaction> reader(store_->CreateReadTransaction());
+  UniquePtr<Cursor> cursor(reader->CreateCursor(space_.get()));
+  ASSERT_EQ(Status::kSuccess, cursor->SeekToFirst());
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_TRUE(cursor->Valid());
+    EXPECT_EQ("key" + std::to_string(100 + i), SpanString(cursor->key()));
+    Status status;
+    span<const uint8_t> value;
+    std::tie(status, value) = cursor->Value();
+    ASSERT_EQ(Status::kSuccess, status);
+    EXPECT_EQ((i % 2 == 0) ? std::to_string(i) : TestValue(400, i),
+              SpanString(value));
+    ASSERT_EQ(Status::kSuccess, cursor->Next());
+  }
+  EXPECT_FALSE(cursor->Valid());
+}
+
+TEST_F(ValueLogSpaceTest, UnsupportedOptions) {
+  UniquePtr<Transaction> transaction(store_->CreateTransaction());
+  SpaceOptions options;
+  options.value_log_threshold = 100;
+  options.hashed = true;
+  Status status;
+  Space* raw_space;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("hashed"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+
+  options.hashed = false;
+  options.integer_key_size = 8;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("integer"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+
+  options.integer_key_size = 0;
+  options.value_log_threshold = 0x10000;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("threshold"), options);
+  EXPECT_EQ(Status::kNotSupported, status);
+
+  options.value_log_threshold = 0;
+  std::tie(status, raw_space) = transaction->CreateSpace(
+      store_->RootCatalog(), StringSpan("plain"), options);
+  ASSERT_EQ(Status::kSuccess, status);
+  UniquePtr<Space> plain_space(raw_space);
+  EXPECT_EQ(Status::kNotSupported,
+            transaction->CompactValueLog(plain_space.get()));
+  ASSERT_EQ(Status::kSuccess, transaction->Commit());
+}
+
+}  // namespace berrydb
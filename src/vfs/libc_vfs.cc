@@ -15,6 +15,12 @@
 #include <cstdio>
 #include <tuple>
 
+#if defined(_WIN32) || defined(WIN32)
+#include <io.h>
+#else  // defined(_WIN32) || defined(WIN32)
+#include <unistd.h>
+#endif  // defined(_WIN32) || defined(WIN32)
+
 #include "berrydb/platform.h"
 #include "berrydb/status.h"
 #include "../util/checks.h"
@@ -100,10 +106,21 @@ Status WriteLibcFile(std::FILE* fp, span<const uint8_t> data, size_t offset) {
 }
 
 Status SyncLibcFile(std::FILE* fp) {
-  // HACK(pwnall): fflush() does not have the guarantees we require, but is
-  //               the closest that the C/C++ standard has to offer.
-  // This should use fdatasync() on POSIX and FlushFileBuffers() on Windows.
-  return (std::fflush(fp) == 0) ? Status::kSuccess : Status::kIoError;
+  if (std::fflush(fp) != 0)
+    return Status::kIoError;
+
+#if defined(_WIN32) || defined(WIN32)
+  const int sync_result = _commit(_fileno(fp));
+#elif defined(__APPLE__)
+  // macOS does not implement fdatasync().
+  const int sync_result = fsync(fileno(fp));
+#else
+  // fdatasync() skips metadata that is not needed to read the file back, such
+  // as the modification time. Log files are preallocated, so commits do not
+  // change the file size, and syncing them only flushes data.
+  const int sync_result = fdatasync(fileno(fp));
+#endif  // defined(_WIN32) || defined(WIN32)
+  return (sync_result == 0) ? Status::kSuccess : Status::kIoError;
 }
 
 }  // namespace
@@ -124,18 +141,18 @@ class LibcBlockAccessFile : public BlockAccessFile {
   }
 
   Status Read(size_t offset, span<uint8_t> buffer) override {
-    BERRYDB_ASSUME_EQ(buffer.size() & (buffer.size() - 1), 0U);
 #if BERRYDB_CHECK_IS_ON()
     BERRYDB_ASSUME_EQ(offset & (block_size_ - 1), 0U);
+    BERRYDB_ASSUME_EQ(buffer.size() & (block_size_ - 1), 0U);
 #endif  // BERRYDB_CHECK_IS_ON()
 
     return ReadLibcFile(fp_, offset, buffer);
   }
 
   Status Write(span<const uint8_t> data, size_t offset) override {
-    BERRYDB_ASSUME_EQ(data.size() & (data.size() - 1), 0U);
 #if BERRYDB_CHECK_IS_ON()
     BERRYDB_CHECK_EQ(offset & (block_size_ - 1), 0U);
+    BERRYDB_CHECK_EQ(data.size() & (block_size_ - 1), 0U);
 #endif  // BERRYDB_CHECK_IS_ON()
 
     return WriteLibcFile(fp_, data, offset);
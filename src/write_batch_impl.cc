@@ -0,0 +1,138 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./write_batch_impl.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "berrydb/platform.h"
+#include "./util/span_util.h"
+
+namespace berrydb {
+
+static_assert(std::is_standard_layout<WriteBatchImpl>::value,
+    "WriteBatchImpl must be a standard layout type so its public API can be "
+    "exposed cheaply");
+
+namespace {
+
+/** The alignment of the operation headers in the arena. */
+constexpr size_t kArenaAlignment = alignof(void*);
+
+/** Rounds a size up to the alignment of the operation headers. */
+inline constexpr size_t AlignArenaSize(size_t size) noexcept {
+  return (size + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+}
+
+/** The smallest arena allocated by a batch. */
+constexpr size_t kMinArenaCapacity = 256;
+
+}  // namespace
+
+WriteBatchImpl* WriteBatchImpl::Create() {
+  void* const heap_block = Allocate(sizeof(WriteBatchImpl));
+  WriteBatchImpl* const batch = new (heap_block) WriteBatchImpl();
+  BERRYDB_ASSUME_EQ(heap_block, static_cast<void*>(batch));
+  return batch;
+}
+
+void WriteBatchImpl::Release() {
+  this->~WriteBatchImpl();
+  void* const heap_block = static_cast<void*>(this);
+  Deallocate(heap_block, sizeof(WriteBatchImpl));
+}
+
+WriteBatchImpl::WriteBatchImpl() noexcept = default;
+
+WriteBatchImpl::~WriteBatchImpl() {
+  if (arena_ != nullptr)
+    Deallocate(arena_, arena_capacity_);
+}
+
+void WriteBatchImpl::Put(SpaceImpl* space, span<const uint8_t> key,
+                         span<const uint8_t> value) {
+  Append(OperationType::kPut, space, key, value);
+}
+
+void WriteBatchImpl::Delete(SpaceImpl* space, span<const uint8_t> key) {
+  Append(OperationType::kDelete, space, key, span<const uint8_t>());
+}
+
+void WriteBatchImpl::Append(OperationType type, SpaceImpl* space,
+                            span<const uint8_t> key,
+                            span<const uint8_t> value) {
+  BERRYDB_ASSUME(space != nullptr);
+
+  const size_t operation_size = AlignArenaSize(
+      sizeof(OperationHeader) + key.size() + value.size());
+  const size_t new_arena_size = arena_size_ + operation_size;
+  if (new_arena_size > arena_capacity_) {
+    size_t new_capacity = std::max(arena_capacity_ * 2, kMinArenaCapacity);
+    while (new_capacity < new_arena_size)
+      new_capacity *= 2;
+    uint8_t* const new_arena =
+        reinterpret_cast<uint8_t*>(Allocate(new_capacity));
+    if (arena_ != nullptr) {
+      std::memcpy(new_arena, arena_, arena_size_);
+      Deallocate(arena_, arena_capacity_);
+    }
+    arena_ = new_arena;
+    arena_capacity_ = new_capacity;
+  }
+
+  uint8_t* const operation = arena_ + arena_size_;
+  OperationHeader* const header = new (operation) OperationHeader();
+  header->space = space;
+  header->key_size = key.size();
+  header->value_size = value.size();
+  header->type = type;
+  uint8_t* const key_data = operation + sizeof(OperationHeader);
+  CopySpan(key, span<uint8_t>(key_data, key.size()));
+  CopySpan(value, span<uint8_t>(key_data + key.size(), value.size()));
+
+  arena_size_ = new_arena_size;
+  ++operation_count_;
+}
+
+void WriteBatchImpl::SortedOperations(
+    std::vector<Operation, PlatformAllocator<Operation>>* operations) const {
+  BERRYDB_ASSUME(operations != nullptr);
+
+  operations->clear();
+  operations->reserve(operation_count_);
+  size_t offset = 0;
+  while (offset < arena_size_) {
+    const OperationHeader* const header =
+        reinterpret_cast<const OperationHeader*>(arena_ + offset);
+    const uint8_t* const key_data =
+        arena_ + offset + sizeof(OperationHeader);
+    operations->push_back({
+        header->type, header->space,
+        span<const uint8_t>(key_data, header->key_size),
+        span<const uint8_t>(key_data + header->key_size, header->value_size)});
+    offset += AlignArenaSize(
+        sizeof(OperationHeader) + header->key_size + header->value_size);
+  }
+  BERRYDB_ASSUME_EQ(offset, arena_size_);
+  BERRYDB_ASSUME_EQ(operations->size(), operation_count_);
+
+  // Spaces are ordered by address. Any consistent order works, because the
+  // operations on different spaces don't interact.
+  std::stable_sort(
+      operations->begin(), operations->end(),
+      [](const Operation& lhs, const Operation& rhs) {
+        if (lhs.space != rhs.space)
+          return std::less<const SpaceImpl*>()(lhs.space, rhs.space);
+        const size_t common_size = std::min(lhs.key.size(), rhs.key.size());
+        const int compare = (common_size == 0) ? 0 :
+            std::memcmp(lhs.key.data(), rhs.key.data(), common_size);
+        if (compare != 0)
+          return compare < 0;
+        return lhs.key.size() < rhs.key.size();
+      });
+}
+
+}  // namespace berrydb
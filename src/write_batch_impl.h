@@ -0,0 +1,122 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BERRYDB_WRITE_BATCH_IMPL_H_
+#define BERRYDB_WRITE_BATCH_IMPL_H_
+
+#include <vector>
+
+#include "berrydb/span.h"
+#include "berrydb/write_batch.h"
+#include "./util/checks.h"
+#include "./util/platform_allocator.h"
+
+namespace berrydb {
+
+class SpaceImpl;
+
+/** Internal representation for the WriteBatch class in the public API.
+ *
+ * The operations are encoded back to back in a single arena buffer, so adding
+ * an operation usually costs a copy, and a batch with thousands of small keys
+ * only needs a handful of allocations. Each operation is an OperationHeader,
+ * followed by the key and the value, padded to keep the headers aligned.
+ */
+class WriteBatchImpl {
+ public:
+  /** The kinds of operations in a batch. */
+  enum class OperationType : uint8_t {
+    kPut = 0,
+    kDelete = 1,
+  };
+
+  /** A decoded operation. The spans point into the batch's arena. */
+  struct Operation {
+    OperationType type;
+    SpaceImpl* space;
+    span<const uint8_t> key;
+    /** Empty for kDelete operations. */
+    span<const uint8_t> value;
+  };
+
+  /** Create a WriteBatchImpl instance. */
+  static WriteBatchImpl* Create();
+
+  WriteBatchImpl(const WriteBatchImpl&) = delete;
+  WriteBatchImpl(WriteBatchImpl&&) = delete;
+  WriteBatchImpl& operator=(const WriteBatchImpl&) = delete;
+  WriteBatchImpl& operator=(WriteBatchImpl&&) = delete;
+
+  /** Computes the internal representation for a pointer from the public API. */
+  static inline WriteBatchImpl* FromApi(WriteBatch* api) noexcept {
+    WriteBatchImpl* const impl = reinterpret_cast<WriteBatchImpl*>(api);
+    BERRYDB_ASSUME_EQ(api, &impl->api_);
+    return impl;
+  }
+  /** Computes the internal representation for a pointer from the public API. */
+  static inline const WriteBatchImpl* FromApi(const WriteBatch* api) noexcept {
+    const WriteBatchImpl* const impl =
+        reinterpret_cast<const WriteBatchImpl*>(api);
+    BERRYDB_ASSUME_EQ(api, &impl->api_);
+    return impl;
+  }
+
+  /** Computes the public API representation for this batch. */
+  inline constexpr WriteBatch* ToApi() noexcept { return &api_; }
+
+  /** Decodes the batch's operations, sorted by space and key.
+   *
+   * Operations on the same key keep the order in which they were added.
+   *
+   * @param operations receives the operations; existing content is replaced
+   */
+  void SortedOperations(
+      std::vector<Operation, PlatformAllocator<Operation>>* operations) const;
+
+  // See the public API documention for details.
+  void Put(SpaceImpl* space, span<const uint8_t> key,
+           span<const uint8_t> value);
+  void Delete(SpaceImpl* space, span<const uint8_t> key);
+  inline void Clear() noexcept {
+    arena_size_ = 0;
+    operation_count_ = 0;
+  }
+  inline constexpr size_t OperationCount() const noexcept {
+    return operation_count_;
+  }
+  inline constexpr size_t ByteSize() const noexcept { return arena_size_; }
+  void Release();
+
+ private:
+  /** Precedes each operation's key and value in the arena. */
+  struct OperationHeader {
+    SpaceImpl* space;
+    size_t key_size;
+    size_t value_size;
+    OperationType type;
+  };
+
+  /** Use WriteBatchImpl::Create() to obtain WriteBatchImpl instances. */
+  WriteBatchImpl() noexcept;
+  /** Use Release() to destroy WriteBatchImpl instances. */
+  ~WriteBatchImpl();
+
+  /** Appends an operation to the arena. */
+  void Append(OperationType type, SpaceImpl* space, span<const uint8_t> key,
+              span<const uint8_t> value);
+
+  /* The public API version of this class. */
+  WriteBatch api_;  // Must be the first class member.
+
+  /** The encoded operations. Grown by doubling. */
+  uint8_t* arena_ = nullptr;
+  size_t arena_capacity_ = 0;
+  size_t arena_size_ = 0;
+
+  size_t operation_count_ = 0;
+};
+
+}  // namespace berrydb
+
+#endif  // BERRYDB_WRITE_BATCH_IMPL_H_
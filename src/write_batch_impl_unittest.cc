@@ -0,0 +1,150 @@
+// Copyright 2018 The BerryDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "./write_batch_impl.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "berrydb/span.h"
+#include "./space_impl.h"
+
+#include "gtest/gtest.h"
+
+namespace berrydb {
+
+class WriteBatchImplTest : public ::testing::Test {
+ protected:
+  using Operation = WriteBatchImpl::Operation;
+  using OperationType = WriteBatchImpl::OperationType;
+
+  void SetUp() override {
+    batch_ = WriteBatchImpl::Create();
+    space1_ = SpaceImpl::Create(1, CatalogImpl::EntryType::kSpace,
+                                BloomFilter(), ValueLog());
+    space2_ = SpaceImpl::Create(2, CatalogImpl::EntryType::kSpace,
+                                BloomFilter(), ValueLog());
+  }
+  void TearDown() override {
+    batch_->Release();
+    space1_->Release();
+    space2_->Release();
+  }
+
+  static span<const uint8_t> Bytes(const std::string& string) {
+    return span<const uint8_t>(
+        reinterpret_cast<const uint8_t*>(string.data()), string.size());
+  }
+  static std::string String(span<const uint8_t> bytes) {
+    return std::string(reinterpret_cast<const char*>(bytes.data()),
+                       bytes.size());
+  }
+
+  WriteBatchImpl* batch_;
+  SpaceImpl* space1_;
+  SpaceImpl* space2_;
+  std::vector<Operation, PlatformAllocator<Operation>> operations_;
+};
+
+TEST_F(WriteBatchImplTest, EmptyBatch) {
+  EXPECT_EQ(0U, batch_->OperationCount());
+  EXPECT_EQ(0U, batch_->ByteSize());
+
+  batch_->SortedOperations(&operations_);
+  EXPECT_TRUE(operations_.empty());
+}
+
+TEST_F(WriteBatchImplTest, PutAndDelete) {
+  batch_->Put(space1_, Bytes("key"), Bytes("value"));
+  batch_->Delete(space1_, Bytes("gone"));
+  EXPECT_EQ(2U, batch_->OperationCount());
+  EXPECT_LT(0U, batch_->ByteSize());
+
+  batch_->SortedOperations(&operations_);
+  ASSERT_EQ(2U, operations_.size());
+  EXPECT_EQ(OperationType::kDelete, operations_[0].type);
+  EXPECT_EQ(space1_, operations_[0].space);
+  EXPECT_EQ("gone", String(operations_[0].key));
+  EXPECT_TRUE(operations_[0].value.empty());
+  EXPECT_EQ(OperationType::kPut, operations_[1].type);
+  EXPECT_EQ(space1_, operations_[1].space);
+  EXPECT_EQ("key", String(operations_[1].key));
+  EXPECT_EQ("value", String(operations_[1].value));
+}
+
+TEST_F(WriteBatchImplTest, SortsBySpaceThenKey) {
+  SpaceImpl* const low_space = std::less<SpaceImpl*>()(space1_, space2_) ?
+      space1_ : space2_;
+  SpaceImpl* const high_space = (low_space == space1_) ? space2_ : space1_;
+
+  batch_->Put(high_space, Bytes("a"), Bytes("1"));
+  batch_->Put(low_space, Bytes("bb"), Bytes("2"));
+  batch_->Put(low_space, Bytes("b"), Bytes("3"));
+  batch_->Put(low_space, Bytes(""), Bytes("4"));
+  batch_->Put(low_space, Bytes("ab"), Bytes("5"));
+
+  batch_->SortedOperations(&operations_);
+  ASSERT_EQ(5U, operations_.size());
+  EXPECT_EQ(low_space, operations_[0].space);
+  EXPECT_EQ("", String(operations_[0].key));
+  EXPECT_EQ(low_space, operations_[1].space);
+  EXPECT_EQ("ab", String(operations_[1].key));
+  EXPECT_EQ(low_space, operations_[2].space);
+  EXPECT_EQ("b", String(operations_[2].key));
+  EXPECT_EQ(low_space, operations_[3].space);
+  EXPECT_EQ("bb", String(operations_[3].key));
+  EXPECT_EQ(high_space, operations_[4].space);
+  EXPECT_EQ("a", String(operations_[4].key));
+}
+
+TEST_F(WriteBatchImplTest, SameKeyKeepsInsertionOrder) {
+  batch_->Put(space1_, Bytes("key"), Bytes("first"));
+  batch_->Put(space1_, Bytes("other"), Bytes("other"));
+  batch_->Delete(space1_, Bytes("key"));
+  batch_->Put(space1_, Bytes("key"), Bytes("last"));
+
+  batch_->SortedOperations(&operations_);
+  ASSERT_EQ(4U, operations_.size());
+  EXPECT_EQ(OperationType::kPut, operations_[0].type);
+  EXPECT_EQ("first", String(operations_[0].value));
+  EXPECT_EQ(OperationType::kDelete, operations_[1].type);
+  EXPECT_EQ(OperationType::kPut, operations_[2].type);
+  EXPECT_EQ("last", String(operations_[2].value));
+  EXPECT_EQ("other", String(operations_[3].key));
+}
+
+TEST_F(WriteBatchImplTest, ArenaGrowth) {
+  // Enough data to outgrow the initial arena several times.
+  for (int i = 0; i < 1000; ++i) {
+    std::string key = "key" + std::to_string(100000 + i);
+    std::string value(i % 37, static_cast<char>('a' + i % 26));
+    batch_->Put(space1_, Bytes(key), Bytes(value));
+  }
+  EXPECT_EQ(1000U, batch_->OperationCount());
+
+  batch_->SortedOperations(&operations_);
+  ASSERT_EQ(1000U, operations_.size());
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ("key" + std::to_string(100000 + i), String(operations_[i].key));
+    EXPECT_EQ(std::string(i % 37, static_cast<char>('a' + i % 26)),
+              String(operations_[i].value));
+  }
+}
+
+TEST_F(WriteBatchImplTest, ClearKeepsBatchUsable) {
+  batch_->Put(space1_, Bytes("key"), Bytes("value"));
+  batch_->Clear();
+  EXPECT_EQ(0U, batch_->OperationCount());
+  EXPECT_EQ(0U, batch_->ByteSize());
+
+  batch_->Delete(space2_, Bytes("other"));
+  batch_->SortedOperations(&operations_);
+  ASSERT_EQ(1U, operations_.size());
+  EXPECT_EQ(OperationType::kDelete, operations_[0].type);
+  EXPECT_EQ(space2_, operations_[0].space);
+  EXPECT_EQ("other", String(operations_[0].key));
+}
+
+}  // namespace berrydb